@@ -38,6 +38,7 @@
 #include "hal_twim.h"
 #include "common_util.h"
 #include "log.h"
+#include "pwr_mgr.h"
 #include "nrf_util.h"
 #include "nrf_sdm.h"
 #include "ble_adv.h"
@@ -174,24 +175,6 @@ void on_connect ()
 {
     
 }
-/**
- * Different calls to sleep depending on the status of Softdevice
- */
-void slumber(void)
-{
-    uint8_t is_sd_enabled;
-    sd_softdevice_is_enabled(&is_sd_enabled);
-    // Would in the SENSING mode
-    if(is_sd_enabled == 0)
-    {
-        __WFI();
-    }
-    else
-    {
-        sd_app_evt_wait();
-    }
-}
-
 /**
  * @brief Function for application main entry.
  */
@@ -216,7 +199,7 @@ int main(void)
     ms_timer_start (MS_TIMER1, MS_REPEATED_CALL, MS_TIMER_TICKS_MS(100), ms_timer_handler);
     while (true)
     {
-        slumber ();
+        pwr_mgr_sleep ();
     }
 }
 
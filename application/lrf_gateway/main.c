@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
 #include "math.h"
 
 #include "nrf.h"
@@ -41,9 +42,14 @@
 #include "hal_nop_delay.h"
 #include "log.h"
 #include "nrf_util.h"
+#include "irq_msg_util.h"
+#include "evt_sched.h"
 
 #include "rf_comm.h"
 #include "rf_spi_hw.h"
+#include "rf_link_table.h"
+#include "rf_link_adapt.h"
+#include "rf_link_arq.h"
 #include "byte_frame.h"
 #include "aa_aaa_battery_check.h"
 
@@ -81,6 +87,22 @@ uint16_t start_pkt_no = 0;
 
 #define TEST_DURATION_MS TEST_DURATION_S*1000
 
+/** Period of the summary of the link quality of the nodes */
+#define LINK_SUMMARY_PERIOD_S 300
+
+/** First byte of a summary frame, which can't be the RSSI of a packet */
+#define LINK_SUMMARY_MARKER 0x7F
+
+/** Nodes in a summary frame, each of @ref LINK_SUMMARY_NODE_LEN bytes */
+#define LINK_SUMMARY_NODES_PER_FRAME 3
+#define LINK_SUMMARY_NODE_LEN 10
+
+/** Size of a frame after the byte_frame encoding */
+#define ENCODED_FRAME_SIZE (2*32 + 2)
+
+/** Packets received which wait to be sent to the host. A power of 2 */
+#define HOST_PKT_QUEUE_LEN 8
+
 typedef enum
 {
     GSM_GATEWAY_PKT = 2,
@@ -90,6 +112,26 @@ typedef enum
 
 //static volatile bool rx_started = false;
 
+/** Payload of the feedback packet to the nodes of the packets received */
+static uint8_t g_arr_feedback[RF_LINK_FEEDBACK_MAX_ENTRIES*RF_LINK_FEEDBACK_ENTRY_LEN];
+static uint32_t g_feedback_entries;
+static uint32_t g_feedback_len;
+
+/** Time since the boot in s */
+static volatile uint32_t g_uptime_s = 0;
+
+/** The packets received with their RSSI before them, queued by the radio
+ *  interrupt and sent to the host from the main loop */
+static struct
+{
+    uint8_t data[32];
+    uint8_t len;
+}g_host_pkts[HOST_PKT_QUEUE_LEN];
+static volatile uint32_t g_host_pkt_head;
+static volatile uint32_t g_host_pkt_tail;
+/** Packets not sent to the host as the queue was full */
+static volatile uint32_t g_host_pkt_dropped;
+
 //static mod_ble_data_t ble_data;
 
 
@@ -103,6 +145,7 @@ typedef enum
 
 void rx_failed_handler (uint32_t error);
 void rx_done_handler (uint32_t size);
+void tx_done_handler (uint32_t status);
 
 static rf_spi_init_t gc_spi_hw= 
 {
@@ -135,6 +178,8 @@ static rf_comm_radio_t gc_radio_params =
     .irq_priority = APP_IRQ_PRIORITY_LOW,
     .rf_rx_done_handler = rx_done_handler,
     .rf_rx_failed_handler = rx_failed_handler,
+    .rf_tx_done_handler = tx_done_handler,
+    .rf_tx_failed_handler = tx_done_handler,
 };
 
 
@@ -182,7 +227,7 @@ void byte_frame_done(const uint8_t * encoded_data,uint16_t len)
 
 #ifdef LOG_TEENSY
 //    hal_gpio_pin_toggle (13);
-    uint8_t p_data[16];
+    uint8_t p_data[ENCODED_FRAME_SIZE];
     memcpy (p_data, encoded_data, len);
     hal_uart_putdata (p_data, len);
         
@@ -195,8 +240,112 @@ void byte_frame_done(const uint8_t * encoded_data,uint16_t len)
 #endif
 }
 
+/**
+ * Send the link quality of all the nodes heard, in frames of
+ * | 0x7F | Nodes | Node 1 | ... |
+ * with each node as
+ * | Dev ID | RSSI | LQI | Loss % | Rx Pkts | Age | Freq offset |
+ * |   2B   |  1B  | 1B  |   1B   |   2B    | 1B  |     2B      |
+ * with the RSSI in dBm, the age since last heard in minutes and the
+ * frequency offset of the node in signed steps of 10 Hz. The counts
+ * saturate at their maximum.
+ */
+static void link_summary_send (uint32_t uptime_s)
+{
+    uint8_t l_arr_frame[2 + LINK_SUMMARY_NODES_PER_FRAME*LINK_SUMMARY_NODE_LEN];
+    uint32_t l_nodes = 0;
+    rf_link_stats_t l_stats;
+
+    for(uint32_t slot = 0; slot < RF_LINK_TABLE_SIZE; slot++)
+    {
+        bool l_is_used;
+        CRITICAL_REGION_ENTER();
+        l_is_used = rf_link_table_read (slot, &l_stats);
+        CRITICAL_REGION_EXIT();
+        if(l_is_used == false)
+        {
+            continue;
+        }
+
+        uint8_t * p_node = &l_arr_frame[2 + l_nodes*LINK_SUMMARY_NODE_LEN];
+        uint32_t l_age_min = (uptime_s - l_stats.last_seen)/60;
+        int32_t l_freq_off = l_stats.freq_off_hz/10;
+        l_freq_off = (l_freq_off > INT16_MAX) ? INT16_MAX :
+                ((l_freq_off < INT16_MIN) ? INT16_MIN : l_freq_off);
+        p_node[0] = (l_stats.dev_id >> 8) & 0xFF;
+        p_node[1] = l_stats.dev_id & 0xFF;
+        p_node[2] = (uint8_t) (l_stats.rssi_x16/16);
+        p_node[3] = l_stats.lqi_x16/16;
+        p_node[4] = rf_link_loss_pct (&l_stats);
+        p_node[5] = (l_stats.rx_count > 0xFFFF) ? 0xFF : ((l_stats.rx_count >> 8) & 0xFF);
+        p_node[6] = (l_stats.rx_count > 0xFFFF) ? 0xFF : (l_stats.rx_count & 0xFF);
+        p_node[7] = (l_age_min > 0xFF) ? 0xFF : l_age_min;
+        p_node[8] = ((uint16_t) l_freq_off >> 8) & 0xFF;
+        p_node[9] = (uint16_t) l_freq_off & 0xFF;
+        l_nodes++;
+
+        if(l_nodes == LINK_SUMMARY_NODES_PER_FRAME)
+        {
+            l_arr_frame[0] = LINK_SUMMARY_MARKER;
+            l_arr_frame[1] = l_nodes;
+            encodeFrame (l_arr_frame, 2 + l_nodes*LINK_SUMMARY_NODE_LEN, byte_frame_done);
+            l_nodes = 0;
+        }
+    }
+    if(l_nodes != 0)
+    {
+        l_arr_frame[0] = LINK_SUMMARY_MARKER;
+        l_arr_frame[1] = l_nodes;
+        encodeFrame (l_arr_frame, 2 + l_nodes*LINK_SUMMARY_NODE_LEN, byte_frame_done);
+    }
+    log_printf("Link table : %d nodes, %d replaced, %d not sent\n",
+            rf_link_table_count (), rf_link_table_evictions (), g_host_pkt_dropped);
+}
+
+/** The summary is due, in the main loop as it is long and prints */
+static void next_interval_handler (uint32_t uptime_s)
+{
+    link_summary_send (uptime_s);
+}
+
+/** The gateway has no states to change */
+static void state_change_handler (uint32_t state)
+{
+}
+
+/** Send the packets queued by the radio interrupt to the host. The frames
+ *  are only sent from the main loop, so they aren't split by another. */
+static void host_pkts_send (void)
+{
+    while(g_host_pkt_tail != g_host_pkt_head)
+    {
+        uint32_t l_idx = g_host_pkt_tail % HOST_PKT_QUEUE_LEN;
+        encodeFrame (g_host_pkts[l_idx].data, g_host_pkts[l_idx].len, byte_frame_done);
+        g_host_pkt_tail++;
+    }
+}
+
+/** Sleep till an interrupt once there is nothing to send. With the
+ *  interrupts masked, one which posts after the check still ends the WFI. */
+static void idle_handler (void)
+{
+    __disable_irq ();
+    if(evt_sched_is_empty () && (g_host_pkt_tail == g_host_pkt_head))
+    {
+        __WFI ();
+    }
+    __enable_irq ();
+}
+
 void ms_timer_handler ()
 {
+    g_uptime_s++;
+    //The radio stays awake, so it is calibrated again at a send when due
+    rf_comm_cal_update (1, RF_COMM_TEMP_UNKNOWN);
+    if((g_uptime_s % LINK_SUMMARY_PERIOD_S) == 0)
+    {
+        irq_msg_push (MSG_NEXT_INTERVAL, (void *) g_uptime_s);
+    }
 //    g_arr_gsm_pkt[GSM_PKT_TYPE_POS] = GSM_GATEWAY_PKT;
 
 //    g_arr_gsm_pkt[PAYLOAD_POS] = aa_aaa_battery_status ();
@@ -218,42 +367,98 @@ void rx_failed_handler (uint32_t error)
     rf_comm_rx_enable();
 }
 
-void rx_done_handler (uint32_t size)
+/** Queue a packet received for the host with its RSSI before it and update
+ *  the link quality of its node. A packet asking for an ack is acked with
+ *  the feedback, and a packet sent again which was received before is
+ *  acked again but not sent to the host. */
+static void rx_pkt_handler (rf_comm_rx_pkt_t * p_pkt)
 {
-//    hal_gpio_pin_toggle (13);
-    uint8_t l_arr_rf_pkt[32];
-//    log_printf("%s : %d\n", __func__, size);
+    if((p_pkt->crc_ok == false) || (p_pkt->len >= sizeof(g_host_pkts[0].data))
+            || (p_pkt->len < RF_COMM_HDR_LEN))
+    {
+        return;
+    }
+    uint16_t l_dev_id = (p_pkt->p_data[RF_COMM_HDR_DEV_ID_POS] << 8)
+                | p_pkt->p_data[RF_COMM_HDR_DEV_ID_POS + 1];
+    uint8_t l_seq = p_pkt->p_data[RF_COMM_HDR_SEQ_POS];
+    uint8_t l_flags = (p_pkt->len > (RF_COMM_HDR_LEN + RF_LINK_FLAGS_POS)) ?
+            p_pkt->p_data[RF_COMM_HDR_LEN + RF_LINK_FLAGS_POS] : 0;
+    //Only a retransmission is a duplicate, not the first packet after a reset
+    bool l_is_dup = (l_flags & RF_LINK_FLAG_RETX)
+            && rf_link_table_is_dup (l_dev_id, l_seq);
+    rf_link_table_update (l_dev_id, p_pkt->p_data[RF_COMM_HDR_APP_ID_POS],
+            l_seq, p_pkt->rssi, p_pkt->lqi, g_uptime_s);
+    rf_link_table_freq_update (l_dev_id, rf_comm_get_freq_offset ());
+
+    if(l_flags & RF_LINK_FLAG_ACK_REQ)
     {
-        uint8_t pkt_len;
-        l_arr_rf_pkt[0] = rf_comm_get_rssi ();
-        rf_comm_pkt_receive (&l_arr_rf_pkt[1], &pkt_len);
-        /* Flush the RX FIFO */
-//        log_printf("Data: ");
-        for(uint32_t i =0; i < pkt_len; i++)
+        //Ack with the RSSI, the oldest entry is replaced if full
+        if(g_feedback_entries == RF_LINK_FEEDBACK_MAX_ENTRIES)
         {
-//            log_printf("%d  ", l_arr_rf_pkt[i+1]);
-//#ifdef LOG_TEENSY        
-//            log_printf("%d : ", l_lkp_cnt);
-//            hal_uart_putchar (l_arr_rf_pkt[i]);
-//            hal_uart_putchar('\n');
-//#endif
+            memmove (g_arr_feedback, &g_arr_feedback[RF_LINK_FEEDBACK_ENTRY_LEN],
+                    sizeof(g_arr_feedback) - RF_LINK_FEEDBACK_ENTRY_LEN);
+            g_feedback_entries--;
         }
-//        log_printf("\n");
-        encodeFrame (l_arr_rf_pkt, (pkt_len+1), byte_frame_done);
-//        int8_t rf_rx_rssi;
-//        rf_rx_rssi = (uint8_t)rf_comm_get_rssi ();
-//        log_printf("RSSI : %d\n", (int8_t)l_arr_rf_pkt[0]);
-//        rssi_sum += rf_rx_rssi;
+        g_feedback_len = rf_link_feedback_put (g_arr_feedback, g_feedback_entries,
+                l_dev_id, l_seq, p_pkt->rssi, rf_link_table_cmd_get (l_dev_id));
+        g_feedback_entries++;
     }
-    rf_comm_idle ();
-    rf_comm_rx_enable();
-//    else
-//    {
-//        log_printf ("*** Data not ready.\n");
-//    }
+    if(l_is_dup)
+    {
+        log_printf("Dup 0x%x : %d\n", l_dev_id, l_seq);
+        return;
+    }
+    if((g_host_pkt_head - g_host_pkt_tail) == HOST_PKT_QUEUE_LEN)
+    {
+        g_host_pkt_dropped++;
+        return;
+    }
+    uint32_t l_idx = g_host_pkt_head % HOST_PKT_QUEUE_LEN;
+    g_host_pkts[l_idx].data[0] = p_pkt->rssi;
+    memcpy (&g_host_pkts[l_idx].data[1], p_pkt->p_data, p_pkt->len);
+    g_host_pkts[l_idx].len = p_pkt->len + 1;
+    //The packet is written before the main loop can see it
+    __DMB ();
+    g_host_pkt_head++;
+}
 
-//    start_rx();
+void rx_done_handler (uint32_t size)
+{
+    //All the packets queued in the RX FIFO are sent and the radio stays in RX
+    g_feedback_entries = 0;
+    rf_comm_pkt_receive_all (rx_pkt_handler);
+    //Reply to the nodes at once, without the CSMA, and go back to RX after
+    if(g_feedback_entries != 0)
+    {
+        rf_comm_pkt_send (RF_LINK_FEEDBACK_PKT_TYPE, g_arr_feedback, g_feedback_len);
+    }
+}
+
+void tx_done_handler (uint32_t status)
+{
+    rf_comm_rx_enable ();
 }
+
+#ifdef LOG_TEENSY
+/** A line from the host as "<Dev ID> <Cmd>" in decimal or 0x hex, to send
+ *  the command to the node in the acks to it */
+static void uart_line_handler (uint8_t * p_line)
+{
+    char * p_end;
+    uint32_t l_dev_id = strtoul ((char *) p_line, &p_end, 0);
+    uint32_t l_cmd = strtoul (p_end, &p_end, 0);
+    bool l_is_set = false;
+
+    if((l_dev_id <= 0xFFFF) && (l_cmd <= 0xFF))
+    {
+        CRITICAL_REGION_ENTER();
+        l_is_set = rf_link_table_cmd_set (l_dev_id, l_cmd);
+        CRITICAL_REGION_EXIT();
+    }
+    log_printf("Cmd 0x%x : %d %s\n", l_dev_id, l_cmd, l_is_set ? "" : "not set");
+}
+#endif
+
 /**
  * @brief Function for application main entry.
  */
@@ -265,7 +470,7 @@ int main(void)
     log_printf("Hello World from RF_RX..!!\n");
 
 #ifdef LOG_TEENSY
-    hal_uart_init(HAL_UART_BAUD_1M, NULL);
+    hal_uart_init(HAL_UART_BAUD_1M, uart_line_handler);
 #endif
     
 #if DC_DC_CIRCUITRY == true  //Defined in the board header file
@@ -274,6 +479,12 @@ int main(void)
     NRF_POWER->TASKS_LOWPWR = 1;
 
     ms_timer_init(APP_IRQ_PRIORITY_LOWEST);
+    evt_sched_init (idle_handler);
+    {
+        irq_msg_callbacks cb =
+            { next_interval_handler, state_change_handler };
+        irq_msg_init (&cb);
+    }
 #ifdef TCXO_EN_PIN
     hal_gpio_cfg_output (TCXO_EN_PIN, 1);
     hal_gpio_pin_set (TCXO_EN_PIN);
@@ -294,9 +505,10 @@ int main(void)
     rf_comm_pkt_config (&pkt_config);
     rf_comm_idle ();
     
+    rf_link_table_init ();
     rf_comm_rx_enable();
     
-    ms_timer_start (MS_TIMER0, MS_REPEATED_CALL, MS_TIMER_TICKS_MS(300*1000),
+    ms_timer_start (MS_TIMER0, MS_REPEATED_CALL, MS_TIMER_TICKS_MS(1000),
                     ms_timer_handler);
     
 //    start_rx();
@@ -308,8 +520,9 @@ int main(void)
 //    NVIC_EnableIRQ (GPIOTE_IRQn);
     while(1)
     {
-//        slumber ();
-        __WFI ();
+        host_pkts_send ();
+        //Sleeps in idle_handler once the events are processed
+        irq_msg_process ();
     }
 }
 
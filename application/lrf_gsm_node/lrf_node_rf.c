@@ -121,6 +121,15 @@ static gps_mod_config_t g_gps_config;
 
 static rf_comm_hw_t g_rf_comm_hw;
 
+/** Listen before talk, as the nodes wake on similar schedules */
+static rf_comm_csma_t g_rf_comm_csma =
+{
+    .max_attempts = 8,
+    .min_backoff_ms = 20,
+    .max_backoff_ms = 2560,
+    .cca_thr_dbm = -85,
+};
+
 //function declaration
 
 /**
@@ -186,6 +195,7 @@ void node_rf_wakeup ()
     rf_comm_wake();
     log_printf("Radio ID :0x%x\n", rf_comm_get_radio_id ());
     rf_comm_radio_init (&g_rf_comm_radio, &g_rf_comm_hw);
+    rf_comm_csma_config (&g_rf_comm_csma);
 
     rf_comm_idle ();
     rf_comm_enable_irq ();
@@ -268,7 +278,10 @@ void ms_timer_handler (void)
 
 void node_rf_tx_done (uint32_t status)
 {
-    log_printf("Tx Done : %d\n", status);
+    rf_comm_csma_stats_t l_csma_stats;
+    rf_comm_get_csma_stats (&l_csma_stats);
+    log_printf("Tx Done : %d CCA %d Busy %d\n", status,
+            l_csma_stats.last_attempts, l_csma_stats.busy);
     node_rf_sleep ();
 }
 
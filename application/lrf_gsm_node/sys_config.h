@@ -60,10 +60,17 @@
 
 /** RTC used for MS_TIMER module */
 #define RTC_USED_MS_TIMER 1
+/** RTC used as the time base of the power manager, shared with MS_TIMER
+ *  as the nRF52810 has no RTC2 */
+#define RTC_USED_PWR_MGR RTC_USED_MS_TIMER
 /** MS_TIMER used for Device Ticks module */
 #define MS_TIMER_USED_DEVICE_TICKS 0
 /** MS_TIMER used for main application */
 #define MS_TIMER_USED_LRF_NODE_MOD 1
+/** MS_TIMER used for Button UI module */
+#define MS_TIMER_USED_BUTTON_UI 2
+/** MS_TIMER used for the long preamble and CSMA backoff of the RF communication module */
+#define MS_TIMER_USED_RF_COMM 3
 
 /** GPIOTE PORT channel used for button_ui */
 #define GPIOTE_CH_USED_BUTTON_UI_PORT 
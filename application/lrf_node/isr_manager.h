@@ -19,35 +19,51 @@
 #ifndef TEMPLATE_ISR_MANAGE_H
 #define TEMPLATE_ISR_MANAGE_H
 
+#include "stdint.h"
+
 //Drivers for hal level Irq management
-void hal_gpio_Handler (void);
+void hal_gpio_Handler (uint32_t fired);
 
-void hal_saadc_Handler (void);
+void hal_saadc_Handler (uint32_t fired);
 
-void hal_spim_Handler (void);
+void hal_spim_Handler (uint32_t fired);
 
-void hal_twim_Handler (void);
+void hal_twim_Handler (uint32_t fired);
 
-void hal_uart_Handler (void);
+void hal_uart_Handler (uint32_t fired);
 
-void hal_wdt_Handler (void);
+void hal_wdt_Handler (uint32_t fired);
 
 
 //Declaration for peripheral level Irq
-void ble_adv_radio_Handler (void);
+void ble_adv_radio_Handler (uint32_t fired);
+
+void gpio_edge_gpiote_Handler (uint32_t fired);
+
+void rf_comm_gpiote_Handler (uint32_t fired);
+
+void ms_timer_rtc_Handler (uint32_t fired);
+
+void random_num_rng_Handler (uint32_t fired);
+
+void uart_printf_uart_Handler (uint32_t fired);
+
+void hal_pwm_Handler (uint32_t fired);
+
+void hal_radio_Handler (uint32_t fired);
 
-void button_ui_gpiote_Handler (void);
+void tssp_detect_swi_Handler (uint32_t fired);
 
-void rf_comm_gpiote_Handler (void);
+void tssp_ir_tx_timer1_Handler (uint32_t fired);
 
-void ms_timer_rtc_Handler (void);
+void tssp_ir_tx_timer2_Handler (uint32_t fired);
 
-void uart_printf_uart_Handler (void);
+void us_timer_timer_Handler (uint32_t fired);
 
 void evt_sd_handler_swi_Handler (void);
 
 void sensebe_ble_swi_Handler (void);
 
-void radio_trigger_timer_Handler (void);
+void radio_trigger_timer_Handler (uint32_t fired);
 
 #endif //TEMPLATE_ISR_MANAGE_H
@@ -23,10 +23,14 @@
 #include "KXTJ3.h"
 #include "aa_aaa_battery_check.h"
 #include "random_num.h"
+#include "rf_link_adapt.h"
+#include "rf_link_arq.h"
 #include "hal_gpio.h"
 #include "string.h"
 #include "log.h"
 #include "hal_nop_delay.h"
+#include "nrf_sdm.h"
+#include "nrf_soc.h"
 
 
 //macros
@@ -62,9 +66,27 @@
 /** Maximum length of RF packet */
 #define RF_MAX_LEN (16)
 
+/** Bytes on air of the feedback packet of the gateway with both entries,
+ *  which acks each packet and has its RSSI to adapt the link */
+#define LINK_FEEDBACK_PKT_BYTES (4 + 4 + 1 + 5 + 10 + 2)
+/** Time in ms for the gateway to reply, beyond the feedback packet */
+#define LINK_FEEDBACK_MARGIN_MS (150)
+/** Sensitivity in dBm of the gateway at the bit rate used */
+#define LINK_SENSITIVITY_DBM (-125)
+/** An alive packet asks for the ack, with the feedback, after these many */
+#define LINK_FEEDBACK_EVERY (4)
+/** The most alive packets between the feedbacks, 32 h at ALIVE_FREQ_S */
+#define LINK_FEEDBACK_EVERY_MAX (64)
+
+/** After the first estimate the frequency offset to the gateway is
+ *  corrected by 1/this of each, to smooth the noise of the estimate */
+#define FREQ_OFF_GAIN_DIV (2)
+
 /** PKT Structure */
 typedef struct
 {
+    /** Flags of the link, at RF_LINK_FLAGS_POS */
+    uint8_t flags;
     uint8_t batt_volt;
     uint8_t angle;
 }node_rf_pkt_t;
@@ -122,6 +144,20 @@ static uint32_t garr_random_offset [] = {ALIVE_FREQ_S, TILT_FREQ_S, MAINTAIN_FRE
 /**Variable to store TCXO pin number */
 static uint32_t g_pin_tcxo_en;
 
+/** The radio keeps its configuration in the sleep, so it is initialized
+ *  only at the first wake up and after new parameters */
+static bool g_is_rf_init_due = true;
+/** If the power or the bit rate of the link adaptation are to be set at
+ *  the next wake up */
+static bool g_is_link_changed = false;
+/** Time in s since the time was last given to the radio for its
+ *  calibration */
+static uint32_t g_rf_cal_elapsed_s = 0;
+/** Shift of the frequency of the radio to that of the gateway in Hz, for
+ *  the drift of the crystal without a TCXO */
+static int32_t g_freq_off_hz = 0;
+static bool g_is_freq_off_set = false;
+
 
 /**variable to store RF HW information*/
 
@@ -129,15 +165,71 @@ void node_rf_tx_done (uint32_t status);
 
 void node_rf_tx_failed (uint32_t status);
 
+void node_rf_rx_done (uint32_t status);
+
+void node_rf_rx_failed (uint32_t status);
+
 static rf_comm_radio_t g_rf_comm_radio = 
 {
     .rf_tx_done_handler = node_rf_tx_done,
     .rf_tx_failed_handler = node_rf_tx_failed,
+    .rf_rx_done_handler = node_rf_rx_done,
+    .rf_rx_failed_handler = node_rf_rx_failed,
     .irq_priority = APP_IRQ_PRIORITY_LOW,
 };
 
 static rf_comm_hw_t g_rf_comm_hw;
 
+/** Partial adaptation: only the TX power. The gateway listens at one bit
+ *  rate, so the rate ladder of rf_link_adapt isn't used and a node stays at
+ *  the bit rate of lrf_node_mod_init. lrf_gsm_node doesn't adapt its link. */
+static rf_link_adapt_rate_t g_link_rates[1] =
+{
+    {.sensitivity_dbm = LINK_SENSITIVITY_DBM},
+};
+
+static rf_link_adapt_config_t g_link_config =
+{
+    .min_pwr_dbm = -3,
+    .pwr_step_db = 3,
+    .target_margin_db = 10,
+    .hysteresis_db = 6,
+    .max_misses = 3,
+    .p_rates = g_link_rates,
+    .rate_count = ARRAY_SIZE(g_link_rates),
+};
+
+static rf_link_adapt_t g_link;
+
+/** Device ID in the RF header, to find the feedback for this node */
+static uint16_t g_dev_id;
+/** Alive packets between the ones with the ack requested, and the count
+ *  since the last one */
+static uint32_t g_link_fb_every = LINK_FEEDBACK_EVERY;
+static uint32_t g_link_fb_cnt = 0;
+/** The packets are sent again every few s till acked, for up to a minute */
+static const rf_link_arq_config_t gc_arq_config =
+{
+    .max_retries = 5,
+    .min_backoff = 2,
+    .max_backoff = 16,
+};
+
+static rf_link_arq_t g_arq;
+
+/** The packet waiting for its ack, to be sent again */
+static node_rf_pkt_t g_arq_pkt;
+static uint8_t g_arq_pkt_type;
+
+/** Listen before talk, as the nodes wake on similar schedules */
+static rf_comm_csma_t g_rf_comm_csma =
+{
+    .max_attempts = 8,
+    .min_backoff_ms = 20,
+    .max_backoff_ms = 2560,
+    .cca_thr_dbm = -85,
+};
+
 //function declaration
 
 /**
@@ -220,13 +312,55 @@ bool is_node_moving (uint32_t threshold)
         return 0;
     }}
 
+/** Die temperature of the MCU in degree C, near the radio on the board */
+static int32_t node_temp_get (void)
+{
+    int32_t temp;
+    uint8_t is_sd_enabled;
+
+    sd_softdevice_is_enabled (&is_sd_enabled);
+    if(is_sd_enabled)
+    {
+        sd_temp_get (&temp);
+    }
+    else
+    {
+        NRF_TEMP->EVENTS_DATARDY = 0;
+        NRF_TEMP->TASKS_START = 1;
+        while(NRF_TEMP->EVENTS_DATARDY == 0)
+        {
+        }
+        temp = NRF_TEMP->TEMP;
+        NRF_TEMP->TASKS_STOP = 1;
+    }
+    //In steps of 0.25 C
+    return temp/4;
+}
+
 void node_rf_wakeup ()
 {
     hal_gpio_pin_set (g_pin_tcxo_en);
-    hal_nop_delay_ms (50);
-    rf_comm_wake();
-    log_printf("Radio ID :0x%x\n", rf_comm_get_radio_id ());
-    rf_comm_radio_init (&g_rf_comm_radio, &g_rf_comm_hw);
+    rf_comm_cal_update (g_rf_cal_elapsed_s, node_temp_get ());
+    g_rf_cal_elapsed_s = 0;
+    //Waits till the radio is ready with the TCXO stable
+    if(rf_comm_wake () != 0)
+    {
+        log_printf("Radio not ready\n");
+    }
+    if(g_is_rf_init_due)
+    {
+        log_printf("Radio ID :0x%x\n", rf_comm_get_radio_id ());
+        rf_comm_radio_init (&g_rf_comm_radio, &g_rf_comm_hw);
+        rf_comm_csma_config (&g_rf_comm_csma);
+        g_is_rf_init_due = false;
+        g_is_link_changed = false;
+    }
+    else if(g_is_link_changed)
+    {
+        rf_comm_set_pwr (g_rf_comm_radio.tx_power);
+        rf_comm_set_bitrate (g_rf_comm_radio.bitrate);
+        g_is_link_changed = false;
+    }
 
     rf_comm_idle ();
     rf_comm_enable_irq ();
@@ -349,6 +483,7 @@ void ms_timer_handler (void)
 {
     //calculate angle
     static uint32_t l_sense_alive_s = 0;
+    g_rf_cal_elapsed_s += SENSE_FREQ_S;
     memcpy (&g_acce_data,kxtj3_get_acce_value (), sizeof(KXTJ3_g_data_t));
     g_node_current_angle = get_angle (g_acce_data.yg);
     bool l_current_motion = is_node_moving (MOTION_THRESHOLD);
@@ -370,22 +505,44 @@ void ms_timer_handler (void)
                 g_acce_data.xg, g_acce_data.yg, g_acce_data.zg, g_node_state);
     //send RF packet if needed
     log_printf("T : L %d garr %d\n", l_sense_alive_s, garr_random_offset[g_node_state]);
-    if(l_sense_alive_s < garr_random_offset[g_node_state])
+    if(rf_link_arq_tick (&g_arq))
+    {
+        log_printf("Retry %d\n", g_arq.retries);
+        node_rf_wakeup ();
+        g_arq_pkt.flags = RF_LINK_FLAG_ACK_REQ | RF_LINK_FLAG_RETX;
+        rf_comm_pkt_resend (g_arq_pkt_type, (uint8_t *)&g_arq_pkt,
+                          sizeof(node_rf_pkt_t));
+    }
+    else if(l_sense_alive_s < garr_random_offset[g_node_state])
     {
         l_sense_alive_s++;
     }
-    else
+    //A new packet waits till the one before is acked or given up
+    else if(rf_link_arq_is_busy (&g_arq) == false)
     {
         node_rf_wakeup ();
         l_sense_alive_s = 0;
-        node_rf_pkt_t l_pkt = 
+        //Events are always acked, an alive packet only for the feedback
+        g_link_fb_cnt++;
+        if((g_current_pkt_type != PKT_ALIVE) || (g_link_fb_cnt >= g_link_fb_every))
         {
-            .batt_volt = aa_aaa_battery_status (),
-            .angle = g_node_current_angle
-        };
+            g_link_fb_cnt = 0;
+            g_arq_pkt.flags = RF_LINK_FLAG_ACK_REQ;
+        }
+        else
+        {
+            g_arq_pkt.flags = 0;
+        }
+        g_arq_pkt.batt_volt = aa_aaa_battery_status ();
+        g_arq_pkt.angle = g_node_current_angle;
+        g_arq_pkt_type = g_current_pkt_type;
         //RF
-        rf_comm_pkt_send (g_current_pkt_type, (uint8_t *)&l_pkt, 
+        rf_comm_pkt_send (g_arq_pkt_type, (uint8_t *)&g_arq_pkt, 
                           sizeof(node_rf_pkt_t));
+        if(g_arq_pkt.flags & RF_LINK_FLAG_ACK_REQ)
+        {
+            rf_link_arq_sent (&g_arq);
+        }
         g_pkt_cnt++;
         garr_random_offset[g_node_state] = (garr_freq_s[g_node_state] + 
             (random_num_generate (0,3)));
@@ -396,18 +553,145 @@ void ms_timer_handler (void)
 
 void node_rf_tx_done (uint32_t status)
 {
-    log_printf("Tx Done : %d\n", status);
-    node_rf_sleep ();
+    rf_comm_csma_stats_t l_csma_stats;
+    rf_comm_get_csma_stats (&l_csma_stats);
+    log_printf("Tx Done : %d CCA %d Busy %d\n", status,
+            l_csma_stats.last_attempts, l_csma_stats.busy);
+    if(g_arq_pkt.flags & RF_LINK_FLAG_ACK_REQ)
+    {
+        rf_comm_rx_window ((LINK_FEEDBACK_PKT_BYTES * 8 * 1000) / g_rf_comm_radio.bitrate
+                + LINK_FEEDBACK_MARGIN_MS);
+    }
+    else
+    {
+        node_rf_sleep ();
+    }
 }
 
-void node_rf_tx_failed (uint32_t status)
+/** Use the power and rate of the link adaptation from the next wake up */
+static void link_adapt_apply (void)
 {
-    //in certain cases
-    log_printf("Tx Failed : %d\n", status);
+    g_rf_comm_radio.tx_power = rf_link_adapt_pwr (&g_link);
+    g_rf_comm_radio.bitrate = rf_link_adapt_bitrate (&g_link);
+    g_is_link_changed = true;
+    log_printf("Link : %d dBm %d bps\n", g_rf_comm_radio.tx_power,
+            g_rf_comm_radio.bitrate);
+}
+
+/** The feedback is asked for again soon after the link changed or while a
+ *  miss can still fall back, else after twice as many alive packets. So a
+ *  steady link, or a far node already at the maximum power, rarely listens
+ *  in vain for the feedback. */
+static void link_feedback_every_set (bool is_soon)
+{
+    if(is_soon)
+    {
+        g_link_fb_every = LINK_FEEDBACK_EVERY;
+    }
+    else if(g_link_fb_every < LINK_FEEDBACK_EVERY_MAX)
+    {
+        g_link_fb_every *= 2;
+    }
+}
+
+/** Act on a command of the gateway in the ack of a packet */
+static void downlink_cmd_handler (uint8_t cmd)
+{
+    log_printf("Cmd : %d\n", cmd);
+    switch(cmd)
+    {
+        case LRF_NODE_CMD_SEND_NOW :
+            garr_random_offset[g_node_state] = 0;
+            break;
+        case LRF_NODE_CMD_RESENSE :
+            g_node_state = STATE_SENSE;
+            g_node_threshold_angle = g_node_upper_threshold_angle;
+            g_pkt_cnt = 0;
+            break;
+        default :
+            break;
+    }
+}
+
+/** Follow the frequency of the gateway from the offset estimated for its
+ *  feedback, which is with the shift already applied */
+static void freq_off_track (int32_t est_hz)
+{
+    g_freq_off_hz += g_is_freq_off_set ? (est_hz / FREQ_OFF_GAIN_DIV) : est_hz;
+    g_is_freq_off_set = true;
+    //Kept in the sleep, so used from the next TX and RX
+    rf_comm_set_freq_offset (g_freq_off_hz);
+}
+
+static bool g_is_feedback_got;
+
+static void node_rf_pkt_handler (rf_comm_rx_pkt_t * p_pkt)
+{
+    int8_t l_rssi;
+    uint8_t l_cmd;
+    bool l_is_changed;
+
+    if((p_pkt->crc_ok == false) || (p_pkt->len < RF_COMM_HDR_LEN)
+            || (p_pkt->p_data[RF_COMM_HDR_TYPE_POS] != RF_LINK_FEEDBACK_PKT_TYPE))
+    {
+        return;
+    }
+    if(rf_link_feedback_find (&p_pkt->p_data[RF_COMM_HDR_LEN],
+            p_pkt->len - RF_COMM_HDR_LEN, g_dev_id, rf_comm_get_tx_seq (),
+            &l_rssi, &l_cmd))
+    {
+        g_is_feedback_got = true;
+        log_printf("Feedback : RSSI %d\n", l_rssi);
+        freq_off_track (rf_comm_get_freq_offset ());
+        rf_link_arq_acked (&g_arq);
+        l_is_changed = rf_link_adapt_feedback (&g_link, l_rssi);
+        if(l_is_changed)
+        {
+            link_adapt_apply ();
+        }
+        link_feedback_every_set (l_is_changed);
+        if(l_cmd != LRF_NODE_CMD_NONE)
+        {
+            downlink_cmd_handler (l_cmd);
+        }
+    }
+}
+
+void node_rf_rx_done (uint32_t status)
+{
+    g_is_feedback_got = false;
+    rf_comm_pkt_receive_all (node_rf_pkt_handler);
+    //Else the feedback of another node, the window continues
+    if(g_is_feedback_got)
     {
         node_rf_sleep ();
+    }
+}
 
+void node_rf_rx_failed (uint32_t status)
+{
+    log_printf("Feedback missed\n");
+    bool l_is_changed = rf_link_adapt_miss (&g_link);
+    if(l_is_changed)
+    {
+        link_adapt_apply ();
     }
+    link_feedback_every_set (l_is_changed
+            || (rf_link_adapt_pwr (&g_link) != g_link_config.max_pwr_dbm));
+    if(rf_link_arq_missed (&g_arq) == false)
+    {
+        log_printf("Pkt given up\n");
+    }
+    node_rf_sleep ();
+}
+
+void node_rf_tx_failed (uint32_t status)
+{
+    //in certain cases
+    log_printf("Tx Failed : %d\n", status);
+    //As the channel was busy, sent again after the backoff like a missed ack
+    rf_link_arq_missed (&g_arq);
+    node_rf_sleep ();
 }
 
 /** APIs */
@@ -418,6 +702,11 @@ void lrf_node_mod_init (lrf_node_mod_init_t * p_mod_init)
     g_rf_comm_radio.center_freq = p_mod_init->radio_params.center_freq;
     g_rf_comm_radio.freq_dev = p_mod_init->radio_params.fdev;
     g_rf_comm_radio.tx_power = p_mod_init->radio_params.tx_power;
+    g_link_rates[0].bitrate = p_mod_init->radio_params.bitrate;
+    g_link_config.max_pwr_dbm = p_mod_init->radio_params.tx_power;
+    rf_link_adapt_init (&g_link, &g_link_config);
+    rf_link_arq_init (&g_arq, &gc_arq_config);
+    g_dev_id = p_mod_init->radio_header.prod_id;
     
     memcpy (&g_rf_comm_hw, &p_mod_init->radio_gpio, sizeof(rf_comm_hw_t));
     
@@ -462,6 +751,7 @@ void lrf_node_mod_start ()
     g_acce_data.xg = 0;
     g_acce_data.yg = 0;
     g_acce_data.zg = 0;
+    rf_link_arq_init (&g_arq, &gc_arq_config);
     node_rf_wakeup ();
     node_rf_sleep ();
     ms_timer_start (MOD_TIMER, MS_REPEATED_CALL, MS_TIMER_TICKS_MS(SENSE_FREQ_MS),
@@ -493,6 +783,7 @@ void lrf_node_mod_update_rf_head (lrf_node_mod_rf_head_t * p_head)
         .app_id = p_head->app_id,
     };
     rf_comm_pkt_config (&l_rf_pkt);
+    g_dev_id = p_head->prod_id;
 }
 
 void lrf_node_mod_update_rf_params (lrf_node_mod_rf_params_t * p_params)
@@ -502,6 +793,10 @@ void lrf_node_mod_update_rf_params (lrf_node_mod_rf_params_t * p_params)
     g_rf_comm_radio.center_freq = p_params->center_freq;
     g_rf_comm_radio.freq_dev = p_params->fdev;
     g_rf_comm_radio.tx_power = p_params->tx_power;
+    g_link_rates[0].bitrate = p_params->bitrate;
+    g_link_config.max_pwr_dbm = p_params->tx_power;
+    rf_link_adapt_init (&g_link, &g_link_config);
+    g_is_rf_init_due = true;
 }
 
 void lrf_node_mod_set_angle_thresholds (uint8_t lower_angle, uint8_t upper_angle)
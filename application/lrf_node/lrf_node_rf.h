@@ -33,6 +33,18 @@
 #define MS_TIMER_USED_LRF_NODE_MOD 0
 #endif
 
+/** Commands the gateway can send to the node in the ack of a packet. An
+ *  alive packet asks for the ack only every 4 to 64 of them, so a command
+ *  to an idle node can wait for that long. */
+typedef enum
+{
+    LRF_NODE_CMD_NONE,
+    /** Send the next packet at the next check of the angle */
+    LRF_NODE_CMD_SEND_NOW,
+    /** Go back to sensing from the tilted or maintain state */
+    LRF_NODE_CMD_RESENSE,
+}lrf_node_cmd_t;
+
 typedef struct 
 {
     /** Center freq : kHz */
@@ -31,6 +31,7 @@
 #include "rf_comm.h"
 #include "rf_spi_hw.h"
 #include "log.h"
+#include "pwr_mgr.h"
 #include "nrf_util.h"
 #include "hal_clocks.h"
 #include "ms_timer.h"
@@ -218,7 +219,6 @@ void next_interval_handler (uint32_t ticks)
 {
 //    static prev_state = LRF_STATE_PRE_DEPLOYED;
     log_printf("t%d\n",ticks);
-    button_ui_add_tick (ticks);
     if((gs_lrf_state == LRF_STATE_DEPLOYMENT))
     {
         g_dply_align.align_flag = (lrf_node_mod_get_angle ());
@@ -512,24 +512,6 @@ void boot_pwr_config(void)
     NRF_POWER->TASKS_LOWPWR = 1;
 }
 
-/**
- * Different calls to sleep depending on the status of Softdevice
- */
-void slumber(void)
-{
-    uint8_t is_sd_enabled;
-    sd_softdevice_is_enabled(&is_sd_enabled);
-    // Would in the SENSING mode
-    if(is_sd_enabled == 0)
-    {
-        __WFI();
-    }
-    else
-    {
-        sd_app_evt_wait();
-    }
-}
-
 
 int main ()
 {
@@ -538,6 +520,7 @@ int main ()
     log_printf("Hello world from LRF Node\n");    
     lfclk_init (LFCLK_SRC_Xtal);
     ms_timer_init (APP_IRQ_PRIORITY_LOW);
+    random_num_init (APP_IRQ_PRIORITY_LOWEST);
     
 #if ENABLE_WDT == 1
     hal_wdt_init(WDT_PERIOD_MS, wdt_prior_reset_callback);
@@ -600,6 +583,6 @@ int main ()
 #endif
         device_tick_process ();
         irq_msg_process ();
-        slumber ();
+        pwr_mgr_sleep ();
     }
 }
\ No newline at end of file
@@ -40,6 +40,7 @@
 #include "hal_gpio.h"
 #include "hal_nop_delay.h"
 #include "log.h"
+#include "pwr_mgr.h"
 #include "nrf_util.h"
 #include "pin_trace.h"
 #include "rf_rx_ble.h"
@@ -214,24 +215,6 @@ void on_connect ()
 {
     is_connected = true;
 }
-///**
-// * Different calls to sleep depending on the status of Softdevice
-// */
-void slumber(void)
-{
-    uint8_t is_sd_enabled;
-    sd_softdevice_is_enabled(&is_sd_enabled);
-    // Would in the SENSING mode
-    if(is_sd_enabled == 0)
-    {
-        __WFI();
-    }
-    else
-    {
-        sd_app_evt_wait();
-    }
-}
-
 void rx_failed_handler (uint32_t error)
 {
     log_printf("%s : %d\n", __func__, error);
@@ -368,7 +351,7 @@ int main(void)
 //    NVIC_EnableIRQ (GPIOTE_IRQn);
     while(1)
     {
-        slumber ();
+        pwr_mgr_sleep ();
     }
 }
 
@@ -49,10 +49,34 @@
  * }
  * @enddot
  *
+ *  When built with SAADC_LOG_STREAM the application instead samples continuously
+ *  for high rate captures. A TIMER paces the SAMPLE task through PPI, the END
+ *  event restarts the SAADC through PPI into the next block of an EasyDMA ring
+ *  and the ISR only does the book-keeping of the blocks. The filled blocks are
+ *  sent from the main thread as binary frames over the RTT channel
+ *  @ref STREAM_RTT_CHANNEL or the UARTE. The frames are decoded by
+ *  utils/saadc_stream_decode.py.
+ *
+ * @dot
+ * digraph Stream_diagram {
+ *  rankdir="LR";
+ *  tmr_evt [shape = circle, width = 1.5, label = "TIMER\ncompare"]
+ *  adc_sample [shape = circle, width = 1.5, label ="Sample ADC"]
+ *  adc_end [shape = circle, width = 1.5, label = "Block\nfilled"]
+ *  adc_start [shape = circle, width = 1.5, label ="Start ADC\nnext block"]
+ *  main [shape = circle, width = 1.5, label ="Frame sent\nfrom main"]
+ *  tmr_evt -> adc_sample [label = "PPI:sample\nall channels"];
+ *  adc_sample -> adc_end [style = "dotted", label = "Every\nSTREAM_BLOCK_SAMPLES"];
+ *  adc_end -> adc_start [label = "PPI:restart\nwith next buffer"];
+ *  adc_end -> main [label = "IRQ:block\nready"];
+ * }
+ * @enddot
+ *
  * @{
  */
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include "nrf.h"
 
@@ -67,6 +91,9 @@
 #include "common_util.h"
 #include "nrf_util.h"
 #include "log.h"
+#if defined SAADC_LOG_STREAM && defined STREAM_SINK_RTT
+#include "SEGGER_RTT.h"
+#endif
 
 /*      Defines         */
 /** @brief Macro that defines the data sampling frequency */
@@ -117,6 +144,47 @@
 #define PIR_AMP_CHANNEL_LOWER_LIMIT    (-100)
 /** @} */
 
+/** @brief The TIMER peripheral used to pace the sampling in the streaming mode.
+ *  Defined in both modes so that sys_config_check.py sees it as allocated */
+#define STREAM_TIMER_USED           1
+
+#if defined SAADC_LOG_STREAM
+#ifndef STREAM_SAMPLE_FREQ
+/** @brief Sampling frequency in Hz of all the channels in the streaming mode */
+#define STREAM_SAMPLE_FREQ          50000
+#endif
+
+/** @brief The TIMER peripheral's register structure used for streaming */
+#define STREAM_TIMER                CONCAT_2(NRF_TIMER, STREAM_TIMER_USED)
+/** @brief Number of 16 MHz TIMER ticks between two sampling rounds */
+#define STREAM_TIMER_TICKS          (16000000/STREAM_SAMPLE_FREQ)
+
+/** @brief Number of sampling rounds of all the channels in a block which is sent as one frame */
+#define STREAM_BLOCK_SAMPLES        256
+/** @brief Number of blocks in the EasyDMA ring. Must be a power of 2 */
+#define STREAM_BLOCK_COUNT          4
+/** @brief Number of samples of all the channels in a block */
+#define STREAM_BLOCK_LEN            (STREAM_BLOCK_SAMPLES*SAADC_NUMBER_OF_CHANNELS)
+
+/** @brief The two bytes that mark the start of a frame, sent as 0x5A, 0xA5 */
+#define STREAM_FRAME_SYNC           0xA55A
+
+#if defined STREAM_SINK_RTT
+/** @brief The RTT up channel on which the frames are sent. Channel 0 is for logs */
+#define STREAM_RTT_CHANNEL          1
+/** @brief Size of the RTT buffer of @ref STREAM_RTT_CHANNEL */
+#define STREAM_RTT_BUFFER_SIZE      4096
+#elif defined STREAM_SINK_UARTE
+/** @brief The UARTE baud rate used for sending the frames */
+#define STREAM_UARTE_BAUD           UARTE_BAUDRATE_BAUDRATE_Baud1M
+#if defined LOG_UART_PRINTF || defined LOG_UART_DMA_PRINTF
+#error The UART logger and the UARTE stream sink use the same peripheral
+#endif
+#else
+#error Define the sink for the SAADC stream with STREAM_SINK_RTT or STREAM_SINK_UARTE
+#endif
+#endif
+
 /** @brief The ADC converstion resolution used in this application */
 #define APPLN_SAADC_RESOLUTION    NRF_SAADC_RESOLUTION_12BIT
 /** @brief The number of samples used to average to get the result */
@@ -147,9 +215,67 @@ static const nrf_saadc_channel_config_t saadc_ch_config[SAADC_NUMBER_OF_CHANNELS
             SAADC_AMP_CHANNEL_CONFIG
     };
 
+#if defined SAADC_LOG_STREAM
+/** @brief A block of samples along with the header and trailer of the frame
+ *  in which it is sent, so that the SAADC's EasyDMA writes directly in the frame.
+ *  All the multi-byte fields are little endian.
+ */
+struct __attribute__((packed, aligned(4))) stream_frame
+{
+    /** Always @ref STREAM_FRAME_SYNC */
+    uint16_t sync;
+    /** Number of bytes of the samples in the frame */
+    uint16_t len;
+    /** Sequence number of the block, increments with every lost block too */
+    uint32_t seq;
+    /** The RTC0 count at 32768 Hz when the block was filled */
+    uint32_t timestamp;
+    /** Number of blocks lost since the start of streaming before this one */
+    uint32_t lost;
+    /** Bit mask of the SAADC channels sampled */
+    uint8_t ch_mask;
+    /** Number of SAADC channels sampled in each round */
+    uint8_t ch_count;
+    /** The 16 MHz TIMER ticks between two sampling rounds */
+    uint16_t period;
+    /** Samples of the channels interleaved per sampling round */
+    int16_t samples[STREAM_BLOCK_LEN];
+    /** Fletcher-16 checksum from the len field till the end of the samples */
+    uint16_t checksum;
+};
+
+/** @brief The context of the blocks in the EasyDMA ring */
+static volatile struct
+{
+    /** Number of blocks filled by the SAADC and ready to be sent */
+    uint32_t put;
+    /** Number of blocks sent to the sink */
+    uint32_t get;
+    /** Sequence number of the next block to be filled */
+    uint32_t seq;
+    /** Number of blocks discarded because the sink was not keeping up */
+    uint32_t lost;
+    /** If the block being filled now is the discard block */
+    bool filling_discard;
+    /** If the block set up for the next START is the discard block */
+    bool next_discard;
+} stream;
+
+/** @brief The ring of blocks where the SAADC EasyDMA writes the samples */
+static struct stream_frame stream_ring[STREAM_BLOCK_COUNT];
+/** @brief The block where the samples are written when the ring is full */
+static int16_t stream_discard[STREAM_BLOCK_LEN];
+
+#if defined STREAM_SINK_RTT
+/** @brief The buffer of the RTT channel @ref STREAM_RTT_CHANNEL */
+static uint8_t stream_rtt_buffer[STREAM_RTT_BUFFER_SIZE];
+#endif
+
+#else
 /*      Globals        */
 /** @brief The single length array that stores the SAADC converted value */
 static int16_t saadc_result[1];
+#endif
 
 /*      Function declarations        */
 /** @brief Sets up the SAADC peripheral according to its configuration defines,
@@ -166,6 +292,227 @@ void trigger_handler(void)
 
 
 /*      Function definitions        */
+#if defined SAADC_LOG_STREAM
+
+/** @brief Sets the EasyDMA pointer for the START following the one which
+ *  just happened. The START latches this pointer, so this is called on STARTED.
+ */
+static void stream_next_block_set(void)
+{
+    stream.filling_discard = stream.next_discard;
+
+    uint32_t reserved = (stream.put - stream.get) +
+            ((stream.filling_discard == true) ? 0 : 1);
+    if(reserved < STREAM_BLOCK_COUNT)
+    {
+        uint32_t idx = (stream.put + ((stream.filling_discard == true) ? 0 : 1))
+                & (STREAM_BLOCK_COUNT - 1);
+        nrf_saadc_buffer_init(stream_ring[idx].samples, STREAM_BLOCK_LEN);
+        stream.next_discard = false;
+    }
+    else
+    {
+        nrf_saadc_buffer_init(stream_discard, STREAM_BLOCK_LEN);
+        stream.next_discard = true;
+    }
+}
+
+/** @brief Implementation of the SAADC interrupt handler in the streaming mode.
+ *  It only tracks which blocks are filled, the frames are sent from main.
+ */
+void SAADC_IRQHandler(void)
+{
+    if (nrf_saadc_event_check(NRF_SAADC_EVENT_END))
+    {
+        nrf_saadc_event_clear(NRF_SAADC_EVENT_END);
+
+        if(stream.filling_discard == false)
+        {
+            struct stream_frame * frame =
+                    &stream_ring[stream.put & (STREAM_BLOCK_COUNT - 1)];
+            frame->seq = stream.seq;
+            frame->timestamp = NRF_RTC0->COUNTER;
+            frame->lost = stream.lost;
+            stream.put++;
+        }
+        else
+        {
+            stream.lost++;
+        }
+        stream.seq++;
+    }
+
+    if(nrf_saadc_event_check(NRF_SAADC_EVENT_STARTED))
+    {
+        nrf_saadc_event_clear(NRF_SAADC_EVENT_STARTED);
+        stream_next_block_set();
+    }
+}
+
+/**
+ * @brief Calculates the Fletcher-16 checksum of a buffer
+ * @param buf Pointer to the buffer
+ * @param len Number of bytes in the buffer
+ * @return The checksum with sum2 in the upper byte
+ */
+static uint16_t stream_checksum(const uint8_t * buf, uint32_t len)
+{
+    uint32_t sum1 = 0, sum2 = 0;
+    while(len)
+    {
+        //Reduce the sums at least once every 360 bytes to avoid overflow
+        uint32_t chunk = (len > 360) ? 360 : len;
+        len -= chunk;
+        do
+        {
+            sum1 += *buf++;
+            sum2 += sum1;
+        }while(--chunk);
+        sum1 %= 255;
+        sum2 %= 255;
+    }
+    return (uint16_t)((sum2 << 8) | sum1);
+}
+
+/**
+ * @brief Sends a frame to the sink without waiting for it
+ * @param frame Pointer to the frame to be sent
+ * @return True if the sink took the frame, false if it is busy
+ */
+static bool stream_sink_write(struct stream_frame * frame)
+{
+#if defined STREAM_SINK_RTT
+    return (SEGGER_RTT_Write(STREAM_RTT_CHANNEL, frame, sizeof(struct stream_frame))
+            == sizeof(struct stream_frame));
+#else
+    //The frame is sent by EasyDMA directly from the ring
+    NRF_UARTE0->EVENTS_ENDTX = 0;
+    NRF_UARTE0->TXD.PTR = (uint32_t) frame;
+    NRF_UARTE0->TXD.MAXCNT = sizeof(struct stream_frame);
+    NRF_UARTE0->TASKS_STARTTX = 1;
+    return true;
+#endif
+}
+
+/**
+ * @brief Sends all the filled blocks as frames to the sink. To be called
+ *  in the main loop. The blocks stay in the ring while the sink is busy.
+ */
+static void stream_process(void)
+{
+#if defined STREAM_SINK_UARTE
+    //The block being sent by the UARTE's EasyDMA is freed only after it is done
+    static bool block_in_tx = false;
+    if((block_in_tx == true) && (NRF_UARTE0->EVENTS_ENDTX == 1))
+    {
+        stream.get++;
+        block_in_tx = false;
+    }
+#endif
+    while(stream.get != stream.put)
+    {
+#if defined STREAM_SINK_UARTE
+        if(block_in_tx == true)
+        {
+            break;
+        }
+#endif
+        struct stream_frame * frame =
+                &stream_ring[stream.get & (STREAM_BLOCK_COUNT - 1)];
+        frame->sync = STREAM_FRAME_SYNC;
+        frame->len = sizeof(frame->samples);
+        frame->ch_mask = (1 << SAADC_NUMBER_OF_CHANNELS) - 1;
+        frame->ch_count = SAADC_NUMBER_OF_CHANNELS;
+        frame->period = STREAM_TIMER_TICKS;
+        frame->checksum = stream_checksum((uint8_t *) &frame->len,
+                offsetof(struct stream_frame, checksum) -
+                offsetof(struct stream_frame, len));
+
+        if(stream_sink_write(frame) == false)
+        {
+            break;
+        }
+#if defined STREAM_SINK_UARTE
+        block_in_tx = true;
+#else
+        stream.get++;
+#endif
+    }
+}
+
+static void saadc_init(void)
+{
+    static_assert((SAADC_NUMBER_OF_CHANNELS > 0) && (SAADC_NUMBER_OF_CHANNELS <= 8),
+            "The number of SAADC channels is between 1 and 8");
+    static_assert(IS_POWER_OF_TWO(STREAM_BLOCK_COUNT),
+            "The number of blocks in the stream ring must be a power of 2");
+    static_assert((STREAM_SAMPLE_FREQ*SAADC_NUMBER_OF_CHANNELS) <= 200000,
+            "The SAADC can do at most 200 kS/s with the 3 us acquisition time");
+    static_assert((offsetof(struct stream_frame, samples) % 4) == 0,
+            "The samples in the frame must be word aligned for EasyDMA");
+
+#if defined STREAM_SINK_RTT
+    SEGGER_RTT_ConfigUpBuffer(STREAM_RTT_CHANNEL, "saadc", stream_rtt_buffer,
+            sizeof(stream_rtt_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#else
+    hal_gpio_cfg_output(TX_PIN_NUMBER, 1);
+    NRF_UARTE0->PSEL.TXD = TX_PIN_NUMBER;
+    NRF_UARTE0->BAUDRATE = (STREAM_UARTE_BAUD << UARTE_BAUDRATE_BAUDRATE_Pos);
+    NRF_UARTE0->CONFIG = 0;
+    NRF_UARTE0->ENABLE = (UARTE_ENABLE_ENABLE_Enabled << UARTE_ENABLE_ENABLE_Pos);
+#endif
+
+    nrf_saadc_resolution_set(APPLN_SAADC_RESOLUTION);
+    saadc_sampling_task_mode_set();
+    nrf_saadc_oversample_set(NRF_SAADC_OVERSAMPLE_DISABLED);
+
+    for (uint32_t i = 0; i < SAADC_NUMBER_OF_CHANNELS; i++)
+    {
+        nrf_saadc_channel_config_t ch_config = saadc_ch_config[i];
+        ch_config.acq_time = NRF_SAADC_ACQTIME_3US;
+        ch_config.burst = NRF_SAADC_BURST_DISABLED;
+        saadc_channel_init(i, &ch_config);
+    }
+
+    stream.put = stream.get = stream.seq = stream.lost = 0;
+    stream.filling_discard = stream.next_discard = false;
+    nrf_saadc_buffer_init(stream_ring[0].samples, STREAM_BLOCK_LEN);
+
+    NVIC_SetPriority(SAADC_IRQn, APPLN_SAADC_IRQ_PRIORITY);
+    NVIC_ClearPendingIRQ(SAADC_IRQn);
+    NVIC_EnableIRQ(SAADC_IRQn);
+    nrf_saadc_int_enable(NRF_SAADC_INT_END | NRF_SAADC_INT_STARTED);
+
+    NRF_PPI->CH[PPI_CHEN_CH0_Pos].EEP = (uint32_t) &(STREAM_TIMER->EVENTS_COMPARE[0]);
+    NRF_PPI->CH[PPI_CHEN_CH0_Pos].TEP = (uint32_t) &(NRF_SAADC->TASKS_SAMPLE);
+    NRF_PPI->CHENSET = PPI_CHENSET_CH0_Set << PPI_CHEN_CH0_Pos;
+
+    NRF_PPI->CH[PPI_CHEN_CH1_Pos].EEP = (uint32_t) &(NRF_SAADC->EVENTS_END);
+    NRF_PPI->CH[PPI_CHEN_CH1_Pos].TEP = (uint32_t) &(NRF_SAADC->TASKS_START);
+    NRF_PPI->CHENSET = PPI_CHENSET_CH1_Set << PPI_CHEN_CH1_Pos;
+
+    //RTC0 free runs to timestamp the blocks
+    NRF_RTC0->TASKS_STOP = 1;
+    NRF_RTC0->PRESCALER = 0;
+    NRF_RTC0->TASKS_CLEAR = 1;
+    NRF_RTC0->TASKS_START = 1;
+
+    STREAM_TIMER->TASKS_STOP = 1;
+    STREAM_TIMER->TASKS_CLEAR = 1;
+    STREAM_TIMER->MODE = TIMER_MODE_MODE_Timer;
+    STREAM_TIMER->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
+    STREAM_TIMER->PRESCALER = 0;
+    STREAM_TIMER->CC[0] = STREAM_TIMER_TICKS;
+    STREAM_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+    STREAM_TIMER->EVENTS_COMPARE[0] = 0;
+
+    nrf_saadc_enable();
+    NRF_SAADC->TASKS_START = 1;
+    STREAM_TIMER->TASKS_START = 1;
+}
+
+#else
+
 /** @brief Implementation of the SAADC interrupt handler */
 void SAADC_IRQHandler(void)
 {
@@ -325,6 +672,7 @@ static void saadc_init(void)
     NRF_RTC0->TASKS_START = 1;
     nrf_saadc_enable();
 }
+#endif
 
 
 /**
@@ -342,6 +690,9 @@ int main(void)
 
     while (true)
     {
+#if defined SAADC_LOG_STREAM
+        stream_process();
+#endif
         __WFI();
     }
 }
@@ -38,12 +38,14 @@
 #include "boards.h"
 
 #include "log.h"
+#include "pwr_mgr.h"
 #include "nrf_util.h"
 #include "hal_gpio.h"
 #include "ms_timer.h"
 #include "hal_nop_delay.h"
 #include "hal_wdt.h"
 #include "irq_msg_util.h"
+#include "evt_sched.h"
 #include "device_tick.h"
 #include "pir_sense.h"
 #include "hal_pin_analog_input.h"
@@ -60,6 +62,8 @@
 #include "dev_id_fw_ver.h"
 #include "sensepi_store_config.h"
 #include "hal_nvmc.h"
+#include "warm_boot.h"
+#include "time_tracker.h"
 
 /* ----- Defines ----- */
 
@@ -150,12 +154,58 @@ static sensepi_func_config_t sensepi_func_default_config =
 };
 
 
+_Static_assert(sizeof(sensepi_ble_config_t) <= sizeof(((warm_boot_state_t *)0)->app_data),
+        "The warm boot snapshot can't hold the configuration");
+_Static_assert(MOTION_AND_TIMER <= WARM_BOOT_COUNTERS,
+        "The warm boot snapshot can't hold the trigger counts");
+
 /* ----- Function declarations ----- */
 
 /* ----- Function definitions ----- */
-/** Function called just before reset due to WDT */
-void wdt_prior_reset_callback(void){
-    log_printf("WDT reset\n");
+/**
+ * @brief Keep a copy of the configuration in the warm boot snapshot, so
+ *  that it is used after a warm boot without reading the flash
+ * @param config The configuration in use
+ */
+static void retain_config(sensepi_ble_config_t * config)
+{
+    memcpy(warm_boot_state()->app_data, config, sizeof(sensepi_ble_config_t));
+    warm_boot_commit();
+}
+
+/**
+ * @brief Keep the time of day, the date and the trigger counts in the warm
+ *  boot snapshot. Called on every tick while sensing.
+ */
+static void retain_sensing(void)
+{
+    warm_boot_state_t * p_state = warm_boot_state();
+    time_tracker_ddmmyy_t * p_date = time_tracker_get_current_date();
+
+    p_state->time_s = time_tracker_get_current_time_s();
+    p_state->date = (p_date->yy << 16) | (p_date->mm << 8) | p_date->dd;
+    memcpy(p_state->counters, sensepi_func_get_trigger_counts(),
+            MOTION_AND_TIMER*sizeof(uint32_t));
+    warm_boot_commit();
+}
+
+/**
+ * @brief Restore the time of day, the date and the trigger counts from the
+ *  warm boot snapshot after sensepi_func is initialized
+ */
+static void resume_sensing(void)
+{
+    warm_boot_state_t * p_state = warm_boot_state();
+    time_tracker_ddmmyy_t date =
+    {
+        .dd = p_state->date & 0xFF,
+        .mm = (p_state->date >> 8) & 0xFF,
+        .yy = (p_state->date >> 16) & 0xFF,
+    };
+
+    time_tracker_set_date_time(&date, p_state->time_s);
+    memcpy(sensepi_func_get_trigger_counts(), p_state->counters,
+            MOTION_AND_TIMER*sizeof(uint32_t));
 }
 
 void prepare_init_ble_adv()
@@ -217,6 +267,7 @@ static void ble_evt_handler(ble_evt_t * evt)
 static void get_sensepi_config_t(sensepi_ble_config_t *config)
 {
     sensepi_func_update_settings (config);
+    retain_config (config);
 }
 
 /**
@@ -227,13 +278,14 @@ static void get_sensepi_config_t(sensepi_ble_config_t *config)
 void next_interval_handler(uint32_t interval)
 {
     log_printf("in %d\n", interval);
-    button_ui_add_tick(interval);
     switch(current_state)
     {
     case SENSING:
     {
         log_printf("Nxt Evt Hndlr : SENSING\n");
         sensepi_func_add_ticks (interval);        
+        warm_boot_mark_stable();
+        retain_sensing();
     }
         break;
     case ADVERTISING:
@@ -263,7 +315,14 @@ void state_change_handler(uint32_t new_state)
         log_printf("new state same as current state\n");
         return;
     }
+    if(current_state == SENSING)
+    {
+        //Current budget of the sensing mode which has ended
+        pwr_mgr_log_report();
+    }
     current_state = (sense_states) new_state;
+    warm_boot_state()->mode = current_state;
+    warm_boot_commit();
 
     switch(current_state)
     {
@@ -271,6 +330,7 @@ void state_change_handler(uint32_t new_state)
         {
             sd_softdevice_disable();
             log_printf("State Change : SENSING\n");
+            pwr_mgr_stats_reset();
             device_tick_cfg tick_cfg =
             {
                 MS_TIMER_TICKS_MS(SENSE_FAST_TICK_INTERVAL_MS),
@@ -370,6 +430,7 @@ void button_handler(button_ui_steps step, button_ui_action act)
             case BUTTON_UI_STEP_LONG:
                 {
                     NRF_POWER->GPREGRET = 0xB1;
+                    warm_boot_invalidate();
                     log_printf("Trying to do system reset..!!");
                     uint8_t is_sd_enabled;
                     sd_softdevice_is_enabled(&is_sd_enabled);
@@ -490,24 +551,17 @@ void load_last_config()
         sensepi_store_config_get_last_config ();
     
     sensepi_func_update_settings (&p_store_config->ble_config);
+    retain_config (&p_store_config->ble_config);
 }
 
 /**
- * Different calls to sleep depending on the status of Softdevice
+ * @brief Called by the event scheduler when no event is pending, to flush
+ *  the log of the handlers and sleep till the next interrupt
  */
-void slumber(void)
+static void idle_handler(void)
 {
-    uint8_t is_sd_enabled;
-    sd_softdevice_is_enabled(&is_sd_enabled);
-    // Would in the SENSING mode
-    if(is_sd_enabled == 0)
-    {
-        __WFI();
-    }
-    else
-    {
-        sd_app_evt_wait();
-    }
+    log_process();
+    pwr_mgr_sleep();
 }
 
 /**
@@ -515,17 +569,36 @@ void slumber(void)
  */
 int main(void)
 {
-    leds_init();
+    //Before boot_pwr_config clears the reset reason
+    bool is_warm = warm_boot_init();
+
+    if(is_warm)
+    {
+        //No start up blink when resuming
+        hal_gpio_cfg_output(LED_RED, !LEDS_ACTIVE_STATE);
+        hal_gpio_cfg_output(LED_GREEN, !LEDS_ACTIVE_STATE);
+    }
+    else
+    {
+        leds_init();
+    }
 
     /* Mandatory welcome message */
     log_init();
     log_printf("\n\nHello SensePi World!\n");
+    {
+        warm_boot_state_t * p_state = warm_boot_state();
+        log_printf("%s boot, last fault %d of 0x%x at 0x%x\n",
+            is_warm ? "Warm" : "Cold", p_state->fault,
+            p_state->fault_id, p_state->fault_pc);
+    }
     boot_pwr_config();
 
     lfclk_init(LFCLK_SRC_Xtal);
     ms_timer_init(APP_IRQ_PRIORITY_LOW);
 #if ENABLE_WDT == 1
-    hal_wdt_init(WDT_PERIOD_MS, wdt_prior_reset_callback);
+    //No handler, the reset reason identifies a WDT reset on the next boot
+    hal_wdt_init(WDT_PERIOD_MS, NULL);
     hal_wdt_start();
 #endif
 
@@ -534,6 +607,7 @@ int main(void)
     led_sense_init(LED_GREEN,
             PIN_TO_ANALOG_INPUT(LED_LIGHT_SENSE), !LEDS_ACTIVE_STATE);
 
+    evt_sched_init(idle_handler);
     {
         irq_msg_callbacks cb =
             { next_interval_handler, state_change_handler };
@@ -541,11 +615,30 @@ int main(void)
     }
     sensepi_func_init(&sensepi_func_default_config);
 
-    current_state = ADVERTISING; //So that a state change happens
-    irq_msg_push(MSG_STATE_CHANGE, (void *)SENSING);
+    if(is_warm && (warm_boot_state()->mode != SENSING))
+    {
+        //Reset while with the app, so advertise for it to connect again
+        current_state = SENSING; //So that a state change happens
+        irq_msg_push(MSG_STATE_CHANGE, (void *)ADVERTISING);
+    }
+    else
+    {
+        current_state = ADVERTISING; //So that a state change happens
+        irq_msg_push(MSG_STATE_CHANGE, (void *)SENSING);
+    }
     sensepi_ble_init(ble_evt_handler, get_sensepi_config_t);
-    sensepi_store_config_check_fw_ver ();
-    load_last_config ();
+    if(is_warm)
+    {
+        //The configuration in use before the reset, without the flash scan
+        sensepi_func_update_settings(
+            (sensepi_ble_config_t *) warm_boot_state()->app_data);
+        resume_sensing();
+    }
+    else
+    {
+        sensepi_store_config_check_fw_ver ();
+        load_last_config ();
+    }
     while (true)
     {
 #if ENABLE_WDT == 1
@@ -553,8 +646,8 @@ int main(void)
         hal_wdt_feed();
 #endif
         device_tick_process();
+        //Sleeps in idle_handler once the events are processed
         irq_msg_process();
-        slumber();
     }
 }
 
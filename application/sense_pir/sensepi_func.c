@@ -88,6 +88,9 @@ static uint32_t g_add_ticks_motion_feedback = 0;
 /** Array to store state of each trigger : [pir_timer] : {OFF,ON} */
 static mod_state_t g_arr_mod_state[MOTION_AND_TIMER];
 
+/** Array to store number of camera triggers of each type : [pir_timer] */
+static uint32_t g_arr_trigger_count[MOTION_AND_TIMER];
+
 
 /** Function to assign variables */
 void assign_varaibles ();
@@ -326,6 +329,7 @@ void mod_motion_handler ()
     if(cam_trigger_is_on () != true)
     {
         cam_trigger (g_motion_current_settings);
+        g_arr_trigger_count[MOTION_ONLY]++;
     }
 }
 
@@ -389,6 +393,7 @@ void mod_timer_handler ()
     if(cam_trigger_is_on () == false)
     {
         cam_trigger (g_timer_current_settings);
+        g_arr_trigger_count[TIMER_ONLY]++;
     }
 }
 
@@ -533,6 +538,11 @@ sensepi_func_modes_t sensepi_func_get_current_mode ()
     return g_current_mode;
 }
 
+uint32_t * sensepi_func_get_trigger_counts ()
+{
+    return g_arr_trigger_count;
+}
+
 void sensepi_func_add_ticks (uint32_t ticks)
 {
     //pass ticks to every sub-modules' individual add tick function 
@@ -143,6 +143,13 @@ void sensepi_func_stop ();
  */
 sensepi_func_modes_t sensepi_func_get_current_mdoe ();
 
+/**
+ * @brief Function to get the number of camera triggers since the boot
+ * @return Array of the counts, indexed by MOTION_ONLY and TIMER_ONLY, which
+ *  can be written to restore the counts after a warm boot
+ */
+uint32_t * sensepi_func_get_trigger_counts ();
+
 /**
  * @bierf Function to send ticks since last add_ticks event
  * @param ticks Ticks since last add_ticks event.
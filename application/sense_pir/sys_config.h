@@ -58,6 +58,9 @@
 #define GPIOTE_CH_USED_BUTTON_UI_PORT 
 /** RTC used for MS_TIMER module */
 #define RTC_USED_MS_TIMER 1
+/** RTC used as the time base of the power manager, shared with MS_TIMER
+ *  as the nRF52810 has no RTC2 */
+#define RTC_USED_PWR_MGR RTC_USED_MS_TIMER
 /** RTC used for TSSP detect module */
 #define RTC_USED_AUX_CLK 0
 /** MS_TIMER used for Device Ticks module */
@@ -66,8 +69,8 @@
 #define MS_TIMER_USED_OUT_GEN 1
 /** MS_TIMER used for SenseBe TxRx module */
 #define MS_TIMER_USED_SENSEPI 2
-
-#define MS_TIMER_USED_SENSEPI_RADIO_CONTROL 3
+/** MS_TIMER used for Button UI module */
+#define MS_TIMER_USED_BUTTON_UI 3
 /** Number of PPI channels used for AUX clock module */
 #define PPI_CHANNELS_USED_AUX_CLK 3
 /** Base number for PPI channels in AUX clock module */
@@ -94,6 +97,18 @@
 #define TIMER_CHANNEL_USED_RADIO_TRIGGER_1 1
 /** 3rd timer channel used for radio trigger module */
 #define TIMER_CHANNEL_USED_RADIO_TRIGGER_2 2
+/** Timer with which out pattern gen places the camera trigger edges */
+#define TIMER_USED_OUT_GEN 1
+/** Number of camera trigger pins generated with the timer */
+#define OUT_GEN_HW_NUM_OUT 2
+/** PPI channel toggling the 1st camera trigger pin */
+#define PPI_CH_USED_OUT_GEN_0 5
+/** PPI channel toggling the 2nd camera trigger pin */
+#define PPI_CH_USED_OUT_GEN_1 6
+/** GPIOTE channel of the 1st camera trigger pin */
+#define GPIOTE_CH_USED_OUT_GEN_0 0
+/** GPIOTE channel of the 2nd camera trigger pin */
+#define GPIOTE_CH_USED_OUT_GEN_1 1
 /** SAADC channel used for Simple ADC module */
 #define SAADC_CHANNEL_USED_SIMPLE_ADC 1
 /** SAADC channel used for PIR Sense module */
@@ -102,6 +117,10 @@
 #define SWI_USED_SENSEPI_BLE 1
 /** SWI used for Evt SD Handler module */
 #define SWI_USED_EVT_SD_HANDLER 2
+/** The faults are recorded for the warm boot module */
+#define WARM_BOOT_USED
+/** Words of the warm boot snapshot to hold the sensepi_ble_config_t */
+#define WARM_BOOT_APP_DATA_WORDS 52
 
 
 #endif /* SYS_CONFIG_H */
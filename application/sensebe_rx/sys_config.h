@@ -56,6 +56,9 @@
 
 /** RTC used for MS_TIMER module */
 #define RTC_USED_MS_TIMER 1
+/** RTC used as the time base of the power manager, shared with MS_TIMER
+ *  as the nRF52810 has no RTC2 */
+#define RTC_USED_PWR_MGR RTC_USED_MS_TIMER
 /** RTC used for TSSP detect module */
 #define RTC_USED_TSSP_DETECT 0
 /** MS_TIMER used for Device Ticks module */
@@ -64,8 +67,8 @@
 #define MS_TIMER_USED_OUT_GEN 1
 /** MS_TIMER used for SenseBe TxRx module */
 #define MS_TIMER_USED_SENSBE_TX_RX 2
-
-#define MS_TIMER_USED_SENSEBE_RADIO_CONTROL 3
+/** MS_TIMER used for Button UI module */
+#define MS_TIMER_USED_BUTTON_UI 3
 /** 1st PPI channel used for TSSP detect module */
 #define PPI_CH_USED_TSSP_DETECT_1 0
 /** 2nd PPI channel used for TSSP detect module */
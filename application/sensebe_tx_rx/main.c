@@ -37,6 +37,7 @@
 #include "boards.h"
 
 #include "log.h"
+#include "pwr_mgr.h"
 #include "hal_wdt.h"
 #include "nrf_util.h"
 #include "hal_gpio.h"
@@ -256,7 +257,6 @@ static void get_sensebe_config_t(sensebe_config_t *config)
 void next_interval_handler(uint32_t interval)
 {
     log_printf("in %d\n", interval);
-    button_ui_add_tick(interval);
     switch(current_state)
     {
     case SENSING:
@@ -523,24 +523,6 @@ void load_last_config()
     sensebe_tx_rx_update_config (sensebe_store_config_get_last_config ());
 }
 
-/**
- * Different calls to sleep depending on the status of Softdevice
- */
-void slumber(void)
-{
-    uint8_t is_sd_enabled;
-    sd_softdevice_is_enabled(&is_sd_enabled);
-    // Would in the SENSING mode
-    if(is_sd_enabled == 0)
-    {
-        __WFI();
-    }
-    else
-    {
-        sd_app_evt_wait();
-    }
-}
-
 /**
  * @brief Function for application main entry.
  */
@@ -585,7 +567,7 @@ int main(void)
 #endif
         device_tick_process();
         irq_msg_process();
-        slumber();
+        pwr_mgr_sleep();
     }
 }
 
@@ -18,6 +18,7 @@
 
 #include "template_isr_manager.h"
 #include "nrf.h"
+#include "isr_dispatch.h"
 
 #if SYS_CFG_PRESENT == 1
 #include "sys_config.h"
@@ -33,103 +34,54 @@ void POWER_CLOCK_IRQHandler (void)
 
 void RADIO_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_RADIO);
 #if defined HAL_RADIO_PERIPH_USED
-    hal_radio_Handler ();
+    ISR_DISPATCH_CALL (hal_radio_Handler, fired);
 #endif
 
 #if defined RADIO_PERIPH_USED_BLE_ADV
-    ble_adv_radio_Handler ();
-#endif
-    NRF_RADIO->EVENTS_ADDRESS = 0;
-    NRF_RADIO->EVENTS_BCMATCH = 0;
-    NRF_RADIO->EVENTS_CRCERROR = 0;
-    NRF_RADIO->EVENTS_CRCOK = 0;
-    NRF_RADIO->EVENTS_DEVMATCH = 0;
-    NRF_RADIO->EVENTS_DEVMISS = 0;
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    NRF_RADIO->EVENTS_END = 0;
-    NRF_RADIO->EVENTS_PAYLOAD = 0;
-    NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->EVENTS_RSSIEND = 0;
-    
+    ISR_DISPATCH_CALL (ble_adv_radio_Handler, fired);
+#endif
 }
 
 void UARTE0_UART0_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_UARTE0);
 #if defined LOG_UART_PRINTF
-    hal_uart_Handler ();
+    ISR_DISPATCH_CALL (hal_uart_Handler, fired);
 #elif defined LOG_UART_DMA_PRINTF
-    uart_printf_uart_Handler ();
-#endif
-//Clear events
-    NRF_UARTE0->EVENTS_CTS = 0;
-    NRF_UARTE0->EVENTS_ENDRX = 0;
-    NRF_UARTE0->EVENTS_ENDTX = 0;
-    NRF_UARTE0->EVENTS_ERROR = 0;
-    NRF_UARTE0->EVENTS_NCTS = 0;
-    NRF_UARTE0->EVENTS_RXDRDY = 0;
-    NRF_UARTE0->EVENTS_RXSTARTED = 0;
-    NRF_UARTE0->EVENTS_RXTO = 0;
-    NRF_UARTE0->EVENTS_TXDRDY = 0;
-    NRF_UARTE0->EVENTS_TXSTARTED = 0;
-    NRF_UARTE0->EVENTS_TXSTOPPED = 0;
-    
+    ISR_DISPATCH_CALL (uart_printf_uart_Handler, fired);
+#endif
 }
 
 void SPIM0_SPIS0_TWIM0_TWIS0_SPI0_TWI0_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_SPIM0);
 #if defined HAL_SPIM_PERIPH_USED
 #if HAL_SPIM_PERIPH_USED == 0
-    hal_spim_Handler ();
+    ISR_DISPATCH_CALL (hal_spim_Handler, fired);
 #endif
 #endif
 #if defined HAL_TWIM_PERIPH_USED 
 #if HAL_TWIM_PERIPH_USED == 0
-    hal_twim_Handler ();
+    ISR_DISPATCH_CALL (hal_twim_Handler, fired);
 #endif
 #endif
-//Clear events
-    NRF_SPIM0->EVENTS_END = 0;
-    NRF_SPIM0->EVENTS_ENDRX = 0;
-    NRF_SPIM0->EVENTS_ENDTX = 0;
-    NRF_SPIM0->EVENTS_STARTED = 0;
-    NRF_SPIM0->EVENTS_STOPPED = 0;
-    
-    NRF_TWIM0->EVENTS_ERROR = 0;
-    NRF_TWIM0->EVENTS_LASTRX = 0;
-    NRF_TWIM0->EVENTS_LASTTX = 0;
-    NRF_TWIM0->EVENTS_RXSTARTED = 0;
-    NRF_TWIM0->EVENTS_STOPPED = 0;
-    NRF_TWIM0->EVENTS_SUSPENDED = 0;
-    NRF_TWIM0->EVENTS_TXSTARTED = 0;
 }
 #if defined NRF52840
 void SPIM1_SPIS1_TWIM1_TWIS1_SPI1_TWI1_IRQHandler ()
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_SPIM1);
 #if defined HAL_SPIM_PERIPH_USED
 #if HAL_SPIM_PERIPH_USED == 1
-    hal_spim_Handler ();
+    ISR_DISPATCH_CALL (hal_spim_Handler, fired);
 #endif
 #endif
 #if defined HAL_TWIM_PERIPH_USED
 #if HAL_TWIM_PERIPH_USED == 1
-    hal_twim_Handler ();
+    ISR_DISPATCH_CALL (hal_twim_Handler, fired);
 #endif
 #endif
-//Clear events
-    NRF_SPIM1->EVENTS_END = 0;
-    NRF_SPIM1->EVENTS_ENDRX = 0;
-    NRF_SPIM1->EVENTS_ENDTX = 0;
-    NRF_SPIM1->EVENTS_STARTED = 0;
-    NRF_SPIM1->EVENTS_STOPPED = 0;
-    
-    NRF_TWIM1->EVENTS_ERROR = 0;
-    NRF_TWIM1->EVENTS_LASTRX = 0;
-    NRF_TWIM1->EVENTS_LASTTX = 0;
-    NRF_TWIM1->EVENTS_RXSTARTED = 0;
-    NRF_TWIM1->EVENTS_STOPPED = 0;
-    NRF_TWIM1->EVENTS_SUSPENDED = 0;
-    NRF_TWIM1->EVENTS_TXSTARTED = 0;
 }
 
 void NFCT_IRQHandler (void)
@@ -138,43 +90,34 @@ void NFCT_IRQHandler (void)
 #endif
 void GPIOTE_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_GPIOTE);
 #if defined GPIOTE_CH_USED_BUTTON_UI_PORT
-    button_ui_gpiote_Handler ();
+    ISR_DISPATCH_CALL (gpio_edge_gpiote_Handler, fired);
 #endif
-//Clear events
-    NRF_GPIOTE->EVENTS_PORT = 0;
-    NRF_GPIOTE->EVENTS_IN[0] = 0;
-    NRF_GPIOTE->EVENTS_IN[1] = 0;
-    NRF_GPIOTE->EVENTS_IN[2] = 0;
-    NRF_GPIOTE->EVENTS_IN[3] = 0;
-    NRF_GPIOTE->EVENTS_IN[4] = 0;
-    NRF_GPIOTE->EVENTS_IN[5] = 0;
-    NRF_GPIOTE->EVENTS_IN[6] = 0;
-    NRF_GPIOTE->EVENTS_IN[7] = 0;
 }
 
 void SAADC_IRQHandler (void)
 {
-//Clear events
 }
 
 void TIMER0_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_TIMER0);
 #if defined TIMER_USED_TSSP_IR_TX_1
 #if TIMER_USED_TSSP_IR_TX_1 == 0
-    tssp_ir_tx_timer1_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer1_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_TSSP_IR_TX_2
 #if TIMER_USED_TSSP_IR_TX_2 == 0
-    tssp_ir_tx_timer2_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer2_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_US_TIMER
 #if TIMER_USED_US_TIMER == 0
-    us_timer_timer_Handler ();
+    ISR_DISPATCH_CALL (us_timer_timer_Handler, fired);
 #endif
 #endif
 
@@ -189,32 +132,32 @@ void TIMER0_IRQHandler (void)
     
 #endif
 #endif
-//Clear events
-    NRF_TIMER0->EVENTS_COMPARE[0] = 0;
-    NRF_TIMER0->EVENTS_COMPARE[1] = 0;
-    NRF_TIMER0->EVENTS_COMPARE[2] = 0;
-    NRF_TIMER0->EVENTS_COMPARE[3] = 0;
-    NRF_TIMER0->EVENTS_COMPARE[4] = 0;
-    NRF_TIMER0->EVENTS_COMPARE[5] = 0;
+
+#if defined TIMER_USED_OUT_GEN
+#if TIMER_USED_OUT_GEN == 0
+    ISR_DISPATCH_CALL (out_gen_timer_Handler, fired);
+#endif
+#endif
 }
 
 void TIMER1_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_TIMER1);
 #if defined TIMER_USED_TSSP_IR_TX_1
 #if TIMER_USED_TSSP_IR_TX_1 == 1
-    tssp_ir_tx_timer1_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer1_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_TSSP_IR_TX_2
 #if TIMER_USED_TSSP_IR_TX_2 == 1
-    tssp_ir_tx_timer2_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer2_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_US_TIMER
 #if TIMER_USED_US_TIMER == 1
-    us_timer_timer_Handler ();
+    ISR_DISPATCH_CALL (us_timer_timer_Handler, fired);
 #endif
 #endif
 
@@ -227,32 +170,32 @@ void TIMER1_IRQHandler (void)
 #if TIMER_USED_SIMPLE_PWM == 1
 #endif
 #endif
-//Clear events
-    NRF_TIMER1->EVENTS_COMPARE[0] = 0;
-    NRF_TIMER1->EVENTS_COMPARE[1] = 0;
-    NRF_TIMER1->EVENTS_COMPARE[2] = 0;
-    NRF_TIMER1->EVENTS_COMPARE[3] = 0;
-    NRF_TIMER1->EVENTS_COMPARE[4] = 0;
-    NRF_TIMER1->EVENTS_COMPARE[5] = 0;
+
+#if defined TIMER_USED_OUT_GEN
+#if TIMER_USED_OUT_GEN == 1
+    ISR_DISPATCH_CALL (out_gen_timer_Handler, fired);
+#endif
+#endif
 }
 
 void TIMER2_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_TIMER2);
 #if defined TIMER_USED_TSSP_IR_TX_1
 #if TIMER_USED_TSSP_IR_TX_1 == 2
-    tssp_ir_tx_timer1_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer1_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_TSSP_IR_TX_2
 #if TIMER_USED_TSSP_IR_TX_2 == 2
-    tssp_ir_tx_timer2_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer2_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_US_TIMER
 #if TIMER_USED_US_TIMER == 2
-    us_timer_timer_Handler ();
+    ISR_DISPATCH_CALL (us_timer_timer_Handler, fired);
 #endif
 #endif
 
@@ -265,17 +208,17 @@ void TIMER2_IRQHandler (void)
 #if TIMER_USED_SIMPLE_PWM == 2
 #endif
 #endif
-//Clear events
-    NRF_TIMER2->EVENTS_COMPARE[0] = 0;
-    NRF_TIMER2->EVENTS_COMPARE[1] = 0;
-    NRF_TIMER2->EVENTS_COMPARE[2] = 0;
-    NRF_TIMER2->EVENTS_COMPARE[3] = 0;
-    NRF_TIMER2->EVENTS_COMPARE[4] = 0;
-    NRF_TIMER2->EVENTS_COMPARE[5] = 0;
+
+#if defined TIMER_USED_OUT_GEN
+#if TIMER_USED_OUT_GEN == 2
+    ISR_DISPATCH_CALL (out_gen_timer_Handler, fired);
+#endif
+#endif
 }
 
 void RTC0_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_RTC0);
 #if defined RTC_USED_PIR_SENSE
 #if RTC_USED_PIR_SENSE == 0
 #endif
@@ -283,22 +226,15 @@ void RTC0_IRQHandler (void)
 
 #if defined RTC_USED_TSSP_DETECT
 #if RTC_USED_TSSP_DETECT == 0
-    tssp_detect_rtc_Handler ();
+    ISR_DISPATCH_CALL (tssp_detect_rtc_Handler, fired);
 #endif
 #endif
 
 #if defined RTC_USED_MS_TIMER
 #if RTC_USED_MS_TIMER == 0
-    ms_timer_rtc_Handler ();
+    ISR_DISPATCH_CALL (ms_timer_rtc_Handler, fired);
 #endif
 #endif
-//Clear events
-    NRF_RTC0->EVENTS_TICK = 0;
-    NRF_RTC0->EVENTS_OVRFLW = 0;
-    NRF_RTC0->EVENTS_COMPARE[0] = 0;
-    NRF_RTC0->EVENTS_COMPARE[1] = 0;
-    NRF_RTC0->EVENTS_COMPARE[2] = 0;
-    NRF_RTC0->EVENTS_COMPARE[3] = 0;
 }
 
 void TEMP_IRQHandler (void)
@@ -307,6 +243,8 @@ void TEMP_IRQHandler (void)
 
 void RNG_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_RNG);
+    ISR_DISPATCH_CALL (random_num_rng_Handler, fired);
 }
 
 void ECB_IRQHandler (void)
@@ -319,13 +257,13 @@ void CCM_AAR_IRQHandler (void)
 
 void WDT_IRQHandler (void)
 {
-    hal_wdt_Handler ();
-    NRF_WDT->EVENTS_TIMEOUT = 0;
-    (void) NRF_WDT->EVENTS_TIMEOUT;
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_WDT);
+    ISR_DISPATCH_CALL (hal_wdt_Handler, fired);
 }
 
 void RTC1_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_RTC1);
 #if defined RTC_USED_PIR_SENSE
 #if RTC_USED_PIR_SENSE == 1
 #endif
@@ -333,22 +271,15 @@ void RTC1_IRQHandler (void)
 
 #if defined RTC_USED_TSSP_DETECT
 #if RTC_USED_TSSP_DETECT == 1
-    tssp_detect_rtc_Handler ();
+    ISR_DISPATCH_CALL (tssp_detect_rtc_Handler, fired);
 #endif
 #endif
 
 #if defined RTC_USED_MS_TIMER
 #if RTC_USED_MS_TIMER == 1
-    ms_timer_rtc_Handler ();
+    ISR_DISPATCH_CALL (ms_timer_rtc_Handler, fired);
 #endif
 #endif
-//Clear events
-    NRF_RTC1->EVENTS_TICK = 0;
-    NRF_RTC1->EVENTS_OVRFLW = 0;
-    NRF_RTC1->EVENTS_COMPARE[0] = 0;
-    NRF_RTC1->EVENTS_COMPARE[1] = 0;
-    NRF_RTC1->EVENTS_COMPARE[2] = 0;
-    NRF_RTC1->EVENTS_COMPARE[3] = 0;
 }
 
 void QDEC_IRQHandler (void)
@@ -361,9 +292,10 @@ void COMP_LPCOMP_IRQHandler (void)
 
 void SWI0_EGU0_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_EGU0);
 #if defined SWI_USED_EVT_SD_HANDLER
 #if SWI_USED_EVT_SD_HANDLER == 0
-    evt_sd_handler_swi_Handler ();
+    ISR_DISPATCH_CALL (evt_sd_handler_swi_Handler);
 #endif
 #endif
 
@@ -375,18 +307,17 @@ void SWI0_EGU0_IRQHandler (void)
 
 #if defined EGU_USED_TSSP_DETECT
 #if EGU_USED_TSSP_DETECT == 0
-    tssp_detect_swi_Handler ();
-    NRF_EGU0->EVENTS_TRIGGERED[EGU_CHANNEL_USED_TSSP_DETECT] = 0;
+    ISR_DISPATCH_CALL (tssp_detect_swi_Handler, fired);
 #endif
 #endif
-
 }
 
 void SWI1_EGU1_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_EGU1);
 #if defined SWI_USED_EVT_SD_HANDLER
 #if SWI_USED_EVT_SD_HANDLER == 1
-    evt_sd_handler_swi_Handler ();
+    ISR_DISPATCH_CALL (evt_sd_handler_swi_Handler);
 #endif
 #endif
 
@@ -398,8 +329,7 @@ void SWI1_EGU1_IRQHandler (void)
 
 #if defined EGU_USED_TSSP_DETECT
 #if EGU_USED_TSSP_DETECT == 1
-    tssp_detect_swi_Handler ();
-    NRF_EGU1->EVENTS_TRIGGERED[EGU_CHANNEL_USED_TSSP_DETECT] = 0;
+    ISR_DISPATCH_CALL (tssp_detect_swi_Handler, fired);
 #endif
 #endif
 }
@@ -408,7 +338,7 @@ void SWI2_EGU2_IRQHandler (void)
 {
 #if defined SWI_USED_EVT_SD_HANDLER
 #if SWI_USED_EVT_SD_HANDLER == 2
-    evt_sd_handler_swi_Handler ();
+    ISR_DISPATCH_CALL (evt_sd_handler_swi_Handler);
 #endif
 #endif
 
@@ -420,7 +350,7 @@ void SWI2_EGU2_IRQHandler (void)
 
 #if defined EGU_USED_TSSP_DETECT
 #if EGU_USED_TSSP_DETECT == 2
-    tssp_detect_swi_Handler ();
+    ISR_DISPATCH_CALL (tssp_detect_swi_Handler, isr_dispatch_take (NRF_EGU2));
 #endif
 #endif
 }
@@ -429,7 +359,7 @@ void SWI3_EGU3_IRQHandler (void)
 {
 #if defined SWI_USED_EVT_SD_HANDLER
 #if SWI_USED_EVT_SD_HANDLER == 3
-    evt_sd_handler_swi_Handler ();
+    ISR_DISPATCH_CALL (evt_sd_handler_swi_Handler);
 #endif
 #endif
 
@@ -441,7 +371,7 @@ void SWI3_EGU3_IRQHandler (void)
 
 #if defined EGU_USED_TSSP_DETECT
 #if EGU_USED_TSSP_DETECT == 3
-    tssp_detect_swi_Handler ();
+    ISR_DISPATCH_CALL (tssp_detect_swi_Handler, isr_dispatch_take (NRF_EGU3));
 #endif
 #endif
 }
@@ -450,7 +380,7 @@ void SWI4_EGU4_IRQHandler (void)
 {
 #if defined SWI_USED_EVT_SD_HANDLER
 #if SWI_USED_EVT_SD_HANDLER == 4
-    evt_sd_handler_swi_Handler ();
+    ISR_DISPATCH_CALL (evt_sd_handler_swi_Handler);
 #endif
 #endif
 
@@ -463,7 +393,7 @@ void SWI4_EGU4_IRQHandler (void)
 
 #if defined EGU_USED_TSSP_DETECT
 #if EGU_USED_TSSP_DETECT == 4
-    tssp_detect_swi_Handler ();
+    ISR_DISPATCH_CALL (tssp_detect_swi_Handler, isr_dispatch_take (NRF_EGU4));
 #endif
 #endif
 }
@@ -472,7 +402,7 @@ void SWI5_EGU5_IRQHandler (void)
 {
 #if defined SWI_USED_EVT_SD_HANDLER
 #if SWI_USED_EVT_SD_HANDLER == 5
-    evt_sd_handler_swi_Handler ();
+    ISR_DISPATCH_CALL (evt_sd_handler_swi_Handler);
 #endif
 #endif
 
@@ -485,7 +415,7 @@ void SWI5_EGU5_IRQHandler (void)
 
 #if defined EGU_USED_TSSP_DETECT
 #if EGU_USED_TSSP_DETECT == 5
-    tssp_detect_swi_Handler ();
+    ISR_DISPATCH_CALL (tssp_detect_swi_Handler, isr_dispatch_take (NRF_EGU5));
 #endif
 #endif
 }
@@ -493,21 +423,22 @@ void SWI5_EGU5_IRQHandler (void)
 #if defined NRF52840
 void TIMER3_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_TIMER3);
 #if defined TIMER_USED_TSSP_IR_TX_1
 #if TIMER_USED_TSSP_IR_TX_1 == 3
-    tssp_ir_tx_timer1_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer1_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_TSSP_IR_TX_2
 #if TIMER_USED_TSSP_IR_TX_2 == 3
-    tssp_ir_tx_timer2_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer2_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_US_TIMER
 #if TIMER_USED_US_TIMER == 3
-    us_timer_timer_Handler ();
+    ISR_DISPATCH_CALL (us_timer_timer_Handler, fired);
 #endif
 #endif
 
@@ -520,32 +451,32 @@ void TIMER3_IRQHandler (void)
 #if TIMER_USED_SIMPLE_PWM == 3
 #endif
 #endif
-//Clear events
-    NRF_TIMER3->EVENTS_COMPARE[0] = 0;
-    NRF_TIMER3->EVENTS_COMPARE[1] = 0;
-    NRF_TIMER3->EVENTS_COMPARE[2] = 0;
-    NRF_TIMER3->EVENTS_COMPARE[3] = 0;
-    NRF_TIMER3->EVENTS_COMPARE[4] = 0;
-    NRF_TIMER3->EVENTS_COMPARE[5] = 0;
+
+#if defined TIMER_USED_OUT_GEN
+#if TIMER_USED_OUT_GEN == 3
+    ISR_DISPATCH_CALL (out_gen_timer_Handler, fired);
+#endif
+#endif
 }
 
 void TIMER4_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_TIMER4);
 #if defined TIMER_USED_TSSP_IR_TX_1
 #if TIMER_USED_TSSP_IR_TX_1 == 4
-    tssp_ir_tx_timer1_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer1_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_TSSP_IR_TX_2
 #if TIMER_USED_TSSP_IR_TX_2 == 4
-    tssp_ir_tx_timer2_Handler ();
+    ISR_DISPATCH_CALL (tssp_ir_tx_timer2_Handler, fired);
 #endif
 #endif
 
 #if defined TIMER_USED_US_TIMER
 #if TIMER_USED_US_TIMER == 4
-    us_timer_timer_Handler ();
+    ISR_DISPATCH_CALL (us_timer_timer_Handler, fired);
 #endif
 #endif
 
@@ -558,35 +489,23 @@ void TIMER4_IRQHandler (void)
 #if TIMER_USED_SIMPLE_PWM == 4
 #endif
 #endif
-//Clear events
-    NRF_TIMER4->EVENTS_COMPARE[0] = 0;
-    NRF_TIMER4->EVENTS_COMPARE[1] = 0;
-    NRF_TIMER4->EVENTS_COMPARE[2] = 0;
-    NRF_TIMER4->EVENTS_COMPARE[3] = 0;
-    NRF_TIMER4->EVENTS_COMPARE[4] = 0;
-    NRF_TIMER4->EVENTS_COMPARE[5] = 0;
+
+#if defined TIMER_USED_OUT_GEN
+#if TIMER_USED_OUT_GEN == 4
+    ISR_DISPATCH_CALL (out_gen_timer_Handler, fired);
+#endif
+#endif
 }
 #endif
 
 void PWM0_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_PWM0);
 #if defined HAL_PWM_PERIPH_USED 
 #if HAL_PWM_PERIPH_USED == 0
-    hal_pwm_Handler ();
+    ISR_DISPATCH_CALL (hal_pwm_Handler, fired);
 #endif
 #endif
-//Clear events
-    NRF_PWM0->EVENTS_LOOPSDONE = 0;
-    NRF_PWM0->EVENTS_PWMPERIODEND = 0;
-    NRF_PWM0->EVENTS_SEQEND[0] = 0;
-    NRF_PWM0->EVENTS_SEQEND[1] = 0;
-    NRF_PWM0->EVENTS_SEQEND[2] = 0;
-    NRF_PWM0->EVENTS_SEQEND[3] = 0;
-    NRF_PWM0->EVENTS_SEQSTARTED[0] = 0;
-    NRF_PWM0->EVENTS_SEQSTARTED[1] = 0;
-    NRF_PWM0->EVENTS_SEQSTARTED[2] = 0;
-    NRF_PWM0->EVENTS_SEQSTARTED[3] = 0;
-    NRF_PWM0->EVENTS_STOPPED = 0;
 }
 
 void PDM_IRQHandler (void)
@@ -600,34 +519,26 @@ void MWU_IRQHandler (void)
 #if defined NRF52840
 void PWM1_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_PWM1);
 #if defined HAL_PWM_PERIPH_USED 
 #if HAL_PWM_PERIPH_USED == 1
-    hal_pwm_Handler ();
+    ISR_DISPATCH_CALL (hal_pwm_Handler, fired);
 #endif
 #endif
-    NRF_PWM1->EVENTS_LOOPSDONE = 0;
-    NRF_PWM1->EVENTS_PWMPERIODEND = 0;
-    NRF_PWM1->EVENTS_SEQEND = 0;
-    NRF_PWM1->EVENTS_SEQSTARTED = 0;
-    NRF_PWM1->EVENTS_STOPPED = 0;
 }
 
 void PWM2_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_PWM2);
 #if defined HAL_PWM_PERIPH_USED 
 #if HAL_PWM_PERIPH_USED == 2
 #endif
 #endif
-//Clear events
-    NRF_PWM2->EVENTS_LOOPSDONE = 0;
-    NRF_PWM2->EVENTS_PWMPERIODEND = 0;
-    NRF_PWM2->EVENTS_SEQEND = 0;
-    NRF_PWM2->EVENTS_SEQSTARTED = 0;
-    NRF_PWM2->EVENTS_STOPPED = 0;
 }
 
 void SPIM2_SPIS2_SPI2_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_SPIM2);
 #if defined HAL_SPIM_PERIPH_USED
 #if HAL_SPIM_PERIPH_USED == 2
 #endif
@@ -637,24 +548,11 @@ void SPIM2_SPIS2_SPI2_IRQHandler (void)
 #if HAL_TWIM_PERIPH_USED == 2
 #endif
 #endif
-//Clear events
-    NRF_SPIM2->EVENTS_END = 0;
-    NRF_SPIM2->EVENTS_ENDRX = 0;
-    NRF_SPIM2->EVENTS_ENDTX = 0;
-    NRF_SPIM2->EVENTS_STARTED = 0;
-    NRF_SPIM2->EVENTS_STOPPED = 0;
-    
-    NRF_TWIM2->EVENTS_ERROR = 0;
-    NRF_TWIM2->EVENTS_LASTRX = 0;
-    NRF_TWIM2->EVENTS_LASTTX = 0;
-    NRF_TWIM2->EVENTS_RXSTARTED = 0;
-    NRF_TWIM2->EVENTS_STOPPED = 0;
-    NRF_TWIM2->EVENTS_SUSPENDED = 0;
-    NRF_TWIM2->EVENTS_TXSTARTED = 0;
 }
 
 void RTC2_IRQHandler (void)
 {
+    uint32_t fired __attribute__((unused)) = isr_dispatch_take (NRF_RTC2);
 #if defined RTC_USED_PIR_SENSE
 #if RTC_USED_PIR_SENSE == 2
 #endif
@@ -669,10 +567,6 @@ void RTC2_IRQHandler (void)
 #if RTC_USED_MS_TIMER == 2
 #endif
 #endif
-//Clear events
-    NRF_RTC2->EVENTS_TICK = 0;
-    NRF_RTC2->EVENTS_OVRFLW = 0;
-    NRF_RTC2->EVENTS_COMPARE = 0;
 }
 
 void I2S_IRQHandler (void)
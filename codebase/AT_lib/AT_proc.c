@@ -24,6 +24,7 @@
 #include "nrf_util.h"
 #include "ms_timer.h"
 #include "hal_nop_delay.h"
+#include "prof_region.h"
 
 /** List of all possiable states for command */
 typedef enum 
@@ -237,6 +238,7 @@ void process_rsp ()
 {  
     if((g_current_status == CMD_RUNNING) || (g_current_status == CMD_REPEAT))
     {
+        PROF_REGION_START(AT_proc_rsp);
         if(rsp_is_var)
         {
             var_rsp_handler ();
@@ -245,6 +247,7 @@ void process_rsp ()
         {
             fix_rsp_handler ();
         }
+        PROF_REGION_STOP(AT_proc_rsp);
     }
     else
     {
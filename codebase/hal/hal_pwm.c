@@ -20,6 +20,7 @@
 #include "nrf_assert.h"
 #include "hal_gpio.h"
 #include "stddef.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -54,71 +55,46 @@ static void call_handler(hal_pwm_irq_mask_t irq_source)
     }
 }
 #if ISR_MANAGER == 1
-void hal_pwm_Handler (void)
+void hal_pwm_Handler (uint32_t fired)
 #else
 void PWM_IRQ_Handler(void)
 #endif
 {
-    if(PWM_ID->EVENTS_STOPPED == 1)
-    {
 #if ISR_MANAGER == 0
-        PWM_ID->EVENTS_STOPPED = 0;
-        (void) PWM_ID->EVENTS_STOPPED;
+    uint32_t fired = isr_dispatch_take (PWM_ID);
 #endif
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_STOPPED))
+    {
         call_handler(HAL_PWM_IRQ_STOPPED_MASK);
     }
 
-    if(PWM_ID->EVENTS_SEQSTARTED[0] == 1)
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_SEQSTARTED[0]))
     {
-#if ISR_MANAGER == 0
-        PWM_ID->EVENTS_SEQSTARTED[0] = 0;
-        (void) PWM_ID->EVENTS_SEQSTARTED[0];
-#endif
         call_handler(HAL_PWM_IRQ_SEQSTARTED0_MASK);
     }
 
-    if(PWM_ID->EVENTS_SEQSTARTED[1] == 1)
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_SEQSTARTED[1]))
     {
-#if ISR_MANAGER == 0
-        PWM_ID->EVENTS_SEQSTARTED[1] = 0;
-        (void) PWM_ID->EVENTS_SEQSTARTED[1];
-#endif
         call_handler(HAL_PWM_IRQ_SEQSTARTED1_MASK);
     }
 
-    if(PWM_ID->EVENTS_SEQEND[0] == 1)
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_SEQEND[0]))
     {
-#if ISR_MANAGER == 0
-        PWM_ID->EVENTS_SEQEND[0] = 0;
-        (void) PWM_ID->EVENTS_SEQEND[0];
-#endif
         call_handler(HAL_PWM_IRQ_SEQEND0_MASK);
     }
 
-    if(PWM_ID->EVENTS_SEQEND[1] == 1)
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_SEQEND[1]))
     {
-#if ISR_MANAGER == 0
-        PWM_ID->EVENTS_SEQEND[1] = 0;
-        (void) PWM_ID->EVENTS_SEQEND[1];
-#endif
         call_handler(HAL_PWM_IRQ_SEQEND1_MASK);
     }
 
-    if(PWM_ID->EVENTS_PWMPERIODEND == 1)
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_PWMPERIODEND))
     {
-#if ISR_MANAGER == 0
-        PWM_ID->EVENTS_PWMPERIODEND = 0;
-        (void) PWM_ID->EVENTS_PWMPERIODEND;
-#endif
         call_handler(HAL_PWM_IRQ_PWMPERIODEND_MASK);
     }
 
-    if(PWM_ID->EVENTS_LOOPSDONE == 1)
+    if(fired & ISR_DISPATCH_EVT(PWM_ID, PWM_ID->EVENTS_LOOPSDONE))
     {
-#if ISR_MANAGER == 0
-        PWM_ID->EVENTS_LOOPSDONE = 0;
-        (void) PWM_ID->EVENTS_LOOPSDONE;
-#endif
         call_handler(HAL_PWM_IRQ_LOOPSDONE_MASK);
     }
 }
@@ -198,6 +174,15 @@ void hal_pwm_start(hal_pwm_start_t * start_config)
     PWM_ID->INTEN = 0;
     PWM_ID->TASKS_STOP = 1;
 
+    //Events of a previous run mustn't reach the handler of this one
+    PWM_ID->EVENTS_STOPPED = 0;
+    PWM_ID->EVENTS_SEQSTARTED[0] = 0;
+    PWM_ID->EVENTS_SEQSTARTED[1] = 0;
+    PWM_ID->EVENTS_SEQEND[0] = 0;
+    PWM_ID->EVENTS_SEQEND[1] = 0;
+    PWM_ID->EVENTS_PWMPERIODEND = 0;
+    PWM_ID->EVENTS_LOOPSDONE = 0;
+
     PWM_ID->ENABLE = (PWM_ENABLE_ENABLE_Enabled << PWM_ENABLE_ENABLE_Pos);
     PWM_ID->COUNTERTOP = (start_config->countertop << PWM_COUNTERTOP_COUNTERTOP_Pos);
     PWM_ID->LOOP = (start_config->loop << PWM_LOOP_CNT_Pos);
@@ -232,3 +217,14 @@ void hal_pwm_stop(void)
     PWM_ID->TASKS_STOP = 1;
     PWM_ID->ENABLE = (PWM_ENABLE_ENABLE_Disabled << PWM_ENABLE_ENABLE_Pos);
 }
+
+void hal_pwm_set_seq_len(uint32_t seq_no, uint16_t len)
+{
+    ASSERT(seq_no < 2);
+    PWM_ID->SEQ[seq_no].CNT = len << PWM_SEQ_CNT_CNT_Pos;
+}
+
+void hal_pwm_set_shorts(uint32_t shorts_mask)
+{
+    PWM_ID->SHORTS = shorts_mask;
+}
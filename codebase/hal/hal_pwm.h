@@ -224,6 +224,21 @@ void hal_pwm_start(hal_pwm_start_t * start_config);
  */
 void hal_pwm_stop(void);
 
+/**
+ * @brief Change the number of values of a sequence while the PWM is running.
+ *  The new length is used from the next time the sequence starts, so the
+ *  buffer of a sequence can be refilled on its SEQEND event.
+ * @param seq_no The sequence, either 0 or 1
+ * @param len Number of 16-bit values in the sequence's buffer
+ */
+void hal_pwm_set_seq_len(uint32_t seq_no, uint16_t len);
+
+/**
+ * @brief Change the shortcuts while the PWM is running
+ * @param shorts_mask OR of the values in @ref hal_pwm_short_mask_t
+ */
+void hal_pwm_set_shorts(uint32_t shorts_mask);
+
 #endif /* CODEBASE_HAL_HAL_PWM_H_ */
 
 /**
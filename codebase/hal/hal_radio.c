@@ -21,6 +21,8 @@
 
 #include "hal_radio.h"
 #include "nrf.h"
+#include "isr_dispatch.h"
+#include "pwr_mgr.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -72,6 +74,11 @@ void (* pb_tx_done_handler) (void * buff, uint32_t len);
 /** Function pointer buffer for reception done function pointer */
 void (* pb_rx_done_handler) (void * buff, uint32_t len);
 
+/** Client ID with the power manager, which needs the HF crystal from the
+ *  init till the deinit of the radio */
+static uint32_t pwr_client;
+static bool is_pwr_client_reg = false;
+
 void hal_radio_init (hal_radio_config_t * radio_init_config)
 {
     if(radio_init_config->tx_done_handler != NULL)
@@ -83,13 +90,13 @@ void hal_radio_init (hal_radio_config_t * radio_init_config)
         pb_rx_done_handler = radio_init_config->rx_done_handler;
     }
     
-    /**Enable HF Clock*/
-    if(NRF_CLOCK->HFCLKSTAT !=
-      ((CLOCK_HFCLKSTAT_STATE_Running << CLOCK_HFCLKSTAT_STATE_Pos) |
-      (CLOCK_HFCLKSTAT_SRC_Xtal << CLOCK_HFCLKSTAT_SRC_Pos)))
+    /**Enable HF Clock, started and waited for by the power manager*/
+    if(is_pwr_client_reg == false)
     {
-        NRF_CLOCK->TASKS_HFCLKSTART = 1;
+        pwr_client = pwr_mgr_client_register ("hal_radio", 0);
+        is_pwr_client_reg = true;
     }
+    pwr_mgr_need (pwr_client, PWR_MGR_NEED_HFXO);
     
     //Power on Radio
     NRF_RADIO->POWER = RADIO_POWER_POWER_Enabled;
@@ -171,6 +178,7 @@ void hal_radio_deinit ()
     NRF_RADIO->TASKS_DISABLE = 1;
     NRF_RADIO->POWER = (RADIO_POWER_POWER_Disabled << RADIO_POWER_POWER_Pos) &
         RADIO_POWER_POWER_Msk;
+    pwr_mgr_need (pwr_client, PWR_MGR_NEED_NONE);
 }
 
 bool hal_radio_is_on ()
@@ -180,33 +188,27 @@ bool hal_radio_is_on ()
 
 
 #if ISR_MANAGER == 1
-void hal_radio_Handler ()
+void hal_radio_Handler (uint32_t fired)
 #else
 void RADIO_IRQHandler ()
 #endif
 {
-    if(NRF_RADIO->EVENTS_CRCOK == 1)
-    {
 #if ISR_MANAGER == false
-        NRF_RADIO->EVENTS_CRCOK = 0;
+    uint32_t fired = isr_dispatch_take (NRF_RADIO);
 #endif
+    if(fired & ISR_DISPATCH_EVT(NRF_RADIO, NRF_RADIO->EVENTS_CRCOK))
+    {
         if(pb_rx_done_handler != NULL)
         {
             pb_rx_done_handler (payload_buff.p_payload, payload_buff.payload_len - 1);
         }
     }
-    if(NRF_RADIO->EVENTS_CRCERROR == 1)
+    if(fired & ISR_DISPATCH_EVT(NRF_RADIO, NRF_RADIO->EVENTS_CRCERROR))
     {
-#if ISR_MANAGER == false
-        NRF_RADIO->EVENTS_CRCERROR = 0;
-#endif
         
     }
-    if(NRF_RADIO->EVENTS_END == 1)
+    if(fired & ISR_DISPATCH_EVT(NRF_RADIO, NRF_RADIO->EVENTS_END))
     {
-#if ISR_MANAGER == false
-        NRF_RADIO->EVENTS_END = 0;
-#endif
         if(pb_tx_done_handler != NULL)
         {
             pb_tx_done_handler (payload_buff.p_payload, payload_buff.payload_len - 1);
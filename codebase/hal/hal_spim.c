@@ -24,6 +24,7 @@
 #include "stddef.h"
 #include "nrf_assert.h"
 #include "log.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -152,36 +153,32 @@ uint32_t hal_spim_is_busy ()
 }
 
 #if ISR_MANAGER == 1
-void hal_spim_Handler (void)
+void hal_spim_Handler (uint32_t fired)
 #else
 void SPIM_IRQ_Handler (void)
 #endif
 {
-    if(SPIM_ID->EVENTS_END == 1)
-    {
 #if ISR_MANAGER == 0
-        SPIM_ID->EVENTS_END = 0;
+    uint32_t fired = isr_dispatch_take (SPIM_ID);
 #endif
+    if(fired & ISR_DISPATCH_EVT(SPIM_ID, SPIM_ID->EVENTS_END))
+    {
         mod_is_busy = false;
         hal_gpio_pin_set (csBar);
         SPIM_ID->ENABLE = (SPIM_ENABLE_ENABLE_Disabled << SPIM_ENABLE_ENABLE_Pos) &
             SPIM_ENABLE_ENABLE_Msk;
     }
-    if(SPIM_ID->EVENTS_ENDTX == 1 && ((intr_enabled & HAL_SPIM_TX_DONE) != 0))
+    if((fired & ISR_DISPATCH_EVT(SPIM_ID, SPIM_ID->EVENTS_ENDTX)) &&
+            ((intr_enabled & HAL_SPIM_TX_DONE) != 0))
     {
-#if ISR_MANAGER == 0
-        SPIM_ID->EVENTS_ENDTX = 0;
-#endif
         if(tx_done != NULL)
         {
             tx_done(SPIM_ID->TXD.AMOUNT);
         }
     }
-    if(SPIM_ID->EVENTS_ENDRX == 1 && ((intr_enabled & HAL_SPIM_RX_DONE) != 0))
+    if((fired & ISR_DISPATCH_EVT(SPIM_ID, SPIM_ID->EVENTS_ENDRX)) &&
+            ((intr_enabled & HAL_SPIM_RX_DONE) != 0))
     {
-#if ISR_MANAGER == 0
-        SPIM_ID->EVENTS_ENDRX = 0;
-#endif
         if(rx_done != NULL)
         {
             rx_done(SPIM_ID->RXD.AMOUNT);
@@ -19,6 +19,7 @@
 #include "hal_twim.h"
 #include "stdbool.h"
 #include "common_util.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -284,22 +285,19 @@ uint8_t hal_twim_is_working (void)
 }
 
 #if ISR_MANAGER == 1
-void hal_twim_Handler (void)
+void hal_twim_Handler (uint32_t fired)
 #else
 void TWIM_IRQ_Handler(void)
 #endif
 {
-    if(TWIM_ID->EVENTS_ERROR == 1){
 #if ISR_MANAGER == 0
-        TWIM_EVENT_CLEAR(TWIM_ID->EVENTS_ERROR);
+    uint32_t fired = isr_dispatch_take (TWIM_ID);
 #endif
+    if(fired & ISR_DISPATCH_EVT(TWIM_ID, TWIM_ID->EVENTS_ERROR)){
         handle_error();
     }
 
-    if(TWIM_ID->EVENTS_STOPPED == 1){
-#if ISR_MANAGER == 0
-        TWIM_EVENT_CLEAR(TWIM_ID->EVENTS_STOPPED);
-#endif
+    if(fired & ISR_DISPATCH_EVT(TWIM_ID, TWIM_ID->EVENTS_STOPPED)){
         twim_status.transfer_finished = true;
 
         send_event(twim_status.current_transfer);
@@ -20,6 +20,7 @@
 #include "boards.h"
 #include "hal_gpio.h"
 #include "nrf_util.h"
+#include "isr_dispatch.h"
 #include "tinyprintf.h"
 #include "stdbool.h"
 
@@ -98,15 +99,18 @@ static void rx_collect(uint8_t rx_char)
  *  Only data reception causes interrupt. The received data is passed to @ref rx_collect.
  */
 #if ISR_MANAGER == 1
-void hal_uart_Handler ()
+void hal_uart_Handler (uint32_t fired)
 #else
 void UART_IRQ_Handler (void)
 #endif
 {
 #if ISR_MANAGER == 0
-    UART_ID->EVENTS_ENDRX = 0;
+    uint32_t fired = isr_dispatch_take (UART_ID);
 #endif
-    rx_collect(rx_buff);
+    if(fired & ISR_DISPATCH_EVT(UART_ID, UART_ID->EVENTS_ENDRX))
+    {
+        rx_collect(rx_buff);
+    }
 }
 
 void hal_uart_putdata (uint8_t * p_data, uint32_t len)
@@ -20,9 +20,11 @@
 #include "boards.h"
 #include "hal_gpio.h"
 #include "nrf_util.h"
+#include "isr_dispatch.h"
 #include "tinyprintf.h"
 #include "stdbool.h"
 #include "string.h"
+#include "pwr_mgr.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -63,15 +65,21 @@ uint32_t process_count;
 /** Count of number of bytes received by UART, incremented in interrupt*/
 volatile uint32_t rx_count;
 
+/** Client ID with the power manager, which needs the HF clock while receiving */
+static uint32_t pwr_client;
+static bool is_pwr_client_reg = false;
+
 #if ISR_MANAGER == 1
-void hal_uart_Handler ()
+void hal_uart_Handler (uint32_t fired)
 #else
 void UART_IRQ_Handler (void)
 #endif
 {
-    if(NRF_UARTE0->EVENTS_RXDRDY == 1)
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (NRF_UARTE0);
+#endif
+    if(fired & ISR_DISPATCH_EVT(NRF_UARTE0, NRF_UARTE0->EVENTS_RXDRDY))
     {
-        NRF_UARTE0->EVENTS_RXDRDY = 0;
         //This is to increment to zero if it overflows
         rx_count = ((rx_count + 1) & (RX_BUFFER_SIZE - 1));
     }
@@ -100,6 +108,7 @@ void hal_uarte_start_rx(void (*handler) (uint8_t rx_byte))
     rx_count = 0;
     process_count = 0;
 
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_HFCLK);
     NRF_UARTE0->TASKS_STARTRX = 1;
 }
 
@@ -108,6 +117,7 @@ void hal_uarte_stop_rx(void)
     NRF_UARTE0->INTENCLR = 0xFFFFFFFF;
     NVIC_DisableIRQ(UARTE0_UART0_IRQn);
     NRF_UARTE0->TASKS_STOPRX = 1;
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_NONE);
 }
 
 void hal_uarte_putchar(uint8_t cr)
@@ -209,6 +219,12 @@ void hal_uarte_init(hal_uarte_baud_t baud, uint32_t irq_priority)
     init_printf((void *) !(START_TX), printf_callback);
 
     NVIC_SetPriority(UARTE_IRQN, irq_priority);
+
+    if(is_pwr_client_reg == false)
+    {
+        pwr_client = pwr_mgr_client_register("hal_uarte", PWR_MGR_UA_UARTE);
+        is_pwr_client_reg = true;
+    }
 }
 
 void hal_uarte_uninit(void)
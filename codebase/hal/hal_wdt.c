@@ -21,6 +21,7 @@
 #include "hal_wdt.h"
 #include "nrf_util.h"
 #include "common_util.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -74,15 +75,16 @@ void hal_wdt_start(void)
 }
 
 #if ISR_MANAGER == 1
-void hal_wdt_Handler ()
+void hal_wdt_Handler (uint32_t fired)
 #else
 void WDT_IRQHandler(void)
 #endif
 {
 #if ISR_MANAGER == 0
-    NRF_WDT->EVENTS_TIMEOUT = 0;
+    uint32_t fired = isr_dispatch_take (NRF_WDT);
 #endif
-    if (wdt_irq_handler != NULL)
+    if ((fired & ISR_DISPATCH_EVT(NRF_WDT, NRF_WDT->EVENTS_TIMEOUT)) &&
+            (wdt_irq_handler != NULL))
     {
         wdt_irq_handler();
     }
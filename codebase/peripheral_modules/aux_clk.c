@@ -24,6 +24,11 @@
 #include "hal_ppi.h"
 #include "hal_clocks.h"
 #include "common_util.h"
+#include "nrf_util.h"
+#include "isr_dispatch.h"
+#if AUX_CLK_HFCLK_SOLO_MODULE == 1
+#include "pwr_mgr.h"
+#endif
 
 #define RTC_USED  CONCAT_2(NRF_RTC, RTC_USED_AUX_CLK) 
 
@@ -57,6 +62,24 @@
 
 #define TIMER_TICKS_MS(x) (x * 1000)
 
+/** Duration of a RTC tick in us, rounded up */
+#define RTC_TICK_US     31
+
+/** Maximum value of the 24 bit RTC counter */
+#define RTC_COUNTER_MAX 0x00FFFFFF
+
+/** Units of the time base in a us, 1/512 us in which a RTC tick is whole */
+#define UNITS_US        512
+
+/** A tick of the 32768 Hz RTC in the units of the time base */
+#define UNITS_RTC_TICK  15625
+
+/** Units counted by the RTC till its counter wraps */
+#define UNITS_RTC_SPAN  ((uint64_t)(RTC_COUNTER_MAX + 1) * UNITS_RTC_TICK)
+
+/** In the auto mode, the TIMER is used when a deadline is this close */
+#define AUTO_NEAR_US    (AUX_CLK_AUTO_GUARD_US + 3*RTC_TICK_US)
+
 
 /** Function pointer buffer to store callback handler */
 void (*callbac_buffer) (uint8_t events);
@@ -68,92 +91,133 @@ static app_irq_priority_t g_irq_priority;
 
 static aux_clk_ppi_t g_arr_ppi_cnf[PPI_CHANNELS_USED_AUX_CLK];
 
-#if ISR_MANAGER == 1
-void aux_clk_rtc_handler (void)
-#else
-void RTC_IRQ_Handler(void)
+/** Deadlines of the channels in us from the start or the last clear */
+static uint32_t g_cc_us[AUX_CLK_MAX_CHANNELS];
+
+/** Time in us from the start or the last clear at which the running source
+ *  took over. Non zero after a switch of the source. The TIMER counts from
+ *  this time, the RTC from the zero in @ref g_zero_u. */
+static uint32_t g_base_us = 0;
+
+/** Position of the start or the last clear in the count of the RTC, in
+ *  1/512 us. The RTC runs from the start to the stop whatever the source,
+ *  so that a switch doesn't lose the phase of its tick. It is non zero
+ *  after a compare event of the TIMER clears it through PPI. */
+static uint64_t g_zero_u = 0;
+
+/** Events enabled from @ref aux_clk_evt_t */
+static uint8_t g_evts_en = 0;
+
+/** If the source is selected as per the deadlines */
+static bool g_is_auto = false;
+
+/** Channels whose RTC compare is set early in the auto mode to switch to
+ *  the TIMER for the rest of the time to the deadline */
+static uint8_t g_early_evts = 0;
+
+/** If the clock is started */
+static bool g_is_running = false;
+
+static void check_hw_clear (uint8_t events);
+static uint8_t ppi_events (void);
+static void auto_select (void);
+static void switch_src (aux_clk_source_t source);
+
+#if AUX_CLK_HFCLK_SOLO_MODULE == 1
+/** ID of this module as a client of the power manager */
+static uint32_t g_pwr_mgr_id;
+static bool g_is_pwr_mgr_reg = false;
 #endif
+
+/**
+ * @brief Get the compare events of a counter for its handler. The ones which
+ *  can interrupt are in the mask taken by the ISR. The ones only routed
+ *  through PPI are read and cleared here as no ISR takes them, so that a
+ *  clear of the counter through them is known.
+ * @param fired Mask of the events taken by the ISR
+ * @param cc0_evt Mask of the compare event of channel 0 in @p fired
+ * @param evts_compare Compare event registers of the counter
+ * @return Mask of the events from @ref aux_clk_evt_t
+ */
+static uint8_t take_events (uint32_t fired, uint32_t cc0_evt,
+        volatile uint32_t * evts_compare)
 {
+    uint8_t ppi_only = ppi_events () & ~g_evts_en;
     uint8_t events = 0;
-    if(RTC_USED->EVENTS_COMPARE[0] == 1)
+    for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
     {
-        events |= AUX_CLK_EVT_CC0;
-#if isr_manager == 0
-        RTC_USED->EVENTS_COMPARE[0] = 0;
-#endif
+        if(fired & (cc0_evt << cnt))
+        {
+            events |= (1 << cnt);
+        }
+        else if((ppi_only & (1 << cnt)) && evts_compare[cnt])
+        {
+            evts_compare[cnt] = 0;
+            events |= (1 << cnt);
+        }
     }
-    if(RTC_USED->EVENTS_COMPARE[1] == 1)
-    {
-        events |= AUX_CLK_EVT_CC1;
-#if isr_manager == 0
-        RTC_USED->EVENTS_COMPARE[1] = 0;
+    return events;
+}
+
+#if ISR_MANAGER == 1
+void aux_clk_rtc_handler (uint32_t fired)
+#else
+void RTC_IRQ_Handler(void)
 #endif
-    }
-    if(RTC_USED->EVENTS_COMPARE[2] == 1)
-    {
-        events |= AUX_CLK_EVT_CC2;
-#if isr_manager == 0
-        RTC_USED->EVENTS_COMPARE[2] = 0;
+{
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (RTC_USED);
 #endif
+    uint8_t events = take_events (fired,
+            ISR_DISPATCH_EVT(RTC_USED, RTC_USED->EVENTS_COMPARE[0]),
+            RTC_USED->EVENTS_COMPARE);
+    if(g_source != AUX_CLK_SRC_LFCLK)
+    {
+        //The RTC runs on as the time base while the TIMER is the source
+        return;
     }
-    if(RTC_USED->EVENTS_COMPARE[3] == 1)
+    check_hw_clear (events);
+    events &= g_evts_en;
+    if(events & g_early_evts)
     {
-        events |= AUX_CLK_EVT_CC3;
-#if isr_manager == 0
-        RTC_USED->EVENTS_COMPARE[3] = 0;
-#endif
+        //Not a deadline, time to switch to the TIMER till the deadline
+        events &= ~g_early_evts;
+        auto_select ();
     }
-    if(callbac_buffer != NULL)
+    if((callbac_buffer != NULL) && events)
     {
         callbac_buffer (events);
     }
 }
 
 #if ISR_MANAGER == 1
-void aux_clk_timer_handler (void)
+void aux_clk_timer_handler (uint32_t fired)
 #else
 void TIMER_IRQ_Handler (void)
 #endif
 {
-    uint8_t events = 0;
-    if(TIMER_USED->EVENTS_COMPARE[0] == 1)
-    {
-        events |= AUX_CLK_EVT_CC0;
 #if ISR_MANAGER == 0
-        TIMER_USED->EVENTS_COMPARE[0] = 0;
+    uint32_t fired = isr_dispatch_take (TIMER_USED);
 #endif
-    }
-    if(TIMER_USED->EVENTS_COMPARE[1] == 1)
+    uint8_t events = take_events (fired,
+            ISR_DISPATCH_EVT(TIMER_USED, TIMER_USED->EVENTS_COMPARE[0]),
+            TIMER_USED->EVENTS_COMPARE);
+    check_hw_clear (events);
+    events &= g_evts_en;
+    if((callbac_buffer != NULL) && events)
     {
-        events |= AUX_CLK_EVT_CC1;
-#if ISR_MANAGER == 0
-        TIMER_USED->EVENTS_COMPARE[1] = 0;
-#endif
-    }
-    if(TIMER_USED->EVENTS_COMPARE[2] == 1)
-    {
-        events |= AUX_CLK_EVT_CC2;
-#if ISR_MANAGER == 0
-        TIMER_USED->EVENTS_COMPARE[2] = 0;
-#endif
-    }
-    if(TIMER_USED->EVENTS_COMPARE[3] == 1)
-    {
-        events |= AUX_CLK_EVT_CC3;
-#if ISR_MANAGER == 0
-        TIMER_USED->EVENTS_COMPARE[3] = 0;
-#endif
+        callbac_buffer (events);
     }
-    if(callbac_buffer != NULL)
+    if(g_is_auto)
     {
-        callbac_buffer (events);
+        auto_select ();
     }
 }
 
 void set_timer ()
 {
 #if AUX_CLK_HFCLK_SOLO_MODULE == 1
-    hfclk_xtal_init_blocking ();
+    pwr_mgr_need (g_pwr_mgr_id, PWR_MGR_NEED_HFXO);
 #endif
     if(g_irq_priority != APP_IRQ_PRIORITY_THREAD)
     {
@@ -167,7 +231,7 @@ void set_timer ()
 void set_rtc ()
 {
 #if AUX_CLK_HFCLK_SOLO_MODULE == 1
-    hfclk_xtal_deinit ();
+    pwr_mgr_need (g_pwr_mgr_id, PWR_MGR_NEED_NONE);
 #endif
     
     if(g_irq_priority != APP_IRQ_PRIORITY_THREAD)
@@ -268,29 +332,260 @@ void set_ppi ()
     }
 }
 
-void aux_clk_select_src (aux_clk_source_t source)
+/** Mask of the compare events from a PPI channel's event */
+static uint8_t ppi_cmp_evt (uint32_t event)
 {
-    g_source = source;
-    NVIC_DisableIRQ (RTC_IRQN);
-    NVIC_DisableIRQ (TIMER_IRQN); 
-    RTC_USED->TASKS_CLEAR = 1;
-    TIMER_USED->TASKS_CLEAR =1;
+    return ((event >= AUX_CLK_EVT_CC0) && (event <= AUX_CLK_EVT_CC3)) ?
+            (uint8_t) event : 0;
+}
+
+/** Get the compare events which are routed through PPI */
+static uint8_t ppi_events (void)
+{
+    uint8_t events = 0;
+    for(uint32_t cnt = 0; cnt < PPI_CHANNELS_USED_AUX_CLK; cnt++)
+    {
+        events |= ppi_cmp_evt (g_arr_ppi_cnf[cnt].event);
+    }
+    return events;
+}
+
+/** Get the compare events which clear the counter through PPI */
+static uint8_t clear_events (void)
+{
+    uint8_t events = 0;
+    for(uint32_t cnt = 0; cnt < PPI_CHANNELS_USED_AUX_CLK; cnt++)
+    {
+        if((g_arr_ppi_cnf[cnt].task1 == AUX_CLK_TASKS_CLEAR) ||
+           (g_arr_ppi_cnf[cnt].task2 == AUX_CLK_TASKS_CLEAR))
+        {
+            events |= ppi_cmp_evt (g_arr_ppi_cnf[cnt].event);
+        }
+    }
+    return events;
+}
+
+/** Time counted by the RTC since the start or the last clear, in 1/512 us */
+static uint64_t rtc_units (void)
+{
+    return ((uint64_t)RTC_USED->COUNTER * UNITS_RTC_TICK + UNITS_RTC_SPAN
+            - g_zero_u) % UNITS_RTC_SPAN;
+}
+
+/** Time in us since the start or the last clear on the running source */
+static uint32_t elapsed_us (void)
+{
+    if(g_source == AUX_CLK_SRC_LFCLK)
+    {
+        return (uint32_t)(rtc_units () / UNITS_US);
+    }
+    else
+    {
+        uint32_t cc0 = TIMER_USED->CC[0];
+        TIMER_USED->TASKS_CAPTURE[0] = 1;
+        uint32_t counter = TIMER_USED->CC[0];
+        TIMER_USED->CC[0] = cc0;
+        return g_base_us + counter;
+    }
+}
+
+/** Write the compare value of a channel in the running source, relative to
+ *  the zero in the RTC and to the time it took over in the TIMER */
+static void write_cc (uint32_t cnt)
+{
+    uint32_t rel_us;
+    uint32_t cc_us = g_cc_us[cnt];
+    uint8_t evt = (1 << cnt);
+
+    g_early_evts &= ~evt;
+    if(g_cc_us[cnt] < g_base_us)
+    {
+        //Deadline was before the switch, so it isn't hit till a clear
+        RTC_USED->CC[cnt] = RTC_COUNTER_MAX;
+        TIMER_USED->CC[cnt] = 0xFFFFFFFF;
+        return;
+    }
+    rel_us = g_cc_us[cnt] - g_base_us;
+
+    if(g_source == AUX_CLK_SRC_LFCLK)
+    {
+        //In the auto mode, the RTC wakes up early for the interrupt only
+        //deadlines and the TIMER takes over for the rest
+        if(g_is_auto && (g_evts_en & evt) && !(ppi_events () & evt)
+                && (rel_us > AUTO_NEAR_US))
+        {
+            cc_us -= AUX_CLK_AUTO_GUARD_US;
+            g_early_evts |= evt;
+        }
+        RTC_USED->CC[cnt] = (uint32_t)(ROUNDED_DIV(g_zero_u +
+                (uint64_t)cc_us * UNITS_US, UNITS_RTC_TICK)) & RTC_COUNTER_MAX;
+    }
+    else
+    {
+        TIMER_USED->CC[cnt] = rel_us;
+    }
+}
+
+/** Route the PPI channels to the running source without changing
+ *  which of them are enabled */
+static void reroute_ppi (void)
+{
+    hal_ppi_setup_t ppi_setup;
+    for(uint32_t cnt = 0; cnt < PPI_CHANNELS_USED_AUX_CLK; cnt++)
+    {
+        ppi_setup.ppi_id = PPI_CHANNEL_BASE_AUX_CLK + cnt;
+        ppi_setup.event = select_event (g_arr_ppi_cnf[cnt].event);
+        ppi_setup.task = select_task (g_arr_ppi_cnf[cnt].task1);
+        ppi_setup.fork = select_task (g_arr_ppi_cnf[cnt].task2);
+        (void) hal_ppi_set (&ppi_setup);
+    }
+}
+
+/** A compare event which clears the counter through PPI is the new zero.
+ *  The RTC is cleared with it. The TIMER is cleared alone, so the zero moves
+ *  in the count of the RTC by the deadline of the event. The compare values
+ *  are made relative to the new zero. */
+static void check_hw_clear (uint8_t events)
+{
+    uint8_t clr = events & clear_events ();
+    bool is_rewrite = (g_base_us != 0);
+    uint32_t cnt = 0;
+
+    if(clr == 0)
+    {
+        return;
+    }
+    if(g_source == AUX_CLK_SRC_LFCLK)
+    {
+        is_rewrite = is_rewrite || (g_zero_u != 0);
+        g_zero_u = 0;
+    }
+    else
+    {
+        while((clr & (1 << cnt)) == 0)
+        {
+            cnt++;
+        }
+        g_zero_u = (g_zero_u + (uint64_t)g_cc_us[cnt] * UNITS_US) % UNITS_RTC_SPAN;
+    }
+    g_base_us = 0;
+    if(is_rewrite)
+    {
+        for(cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+        {
+            write_cc (cnt);
+        }
+    }
+}
+
+/** Switch the source of a running clock keeping the elapsed time and the
+ *  deadlines. The RTC runs on as the time base, the TIMER starts from zero
+ *  at the time read from the RTC and is given the time remaining to the
+ *  deadlines. So the error stays within a RTC tick however many switches. */
+static void switch_src (aux_clk_source_t source)
+{
+
+#if AUX_CLK_HFCLK_SOLO_MODULE == 1
+    if(source == AUX_CLK_SRC_HFCLK)
+    {
+        //Wait for the crystal before the time is read
+        pwr_mgr_need (g_pwr_mgr_id, PWR_MGR_NEED_HFXO);
+    }
+#endif
+
+    CRITICAL_REGION_ENTER();
+    if(g_source == AUX_CLK_SRC_LFCLK)
+    {
+        NVIC_DisableIRQ (RTC_IRQN);
+    }
+    else
+    {
+        NVIC_DisableIRQ (TIMER_IRQN);
+        TIMER_USED->TASKS_STOP = 1;
+    }
+    TIMER_USED->TASKS_CLEAR = 1;
     for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
     {
         RTC_USED->EVENTS_COMPARE[cnt] = 0;
         TIMER_USED->EVENTS_COMPARE[cnt] = 0;
     }
-    set_ppi ();
+
+    g_base_us = (uint32_t)(rtc_units () / UNITS_US);
+    g_source = source;
+    for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+    {
+        write_cc (cnt);
+    }
+    reroute_ppi ();
     (g_source == AUX_CLK_SRC_LFCLK) ? set_rtc () : set_timer ();
+    CRITICAL_REGION_EXIT();
+}
+
+/** In the auto mode, use the TIMER only when an interrupt only deadline is
+ *  near and the RTC otherwise */
+static void auto_select (void)
+{
+    aux_clk_source_t source = AUX_CLK_SRC_LFCLK;
+    uint32_t now_us;
+    uint8_t events;
 
+    if((g_is_auto == false) || (g_is_running == false))
+    {
+        return;
+    }
+    now_us = elapsed_us ();
+    events = g_evts_en & ~ppi_events ();
+    for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+    {
+        if((events & (1 << cnt)) && (g_cc_us[cnt] >= now_us) &&
+           ((g_cc_us[cnt] - now_us) <= AUTO_NEAR_US))
+        {
+            source = AUX_CLK_SRC_HFCLK;
+        }
+    }
+    if(source != g_source)
+    {
+        switch_src (source);
+    }
+}
+
+void aux_clk_select_src (aux_clk_source_t source)
+{
+    g_is_auto = (source == AUX_CLK_SRC_AUTO);
+    if(g_is_running == false)
+    {
+        g_source = g_is_auto ? AUX_CLK_SRC_LFCLK : source;
+        aux_clk_start ();
+    }
+    else if(g_is_auto)
+    {
+        //Set the RTC compares early if needed
+        switch_src (AUX_CLK_SRC_LFCLK);
+        auto_select ();
+    }
+    else if(source != g_source)
+    {
+        switch_src (source);
+    }
 }
 
 void aux_clk_set (aux_clk_setup_t * aux_clk)
 {
-    g_source = aux_clk->source;
+    g_is_auto = (aux_clk->source == AUX_CLK_SRC_AUTO);
+    g_source = g_is_auto ? AUX_CLK_SRC_LFCLK : aux_clk->source;
+    g_evts_en = aux_clk->events_en;
+    g_base_us = 0;
+    g_zero_u = 0;
     memcpy (g_arr_ppi_cnf, aux_clk->arr_ppi_cnf, 
             (sizeof(aux_clk_ppi_t) * PPI_CHANNELS_USED_AUX_CLK));
     callbac_buffer = aux_clk->callback_handler;
+#if AUX_CLK_HFCLK_SOLO_MODULE == 1
+    if(g_is_pwr_mgr_reg == false)
+    {
+        g_pwr_mgr_id = pwr_mgr_client_register ("aux_clk", PWR_MGR_UA_TIMER);
+        g_is_pwr_mgr_reg = true;
+    }
+#endif
     
     RTC_USED->PRESCALER = 0;
     
@@ -300,6 +595,7 @@ void aux_clk_set (aux_clk_setup_t * aux_clk)
     
     for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
     {
+        g_cc_us[cnt] = TIMER_TICKS_MS(aux_clk->arr_cc_ms[cnt]);
         RTC_USED->CC[cnt] = RTC_TICKS_MS(aux_clk->arr_cc_ms[cnt]);
         TIMER_USED->CC[cnt] = TIMER_TICKS_MS(aux_clk->arr_cc_ms[cnt]);
         if((aux_clk->events_en & (uint8_t)(1<<cnt)))
@@ -314,12 +610,30 @@ void aux_clk_set (aux_clk_setup_t * aux_clk)
 
 void aux_clk_start ()
 {
+    g_is_running = true;
+    for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+    {
+        write_cc (cnt);
+    }
     set_ppi ();
-    (g_source == AUX_CLK_SRC_LFCLK) ? set_rtc () : set_timer ();
+    if(g_source == AUX_CLK_SRC_LFCLK)
+    {
+        set_rtc ();
+    }
+    else
+    {
+        //The RTC is the time base for a later switch
+        RTC_USED->TASKS_START = 1;
+        set_timer ();
+    }
+    auto_select ();
 }
 
 void aux_clk_stop ()
 {
+    g_is_running = false;
+    g_base_us = 0;
+    g_zero_u = 0;
     NVIC_DisableIRQ (RTC_IRQN);
     RTC_USED->TASKS_CLEAR = 1;
     RTC_USED->TASKS_STOP = 1;
@@ -328,23 +642,56 @@ void aux_clk_stop ()
     TIMER_USED->TASKS_STOP = 1;
     TIMER_USED->TASKS_SHUTDOWN = 1;    
     (void) TIMER_USED->TASKS_SHUTDOWN;
+#if AUX_CLK_HFCLK_SOLO_MODULE == 1
+    pwr_mgr_need (g_pwr_mgr_id, PWR_MGR_NEED_NONE);
+#endif
 }
  
 void aux_clk_clear ()
 {
+    bool is_rewrite = (g_base_us != 0) || (g_zero_u != 0);
     TIMER_USED->TASKS_CLEAR = 1;
     RTC_USED->TASKS_CLEAR = 1;
+    g_zero_u = 0;
+    if(is_rewrite)
+    {
+        g_base_us = 0;
+        for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+        {
+            write_cc (cnt);
+        }
+    }
+    auto_select ();
 }
 
 void aux_clk_en_evt (uint8_t events)
 {
+    for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+    {
+        //Compare events set while the interrupt was disabled are stale
+        if((events & ~g_evts_en) & (1 << cnt))
+        {
+            RTC_USED->EVENTS_COMPARE[cnt] = 0;
+            TIMER_USED->EVENTS_COMPARE[cnt] = 0;
+        }
+    }
+    g_evts_en |= events;
     RTC_USED->EVTENSET |= (events << 16);
     RTC_USED->INTENSET |= (events << 16);        
     TIMER_USED->INTENSET |= (events << 16);
+    if(g_is_auto)
+    {
+        for(uint32_t cnt = 0; cnt < AUX_CLK_MAX_CHANNELS; cnt++)
+        {
+            write_cc (cnt);
+        }
+        auto_select ();
+    }
 }
 
 void aux_clk_dis_evt (uint8_t events)
 {
+    g_evts_en &= ~events;
     RTC_USED->EVTENCLR |= (events << 16);
     RTC_USED->INTENCLR |= (events << 16);        
     TIMER_USED->INTENCLR |= (events << 16);
@@ -366,8 +713,9 @@ void aux_clk_update_ppi (uint32_t ppi_channel, aux_clk_ppi_t * new_ppi)
 
 void aux_clk_update_cc (uint32_t cc_id,uint32_t new_val_ms)
 {
-    TIMER_USED->CC[cc_id] = TIMER_TICKS_MS(new_val_ms);
-    RTC_USED->CC[cc_id] = RTC_TICKS_MS(new_val_ms);
+    g_cc_us[cc_id] = TIMER_TICKS_MS(new_val_ms);
+    write_cc (cc_id);
+    auto_select ();
 }
 
 void aux_clk_update_irq_priority (app_irq_priority_t new_priority)
@@ -377,23 +725,9 @@ void aux_clk_update_irq_priority (app_irq_priority_t new_priority)
 
 uint32_t aux_clk_get_ms (void)
 {
-    uint32_t ms;
-    
-    if(g_source ==AUX_CLK_SRC_LFCLK)
-    {
-        ms = (RTC_USED->COUNTER * 1000)/32768;
-    }
-    else
-    {
-        uint32_t cc0 = TIMER_USED->CC[0];
-        TIMER_USED->TASKS_CAPTURE[0] = 1;
-        uint32_t counter = TIMER_USED->CC[0];
-        TIMER_USED->CC[0] = cc0;
-        ms = counter / 1000;
-    }
-    
-    return ms;
+    return elapsed_us () / 1000;
 }
+
 void aux_clk_dis_ppi_ch (uint32_t aux_ppi_channel)
 {
     hal_ppi_dis_ch (aux_ppi_channel);
@@ -27,6 +27,22 @@
  * @brief Module to manage auxiliary clock used by other modules like pir_sense
  * and tssp_detect. This module will switch between RTC(LFCLK) and TIMER(HFCLK)
  * as needed
+ *
+ * The source can be switched while the clock runs. The elapsed time and the
+ * deadlines are kept across the switches with an error of up to one RTC tick
+ * (31 us) however many switches there are, as the RTC keeps running as the
+ * time base while the TIMER is the source. The TIMER counts from the time
+ * read from the RTC at the switch. When a compare event clears
+ * the counter through PPI, the deadlines are made relative to zero again in
+ * the interrupt handler of that event. A clear by an event of another
+ * peripheral through PPI isn't seen by this module, so the first deadline
+ * after such a clear following a switch comes early by the time elapsed
+ * before the switch.
+ *
+ * With @ref AUX_CLK_SRC_AUTO, the RTC runs till @ref AUX_CLK_AUTO_GUARD_US
+ * before a deadline which only generates an interrupt and the TIMER runs
+ * for the remaining time. The deadlines used as PPI events are hit on the
+ * running source.
  * @{
  */
 
@@ -85,6 +101,13 @@
 #ifndef AUX_CLK_HFCLK_SOLO_MODULE 
 #define AUX_CLK_HFCLK_SOLO_MODULE 0
 #endif
+
+/** Time in us before a deadline from which the TIMER is used in the auto
+ *  mode. Must cover the RTC interrupt latency and the start of the HF
+ *  crystal when @ref AUX_CLK_HFCLK_SOLO_MODULE is set. */
+#ifndef AUX_CLK_AUTO_GUARD_US
+#define AUX_CLK_AUTO_GUARD_US 1000
+#endif
 #define AUX_CLK_NO_IRQ 0xFFFFFFFF
 
 #define AUX_CLK_MAX_CHANNELS 4
@@ -98,6 +121,8 @@ typedef enum
     AUX_CLK_SRC_LFCLK,
     /** High Freq Clock : Timer peripheral */
     AUX_CLK_SRC_HFCLK,
+    /** RTC with the Timer only near the deadlines */
+    AUX_CLK_SRC_AUTO,
 }aux_clk_source_t;
 
 /** List of events generated by this module */
@@ -171,7 +196,8 @@ typedef struct
 void aux_clk_set (aux_clk_setup_t * aux_clk);
 
 /**
- * @brief Function to select the clock source for auxiliary clock module
+ * @brief Function to select the clock source for auxiliary clock module. If
+ *  the clock is running, the elapsed time and the deadlines are kept.
  * @param source Clock source used. @ref aux_clk_source_t
  */
 void aux_clk_select_src (aux_clk_source_t source);
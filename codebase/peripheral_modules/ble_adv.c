@@ -55,6 +55,7 @@
 #include "tinyprintf.h"
 #include "nrf.h"
 #include "nrf_util.h"
+#include "isr_dispatch.h"
 #include "hal_clocks.h"
 #include "profiler_timer.h"
 #include <string.h>
@@ -522,21 +523,21 @@ void irq_adv_tx_ready(void){
 }
 
 #if ISR_MANAGER == 1
-void ble_adv_radio_Handler ()
+void ble_adv_radio_Handler (uint32_t fired)
 #else
 void RADIO_IRQHandler(void)
 #endif
 {
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (NRF_RADIO);
+#endif
 
-    if(1 == NRF_RADIO->EVENTS_END){
-        NRF_RADIO->EVENTS_END = 0;
-        (void) NRF_RADIO->EVENTS_END;
+    if(fired & ISR_DISPATCH_EVT(NRF_RADIO, NRF_RADIO->EVENTS_END)){
         end_handler[radio_ctx.state]();
     }
 
-    if((1 == NRF_RADIO->EVENTS_DISABLED) && (0 == NRF_RADIO->EVENTS_END)){
-        NRF_RADIO->EVENTS_DISABLED = 0;
-        (void) NRF_RADIO->EVENTS_DISABLED;
+    if((fired & ISR_DISPATCH_EVT(NRF_RADIO, NRF_RADIO->EVENTS_DISABLED))
+            && (0 == NRF_RADIO->EVENTS_END)){
         dis_handler[radio_ctx.state]();
     }
 }
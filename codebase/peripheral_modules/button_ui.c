@@ -1,5 +1,5 @@
 /**
- *  button_ui.h : Button UI Event Generator
+ *  button_ui.c : Button UI Event Generator
  *  Copyright (C) 2019  Appiko
  *
  *  This program is free software: you can redistribute it and/or modify
@@ -18,124 +18,146 @@
 
 #include "nrf.h"
 #include "button_ui.h"
+#include "gpio_edge.h"
 #include "hal_gpio.h"
 #include "boards.h"
 
-#if ISR_MANAGER == 1
-#include "isr_manager.h"
-#endif
-
 #ifndef BUTTON_ACTIVE_STATE
 #error "The board definition file must specify the GPIO state on button press"
 #endif
 
 #if BUTTON_ACTIVE_STATE == 1
 #define GPIO_PULL_RESISTOR  HAL_GPIO_PULL_DOWN
-#define GPIO_PIN_SENSE      GPIO_PIN_CNF_SENSE_High
 #define BUTTON_PRESSED      1
 #define BUTTON_RELEASED     0
 #else
 #define GPIO_PULL_RESISTOR  HAL_GPIO_PULL_UP
-#define GPIO_PIN_SENSE      GPIO_PIN_CNF_SENSE_Low
 #define BUTTON_PRESSED      0
 #define BUTTON_RELEASED     1
 #endif
 
-uint32_t btn_pin;
-void (*handler)(button_ui_steps step, button_ui_action act);
-//This bool is used generate an event of release action for the
-//wake step, when the step count is still at 0, i.e. before press
-bool wake_evt = false, btn_press_start = false;
+#define BUTTON_UI_MS_TIMER  CONCAT_2(MS_TIMER, MS_TIMER_USED_BUTTON_UI)
 
-#if ISR_MANAGER == 1
-void button_ui_gpiote_Handler ()
-#else
-void GPIOTE_IRQHandler(void)
-#endif
-{
-    wake_evt = true;
-    handler(BUTTON_UI_STEP_WAKE, BUTTON_UI_ACT_CROSS);
-#if ISR_MANAGER == 0
-    NRF_GPIOTE->EVENTS_PORT = 0;
-    (void) NRF_GPIOTE->EVENTS_PORT;
-#endif
-    
-    btn_press_start = true;
-}
+/** The debounce time in ms_timer ticks, at least a tick */
+#define DEBOUNCE_TICKS      (MS_TIMER_TICKS_MS(BUTTON_UI_DEBOUNCE_MS) ? \
+                                MS_TIMER_TICKS_MS(BUTTON_UI_DEBOUNCE_MS) : 1)
 
-void button_ui_init(uint32_t button_pin,
-     uint32_t irq_priority, void (*button_ui_handler)
-     (button_ui_steps step, button_ui_action act))
-{
-    hal_gpio_cfg(button_pin, GPIO_PIN_CNF_DIR_Input,
-        GPIO_PIN_CNF_INPUT_Connect, GPIO_PULL_RESISTOR,
-        GPIO_PIN_CNF_DRIVE_S0S1, GPIO_PIN_SENSE);
+static uint32_t btn_pin;
+static void (*handler)(button_ui_steps step, button_ui_action act);
 
-    btn_pin = button_pin;
-    handler = button_ui_handler;
-
-    NRF_GPIOTE->EVENTS_PORT = 0;
-    NRF_GPIOTE->INTENSET = (GPIOTE_INTENSET_PORT_Enabled
-            << GPIOTE_INTENSET_PORT_Pos);
+/** If a new press generates the events */
+static bool is_wake_en = true;
+/** If a press is in progress, from its wake event till its release event */
+static bool is_pressed = false;
+/** If the level after the last edge is the pressed level */
+static bool is_level_pressed = false;
+/** The times of the start of the press and of the last edge */
+static uint32_t press_ticks, edge_ticks;
+/** Number of steps crossed in the press in progress */
+static uint32_t step = 0;
 
-    NVIC_ClearPendingIRQ(GPIOTE_IRQn);
-    NVIC_SetPriority(GPIOTE_IRQn, irq_priority);
-    NVIC_EnableIRQ(GPIOTE_IRQn);
-}
+static void timer_handler(void);
 
-void button_ui_add_tick(uint32_t ui_ticks)
+/**
+ * Generate the events due till now from the times of the edges and start
+ *  the timer for the next one. The steps are crossed only for the time the
+ *  button was pressed, so a release waiting for its debounce doesn't cross.
+ */
+static void evaluate(void)
 {
-    static uint32_t ticks = 0, step = 0;
+    uint32_t now = ms_timer_get_current_count();
+    uint32_t end = is_level_pressed ? now : edge_ticks;
+    uint32_t held = (end - press_ticks) & GPIO_EDGE_TICKS_MASK;
+    uint32_t wait = 0;
 
-    if(btn_press_start == true)
+    while((step < BUTTON_UI_STEP_WAKE) && (held > press_duration[step]))
     {
-        ui_ticks = 1;
-        btn_press_start = false;
+        handler((button_ui_steps) step, BUTTON_UI_ACT_CROSS);
+        step++;
     }
 
-    if((hal_gpio_pin_read(btn_pin) == BUTTON_RELEASED)
-            && (0 == step))
+    if(is_level_pressed == false)
     {
-        ticks = 0;
-        if(wake_evt == true)
+        uint32_t released = (now - edge_ticks) & GPIO_EDGE_TICKS_MASK;
+        if(released >= DEBOUNCE_TICKS)
         {
-            wake_evt = false;
-            handler(BUTTON_UI_STEP_WAKE, BUTTON_UI_ACT_RELEASE);
+            uint32_t temp_step = step;
+            is_pressed = false;
+            step = 0;
+            ms_timer_stop(BUTTON_UI_MS_TIMER);
+            handler((temp_step == 0) ? BUTTON_UI_STEP_WAKE :
+                    (button_ui_steps) (temp_step - 1), BUTTON_UI_ACT_RELEASE);
+            if(is_wake_en == false)
+            {
+                gpio_edge_enable(btn_pin, false);
+            }
+            return;
         }
-        return ;
+        wait = DEBOUNCE_TICKS - released;
+    }
+    else if(step < BUTTON_UI_STEP_WAKE)
+    {
+        wait = press_duration[step] + 1 - held;
     }
 
-    if((hal_gpio_pin_read(btn_pin) == BUTTON_PRESSED)){
-        ticks += ui_ticks;
+    if(wait)
+    {
+        ms_timer_start(BUTTON_UI_MS_TIMER, MS_SINGLE_CALL, wait, timer_handler);
     }
+    else
+    {
+        ms_timer_stop(BUTTON_UI_MS_TIMER);
+    }
+}
 
-    if(ticks > press_duration[step])
+static void timer_handler(void)
+{
+    if(is_pressed)
     {
-        handler((button_ui_steps) step, BUTTON_UI_ACT_CROSS);
-        step++;
+        evaluate();
     }
+}
+
+static void edge_handler(uint32_t pin, uint32_t level, uint32_t ticks)
+{
+    is_level_pressed = (level == BUTTON_PRESSED);
+    edge_ticks = ticks;
 
-    if(hal_gpio_pin_read(btn_pin) == BUTTON_RELEASED)
+    if(is_pressed)
+    {
+        evaluate();
+    }
+    else if(is_level_pressed && is_wake_en)
     {
-        uint32_t temp_step = step;
-        wake_evt = false;
-        step = ticks = 0;
-        handler((button_ui_steps) (temp_step - 1),
-                BUTTON_UI_ACT_RELEASE);
+        is_pressed = true;
+        step = 0;
+        press_ticks = ticks;
+        handler(BUTTON_UI_STEP_WAKE, BUTTON_UI_ACT_CROSS);
+        evaluate();
     }
 }
 
+void button_ui_init(uint32_t button_pin,
+     uint32_t irq_priority, void (*button_ui_handler)
+     (button_ui_steps step, button_ui_action act))
+{
+    btn_pin = button_pin;
+    handler = button_ui_handler;
+
+    gpio_edge_add(button_pin, GPIO_PULL_RESISTOR,
+            (BUTTON_PRESSED == 1), edge_handler);
+    gpio_edge_init(irq_priority);
+}
+
 void button_ui_config_wake(bool set_wake_on)
 {
-    if (set_wake_on)
+    is_wake_en = set_wake_on;
+    if(set_wake_on)
     {
-        NRF_GPIOTE->INTENSET = (GPIOTE_INTENSET_PORT_Enabled
-                << GPIOTE_INTENSET_PORT_Pos);
+        gpio_edge_enable(btn_pin, true);
     }
-    else
+    else if(is_pressed == false)
     {
-        NRF_GPIOTE->INTENCLR = (GPIOTE_INTENCLR_PORT_Enabled
-                << GPIOTE_INTENCLR_PORT_Pos);
+        gpio_edge_enable(btn_pin, false);
     }
 }
-
@@ -26,7 +26,11 @@
  * @defgroup group_button_ui Button UI event generator
  *
  * @brief Driver for the generating all the button related UI events
- *  for the application.
+ *  for the application. The edges of the button are timestamped by the
+ *  @ref group_gpio_edge and the durations of @ref press_duration are
+ *  measured from these times with a one shot ms_timer, so the button
+ *  isn't polled while it is pressed. A release is taken only after the
+ *  button stays released for @ref BUTTON_UI_DEBOUNCE_MS.
  *
  * @{
  */
@@ -36,6 +40,19 @@
 #include "stdbool.h"
 #include "ms_timer.h"
 
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+#ifndef MS_TIMER_USED_BUTTON_UI
+#define MS_TIMER_USED_BUTTON_UI 3
+#endif
+
+/** Time in ms for which the button must stay released for a release */
+#ifndef BUTTON_UI_DEBOUNCE_MS
+#define BUTTON_UI_DEBOUNCE_MS   20
+#endif
+
 /**
  * Enum defining the type of actions possible with buttons
  */
@@ -74,18 +91,15 @@ const static uint32_t press_duration[] = {
  * @param button_pin Button Pin number to monitor
  * @param irq_priority IRQ priority of the GPIOTE irq used
  * @param button_ui_handler Handler to be called for all the button events
+ * @note The IRQ priority must be the same as that of the ms_timer module as
+ *  the events are generated from both the interrupts
  */
 void button_ui_init(uint32_t button_pin, uint32_t irq_priority,
         void (*button_ui_handler)(button_ui_steps step, button_ui_action act));
-/**
- * @brief The ticks that need to be sent to the button UI module
- *  for its processing
- * @param ui_ticks UI ticks generated by next interval handler
- */
-void button_ui_add_tick(uint32_t ui_ticks);
 
 /**
- * @brief To enable/disable the button UI GPIOTE IRQ
+ * @brief To enable/disable the wake on a button press. A press which is
+ *  in progress when disabled still generates its events till its release.
  * @param set_wake_on Set to true to enable and false to disable
  */
 void button_ui_config_wake(bool set_wake_on);
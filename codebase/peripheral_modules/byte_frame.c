@@ -16,6 +16,7 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "byte_frame.h"
+#include "prof_region.h"
 
 #define START_FLAG 0x12
 #define END_FLAG 0x13
@@ -51,6 +52,7 @@ bool encodeFrame(const uint8_t *bytesToEncode, uint16_t len,
         return false;
     }
 
+    PROF_REGION_START(byte_frame_encode);
     *currentOutput = START_FLAG;
     currentOutput++;
 
@@ -69,6 +71,7 @@ bool encodeFrame(const uint8_t *bytesToEncode, uint16_t len,
 
     *currentOutput = END_FLAG;
     currentOutput++;
+    PROF_REGION_STOP(byte_frame_encode);
 
     (*encode_done)(encodedOutput, currentOutput-encodedOutput);
     return true;
@@ -81,6 +84,7 @@ void decodeFrame(const uint8_t *bytesToDecode, uint16_t len,
     /* Decode data start values */
     
     const uint8_t *currentInput = bytesToDecode;
+    PROF_REGION_START(byte_frame_decode);
 
     while(currentInput < bytesToDecode+len){
 
@@ -173,5 +177,6 @@ void decodeFrame(const uint8_t *bytesToDecode, uint16_t len,
         /* Next input uint8_t */
         currentInput++;
     }
+    PROF_REGION_STOP(byte_frame_decode);
 }
 
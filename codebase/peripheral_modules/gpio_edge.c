@@ -0,0 +1,162 @@
+/**
+ *  gpio_edge.c : GPIO edge event service
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gpio_edge.h"
+#include "nrf.h"
+#include "hal_gpio.h"
+#include "ms_timer.h"
+#include "nrf_util.h"
+#include "nrf_assert.h"
+#include "isr_dispatch.h"
+
+#if ISR_MANAGER == 1
+#include "isr_manager.h"
+#endif
+
+/** The handlers of the pins, indexed by the pin number */
+static gpio_edge_handler_t handlers[GPIO_EDGE_MAX_PINS];
+/** Bit map of the pins being sensed */
+static volatile uint32_t pins_en = 0;
+/** Bit map of the pins whose active level is high */
+static uint32_t pins_active_high = 0;
+/** If the PORT event interrupt is initialized */
+static bool is_init = false;
+
+/** Set the SENSE field of a pin's configuration */
+static void set_sense(uint32_t pin, uint32_t sense)
+{
+    NRF_GPIO->PIN_CNF[pin] = (NRF_GPIO->PIN_CNF[pin] & ~GPIO_PIN_CNF_SENSE_Msk)
+            | (sense << GPIO_PIN_CNF_SENSE_Pos);
+}
+
+/** The SENSE for the active level of a pin */
+static uint32_t active_sense(uint32_t pin)
+{
+    return (pins_active_high & (1 << pin)) ?
+            GPIO_PIN_CNF_SENSE_High : GPIO_PIN_CNF_SENSE_Low;
+}
+
+void gpio_edge_init(uint32_t irq_priority)
+{
+    NRF_GPIO->DETECTMODE = GPIO_DETECTMODE_DETECTMODE_LDETECT
+            << GPIO_DETECTMODE_DETECTMODE_Pos;
+
+    //The PORT event of the pins added by another module isn't cleared
+    if(is_init == false)
+    {
+        NRF_GPIOTE->EVENTS_PORT = 0;
+        NVIC_ClearPendingIRQ(GPIOTE_IRQn);
+        is_init = true;
+    }
+    NRF_GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Enabled << GPIOTE_INTENSET_PORT_Pos;
+
+    NVIC_SetPriority(GPIOTE_IRQn, irq_priority);
+    NVIC_EnableIRQ(GPIOTE_IRQn);
+}
+
+void gpio_edge_add(uint32_t pin, uint32_t pull_cfg, bool is_active_high,
+        gpio_edge_handler_t handler)
+{
+    ASSERT(pin < GPIO_EDGE_MAX_PINS);
+
+    CRITICAL_REGION_ENTER();
+    handlers[pin] = handler;
+    if(is_active_high)
+    {
+        pins_active_high |= (1 << pin);
+    }
+    else
+    {
+        pins_active_high &= ~(1 << pin);
+    }
+    hal_gpio_cfg(pin, GPIO_PIN_CNF_DIR_Input, GPIO_PIN_CNF_INPUT_Connect,
+            pull_cfg, GPIO_PIN_CNF_DRIVE_S0S1, active_sense(pin));
+    NRF_GPIO->LATCH = (1 << pin);
+    pins_en |= (1 << pin);
+    CRITICAL_REGION_EXIT();
+}
+
+void gpio_edge_remove(uint32_t pin)
+{
+    ASSERT(pin < GPIO_EDGE_MAX_PINS);
+
+    CRITICAL_REGION_ENTER();
+    pins_en &= ~(1 << pin);
+    hal_gpio_cfg(pin, GPIO_PIN_CNF_DIR_Input, GPIO_PIN_CNF_INPUT_Disconnect,
+            GPIO_PIN_CNF_PULL_Disabled, GPIO_PIN_CNF_DRIVE_S0S1,
+            GPIO_PIN_CNF_SENSE_Disabled);
+    NRF_GPIO->LATCH = (1 << pin);
+    CRITICAL_REGION_EXIT();
+}
+
+void gpio_edge_enable(uint32_t pin, bool is_enabled)
+{
+    ASSERT(pin < GPIO_EDGE_MAX_PINS);
+
+    CRITICAL_REGION_ENTER();
+    if(is_enabled)
+    {
+        set_sense(pin, active_sense(pin));
+        pins_en |= (1 << pin);
+    }
+    else
+    {
+        pins_en &= ~(1 << pin);
+        set_sense(pin, GPIO_PIN_CNF_SENSE_Disabled);
+        NRF_GPIO->LATCH = (1 << pin);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+#if ISR_MANAGER == 1
+void gpio_edge_gpiote_Handler (uint32_t fired)
+#else
+void GPIOTE_IRQHandler(void)
+#endif
+{
+    uint32_t latch;
+
+    //The PORT event is cleared before the LATCH is read, in the ISR manager
+    //or here. The LATCH is used in place of the mask as other edges can
+    //be pending in it.
+#if ISR_MANAGER == 0
+    (void) isr_dispatch_take (NRF_GPIOTE);
+#endif
+
+    //The LATCH is read again till it is empty, so that a pin latched while
+    //the handlers run doesn't depend on another PORT event to be seen
+    latch = NRF_GPIO->LATCH & pins_en;
+    while(latch)
+    {
+        uint32_t ticks = ms_timer_get_current_count();
+        do
+        {
+            uint32_t pin = __CLZ(__RBIT(latch));
+            uint32_t level = hal_gpio_pin_read(pin);
+
+            //The SENSE is flipped before the LATCH is cleared, so an edge
+            //after the read sets the LATCH again
+            set_sense(pin, level ? GPIO_PIN_CNF_SENSE_Low : GPIO_PIN_CNF_SENSE_High);
+            NRF_GPIO->LATCH = (1 << pin);
+            latch &= ~(1 << pin);
+
+            handlers[pin](pin, level, ticks);
+        }while(latch);
+        latch = NRF_GPIO->LATCH & pins_en;
+    }
+}
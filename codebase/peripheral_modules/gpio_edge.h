@@ -0,0 +1,96 @@
+/**
+ *  gpio_edge.h : GPIO edge event service
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_gpio_edge GPIO edge event service
+ * @brief Service sharing the GPIOTE PORT event among the modules which
+ *  monitor GPIO pins, such as the button UI and the GPIO level handler.
+ *  A pin is first sensed for its active level. On every PORT event the
+ *  latched pins are read, the SENSE of each is flipped to the opposite of
+ *  its level so that the next edge is caught and the handler of the pin is
+ *  called with the level and the time of the edge. The time is the 24 bit
+ *  count of the RTC of the ms_timer module read on entry to the ISR, so
+ *  that the users can measure durations and debounce without polling the
+ *  pins. The latch (LDETECT) mode of the GPIO port is used, so a pin which
+ *  changes while the ISR runs generates another PORT event. Any of the 32
+ *  pins of the port can be monitored.
+ * @{
+ */
+
+#ifndef CODEBASE_PERIPHERAL_MODULES_GPIO_EDGE_H_
+#define CODEBASE_PERIPHERAL_MODULES_GPIO_EDGE_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** Maximum number of pins which can be monitored */
+#define GPIO_EDGE_MAX_PINS  32
+
+/** Mask of the 24 bit times given to the handlers */
+#define GPIO_EDGE_TICKS_MASK    0x00FFFFFF
+
+/**
+ * @brief Handler of the edges of a pin
+ * @param pin The pin number
+ * @param level The level of the pin after the edge, 1 for high
+ * @param ticks The RTC count of the ms_timer module at the edge
+ */
+typedef void (*gpio_edge_handler_t)(uint32_t pin, uint32_t level, uint32_t ticks);
+
+/**
+ * @brief Initialize the service by enabling the PORT event interrupt.
+ *  Can be called by each of the modules using the service.
+ * @param irq_priority The priority of the GPIOTE IRQ
+ */
+void gpio_edge_init(uint32_t irq_priority);
+
+/**
+ * @brief Configure a pin as an input and start monitoring it. The handler
+ *  is first called when the pin is at the active level, then on every edge.
+ * @param pin The pin number
+ * @param pull_cfg The pull up/down or disabled config as per the nrf
+ *  bitfields header file
+ * @param is_active_high True if the first level sensed is high, else low
+ * @param handler The handler called on the edges of the pin
+ */
+void gpio_edge_add(uint32_t pin, uint32_t pull_cfg, bool is_active_high,
+        gpio_edge_handler_t handler);
+
+/**
+ * @brief Stop monitoring a pin and disconnect its input buffer
+ * @param pin The pin number
+ */
+void gpio_edge_remove(uint32_t pin);
+
+/**
+ * @brief Enable or disable the sensing of a monitored pin. On enabling the
+ *  pin is sensed for its active level again.
+ * @param pin The pin number
+ * @param is_enabled True to enable and false to disable
+ */
+void gpio_edge_enable(uint32_t pin, bool is_enabled);
+
+#endif /* CODEBASE_PERIPHERAL_MODULES_GPIO_EDGE_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -17,76 +17,143 @@
  */
 
 #include "gpio_level_handler.h"
-#include "hal_gpio.h"
-
-#if ISR_MANAGER == 1
-#include "isr_manager.h"
-#endif
-
-#define GPIO_BUFFER_SIZE   4
-
-gpio_level_cfg cfg_buffer[GPIO_BUFFER_SIZE];
-uint32_t gpio_len;
-
-void gpio_level_init(gpio_level_cfg * cfg, uint32_t cfg_num, uint32_t irq_priority)
+#include "gpio_edge.h"
+#include "nrf_assert.h"
+#include "common_util.h"
+
+#define GPIO_LEVEL_MS_TIMER CONCAT_2(MS_TIMER, MS_TIMER_USED_GPIO_LEVEL)
+
+/** The debounce time in ms_timer ticks, at least a tick */
+#define DEBOUNCE_TICKS      (MS_TIMER_TICKS_MS(GPIO_LEVEL_DEBOUNCE_MS) ? \
+                                MS_TIMER_TICKS_MS(GPIO_LEVEL_DEBOUNCE_MS) : 1)
+
+/** The handlers of the pins, indexed by the pin number */
+static void (*handlers[GPIO_EDGE_MAX_PINS])(bool is_still_on);
+/** Bit map of the pins configured to trigger on high level */
+static uint32_t pins_trigger_high = 0;
+/** Bit map of the pins configured */
+static uint32_t pins_used = 0;
+/** Bit map of the pins at their level, as last reported to the handlers */
+static uint32_t pins_reported = 0;
+/** Bit map of the pins at their level after the last edge */
+static uint32_t pins_on = 0;
+/** Bit map of the pins whose bounces are being ignored */
+static uint32_t pins_locked = 0;
+/** The times of the last change reported for the pins */
+static uint32_t report_ticks[GPIO_EDGE_MAX_PINS];
+
+/** Report the level of a pin and ignore its bounces for the debounce time */
+static void report(uint32_t pin, uint32_t ticks)
 {
-    if(cfg_num == 0)
-    {
-        NRF_GPIOTE->EVENTS_PORT = 0;
+    bool is_on = ((pins_on >> pin) & 1);
 
-        NRF_GPIOTE->INTENCLR = GPIOTE_INTENCLR_PORT_Enabled << GPIOTE_INTENCLR_PORT_Pos;
+    pins_reported = (pins_reported & ~(1 << pin)) | (is_on << pin);
+    pins_locked |= (1 << pin);
+    report_ticks[pin] = ticks;
+    handlers[pin](is_on);
+}
 
-        NVIC_ClearPendingIRQ(GPIOTE_IRQn);
-        NVIC_DisableIRQ(GPIOTE_IRQn);
+/**
+ * Report the pins whose debounce time is over and whose level differs from
+ *  the one reported, then start the timer for the next debounce to end.
+ */
+static void timer_handler(void)
+{
+    uint32_t now = ms_timer_get_current_count();
+    uint32_t wait = DEBOUNCE_TICKS;
+    uint32_t locked = pins_locked;
 
-        ///TODO revert the GPIO configs of the previously configured pins
+    while(locked)
+    {
+        uint32_t pin = __CLZ(__RBIT(locked));
+        uint32_t elapsed = (now - report_ticks[pin]) & GPIO_EDGE_TICKS_MASK;
+        locked &= ~(1 << pin);
 
-        return ;
+        if(elapsed < DEBOUNCE_TICKS)
+        {
+            wait = MIN(wait, DEBOUNCE_TICKS - elapsed);
+            continue;
+        }
+        pins_locked &= ~(1 << pin);
+        if(((pins_on ^ pins_reported) >> pin) & 1)
+        {
+            report(pin, now);
+        }
     }
 
-    uint32_t i;
-    for(i = 0; i<cfg_num; i++)
+    if(pins_locked)
     {
-        cfg_buffer[i] = *(cfg + i);
-
-        hal_gpio_cfg((cfg + i)->pin_num,
-                    GPIO_PIN_CNF_DIR_Input,
-                    GPIO_PIN_CNF_INPUT_Connect,
-                    (cfg + i)->pull_cfg,
-                    GPIO_PIN_CNF_DRIVE_S0S1,
-                    ((cfg + i)->trigger_on_high)
-                        ?GPIO_PIN_CNF_SENSE_High:GPIO_PIN_CNF_SENSE_Low );
+        ms_timer_start(GPIO_LEVEL_MS_TIMER, MS_SINGLE_CALL, wait, timer_handler);
     }
-    gpio_len = cfg_num;
+    else
+    {
+        ms_timer_stop(GPIO_LEVEL_MS_TIMER);
+    }
+}
 
-    NRF_GPIO->DETECTMODE = GPIO_DETECTMODE_DETECTMODE_LDETECT << GPIO_DETECTMODE_DETECTMODE_Pos;
-    NRF_GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Enabled << GPIOTE_INTENSET_PORT_Pos;
+static void edge_handler(uint32_t pin, uint32_t level, uint32_t ticks)
+{
+    uint32_t level_checked = (pins_trigger_high >> pin) & 1;
+    bool is_timer_idle = (pins_locked == 0);
 
-    NVIC_ClearPendingIRQ(GPIOTE_IRQn);
-    NVIC_SetPriority(GPIOTE_IRQn, irq_priority);
-    NVIC_EnableIRQ(GPIOTE_IRQn);
+    pins_on = (pins_on & ~(1 << pin)) | ((level == level_checked) << pin);
 
+    //The timer reports the pin at the end of its debounce if needed
+    if(((pins_locked >> pin) & 1) ||
+            ((((pins_on ^ pins_reported) >> pin) & 1) == 0))
+    {
+        return;
+    }
+
+    report(pin, ticks);
+    //A running timer ends earlier than the debounce of this pin
+    if(is_timer_idle)
+    {
+        uint32_t elapsed = (ms_timer_get_current_count() - ticks)
+                & GPIO_EDGE_TICKS_MASK;
+        ms_timer_start(GPIO_LEVEL_MS_TIMER, MS_SINGLE_CALL,
+                (elapsed < DEBOUNCE_TICKS) ? (DEBOUNCE_TICKS - elapsed) : 1,
+                timer_handler);
+    }
 }
-#if ISR_HADNLER == 1
-void gpio_level_handler_gpiote_Handler ()
-#else
-void GPIOTE_IRQHandler(void)
-#endif
-{
-    NRF_GPIOTE->EVENTS_PORT = 0;
-    (void) NRF_GPIOTE->EVENTS_PORT;
 
-    uint32_t i;
-    for(i = 0; i<gpio_len; i++)
+void gpio_level_init(gpio_level_cfg * cfg, uint32_t cfg_num, uint32_t irq_priority)
+{
+    if(cfg_num == 0)
     {
-        uint32_t pin_num = cfg_buffer[i].pin_num;
-        if(NRF_GPIO->LATCH & (1 << pin_num))
+        for(uint32_t pin = 0; pin < GPIO_EDGE_MAX_PINS; pin++)
         {
-            uint32_t pin_val = hal_gpio_pin_read(pin_num);
-            uint32_t level_checked = cfg_buffer[i].trigger_on_high;
+            if(pins_used & (1 << pin))
+            {
+                gpio_edge_remove(pin);
+            }
+        }
+        ms_timer_stop(GPIO_LEVEL_MS_TIMER);
+        pins_used = 0;
+        pins_locked = 0;
+        return ;
+    }
+
+    ASSERT(cfg_num <= GPIO_EDGE_MAX_PINS);
+    for(uint32_t i = 0; i<cfg_num; i++)
+    {
+        uint32_t pin = (cfg + i)->pin_num;
 
-            NRF_GPIO->LATCH = (1 << pin_num);
-            cfg_buffer[i].handler((pin_val == level_checked));
+        handlers[pin] = (cfg + i)->handler;
+        if((cfg + i)->trigger_on_high)
+        {
+            pins_trigger_high |= (1 << pin);
+        }
+        else
+        {
+            pins_trigger_high &= ~(1 << pin);
         }
+        pins_used |= (1 << pin);
+        pins_reported &= ~(1 << pin);
+        pins_on &= ~(1 << pin);
+        gpio_edge_add(pin, (cfg + i)->pull_cfg,
+                (cfg + i)->trigger_on_high, edge_handler);
     }
+
+    gpio_edge_init(irq_priority);
 }
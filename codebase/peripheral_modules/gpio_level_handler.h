@@ -23,7 +23,12 @@
  * @defgroup group_gpio_level GPIO level handler
  * @brief Driver to use GPIOTE port event to detect whenever any of multiple GPIO pins
  *  are at a specified polarity. This module can be used to wake the nRF SoC from the
- *  SYSTEM OFF mode and consumes about 1 uA of current.
+ *  SYSTEM OFF mode and consumes about 1 uA of current. The pins are monitored with
+ *  the @ref group_gpio_edge, so the handler of a pin is called when it goes to the
+ *  specified level and again when it leaves it. The first edge of a change is
+ *  reported at once, after which the pin is not reported again for
+ *  @ref GPIO_LEVEL_DEBOUNCE_MS. If the pin then differs from what was reported,
+ *  this is reported at the end of that time from a one shot ms_timer.
  *
  * @{
  */
@@ -33,6 +38,20 @@
 
 #include "stdint.h"
 #include "stdbool.h"
+#include "ms_timer.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+#ifndef MS_TIMER_USED_GPIO_LEVEL
+#define MS_TIMER_USED_GPIO_LEVEL 2
+#endif
+
+/** Time in ms for which the bounces after a reported change are ignored */
+#ifndef GPIO_LEVEL_DEBOUNCE_MS
+#define GPIO_LEVEL_DEBOUNCE_MS  20
+#endif
 
 /**
  * @brief The configuration parameter for each of the GPIO pin
@@ -41,7 +60,7 @@
 typedef struct
 {
     void (*handler)(bool is_still_on);  ///The handler that's called when
-                             ///this pin is at the specified level
+                             ///this pin goes to or leaves the specified level
     uint32_t pin_num;       ///The pin number
     uint32_t pull_cfg;      ///The pull up/down or disabled config as per
                              ///the nrf bitfields header file
@@ -54,7 +73,8 @@ typedef struct
  *  configurations of all the GPIOs that need to be monitored
  * @param cfg A pointer to an array of GPIO configurations which need to be
  *  configured to generate port events and call the appropriate handler
- * @param cfg_num The size of the array
+ * @param cfg_num The size of the array, at most @ref GPIO_EDGE_MAX_PINS. The pins
+ *  configured earlier are released if this is 0.
  * @param irq_priority The priority of the GPIOTE port event IRQ handler
  */
 void gpio_level_init(gpio_level_cfg * cfg, uint32_t cfg_num, uint32_t irq_priority);
@@ -21,24 +21,14 @@
 #include "ms_timer.h"
 #include "nrf_assert.h"
 #include "string.h"
-#include "minmea.h"
+#include "nmea_parser.h"
 #include "log.h"
 #include "stdbool.h"
 
-#define MAX_LINE_BUFF_LEN 81
-
 #define MAX_HDOP    3
 
 #define MIN_FIXES 30
 
-typedef struct 
-{
-    struct minmea_float lat;
-    struct minmea_float lng;
-    struct minmea_float hdop;
-}gps_data_t;
-
-static gps_data_t gps_data;
 
 static uint32_t g_timeout_ticks;
 
@@ -60,8 +50,6 @@ static gps_mod_loc_t g_current_loc;
 
 //static gps_mod_loc_t g_last_valid_loc;
 
-uint8_t g_line[MAX_LINE_BUFF_LEN];
-
 void (* g_loc_handler) (gps_mod_loc_t * loc);
 
 void (* g_timeout_handler) ();
@@ -71,7 +59,7 @@ static uint32_t g_fix_cnt = 0;
 
 const app_irq_priority_t g_disable_irq = APP_IRQ_PRIORITY_THREAD;
 
-void rx_data_parser(uint8_t byte);
+void nmea_sentence_handler(nmea_sentence_t type, nmea_parser_data_t * data);
 
 
 void set_gps_state (bool state, app_irq_priority_t irq_priority)
@@ -80,7 +68,8 @@ void set_gps_state (bool state, app_irq_priority_t irq_priority)
     {
 
         hal_uarte_init(g_baudrate, irq_priority);
-        hal_uarte_start_rx (rx_data_parser);
+        nmea_parser_init (nmea_sentence_handler);
+        hal_uarte_start_rx (nmea_parser_feed);
         g_current_loc.lat = 0;
         g_current_loc.lng = 0;
         hal_gpio_pin_clear (g_en_pin);
@@ -94,17 +83,26 @@ void set_gps_state (bool state, app_irq_priority_t irq_priority)
 }
 
 
-void validate_gps_data ()
+/**
+ * @brief Converts a coordinate in degrees x 10^7 to the resolution set in init
+ * @param deg_e7 The coordinate in degrees x 10^7
+ * @return The coordinate in degrees x @ref g_loc_res
+ */
+static int32_t e7_to_res (int32_t deg_e7)
+{
+    return deg_e7 / (int32_t)(GPS_MOD_RES_D7/g_loc_res);
+}
+
+void validate_gps_data (nmea_parser_data_t * data)
 {
-    if(((float)(gps_data.hdop.value/gps_data.hdop.scale) < MAX_HDOP) &&
-        (gps_data.lat.value != 0) && (gps_data.lng.value != 0))
+    //A fix without HDOP has NMEA_PARSER_DOP_UNKNOWN, above the limit
+    if((data->hdop_c < (MAX_HDOP*100)) &&
+        (data->lat_e7 != 0) && (data->lng_e7 != 0))
     {
         g_fix_cnt++;
         
-        g_current_loc.lng = (uint32_t)((float)(minmea_tocoord(&gps_data.lng)) *
-                                g_loc_res);
-        g_current_loc.lat = (uint32_t)((float)(minmea_tocoord(&gps_data.lat)) *
-                                g_loc_res);
+        g_current_loc.lng = e7_to_res (data->lng_e7);
+        g_current_loc.lat = e7_to_res (data->lat_e7);
         if((g_fix_cnt > MIN_FIXES) && (g_current_loc.lng != (-1)) && (g_is_always_on == false))
         {
             g_loc_handler(&g_current_loc);
@@ -113,100 +111,13 @@ void validate_gps_data ()
     }
 }
 
-
-void update_location ()
-{
-    switch (minmea_sentence_id((char *)g_line, false))
-    {
-        case MINMEA_SENTENCE_GLL:
-        {
-            struct minmea_sentence_gll frame;
-            if (minmea_parse_gll(&frame, (char *)g_line)) 
-            {
-//                                    log_printf("GLL Coordinates: (%d/%d,%d/%d)\n\n",
-//                                            frame.latitude.value, frame.latitude.scale,
-//                                            frame.longitude.value, frame.longitude.scale
-//                                            );
-                gps_data.lat = frame.latitude;
-                gps_data.lng = frame.longitude;
-
-            } else {
-//                                    log_printf(" GLL Err. \n");
-            }
-        }
-
-        case MINMEA_SENTENCE_GGA:
-        {
-            struct minmea_sentence_gga frame;
-            if (minmea_parse_gga(&frame, (char *)g_line)) 
-            {
-//                log_printf("$GGA: LatLng: (%d/%d,%d/%d)\n Accuracy: (%d/%d) \n\n",
-//
-//                        frame.latitude.value, frame.latitude.scale,
-//                        frame.longitude.value, frame.longitude.scale,
-//                        frame.hdop.value, frame.hdop.scale
-//
-//                        );
-
-                gps_data.hdop.scale = frame.hdop.scale;
-                gps_data.lat.scale = frame.latitude.scale;
-                gps_data.lng.scale = frame.longitude.scale;
-                
-                gps_data.hdop.value = frame.hdop.value;
-                gps_data.lat.value = frame.latitude.value;
-                gps_data.lng.value = frame.longitude.value;
-                validate_gps_data ();
-                
-            }
-            else
-            {
-//                                    log_printf("GGA Err.\n");
-            }
-        }
-            break;
-        case MINMEA_SENTENCE_RMC:
-        {
-            struct minmea_sentence_rmc frame;
-            if (minmea_parse_rmc(&frame, (char *)g_line))
-            {
-//                                    log_printf("$RMC: LatLng: (%d/%d, %d/%d)\n\n",
-//                                            frame.latitude.value, frame.latitude.scale,
-//                                            frame.longitude.value, frame.longitude.scale
-//                                            );
-//
-                gps_data.lat = frame.latitude;
-                gps_data.lng = frame.longitude;
-            }
-            else
-            {
-            }
-
-        }
-            break;
-        default:
-            break;
-
-    }
-}
-
-void rx_data_parser(uint8_t byte)
+void nmea_sentence_handler (nmea_sentence_t type, nmea_parser_data_t * data)
 {
-    static uint32_t line_length = 0;
-    if (byte == '\n' || byte == '\r')
+    //Only GGA has the HDOP needed to qualify a fix, GLL and RMC only
+    //update the position kept in the parser's data
+    if((type == NMEA_SENTENCE_GGA) && (data->valid == true))
     {
-        update_location ();
-        line_length = 0;
-    }
-    else if (line_length == 0 && byte == '$') 
-    {
-        // push G to (char *)g_line at index 0
-        memset(g_line,'\0',MAX_LINE_BUFF_LEN);
-        g_line[line_length++] = '$';
-    } 
-    else if (line_length != 0) 
-    {
-        //push to (char *)g_line
-        g_line[line_length++] = byte;
+        validate_gps_data (data);
     }
 }
 
@@ -272,4 +183,9 @@ gps_mod_loc_t * gps_mod_get_last_location ()
 void gps_mod_process ()
 {
     hal_uarte_process ();
-}
\ No newline at end of file
+}
+
+const nmea_parser_stats_t * gps_mod_get_stats ()
+{
+    return nmea_parser_get_stats ();
+}
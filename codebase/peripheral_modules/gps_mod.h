@@ -22,6 +22,7 @@
 #include "hal_uarte.h"
 #include "nrf_util.h"
 #include "device_tick.h"
+#include "nmea_parser.h"
 
 
 
@@ -100,6 +101,12 @@ gps_mod_loc_t * gps_mod_get_last_location ();
  */
 void gps_mod_process ();
 
+/**
+ * @brief Function to get the statistics of the NMEA sentences received
+ * @return Pointer to the per sentence counters of the NMEA parser
+ */
+const nmea_parser_stats_t * gps_mod_get_stats ();
+
 
 
 #endif /* GPS_MOD_H */
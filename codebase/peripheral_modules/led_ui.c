@@ -31,12 +31,15 @@
 #include "nrf_util.h"
 #include "log.h"
 #include "boards.h"
+#include "nrf_assert.h"
 #include "stddef.h"
 
 #define MAX_COUNT_PWM           1000
-#define MAX_SEQ_LEN_SEC         20
 #define PWM_UPDATE_PERIOD_MS    32
-#define PWM_BUFFER_SIZE         ((uint32_t)((MAX_SEQ_LEN_SEC*1000)/PWM_UPDATE_PERIOD_MS))
+/** Number of PWM updates interpolated in one chunk of the PWM double buffer */
+#define PWM_CHUNK_UPDATES       16
+/** The max loop count so that a playing sequence is restarted only by the shortcut */
+#define PWM_LOOP_MAX            0xFFFF
 
 static struct{
   led_sequences seq;
@@ -44,15 +47,157 @@ static struct{
   uint16_t priority;
 }led_ui_context[LED_UI_SEQ_T_SIZE];
 
+/** The two chunks of the PWM double buffer played alternately by SEQ[0] and SEQ[1] */
 static struct
 {
   uint16_t color[LED_COLOR_MAX];
-} seq_buffer[PWM_BUFFER_SIZE];
+} seq_buffer[2][PWM_CHUNK_UPDATES];
+
+/** State of the interpolation of the sequence being played */
+static struct
+{
+    uint16_t * dur_ptr;
+    uint16_t * seq_ptr[LED_COLOR_MAX];
+    uint32_t seg_num;
+    /// Total number of PWM updates in the sequence
+    uint32_t total_updates;
+    /// Number of PWM updates generated in the current run of the sequence
+    uint32_t update_cnt;
+    /// The current segment being interpolated
+    uint32_t seg;
+    /// The current update in the segment
+    uint32_t seg_update;
+    /// Number of updates in the current segment
+    uint32_t seg_updates_num;
+    /// The overflow in ms from the previous segment to the current one
+    uint32_t overflow;
+    /// If the sequence is to be repeated after it ends
+    bool loop;
+    /// If all the updates of a single sequence are in the buffer
+    bool done;
+}gen;
 
 const uint16_t zero_val_arr[32] = { 0 };
 
+/**
+ * @brief Sets up the interpolation state of the segment @ref gen.seg
+ */
+static void gen_seg_start(void)
+{
+    uint32_t curr_seg_dur = gen.dur_ptr[gen.seg] - gen.overflow;
+    gen.seg_updates_num = 1 + curr_seg_dur/PWM_UPDATE_PERIOD_MS;
+    gen.seg_update = 0;
+}
+
+/**
+ * @brief Moves to the next segment once all updates of the current are done
+ */
+static void gen_seg_end(void)
+{
+    uint32_t curr_seg_dur = gen.dur_ptr[gen.seg] - gen.overflow;
+    uint32_t curr_dur_mod = curr_seg_dur - (gen.seg_updates_num-1)*PWM_UPDATE_PERIOD_MS;
+    gen.overflow = (curr_dur_mod)?(PWM_UPDATE_PERIOD_MS - curr_dur_mod):0;
+    gen.seg++;
+}
+
+/**
+ * @brief Resets the interpolation to the start of the sequence
+ */
+static void gen_rewind(void)
+{
+    gen.seg = 1;
+    gen.overflow = 0;
+    gen.update_cnt = 0;
+    gen_seg_start();
+}
+
+/**
+ * @brief Interpolates the next chunk of PWM updates of the sequence
+ * @param buf The chunk of the PWM double buffer to be filled
+ * @return The number of updates filled in the chunk
+ */
+static uint32_t gen_chunk(uint32_t buf)
+{
+    uint32_t cnt = 0;
+    while((cnt < PWM_CHUNK_UPDATES) && (gen.done == false))
+    {
+        uint32_t i = gen.seg;
+        uint32_t seg_count = gen.overflow + gen.seg_update*PWM_UPDATE_PERIOD_MS;
+        for(uint32_t k = 0; k < LED_COLOR_MAX; k++)
+        {
+            uint16_t val = ((int32_t)(seg_count *
+                ((int32_t)(gen.seq_ptr[k][i] - gen.seq_ptr[k][i-1]))))
+                /gen.dur_ptr[i] + gen.seq_ptr[k][i-1];
+
+            seq_buffer[buf][cnt].color[k] = (LEDS_ACTIVE_STATE)?
+                    (val | (1<<15)) : (val);
+        }
+        cnt++;
+
+        gen.seg_update++;
+        if(gen.seg_update == gen.seg_updates_num)
+        {
+            gen_seg_end();
+            gen_seg_start();
+        }
+
+        //The last computed update of a sequence is not played
+        gen.update_cnt++;
+        if(gen.update_cnt == gen.total_updates)
+        {
+            if(gen.loop)
+            {
+                gen_rewind();
+            }
+            else
+            {
+                gen.done = true;
+            }
+        }
+    }
+    return cnt;
+}
+
+/**
+ * @brief Refills the chunk of a sequence that just ended while the other one
+ *  plays. When a single sequence runs out the PWM is stopped after the
+ *  chunk with the last updates.
+ * @param buf The chunk whose sequence just ended
+ */
+static void refill_chunk(uint32_t buf)
+{
+    if(gen.done == true)
+    {
+        return;
+    }
+
+    uint32_t cnt = gen_chunk(buf);
+    if(cnt != 0)
+    {
+        hal_pwm_set_seq_len(buf, LED_COLOR_MAX * cnt);
+    }
+
+    if(gen.done == true)
+    {
+        //Stop after this chunk, or after the one playing if this one is empty
+        hal_pwm_set_shorts((cnt != 0) ?
+                ((buf == 0) ? HAL_PWM_SHORT_SEQEND0_STOP_MASK : HAL_PWM_SHORT_SEQEND1_STOP_MASK) :
+                ((buf == 0) ? HAL_PWM_SHORT_SEQEND1_STOP_MASK : HAL_PWM_SHORT_SEQEND0_STOP_MASK));
+    }
+}
+
 void pwm_irq_handler(hal_pwm_irq_mask_t irq_source)
 {
+    if(HAL_PWM_IRQ_SEQEND0_MASK == irq_source)
+    {
+        refill_chunk(0);
+    }
+
+    if(HAL_PWM_IRQ_SEQEND1_MASK == irq_source)
+    {
+        refill_chunk(1);
+    }
+
     if(HAL_PWM_IRQ_STOPPED_MASK == irq_source)
     {
         led_ui_context[LED_UI_SINGLE_SEQ].is_on = false;
@@ -131,56 +276,50 @@ static void start_seq_pwm(led_sequences seq, led_ui_seq_t type, led_ui_priority_
     led_ui_context[type].seq = seq;
     led_ui_context[type].priority = priority;
 
-    uint16_t * dur_ptr = led_seq_get_seq_duration_ptr(seq);
-    uint32_t seq_seg_num = led_seq_get_seg_len(seq);
+    //Stop first so that the interrupt doesn't use the state being changed
+    hal_pwm_stop();
+
+    gen.dur_ptr = led_seq_get_seq_duration_ptr(seq);
+    gen.seg_num = led_seq_get_seg_len(seq);
 
     uint32_t led_num = led_seq_get_pin_num(seq);
 
-    uint16_t * seq_ptr[LED_COLOR_MAX];
     uint32_t pin_arr[LED_COLOR_MAX];
     bool pin_idle[LED_COLOR_MAX];
 
     for(uint32_t k = 0; k < led_num; k++)
     {
-        seq_ptr[k] = led_seq_get_seq_color_ptr(seq, k);
+        gen.seq_ptr[k] = led_seq_get_seq_color_ptr(seq, k);
         pin_arr[k] = led_seq_get_pin_ptr()[k];
         pin_idle[k] = (!LEDS_ACTIVE_STATE);
     }
     for(uint32_t k = led_num; k < LED_COLOR_MAX; k++)
     {
-        seq_ptr[k] = (uint16_t *)zero_val_arr;
+        gen.seq_ptr[k] = (uint16_t *)zero_val_arr;
         pin_arr[k] = led_seq_get_pin_ptr()[0];
         pin_idle[k] = (!LEDS_ACTIVE_STATE);
     }
 
-    uint32_t overflow = 0; //To store the overflow from one segment to another
-    uint32_t buff_cnt = 0; //To store the number of elements generated in buffer
-
-    for(uint32_t i = 1; i<seq_seg_num; i++)
+    //Only the number of updates in the sequence is found here, the values
+    //are interpolated a chunk at a time as the sequence plays
+    gen.total_updates = 0;
+    gen.overflow = 0;
+    for(gen.seg = 1; gen.seg < gen.seg_num; )
     {
-        uint32_t curr_seg_dur = dur_ptr[i] - overflow;
-        uint32_t seg_updates_num = 1 + curr_seg_dur/PWM_UPDATE_PERIOD_MS;
-
-        for(uint32_t j = 0; j < seg_updates_num; j++)
-        {
-            uint32_t seg_count = overflow + j*PWM_UPDATE_PERIOD_MS;
-            for(uint32_t k = 0; k < LED_COLOR_MAX; k++)
-            {
-                seq_buffer[buff_cnt].color[k] = ((int32_t)(seg_count *
-                    ((int32_t)(seq_ptr[k][i] - seq_ptr[k][i-1]))))
-                    /dur_ptr[i] + seq_ptr[k][i-1];
+        gen_seg_start();
+        gen.total_updates += gen.seg_updates_num;
+        gen_seg_end();
+    }
+    //The last update generated is not played
+    gen.total_updates--;
+    ASSERT(gen.total_updates > 0);
 
-                seq_buffer[buff_cnt].color[k] = (LEDS_ACTIVE_STATE)?
-                        (seq_buffer[buff_cnt].color[k] | (1<<15)):
-                        (seq_buffer[buff_cnt].color[k]);
-            }
-            buff_cnt++;
-        }
+    gen.loop = (type == LED_UI_LOOP_SEQ);
+    gen.done = false;
+    gen_rewind();
 
-        uint32_t curr_dur_mod = curr_seg_dur - (seg_updates_num-1)*PWM_UPDATE_PERIOD_MS;
-        overflow = (curr_dur_mod)?(PWM_UPDATE_PERIOD_MS - curr_dur_mod):0;
-    }
-    buff_cnt--;
+    uint32_t cnt0 = gen_chunk(0);
+    uint32_t cnt1 = gen_chunk(1);
 
     hal_pwm_init_t init_config =
     {
@@ -201,33 +340,36 @@ static void start_seq_pwm(led_sequences seq, led_ui_seq_t type, led_ui_priority_
         .seq_config =
         {
             {
-                .seq_values = (uint16_t *) seq_buffer,
-                .len = (LED_COLOR_MAX * buff_cnt),
+                .seq_values = (uint16_t *) seq_buffer[0],
+                .len = (LED_COLOR_MAX * cnt0),
                 .repeats = (PWM_UPDATE_PERIOD_MS - 1),
                 .end_delay = 0
             },
             {
-                .seq_values = (uint16_t *) seq_buffer,
-                .len = (LED_COLOR_MAX * buff_cnt),
+                .seq_values = (uint16_t *) seq_buffer[1],
+                .len = (LED_COLOR_MAX * cnt1),
                 .repeats = (PWM_UPDATE_PERIOD_MS - 1),
                 .end_delay = 0
             }
         },
+        .irq_handler = pwm_irq_handler
     };
 
-    if(type == LED_UI_SINGLE_SEQ)
+    if(cnt1 == 0)
     {
+        //The whole single sequence fits in the first chunk
         start_config.loop = 0;
         start_config.shorts_mask = HAL_PWM_SHORT_SEQEND0_STOP_MASK;
         start_config.interrupt_masks = HAL_PWM_IRQ_STOPPED_MASK;
-        start_config.irq_handler = pwm_irq_handler;
     }
-    else // LOOP_SEQ
+    else
     {
-        start_config.loop = 1;
-        start_config.shorts_mask = HAL_PWM_SHORT_LOOPSDONE_SEQSTART0_MASK;
-        start_config.interrupt_masks = 0;
-        start_config.irq_handler = NULL;
+        //The two chunks keep alternating till the sequence is done
+        start_config.loop = PWM_LOOP_MAX;
+        start_config.shorts_mask = (gen.done == true) ?
+                HAL_PWM_SHORT_SEQEND1_STOP_MASK : HAL_PWM_SHORT_LOOPSDONE_SEQSTART0_MASK;
+        start_config.interrupt_masks = HAL_PWM_IRQ_SEQEND0_MASK |
+                HAL_PWM_IRQ_SEQEND1_MASK | HAL_PWM_IRQ_STOPPED_MASK;
     }
 
     hal_pwm_start(&start_config);
@@ -23,7 +23,8 @@
 #define log_printf(...)
 #elif defined LOG_SEGGER_RTT
 #include "SEGGER_RTT.h"
-#define log_init()
+#include "rtt_chan.h"
+#define log_init()       rtt_chan_init()
 #define log_printf(...)  SEGGER_RTT_printf(0, __VA_ARGS__)
 #elif defined LOG_UART_DMA_PRINTF//UARTE printf
 #include "nrf.h"
@@ -53,9 +54,19 @@
 #pragma GCC diagnostic push
 #define log_printf(...)  
 #pragma GCC diagnostic pop
+#elif defined LOG_DEFERRED_RTT || defined LOG_DEFERRED_UART
+#include "log_deferred.h"
+#define log_init()       log_deferred_init()
+#define log_printf(...)  LOG_DEFERRED_PRINTF(__VA_ARGS__)
+#define log_process()    log_deferred_process()
 #else
 #define log_init()
 #define log_printf(...)
 #endif
 
+/** Sends the buffered logs for the backends which defer the output */
+#ifndef log_process
+#define log_process()
+#endif
+
 #endif /* CODEBASE_PERIPHERAL_MODULES_LOG_H_ */
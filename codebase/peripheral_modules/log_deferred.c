@@ -0,0 +1,144 @@
+/**
+ *  log_deferred.c : Deferred binary logging
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "log_deferred.h"
+#include "stdarg.h"
+#include "stdbool.h"
+#include "nrf.h"
+#include "nrf_util.h"
+#include "ms_timer.h"
+#include "common_util.h"
+
+#if defined LOG_DEFERRED_RTT
+#include "SEGGER_RTT.h"
+#elif defined LOG_DEFERRED_UART
+#include "hal_uart.h"
+#else
+#error "Define LOG_DEFERRED_RTT or LOG_DEFERRED_UART for the sink of the logs"
+#endif
+
+#if ((LOG_DEFERRED_BUF_SIZE & (LOG_DEFERRED_BUF_SIZE - 1)) != 0)
+#error "LOG_DEFERRED_BUF_SIZE must be a power of 2"
+#endif
+
+/** RTT channel on which the records are sent */
+#define LOG_DEFERRED_RTT_CHANNEL    0
+
+/** Maximum words sent to the sink at a time, so that a write in the
+ *  skip mode of RTT can fit in the up buffer */
+#define SINK_MAX_WORDS              64
+
+#if defined LOG_DEFERRED_RTT && defined BUFFER_SIZE_UP
+#if (BUFFER_SIZE_UP <= (SINK_MAX_WORDS*4))
+#error "The RTT up buffer must be larger than SINK_MAX_WORDS words, else the logs are stuck"
+#endif
+#endif
+
+/** Size of a record in words for a given number of arguments */
+#define RECORD_WORDS(nargs)         (2 + (nargs))
+
+/** Ring buffer of the records. The head and tail are free running counters
+ *  and are masked when indexing the buffer. */
+static struct
+{
+    uint32_t buf[LOG_DEFERRED_BUF_SIZE/sizeof(uint32_t)];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+}ring;
+
+/** Sequence number of the next record, incremented for dropped records too */
+static uint8_t seq;
+
+#define RING_MASK                   ((LOG_DEFERRED_BUF_SIZE/sizeof(uint32_t)) - 1)
+
+void log_deferred_init(void)
+{
+    ring.head = 0;
+    ring.tail = 0;
+    seq = 0;
+#if defined LOG_DEFERRED_UART
+    hal_uart_init(HAL_UART_BAUD_1M, NULL);
+#endif
+}
+
+void log_deferred_write(uint32_t fmt_addr, uint32_t nargs, ...)
+{
+    va_list args;
+    uint32_t time = ms_timer_get_current_count();
+
+    if(nargs > LOG_DEFERRED_MAX_ARGS)
+    {
+        nargs = LOG_DEFERRED_MAX_ARGS;
+    }
+
+    va_start(args, nargs);
+    CRITICAL_REGION_ENTER();
+    uint32_t head = ring.head;
+    if((RING_MASK + 1) - (head - ring.tail) >= RECORD_WORDS(nargs))
+    {
+        ring.buf[head++ & RING_MASK] = (LOG_DEFERRED_SYNC << 24) |
+                (nargs << 16) | (fmt_addr & 0xFFFF);
+        ring.buf[head++ & RING_MASK] = (seq << 24) | (time & 0xFFFFFF);
+        for(uint32_t i = 0; i < nargs; i++)
+        {
+            ring.buf[head++ & RING_MASK] = va_arg(args, uint32_t);
+        }
+        ring.head = head;
+    }
+    seq++;
+    CRITICAL_REGION_EXIT();
+    va_end(args);
+}
+
+/**
+ * @brief Send data to the sink
+ * @param data Pointer to the words to send
+ * @param len Number of bytes to send
+ * @return Number of bytes sent
+ */
+static uint32_t sink_write(uint32_t * data, uint32_t len)
+{
+#if defined LOG_DEFERRED_RTT
+    return SEGGER_RTT_Write(LOG_DEFERRED_RTT_CHANNEL, data, len);
+#elif defined LOG_DEFERRED_UART
+    hal_uart_putdata((uint8_t *) data, len);
+    return len;
+#endif
+}
+
+void log_deferred_process(void)
+{
+    uint32_t head = ring.head;
+    uint32_t tail = ring.tail;
+
+    while(head != tail)
+    {
+        //Send till the end of the buffer if the data wraps around
+        uint32_t words = MIN(head - tail,
+                (RING_MASK + 1) - (tail & RING_MASK));
+        words = MIN(words, SINK_MAX_WORDS);
+        uint32_t sent = sink_write(&ring.buf[tail & RING_MASK],
+                words*sizeof(uint32_t))/sizeof(uint32_t);
+        tail += sent;
+        ring.tail = tail;
+        if(sent != words)
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/**
+ *  log_deferred.h : Deferred binary logging
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CODEBASE_PERIPHERAL_MODULES_LOG_DEFERRED_H_
+#define CODEBASE_PERIPHERAL_MODULES_LOG_DEFERRED_H_
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_log_deferred Deferred binary logging
+ * @brief Backend of @ref log.h where the formatting of log_printf is done on
+ *  the host. The format strings are placed in the non-loaded .log_fmt section
+ *  of the ELF and each call only copies a record with the string's offset in
+ *  this section, the RTC count and the raw argument words into a ring buffer.
+ *  The ring buffer is sent in @ref log_deferred_process over RTT or UART
+ *  and the records are decoded with utils/log_deferred_decode.py using the
+ *  ELF file of the application.
+ *
+ *  Record format, little endian 32 bit words:
+ *  - Word 0: 0xA5 sync (31:24), number of arguments (23:16),
+ *            format string offset in .log_fmt (15:0)
+ *  - Word 1: Sequence number (31:24), RTC count of ms_timer (23:0)
+ *  - Word 2 onwards: The arguments
+ *
+ * @note All the arguments must be 32 bit or smaller. The pointer of a %s
+ *  argument is sent as it is and so only strings in flash (like __func__ or
+ *  string literals) can be printed by the decoder.
+ * @{
+ */
+
+#include "stdint.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+#ifndef LOG_DEFERRED_BUF_SIZE
+/** Size of the ring buffer in bytes, must be a power of 2 */
+#define LOG_DEFERRED_BUF_SIZE   1024
+#endif
+
+/** Maximum number of arguments of a log_printf call */
+#define LOG_DEFERRED_MAX_ARGS   8
+
+/** Sync byte at the start of a record */
+#define LOG_DEFERRED_SYNC       0xA5
+
+/** Attribute to place the format strings in the non-loaded section */
+#define LOG_DEFERRED_FMT_SECTION __attribute__((section(".log_fmt")))
+
+/** @brief Counts the arguments after the format string */
+#define LOG_DEFERRED_NARGS(...)  LOG_DEFERRED_NARGS_(__VA_ARGS__, \
+        8, 7, 6, 5, 4, 3, 2, 1, 0, 0)
+#define LOG_DEFERRED_NARGS_(fmt, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+/**
+ * @brief Macro that log_printf maps to. The format string is stored in the
+ *  .log_fmt section and only its address is used on the device.
+ */
+#define LOG_DEFERRED_PRINTF(fmt, ...)                                       \
+    do                                                                      \
+    {                                                                       \
+        static const char __log_fmt[] LOG_DEFERRED_FMT_SECTION = fmt;       \
+        log_deferred_write((uint32_t) __log_fmt,                            \
+            LOG_DEFERRED_NARGS(fmt, ##__VA_ARGS__), ##__VA_ARGS__);         \
+    }while(0)
+
+/**
+ * @brief Initialize the ring buffer and the sink used to send the records
+ */
+void log_deferred_init(void);
+
+/**
+ * @brief Write a log record to the ring buffer. The record is dropped if
+ *  there isn't space for it, which the decoder finds with the sequence number.
+ * @param fmt_addr Address of the format string in the .log_fmt section
+ * @param nargs Number of 32 bit arguments that follow
+ * @note Call this with the @ref LOG_DEFERRED_PRINTF macro
+ */
+void log_deferred_write(uint32_t fmt_addr, uint32_t nargs, ...);
+
+/**
+ * @brief Send the records in the ring buffer to the sink. To be called
+ *  from the main loop or before going to sleep.
+ */
+void log_deferred_process(void);
+
+#endif /* CODEBASE_PERIPHERAL_MODULES_LOG_DEFERRED_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -20,6 +20,8 @@
 #include "stddef.h"
 #include "nrf_assert.h"
 
+#include "isr_dispatch.h"
+
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
 #endif
@@ -52,6 +54,9 @@ static volatile uint32_t ms_timers_status;
 /** To keep track of which timer needs an overflow event */
 static volatile uint32_t overflow_req_status;
 
+/** If the RTC is kept running when no timer is running */
+static volatile bool is_rtc_kept = false;
+
 /**
  * @brief Function to check number of overflow required and ticks after overflows are done 
  * @param counter_val Current RTC counter value.
@@ -93,6 +98,12 @@ void rtc_overflow_handler ()
         {
             if(ms_timer[id].timer_over_flow_num == 1)
             {
+                //The compare event is set on every earlier wrap of the
+                //counter, so clear it unless the compare is already due
+                if(RTC_ID->CC[id] > (RTC_ID->COUNTER + 1))
+                {
+                    RTC_ID->EVENTS_COMPARE[id] = 0;
+                }
                 RTC_ID->EVTENSET = 1 << (RTC_INTENSET_COMPARE0_Pos + id);
                 RTC_ID->INTENSET = 1 << (RTC_INTENSET_COMPARE0_Pos + id);
                 overflow_req_status &= 0<<id;
@@ -158,9 +169,10 @@ void ms_timer_start(ms_timer_num id, ms_timer_mode mode, uint64_t ticks, void (*
         ms_timer[id].timer_mode = ticks;
     }
     
-    cal_overflow_ticks_req (counter_val, ticks, id);
-
+    //Clear a leftover compare event before the interrupt is enabled
     RTC_ID->EVENTS_COMPARE[id] = 0;
+
+    cal_overflow_ticks_req (counter_val, ticks, id);
      
     if (ms_timers_status == 0)
     {
@@ -177,7 +189,20 @@ void ms_timer_stop(ms_timer_num id)
     RTC_ID->EVTENCLR = 1 << (RTC_INTENSET_COMPARE0_Pos + id);
     RTC_ID->INTENCLR = 1 << (RTC_INTENSET_COMPARE0_Pos + id);
 
-    if (ms_timers_status == 0)
+    if ((ms_timers_status == 0) && (is_rtc_kept == false))
+    {
+        RTC_ID->TASKS_STOP = 1;
+    }
+}
+
+void ms_timer_keep_running(bool is_kept)
+{
+    is_rtc_kept = is_kept;
+    if(is_kept)
+    {
+        RTC_ID->TASKS_START = 1;
+    }
+    else if(ms_timers_status == 0)
     {
         RTC_ID->TASKS_STOP = 1;
     }
@@ -193,29 +218,25 @@ bool ms_timer_get_on_status(ms_timer_num id)
  */
 __attribute__((optimize("unroll-loops")))
 #if ISR_MANAGER == 1
-void ms_timer_rtc_Handler ()
+void ms_timer_rtc_Handler (uint32_t fired)
 #else
 void RTC_IRQ_Handler()
 #endif
 {
-    uint32_t counter_val = RTC_ID->COUNTER;
-    if(RTC_ID->EVENTS_OVRFLW)
-    {
 #if ISR_MANAGER == 0
-        RTC_ID->EVENTS_OVRFLW = 0;
+    uint32_t fired = isr_dispatch_take (RTC_ID);
 #endif
+    uint32_t counter_val = RTC_ID->COUNTER;
+    if(fired & ISR_DISPATCH_EVT(RTC_ID, RTC_ID->EVENTS_OVRFLW))
+    {
         rtc_overflow_handler ();
     }
     for (ms_timer_num id = MS_TIMER0; id < MS_TIMER_MAX; id++)
     {
-        if (RTC_ID->EVENTS_COMPARE[id])
+        if (fired & ISR_DISPATCH_EVT(RTC_ID, RTC_ID->EVENTS_COMPARE[id]))
         {
             RTC_ID->EVTENCLR = 1 << (RTC_INTENSET_COMPARE0_Pos + id);
             RTC_ID->INTENCLR = 1 << (RTC_INTENSET_COMPARE0_Pos + id);
-#if ISR_MANAGER == 0
-            RTC_ID->EVENTS_COMPARE[id] = 0;
-            (void)RTC_ID->EVENTS_COMPARE[id];
-#endif
 
             void (*cb_handler)(void) = NULL;
             if (ms_timer[id].timer_handler != NULL)
@@ -112,6 +112,15 @@ void ms_timer_start(ms_timer_num id, ms_timer_mode mode, uint64_t ticks, void (*
  */
 void ms_timer_stop(ms_timer_num id);
 
+/**
+ * @brief Keep the RTC counting when no timer is running, for a module
+ *  which uses its counter as a time base
+ * @param is_kept True to keep the RTC running, false to let it stop when
+ *  no timer is running
+ * @note To be called after @ref ms_timer_init, which stops the RTC
+ */
+void ms_timer_keep_running(bool is_kept);
+
 /**
  * Returns if a timer is on
  * @param id		ID of timer being enquired
@@ -25,6 +25,7 @@
 #include "nrf_util.h"
 #include "log.h"
 #include "common_util.h"
+#include "prof_region.h"
 
 #define PAGE_METADATA_OFFSET 1
 
@@ -112,6 +113,7 @@ void empty_page (uint32_t page_addr);
 
 void get_total_entries (uint32_t log_id)
 {
+    PROF_REGION_START(nvm_logger_count_entries);
     for(uint32_t page_no = 0; page_no < LOGS[log_id].no_pages; page_no++)
     {   
         for(uint32_t loc = 0; loc < LOGS[log_id].last_entry_no; loc++)
@@ -124,8 +126,9 @@ void get_total_entries (uint32_t log_id)
                 LOGS[log_id].total_entries++;
             }
         }
-        log_printf("Total Entries LOGS[%d] : %d\n", log_id,LOGS[log_id].total_entries);
     }    
+    PROF_REGION_STOP(nvm_logger_count_entries);
+    log_printf("Total Entries LOGS[%d] : %d\n", log_id,LOGS[log_id].total_entries);
 }
 
 uint32_t get_next_loc (uint32_t log_id)
@@ -135,6 +138,7 @@ uint32_t get_next_loc (uint32_t log_id)
      * empty location available. So write log_write function to take care of
      * erasing of next page */
     log_printf("%s\n",__func__);
+    PROF_REGION_START(nvm_logger_next_loc);
     uint32_t page_no = 0;
     uint32_t * p_mem_loc = (uint32_t *)LOGS[log_id].page_addrs[page_no];
     bool next_loc_found = false;
@@ -161,6 +165,7 @@ uint32_t get_next_loc (uint32_t log_id)
             current_page_entry_no = 0;
         }
     }
+    PROF_REGION_STOP(nvm_logger_next_loc);
     log_printf("Next loc : %x\n", p_mem_loc);
     return (uint32_t)p_mem_loc;
 }
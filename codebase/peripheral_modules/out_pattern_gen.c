@@ -30,6 +30,75 @@
 /** Specify the MS_TIMER used for the output pattern generator module */
 #define OUT_GEN_MS_TIMER_USED           CONCAT_2(MS_TIMER, MS_TIMER_USED_OUT_GEN) 
 
+#if defined TIMER_USED_OUT_GEN
+#include "nrf_util.h"
+#include "hal_ppi.h"
+#include "pwr_mgr.h"
+#include "isr_dispatch.h"
+#include "res_alloc.h"
+
+#if ISR_MANAGER == 1
+#include "isr_manager.h"
+#endif
+
+#define TIMER_ID            CONCAT_2(NRF_TIMER, TIMER_USED_OUT_GEN)
+#define TIMER_IRQN          CONCAT_3(TIMER, TIMER_USED_OUT_GEN, _IRQn)
+#define TIMER_IRQ_Handler   CONCAT_3(TIMER, TIMER_USED_OUT_GEN, _IRQHandler)
+#define TIMER_CC_NUM        CONCAT_3(TIMER, TIMER_USED_OUT_GEN, _CC_NUM)
+
+#if (OUT_GEN_HW_NUM_OUT > TIMER_CC_NUM) || (OUT_GEN_HW_NUM_OUT > OUT_GEN_MAX_NUM_OUT)
+#error "OUT_GEN_HW_NUM_OUT needs a CC register of TIMER_USED_OUT_GEN for each pin"
+#endif
+
+/** Prescaler 4 for the TIMER to count us from the PCLK1M */
+#define TIMER_PRESCALER     4
+
+/** An edge less than this many us after the counter when it is loaded is
+ *  made by the CPU, as the counter could pass the CC before it is written */
+#define HW_MIN_LEAD_US      4
+
+/** Transition index of a pin with no edge left in the pattern */
+#define HW_NO_EDGE          (OUT_GEN_MAX_TRANSITIONS + 1)
+
+static const uint8_t hw_ppi_ch[OUT_GEN_HW_NUM_OUT] =
+{
+    PPI_CH_USED_OUT_GEN_0, PPI_CH_USED_OUT_GEN_1,
+#if OUT_GEN_HW_NUM_OUT > 2
+    PPI_CH_USED_OUT_GEN_2,
+#endif
+#if OUT_GEN_HW_NUM_OUT > 3
+    PPI_CH_USED_OUT_GEN_3,
+#endif
+};
+
+static const uint8_t hw_gpiote_ch[OUT_GEN_HW_NUM_OUT] =
+{
+    GPIOTE_CH_USED_OUT_GEN_0, GPIOTE_CH_USED_OUT_GEN_1,
+#if OUT_GEN_HW_NUM_OUT > 2
+    GPIOTE_CH_USED_OUT_GEN_2,
+#endif
+#if OUT_GEN_HW_NUM_OUT > 3
+    GPIOTE_CH_USED_OUT_GEN_3,
+#endif
+};
+
+static struct
+{
+    /** If the pattern being generated is played by the TIMER */
+    bool is_on;
+    /** Time in us of each transition from the start of the pattern */
+    uint32_t transition_us[OUT_GEN_MAX_TRANSITIONS + 1];
+    /** The transition in which each pin toggles next, in its CC */
+    uint32_t next_edge[OUT_GEN_MAX_NUM_OUT];
+    /** The CC with the end of the pattern, OUT_GEN_MAX_NUM_OUT if none */
+    uint32_t end_cc;
+    /** Edges made by the CPU after their time */
+    uint32_t late_edges;
+    /** ID of this module with the power manager, for the HF crystal */
+    uint32_t pwr_client;
+}hw;
+#endif
+
 static struct
 {
     uint32_t num_out;
@@ -46,6 +115,192 @@ void (*done_handler)(uint32_t out_gen_state);
 
 static uint32_t timer_start_ticks_value;
 
+#if defined TIMER_USED_OUT_GEN
+/** The transition after @p from in which the pin toggles */
+static uint32_t hw_next_toggle(uint32_t pin, uint32_t from)
+{
+    for(uint32_t t = from; t <= context.num_transitions; t++)
+    {
+        if(context.next_out[pin][t] != context.next_out[pin][t - 1])
+        {
+            return t;
+        }
+    }
+    return HW_NO_EDGE;
+}
+
+/** The count of the TIMER, captured in the CC of the pin being loaded */
+static uint32_t hw_now_us(uint32_t cc)
+{
+    TIMER_ID->TASKS_CAPTURE[cc] = 1;
+    return TIMER_ID->CC[cc];
+}
+
+/** Load the next edge of a pin in its CC. The edges whose time is too near
+ *  or already passed are made here. */
+static void hw_load(uint32_t pin)
+{
+    uint32_t now = hw_now_us(pin);
+
+    while(hw.next_edge[pin] != HW_NO_EDGE)
+    {
+        uint32_t at = hw.transition_us[hw.next_edge[pin]];
+        if((int32_t)(at - now) >= HW_MIN_LEAD_US)
+        {
+            TIMER_ID->CC[pin] = at;
+            TIMER_ID->INTENSET = TIMER_INTENSET_COMPARE0_Msk << pin;
+            hal_ppi_en_ch (hw_ppi_ch[pin]);
+            return;
+        }
+        NRF_GPIOTE->TASKS_OUT[hw_gpiote_ch[pin]] = 1;
+        if((int32_t)(now - at) > 0)
+        {
+            hw.late_edges++;
+        }
+        hw.next_edge[pin] = hw_next_toggle(pin, hw.next_edge[pin] + 1);
+    }
+    hal_ppi_dis_ch (hw_ppi_ch[pin]);
+    TIMER_ID->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk << pin;
+}
+
+/** Release the pins to the GPIO with their values, and the TIMER */
+static void hw_release(bool * out_vals)
+{
+    TIMER_ID->TASKS_STOP = 1;
+    TIMER_ID->TASKS_SHUTDOWN = 1;
+    TIMER_ID->INTENCLR = 0xFFFFFFFF;
+    for(uint32_t i = 0; i < context.num_out; i++)
+    {
+        hal_ppi_dis_ch (hw_ppi_ch[i]);
+        hal_gpio_pin_write(context.out_pins[i], out_vals[i]);
+        NRF_GPIOTE->CONFIG[hw_gpiote_ch[i]] = 0;
+    }
+    pwr_mgr_need(hw.pwr_client, PWR_MGR_NEED_NONE);
+    hw.is_on = false;
+}
+
+/** End the pattern at its last transition, or arm a free CC for it */
+static void hw_end(uint32_t cc)
+{
+    bool final_out[OUT_GEN_MAX_NUM_OUT];
+
+    if((int32_t)(hw.transition_us[context.num_transitions] - hw_now_us(cc))
+            >= HW_MIN_LEAD_US)
+    {
+        hw.end_cc = cc;
+        TIMER_ID->CC[cc] = hw.transition_us[context.num_transitions];
+        TIMER_ID->INTENSET = TIMER_INTENSET_COMPARE0_Msk << cc;
+        return;
+    }
+    for(uint32_t i = 0; i < context.num_out; i++)
+    {
+        final_out[i] = context.next_out[i][context.num_transitions];
+    }
+    hw_release(final_out);
+    context.current_transition = context.num_transitions;
+    context.is_on = false;
+    if(done_handler != NULL)
+    {
+        done_handler(context.end_context);
+    }
+}
+
+#if ISR_MANAGER == 1
+void out_gen_timer_Handler (uint32_t fired)
+#else
+void TIMER_IRQ_Handler (void)
+#endif
+{
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (TIMER_ID);
+#endif
+    bool is_all_done = true;
+    uint32_t last = 0;
+
+    for(uint32_t i = 0; (i < context.num_out) && hw.is_on; i++)
+    {
+        if((fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[i])) == 0)
+        {
+            continue;
+        }
+        if(i == hw.end_cc)
+        {
+            hw_end(i);
+            return;
+        }
+        //The pin is toggled by the PPI, its next edge is loaded
+        hw.next_edge[i] = hw_next_toggle(i, hw.next_edge[i] + 1);
+        hw_load(i);
+        last = i;
+    }
+    if((hw.is_on == false) || (hw.end_cc != OUT_GEN_MAX_NUM_OUT) || (fired == 0))
+    {
+        return;
+    }
+    for(uint32_t i = 0; i < context.num_out; i++)
+    {
+        is_all_done = is_all_done && (hw.next_edge[i] == HW_NO_EDGE);
+    }
+    if(is_all_done)
+    {
+        hw_end(last);
+    }
+}
+
+/** Play the pattern in the context with the TIMER, false if it can't be */
+static bool hw_start(void)
+{
+    uint64_t ticks = 0;
+
+    if(context.num_out > OUT_GEN_HW_NUM_OUT)
+    {
+        return false;
+    }
+    //The ticks of every transition from the start, so the rounding to a us
+    //doesn't build up
+    for(uint32_t t = 0; t <= context.num_transitions; t++)
+    {
+        uint64_t us = ROUNDED_DIV(ticks * 1000000, MS_TIMER_FREQ);
+        if(us > (UINT32_MAX/2))
+        {
+            return false;
+        }
+        hw.transition_us[t] = (uint32_t) us;
+        ticks += (t < context.num_transitions) ? context.transitions_durations[t] : 0;
+    }
+
+    pwr_mgr_need(hw.pwr_client, PWR_MGR_NEED_HFXO);
+    TIMER_ID->TASKS_STOP = 1;
+    TIMER_ID->TASKS_CLEAR = 1;
+    TIMER_ID->INTENCLR = 0xFFFFFFFF;
+    hw.is_on = true;
+    hw.end_cc = OUT_GEN_MAX_NUM_OUT;
+    for(uint32_t i = 0; i < context.num_out; i++)
+    {
+        TIMER_ID->EVENTS_COMPARE[i] = 0;
+        NRF_GPIOTE->CONFIG[hw_gpiote_ch[i]] =
+                  (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos)
+                | (context.out_pins[i] << GPIOTE_CONFIG_PSEL_Pos)
+                | (GPIOTE_CONFIG_POLARITY_Toggle << GPIOTE_CONFIG_POLARITY_Pos)
+                | ((context.next_out[i][0] ? GPIOTE_CONFIG_OUTINIT_High :
+                    GPIOTE_CONFIG_OUTINIT_Low) << GPIOTE_CONFIG_OUTINIT_Pos);
+        hw.next_edge[i] = hw_next_toggle(i, 1);
+        hw_load(i);
+    }
+    TIMER_ID->TASKS_START = 1;
+    //With no pin toggling the pattern is only a delay
+    for(uint32_t i = 0; i < context.num_out; i++)
+    {
+        if(hw.next_edge[i] != HW_NO_EDGE)
+        {
+            return true;
+        }
+    }
+    hw_end(0);
+    return true;
+}
+#endif
+
 static void timer_handler(void)
 {
     context.current_transition++;
@@ -84,6 +339,45 @@ void out_gen_init(uint32_t num_out, uint32_t * out_pins, bool * out_init_value)
     }
 
     context.is_on = false;
+
+#if defined TIMER_USED_OUT_GEN
+    static bool is_hw_init = false;
+    if(is_hw_init == false)
+    {
+        hw.pwr_client = pwr_mgr_client_register("out_gen", PWR_MGR_UA_TIMER);
+        //Claim the TIMER and the channels so that a module getting its
+        //resources at run time isn't given the same ones
+        bool is_reserved = res_alloc_reserve_range(RES_ALLOC_TIMER_CC,
+                res_alloc_timer_cc_idx(TIMER_USED_OUT_GEN, 0), TIMER_CC_NUM);
+        for(uint32_t i = 0; i < OUT_GEN_HW_NUM_OUT; i++)
+        {
+            is_reserved = res_alloc_reserve(RES_ALLOC_PPI_CH, hw_ppi_ch[i])
+                    && res_alloc_reserve(RES_ALLOC_GPIOTE_CH, hw_gpiote_ch[i])
+                    && is_reserved;
+        }
+        ASSERT(is_reserved);
+        is_hw_init = true;
+    }
+    hw.is_on = false;
+    hw.late_edges = 0;
+    TIMER_ID->TASKS_STOP = 1;
+    TIMER_ID->MODE = TIMER_MODE_MODE_Timer;
+    TIMER_ID->PRESCALER = TIMER_PRESCALER;
+    TIMER_ID->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    TIMER_ID->SHORTS = 0;
+    for(uint32_t i = 0; i < OUT_GEN_HW_NUM_OUT; i++)
+    {
+        hal_ppi_setup_t ppi =
+        {
+            .ppi_id = hw_ppi_ch[i],
+            .event = (uint32_t) &(TIMER_ID->EVENTS_COMPARE[i]),
+            .task = (uint32_t) &(NRF_GPIOTE->TASKS_OUT[hw_gpiote_ch[i]]),
+        };
+        hal_ppi_set (&ppi);
+    }
+    NVIC_SetPriority(TIMER_IRQN, OUT_GEN_IRQ_PRIORITY);
+    NVIC_EnableIRQ(TIMER_IRQN);
+#endif
 }
 
 void out_gen_start(out_gen_config_t * out_gen_config)
@@ -108,15 +402,27 @@ void out_gen_start(out_gen_config_t * out_gen_config)
     context.is_on = true;
     context.end_context = out_gen_config->out_gen_state;
     done_handler = out_gen_config->done_handler;
+    timer_start_ticks_value = ms_timer_get_current_count();
 
+#if defined TIMER_USED_OUT_GEN
+    if(hw_start())
+    {
+        return;
+    }
+#endif
     ms_timer_start(OUT_GEN_MS_TIMER_USED, MS_SINGLE_CALL,
             out_gen_config->transitions_durations[context.current_transition],timer_handler);
-    timer_start_ticks_value = ms_timer_get_current_count();
 }
 
 void out_gen_stop(bool * out_vals)
 {
     context.is_on = false;
+#if defined TIMER_USED_OUT_GEN
+    if(hw.is_on)
+    {
+        hw_release(out_vals);
+    }
+#endif
     ms_timer_stop(OUT_GEN_MS_TIMER_USED);
     for(uint32_t i = 0; i< context.num_out; i++)
     {
@@ -134,3 +440,12 @@ inline uint32_t out_gen_get_ticks(void)
     return ((ms_timer_get_current_count() + (1<<24) - timer_start_ticks_value)
             & 0x00FFFFFF);
 }
+
+uint32_t out_gen_get_late_edges(void)
+{
+#if defined TIMER_USED_OUT_GEN
+    return hw.late_edges;
+#else
+    return 0;
+#endif
+}
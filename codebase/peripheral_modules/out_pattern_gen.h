@@ -25,6 +25,16 @@
  * @brief Output pattern generator module is used for generating a one time digital
  *  signal pattern on a number of pins.
  *
+ * @note When TIMER_USED_OUT_GEN is defined, the edges are placed by that
+ *  TIMER at 1 MHz: each pin has a CC register whose compare event toggles
+ *  the pin through a PPI channel and a GPIOTE task, so the edges don't
+ *  move with the interrupt latency. The interrupt of a compare only loads
+ *  the time of the next edge of that pin, and the HF crystal is kept on
+ *  with pwr_mgr while a pattern plays. An edge whose time has already
+ *  passed when it is loaded is made by the CPU and counted in
+ *  @ref out_gen_get_late_edges. Patterns longer than the 32 bit us count
+ *  and pins beyond @ref OUT_GEN_HW_NUM_OUT are generated with the ms_timer.
+ *
  * @{
  */
 
@@ -41,6 +51,59 @@
 #define MS_TIMER_USED_OUT_GEN 1
 #endif
 
+#if defined TIMER_USED_OUT_GEN
+/** Number of pins with a CC of the TIMER, a PPI and a GPIOTE channel */
+#ifndef OUT_GEN_HW_NUM_OUT
+#define OUT_GEN_HW_NUM_OUT 4
+#endif
+
+#ifndef PPI_CH_USED_OUT_GEN_0
+#define PPI_CH_USED_OUT_GEN_0 14
+#endif
+
+#ifndef PPI_CH_USED_OUT_GEN_1
+#define PPI_CH_USED_OUT_GEN_1 15
+#endif
+
+#if OUT_GEN_HW_NUM_OUT > 2
+#ifndef PPI_CH_USED_OUT_GEN_2
+#define PPI_CH_USED_OUT_GEN_2 16
+#endif
+#endif
+
+#if OUT_GEN_HW_NUM_OUT > 3
+#ifndef PPI_CH_USED_OUT_GEN_3
+#define PPI_CH_USED_OUT_GEN_3 12
+#endif
+#endif
+
+#ifndef GPIOTE_CH_USED_OUT_GEN_0
+#define GPIOTE_CH_USED_OUT_GEN_0 4
+#endif
+
+#ifndef GPIOTE_CH_USED_OUT_GEN_1
+#define GPIOTE_CH_USED_OUT_GEN_1 5
+#endif
+
+#if OUT_GEN_HW_NUM_OUT > 2
+#ifndef GPIOTE_CH_USED_OUT_GEN_2
+#define GPIOTE_CH_USED_OUT_GEN_2 6
+#endif
+#endif
+
+#if OUT_GEN_HW_NUM_OUT > 3
+#ifndef GPIOTE_CH_USED_OUT_GEN_3
+#define GPIOTE_CH_USED_OUT_GEN_3 7
+#endif
+#endif
+
+/** Priority of the TIMER interrupt which loads the next edges. The done
+ *  handler is called from it, so it is the priority the apps give ms_timer. */
+#ifndef OUT_GEN_IRQ_PRIORITY
+#define OUT_GEN_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
+#endif
+#endif
+
 
 /** The maximum number of transitions that can occur in the generated pattern */
 #define OUT_GEN_MAX_TRANSITIONS 64
@@ -104,6 +167,14 @@ bool out_gen_is_on(void);
  */
 uint32_t out_gen_get_ticks(void);
 
+/**
+ * @brief Function to get the number of edges made by the CPU after their
+ *  time, as the interrupt which loads them into the TIMER came too late
+ * @return Number of late edges since @ref out_gen_init, always 0 without
+ *  TIMER_USED_OUT_GEN
+ */
+uint32_t out_gen_get_late_edges(void);
+
 #endif /* CODEBASE_PERIPHERAL_MODULES_OUT_PATTERN_GEN_H_ */
 
 /**
@@ -22,6 +22,7 @@
 #include "nrf_util.h"
 #include "hal_ppi.h"
 #include "aux_clk.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -42,18 +43,21 @@ void (*sense_handler)(int32_t adc_val);
 
 /** @brief Implementation of the SAADC interrupt handler */
 #if ISR_MANAGER == 1
-void pir_sense_saadc_Handler (void)
+void pir_sense_saadc_Handler (uint32_t fired)
 #else
 void SAADC_IRQHandler(void)
 #endif
 {
 #if ISR_MANAGER == 0
-    NRF_SAADC->EVENTS_CH[SAADC_CHANNEL].LIMITH = 0;
-    (void) NRF_SAADC->EVENTS_CH[SAADC_CHANNEL].LIMITH;
-    NRF_SAADC->EVENTS_CH[SAADC_CHANNEL].LIMITL = 0;
-    (void) NRF_SAADC->EVENTS_CH[SAADC_CHANNEL].LIMITL;
+    uint32_t fired = isr_dispatch_take (NRF_SAADC);
 #endif
-    sense_handler(saadc_result[0]);
+    if(fired & (ISR_DISPATCH_EVT(NRF_SAADC,
+            NRF_SAADC->EVENTS_CH[SAADC_CHANNEL].LIMITH) |
+            ISR_DISPATCH_EVT(NRF_SAADC,
+            NRF_SAADC->EVENTS_CH[SAADC_CHANNEL].LIMITL)))
+    {
+        sense_handler(saadc_result[0]);
+    }
 }
 
 void pir_sense_start(pir_sense_cfg * init)
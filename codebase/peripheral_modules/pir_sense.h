@@ -86,8 +86,9 @@
 #define PPI_CHANNEL_USED_PIR_SENSE_3 2
 #endif
 
+/** The samples are timed by aux_clk, so its RTC is the one used */
 #ifndef RTC_USED_PIR_SENSE
-#define RTC_USED_PIR_SENSE 0
+#define RTC_USED_PIR_SENSE RTC_USED_AUX_CLK
 #endif
 
 /** List of Clock Sources that can be used to drive this module */
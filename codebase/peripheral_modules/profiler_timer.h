@@ -25,6 +25,8 @@
  *
  * @warning Verify in the nrf5xxxx_peripheral.h file that the timer used
  *  can work up to 32 bit resolution
+ * @note The @ref group_prof_region measures nested regions without a TIMER
+ *  and without printing in the measured code.
  * @{
  */
 
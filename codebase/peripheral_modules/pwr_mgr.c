@@ -0,0 +1,419 @@
+/**
+ *  pwr_mgr.c : Power manager for the idle state of the application
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pwr_mgr.h"
+#include "nrf.h"
+#include "nrf_peripherals.h"
+#include "nrf_util.h"
+#include "nrf_assert.h"
+#include "hal_clocks.h"
+#include "ms_timer.h"
+#include "log.h"
+#include "string.h"
+#if defined(SOFTDEVICE_PRESENT)
+#include "nrf_sdm.h"
+#include "nrf_soc.h"
+#endif
+
+/** The RTC which is the time base. The SoCs with three RTCs have RTC2 free
+ *  for it, the others share the RTC of ms_timer and keep it running. */
+#ifndef RTC_USED_PWR_MGR
+#if (RTC_COUNT > 2)
+#define RTC_USED_PWR_MGR 2
+#else
+#define RTC_USED_PWR_MGR MS_TIMER_RTC_USED
+#endif
+#endif
+
+/** The RTC whose counter is used to measure the time asleep and awake */
+#define RTC_ID              CONCAT_2(NRF_RTC, RTC_USED_PWR_MGR)
+
+/** Mask of the 24 bit RTC counter */
+#define RTC_COUNTER_MASK    0x00FFFFFF
+
+/** Convert LFCLK ticks to ms */
+#define TICKS_TO_MS(ticks)  ((uint32_t)(((ticks) * 1000) / LFCLK_FREQ))
+
+/** A client of the power manager */
+typedef struct
+{
+    /** Name of the client */
+    const char * name;
+    /** The needs from @ref pwr_mgr_need_t */
+    uint32_t needs;
+    /** Current of the peripheral of the client while it has a need */
+    uint32_t periph_ua;
+    /** Number of sleeps during which this client needed the HF crystal */
+    uint32_t hfxo_sleeps;
+    /** Number of sleeps during which this client needed only the HF clock */
+    uint32_t hfclk_sleeps;
+}pwr_mgr_client_t;
+
+static pwr_mgr_client_t clients[PWR_MGR_MAX_CLIENTS];
+static uint32_t client_count = 0;
+
+static pwr_mgr_stats_t stats;
+
+/** RTC counter at the last wake, valid only if is_started is true */
+static uint32_t last_wake_counter;
+static bool is_started = false;
+
+/** If the RTC used as the time base is started */
+static bool is_rtc_started = false;
+
+/** If the constant latency mode is set */
+static bool is_const_lat = false;
+
+/** If the HF crystal is started by this module */
+static bool is_hfxo_started = false;
+
+/** Number of sleeps with the HF crystal running while no client needed it */
+static uint32_t unowned_hfxo_sleeps = 0;
+
+#if defined(SOFTDEVICE_PRESENT)
+/** If the HF crystal is requested from the SoftDevice */
+static bool is_sd_hfclk_requested = false;
+#endif
+
+/** Check if the SoftDevice is enabled */
+static bool is_sd_enabled(void)
+{
+    uint8_t is_enabled = 0;
+#if defined(SOFTDEVICE_PRESENT)
+    (void) sd_softdevice_is_enabled(&is_enabled);
+#endif
+    return (is_enabled != 0);
+}
+
+/** Check if the HF crystal is running */
+static bool is_hfxo_running(void)
+{
+    return (NRF_CLOCK->HFCLKSTAT ==
+        ((CLOCK_HFCLKSTAT_STATE_Running << CLOCK_HFCLKSTAT_STATE_Pos) |
+        (CLOCK_HFCLKSTAT_SRC_Xtal << CLOCK_HFCLKSTAT_SRC_Pos)));
+}
+
+/** Start the RTC used as the time base, which runs from then on */
+static void rtc_start(void)
+{
+#if (RTC_USED_PWR_MGR == MS_TIMER_RTC_USED)
+    //ms_timer would otherwise stop it when none of its timers run
+    ms_timer_keep_running(true);
+#else
+    RTC_ID->TASKS_STOP = 1;
+    RTC_ID->PRESCALER = 0;
+    RTC_ID->TASKS_START = 1;
+#endif
+    is_rtc_started = true;
+}
+
+/** Get the needs of all the clients */
+static uint32_t all_needs(void)
+{
+    uint32_t needs = 0;
+    for(uint32_t i = 0; i < client_count; i++)
+    {
+        needs |= clients[i].needs;
+    }
+    return needs;
+}
+
+/** Get the current of the peripherals of the clients which have a need */
+static uint32_t all_periph_ua(void)
+{
+    uint32_t periph_ua = 0;
+    for(uint32_t i = 0; i < client_count; i++)
+    {
+        if(clients[i].needs != PWR_MGR_NEED_NONE)
+        {
+            periph_ua += clients[i].periph_ua;
+        }
+    }
+    return periph_ua;
+}
+
+/** Start or stop the HF crystal and set the power mode as per the needs */
+static void apply_needs(uint32_t needs, bool is_sd)
+{
+    bool const_lat = ((needs & PWR_MGR_NEED_CONST_LAT) != 0);
+
+#if defined(SOFTDEVICE_PRESENT)
+    if(is_sd)
+    {
+        if((needs & PWR_MGR_NEED_HFXO) && (is_sd_hfclk_requested == false))
+        {
+            uint32_t is_running = 0;
+            (void) sd_clock_hfclk_request();
+            do
+            {
+                (void) sd_clock_hfclk_is_running(&is_running);
+            }while(is_running == 0);
+            is_sd_hfclk_requested = true;
+        }
+        else if(((needs & PWR_MGR_NEED_HFXO) == 0) && is_sd_hfclk_requested)
+        {
+            (void) sd_clock_hfclk_release();
+            is_sd_hfclk_requested = false;
+        }
+
+        if(const_lat != is_const_lat)
+        {
+            (void) sd_power_mode_set(const_lat ?
+                NRF_POWER_MODE_CONSTLAT : NRF_POWER_MODE_LOWPWR);
+            is_const_lat = const_lat;
+        }
+        return;
+    }
+    //Requests are dropped when the SoftDevice is disabled
+    is_sd_hfclk_requested = false;
+#endif
+
+    //The HF crystal started by modules not registered here is left
+    //running and accounted in unowned_hfxo_sleeps
+    if(needs & PWR_MGR_NEED_HFXO)
+    {
+        if(is_hfxo_running() == false)
+        {
+            hfclk_xtal_init_blocking();
+            is_hfxo_started = true;
+        }
+    }
+    else if(is_hfxo_started)
+    {
+        hfclk_xtal_deinit();
+        is_hfxo_started = false;
+    }
+
+    if(const_lat != is_const_lat)
+    {
+        if(const_lat)
+        {
+            NRF_POWER->TASKS_CONSTLAT = 1;
+        }
+        else
+        {
+            NRF_POWER->TASKS_LOWPWR = 1;
+        }
+        is_const_lat = const_lat;
+    }
+}
+
+uint32_t pwr_mgr_client_register(const char * name, uint32_t periph_ua)
+{
+    uint32_t client;
+
+    ASSERT(client_count < PWR_MGR_MAX_CLIENTS);
+    CRITICAL_REGION_ENTER();
+    client = client_count++;
+    CRITICAL_REGION_EXIT();
+
+    clients[client].name = name;
+    clients[client].needs = PWR_MGR_NEED_NONE;
+    clients[client].periph_ua = periph_ua;
+    clients[client].hfxo_sleeps = 0;
+    clients[client].hfclk_sleeps = 0;
+    return client;
+}
+
+void pwr_mgr_need(uint32_t client, uint32_t needs)
+{
+    uint32_t added;
+
+    bool is_sd = is_sd_enabled();
+
+    ASSERT(client < client_count);
+    CRITICAL_REGION_ENTER();
+    added = needs & ~clients[client].needs;
+    clients[client].needs = needs;
+
+    //Anything released is applied only on the next sleep
+    if(added)
+    {
+        apply_needs(all_needs(), is_sd);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void pwr_mgr_sleep(void)
+{
+    uint32_t needs, periph_ua;
+    bool is_sd = is_sd_enabled();
+    bool is_hfxo;
+    uint32_t sleep_counter, slept;
+
+    if(is_rtc_started == false)
+    {
+        rtc_start();
+    }
+
+    //A need added by an interrupt between reading and applying the needs
+    //would be undone, such as the HF crystal stopped after it is started
+    CRITICAL_REGION_ENTER();
+    needs = all_needs();
+    periph_ua = all_periph_ua();
+    apply_needs(needs, is_sd);
+    CRITICAL_REGION_EXIT();
+    is_hfxo = is_hfxo_running();
+
+    sleep_counter = RTC_ID->COUNTER;
+    if(is_started)
+    {
+        stats.awake_ticks += (sleep_counter - last_wake_counter) & RTC_COUNTER_MASK;
+    }
+
+    if(is_sd)
+    {
+#if defined(SOFTDEVICE_PRESENT)
+        (void) sd_app_evt_wait();
+#endif
+        last_wake_counter = RTC_ID->COUNTER;
+        stats.wake_count[PWR_MGR_WAKE_SRC_OTHER]++;
+    }
+    else
+    {
+        bool is_irq = false;
+
+        //The CPU wakes on a pending interrupt even when masked, so the
+        //interrupts which woke it are seen before their handlers run
+        __disable_irq();
+        __WFI();
+        last_wake_counter = RTC_ID->COUNTER;
+        for(uint32_t irq = 0; irq < PWR_MGR_IRQ_COUNT; irq++)
+        {
+            if(NVIC->ISPR[irq/32] & (1UL << (irq % 32)))
+            {
+                stats.wake_count[irq]++;
+                is_irq = true;
+            }
+        }
+        __enable_irq();
+        if(is_irq == false)
+        {
+            stats.wake_count[PWR_MGR_WAKE_SRC_OTHER]++;
+        }
+    }
+
+    slept = (last_wake_counter - sleep_counter) & RTC_COUNTER_MASK;
+    is_started = true;
+
+    stats.sleep_count++;
+    stats.sleep_ticks += slept;
+    stats.sleep_periph_charge += (uint64_t) slept * periph_ua;
+    if(is_hfxo)
+    {
+        stats.sleep_hfxo_ticks += slept;
+        if((needs & PWR_MGR_NEED_HFXO) == 0)
+        {
+            unowned_hfxo_sleeps++;
+        }
+        for(uint32_t i = 0; i < client_count; i++)
+        {
+            if(clients[i].needs & PWR_MGR_NEED_HFXO)
+            {
+                clients[i].hfxo_sleeps++;
+            }
+        }
+    }
+    else if(needs & PWR_MGR_NEED_HFCLK)
+    {
+        stats.sleep_hfint_ticks += slept;
+    }
+    //Clients needing only the HF clock, whichever oscillator gives it
+    for(uint32_t i = 0; i < client_count; i++)
+    {
+        if((clients[i].needs & (PWR_MGR_NEED_HFXO | PWR_MGR_NEED_HFCLK)) ==
+                PWR_MGR_NEED_HFCLK)
+        {
+            clients[i].hfclk_sleeps++;
+        }
+    }
+}
+
+const pwr_mgr_stats_t * pwr_mgr_get_stats(void)
+{
+    return &stats;
+}
+
+void pwr_mgr_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(pwr_mgr_stats_t));
+    for(uint32_t i = 0; i < client_count; i++)
+    {
+        clients[i].hfxo_sleeps = 0;
+        clients[i].hfclk_sleeps = 0;
+    }
+    unowned_hfxo_sleeps = 0;
+    is_started = false;
+}
+
+uint32_t pwr_mgr_estimate_current_na(void)
+{
+    uint64_t total = stats.sleep_ticks + stats.awake_ticks;
+    uint64_t charge;
+
+    if(total == 0)
+    {
+        return 0;
+    }
+    charge = stats.sleep_ticks * PWR_MGR_UA_SLEEP
+            + stats.sleep_hfxo_ticks * PWR_MGR_UA_HFXO
+            + stats.sleep_hfint_ticks * PWR_MGR_UA_HFINT
+            + stats.sleep_periph_charge
+            + stats.awake_ticks * PWR_MGR_UA_RUN;
+    return (uint32_t)((charge * 1000) / total);
+}
+
+void pwr_mgr_log_report(void)
+{
+    log_printf("Power: %d sleeps, asleep %d ms (HFXO on %d ms, HFINT on %d ms), awake %d ms\n",
+        stats.sleep_count, TICKS_TO_MS(stats.sleep_ticks),
+        TICKS_TO_MS(stats.sleep_hfxo_ticks), TICKS_TO_MS(stats.sleep_hfint_ticks),
+        TICKS_TO_MS(stats.awake_ticks));
+    log_printf("Power: estimated average %d nA\n", pwr_mgr_estimate_current_na());
+    for(uint32_t irq = 0; irq < PWR_MGR_WAKE_SRC_COUNT; irq++)
+    {
+        if(stats.wake_count[irq])
+        {
+            if(irq == PWR_MGR_WAKE_SRC_OTHER)
+            {
+                log_printf(" Woken by other: %d\n", stats.wake_count[irq]);
+            }
+            else
+            {
+                log_printf(" Woken by IRQ %d: %d\n", irq, stats.wake_count[irq]);
+            }
+        }
+    }
+    for(uint32_t i = 0; i < client_count; i++)
+    {
+        if(clients[i].hfxo_sleeps)
+        {
+            log_printf(" %s kept HFXO on in %d sleeps\n",
+                clients[i].name, clients[i].hfxo_sleeps);
+        }
+        if(clients[i].hfclk_sleeps)
+        {
+            log_printf(" %s kept HFCLK on in %d sleeps\n",
+                clients[i].name, clients[i].hfclk_sleeps);
+        }
+    }
+    if(unowned_hfxo_sleeps)
+    {
+        log_printf(" HFXO on without a client in %d sleeps\n", unowned_hfxo_sleeps);
+    }
+}
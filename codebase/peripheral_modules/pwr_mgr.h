@@ -0,0 +1,188 @@
+/**
+ *  pwr_mgr.h : Power manager for the idle state of the application
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_pwr_mgr Power manager
+ * @brief Module to put the SoC to sleep from the main loop of an application.
+ *  Modules register as clients and declare if they need the HF crystal
+ *  oscillator, the HF clock or the constant latency mode while the CPU
+ *  sleeps. The HF crystal is stopped on sleep when no client needs it and
+ *  the low power mode is used when no client needs constant latency. The
+ *  HF clock is requested by the peripherals themselves, so the need of it
+ *  is only accounted, as the HF internal oscillator when the crystal isn't
+ *  running.
+ *
+ *  The time asleep and awake are measured with the counter of an RTC and
+ *  the interrupts which woke the CPU are counted. RTC2 is used where the
+ *  SoC has it, else the RTC of ms_timer is shared and kept running when
+ *  no ms_timer runs. The applications set it with RTC_USED_PWR_MGR in
+ *  their sys_config.h with the other RTCs. From these an estimate of the
+ *  average current is made with the currents in @ref PWR_MGR_UA_SLEEP,
+ *  @ref PWR_MGR_UA_HFXO, @ref PWR_MGR_UA_HFINT and @ref PWR_MGR_UA_RUN,
+ *  and the current of the peripheral of each client while it has a need
+ *  during a sleep.
+ *  The time between two calls of @ref pwr_mgr_sleep must be less than the
+ *  512 s wrap around of the 24 bit RTC counter for these to be right.
+ *
+ *  Without the SoftDevice, the CPU sleeps with the interrupts masked so
+ *  that the interrupts pending on wake can be counted before their
+ *  handlers run. With the SoftDevice enabled sd_app_evt_wait is used and
+ *  the wakes are counted under @ref PWR_MGR_WAKE_SRC_OTHER.
+ * @{
+ */
+
+#ifndef CODEBASE_PERIPHERAL_MODULES_PWR_MGR_H_
+#define CODEBASE_PERIPHERAL_MODULES_PWR_MGR_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+#ifndef PWR_MGR_MAX_CLIENTS
+#define PWR_MGR_MAX_CLIENTS 8
+#endif
+
+/** Current in uA when asleep with the RTC running */
+#ifndef PWR_MGR_UA_SLEEP
+#define PWR_MGR_UA_SLEEP    2
+#endif
+
+/** Additional current in uA when the HF crystal oscillator is running */
+#ifndef PWR_MGR_UA_HFXO
+#define PWR_MGR_UA_HFXO     250
+#endif
+
+/** Additional current in uA when the HF internal oscillator is running */
+#ifndef PWR_MGR_UA_HFINT
+#define PWR_MGR_UA_HFINT    60
+#endif
+
+/** Current in uA when the CPU is running from flash */
+#ifndef PWR_MGR_UA_RUN
+#define PWR_MGR_UA_RUN      3700
+#endif
+
+/** Current in uA of a TIMER running at 1 MHz, for the clients using one */
+#ifndef PWR_MGR_UA_TIMER
+#define PWR_MGR_UA_TIMER    5
+#endif
+
+/** Current in uA of the UARTE receiving, for its client */
+#ifndef PWR_MGR_UA_UARTE
+#define PWR_MGR_UA_UARTE    55
+#endif
+
+/** Number of interrupts whose wakes are counted, from IRQn 0 */
+#define PWR_MGR_IRQ_COUNT       40
+/** Index of the wakes not caused by a pending interrupt */
+#define PWR_MGR_WAKE_SRC_OTHER  PWR_MGR_IRQ_COUNT
+/** Number of wake sources counted */
+#define PWR_MGR_WAKE_SRC_COUNT  (PWR_MGR_IRQ_COUNT + 1)
+
+/**
+ * @brief The needs of a client while the CPU sleeps
+ */
+typedef enum
+{
+    PWR_MGR_NEED_NONE = 0,              ///< Nothing needed
+    PWR_MGR_NEED_HFXO = (1 << 0),       ///< HF clock from the crystal oscillator
+    PWR_MGR_NEED_CONST_LAT = (1 << 1),  ///< Constant latency mode
+    PWR_MGR_NEED_HFCLK = (1 << 2),      ///< HF clock from any source
+}pwr_mgr_need_t;
+
+/**
+ * @brief The statistics of the sleeps, with the time in LFCLK ticks
+ */
+typedef struct
+{
+    /** Number of times the CPU slept */
+    uint32_t sleep_count;
+    /** Time asleep */
+    uint64_t sleep_ticks;
+    /** Time asleep with the HF crystal oscillator running */
+    uint64_t sleep_hfxo_ticks;
+    /** Time asleep with the HF clock needed from the internal oscillator */
+    uint64_t sleep_hfint_ticks;
+    /** Charge of the peripherals of the clients asleep, in uA times ticks */
+    uint64_t sleep_periph_charge;
+    /** Time awake */
+    uint64_t awake_ticks;
+    /** Number of wakes by each interrupt, indexed by the IRQn */
+    uint32_t wake_count[PWR_MGR_WAKE_SRC_COUNT];
+}pwr_mgr_stats_t;
+
+/**
+ * @brief Register a client of the power manager
+ * @param name Name of the client, used in @ref pwr_mgr_log_report
+ * @param periph_ua Current in uA of the peripheral of the client while it
+ *  has a need, not including the clocks
+ * @return The ID of the client for @ref pwr_mgr_need
+ */
+uint32_t pwr_mgr_client_register(const char * name, uint32_t periph_ua);
+
+/**
+ * @brief Set the needs of a client. The HF crystal oscillator is started
+ *  and waited for here if it becomes needed. It is stopped only on the next
+ *  sleep if no other client needs it.
+ * @param client The ID of the client
+ * @param needs The needs of the client from @ref pwr_mgr_need_t OR-ed
+ */
+void pwr_mgr_need(uint32_t client, uint32_t needs);
+
+/**
+ * @brief Sleep till an event or interrupt, to be called from the main loop
+ *  when there is nothing left to process
+ */
+void pwr_mgr_sleep(void);
+
+/**
+ * @brief Get the statistics of the sleeps since the start or the last reset
+ * @return Pointer to the statistics
+ */
+const pwr_mgr_stats_t * pwr_mgr_get_stats(void);
+
+/**
+ * @brief Reset the statistics of the sleeps
+ */
+void pwr_mgr_stats_reset(void);
+
+/**
+ * @brief Estimate the average current of the SoC from the statistics. The
+ *  current of the peripherals is included only for the clients asleep.
+ * @return The average current in nA
+ */
+uint32_t pwr_mgr_estimate_current_na(void);
+
+/**
+ * @brief Print the statistics, the estimated current and the clients which
+ *  kept the HF clock running during sleep with log_printf
+ */
+void pwr_mgr_log_report(void);
+
+#endif /* CODEBASE_PERIPHERAL_MODULES_PWR_MGR_H_ */
+
+/**
+ * @}
+ * @}
+ */
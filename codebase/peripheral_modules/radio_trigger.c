@@ -19,6 +19,7 @@
 #include "radio_trigger.h"
 #include "hal_radio.h"
 #include "nrf52810.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -148,37 +149,31 @@ void radio_trigger_shut ()
 }
 
 #if ISR_MANAGER == true
-void radio_trigger_timer_Handler ()
+void radio_trigger_timer_Handler (uint32_t fired)
 #else
 void TIMER_IRQ_Handler ()
 #endif
 {
+#if ISR_MANAGER == false
+    uint32_t fired = isr_dispatch_take (TIMER_ID);
+#endif
     if(radio_dir == RADIO_TRIGGER_Tx)
     {
-        if(TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_COMMON_STARTUP] == true)
+        if(fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_COMMON_STARTUP]))
         {
-#if ISR_MANAGER == false
-            TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_COMMON_STARTUP] = false;
-#endif
             log_printf("%s\n", __func__);
             hal_radio_start_tx ();
         }
         
-        if(TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_TX_FREQ] == true)
+        if(fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_TX_FREQ]))
         {
-#if ISR_MANAGER == false
-            TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_TX_FREQ] = false;
-#endif
             hal_radio_start_tx ();
             TIMER_ID->CC[TIMER_CHANNEL_TX_FREQ] += radio_tx_freq_ticks;
             log_printf("CC[%d] : %d\n", TIMER_CHANNEL_TX_FREQ, TIMER_ID->CC[TIMER_CHANNEL_TX_FREQ]);
         }
         
-        if(TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_TX_ON])
+        if(fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_TX_ON]))
         {
-#if ISR_MANAGER == false
-            TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_TX_ON] = false;
-#endif
             TIMER_ID->TASKS_CLEAR = 1;
             TIMER_ID->TASKS_STOP = 1;
             TIMER_ID->TASKS_SHUTDOWN = 1;
@@ -189,19 +184,13 @@ void TIMER_IRQ_Handler ()
     }
     else
     {
-        if(TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_COMMON_STARTUP] == true)
+        if(fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_COMMON_STARTUP]))
         {
-#if ISR_MANAGER == false
-            TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_COMMON_STARTUP] = false;
-#endif
             hal_radio_start_rx ();
         }
         
-        if(TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_RX_ON])
+        if(fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_RX_ON]))
         {
-#if ISR_MANAGER == false
-            TIMER_ID->EVENTS_COMPARE[TIMER_CHANNEL_RX_ON] = false;
-#endif
             TIMER_ID->TASKS_CLEAR = 1;
             TIMER_ID->TASKS_STOP = 1;
             TIMER_ID->TASKS_SHUTDOWN = 1;
@@ -1,5 +1,5 @@
 /*
- *  random_num.c : <Write brief>
+ *  random_num.c : Random number service with a background entropy pool
  *  Copyright (C) 2019  Appiko
  *
  *  This program is free software: you can redistribute it and/or modify
@@ -17,25 +17,238 @@
  */
 
 #include "random_num.h"
-#include "nrf52.h"
-#include "nrf52810_bitfields.h"
+#include "nrf.h"
+#include "nrf_util.h"
 #include "nrf_assert.h"
+#include "stdbool.h"
+#include "isr_dispatch.h"
+#if defined(SOFTDEVICE_PRESENT)
+#include "nrf_sdm.h"
+#include "nrf_soc.h"
+#endif
 
-uint32_t random_num_generate (uint32_t min, uint32_t max)
+#if ISR_MANAGER == 1
+#include "isr_manager.h"
+#endif
+
+#if (RANDOM_NUM_POOL_SIZE & (RANDOM_NUM_POOL_SIZE - 1)) != 0
+#error "RANDOM_NUM_POOL_SIZE must be a power of 2"
+#endif
+
+/** The entropy pool, written by the RNG interrupt and read in thread mode */
+static volatile uint8_t pool[RANDOM_NUM_POOL_SIZE];
+/** Free running index of the next byte to be written in the pool */
+static volatile uint32_t pool_wr = 0;
+/** Free running index of the next byte to be read from the pool */
+static volatile uint32_t pool_rd = 0;
+
+/** The state of the xoshiro128** generator */
+static uint32_t state[4];
+/** Index of the state word in which the next pool word is mixed */
+static uint32_t mix_idx = 0;
+
+static bool is_init = false;
+/** If the RNG is started by this module and not stopped since */
+static volatile bool is_rng_running = false;
+
+/** Check if the SoftDevice is enabled */
+static bool is_sd_enabled(void)
 {
-    ASSERT(min < max)
-    uint32_t ret_rand, range;
-    range = (max - min);
-    uint32_t hw_rand;
-    
-    NRF_RNG->CONFIG = RNG_CONFIG_DERCEN_Enabled;
-    NRF_RNG->EVENTS_VALRDY = 0;
+    uint8_t is_enabled = 0;
+#if defined(SOFTDEVICE_PRESENT)
+    (void) sd_softdevice_is_enabled(&is_enabled);
+#endif
+    return (is_enabled != 0);
+}
+
+static inline uint32_t pool_count(void)
+{
+    return pool_wr - pool_rd;
+}
+
+static inline uint32_t rotl(uint32_t x, uint32_t k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+/** The next number of the xoshiro128** generator */
+static uint32_t xoshiro_next(void)
+{
+    uint32_t result = rotl(state[1] * 5, 7) * 9;
+    uint32_t t = state[1] << 9;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 11);
+
+    return result;
+}
+
+/** Seed the generator from the device ID and address, so that the devices
+ *  don't start with the same sequence before the pool has any entropy */
+static void seed_from_ficr(void)
+{
+    state[0] = NRF_FICR->DEVICEID[0];
+    state[1] = NRF_FICR->DEVICEID[1];
+    state[2] = NRF_FICR->DEVICEADDR[0];
+    state[3] = NRF_FICR->DEVICEADDR[1] | 0x80000000;
+    for(uint32_t i = 0; i < 8; i++)
+    {
+        (void) xoshiro_next();
+    }
+}
+
+/** Start the RNG to fill the pool, which is stopped from its interrupt */
+static void rng_start(void)
+{
+    is_rng_running = true;
+    NRF_RNG->CONFIG = RNG_CONFIG_DERCEN_Enabled << RNG_CONFIG_DERCEN_Pos;
+    NRF_RNG->INTENSET = RNG_INTENSET_VALRDY_Enabled << RNG_INTENSET_VALRDY_Pos;
+    NVIC_EnableIRQ(RNG_IRQn);
     NRF_RNG->TASKS_START = 1;
-    while(NRF_RNG->EVENTS_VALRDY == 0);
-    NRF_RNG->TASKS_STOP = 1;
-    hw_rand = (uint32_t)NRF_RNG->VALUE;
-    NRF_RNG->CONFIG = RNG_CONFIG_DERCEN_Disabled;
-    ret_rand = (min + (hw_rand * range)/256);
-    
-    return ret_rand;
+}
+
+/** Refill the pool from the RNG or the SoftDevice, without waiting */
+static void pool_refill(void)
+{
+    if(is_sd_enabled())
+    {
+        //The RNG is used by the SoftDevice, which stops its interrupt
+        is_rng_running = false;
+#if defined(SOFTDEVICE_PRESENT)
+        uint8_t available = 0;
+        (void) sd_rand_application_bytes_available_get(&available);
+        while(available-- && (pool_count() < RANDOM_NUM_POOL_SIZE))
+        {
+            uint8_t byte;
+            if(sd_rand_application_vector_get(&byte, 1) != NRF_SUCCESS)
+            {
+                break;
+            }
+            pool[pool_wr & (RANDOM_NUM_POOL_SIZE - 1)] = byte;
+            pool_wr++;
+        }
+#endif
+    }
+    else if(is_rng_running == false)
+    {
+        rng_start();
+    }
+}
+
+void random_num_init (uint32_t irq_priority)
+{
+    if(is_init == false)
+    {
+        seed_from_ficr();
+        is_init = true;
+    }
+
+    if(is_sd_enabled() == false)
+    {
+        NRF_RNG->TASKS_STOP = 1;
+        NRF_RNG->EVENTS_VALRDY = 0;
+        NVIC_ClearPendingIRQ(RNG_IRQn);
+        NVIC_SetPriority(RNG_IRQn, irq_priority);
+        is_rng_running = false;
+    }
+    pool_refill();
+}
+
+uint32_t random_num_get (void)
+{
+    uint32_t word = 0;
+    bool is_word = false;
+
+    if(is_init == false)
+    {
+        seed_from_ficr();
+        is_init = true;
+    }
+
+    CRITICAL_REGION_ENTER();
+    if(pool_count() >= 4)
+    {
+        for(uint32_t i = 0; i < 4; i++)
+        {
+            word = (word << 8) | pool[pool_rd & (RANDOM_NUM_POOL_SIZE - 1)];
+            pool_rd++;
+        }
+        is_word = true;
+    }
+    if(is_word || (pool_count() < RANDOM_NUM_POOL_SIZE/2))
+    {
+        pool_refill();
+    }
+
+    if(is_word)
+    {
+        state[mix_idx] ^= word;
+        mix_idx = (mix_idx + 1) & 3;
+        //The all zero state is the only one the generator can't leave
+        if((state[0] | state[1] | state[2] | state[3]) == 0)
+        {
+            state[0] = 1;
+        }
+    }
+    word = xoshiro_next();
+    CRITICAL_REGION_EXIT();
+
+    return word;
+}
+
+uint32_t random_num_below (uint32_t bound)
+{
+    ASSERT(bound != 0);
+    uint64_t m = (uint64_t) random_num_get() * bound;
+    uint32_t low = (uint32_t) m;
+
+    //Reject the products whose low word is below 2^32 mod bound, so that
+    //every result comes from the same count of 32 bit numbers
+    if(low < bound)
+    {
+        uint32_t threshold = (0 - bound) % bound;
+        while(low < threshold)
+        {
+            m = (uint64_t) random_num_get() * bound;
+            low = (uint32_t) m;
+        }
+    }
+    return (uint32_t) (m >> 32);
+}
+
+uint32_t random_num_generate (uint32_t min, uint32_t max)
+{
+    ASSERT(min < max);
+    return min + random_num_below(max - min);
+}
+
+#if ISR_MANAGER == 1
+void random_num_rng_Handler (uint32_t fired)
+#else
+void RNG_IRQHandler (void)
+#endif
+{
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (NRF_RNG);
+#endif
+
+    if((fired & ISR_DISPATCH_EVT(NRF_RNG, NRF_RNG->EVENTS_VALRDY)) == 0)
+    {
+        return;
+    }
+    if(pool_count() < RANDOM_NUM_POOL_SIZE)
+    {
+        pool[pool_wr & (RANDOM_NUM_POOL_SIZE - 1)] = (uint8_t) NRF_RNG->VALUE;
+        pool_wr++;
+    }
+    if(pool_count() >= RANDOM_NUM_POOL_SIZE)
+    {
+        NRF_RNG->TASKS_STOP = 1;
+        NRF_RNG->INTENCLR = RNG_INTENCLR_VALRDY_Clear << RNG_INTENCLR_VALRDY_Pos;
+        is_rng_running = false;
+    }
 }
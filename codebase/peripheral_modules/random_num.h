@@ -1,5 +1,5 @@
 /*
- *  random_num.h : <Write brief>
+ *  random_num.h : Random number service with a background entropy pool
  *  Copyright (C) 2019  Appiko
  *
  *  This program is free software: you can redistribute it and/or modify
@@ -16,20 +16,71 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_random_num Random number service
+ * @brief Random numbers which are got without waiting for the RNG. The RNG
+ *  with bias correction fills a small pool of entropy from its VALRDY
+ *  interrupt and is stopped when the pool is full. The numbers are made by
+ *  a xoshiro128** generator, which is seeded from the device ID and into
+ *  which a word from the pool is mixed on every call when the pool has
+ *  one. A call then takes a few tens of cycles and never waits for the
+ *  RNG, with the pool restarting in the background.
+ *
+ *  When the SoftDevice is enabled it owns the RNG, so the pool is filled
+ *  with the random bytes which the SoftDevice has ready instead.
+ *
+ *  The numbers are not for cryptography.
+ * @{
+ */
 
 #ifndef RANDOM_NUM_H
 #define RANDOM_NUM_H
 
 #include "stdint.h"
 
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+/** Size in bytes of the entropy pool, must be a power of 2 */
+#ifndef RANDOM_NUM_POOL_SIZE
+#define RANDOM_NUM_POOL_SIZE    16
+#endif
+
+/**
+ * @brief Initialize the service and start filling the entropy pool
+ * @param irq_priority The priority of the RNG interrupt
+ */
+void random_num_init (uint32_t irq_priority);
+
 /**
- * @brief Function to generate random number with RNG hw peripheral in given range.
+ * @brief Get a random 32 bit number without waiting
+ * @return Random number with all the 32 bits random
+ */
+uint32_t random_num_get (void);
+
+/**
+ * @brief Get a random number below a bound without bias and without
+ *  waiting, with Lemire's multiply and shift with rejection
+ * @param bound The number of values, must not be 0
+ * @return Random number in [0, bound)
+ */
+uint32_t random_num_below (uint32_t bound);
+
+/**
+ * @brief Get a random number in a range without bias and without waiting
  * @param min Minimum value of range
- * @param max Maximum value of range
- * @return Random number
- * @note Random number generated is in the form of steps of (max - min)/256
+ * @param max The value after the maximum of the range, must be more than min
+ * @return Random number in [min, max)
  */
 uint32_t random_num_generate (uint32_t min, uint32_t max);
 
-
 #endif /* RANDOM_NUM_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -22,6 +22,7 @@
 #include "common_util.h"
 #include "log.h"
 #include "nrf_util.h"
+#include "pwr_mgr.h"
 
 /** @anchor simple_pwm_defines
  * @name Defines for the specific RTC peripheral used for ms timer
@@ -34,6 +35,9 @@
 
 uint32_t pwm_pins[3];
 
+/** Client ID with the power manager, which needs the HF clock while the PWM runs */
+static uint32_t pwr_client;
+static bool is_pwr_client_reg = false;
 
 void simple_pwm_init(simple_pwm_timer_freq_t freq,uint32_t max_count)
 {
@@ -53,6 +57,12 @@ void simple_pwm_init(simple_pwm_timer_freq_t freq,uint32_t max_count)
     TIMER_ID->SHORTS = TIMER_SHORTS_COMPARE3_CLEAR_Enabled << TIMER_SHORTS_COMPARE3_CLEAR_Pos;
 
     TIMER_ID->EVENTS_COMPARE[SIMPLE_PWM_MAX_CHANNEL] = 0;
+
+    if(is_pwr_client_reg == false)
+    {
+        pwr_client = pwr_mgr_client_register("simple_pwm", PWR_MGR_UA_TIMER);
+        is_pwr_client_reg = true;
+    }
 }
 
 void simple_pwm_channel_setup(simple_pwm_channel_t channel, uint32_t pwm_out_pin, 
@@ -82,11 +92,11 @@ void simple_pwm_channel_setup(simple_pwm_channel_t channel, uint32_t pwm_out_pin
         hal_gpio_cfg_output(pwm_out_pin,0);
         pwm_pins[channel] = pwm_out_pin;
 
-        NRF_PPI->CH[2*channel].EEP = (uint32_t) &(TIMER_ID->EVENTS_COMPARE[channel]);
-        NRF_PPI->CH[2*channel].TEP = (uint32_t) &(NRF_GPIOTE->TASKS_CLR[channel+SIMPLE_PWM_GPIOTE_START_CH]);
+        NRF_PPI->CH[SIMPLE_PWM_PPI_START_CH+2*channel].EEP = (uint32_t) &(TIMER_ID->EVENTS_COMPARE[channel]);
+        NRF_PPI->CH[SIMPLE_PWM_PPI_START_CH+2*channel].TEP = (uint32_t) &(NRF_GPIOTE->TASKS_CLR[channel+SIMPLE_PWM_GPIOTE_START_CH]);
 
-        NRF_PPI->CH[2*channel+1].EEP = (uint32_t) &(TIMER_ID->EVENTS_COMPARE[SIMPLE_PWM_MAX_CHANNEL]);
-        NRF_PPI->CH[2*channel+1].TEP = (uint32_t) &(NRF_GPIOTE->TASKS_SET[channel+SIMPLE_PWM_GPIOTE_START_CH]);
+        NRF_PPI->CH[SIMPLE_PWM_PPI_START_CH+2*channel+1].EEP = (uint32_t) &(TIMER_ID->EVENTS_COMPARE[SIMPLE_PWM_MAX_CHANNEL]);
+        NRF_PPI->CH[SIMPLE_PWM_PPI_START_CH+2*channel+1].TEP = (uint32_t) &(NRF_GPIOTE->TASKS_SET[channel+SIMPLE_PWM_GPIOTE_START_CH]);
         
         NRF_GPIOTE->CONFIG[channel+SIMPLE_PWM_GPIOTE_START_CH] =
                   (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos)
@@ -99,16 +109,18 @@ void simple_pwm_channel_setup(simple_pwm_channel_t channel, uint32_t pwm_out_pin
 
 void simple_pwm_start ()
 {
-    NRF_PPI->CHENSET = (1<<0)|(1<<1)|(1<<2)|(1<<3)|(1<<4)|(1<<5);
+    NRF_PPI->CHENSET = SIMPLE_PWM_PPI_CH_MASK;
 
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_HFCLK);
     TIMER_ID->TASKS_START = 1;
 }
 
 void simple_pwm_stop ()
 {
-    NRF_PPI->CHENCLR = (1<<0)|(1<<1)|(1<<2)|(1<<3)|(1<<4)|(1<<5);
+    NRF_PPI->CHENCLR = SIMPLE_PWM_PPI_CH_MASK;
     
     TIMER_ID->TASKS_STOP = 1;
 
     TIMER_ID->TASKS_SHUTDOWN = 1;
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_NONE);
 }
\ No newline at end of file
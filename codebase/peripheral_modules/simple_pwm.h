@@ -22,7 +22,10 @@
  *
  * @defgroup group_simple_pwm Simple PWM driver
  * @brief A simple driver to get three PWM channels. This PWM module uses three
- *  GPIOTE channels and six PPI channels
+ *  GPIOTE channels and six PPI channels, which are consecutive from the bases
+ *  GPIOTE_CH_BASE_SIMPLE_PWM and PPI_CHANNEL_BASE_SIMPLE_PWM that can be set
+ *  in sys_config.h. The defaults are clear of the channels of TSSP detect
+ *  and TSSP IR TX in the SenseBe applications.
  *
  * @{
  */
@@ -45,10 +48,31 @@
 ///The number of CC registers in the RTC peripheral used for MS timer
 #define SIMPLE_PWM_CC_COUNT           CONCAT_3(TIMER, SIMPLE_PWM_TIMER_USED, _CC_NUM)
 
+#ifndef GPIOTE_CH_BASE_SIMPLE_PWM
+#define GPIOTE_CH_BASE_SIMPLE_PWM 3
+#endif
+
+#ifndef PPI_CHANNEL_BASE_SIMPLE_PWM
+#define PPI_CHANNEL_BASE_SIMPLE_PWM 8
+#endif
+
+/// Number of GPIOTE channels used from the base, one per output
+#define GPIOTE_CHS_USED_SIMPLE_PWM    3
+
+/// Number of PPI channels used from the base, two per output
+#define PPI_CHANNELS_USED_SIMPLE_PWM  6
+
 /// Three GPIOTE channels are used from this number for this module
-#define SIMPLE_PWM_GPIOTE_START_CH    0
+#define SIMPLE_PWM_GPIOTE_START_CH    GPIOTE_CH_BASE_SIMPLE_PWM
+
+/// Six PPI channels are used from this number for this module
+#define SIMPLE_PWM_PPI_START_CH       PPI_CHANNEL_BASE_SIMPLE_PWM
+
+#define SIMPLE_PWM_PPI_CHS_USED PPI_CHANNELS_USED_SIMPLE_PWM
 
-#define SIMPLE_PWM_PPI_CHS_USED 6
+/// Mask of the PPI channels used by this module
+#define SIMPLE_PWM_PPI_CH_MASK  (((1UL << SIMPLE_PWM_PPI_CHS_USED) - 1) \
+                                    << SIMPLE_PWM_PPI_START_CH)
 
 /**
  * @brief Defines for the frequency at which the timer should run
@@ -25,6 +25,7 @@
 #include "log.h"
 #include "hal_ppi.h"
 #include "aux_clk.h"
+#include "isr_dispatch.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -285,22 +286,27 @@ void tssp_detect_switch_clock (tssp_detect_clk_src_t clk_src)
 }
 
 #if ISR_MANAGER == 1
-void tssp_detect_swi_Handler (void)
+void tssp_detect_swi_Handler (uint32_t fired)
 #else
 void SWI0_IRQHandler ()
 #endif
 {
 #if ISR_MANAGER == 0
-    TSSP_DETECT_EGU_USED->EVENTS_TRIGGERED[EGU_CHANNEL_USED] = 0;
-    (void) TSSP_DETECT_EGU_USED->EVENTS_TRIGGERED[EGU_CHANNEL_USED];
+    uint32_t fired = isr_dispatch_take (TSSP_DETECT_EGU_USED);
 #endif
+    //The interrupt can also be from a software interrupt on the same line
+    if((fired & ISR_DISPATCH_EVT(TSSP_DETECT_EGU_USED,
+            TSSP_DETECT_EGU_USED->EVENTS_TRIGGERED[EGU_CHANNEL_USED])) == 0)
+    {
+        return;
+    }
     hal_ppi_dis_ch (PPI_CHANNEL_USED_EGU);
 //    NRF_PPI->CHENCLR |= 1 << PPI_CHANNEL_USED_EGU;
     detect_handler ( TSSP_DETECT_RTC_USED->COUNTER );
 }
 /*
 #if ISR_MANAGER == 1
-void tssp_detect_rtc_Handler (void)
+void tssp_detect_rtc_Handler (uint32_t fired)
 #else
 void RTC0_IRQHandler (void)
 #endif
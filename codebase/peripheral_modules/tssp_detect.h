@@ -77,6 +77,8 @@ typedef enum
     TSSP_DETECT_LF_CLK = AUX_CLK_SRC_LFCLK,
     /** High freq clock : high power mode */
     TSSP_DETECT_HF_CLK = AUX_CLK_SRC_HFCLK,
+    /** Low freq clock with the high freq clock near the deadlines */
+    TSSP_DETECT_AUTO_CLK = AUX_CLK_SRC_AUTO,
 }tssp_detect_clk_src_t;
 
 /**
@@ -22,6 +22,8 @@
 #include "common_util.h"
 #include "sys_config.h"
 #include "nrf_util.h"
+#include "isr_dispatch.h"
+#include "pwr_mgr.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -47,10 +49,20 @@ static uint32_t tx_en;
 
 static uint32_t tx_in;
 
+/** Client ID with the power manager, which needs the HF clock while the
+ *  two TIMERs run */
+static uint32_t pwr_client;
+static bool is_pwr_client_reg = false;
+
 void tssp_ir_tx_init (uint32_t tssp_tx_en, uint32_t tssp_tx_in)
 {
     tx_en = tssp_tx_en;
     tx_in = tssp_tx_in;
+    if(is_pwr_client_reg == false)
+    {
+        pwr_client = pwr_mgr_client_register("tssp_ir_tx", 2*PWR_MGR_UA_TIMER);
+        is_pwr_client_reg = true;
+    }
     hal_gpio_cfg_output (tx_en,0);
     hal_gpio_cfg_output (tssp_tx_in,0);
     TIMER_ID_56KHZ->TASKS_STOP = 1;
@@ -115,24 +127,31 @@ void tssp_ir_tx_init (uint32_t tssp_tx_en, uint32_t tssp_tx_in)
     NVIC_EnableIRQ (TIMER2_IRQn);
 }
 #if ISR_MANAGER == 1
-void tssp_ir_tx_timer1_Handler ()
+void tssp_ir_tx_timer1_Handler (uint32_t fired)
 #else
 void TIMER2_IRQHandler ()
 #endif
 {
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (TIMER_ID_1KHZ);
+#endif
+    if((fired & ISR_DISPATCH_EVT(TIMER_ID_1KHZ,
+            TIMER_ID_1KHZ->EVENTS_COMPARE[TIMERS_CHANNEL_USED])) == 0)
+    {
+        return;
+    }
     hal_gpio_pin_clear (tx_en);
     hal_gpio_pin_clear (tx_in);
-#if ISR_MANAGER == 0
+    //The 56 kHz compare is only routed through PPI, so no ISR clears it
     TIMER_ID_56KHZ->EVENTS_COMPARE[TIMERS_CHANNEL_USED] = 0;
-    TIMER_ID_1KHZ->EVENTS_COMPARE[TIMERS_CHANNEL_USED] = 0;
-#endif
     TIMER_ID_1KHZ->TASKS_CLEAR = 1;
     TIMER_ID_1KHZ->TASKS_STOP = 1;
     TIMER_ID_1KHZ->TASKS_SHUTDOWN = 1;
     TIMER_ID_56KHZ->TASKS_SHUTDOWN = 1;
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_NONE);
 }
 
-void tssp_ir_tx_timer2_Handler ()
+void tssp_ir_tx_timer2_Handler (uint32_t fired)
 {
     
 }
@@ -150,6 +169,7 @@ void tssp_ir_tx_start (void)
 //    NRF_PPI->CHENSET |= 1 << PPI_xxKHz_2;
     NRF_PPI->CHENSET |= 1 << PPI_56KHz_1;
     NRF_PPI->CHENSET |= 1 << PPI_56KHz_2;
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_HFCLK);
     TIMER_ID_56KHZ->TASKS_START = 1;
     TIMER_ID_1KHZ->TASKS_START = 1;
 
@@ -167,4 +187,5 @@ void tssp_ir_tx_stop (void)
     TIMER_ID_56KHZ->TASKS_STOP = 1;
 
     TIMER_ID_56KHZ->TASKS_SHUTDOWN = 1;
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_NONE);
 }
@@ -21,6 +21,7 @@
 #include "hal_gpio.h"
 #include "boards.h"
 #include "nrf_util.h"
+#include "isr_dispatch.h"
 #include "tinyprintf.h"
 #include <stdbool.h>
 
@@ -93,17 +94,16 @@ static void start_uart_tx(uart_buffers tx_buf)
  *  UARTE interrupt routine.
  */
 #if ISR_MANAGER == 1
-void uart_printf_uart_Handler (void)
+void uart_printf_uart_Handler (uint32_t fired)
 #else
 void UARTE0_UART0_IRQHandler(void)
 #endif
 {
-    if (1 == UARTE_ID->EVENTS_ENDTX)
-    {
 #if ISR_MANAGER == 0
-        UARTE_ID->EVENTS_ENDTX = 0;
-        (void) UARTE_ID->EVENTS_ENDTX;
+    uint32_t fired = isr_dispatch_take (UARTE_ID);
 #endif
+    if (fired & ISR_DISPATCH_EVT(UARTE_ID, UARTE_ID->EVENTS_ENDTX))
+    {
         uart_buffers current_buf = PONG, other_buf = PING;
         if (BUF_STATE[PING].TX == uart_ctx.tx_state)
         {
@@ -19,6 +19,8 @@
 #include "us_timer.h"
 #include "nrf_util.h"
 #include <stddef.h>
+#include "isr_dispatch.h"
+#include "pwr_mgr.h"
 
 #if ISR_MANAGER == 1
 #include "isr_manager.h"
@@ -53,6 +55,10 @@ static struct us_timer_t{
 /** Timers currently used based on the first four bits from LSB */
 static volatile uint32_t us_timers_status;
 
+/** Client ID with the power manager, which needs the HF clock while the TIMER runs */
+static uint32_t pwr_client;
+static bool is_pwr_client_reg = false;
+
 void us_timer_init(uint32_t irq_priority){
     for(us_timer_num id = US_TIMER0; id < US_TIMER_MAX; id++){
         us_timer[id].timer_mode = US_SINGLE_CALL;
@@ -60,6 +66,14 @@ void us_timer_init(uint32_t irq_priority){
     }
     us_timers_status = 0;
 
+    if(is_pwr_client_reg == false)
+    {
+        pwr_client = pwr_mgr_client_register("us_timer", PWR_MGR_UA_TIMER);
+        is_pwr_client_reg = true;
+    }
+    //The TIMER runs from here till the last us timer is stopped
+    pwr_mgr_need(pwr_client, PWR_MGR_NEED_HFCLK);
+
     TIMER_ID->TASKS_STOP      = 1;                        // Stop timer.
     TIMER_ID->MODE            = TIMER_MODE_MODE_Timer;    // Set the timer in Timer Mode.
     TIMER_ID->PRESCALER       = TIMER_PRESCALER;         // Prescaler 4 produces 1 MHz.
@@ -88,6 +102,7 @@ void us_timer_start(us_timer_num id, us_timer_mode mode, uint32_t time_us, void
     //If no timers are currently on
     if (us_timers_status == 0)
     {
+        pwr_mgr_need(pwr_client, PWR_MGR_NEED_HFCLK);
         TIMER_ID->TASKS_START = 1;
     }
 
@@ -105,6 +120,7 @@ void us_timer_stop(us_timer_num id){
     {
         TIMER_ID->TASKS_STOP          = 1;                // Stop timer.
         TIMER_ID->TASKS_SHUTDOWN      = 1;                // Fully stop timer.
+        pwr_mgr_need(pwr_client, PWR_MGR_NEED_NONE);
     }
 }
 
@@ -116,17 +132,16 @@ bool us_timer_get_on_status(us_timer_num id){
  * Triggered Compare register of timer ID
  */
 #if ISR_MANAGER == 1
-void us_timer_timer_Handler ()
+void us_timer_timer_Handler (uint32_t fired)
 #else
 void TIMER_IRQ_Handler()
 #endif
 {
-    for(us_timer_num id = US_TIMER0; id < US_TIMER_MAX; id++){
-        if(TIMER_ID->EVENTS_COMPARE[id]){
 #if ISR_MANAGER == 0
-            TIMER_ID->EVENTS_COMPARE[id] = 0;
-            (void) TIMER_ID->EVENTS_COMPARE[id];
+    uint32_t fired = isr_dispatch_take (TIMER_ID);
 #endif
+    for(us_timer_num id = US_TIMER0; id < US_TIMER_MAX; id++){
+        if(fired & ISR_DISPATCH_EVT(TIMER_ID, TIMER_ID->EVENTS_COMPARE[id])){
             void (*cb_handler)(void) = NULL;
             if(us_timer[id].timer_handler != NULL)
             {
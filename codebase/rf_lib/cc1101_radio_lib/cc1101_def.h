@@ -0,0 +1,197 @@
+/*
+ *  cc1101_def.h : Registers, strobes and bit fields of the TI CC1101
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CC1101_DEF_H
+#define CC1101_DEF_H
+
+//
+// Configuration registers
+//
+#define CC1101_IOCFG2           0x00      //GDO2 output pin configuration
+#define CC1101_IOCFG1           0x01      //GDO1 output pin configuration
+#define CC1101_IOCFG0           0x02      //GDO0 output pin configuration
+#define CC1101_FIFOTHR          0x03      //RX FIFO and TX FIFO thresholds
+#define CC1101_SYNC1            0x04      //Sync word, high byte
+#define CC1101_SYNC0            0x05      //Sync word, low byte
+#define CC1101_PKTLEN           0x06      //Packet length
+#define CC1101_PKTCTRL1         0x07      //Packet automation control
+#define CC1101_PKTCTRL0         0x08      //Packet automation control
+#define CC1101_ADDR             0x09      //Device address
+#define CC1101_CHANNR           0x0A      //Channel number
+#define CC1101_FSCTRL1          0x0B      //Frequency synthesizer control, IF
+#define CC1101_FSCTRL0          0x0C      //Frequency offset
+#define CC1101_FREQ2            0x0D      //Frequency control word, high byte
+#define CC1101_FREQ1            0x0E      //Frequency control word, middle byte
+#define CC1101_FREQ0            0x0F      //Frequency control word, low byte
+#define CC1101_MDMCFG4          0x10      //Channel bandwidth and DRATE_E
+#define CC1101_MDMCFG3          0x11      //DRATE_M
+#define CC1101_MDMCFG2          0x12      //Modulation and sync mode
+#define CC1101_MDMCFG1          0x13      //Preamble bytes and CHANSPC_E
+#define CC1101_MDMCFG0          0x14      //CHANSPC_M
+#define CC1101_DEVIATN          0x15      //Frequency deviation
+#define CC1101_MCSM2            0x16      //RX timeout of the WOR
+#define CC1101_MCSM1            0x17      //CCA mode and states after RX and TX
+#define CC1101_MCSM0            0x18      //Calibration and XOSC
+#define CC1101_FOCCFG           0x19      //Frequency offset compensation
+#define CC1101_BSCFG            0x1A      //Bit synchronization
+#define CC1101_AGCCTRL2         0x1B      //AGC control
+#define CC1101_AGCCTRL1         0x1C      //AGC control, carrier sense thresholds
+#define CC1101_AGCCTRL0         0x1D      //AGC control
+#define CC1101_WOREVT1          0x1E      //EVENT0 timeout, high byte
+#define CC1101_WOREVT0          0x1F      //EVENT0 timeout, low byte
+#define CC1101_WORCTRL          0x20      //Wake on radio control
+#define CC1101_FREND1           0x21      //Front end RX configuration
+#define CC1101_FREND0           0x22      //Front end TX configuration
+#define CC1101_FSCAL3           0x23      //Frequency synthesizer calibration
+#define CC1101_FSCAL2           0x24      //Frequency synthesizer calibration
+#define CC1101_FSCAL1           0x25      //Frequency synthesizer calibration
+#define CC1101_FSCAL0           0x26      //Frequency synthesizer calibration
+#define CC1101_RCCTRL1          0x27      //RC oscillator configuration
+#define CC1101_RCCTRL0          0x28      //RC oscillator configuration
+#define CC1101_FSTEST           0x29      //Frequency synthesizer calibration control
+#define CC1101_PTEST            0x2A      //Production test
+#define CC1101_AGCTEST          0x2B      //AGC test
+#define CC1101_TEST2            0x2C      //Various test settings
+#define CC1101_TEST1            0x2D      //Various test settings
+#define CC1101_TEST0            0x2E      //Various test settings
+
+//
+// Status registers, read with the burst bit set
+//
+#define CC1101_PARTNUM          0x30      //Part number
+#define CC1101_VERSION          0x31      //Version
+#define CC1101_FREQEST          0x32      //Frequency offset estimate
+#define CC1101_LQI              0x33      //CRC_OK and LQI
+#define CC1101_RSSI             0x34      //RSSI now
+#define CC1101_MARCSTATE        0x35      //Main radio control state
+#define CC1101_WORTIME1         0x36      //WOR timer, high byte
+#define CC1101_WORTIME0         0x37      //WOR timer, low byte
+#define CC1101_PKTSTATUS        0x38      //GDOx and packet status
+#define CC1101_VCO_VC_DAC       0x39      //PLL calibration
+#define CC1101_TXBYTES          0x3A      //Underflow and bytes in the TX FIFO
+#define CC1101_RXBYTES          0x3B      //Overflow and bytes in the RX FIFO
+#define CC1101_STATUS_FIRST     CC1101_PARTNUM
+#define CC1101_STATUS_LAST      0x3D
+
+/** The PA table of 8 bytes */
+#define CC1101_PATABLE          0x3E
+/** The address for the access of the TX and RX FIFOs */
+#define CC1101_FIFO             0x3F
+/** Size of each of the TX and RX FIFOs */
+#define CC1101_FIFO_SIZE        64
+
+//
+// Header byte of an SPI transaction
+//
+#define CC1101_HDR_WRITE        0x00
+#define CC1101_HDR_BURST        0x40
+#define CC1101_HDR_READ         0x80
+
+//
+// Strobes
+//
+#define CC1101_SRES             0x30      // Reset the chip
+#define CC1101_SFSTXON          0x31      // Enable and calibrate the FS
+#define CC1101_SXOFF            0x32      // Turn off the crystal oscillator
+#define CC1101_SCAL             0x33      // Calibrate the FS and go to IDLE
+#define CC1101_SRX              0x34      // Go to RX
+#define CC1101_STX              0x35      // Go to TX, from RX only if the channel is clear
+#define CC1101_SIDLE            0x36      // Exit RX or TX
+#define CC1101_SWOR             0x38      // Start the RX polling of the WOR
+#define CC1101_SPWD             0x39      // Go to SLEEP when CSn goes high
+#define CC1101_SFRX             0x3A      // Flush the RX FIFO
+#define CC1101_SFTX             0x3B      // Flush the TX FIFO
+#define CC1101_SWORRST          0x3C      // Reset the WOR timer
+#define CC1101_SNOP             0x3D      // No operation, for the status byte
+
+//
+// Status byte
+//
+#define CC1101_STATUS_STATE_Msk         0x70
+#define CC1101_STATUS_IDLE              0x00
+#define CC1101_STATUS_RX_FIFO_ERR       0x60
+
+//
+// MARCSTATE
+//
+#define CC1101_MARCSTATE_Msk            0x1F
+#define CC1101_MARCSTATE_SLEEP          0x00
+#define CC1101_MARCSTATE_IDLE           0x01
+#define CC1101_MARCSTATE_RX             0x0D
+#define CC1101_MARCSTATE_TX             0x13
+
+//
+// Bit fields
+//
+/** IOCFGx : Asserted at or above the RX FIFO threshold */
+#define CC1101_GDO_RX_FIFO_THR          0x00
+/** IOCFGx : Asserted at or above the TX FIFO threshold */
+#define CC1101_GDO_TX_FIFO_THR          0x02
+/** IOCFGx : Asserted at the sync word, deasserted at the end of the packet */
+#define CC1101_GDO_SYNC_PKT             0x06
+/** IOCFGx : The output inverted */
+#define CC1101_GDO_INV                  0x40
+/** IOCFGx : High impedance */
+#define CC1101_GDO_HI_Z                 0x2E
+
+/** FIFOTHR : Code of the TX and RX FIFO thresholds */
+#define CC1101_FIFOTHR_Msk              0x0F
+
+/** PKTCTRL1 : RSSI and CRC_OK|LQI appended to the packets received */
+#define CC1101_PKTCTRL1_APPEND_STATUS   0x04
+/** PKTCTRL0 : Variable length after the sync word, with a 16 bit CRC */
+#define CC1101_PKTCTRL0_VAR_LEN         0x01
+#define CC1101_PKTCTRL0_CRC_EN          0x04
+
+/** MDMCFG2 : GFSK with 30 of the 32 bits of the double sync word */
+#define CC1101_MDMCFG2_GFSK             0x10
+#define CC1101_MDMCFG2_SYNC_30_32       0x03
+/** MDMCFG1 : NUM_PREAMBLE of 4 bytes */
+#define CC1101_MDMCFG1_PREAMBLE_4       0x20
+
+/** MCSM2 : RX ends in the WOR when there is no carrier sense */
+#define CC1101_MCSM2_RX_TIME_RSSI       0x10
+#define CC1101_MCSM2_RX_TIME_Msk        0x07
+/** MCSM1 : Only unless a packet is being received, with the RSSI checked by
+ *  the driver */
+#define CC1101_MCSM1_CCA_RECEIVING      0x20
+/** MCSM1 : RXOFF_MODE stays in RX, TXOFF_MODE goes to IDLE */
+#define CC1101_MCSM1_RXOFF_RX           0x0C
+/** MCSM0 : FS_AUTOCAL never, PO_TIMEOUT of 64 XOSC periods */
+#define CC1101_MCSM0_NO_AUTOCAL         0x08
+
+/** WORCTRL : EVENT1 of 48 RC periods and RC calibration, RC_PD cleared */
+#define CC1101_WORCTRL_LISTEN           0x78
+#define CC1101_WORCTRL_RC_PD            0x80
+#define CC1101_WORCTRL_RES_Msk          0x03
+
+/** LQI : CRC of the last packet matched, the rest is the LQI */
+#define CC1101_LQI_CRC_OK               0x80
+/** PKTSTATUS : CRC of the last packet matched */
+#define CC1101_PKTSTATUS_CRC_OK         0x80
+/** PKTSTATUS : A sync word was found and the packet hasn't ended */
+#define CC1101_PKTSTATUS_SFD            0x08
+
+/** TXBYTES and RXBYTES : The FIFO underflowed or overflowed */
+#define CC1101_FIFO_ERR                 0x80
+#define CC1101_NUM_BYTES_Msk            0x7F
+
+/** VERSION of the CC1101, whose PARTNUM is 0 */
+#define CC1101_VERSION_ID               0x14
+
+#endif /* CC1101_DEF_H */
@@ -0,0 +1,1252 @@
+/*
+ *  rf_comm.c : rf_comm backend for the CC1101
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The packets have a length byte and a 16 bit CRC, and the radio appends
+ * the RSSI and CRC_OK|LQI to each packet as the CC112x does. The events
+ * are on the same pins as with the CC112x: GDO2 falls at the end of a
+ * packet sent or received, and GDO0 rises at the FIFO threshold. In RX the
+ * interrupt handler then drains the RX FIFO into the RX buffer, in TX GDO0
+ * is inverted to rise when the TX FIFO is below its threshold and the
+ * handler writes the rest of the packet, as the FIFOs are of only 64 bytes.
+ *
+ * The sync word is of 16 bits, sent twice, as the CC1101 can't match the
+ * 32 bit sync word of the CC112x and S2-LP backends.
+ *
+ * The low power listen mode uses the WOR of the radio, with RX ended after
+ * RF_COMM_SNIFF_US unless there is a carrier. The CSMA compares the RSSI to
+ * the threshold itself, as the carrier sense threshold of the radio is
+ * relative to its AGC target in coarse steps, and lets the radio gate the
+ * STX only on a packet being received.
+ *
+ * The registers are kept in SLEEP but for the test registers, which are
+ * written again at the wake.
+ */
+
+#include "string.h"
+
+#include "spi_cc1101_nrf52.h"
+#include "rf_comm.h"
+#include "rf_spi_hw.h"
+#include "cc1101_def.h"
+#include "hal_gpio.h"
+#include "nrf.h"
+#include "isr_dispatch.h"
+#include "log.h"
+#include "hal_nop_delay.h"
+#include "ms_timer.h"
+#include "random_num.h"
+
+#ifndef RF_XTAL_FREQ
+#define RF_XTAL_FREQ 26000000
+#endif
+
+#if ISR_MANAGER == 1
+#include "isr_manager.h"
+#endif
+
+#define GPIOTE_USED0 GPIOTE_CH_USED_RF_COMM_0
+#define GPIOTE_USED1 GPIOTE_CH_USED_RF_COMM_1
+
+/** Time in us for which the radio sniffs for a carrier at each wake up of
+ *  the listen mode */
+#ifndef RF_COMM_SNIFF_US
+#define RF_COMM_SNIFF_US       1000
+#endif
+
+/** RX FIFO threshold, in steps of 4 bytes and at most half the FIFO so
+ *  that there is time to drain it */
+#if (RF_COMM_RX_FIFO_THR > (CC1101_FIFO_SIZE/2))
+#define RX_FIFO_THR            (CC1101_FIFO_SIZE/2)
+#else
+#define RX_FIFO_THR            RF_COMM_RX_FIFO_THR
+#endif
+/** FIFOTHR : The threshold code, with the ADC retention needed for the RX
+ *  filter bandwidths below 325 kHz */
+#define FIFOTHR_VALUE          (0x40 | ((RX_FIFO_THR/4) - 1))
+
+/** FSCTRL0 : Offset in steps of f_xosc/2^14 */
+#define FREQOFF_STEP_DIV       ((int32_t) 1 << 14)
+
+/** The status bytes appended to a received packet, RSSI and CRC_OK|LQI */
+#define RX_STATUS_LEN          2
+/** The offset of the RSSI in dBm from half the RSSI status byte */
+#define RSSI_OFFSET            74
+
+/** Bit periods for the RSSI to settle in RX before the clear channel check */
+#define RSSI_SETTLE_BITS       16
+
+/** MCSM2 : Reset value, with no RX timeout */
+#define MCSM2_DEFAULT          0x07
+/** WORCTRL : Reset value, with the RC oscillator powered down */
+#define WORCTRL_DEFAULT        0xF8
+
+/** Ticks of EVENT0 in a s at WOR_RES 0, of 750 XOSC periods each */
+#define WOR_TICKS_S            (RF_XTAL_FREQ/750)
+
+/** The RX timeout of the WOR as a fraction of EVENT0 for each RX_TIME, in
+ *  us per 10000 ticks at WOR_RES 0 and 1 with a 26 MHz XOSC */
+static const uint32_t wor_rx_time_c[2][7] =
+{
+    {36058, 18029, 9014, 4507, 2254, 1127, 563},
+    {180288, 90144, 45072, 22536, 11268, 5634, 2817},
+};
+
+/** PATABLE values in the 868 MHz band and the power in dBm of each */
+static const struct
+{
+    int8_t dbm;
+    uint8_t reg;
+}pa_table[] =
+{
+    {-30, 0x03},
+    {-20, 0x17},
+    {-15, 0x1D},
+    {-10, 0x26},
+    {-6,  0x37},
+    {0,   0x50},
+    {5,   0x86},
+    {7,   0xCD},
+    {10,  0xC5},
+    {12,  0xC0},
+};
+
+const cc1101_reg_setting_t default_setting[] =
+{
+    {CC1101_IOCFG2,     CC1101_GDO_SYNC_PKT},
+    {CC1101_IOCFG1,     CC1101_GDO_HI_Z},
+    {CC1101_IOCFG0,     CC1101_GDO_RX_FIFO_THR},
+    {CC1101_FIFOTHR,    FIFOTHR_VALUE},
+    {CC1101_SYNC1,      0xD3},
+    {CC1101_SYNC0,      0x91},
+    {CC1101_PKTLEN,     0xFF},
+    {CC1101_PKTCTRL1,   CC1101_PKTCTRL1_APPEND_STATUS},
+    {CC1101_PKTCTRL0,   CC1101_PKTCTRL0_CRC_EN | CC1101_PKTCTRL0_VAR_LEN},
+    {CC1101_FSCTRL1,    0x06},
+    {CC1101_MDMCFG2,    CC1101_MDMCFG2_GFSK | CC1101_MDMCFG2_SYNC_30_32},
+    {CC1101_MDMCFG1,    CC1101_MDMCFG1_PREAMBLE_4 | 0x02},
+    {CC1101_MDMCFG0,    0xF8},
+    {CC1101_MCSM2,      MCSM2_DEFAULT},
+    //STX from RX gated only on a packet being received, stay in RX after a packet
+    {CC1101_MCSM1,      CC1101_MCSM1_CCA_RECEIVING | CC1101_MCSM1_RXOFF_RX},
+    //Calibrate the FS only on SCAL, kept in SLEEP
+    {CC1101_MCSM0,      CC1101_MCSM0_NO_AUTOCAL},
+    {CC1101_FOCCFG,     0x16},
+    {CC1101_BSCFG,      0x6C},
+    {CC1101_AGCCTRL2,   0x43},
+    {CC1101_AGCCTRL1,   0x40},
+    {CC1101_AGCCTRL0,   0x91},
+    {CC1101_WORCTRL,    WORCTRL_DEFAULT},
+    {CC1101_FREND1,     0x56},
+    {CC1101_FREND0,     0x10},
+    {CC1101_FSCAL3,     0xE9},
+    {CC1101_FSCAL2,     0x2A},
+    {CC1101_FSCAL1,     0x00},
+    {CC1101_FSCAL0,     0x1F},
+    {CC1101_TEST2,      0x81},
+    {CC1101_TEST1,      0x35},
+    {CC1101_TEST0,      0x09},
+};
+
+/** TEST2..0 as in default_setting, which aren't kept in SLEEP */
+static const uint8_t test_regs[] = {0x81, 0x35, 0x09};
+
+typedef enum
+{
+    R_IDLE,
+    R_RX,
+    R_TX,
+    R_CCA,
+}radio_state_t;
+
+volatile radio_state_t g_current_state;
+
+static rf_comm_hw_t g_comm_hw;
+
+static uint8_t g_arr_pkt[260];
+/** Bytes of g_arr_pkt to be sent and written to the TX FIFO so far */
+static volatile uint32_t g_tx_len = 0;
+static volatile uint32_t g_tx_pos = 0;
+/** If GDO0 is set for the TX FIFO, else for the RX FIFO */
+static bool g_is_gdo0_tx = false;
+
+/** Sequence number of the next packet sent */
+static uint8_t g_tx_seq = 0;
+
+/** The bytes read from the RX FIFO and not yet delivered as packets */
+static uint8_t g_rx_buf[RF_COMM_RX_BUF_SIZE];
+static uint32_t g_rx_buf_len = 0;
+static uint32_t g_rx_overflows = 0;
+
+/** If the radio is in the low power listen mode */
+static volatile bool g_is_listening = false;
+
+static rf_comm_csma_t g_csma;
+static rf_comm_csma_stats_t g_csma_stats;
+/** Clear channel checks done for the packet being sent */
+static uint32_t g_csma_attempts;
+/** Listen interval of the receiver of the packet being sent with the long
+ *  preamble, 0 for a normal send */
+static uint32_t g_tx_wake_ms;
+
+/** If RX was started with rf_comm_rx_window and hasn't timed out */
+static volatile bool g_is_rx_window = false;
+
+/** The radio parameters with the changes of the setters, to write the
+ *  configuration again if the radio loses it in the sleep */
+static rf_comm_radio_t g_radio;
+static bool g_is_configured = false;
+/** FREQ2..0 as written, read back at the wake to check the configuration */
+static uint8_t g_freq_regs[3];
+
+/** Time in s and temperature since the last calibration of the FS */
+static uint32_t g_cal_age_s;
+static int32_t g_cal_temp_c = RF_COMM_TEMP_UNKNOWN;
+/** Latest temperature of rf_comm_cal_update */
+static int32_t g_temp_c = RF_COMM_TEMP_UNKNOWN;
+/** If the FS is to be calibrated at the next wake or send */
+static bool g_is_cal_due = false;
+
+/** Frequency offset in FSCTRL0 and as estimated for the last good packet,
+ *  in steps of f_xosc/FREQOFF_STEP_DIV */
+static int8_t g_freq_off = 0;
+static int8_t g_freq_off_est = 0;
+
+void (* gp_tx_done) (uint32_t error);
+void (* gp_rx_done) (uint32_t error);
+void (* gp_tx_failed) (uint32_t error);
+void (* gp_rx_failed) (uint32_t error);
+
+static void reg_write (uint8_t addr, uint8_t value)
+{
+    cc1101_spi_write (addr, &value, 1);
+}
+
+static uint8_t reg_read (uint8_t addr)
+{
+    uint8_t value;
+    cc1101_spi_read (addr, &value, 1);
+    return value;
+}
+
+/** Read RXBYTES or TXBYTES, which can be read wrong while the count changes
+ *  and so is taken only when two reads in a row agree (CC1101 errata) */
+static uint8_t fifo_bytes_read (uint8_t addr)
+{
+    uint8_t first, second;
+
+    second = reg_read (addr);
+    do
+    {
+        first = second;
+        second = reg_read (addr);
+    }while(first != second);
+    return second;
+}
+
+/** Set GDO0 for the threshold of the TX FIFO, inverted to rise when a
+ *  refill is needed, or of the RX FIFO */
+static void gdo0_config (bool is_tx)
+{
+    if(is_tx != g_is_gdo0_tx)
+    {
+        g_is_gdo0_tx = is_tx;
+        reg_write (CC1101_IOCFG0, is_tx ?
+                (CC1101_GDO_TX_FIFO_THR | CC1101_GDO_INV) : CC1101_GDO_RX_FIFO_THR);
+    }
+}
+
+/** Stop the low power listen mode if it is on, leaving the radio in IDLE */
+static void listen_exit (void)
+{
+    if(g_is_listening)
+    {
+        g_is_listening = false;
+        //The radio may be asleep between the sniffs, the strobe has to wait
+        //for the XOSC once CSn wakes it
+        (void) rf_spi_wait_ready (RF_COMM_WAKE_TIMEOUT_US);
+        cc1101_spi_strobe (CC1101_SIDLE);
+        reg_write (CC1101_WORCTRL, WORCTRL_DEFAULT);
+        reg_write (CC1101_MCSM2, MCSM2_DEFAULT);
+    }
+}
+
+/** Stop the timer of a CSMA backoff or an RX window still pending */
+static void timer_cancel (void)
+{
+    if(g_current_state == R_CCA)
+    {
+        ms_timer_stop (MS_TIMER_USED_RF_COMM);
+        g_current_state = R_IDLE;
+    }
+    if(g_is_rx_window)
+    {
+        ms_timer_stop (MS_TIMER_USED_RF_COMM);
+        g_is_rx_window = false;
+    }
+}
+
+/** Restart RX after an overflow of the RX FIFO or the buffer */
+static void rx_restart (void)
+{
+    g_rx_overflows++;
+    g_rx_buf_len = 0;
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cc1101_spi_strobe (CC1101_SFRX);
+    cc1101_spi_strobe (g_is_listening ? CC1101_SWOR : CC1101_SRX);
+}
+
+/** Read the bytes in the RX FIFO into the buffer */
+static void rx_fifo_read (void)
+{
+    uint8_t count;
+
+    count = fifo_bytes_read (CC1101_RXBYTES);
+    if(count & CC1101_FIFO_ERR)
+    {
+        rx_restart ();
+        return;
+    }
+    //The last byte in the FIFO mustn't be read while a packet is being
+    //received (CC1101 errata)
+    if((count != 0) && (reg_read (CC1101_PKTSTATUS) & CC1101_PKTSTATUS_SFD))
+    {
+        count--;
+    }
+    if(count == 0)
+    {
+        return;
+    }
+    if(count > (RF_COMM_RX_BUF_SIZE - g_rx_buf_len))
+    {
+        rx_restart ();
+        return;
+    }
+    cc1101_spi_read (CC1101_FIFO, &g_rx_buf[g_rx_buf_len], count);
+    g_rx_buf_len += count;
+}
+
+/** Pass up to max_pkts complete packets in the buffer to the handler and
+ *  remove them from the buffer */
+static uint32_t rx_buf_parse (rf_comm_rx_pkt_handler_t handler, uint32_t max_pkts)
+{
+    uint32_t pos = 0, pkts = 0;
+    rf_comm_rx_pkt_t pkt;
+
+    while((pkts < max_pkts) && (pos < g_rx_buf_len))
+    {
+        uint32_t len = g_rx_buf[pos];
+        if((g_rx_buf_len - pos) < (1 + len + RX_STATUS_LEN))
+        {
+            //The rest of the packet is still being received
+            break;
+        }
+        pkt.p_data = &g_rx_buf[pos + 1];
+        pkt.len = len;
+        pkt.rssi = (int8_t) g_rx_buf[pos + 1 + len]/2 - RSSI_OFFSET;
+        pkt.lqi = g_rx_buf[pos + 2 + len] & ~CC1101_LQI_CRC_OK;
+        pkt.crc_ok = ((g_rx_buf[pos + 2 + len] & CC1101_LQI_CRC_OK) != 0);
+        handler (&pkt);
+        pos += 1 + len + RX_STATUS_LEN;
+        pkts++;
+    }
+    g_rx_buf_len -= pos;
+    memmove (g_rx_buf, &g_rx_buf[pos], g_rx_buf_len);
+    return pkts;
+}
+
+/** Write the rest of the packet being sent to the TX FIFO, as much as fits
+ *  in the room there is */
+static void tx_fifo_fill (uint32_t room)
+{
+    uint32_t len = g_tx_len - g_tx_pos;
+
+    if(len > room)
+    {
+        len = room;
+    }
+    if(len != 0)
+    {
+        cc1101_spi_write (CC1101_FIFO, &g_arr_pkt[g_tx_pos], len);
+        g_tx_pos += len;
+    }
+}
+
+/** Load the packet in g_arr_pkt for a send, with the radio in IDLE. With
+ *  is_now false the TX FIFO is left empty for the long preamble. */
+static void tx_fifo_load (bool is_now)
+{
+    //SFTX works only in IDLE and from IDLE the STX isn't gated by the CCA
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cc1101_spi_strobe (CC1101_SFTX);
+    g_current_state = R_IDLE;
+    g_tx_pos = 0;
+    g_tx_len = 0;
+    if(is_now)
+    {
+        g_tx_len = g_arr_pkt[0] + 1;
+        tx_fifo_fill (CC1101_FIFO_SIZE);
+    }
+    gdo0_config (true);
+}
+
+/** Back to IDLE after a packet sent, or the TX FIFO running empty */
+static void tx_end (void)
+{
+    g_tx_len = 0;
+    g_current_state = R_IDLE;
+}
+
+/** Run all the writes of default_setting */
+static void assign_default (void)
+{
+    for(uint32_t i = 0; i < ARRAY_SIZE(default_setting); i++)
+    {
+        reg_write (default_setting[i].addr, default_setting[i].data);
+    }
+    g_is_gdo0_tx = false;
+}
+
+/** Calibrate the FS, with the radio in IDLE */
+static void cal_run (void)
+{
+    cc1101_spi_strobe (CC1101_SCAL);
+    while(rf_comm_get_state ())
+    {
+    }
+    g_cal_age_s = 0;
+    g_cal_temp_c = g_temp_c;
+    g_is_cal_due = false;
+}
+
+static void cal_if_due (void)
+{
+    if(g_is_cal_due)
+    {
+        cal_run ();
+    }
+}
+
+/** Latch the offset estimated for the packet just received, as the next
+ *  sync word updates it */
+static void freq_off_est_read (void)
+{
+    g_freq_off_est = (int8_t) reg_read (CC1101_FREQEST);
+}
+
+/** Write the configuration of the radio over the reset values */
+static void config_write (rf_comm_radio_t * p_radio)
+{
+    assign_default ();
+    rf_comm_set_bw (p_radio->rx_bandwidth);
+    rf_comm_set_bitrate (p_radio->bitrate);
+    rf_comm_set_fdev (p_radio->freq_dev);
+
+    rf_comm_set_freq (p_radio->center_freq);
+    rf_comm_set_pwr (p_radio->tx_power);
+    rf_comm_csma_config (&g_csma);
+    reg_write (CC1101_FSCTRL0, (uint8_t) g_freq_off);
+}
+
+uint32_t rf_comm_radio_init (rf_comm_radio_t * p_radio_params, rf_comm_hw_t * p_comm_hw)
+{
+    log_printf("%s\n", __func__);
+    memcpy (&g_comm_hw, p_comm_hw, sizeof(rf_comm_hw_t));
+
+    if(p_radio_params->rf_tx_done_handler != NULL)
+    {
+        gp_tx_done = p_radio_params->rf_tx_done_handler;
+    }
+
+    if(p_radio_params->rf_rx_done_handler != NULL)
+    {
+        gp_rx_done = p_radio_params->rf_rx_done_handler;
+    }
+
+    if(p_radio_params->rf_tx_failed_handler != NULL)
+    {
+        gp_tx_failed = p_radio_params->rf_tx_failed_handler;
+    }
+
+    if(p_radio_params->rf_rx_failed_handler != NULL)
+    {
+        gp_rx_failed = p_radio_params->rf_rx_failed_handler;
+    }
+
+    cc1101_spi_strobe (CC1101_SRES);
+    //SO goes low once the XOSC is up again after the reset
+    if(rf_spi_wait_ready (RF_COMM_WAKE_TIMEOUT_US) != 0)
+    {
+        return 1;
+    }
+
+    memcpy (&g_radio, p_radio_params, sizeof(rf_comm_radio_t));
+    config_write (&g_radio);
+    g_is_configured = true;
+    cal_run ();
+
+    hal_gpio_cfg_input (g_comm_hw.rf_gpio2_pin, HAL_GPIO_PULL_DISABLED);
+    hal_gpio_cfg_input (g_comm_hw.rf_gpio0_pin, HAL_GPIO_PULL_DISABLED);
+
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_cfg_output (g_comm_hw.rf_hgm_pin, 0);
+    hal_gpio_cfg_output (g_comm_hw.rf_pa_pin, 0);
+    hal_gpio_cfg_output (g_comm_hw.rf_lna_pin, 0);
+#endif
+
+    rf_comm_enable_irq ();
+    g_rx_buf_len = 0;
+    g_rx_overflows = 0;
+
+    NVIC_SetPriority (GPIOTE_IRQn, p_radio_params->irq_priority);
+    NVIC_EnableIRQ (GPIOTE_IRQn);
+
+    return 0;
+}
+
+uint32_t rf_comm_set_freq (uint32_t freq)
+{
+    uint32_t freq_word;
+    uint8_t freq_regs[3];
+
+    g_radio.center_freq = freq;
+    freq_word = (uint32_t) ROUNDED_DIV(((uint64_t) freq * 1000) << 16,
+            RF_XTAL_FREQ);
+    freq_regs[0] = (freq_word >> 16) & 0x3F;
+    freq_regs[1] = (freq_word >> 8) & 0xFF;
+    freq_regs[2] = freq_word & 0xFF;
+    cc1101_spi_write (CC1101_FREQ2, freq_regs, 3);
+    memcpy (g_freq_regs, freq_regs, sizeof(g_freq_regs));
+    //The FS isn't calibrated on its own when going to RX or TX
+    g_is_cal_due = true;
+    return 0;
+}
+
+uint32_t rf_comm_set_bitrate (uint32_t bitrate)
+{
+    uint32_t drate_e, drate_m;
+    uint8_t mdmcfg4;
+
+    g_radio.bitrate = bitrate;
+    //R = (256 + M) * 2^E * f_xosc / 2^28, the smallest E with M below 256
+    for(drate_e = 0; drate_e < 15; drate_e++)
+    {
+        if(((uint64_t) bitrate << (28 - drate_e)) < (512ULL * RF_XTAL_FREQ))
+        {
+            break;
+        }
+    }
+    drate_m = (uint32_t) ROUNDED_DIV((uint64_t) bitrate << (28 - drate_e),
+            RF_XTAL_FREQ);
+    drate_m = (drate_m < 256) ? 0 : (drate_m - 256);
+    if(drate_m > 255)
+    {
+        drate_m = 255;
+    }
+    mdmcfg4 = (reg_read (CC1101_MDMCFG4) & 0xF0) | drate_e;
+    reg_write (CC1101_MDMCFG4, mdmcfg4);
+    reg_write (CC1101_MDMCFG3, (uint8_t) drate_m);
+    return 0;
+}
+
+uint32_t rf_comm_set_fdev (uint32_t fdev)
+{
+    uint32_t dev_e, dev_m = 0;
+
+    g_radio.freq_dev = fdev;
+    if(fdev / 1000 == 0)
+    {
+        fdev = fdev * 1000;
+    }
+    //fdev = (8 + M) * 2^E * f_xosc / 2^17, the smallest E with M below 8
+    for(dev_e = 0; dev_e < 8; dev_e++)
+    {
+        dev_m = (uint32_t) ROUNDED_DIV((uint64_t) fdev << 17,
+                (uint64_t) RF_XTAL_FREQ << dev_e);
+        if(dev_m < 16)
+        {
+            break;
+        }
+    }
+    if(dev_e == 8)
+    {
+        dev_e = 7;
+        dev_m = 15;
+    }
+    dev_m = (dev_m < 8) ? 0 : (dev_m - 8);
+    reg_write (CC1101_DEVIATN, (dev_e << 4) | dev_m);
+    return 0;
+}
+
+uint32_t rf_comm_set_bw (uint32_t bandwidth)
+{
+    uint32_t bw_e, bw_m = 0;
+    uint8_t mdmcfg4;
+
+    g_radio.rx_bandwidth = bandwidth;
+    if((int)(bandwidth/1000) == 0)
+    {
+        bandwidth = bandwidth*1000;
+    }
+    //BW = f_xosc / (8 * (4 + M) * 2^E), the narrowest at least as wide as
+    //asked, 58 kHz at the narrowest with a 26 MHz XOSC
+    for(bw_e = 4; bw_e-- > 0;)
+    {
+        for(bw_m = 4; bw_m-- > 0;)
+        {
+            if((RF_XTAL_FREQ / (8 * (4 + bw_m) << bw_e)) >= bandwidth)
+            {
+                break;
+            }
+        }
+        if(bw_m < 4)
+        {
+            break;
+        }
+    }
+    if(bw_e > 3)
+    {
+        bw_e = 0;
+        bw_m = 0;
+    }
+    mdmcfg4 = (reg_read (CC1101_MDMCFG4) & 0x0F) | (bw_e << 6) | (bw_m << 4);
+    reg_write (CC1101_MDMCFG4, mdmcfg4);
+    return 0;
+}
+
+uint32_t rf_comm_set_freq_offset (int32_t offset_hz)
+{
+    int64_t steps = (int64_t) offset_hz * FREQOFF_STEP_DIV;
+
+    //Rounded to the nearest step either side of 0
+    steps = (steps + ((steps < 0) ? -(RF_XTAL_FREQ/2) : (RF_XTAL_FREQ/2)))
+            / RF_XTAL_FREQ;
+    if((steps > INT8_MAX) || (steps < INT8_MIN))
+    {
+        return 1;
+    }
+    g_freq_off = (int8_t) steps;
+    reg_write (CC1101_FSCTRL0, (uint8_t) g_freq_off);
+    return 0;
+}
+
+int32_t rf_comm_get_freq_offset (void)
+{
+    return (int32_t) (((int64_t) g_freq_off_est * RF_XTAL_FREQ) / FREQOFF_STEP_DIV);
+}
+
+uint32_t rf_comm_set_pwr (int32_t pwr)
+{
+    uint32_t i;
+
+    g_radio.tx_power = pwr;
+    //Only PATABLE[0] is used, the rest isn't kept in SLEEP
+    for(i = ARRAY_SIZE(pa_table) - 1; i > 0; i--)
+    {
+        if(pa_table[i].dbm <= pwr)
+        {
+            break;
+        }
+    }
+    reg_write (CC1101_PATABLE, pa_table[i].reg);
+    return 0;
+}
+
+uint32_t rf_comm_pkt_config (rf_comm_pkt_t * p_pkt_config)
+{
+    g_arr_pkt[0] = p_pkt_config->max_len;
+    g_arr_pkt[1] = p_pkt_config->app_id;
+    g_arr_pkt[2] = (p_pkt_config->dev_id & 0xFF00)>>8;
+    g_arr_pkt[3] = p_pkt_config->dev_id & 0xFF;
+    return 0;
+}
+
+/** Write the packet after the long preamble of rf_comm_pkt_send_wake */
+static void wake_preamble_done (void)
+{
+    g_tx_len = g_arr_pkt[0] + 1;
+    tx_fifo_fill (CC1101_FIFO_SIZE);
+}
+
+/** The radio has gone to TX with the TX FIFO loaded for a normal send, or
+ *  empty for the long preamble */
+static void tx_started (void)
+{
+    g_current_state = R_TX;
+    if(g_tx_wake_ms != 0)
+    {
+        ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+                MS_TIMER_TICKS_MS(g_tx_wake_ms + RF_COMM_WAKE_MARGIN_MS),
+                wake_preamble_done);
+    }
+}
+
+static void csma_check (void);
+
+/** Wait a random time in the backoff window, which doubles with each check */
+static void csma_backoff_start (void)
+{
+    uint32_t window = g_csma.max_backoff_ms;
+
+    if((g_csma_attempts < 16)
+            && ((g_csma.min_backoff_ms << g_csma_attempts) < window))
+    {
+        window = g_csma.min_backoff_ms << g_csma_attempts;
+    }
+    ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+            MS_TIMER_TICKS_MS(1 + ((window != 0) ? random_num_below (window) : 0)),
+            csma_check);
+}
+
+/** Go to RX till the RSSI settles and send if it is below the threshold */
+static void csma_check (void)
+{
+    uint32_t settle_us;
+    uint8_t marcstate;
+
+    g_csma_attempts++;
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_clear (g_comm_hw.rf_pa_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+#endif
+    cc1101_spi_strobe (CC1101_SRX);
+    settle_us = (RSSI_SETTLE_BITS * 1000000) / g_radio.bitrate;
+    hal_nop_delay_us ((settle_us < RF_COMM_CCA_TIMEOUT_US) ?
+            settle_us : RF_COMM_CCA_TIMEOUT_US);
+
+    if(rf_comm_get_rssi () < g_csma.cca_thr_dbm)
+    {
+        //The radio stays in RX if a packet is being received
+        cc1101_spi_strobe (CC1101_STX);
+        hal_nop_delay_us (RF_COMM_CCA_POLL_US);
+        marcstate = reg_read (CC1101_MARCSTATE) & CC1101_MARCSTATE_Msk;
+        if(marcstate != CC1101_MARCSTATE_RX)
+        {
+#ifdef RF_COMM_AMPLIFIRE
+            hal_gpio_pin_clear (g_comm_hw.rf_lna_pin);
+            hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
+#endif
+            g_csma_stats.last_attempts = g_csma_attempts;
+            g_csma_stats.sent++;
+            tx_started ();
+            return;
+        }
+    }
+
+    g_csma_stats.busy++;
+    //Back off in IDLE, without the packet received meanwhile
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cc1101_spi_strobe (CC1101_SFRX);
+    if(g_csma_attempts < g_csma.max_attempts)
+    {
+        csma_backoff_start ();
+        return;
+    }
+
+    log_printf("CSMA Dropped\n");
+    g_csma_stats.last_attempts = g_csma_attempts;
+    g_csma_stats.dropped++;
+    cc1101_spi_strobe (CC1101_SFTX);
+    tx_end ();
+    if(gp_tx_failed != NULL)
+    {
+        gp_tx_failed (RF_COMM_TX_CCA_FAIL);
+    }
+}
+
+/** Send the loaded TX FIFO now or after the listen before talk */
+static void tx_start (void)
+{
+    if(g_csma.max_attempts == 0)
+    {
+        cc1101_spi_strobe (CC1101_STX);
+        tx_started ();
+    }
+    else
+    {
+        g_csma_attempts = 0;
+        g_current_state = R_CCA;
+        csma_backoff_start ();
+    }
+}
+
+uint32_t rf_comm_csma_config (rf_comm_csma_t * p_csma)
+{
+    //The threshold is compared in csma_check, MCSM1 only gates the STX on
+    //a packet being received
+    if(p_csma != &g_csma)
+    {
+        memcpy (&g_csma, p_csma, sizeof(rf_comm_csma_t));
+    }
+    return 0;
+}
+
+void rf_comm_get_csma_stats (rf_comm_csma_stats_t * p_stats)
+{
+    memcpy (p_stats, &g_csma_stats, sizeof(rf_comm_csma_stats_t));
+}
+
+/** Put the header and the payload of a packet to be sent in g_arr_pkt */
+static void tx_pkt_build (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    g_arr_pkt[0] = RF_COMM_HDR_LEN+len;
+    g_arr_pkt[1 + RF_COMM_HDR_SEQ_POS] = g_tx_seq++;
+    g_arr_pkt[1 + RF_COMM_HDR_TYPE_POS] = pkt_type;
+    memcpy (&g_arr_pkt[1 + RF_COMM_HDR_LEN], p_data, len);
+}
+
+uint32_t rf_comm_pkt_send (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    timer_cancel ();
+    listen_exit ();
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cal_if_due ();
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
+#endif
+    tx_pkt_build (pkt_type, p_data, len);
+    tx_fifo_load (true);
+    g_tx_wake_ms = 0;
+    tx_start ();
+    return 0;
+}
+
+uint32_t rf_comm_pkt_resend (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    g_tx_seq--;
+    return rf_comm_pkt_send (pkt_type, p_data, len);
+}
+
+uint32_t rf_comm_pkt_send_wake (uint8_t pkt_type, uint8_t * p_data, uint8_t len,
+        uint32_t interval_ms)
+{
+    timer_cancel ();
+    listen_exit ();
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cal_if_due ();
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
+#endif
+    tx_pkt_build (pkt_type, p_data, len);
+
+    //With the TX FIFO empty the preamble is sent till the packet is written
+    tx_fifo_load (false);
+    g_tx_wake_ms = interval_ms;
+    tx_start ();
+    return 0;
+}
+
+uint32_t rf_comm_listen_start (uint32_t interval_ms)
+{
+    uint32_t ticks = (uint32_t) (((uint64_t) interval_ms * WOR_TICKS_S) / 1000);
+    uint32_t res = 0, rx_time;
+    uint8_t event0[2];
+
+    //EVENT0 is 16 bits, each step of WOR_RES is 2^5 times longer
+    if(ticks > 0xFFFF)
+    {
+        ticks >>= 5;
+        res = 1;
+    }
+    if(ticks > 0xFFFF)
+    {
+        ticks = 0xFFFF;
+    }
+    else if(ticks == 0)
+    {
+        ticks = 1;
+    }
+    //The shortest RX timeout that is still at least RF_COMM_SNIFF_US,
+    //which RX_TIME_RSSI ends early when there is no carrier
+    for(rx_time = 6; rx_time > 0; rx_time--)
+    {
+        if(((uint64_t) ticks * wor_rx_time_c[res][rx_time] * 26000000)
+                >= ((uint64_t) RF_COMM_SNIFF_US * 10000 * RF_XTAL_FREQ))
+        {
+            break;
+        }
+    }
+
+    timer_cancel ();
+    listen_exit ();
+    cc1101_spi_strobe (CC1101_SIDLE);
+    event0[0] = (ticks >> 8) & 0xFF;
+    event0[1] = ticks & 0xFF;
+    cc1101_spi_write (CC1101_WOREVT1, event0, 2);
+    reg_write (CC1101_MCSM2, CC1101_MCSM2_RX_TIME_RSSI | rx_time);
+    //The RC oscillator is powered and calibrated to the XOSC
+    reg_write (CC1101_WORCTRL, CC1101_WORCTRL_LISTEN | res);
+    gdo0_config (false);
+
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+#endif
+    g_current_state = R_RX;
+    g_is_listening = true;
+    cc1101_spi_strobe (CC1101_SFRX);
+    cc1101_spi_strobe (CC1101_SWORRST);
+    cc1101_spi_strobe (CC1101_SWOR);
+    return 0;
+}
+
+uint32_t rf_comm_listen_stop (void)
+{
+    listen_exit ();
+    g_current_state = R_IDLE;
+    return 0;
+}
+
+uint32_t rf_comm_rx_enable ()
+{
+    timer_cancel ();
+    listen_exit ();
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+#endif
+    //SFRX works only in IDLE
+    cc1101_spi_strobe (CC1101_SIDLE);
+    gdo0_config (false);
+    g_current_state = R_RX;
+    g_rx_buf_len = 0;
+    cc1101_spi_strobe (CC1101_SFRX);
+    cc1101_spi_strobe (CC1101_SRX);
+    return 0;
+}
+
+static void rx_window_timeout (void)
+{
+    g_is_rx_window = false;
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cc1101_spi_strobe (CC1101_SFRX);
+    g_current_state = R_IDLE;
+    if(gp_rx_failed != NULL)
+    {
+        gp_rx_failed (RF_COMM_RX_TIMEOUT);
+    }
+}
+
+uint32_t rf_comm_rx_window (uint32_t timeout_ms)
+{
+    rf_comm_rx_enable ();
+    g_is_rx_window = true;
+    ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+            MS_TIMER_TICKS_MS(timeout_ms), rx_window_timeout);
+    return 0;
+}
+
+uint8_t rf_comm_get_tx_seq (void)
+{
+    return (uint8_t) (g_tx_seq - 1);
+}
+
+
+/** Where rf_comm_pkt_receive copies the packet */
+static uint8_t * gp_rx_dest;
+static uint8_t * gp_rx_dest_len;
+static uint32_t g_rx_dest_status;
+
+static void rx_copy_handler (rf_comm_rx_pkt_t * p_pkt)
+{
+    memcpy (gp_rx_dest, p_pkt->p_data, p_pkt->len);
+    *gp_rx_dest_len = p_pkt->len;
+    g_rx_dest_status = p_pkt->crc_ok ? CC1101_LQI_CRC_OK : 0;
+}
+
+/** Go back to sniffing after a packet in the listen mode */
+static void listen_resume (void)
+{
+    if(g_is_listening)
+    {
+        //The radio stays in RX after the packet, go back to sleep and sniff
+        cc1101_spi_strobe (CC1101_SIDLE);
+        cc1101_spi_strobe (CC1101_SFRX);
+        cc1101_spi_strobe (CC1101_SWOR);
+        g_rx_buf_len = 0;
+    }
+}
+
+uint32_t rf_comm_pkt_receive (uint8_t * p_rxbuff, uint8_t * p_len)
+{
+    gp_rx_dest = p_rxbuff;
+    gp_rx_dest_len = p_len;
+    g_rx_dest_status = 0;
+    *p_len = 0;
+
+    rx_fifo_read ();
+    (void) rx_buf_parse (rx_copy_handler, 1);
+    g_current_state = R_RX;
+    listen_resume ();
+    return g_rx_dest_status;
+}
+
+uint32_t rf_comm_pkt_receive_all (rf_comm_rx_pkt_handler_t handler)
+{
+    uint32_t pkts;
+
+    rx_fifo_read ();
+    pkts = rx_buf_parse (handler, UINT32_MAX);
+    g_current_state = R_RX;
+    listen_resume ();
+    return pkts;
+}
+
+uint32_t rf_comm_get_rx_overflows (void)
+{
+    return g_rx_overflows;
+}
+
+uint32_t rf_comm_idle ()
+{
+    timer_cancel ();
+    listen_exit ();
+    cc1101_spi_strobe (CC1101_SIDLE);
+    cc1101_spi_strobe (CC1101_SFRX);
+    cc1101_spi_strobe (CC1101_SFTX);
+    tx_end ();
+    return 0;
+}
+
+uint32_t rf_comm_sleep ()
+{
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_clear (g_comm_hw.rf_hgm_pin);
+    hal_gpio_pin_clear (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_clear (g_comm_hw.rf_pa_pin);
+#endif
+    timer_cancel ();
+    listen_exit ();
+    cc1101_spi_strobe (CC1101_SIDLE);
+
+    while(rf_comm_get_state ())
+    {
+    }
+
+    //The registers but the test registers and the calibration of the FS are
+    //kept in SLEEP, the FIFOs aren't
+    cc1101_spi_strobe (CC1101_SPWD);
+    tx_end ();
+    return 0;
+}
+
+uint32_t rf_comm_flush (void)
+{
+    cc1101_spi_strobe (CC1101_SFRX);
+    cc1101_spi_strobe (CC1101_SFTX);
+    return 0;
+}
+
+uint32_t rf_comm_wake (void)
+{
+    uint8_t freq_regs[3];
+
+    if(rf_spi_wait_ready (RF_COMM_WAKE_TIMEOUT_US) != 0)
+    {
+        return 1;
+    }
+    cc1101_spi_strobe (CC1101_SIDLE);
+
+    if(g_is_configured)
+    {
+        //A reset of the radio in the sleep, such as on a brown out, loses
+        //the configuration
+        cc1101_spi_read (CC1101_FREQ2, freq_regs, 3);
+        if(memcmp (freq_regs, g_freq_regs, sizeof(freq_regs)) != 0)
+        {
+            log_printf("%s : Config lost\n", __func__);
+            config_write (&g_radio);
+        }
+        else
+        {
+            cc1101_spi_write (CC1101_TEST2, (uint8_t *) test_regs,
+                    sizeof(test_regs));
+        }
+        cal_if_due ();
+    }
+    return 0;
+}
+
+void rf_comm_cal_update (uint32_t elapsed_s, int32_t temp_c)
+{
+    int32_t delta_c = 0;
+
+    g_cal_age_s += elapsed_s;
+    if(temp_c != RF_COMM_TEMP_UNKNOWN)
+    {
+        //The first temperature known is taken as that of the calibration
+        if(g_cal_temp_c == RF_COMM_TEMP_UNKNOWN)
+        {
+            g_cal_temp_c = temp_c;
+        }
+        g_temp_c = temp_c;
+        delta_c = (temp_c > g_cal_temp_c) ?
+                (temp_c - g_cal_temp_c) : (g_cal_temp_c - temp_c);
+    }
+    if((g_cal_age_s >= RF_COMM_CAL_INTERVAL_S)
+            || (delta_c >= RF_COMM_CAL_TEMP_DELTA_C))
+    {
+        g_is_cal_due = true;
+    }
+}
+
+int8_t rf_comm_get_rssi ()
+{
+    return (int8_t) reg_read (CC1101_RSSI)/2 - RSSI_OFFSET;
+}
+
+void rf_comm_disable_irq ()
+{
+    NRF_GPIOTE->CONFIG[GPIOTE_USED0] = 0;
+    NRF_GPIOTE->INTENCLR = 1 << GPIOTE_USED0;
+    NRF_GPIOTE->CONFIG[GPIOTE_USED1] = 0;
+    NRF_GPIOTE->INTENCLR = 1 << GPIOTE_USED1;
+}
+
+void rf_comm_enable_irq ()
+{
+    NRF_GPIOTE->CONFIG[GPIOTE_USED0] =
+        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos)
+        | (g_comm_hw.rf_gpio2_pin << GPIOTE_CONFIG_PSEL_Pos)
+        | (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
+    NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED0;
+    NRF_GPIOTE->CONFIG[GPIOTE_USED1] =
+        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos)
+        | (g_comm_hw.rf_gpio0_pin << GPIOTE_CONFIG_PSEL_Pos)
+        | (GPIOTE_CONFIG_POLARITY_LoToHi << GPIOTE_CONFIG_POLARITY_Pos);
+    NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED1;
+}
+
+uint32_t rf_comm_get_state ()
+{
+    uint8_t state;
+    state = cc1101_spi_strobe (CC1101_SNOP);
+    state &= 0xF0;
+    state >>= 4;
+    return state;
+}
+
+uint32_t rf_comm_get_radio_id ()
+{
+    //PARTNUM is 0, the VERSION tells the CC1101 apart
+    return reg_read (CC1101_VERSION);
+}
+
+/** GDO2 has fallen at the end of a packet sent or received */
+static void pkt_end (void)
+{
+    uint8_t pkt_status, tx_bytes;
+
+    if(g_current_state == R_TX)
+    {
+        tx_bytes = fifo_bytes_read (CC1101_TXBYTES);
+        if(tx_bytes & CC1101_FIFO_ERR)
+        {
+            //The TX FIFO ran empty, SFTX takes the radio out of TXFIFO_UNDERFLOW
+            log_printf("Tx Failed\n");
+            cc1101_spi_strobe (CC1101_SFTX);
+            tx_end ();
+            if(gp_tx_failed != NULL)
+            {
+                gp_tx_failed (tx_bytes);
+            }
+            return;
+        }
+        log_printf("Tx Done\n");
+        tx_end ();
+        if(gp_tx_done != NULL)
+        {
+            gp_tx_done (0);
+        }
+        return;
+    }
+    if(g_current_state != R_RX)
+    {
+        return;
+    }
+    pkt_status = reg_read (CC1101_PKTSTATUS);
+    if(fifo_bytes_read (CC1101_RXBYTES) & CC1101_FIFO_ERR)
+    {
+        rx_restart ();
+        return;
+    }
+    if(pkt_status & CC1101_PKTSTATUS_CRC_OK)
+    {
+        log_printf("Rx Done\n");
+        freq_off_est_read ();
+        g_current_state = R_IDLE;
+        if(gp_rx_done != NULL)
+        {
+            gp_rx_done (pkt_status);
+        }
+    }
+    else if(g_is_listening)
+    {
+        //Back to sniffing, the bad packet is kept in the buffer with the
+        //packets before it and given with crc_ok clear
+        rx_fifo_read ();
+        cc1101_spi_strobe (CC1101_SIDLE);
+        cc1101_spi_strobe (CC1101_SFRX);
+        cc1101_spi_strobe (CC1101_SWOR);
+    }
+    //In an RX window the radio stays in RX till the timeout
+    else if(g_is_rx_window == false)
+    {
+        log_printf("Rx Failed\n");
+        g_current_state = R_IDLE;
+        if(gp_rx_failed != NULL)
+        {
+            gp_rx_failed (pkt_status);
+        }
+    }
+}
+
+#if ISR_MANAGER == 1
+void rf_comm_gpiote_Handler (uint32_t fired)
+#else
+void GPIOTE_IRQHandler ()
+#endif
+{
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (NRF_GPIOTE);
+#endif
+    //The TX FIFO is below or the RX FIFO above the threshold during a long
+    //packet
+    if(fired & ISR_DISPATCH_EVT(NRF_GPIOTE, NRF_GPIOTE->EVENTS_IN[GPIOTE_USED1]))
+    {
+        if(g_is_gdo0_tx)
+        {
+            if(g_tx_pos < g_tx_len)
+            {
+                tx_fifo_fill (CC1101_FIFO_SIZE - (fifo_bytes_read (CC1101_TXBYTES)
+                        & CC1101_NUM_BYTES_Msk));
+            }
+        }
+        else
+        {
+            rx_fifo_read ();
+        }
+    }
+
+    if(fired & ISR_DISPATCH_EVT(NRF_GPIOTE, NRF_GPIOTE->EVENTS_IN[GPIOTE_USED0]))
+    {
+        pkt_end ();
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ *  spi_cc1101_nrf52.c : SPI access of the registers, FIFOs and strobes of
+ *  the CC1101 over the SPIM
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "spi_cc1101_nrf52.h"
+#include "cc1101_def.h"
+#include "hal_spim.h"
+
+#include "string.h"
+#include "stdbool.h"
+
+/** Header byte and a FIFO worth of data */
+#define SPI_BUF_SIZE    (1 + CC1101_FIFO_SIZE)
+
+static cc1101_status_t transfer (uint8_t hdr, uint8_t * p_tx, uint8_t * p_rx,
+        uint32_t len)
+{
+    uint8_t tx_buff[SPI_BUF_SIZE];
+    uint8_t rx_buff[SPI_BUF_SIZE];
+
+    if(len > CC1101_FIFO_SIZE)
+    {
+        len = CC1101_FIFO_SIZE;
+    }
+    tx_buff[0] = hdr;
+    if(p_tx != NULL)
+    {
+        memcpy (&tx_buff[1], p_tx, len);
+    }
+    else
+    {
+        memset (&tx_buff[1], 0x00, len);
+    }
+    hal_spim_tx_rx (tx_buff, 1 + len, rx_buff, 1 + len);
+    while(hal_spim_is_busy ());
+    if(p_rx != NULL)
+    {
+        memcpy (p_rx, &rx_buff[1], len);
+    }
+    return rx_buff[0];
+}
+
+cc1101_status_t cc1101_spi_write (uint8_t addr, uint8_t * p_data, uint32_t len)
+{
+    return transfer (CC1101_HDR_WRITE | ((len > 1) ? CC1101_HDR_BURST : 0) | addr,
+            p_data, NULL, len);
+}
+
+cc1101_status_t cc1101_spi_read (uint8_t addr, uint8_t * p_data, uint32_t len)
+{
+    //Without the burst bit the addresses of the status registers are strobes
+    bool is_burst = (len > 1)
+            || ((addr >= CC1101_STATUS_FIRST) && (addr <= CC1101_STATUS_LAST));
+
+    return transfer (CC1101_HDR_READ | (is_burst ? CC1101_HDR_BURST : 0) | addr,
+            NULL, p_data, len);
+}
+
+cc1101_status_t cc1101_spi_strobe (uint8_t cmd)
+{
+    return transfer (cmd, NULL, NULL, 0);
+}
@@ -0,0 +1,62 @@
+/*
+ *  spi_cc1101_nrf52.h : SPI access of the registers, FIFOs and strobes of
+ *  the CC1101 over the SPIM
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPI_CC1101_NRF52_H
+#define SPI_CC1101_NRF52_H
+#include "stdint.h"
+
+typedef struct
+{
+  uint8_t   addr;
+  uint8_t   data;
+}cc1101_reg_setting_t;
+
+/** The status byte sent by the CC1101 with the header byte, with the state
+ *  in bits 6:4 */
+typedef uint8_t cc1101_status_t;
+
+/**
+ * @brief Write consecutive registers, or the TX FIFO at @ref CC1101_FIFO
+ * @param addr Address of the first register
+ * @param p_data The bytes to write
+ * @param len Number of bytes, at most 64
+ * @return Status byte
+ */
+cc1101_status_t cc1101_spi_write (uint8_t addr, uint8_t * p_data, uint32_t len);
+
+/**
+ * @brief Read consecutive registers, a status register, or the RX FIFO at
+ *  @ref CC1101_FIFO. The burst bit is set for more than a byte and for the
+ *  status registers.
+ * @param addr Address of the first register
+ * @param p_data Filled with the bytes read
+ * @param len Number of bytes, at most 64
+ * @return Status byte
+ */
+cc1101_status_t cc1101_spi_read (uint8_t addr, uint8_t * p_data, uint32_t len);
+
+/**
+ * @brief Send a strobe
+ * @param cmd The strobe
+ * @return Status byte
+ */
+cc1101_status_t cc1101_spi_strobe (uint8_t cmd);
+
+#endif /* SPI_CC1101_NRF52_H */
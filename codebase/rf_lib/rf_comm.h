@@ -22,6 +22,7 @@
 
 #include "nrf_util.h"
 #include "stdint.h"
+#include "stdbool.h"
 
 #if SYS_CFG_PRESENT == 1
 #include "sys_config.h"
@@ -48,6 +49,80 @@
 #define GPIOTE_CH_USED_RF_COMM_3 3
 #endif
 
+/** Bytes in the RX FIFO at which GPIO0 interrupts to drain it, so that
+ *  packets longer than the FIFO of 128 bytes can be received */
+#ifndef RF_COMM_RX_FIFO_THR
+#define RF_COMM_RX_FIFO_THR 64
+#endif
+
+/** Size of the buffer for the bytes read from the RX FIFO and not yet
+ *  delivered, which holds the packets queued back to back in the FIFO */
+#ifndef RF_COMM_RX_BUF_SIZE
+#define RF_COMM_RX_BUF_SIZE 512
+#endif
+
+/** MS_TIMER used to time the long preamble of @ref rf_comm_pkt_send_wake,
+ *  the backoffs of the CSMA and the RX windows */
+#ifndef MS_TIMER_USED_RF_COMM
+#define MS_TIMER_USED_RF_COMM 3
+#endif
+
+/** Time in ms for which the long preamble is sent beyond the listen
+ *  interval, to cover the drift between the RC oscillators */
+#ifndef RF_COMM_WAKE_MARGIN_MS
+#define RF_COMM_WAKE_MARGIN_MS 20
+#endif
+
+/** Maximum time in us to wait in RX for a valid carrier sense before the
+ *  clear channel check of the CSMA */
+#ifndef RF_COMM_CCA_TIMEOUT_US
+#define RF_COMM_CCA_TIMEOUT_US 5000
+#endif
+
+/** Time in us between the reads of the carrier sense and after the STX
+ *  strobe for the clear channel decision */
+#ifndef RF_COMM_CCA_POLL_US
+#define RF_COMM_CCA_POLL_US 100
+#endif
+
+/** Maximum time in us for the radio to be ready at @ref rf_comm_wake, which
+ *  covers the start up of its crystal or TCXO */
+#ifndef RF_COMM_WAKE_TIMEOUT_US
+#define RF_COMM_WAKE_TIMEOUT_US 50000
+#endif
+
+/** Time in s after which the frequency synthesizer is calibrated again at
+ *  the next @ref rf_comm_wake, for the slow drift of the VCO */
+#ifndef RF_COMM_CAL_INTERVAL_S
+#define RF_COMM_CAL_INTERVAL_S (4*60*60)
+#endif
+
+/** Change of temperature in degree C since the last calibration for which
+ *  the frequency synthesizer is calibrated again at the next wake */
+#ifndef RF_COMM_CAL_TEMP_DELTA_C
+#define RF_COMM_CAL_TEMP_DELTA_C 10
+#endif
+
+/** Temperature given to @ref rf_comm_cal_update when it isn't known */
+#define RF_COMM_TEMP_UNKNOWN    INT32_MIN
+
+/** Positions of the header fields in a packet after its length byte. The
+ *  sequence number increments with each packet sent, so that a receiver
+ *  can count the packets lost from the gaps */
+#define RF_COMM_HDR_APP_ID_POS  0
+#define RF_COMM_HDR_DEV_ID_POS  1
+#define RF_COMM_HDR_SEQ_POS     3
+#define RF_COMM_HDR_TYPE_POS    4
+/** Length of the header, the data sent follows it */
+#define RF_COMM_HDR_LEN         5
+
+/** Status given to the rx failed handler when an RX window of
+ *  @ref rf_comm_rx_window ends without the application stopping it */
+#define RF_COMM_RX_TIMEOUT      0x01
+
+/** Status given to the tx failed handler when the channel was busy for all
+ *  the clear channel checks of @ref rf_comm_csma_config */
+#define RF_COMM_TX_CCA_FAIL     0x0B
 
 typedef enum
 {
@@ -86,6 +161,55 @@ typedef struct
 //#endif
 }rf_comm_hw_t;
 
+/** A packet received with the status bytes appended by the radio */
+typedef struct
+{
+    /** The packet after its length byte */
+    uint8_t * p_data;
+    /** Length of the packet */
+    uint8_t len;
+    /** RSSI in dBm when the sync word was found */
+    int8_t rssi;
+    /** Link quality indicator, lower is better */
+    uint8_t lqi;
+    /** If the CRC of the packet matched */
+    bool crc_ok;
+}rf_comm_rx_pkt_t;
+
+/** Handler of the packets got with @ref rf_comm_pkt_receive_all */
+typedef void (*rf_comm_rx_pkt_handler_t) (rf_comm_rx_pkt_t * p_pkt);
+
+/** Listen before talk with a random backoff for the sends, as a CSMA.
+ *  Before each try the radio waits a random time in the backoff window,
+ *  then checks the channel and sends only if the RSSI is below the
+ *  threshold and no packet is being received. A
+ *  busy channel doubles the window, up to the maximum, for the next try. */
+typedef struct
+{
+    /** Maximum number of clear channel checks for a packet, 0 to send
+     *  without the CSMA */
+    uint32_t max_attempts;
+    /** Backoff window in ms for the first check */
+    uint32_t min_backoff_ms;
+    /** Largest backoff window in ms */
+    uint32_t max_backoff_ms;
+    /** RSSI in dBm at or above which the channel is busy */
+    int32_t cca_thr_dbm;
+}rf_comm_csma_t;
+
+/** Statistics of the CSMA since the boot */
+typedef struct
+{
+    /** Clear channel checks of the last packet sent or dropped */
+    uint32_t last_attempts;
+    /** Packets sent after a clear channel check */
+    uint32_t sent;
+    /** Checks which found the channel busy */
+    uint32_t busy;
+    /** Packets dropped as the channel was busy for all the checks */
+    uint32_t dropped;
+}rf_comm_csma_stats_t;
+
 /**
  * @brief Structure to set Radio peripheral
  * @{
@@ -147,6 +271,27 @@ uint32_t rf_comm_set_fdev (uint32_t fdev);
  */
 uint32_t rf_comm_set_bw (uint32_t bandwidth);
 
+/**
+ * @brief Function to shift the frequency of the radio in TX and RX, to
+ *  correct the offset of its crystal from that of its peer. The shift is
+ *  kept across sleep and @ref rf_comm_radio_init.
+ * @param offset_hz Shift in Hz, added to the center frequency
+ * @return Status
+ * @retval 0 The shift is set
+ * @retval 1 The shift is out of the range of the radio or not supported
+ */
+uint32_t rf_comm_set_freq_offset (int32_t offset_hz);
+
+/**
+ * @brief Function to get the frequency offset of the last good packet
+ *  received, as estimated by the radio. With the shift of
+ *  @ref rf_comm_set_freq_offset added, it is the offset of the crystal of
+ *  the sender from that of this radio.
+ * @return Offset in Hz of the sender above the frequency of this radio, 0
+ *  if not estimated
+ */
+int32_t rf_comm_get_freq_offset (void);
+
 /**
  * @brief Function to set transmission power
  * @param pwr Power (dBm -3 to 15)
@@ -171,19 +316,128 @@ uint32_t rf_comm_pkt_config (rf_comm_pkt_t * p_pkt_config);
 uint32_t rf_comm_pkt_send (uint8_t pkt_type, uint8_t * p_data, uint8_t len);
 
 /**
- * @brief Function to received store data into buffer.
- * @param p_rxbuff Buffer memory where received data is to be stored.
- * @param p_len Pointer to variable where length is to be stored
+ * @brief Function to send a packet again with the sequence number of the
+ *  last packet sent, such as a retransmission of a packet whose ack was
+ *  missed, so that the receiver finds it a duplicate
+ * @param pkt_type Packet type
+ * @param p_data pointer to actual data
+ * @param len Length of data
  * @return Status
  */
+uint32_t rf_comm_pkt_resend (uint8_t pkt_type, uint8_t * p_data, uint8_t len);
+
+/**
+ * @brief Function to received store data into buffer. Gives the oldest of
+ *  the packets received, the rest are kept for the next calls.
+ * @param p_rxbuff Buffer memory where received data is to be stored.
+ * @param p_len Pointer to variable where length is to be stored, 0 if no
+ *  packet is received
+ * @return CRC_OK bit of the packet
+ */
 uint32_t rf_comm_pkt_receive (uint8_t * p_rxbuff, uint8_t * p_len);
 
+/**
+ * @brief Function to get all the packets received. The RX FIFO is read in
+ *  one SPI burst of the count in NUM_RXBYTES and every complete packet in
+ *  it is passed to the handler with its RSSI and LQI status bytes. The
+ *  bytes of a packet still being received are kept till the next call.
+ *  The radio stays in RX after a packet, so packets sent back to back are
+ *  all received. On an overflow of the RX FIFO the complete packets in it
+ *  are kept, and it is flushed and RX restarted.
+ *  To be called from the rx done handler or at its interrupt priority.
+ * @param handler The handler called for each packet, the data is valid
+ *  only during the call
+ * @return Number of packets passed to the handler
+ */
+uint32_t rf_comm_pkt_receive_all (rf_comm_rx_pkt_handler_t handler);
+
+/**
+ * @brief Function to get the number of overflows of the RX FIFO
+ * @return Number of overflows since the radio init
+ */
+uint32_t rf_comm_get_rx_overflows (void);
+
 /**
  * @brief Function to start radio reception.
  * @return 
  */
 uint32_t rf_comm_rx_enable ();
 
+/**
+ * @brief Function to start radio reception for a time, such as for a reply
+ *  after a send. The rx done handler is called for each packet and the
+ *  radio stays in RX till the application calls @ref rf_comm_idle or
+ *  @ref rf_comm_sleep, or till the timeout, timed with
+ *  @ref MS_TIMER_USED_RF_COMM, after which the rx failed handler is called
+ *  with @ref RF_COMM_RX_TIMEOUT. Bad packets don't call the rx failed
+ *  handler during the window.
+ * @param timeout_ms The time in ms to stay in RX
+ * @return Status
+ */
+uint32_t rf_comm_rx_window (uint32_t timeout_ms);
+
+/**
+ * @brief Function to get the sequence number of the last packet sent, to
+ *  match the reply of the receiver
+ * @return The sequence number in the header of the last packet
+ */
+uint8_t rf_comm_get_tx_seq (void);
+
+/**
+ * @brief Function to start the low power listen mode. The radio sleeps with
+ *  its eWOR timer running and wakes every interval to sniff the channel,
+ *  going back to sleep unless carrier sense is found. On a carrier it stays
+ *  in RX for the sync word and the packet, so the MCU is interrupted only
+ *  at the end of a packet which had a valid sync word, with the rx done
+ *  handler. Bad packets return the radio to sleep without an interrupt.
+ *  The listen mode continues after @ref rf_comm_pkt_receive, till
+ *  @ref rf_comm_listen_stop, @ref rf_comm_idle, @ref rf_comm_rx_enable,
+ *  @ref rf_comm_sleep or a send.
+ * @param interval_ms The listen interval in ms, the senders must use the
+ *  same with @ref rf_comm_pkt_send_wake
+ * @return Status
+ */
+uint32_t rf_comm_listen_start (uint32_t interval_ms);
+
+/**
+ * @brief Function to stop the low power listen mode and put radio in idle mode
+ * @return Status
+ */
+uint32_t rf_comm_listen_stop (void);
+
+/**
+ * @brief Function to send a packet to a radio in the low power listen mode.
+ *  The preamble is sent for the listen interval plus
+ *  @ref RF_COMM_WAKE_MARGIN_MS, timed with @ref MS_TIMER_USED_RF_COMM, so
+ *  that the receiver sniffs it. The tx done handler is called at the end.
+ * @param pkt_type Packet type (maintain, deploy, sense)
+ * @param p_data pointer to actual data
+ * @param len Length of data
+ * @param interval_ms The listen interval of the receiver in ms
+ * @return Status
+ */
+uint32_t rf_comm_pkt_send_wake (uint8_t pkt_type, uint8_t * p_data, uint8_t len,
+        uint32_t interval_ms);
+
+/**
+ * @brief Function to configure the listen before talk of the sends. With
+ *  it enabled @ref rf_comm_pkt_send and @ref rf_comm_pkt_send_wake return
+ *  at once and the backoffs are timed with @ref MS_TIMER_USED_RF_COMM.
+ *  The tx done handler is called when the packet is sent and the tx failed
+ *  handler with @ref RF_COMM_TX_CCA_FAIL when the channel was busy for all the
+ *  checks. The configuration is kept across @ref rf_comm_radio_init.
+ * @param p_csma The configuration, with max_attempts 0 to disable it
+ * @return Status
+ */
+uint32_t rf_comm_csma_config (rf_comm_csma_t * p_csma);
+
+/**
+ * @brief Function to get the statistics of the CSMA, such as in the tx done
+ *  handler for the number of checks the packet took
+ * @param p_stats Filled with the statistics
+ */
+void rf_comm_get_csma_stats (rf_comm_csma_stats_t * p_stats);
+
 /**
  * @brief Function to put radio in idle mode
  * @return Status
@@ -191,17 +445,34 @@ uint32_t rf_comm_rx_enable ();
 uint32_t rf_comm_idle ();
 
 /**
- * @brief Function to put radio in sleep mode
+ * @brief Function to put radio in sleep mode. The configuration is kept in
+ *  the radio, so only @ref rf_comm_wake is needed after it.
  * @return Status
  */
 uint32_t rf_comm_sleep ();
 
 /**
- * @brief Function to exit Sleep state
+ * @brief Function to exit Sleep state. The radio is waited for till it is
+ *  ready and left in IDLE. Its configuration is restored if it was lost in
+ *  the sleep, such as on a reset of the radio, and the frequency
+ *  synthesizer is calibrated if @ref rf_comm_cal_update found it due.
  * @return Status
+ * @retval 0 The radio is ready
+ * @retval 1 The radio wasn't ready in @ref RF_COMM_WAKE_TIMEOUT_US
  */
 uint32_t rf_comm_wake(void);
 
+/**
+ * @brief Function to give the time passed and the temperature near the
+ *  radio, from which the frequency synthesizer is calibrated at the next
+ *  wake or send if more than @ref RF_COMM_CAL_INTERVAL_S passed or the
+ *  temperature changed by @ref RF_COMM_CAL_TEMP_DELTA_C since the last
+ *  calibration.
+ * @param elapsed_s Time in s since the last call
+ * @param temp_c Temperature in degree C, or @ref RF_COMM_TEMP_UNKNOWN
+ */
+void rf_comm_cal_update (uint32_t elapsed_s, int32_t temp_c);
+
 /**
  * @biref Function to flush Tx Rx buffers
  * @return 
@@ -0,0 +1,143 @@
+/*
+ *  rf_link_adapt.c : Adaptation of the TX power and bit rate of a node
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rf_link_adapt.h"
+
+static int32_t margin (const rf_link_adapt_t * p_link, uint32_t rate_idx,
+        int32_t rssi_dbm)
+{
+    return rssi_dbm - p_link->p_config->p_rates[rate_idx].sensitivity_dbm;
+}
+
+void rf_link_adapt_init (rf_link_adapt_t * p_link,
+        const rf_link_adapt_config_t * p_config)
+{
+    p_link->p_config = p_config;
+    p_link->pwr_dbm = p_config->max_pwr_dbm;
+    p_link->rate_idx = 0;
+    p_link->misses = 0;
+}
+
+bool rf_link_adapt_feedback (rf_link_adapt_t * p_link, int8_t rssi_dbm)
+{
+    const rf_link_adapt_config_t * p_cfg = p_link->p_config;
+    int32_t pwr = p_link->pwr_dbm;
+    uint32_t rate_idx = p_link->rate_idx;
+    int32_t m = margin (p_link, rate_idx, rssi_dbm);
+    int32_t target = p_cfg->target_margin_db;
+
+    p_link->misses = 0;
+    if(m < target)
+    {
+        //Raise the power in steps to just above the target
+        pwr += p_cfg->pwr_step_db
+                * ((target - m + p_cfg->pwr_step_db - 1) / p_cfg->pwr_step_db);
+        if(pwr > p_cfg->max_pwr_dbm)
+        {
+            pwr = p_cfg->max_pwr_dbm;
+            //Short of the margin even at the maximum power
+            if((m + (pwr - p_link->pwr_dbm) < target) && (rate_idx > 0))
+            {
+                rate_idx--;
+            }
+        }
+    }
+    else if(m >= (target + p_cfg->hysteresis_db))
+    {
+        if(((rate_idx + 1) < p_cfg->rate_count)
+                && (margin (p_link, rate_idx + 1, rssi_dbm)
+                        >= (target + p_cfg->hysteresis_db)))
+        {
+            rate_idx++;
+        }
+        else
+        {
+            //Lower the power in steps while the target is kept
+            pwr -= p_cfg->pwr_step_db * ((m - target) / p_cfg->pwr_step_db);
+            if(pwr < p_cfg->min_pwr_dbm)
+            {
+                pwr = p_cfg->min_pwr_dbm;
+            }
+        }
+    }
+
+    if((pwr == p_link->pwr_dbm) && (rate_idx == p_link->rate_idx))
+    {
+        return false;
+    }
+    p_link->pwr_dbm = pwr;
+    p_link->rate_idx = rate_idx;
+    return true;
+}
+
+bool rf_link_adapt_miss (rf_link_adapt_t * p_link)
+{
+    if(p_link->misses < 0xFF)
+    {
+        p_link->misses++;
+    }
+    if((p_link->misses < p_link->p_config->max_misses)
+            || ((p_link->pwr_dbm == p_link->p_config->max_pwr_dbm)
+                    && (p_link->rate_idx == 0)))
+    {
+        return false;
+    }
+    p_link->pwr_dbm = p_link->p_config->max_pwr_dbm;
+    p_link->rate_idx = 0;
+    return true;
+}
+
+int8_t rf_link_adapt_pwr (const rf_link_adapt_t * p_link)
+{
+    return p_link->pwr_dbm;
+}
+
+uint32_t rf_link_adapt_bitrate (const rf_link_adapt_t * p_link)
+{
+    return p_link->p_config->p_rates[p_link->rate_idx].bitrate;
+}
+
+uint32_t rf_link_feedback_put (uint8_t * p_payload, uint32_t entries,
+        uint16_t dev_id, uint8_t seq, int8_t rssi_dbm, uint8_t cmd)
+{
+    uint8_t * p_entry = &p_payload[entries * RF_LINK_FEEDBACK_ENTRY_LEN];
+
+    p_entry[0] = (dev_id >> 8) & 0xFF;
+    p_entry[1] = dev_id & 0xFF;
+    p_entry[2] = seq;
+    p_entry[3] = (uint8_t) rssi_dbm;
+    p_entry[4] = cmd;
+    return (entries + 1) * RF_LINK_FEEDBACK_ENTRY_LEN;
+}
+
+bool rf_link_feedback_find (const uint8_t * p_payload, uint32_t len,
+        uint16_t dev_id, uint8_t seq, int8_t * p_rssi_dbm, uint8_t * p_cmd)
+{
+    for(uint32_t i = 0; (i + RF_LINK_FEEDBACK_ENTRY_LEN) <= len;
+            i += RF_LINK_FEEDBACK_ENTRY_LEN)
+    {
+        if((((p_payload[i] << 8) | p_payload[i + 1]) == dev_id)
+                && (p_payload[i + 2] == seq))
+        {
+            *p_rssi_dbm = (int8_t) p_payload[i + 3];
+            *p_cmd = p_payload[i + 4];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,168 @@
+/*
+ *  rf_link_adapt.h : Adaptation of the TX power and bit rate of a node
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_rf_link_adapt RF link adaptation
+ * @brief Chooses the TX power and bit rate of a node from the RSSI of its
+ *  packets at the gateway, which the gateway sends back in a feedback
+ *  packet. The link margin is the RSSI above the sensitivity of the bit
+ *  rate. When the margin is below the target the power is raised, and
+ *  when at the maximum power the next more robust bit rate is used. When
+ *  the margin is the target plus the hysteresis or more, the next faster
+ *  bit rate is used if it would have that margin too, else the power is
+ *  lowered to keep the target margin. After a number of consecutive
+ *  feedbacks missed the maximum power and the most robust rate are used.
+ *
+ *  The feedback packet of the gateway has the type
+ *  @ref RF_LINK_FEEDBACK_PKT_TYPE and an entry for each of the last
+ *  packets it received, with the device ID and sequence number of the
+ *  packet, its RSSI and a command for the node, so that it also
+ *  acknowledges the packets and carries commands to the nodes.
+ * @{
+ */
+
+#ifndef RF_LINK_ADAPT_H
+#define RF_LINK_ADAPT_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** Packet type of the feedback packet sent by the gateway */
+#define RF_LINK_FEEDBACK_PKT_TYPE       0x80
+/** Length of an entry in the feedback packet: Dev ID (2B), Seq, RSSI, Cmd */
+#define RF_LINK_FEEDBACK_ENTRY_LEN      5
+/** Maximum entries in a feedback packet */
+#define RF_LINK_FEEDBACK_MAX_ENTRIES    2
+
+/** A bit rate the node can use */
+typedef struct
+{
+    /** Bit rate in bps */
+    uint32_t bitrate;
+    /** Sensitivity of the gateway at the bit rate in dBm */
+    int16_t sensitivity_dbm;
+}rf_link_adapt_rate_t;
+
+/** Configuration of the link adaptation */
+typedef struct
+{
+    /** Lowest TX power in dBm */
+    int8_t min_pwr_dbm;
+    /** Highest TX power in dBm */
+    int8_t max_pwr_dbm;
+    /** Step of the TX power in dB */
+    uint8_t pwr_step_db;
+    /** Link margin in dB to be kept above the sensitivity */
+    uint8_t target_margin_db;
+    /** Margin in dB more than the target needed to lower the power or to
+     *  use a faster rate, at least the power step */
+    uint8_t hysteresis_db;
+    /** Consecutive feedbacks missed before falling back */
+    uint8_t max_misses;
+    /** The bit rates from the most robust to the fastest */
+    const rf_link_adapt_rate_t * p_rates;
+    /** Number of bit rates, at least 1 */
+    uint32_t rate_count;
+}rf_link_adapt_config_t;
+
+/** State of the link adaptation of a node */
+typedef struct
+{
+    const rf_link_adapt_config_t * p_config;
+    /** TX power in dBm */
+    int8_t pwr_dbm;
+    /** Index of the bit rate in the configuration */
+    uint8_t rate_idx;
+    /** Consecutive feedbacks missed */
+    uint8_t misses;
+}rf_link_adapt_t;
+
+/**
+ * @brief Start the link adaptation at the maximum power and the most
+ *  robust rate
+ * @param p_link The state
+ * @param p_config The configuration, which must remain valid
+ */
+void rf_link_adapt_init (rf_link_adapt_t * p_link,
+        const rf_link_adapt_config_t * p_config);
+
+/**
+ * @brief Update the power and rate with the RSSI of a packet at the gateway
+ * @param p_link The state
+ * @param rssi_dbm RSSI in dBm of the packet sent with the current power
+ *  and rate
+ * @return True if the power or the rate changed
+ */
+bool rf_link_adapt_feedback (rf_link_adapt_t * p_link, int8_t rssi_dbm);
+
+/**
+ * @brief Record that no feedback was received for a packet
+ * @param p_link The state
+ * @return True if the power or the rate changed
+ */
+bool rf_link_adapt_miss (rf_link_adapt_t * p_link);
+
+/**
+ * @brief Get the TX power to use
+ * @param p_link The state
+ * @return TX power in dBm
+ */
+int8_t rf_link_adapt_pwr (const rf_link_adapt_t * p_link);
+
+/**
+ * @brief Get the bit rate to use
+ * @param p_link The state
+ * @return Bit rate in bps
+ */
+uint32_t rf_link_adapt_bitrate (const rf_link_adapt_t * p_link);
+
+/**
+ * @brief Add an entry to the payload of a feedback packet
+ * @param p_payload The payload after the rf_comm header
+ * @param entries Number of entries already in the payload
+ * @param dev_id Device ID of the packet received
+ * @param seq Sequence number of the packet received
+ * @param rssi_dbm RSSI of the packet received
+ * @param cmd Command for the node, 0 if none
+ * @return Length of the payload with the entry added
+ */
+uint32_t rf_link_feedback_put (uint8_t * p_payload, uint32_t entries,
+        uint16_t dev_id, uint8_t seq, int8_t rssi_dbm, uint8_t cmd);
+
+/**
+ * @brief Find the entry of a packet in the payload of a feedback packet
+ * @param p_payload The payload after the rf_comm header
+ * @param len Length of the payload
+ * @param dev_id Device ID of the packet sent
+ * @param seq Sequence number of the packet sent
+ * @param p_rssi_dbm Filled with the RSSI of the packet at the gateway
+ * @param p_cmd Filled with the command for the node, 0 if none
+ * @return True if the entry is found
+ */
+bool rf_link_feedback_find (const uint8_t * p_payload, uint32_t len,
+        uint16_t dev_id, uint8_t seq, int8_t * p_rssi_dbm, uint8_t * p_cmd);
+
+#endif /* RF_LINK_ADAPT_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,104 @@
+/*
+ *  rf_link_arq.c : Retransmission of the packets of a node till acknowledged
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rf_link_arq.h"
+#include "random_num.h"
+#include "string.h"
+
+void rf_link_arq_init (rf_link_arq_t * p_arq,
+        const rf_link_arq_config_t * p_config)
+{
+    memset (p_arq, 0, sizeof(rf_link_arq_t));
+    p_arq->p_config = p_config;
+}
+
+void rf_link_arq_sent (rf_link_arq_t * p_arq)
+{
+    if(p_arq->is_busy)
+    {
+        p_arq->stats.dropped++;
+    }
+    p_arq->stats.sent++;
+    p_arq->retries = 0;
+    p_arq->ticks_left = 0;
+    p_arq->is_busy = true;
+}
+
+void rf_link_arq_acked (rf_link_arq_t * p_arq)
+{
+    if(p_arq->is_busy && (p_arq->ticks_left == 0))
+    {
+        p_arq->stats.acked++;
+        p_arq->is_busy = false;
+    }
+}
+
+bool rf_link_arq_missed (rf_link_arq_t * p_arq)
+{
+    const rf_link_arq_config_t * p_cfg = p_arq->p_config;
+    uint32_t window;
+
+    if((p_arq->is_busy == false) || (p_arq->ticks_left != 0))
+    {
+        return false;
+    }
+    if(p_arq->retries >= p_cfg->max_retries)
+    {
+        p_arq->stats.dropped++;
+        p_arq->is_busy = false;
+        return false;
+    }
+    //Shifted in steps so that it can't overflow with many retries
+    window = p_cfg->min_backoff;
+    for(uint32_t i = 0; (i < p_arq->retries) && (window < p_cfg->max_backoff); i++)
+    {
+        window <<= 1;
+    }
+    if(window > p_cfg->max_backoff)
+    {
+        window = p_cfg->max_backoff;
+    }
+    //Between half the window and the window, and at least a tick
+    p_arq->ticks_left = (window + 1)/2 + random_num_below (window/2 + 1);
+    if(p_arq->ticks_left == 0)
+    {
+        p_arq->ticks_left = 1;
+    }
+    return true;
+}
+
+bool rf_link_arq_tick (rf_link_arq_t * p_arq)
+{
+    if(p_arq->ticks_left == 0)
+    {
+        return false;
+    }
+    p_arq->ticks_left--;
+    if(p_arq->ticks_left != 0)
+    {
+        return false;
+    }
+    p_arq->retries++;
+    p_arq->stats.retries++;
+    return true;
+}
+
+bool rf_link_arq_is_busy (const rf_link_arq_t * p_arq)
+{
+    return p_arq->is_busy;
+}
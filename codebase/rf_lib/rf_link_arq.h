@@ -0,0 +1,142 @@
+/*
+ *  rf_link_arq.h : Retransmission of the packets of a node till acknowledged
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_rf_link_arq RF link retransmission
+ * @brief Automatic repeat request of the packets of a node to the gateway.
+ *  The first byte of the payload after the rf_comm header has the flags of
+ *  the link. A packet with @ref RF_LINK_FLAG_ACK_REQ is acknowledged by the
+ *  gateway at once with its entry in the feedback packet of
+ *  @ref group_rf_link_adapt. When the ack is missed the node sends the
+ *  packet again with @ref rf_comm_pkt_resend after a backoff, which is
+ *  random between half and all of a window that doubles with each retry
+ *  up to a maximum. After the maximum retries the packet is given up.
+ *
+ *  A packet sent again has the same sequence number and
+ *  @ref RF_LINK_FLAG_RETX, so that the gateway acks it again but drops it
+ *  if it got the packet before, with the last sequence number of each node
+ *  in @ref group_rf_link_table. The backoff is in ticks of the caller,
+ *  which calls @ref rf_link_arq_tick every tick.
+ * @{
+ */
+
+#ifndef RF_LINK_ARQ_H
+#define RF_LINK_ARQ_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** Position of the flags in the payload after the rf_comm header */
+#define RF_LINK_FLAGS_POS       0
+/** The node listens for the ack of the packet */
+#define RF_LINK_FLAG_ACK_REQ    0x01
+/** The packet is sent again as its ack was missed */
+#define RF_LINK_FLAG_RETX       0x02
+
+/** Configuration of the retransmissions */
+typedef struct
+{
+    /** Times a packet is sent again before it is given up */
+    uint8_t max_retries;
+    /** Backoff window before the first retry in ticks, at least 1 */
+    uint16_t min_backoff;
+    /** Largest backoff window in ticks */
+    uint16_t max_backoff;
+}rf_link_arq_config_t;
+
+/** Counts of the packets, which wrap around */
+typedef struct
+{
+    /** New packets sent */
+    uint32_t sent;
+    /** Packets sent again */
+    uint32_t retries;
+    /** Packets acknowledged */
+    uint32_t acked;
+    /** Packets given up after the maximum retries */
+    uint32_t dropped;
+}rf_link_arq_stats_t;
+
+/** State of the retransmissions of a node */
+typedef struct
+{
+    const rf_link_arq_config_t * p_config;
+    /** Retries of the current packet */
+    uint8_t retries;
+    /** Waiting for an ack, or for the end of the backoff if ticks_left */
+    bool is_busy;
+    /** Ticks till the current packet is sent again, 0 if not in backoff */
+    uint16_t ticks_left;
+    rf_link_arq_stats_t stats;
+}rf_link_arq_t;
+
+/**
+ * @brief Start with no packet waiting for an ack
+ * @param p_arq The state
+ * @param p_config The configuration, which must remain valid
+ */
+void rf_link_arq_init (rf_link_arq_t * p_arq,
+        const rf_link_arq_config_t * p_config);
+
+/**
+ * @brief Record that a new packet is sent, which waits for its ack. A
+ *  packet waiting for its ack or in backoff is given up.
+ * @param p_arq The state
+ */
+void rf_link_arq_sent (rf_link_arq_t * p_arq);
+
+/**
+ * @brief Record that the ack of the current packet is got
+ * @param p_arq The state
+ */
+void rf_link_arq_acked (rf_link_arq_t * p_arq);
+
+/**
+ * @brief Record that the ack of the current packet was missed, or that the
+ *  packet couldn't be sent, and start the backoff
+ * @param p_arq The state
+ * @return True if the packet is to be sent again after the backoff, false
+ *  if it is given up
+ */
+bool rf_link_arq_missed (rf_link_arq_t * p_arq);
+
+/**
+ * @brief Count a tick of the backoff
+ * @param p_arq The state
+ * @return True if the backoff is over and the packet is to be sent again
+ *  now, with @ref RF_LINK_FLAG_RETX
+ */
+bool rf_link_arq_tick (rf_link_arq_t * p_arq);
+
+/**
+ * @brief Check if the current packet waits for its ack or its retry, in
+ *  which case a new packet would give it up
+ * @param p_arq The state
+ * @return True if busy with the current packet
+ */
+bool rf_link_arq_is_busy (const rf_link_arq_t * p_arq);
+
+#endif /* RF_LINK_ARQ_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,295 @@
+/*
+ *  rf_link_table.c : Link quality of the nodes heard by a gateway
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rf_link_table.h"
+#include "stddef.h"
+#include "string.h"
+
+#if ((RF_LINK_TABLE_BUCKETS & (RF_LINK_TABLE_BUCKETS - 1)) != 0)
+#error "RF_LINK_TABLE_BUCKETS must be a power of 2"
+#endif
+
+/** Marks the end of a list of slots */
+#define SLOT_NONE       0xFFFF
+
+/** A sequence number more than this after the last is taken as a restart
+ *  of the node instead of lost packets */
+#define MAX_SEQ_GAP     127
+
+/** A slot of the table, in the chain of its hash bucket and in the list
+ *  from the most to the least recently heard */
+typedef struct
+{
+    rf_link_stats_t stats;
+    uint16_t hash_next;
+    uint16_t lru_prev;
+    uint16_t lru_next;
+    bool is_used;
+    /** Command for the node, 0 if none */
+    uint8_t cmd;
+    /** The command was put in an ack */
+    bool is_cmd_sent;
+    /** The frequency offset has an estimate */
+    bool is_freq_off_set;
+}slot_t;
+
+static slot_t slots[RF_LINK_TABLE_SIZE];
+static uint16_t buckets[RF_LINK_TABLE_BUCKETS];
+
+/** The most and least recently heard slots */
+static uint16_t lru_head, lru_tail;
+/** The next slot never used */
+static uint32_t slots_used;
+static uint32_t evictions;
+
+static uint32_t hash (uint16_t dev_id)
+{
+    //Fibonacci hashing, as the device IDs are often consecutive
+    return (((uint32_t) dev_id * 2654435769u) >> 16) & (RF_LINK_TABLE_BUCKETS - 1);
+}
+
+static void lru_unlink (uint16_t idx)
+{
+    slot_t * s = &slots[idx];
+
+    if(s->lru_prev != SLOT_NONE)
+    {
+        slots[s->lru_prev].lru_next = s->lru_next;
+    }
+    else
+    {
+        lru_head = s->lru_next;
+    }
+    if(s->lru_next != SLOT_NONE)
+    {
+        slots[s->lru_next].lru_prev = s->lru_prev;
+    }
+    else
+    {
+        lru_tail = s->lru_prev;
+    }
+}
+
+static void lru_push_head (uint16_t idx)
+{
+    slots[idx].lru_prev = SLOT_NONE;
+    slots[idx].lru_next = lru_head;
+    if(lru_head != SLOT_NONE)
+    {
+        slots[lru_head].lru_prev = idx;
+    }
+    lru_head = idx;
+    if(lru_tail == SLOT_NONE)
+    {
+        lru_tail = idx;
+    }
+}
+
+static void hash_remove (uint16_t idx)
+{
+    uint16_t * p_link = &buckets[hash (slots[idx].stats.dev_id)];
+
+    while(*p_link != idx)
+    {
+        p_link = &slots[*p_link].hash_next;
+    }
+    *p_link = slots[idx].hash_next;
+}
+
+static uint16_t find_slot (uint16_t dev_id)
+{
+    uint16_t idx = buckets[hash (dev_id)];
+
+    while((idx != SLOT_NONE) && (slots[idx].stats.dev_id != dev_id))
+    {
+        idx = slots[idx].hash_next;
+    }
+    return idx;
+}
+
+/** Get a slot for a new node, replacing the least recently heard if full */
+static uint16_t new_slot (uint16_t dev_id)
+{
+    uint16_t idx;
+    uint32_t bucket = hash (dev_id);
+
+    if(slots_used < RF_LINK_TABLE_SIZE)
+    {
+        idx = slots_used++;
+    }
+    else
+    {
+        idx = lru_tail;
+        lru_unlink (idx);
+        hash_remove (idx);
+        evictions++;
+    }
+    memset (&slots[idx].stats, 0, sizeof(rf_link_stats_t));
+    slots[idx].stats.dev_id = dev_id;
+    slots[idx].is_used = true;
+    slots[idx].cmd = 0;
+    slots[idx].is_cmd_sent = false;
+    slots[idx].is_freq_off_set = false;
+    slots[idx].hash_next = buckets[bucket];
+    buckets[bucket] = idx;
+    lru_push_head (idx);
+    return idx;
+}
+
+void rf_link_table_init (void)
+{
+    memset (slots, 0, sizeof(slots));
+    memset (buckets, 0xFF, sizeof(buckets));
+    lru_head = SLOT_NONE;
+    lru_tail = SLOT_NONE;
+    slots_used = 0;
+    evictions = 0;
+}
+
+const rf_link_stats_t * rf_link_table_update (uint16_t dev_id, uint8_t app_id,
+        uint8_t seq, int8_t rssi, uint8_t lqi, uint32_t now)
+{
+    uint16_t idx = find_slot (dev_id);
+    rf_link_stats_t * p;
+
+    if(idx == SLOT_NONE)
+    {
+        idx = new_slot (dev_id);
+        p = &slots[idx].stats;
+        p->rssi_x16 = rssi * 16;
+        p->lqi_x16 = lqi * 16;
+    }
+    else
+    {
+        uint8_t gap = seq - slots[idx].stats.last_seq;
+
+        if(idx != lru_head)
+        {
+            lru_unlink (idx);
+            lru_push_head (idx);
+        }
+        p = &slots[idx].stats;
+        if(gap == 0)
+        {
+            p->dup_count++;
+            p->last_seen = now;
+            return p;
+        }
+        if(gap <= MAX_SEQ_GAP)
+        {
+            p->lost_count += gap - 1;
+        }
+        if(slots[idx].is_cmd_sent)
+        {
+            slots[idx].cmd = 0;
+            slots[idx].is_cmd_sent = false;
+        }
+        p->rssi_x16 += ((rssi * 16) - p->rssi_x16) / (1 << RF_LINK_EWMA_SHIFT);
+        p->lqi_x16 += ((int32_t) (lqi * 16) - p->lqi_x16) / (1 << RF_LINK_EWMA_SHIFT);
+    }
+    p->app_id = app_id;
+    p->last_seq = seq;
+    p->rx_count++;
+    p->last_seen = now;
+    return p;
+}
+
+bool rf_link_table_is_dup (uint16_t dev_id, uint8_t seq)
+{
+    uint16_t idx = find_slot (dev_id);
+    return (idx != SLOT_NONE) && (slots[idx].stats.last_seq == seq);
+}
+
+bool rf_link_table_cmd_set (uint16_t dev_id, uint8_t cmd)
+{
+    uint16_t idx = find_slot (dev_id);
+
+    if(idx == SLOT_NONE)
+    {
+        return false;
+    }
+    slots[idx].cmd = cmd;
+    slots[idx].is_cmd_sent = false;
+    return true;
+}
+
+uint8_t rf_link_table_cmd_get (uint16_t dev_id)
+{
+    uint16_t idx = find_slot (dev_id);
+
+    if((idx == SLOT_NONE) || (slots[idx].cmd == 0))
+    {
+        return 0;
+    }
+    slots[idx].is_cmd_sent = true;
+    return slots[idx].cmd;
+}
+
+bool rf_link_table_freq_update (uint16_t dev_id, int32_t freq_off_hz)
+{
+    uint16_t idx = find_slot (dev_id);
+    rf_link_stats_t * p;
+
+    if(idx == SLOT_NONE)
+    {
+        return false;
+    }
+    p = &slots[idx].stats;
+    if(slots[idx].is_freq_off_set)
+    {
+        p->freq_off_hz += (freq_off_hz - p->freq_off_hz) / (1 << RF_LINK_EWMA_SHIFT);
+    }
+    else
+    {
+        p->freq_off_hz = freq_off_hz;
+        slots[idx].is_freq_off_set = true;
+    }
+    return true;
+}
+
+const rf_link_stats_t * rf_link_table_find (uint16_t dev_id)
+{
+    uint16_t idx = find_slot (dev_id);
+    return (idx == SLOT_NONE) ? NULL : &slots[idx].stats;
+}
+
+bool rf_link_table_read (uint32_t slot, rf_link_stats_t * p_stats)
+{
+    if((slot >= RF_LINK_TABLE_SIZE) || (slots[slot].is_used == false))
+    {
+        return false;
+    }
+    memcpy (p_stats, &slots[slot].stats, sizeof(rf_link_stats_t));
+    return true;
+}
+
+uint32_t rf_link_table_count (void)
+{
+    return slots_used;
+}
+
+uint32_t rf_link_table_evictions (void)
+{
+    return evictions;
+}
+
+uint32_t rf_link_loss_pct (const rf_link_stats_t * p_stats)
+{
+    uint32_t sent = p_stats->rx_count + p_stats->lost_count;
+    return (sent == 0) ? 0 : ((100 * p_stats->lost_count) / sent);
+}
@@ -0,0 +1,187 @@
+/*
+ *  rf_link_table.h : Link quality of the nodes heard by a gateway
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_rf_link_table RF link table
+ * @brief Table of the link quality of each node heard by a gateway, with
+ *  a smoothed RSSI and LQI, the count of packets received, the packets
+ *  lost from the gaps in the sequence numbers and the time last heard.
+ *  A node is found in constant time with a hash of its device ID. When
+ *  the table is full the node heard least recently is replaced.
+ *
+ *  The last sequence number of each node filters the packets a node sends
+ *  again when it missed the ack, and a command can be kept for a node to
+ *  be sent in the acks to it. The frequency offset of each node as
+ *  estimated by the radio is smoothed, to follow the drift of the crystals.
+ *
+ *  The module doesn't disable interrupts, the caller must not update the
+ *  table from one interrupt level while reading it from another.
+ * @{
+ */
+
+#ifndef RF_LINK_TABLE_H
+#define RF_LINK_TABLE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+/** Number of nodes in the table, less than 0xFFFF */
+#ifndef RF_LINK_TABLE_SIZE
+#define RF_LINK_TABLE_SIZE      256
+#endif
+
+/** Number of the hash buckets, a power of 2 */
+#ifndef RF_LINK_TABLE_BUCKETS
+#define RF_LINK_TABLE_BUCKETS   256
+#endif
+
+/** The RSSI and LQI are smoothed with a weight of 1/2^this for a packet */
+#ifndef RF_LINK_EWMA_SHIFT
+#define RF_LINK_EWMA_SHIFT      3
+#endif
+
+/** The link quality of a node */
+typedef struct
+{
+    /** Device ID of the node */
+    uint16_t dev_id;
+    /** Application ID in the last packet of the node */
+    uint8_t app_id;
+    /** Sequence number of the last packet */
+    uint8_t last_seq;
+    /** Smoothed RSSI in 1/16 dBm */
+    int16_t rssi_x16;
+    /** Smoothed LQI in 1/16, lower is better */
+    uint16_t lqi_x16;
+    /** Packets received */
+    uint32_t rx_count;
+    /** Packets lost as found from the gaps in the sequence numbers */
+    uint32_t lost_count;
+    /** Packets received again, with the same sequence number as the last */
+    uint32_t dup_count;
+    /** Time the node was last heard, in the units given by the caller */
+    uint32_t last_seen;
+    /** Smoothed offset in Hz of the frequency of the node above that of
+     *  the gateway, what is left after the node's own correction */
+    int32_t freq_off_hz;
+}rf_link_stats_t;
+
+/**
+ * @brief Clear the table
+ */
+void rf_link_table_init (void);
+
+/**
+ * @brief Update the statistics of a node with a packet received from it
+ * @param dev_id Device ID of the node
+ * @param app_id Application ID in the packet
+ * @param seq Sequence number of the packet
+ * @param rssi RSSI of the packet in dBm
+ * @param lqi LQI of the packet
+ * @param now The current time, in s or any other unit
+ * @return The statistics of the node after the update
+ */
+const rf_link_stats_t * rf_link_table_update (uint16_t dev_id, uint8_t app_id,
+        uint8_t seq, int8_t rssi, uint8_t lqi, uint32_t now);
+
+/**
+ * @brief Check if a packet has the sequence number of the last packet of
+ *  its node, to be called before @ref rf_link_table_update
+ * @param dev_id Device ID of the node
+ * @param seq Sequence number of the packet
+ * @return True if the node is in the table and the packet was received
+ */
+bool rf_link_table_is_dup (uint16_t dev_id, uint8_t seq);
+
+/**
+ * @brief Keep a command for a node to be sent in the acks to it. The
+ *  command is sent in the acks of the next packet of the node and cleared
+ *  when the node sends a packet with another sequence number, as it then
+ *  got the ack or gave up the packet.
+ * @param dev_id Device ID of the node
+ * @param cmd The command, 0 to clear it
+ * @return True if the node is in the table
+ */
+bool rf_link_table_cmd_set (uint16_t dev_id, uint8_t cmd);
+
+/**
+ * @brief Get the command for a node to be sent in an ack, after
+ *  @ref rf_link_table_update with the packet acked
+ * @param dev_id Device ID of the node
+ * @return The command, 0 if none
+ */
+uint8_t rf_link_table_cmd_get (uint16_t dev_id);
+
+/**
+ * @brief Smooth the frequency offset of a node with the estimate for a
+ *  packet, after @ref rf_link_table_update with the packet. The first
+ *  estimate of a node is taken as it is.
+ * @param dev_id Device ID of the node
+ * @param freq_off_hz Offset in Hz of the node above the gateway
+ * @return True if the node is in the table
+ */
+bool rf_link_table_freq_update (uint16_t dev_id, int32_t freq_off_hz);
+
+/**
+ * @brief Find the statistics of a node
+ * @param dev_id Device ID of the node
+ * @return The statistics, NULL if the node isn't in the table
+ */
+const rf_link_stats_t * rf_link_table_find (uint16_t dev_id);
+
+/**
+ * @brief Copy the statistics of a node in a slot of the table, such as to
+ *  go through all the nodes for a summary
+ * @param slot The slot, less than @ref RF_LINK_TABLE_SIZE
+ * @param p_stats Filled with the statistics
+ * @return True if there is a node in the slot
+ */
+bool rf_link_table_read (uint32_t slot, rf_link_stats_t * p_stats);
+
+/**
+ * @brief Get the number of nodes in the table
+ * @return The number of nodes
+ */
+uint32_t rf_link_table_count (void);
+
+/**
+ * @brief Get the number of nodes replaced as the table was full
+ * @return The number of nodes replaced since the init
+ */
+uint32_t rf_link_table_evictions (void);
+
+/**
+ * @brief Get the packets lost of a node in percent
+ * @param p_stats The statistics of the node
+ * @return The packets lost out of the packets sent in percent
+ */
+uint32_t rf_link_loss_pct (const rf_link_stats_t * p_stats);
+
+#endif /* RF_LINK_TABLE_H */
+
+/**
+ * @}
+ * @}
+ */
@@ -19,9 +19,17 @@
 #include "hal_spim.h"
 #include "rf_spi_hw.h"
 #include "hal_gpio.h"
+#include "hal_nop_delay.h"
+
+/** Time in us between the reads of the SO line while waiting for the chip */
+#define READY_POLL_US   10
+
+static uint32_t g_csn_pin, g_miso_pin;
 
 uint32_t rf_spi_init (rf_spi_init_t * p_spi_init)
 {
+    g_csn_pin = p_spi_init->csn_pin;
+    g_miso_pin = p_spi_init->miso_pin;
     hal_gpio_cfg_output (p_spi_init->csn_pin, 1);
     hal_gpio_cfg_output (p_spi_init->sclk_pin, 0);
     hal_gpio_cfg_input (p_spi_init->miso_pin, HAL_GPIO_PULL_DISABLED);
@@ -40,3 +48,19 @@ uint32_t rf_spi_init (rf_spi_init_t * p_spi_init)
     hal_spim_init (&spim_init);
     return 0;
 }
+
+uint32_t rf_spi_wait_ready (uint32_t timeout_us)
+{
+    uint32_t waited_us = 0;
+    uint32_t is_busy;
+
+    hal_gpio_pin_clear (g_csn_pin);
+    while((is_busy = hal_gpio_pin_read (g_miso_pin)) && (waited_us < timeout_us))
+    {
+        hal_nop_delay_us (READY_POLL_US);
+        waited_us += READY_POLL_US;
+    }
+    //SO is released once CSn is high
+    hal_gpio_pin_set (g_csn_pin);
+    return is_busy ? 1 : 0;
+}
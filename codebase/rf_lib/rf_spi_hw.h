@@ -37,4 +37,15 @@ typedef struct
  */
 uint32_t rf_spi_init (rf_spi_init_t * p_spi_init);
 
+/**
+ * @brief Function to wake the chip from sleep with CSn low and wait till it
+ *  is ready, which it shows by pulling its SO (MISO) line low once its
+ *  crystal is stable
+ * @param timeout_us Maximum time in us to wait for the chip
+ * @return Status
+ * @retval 0 The chip is ready
+ * @retval 1 The chip wasn't ready in the timeout
+ */
+uint32_t rf_spi_wait_ready (uint32_t timeout_us);
+
 #endif /* RF_SPI_HW_H */
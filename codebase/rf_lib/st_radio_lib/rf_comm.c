@@ -0,0 +1,1146 @@
+/*
+ *  rf_comm.c : rf_comm for the ST S2-LP
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The packets are in the basic format of the S2-LP with a length byte
+ * inserted by the radio and a 16 bit CRC. Packets with a bad CRC are
+ * dropped by the radio, so the packets given to the application always
+ * have crc_ok set. All the events are on the nIRQ output on GPIO0, and the
+ * interrupt handler drains the RX FIFO into the RX buffer as each packet
+ * ends, or at RF_COMM_RX_FIFO_THR bytes during a long packet.
+ *
+ * The low power listen mode uses the LDC mode: the radio sleeps and its
+ * wake up timer starts RX every interval, for RF_COMM_SNIFF_US unless the
+ * carrier sense stops the RX timer. The long preamble of
+ * rf_comm_pkt_send_wake is set in the preamble length, so the listen
+ * interval is at most 2046 bits at the bit rate, 6.8 s at 300 bps.
+ *
+ * The CSMA does each clear channel check with the CSMA engine of the radio
+ * with no backoff of its own, which listens for 64 bit periods and sends
+ * only if the RSSI stays below the threshold. The backoffs between the
+ * checks are timed with MS_TIMER_USED_RF_COMM as with the CC112x.
+ */
+
+#include "string.h"
+
+#include "spi_s2lp_nrf52.h"
+#include "rf_comm.h"
+#include "s2lp_def.h"
+#include "hal_gpio.h"
+#include "nrf.h"
+#include "isr_dispatch.h"
+#include "log.h"
+#include "hal_nop_delay.h"
+#include "ms_timer.h"
+#include "random_num.h"
+
+#ifndef RF_XTAL_FREQ
+#define RF_XTAL_FREQ 50000000
+#endif
+
+#if ISR_MANAGER == 1
+#include "isr_manager.h"
+#endif
+
+#define GPIOTE_USED0 GPIOTE_CH_USED_RF_COMM_0
+
+/** Time in us for which the radio sniffs for a carrier at each wake up of
+ *  the listen mode */
+#ifndef RF_COMM_SNIFF_US
+#define RF_COMM_SNIFF_US       1000
+#endif
+
+/** The digital clock is the XO divided by 2 when the XO is above 30 MHz */
+#define DIG_DIV_THRESHOLD      30000000
+#if (RF_XTAL_FREQ > DIG_DIV_THRESHOLD)
+#define RF_DIG_FREQ            (RF_XTAL_FREQ/2)
+#else
+#define RF_DIG_FREQ            RF_XTAL_FREQ
+#endif
+
+/** Frequency of the RCO of the wake up timer, calibrated to the XO */
+#define RF_RCO_FREQ            (RF_DIG_FREQ/750)
+
+/** Lowest frequency in kHz of the high band, with the VCO divided by 4.
+ *  Below it is the middle band with the VCO divided by 8 */
+#define HIGH_BAND_MIN_KHZ      826000
+#define HIGH_BAND_FACTOR       4
+#define MIDDLE_BAND_FACTOR     8
+/** VCO frequency in kHz above which the lower charge pump current is used */
+#define VCO_CENTER_KHZ         3600000
+
+/** The IF of 300 kHz for the analog and digital clocks */
+#define IF_OFFSET_ANA          ((uint8_t) ((((300000ULL << 13) * 3) / RF_XTAL_FREQ) - 100))
+#define IF_OFFSET_DIG          ((uint8_t) ((((300000ULL << 13) * 3) / RF_DIG_FREQ) - 100))
+
+/** Sync word of 32 bits, the same as the CC112x backend */
+#define SYNC_BITS              32
+/** Pairs of bits of the preamble of a normal send and the most possible */
+#define PREAMBLE_PAIRS         16
+#define PREAMBLE_PAIRS_MAX     1023
+
+/** The offset of the RSSI in dBm from the RSSI registers */
+#define RSSI_OFFSET            146
+/** The status bytes kept after a packet received, RSSI and CRC_OK|LQI */
+#define RX_STATUS_LEN          2
+/** Set in the status byte of the packets, all of which have a good CRC */
+#define CRC_OK                 0x80
+/** The SQI of a sync word without errors. The LQI given is the SQI below it */
+#define SQI_MAX                (2*SYNC_BITS)
+/** Position in the RX buffer when no packet is being received */
+#define RX_NO_PKT              0xFFFFFFFF
+
+/** Reset values of the registers with a field changed */
+#define XO_RCO_CONF1_DEFAULT   0x6C
+#define XO_RCO_CONF0_DEFAULT   0x30
+#define PM_CONF0_DEFAULT       0x42
+
+/** Time in us between the reads of the state and the most to wait for one */
+#define STATE_POLL_US          50
+#define STATE_TIMEOUT_US       5000
+
+/** The events which pull nIRQ low */
+#define IRQ_USED   (S2LP_IRQ_RX_DATA_READY | S2LP_IRQ_RX_DATA_DISC  \
+                    | S2LP_IRQ_TX_DATA_SENT | S2LP_IRQ_TX_FIFO_ERROR \
+                    | S2LP_IRQ_RX_FIFO_ERROR | S2LP_IRQ_RX_FIFO_ALMOST_FULL \
+                    | S2LP_IRQ_MAX_BO_CCA_REACH)
+
+static const s2lp_reg_setting_t default_setting[] =
+{
+    {S2LP_GPIO0_CONF,       S2LP_GPIO_NIRQ | S2LP_GPIO_MODE_OUT_LP},
+    {S2LP_IF_OFFSET_ANA,    IF_OFFSET_ANA},
+    {S2LP_IF_OFFSET_DIG,    IF_OFFSET_DIG},
+    {S2LP_PCKTCTRL6,        (SYNC_BITS << S2LP_PCKTCTRL6_SYNC_LEN_Pos)},
+    {S2LP_PCKTCTRL5,        PREAMBLE_PAIRS},
+    {S2LP_PCKTCTRL4,        0x00}, //1 byte length, no address
+    {S2LP_PCKTCTRL3,        0x00}, //Basic packet through the FIFOs
+    {S2LP_PCKTCTRL2,        S2LP_PCKTCTRL2_VAR_LEN},
+    {S2LP_PCKTCTRL1,        S2LP_PCKTCTRL1_CRC_16_8005},
+    {S2LP_SYNC3,            0x93},
+    {S2LP_SYNC2,            0x0B},
+    {S2LP_SYNC1,            0x51},
+    {S2LP_SYNC0,            0xDE},
+    {S2LP_PCKT_FLT_OPTIONS, S2LP_PCKT_FLT_RX_TIMEOUT_OR | S2LP_PCKT_FLT_CRC},
+    {S2LP_PROTOCOL2,        S2LP_PROTOCOL2_CS_TIMEOUT_MASK},
+    {S2LP_PROTOCOL1,        0x00},
+    {S2LP_PROTOCOL0,        S2LP_PROTOCOL0_PERS_RX}, //Stay in RX after a packet
+    {S2LP_TIMERS5,          0x00}, //No RX timeout
+    {S2LP_FIFO_CONFIG3,     RF_COMM_RX_FIFO_THR},
+    {S2LP_PA_POWER0,        0x00}, //PA level of index 0, without ramping
+    {S2LP_XO_RCO_CONF0,     XO_RCO_CONF0_DEFAULT | S2LP_XO_RCO_CONF0_RCO_CALIB},
+    {S2LP_IRQ_MASK3,        (IRQ_USED >> 24) & 0xFF},
+    {S2LP_IRQ_MASK2,        (IRQ_USED >> 16) & 0xFF},
+    {S2LP_IRQ_MASK1,        (IRQ_USED >> 8) & 0xFF},
+    {S2LP_IRQ_MASK0,        IRQ_USED & 0xFF},
+};
+
+/** Channel filter bandwidths in 100 Hz for a 26 MHz digital clock, for
+ *  CHFLT_E of i/9 and CHFLT_M of i%9 */
+static const uint16_t chflt_bw[90] =
+{
+    8001, 7951, 7684, 7368, 7051, 6709, 6423, 5867, 5414,
+    4509, 4259, 4032, 3808, 3621, 3417, 3254, 2945, 2703,
+    2247, 2124, 2015, 1900, 1807, 1706, 1624, 1471, 1350,
+    1123, 1062, 1005,  950,  903,  853,  812,  735,  675,
+     561,  530,  502,  474,  451,  426,  406,  367,  337,
+     280,  265,  251,  237,  226,  213,  203,  184,  169,
+     140,  133,  126,  119,  113,  106,  101,   92,   84,
+      70,   66,   63,   59,   56,   53,   51,   46,   42,
+      35,   33,   31,   30,   28,   27,   25,   23,   21,
+      18,   17,   16,   15,   14,   13,   13,   12,   11,
+};
+
+typedef enum
+{
+    R_IDLE,
+    R_RX,
+    R_TX,
+    R_CCA,
+}radio_state_t;
+
+volatile radio_state_t g_current_state;
+
+static rf_comm_hw_t g_comm_hw;
+
+static uint8_t g_arr_pkt[260];
+
+/** Sequence number of the next packet sent */
+static uint8_t g_tx_seq = 0;
+
+/** Bit rate in bps, for the length of the long preamble */
+static uint32_t g_bitrate;
+
+/** The packets received and not yet delivered, each with its length before
+ *  and its status bytes after */
+static uint8_t g_rx_buf[RF_COMM_RX_BUF_SIZE];
+static uint32_t g_rx_buf_len = 0;
+/** Position of the length byte of the packet being received */
+static uint32_t g_rx_pkt_pos = RX_NO_PKT;
+static uint32_t g_rx_overflows = 0;
+
+/** If the radio is in the low power listen mode */
+static volatile bool g_is_listening = false;
+
+static rf_comm_csma_t g_csma;
+static rf_comm_csma_stats_t g_csma_stats;
+/** Clear channel checks done for the packet being sent */
+static uint32_t g_csma_attempts;
+/** Listen interval of the receiver of the packet being sent with the long
+ *  preamble, 0 for a normal send */
+static uint32_t g_tx_wake_ms;
+
+/** If RX was started with rf_comm_rx_window and hasn't timed out */
+static volatile bool g_is_rx_window = false;
+
+void (* gp_tx_done) (uint32_t error);
+void (* gp_rx_done) (uint32_t error);
+void (* gp_tx_failed) (uint32_t error);
+void (* gp_rx_failed) (uint32_t error);
+
+static void reg_write (uint8_t addr, uint8_t value)
+{
+    s2lp_spi_write (addr, &value, 1);
+}
+
+static uint8_t reg_read (uint8_t addr)
+{
+    uint8_t value;
+    s2lp_spi_read (addr, &value, 1);
+    return value;
+}
+
+/** Read the IRQ status, which clears it and releases nIRQ */
+static uint32_t irq_status_read (void)
+{
+    uint8_t sts[4];
+
+    s2lp_spi_read (S2LP_IRQ_STATUS3, sts, 4);
+    return (sts[0] << 24) | (sts[1] << 16) | (sts[2] << 8) | sts[3];
+}
+
+static uint32_t state_read (void)
+{
+    return reg_read (S2LP_MC_STATE0) >> S2LP_STATE_Pos;
+}
+
+static void state_wait (uint32_t state)
+{
+    for(uint32_t wait_us = 0; (state_read () != state)
+            && (wait_us < STATE_TIMEOUT_US); wait_us += STATE_POLL_US)
+    {
+        hal_nop_delay_us (STATE_POLL_US);
+    }
+}
+
+/** Go to READY from RX, TX, SLEEP or the LDC mode */
+static void ready_enter (void)
+{
+    s2lp_spi_cmd (S2LP_CMD_SABORT);
+    s2lp_spi_cmd (S2LP_CMD_READY);
+    state_wait (S2LP_STATE_READY);
+}
+
+/** The TX and RX commands, with the SMPS frequency for each */
+static void cmd_tx (void)
+{
+    reg_write (S2LP_PM_CONF3, S2LP_PM_CONF3_TX);
+    s2lp_spi_cmd (S2LP_CMD_TX);
+}
+
+static void cmd_rx (void)
+{
+    reg_write (S2LP_PM_CONF3, S2LP_PM_CONF3_RX);
+    s2lp_spi_cmd (S2LP_CMD_RX);
+}
+
+/** Set the RX timeout in us, 0 to stay in RX */
+static void rx_timer_set (uint32_t us)
+{
+    //The RX timer counts in steps of 1210 periods of the digital clock
+    uint32_t steps = (uint32_t) (((uint64_t) us * RF_DIG_FREQ) / (1210ULL * 1000000));
+    uint32_t presc;
+    uint8_t timers[2];
+
+    if((us != 0) && (steps == 0))
+    {
+        steps = 1;
+    }
+    presc = (steps > 0xFF) ? ((steps - 1) / 0xFF) : 0;
+    if(presc > 0xFF)
+    {
+        presc = 0xFF;
+    }
+    //TIMERS5 has the counter and TIMERS4 the prescaler
+    timers[0] = (steps / (presc + 1)) & 0xFF;
+    timers[1] = presc;
+    s2lp_spi_write (S2LP_TIMERS5, timers, 2);
+}
+
+static void preamble_set (uint32_t pairs)
+{
+    uint8_t pcktctrl[2];
+
+    pcktctrl[0] = (SYNC_BITS << S2LP_PCKTCTRL6_SYNC_LEN_Pos) | ((pairs >> 8) & 0x03);
+    pcktctrl[1] = pairs & 0xFF;
+    s2lp_spi_write (S2LP_PCKTCTRL6, pcktctrl, 2);
+}
+
+/** Stop the low power listen mode if it is on, leaving the radio in READY */
+static void listen_exit (void)
+{
+    if(g_is_listening)
+    {
+        g_is_listening = false;
+        ready_enter ();
+        reg_write (S2LP_PROTOCOL1, 0x00);
+        reg_write (S2LP_PROTOCOL0, S2LP_PROTOCOL0_PERS_RX);
+        reg_write (S2LP_PM_CONF0, PM_CONF0_DEFAULT);
+        rx_timer_set (0);
+    }
+}
+
+/** Stop the timer of a CSMA backoff or an RX window still pending */
+static void timer_cancel (void)
+{
+    if(g_current_state == R_CCA)
+    {
+        ms_timer_stop (MS_TIMER_USED_RF_COMM);
+        g_current_state = R_IDLE;
+    }
+    if(g_is_rx_window)
+    {
+        ms_timer_stop (MS_TIMER_USED_RF_COMM);
+        g_is_rx_window = false;
+    }
+}
+
+/** Restart RX after an overflow of the RX FIFO or the buffer */
+static void rx_restart (void)
+{
+    g_rx_overflows++;
+    g_rx_buf_len = 0;
+    g_rx_pkt_pos = RX_NO_PKT;
+    s2lp_spi_cmd (S2LP_CMD_SABORT);
+    s2lp_spi_cmd (S2LP_CMD_FLUSHRXFIFO);
+    //In the LDC mode this restarts the sniffing
+    cmd_rx ();
+}
+
+/** Read up to max bytes of the packet being received from the RX FIFO into
+ *  the buffer, after the room for its length byte */
+static bool rx_fifo_read (uint32_t max)
+{
+    uint8_t count;
+
+    count = reg_read (S2LP_RX_FIFO_STATUS) & (S2LP_FIFO_SIZE - 1);
+    if(count > max)
+    {
+        count = max;
+    }
+    if(g_rx_pkt_pos == RX_NO_PKT)
+    {
+        g_rx_pkt_pos = g_rx_buf_len;
+        g_rx_buf_len++;
+    }
+    if((count + RX_STATUS_LEN) > (RF_COMM_RX_BUF_SIZE - g_rx_buf_len))
+    {
+        rx_restart ();
+        return false;
+    }
+    if(count != 0)
+    {
+        s2lp_spi_read (S2LP_FIFO, &g_rx_buf[g_rx_buf_len], count);
+        g_rx_buf_len += count;
+    }
+    return true;
+}
+
+/** Complete the packet at its end with its length and status bytes */
+static bool rx_pkt_done (void)
+{
+    uint8_t pkt_len[2];
+    uint32_t len, read;
+    uint8_t sqi;
+
+    s2lp_spi_read (S2LP_RX_PCKT_LEN1, pkt_len, 2);
+    len = (pkt_len[0] << 8) | pkt_len[1];
+    read = (g_rx_pkt_pos == RX_NO_PKT) ? 0 : (g_rx_buf_len - g_rx_pkt_pos - 1);
+    if((len > 0xFF) || (read > len) || (rx_fifo_read (len - read) == false))
+    {
+        rx_restart ();
+        return false;
+    }
+    g_rx_buf[g_rx_pkt_pos] = g_rx_buf_len - g_rx_pkt_pos - 1;
+    g_rx_buf[g_rx_buf_len++] = reg_read (S2LP_RSSI_LEVEL);
+    sqi = reg_read (S2LP_LINK_QUALIF1) & S2LP_LINK_QUALIF1_SQI_Msk;
+    g_rx_buf[g_rx_buf_len++] = CRC_OK | ((sqi < SQI_MAX) ? (SQI_MAX - sqi) : 0);
+    g_rx_pkt_pos = RX_NO_PKT;
+    return true;
+}
+
+/** Pass up to max_pkts complete packets in the buffer to the handler and
+ *  remove them from the buffer */
+static uint32_t rx_buf_parse (rf_comm_rx_pkt_handler_t handler, uint32_t max_pkts)
+{
+    uint32_t pos = 0, pkts = 0;
+    uint32_t end = (g_rx_pkt_pos == RX_NO_PKT) ? g_rx_buf_len : g_rx_pkt_pos;
+    rf_comm_rx_pkt_t pkt;
+
+    while((pkts < max_pkts) && (pos < end))
+    {
+        uint32_t len = g_rx_buf[pos];
+        pkt.p_data = &g_rx_buf[pos + 1];
+        pkt.len = len;
+        pkt.rssi = (int8_t) ((int32_t) g_rx_buf[pos + 1 + len] - RSSI_OFFSET);
+        pkt.lqi = g_rx_buf[pos + 2 + len] & ~CRC_OK;
+        pkt.crc_ok = ((g_rx_buf[pos + 2 + len] & CRC_OK) != 0);
+        handler (&pkt);
+        pos += 1 + len + RX_STATUS_LEN;
+        pkts++;
+    }
+    g_rx_buf_len -= pos;
+    memmove (g_rx_buf, &g_rx_buf[pos], g_rx_buf_len);
+    if(g_rx_pkt_pos != RX_NO_PKT)
+    {
+        g_rx_pkt_pos -= pos;
+    }
+    return pkts;
+}
+
+void assign_default ()
+{
+    for(uint32_t i = 0; i < ARRAY_SIZE(default_setting); i++)
+    {
+        reg_write (default_setting[i].addr, default_setting[i].data);
+    }
+}
+
+uint32_t rf_comm_radio_init (rf_comm_radio_t * p_radio_params, rf_comm_hw_t * p_comm_hw)
+{
+    log_printf("%s\n", __func__);
+    memcpy (&g_comm_hw, p_comm_hw, sizeof(rf_comm_hw_t));
+
+    if(p_radio_params->rf_tx_done_handler != NULL)
+    {
+        gp_tx_done = p_radio_params->rf_tx_done_handler;
+    }
+
+    if(p_radio_params->rf_rx_done_handler != NULL)
+    {
+        gp_rx_done = p_radio_params->rf_rx_done_handler;
+    }
+
+    if(p_radio_params->rf_tx_failed_handler != NULL)
+    {
+        gp_tx_failed = p_radio_params->rf_tx_failed_handler;
+    }
+
+    if(p_radio_params->rf_rx_failed_handler != NULL)
+    {
+        gp_rx_failed = p_radio_params->rf_rx_failed_handler;
+    }
+
+    s2lp_spi_cmd (S2LP_CMD_SRES);
+    state_wait (S2LP_STATE_READY);
+#if (RF_XTAL_FREQ <= DIG_DIV_THRESHOLD)
+    //The divider of the digital clock can be changed only in STANDBY
+    s2lp_spi_cmd (S2LP_CMD_STANDBY);
+    state_wait (S2LP_STATE_STANDBY);
+    reg_write (S2LP_XO_RCO_CONF1, XO_RCO_CONF1_DEFAULT | S2LP_XO_RCO_CONF1_PD_CLKDIV);
+    s2lp_spi_cmd (S2LP_CMD_READY);
+    state_wait (S2LP_STATE_READY);
+#endif
+
+    assign_default ();
+    g_is_listening = false;
+    rf_comm_set_bw (p_radio_params->rx_bandwidth);
+    rf_comm_set_bitrate (p_radio_params->bitrate);
+    rf_comm_set_fdev (p_radio_params->freq_dev);
+
+    rf_comm_set_freq (p_radio_params->center_freq);
+    rf_comm_set_pwr (p_radio_params->tx_power);
+    rf_comm_csma_config (&g_csma);
+
+    hal_gpio_cfg_input (g_comm_hw.rf_gpio0_pin, HAL_GPIO_PULL_DISABLED);
+
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_cfg_output (g_comm_hw.rf_hgm_pin, 0);
+    hal_gpio_cfg_output (g_comm_hw.rf_pa_pin, 0);
+    hal_gpio_cfg_output (g_comm_hw.rf_lna_pin, 0);
+#endif
+
+    //nIRQ on GPIO0 goes low on an event
+    NRF_GPIOTE->CONFIG[GPIOTE_USED0] =
+        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos)
+        | (g_comm_hw.rf_gpio0_pin << GPIOTE_CONFIG_PSEL_Pos)
+        | (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
+    NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED0;
+    (void) irq_status_read ();
+    g_rx_buf_len = 0;
+    g_rx_pkt_pos = RX_NO_PKT;
+    g_rx_overflows = 0;
+    g_current_state = R_IDLE;
+
+    NVIC_SetPriority (GPIOTE_IRQn, p_radio_params->irq_priority);
+    NVIC_EnableIRQ (GPIOTE_IRQn);
+
+    return 0;
+}
+
+uint32_t rf_comm_set_freq (uint32_t freq)
+{
+    uint32_t band = (freq >= HIGH_BAND_MIN_KHZ) ? HIGH_BAND_FACTOR : MIDDLE_BAND_FACTOR;
+    uint32_t synth, cp_isel;
+    uint8_t synt[4], cfg2;
+    bool pfd_split = (RF_XTAL_FREQ <= DIG_DIV_THRESHOLD);
+
+    //freq = f_xo * SYNT / (2^19 * band)
+    synth = (uint32_t) ROUNDED_DIV((((uint64_t) freq * 1000) << 19) * band,
+            (uint64_t) RF_XTAL_FREQ);
+
+    //Charge pump current from the VCO frequency and the reference clock
+    if((freq * band) >= VCO_CENTER_KHZ)
+    {
+        cp_isel = pfd_split ? 1 : 2;
+    }
+    else
+    {
+        cp_isel = pfd_split ? 2 : 3;
+    }
+    cfg2 = reg_read (S2LP_SYNTH_CONFIG2) & ~S2LP_SYNTH_CONFIG2_PFD_SPLIT;
+    reg_write (S2LP_SYNTH_CONFIG2, cfg2 | (pfd_split ? S2LP_SYNTH_CONFIG2_PFD_SPLIT : 0));
+
+    synt[0] = ((synth >> 24) & 0x0F) | (cp_isel << S2LP_SYNT3_CP_ISEL_Pos)
+            | ((band == MIDDLE_BAND_FACTOR) ? S2LP_SYNT3_BS : 0);
+    synt[1] = (synth >> 16) & 0xFF;
+    synt[2] = (synth >> 8) & 0xFF;
+    synt[3] = synth & 0xFF;
+    s2lp_spi_write (S2LP_SYNT3, synt, 4);
+    return 0;
+}
+
+/** The bit rate of a mantissa and exponent */
+static uint32_t bitrate_calc (uint32_t m, uint32_t e)
+{
+    if(e == 0)
+    {
+        return (uint32_t) (((uint64_t) RF_DIG_FREQ * m) >> 32);
+    }
+    return (uint32_t) (((uint64_t) RF_DIG_FREQ * (65536 + m)) >> (33 - e));
+}
+
+uint32_t rf_comm_set_bitrate (uint32_t bitrate)
+{
+    uint32_t e, m;
+    uint8_t mod[3], cfg;
+
+    for(e = 0; (e < 11) && (bitrate > bitrate_calc (0xFFFF, e)); e++)
+    {
+    }
+    if(e == 0)
+    {
+        m = (uint32_t) ROUNDED_DIV(((uint64_t) bitrate << 32), RF_DIG_FREQ);
+    }
+    else
+    {
+        m = (uint32_t) ROUNDED_DIV(((uint64_t) bitrate << (33 - e)), RF_DIG_FREQ) - 65536;
+    }
+    if(m > 0xFFFF)
+    {
+        m = 0xFFFF;
+    }
+    mod[0] = (m >> 8) & 0xFF;
+    mod[1] = m & 0xFF;
+    mod[2] = S2LP_MOD2_2GFSK_BT1 | e;
+    s2lp_spi_write (S2LP_MOD4, mod, 3);
+
+    //Bessel filter of the PA for the rate
+    cfg = reg_read (S2LP_PA_CONFIG0) & ~S2LP_PA_CONFIG0_FC_Msk;
+    cfg |= (bitrate < 16000) ? 0 : (bitrate < 32000) ? 1 : (bitrate < 62500) ? 2 : 3;
+    reg_write (S2LP_PA_CONFIG0, cfg);
+
+    g_bitrate = bitrate;
+    return 1;
+}
+
+/** The frequency deviation of a mantissa and exponent */
+static uint32_t fdev_calc (uint32_t m, uint32_t e)
+{
+    if(e == 0)
+    {
+        return (uint32_t) (((uint64_t) RF_XTAL_FREQ * m) >> 22);
+    }
+    return (uint32_t) (((uint64_t) RF_XTAL_FREQ * (256 + m)) >> (23 - e));
+}
+
+uint32_t rf_comm_set_fdev (uint32_t fdev)
+{
+    uint32_t e, m;
+    uint8_t mod1;
+
+    if(fdev / 1000 == 0)
+    {
+        fdev = fdev * 1000;
+    }
+    for(e = 0; (e < 11) && (fdev > fdev_calc (0xFF, e)); e++)
+    {
+    }
+    if(e == 0)
+    {
+        m = (uint32_t) ROUNDED_DIV(((uint64_t) fdev << 22), RF_XTAL_FREQ);
+    }
+    else
+    {
+        m = (uint32_t) ROUNDED_DIV(((uint64_t) fdev << (23 - e)), RF_XTAL_FREQ) - 256;
+    }
+    if(m > 0xFF)
+    {
+        m = 0xFF;
+    }
+    mod1 = reg_read (S2LP_MOD1) & ~S2LP_MOD1_FDEV_E_Msk;
+    reg_write (S2LP_MOD1, mod1 | e);
+    reg_write (S2LP_MOD0, m);
+    return 0;
+}
+
+uint32_t rf_comm_set_bw (uint32_t bandwidth)
+{
+    uint32_t best = 0, best_diff = UINT32_MAX;
+
+    if((int)(bandwidth/1000) == 0)
+    {
+        bandwidth = bandwidth*1000;
+    }
+    //The nearest of the filters, which scale with the digital clock
+    for(uint32_t i = 0; i < ARRAY_SIZE(chflt_bw); i++)
+    {
+        uint32_t bw = (uint32_t) (((uint64_t) 100 * chflt_bw[i] * RF_DIG_FREQ) / 26000000);
+        uint32_t diff = (bw > bandwidth) ? (bw - bandwidth) : (bandwidth - bw);
+        if(diff < best_diff)
+        {
+            best_diff = diff;
+            best = i;
+        }
+    }
+    reg_write (S2LP_CHFLT, ((best % 9) << 4) | (best / 9));
+    log_printf("%s : %d\n",__func__, best);
+    return 0;
+}
+
+uint32_t rf_comm_set_pwr (int32_t pwr)
+{
+    uint8_t reg;
+
+    if(pwr > 14)
+    {
+        pwr = 14;
+    }
+    else if(pwr < -30)
+    {
+        pwr = -30;
+    }
+    //The PA level of index 0, in steps of 0.5 dB down from 14.5 dBm
+    reg_write (S2LP_PA_POWER1, 29 - 2*pwr);
+    reg = reg_read (S2LP_PA_POWER0)
+            & ~(S2LP_PA_POWER0_MAXDBM | S2LP_PA_POWER0_MAX_IDX_Msk);
+    reg_write (S2LP_PA_POWER0, reg);
+    log_printf("%s : %d\n", __func__, 29 - 2*pwr);
+    return 0;
+}
+
+uint32_t rf_comm_pkt_config (rf_comm_pkt_t * p_pkt_config)
+{
+    g_arr_pkt[0] = p_pkt_config->max_len;
+    g_arr_pkt[1] = p_pkt_config->app_id;
+    g_arr_pkt[2] = (p_pkt_config->dev_id & 0xFF00)>>8;
+    g_arr_pkt[3] = p_pkt_config->dev_id & 0xFF;
+    return 0;
+}
+
+/** The packet is sent or dropped, back to the normal preamble */
+static void tx_end (void)
+{
+    g_current_state = R_IDLE;
+    if(g_tx_wake_ms != 0)
+    {
+        g_tx_wake_ms = 0;
+        preamble_set (PREAMBLE_PAIRS);
+    }
+}
+
+static void csma_check (void);
+
+/** Wait a random time in the backoff window, which doubles with each check */
+static void csma_backoff_start (void)
+{
+    uint32_t window = g_csma.max_backoff_ms;
+
+    if((g_csma_attempts < 16)
+            && ((g_csma.min_backoff_ms << g_csma_attempts) < window))
+    {
+        window = g_csma.min_backoff_ms << g_csma_attempts;
+    }
+    ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+            MS_TIMER_TICKS_MS(1 + ((window != 0) ? random_num_below (window) : 0)),
+            csma_check);
+}
+
+/** Send with the clear channel check of the radio, which ends with
+ *  TX_DATA_SENT or with MAX_BO_CCA_REACH if the channel is busy */
+static void csma_check (void)
+{
+    g_csma_attempts++;
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_clear (g_comm_hw.rf_pa_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+#endif
+    cmd_tx ();
+}
+
+static void csma_busy (void)
+{
+    g_csma_stats.busy++;
+    if(g_csma_attempts < g_csma.max_attempts)
+    {
+        csma_backoff_start ();
+        return;
+    }
+
+    log_printf("CSMA Dropped\n");
+    g_csma_stats.last_attempts = g_csma_attempts;
+    g_csma_stats.dropped++;
+    s2lp_spi_cmd (S2LP_CMD_FLUSHTXFIFO);
+    tx_end ();
+    if(gp_tx_failed != NULL)
+    {
+        gp_tx_failed (RF_COMM_TX_CCA_FAIL);
+    }
+}
+
+/** Send the loaded TX FIFO now or after the listen before talk */
+static void tx_start (void)
+{
+    if(g_csma.max_attempts == 0)
+    {
+        reg_write (S2LP_PROTOCOL1, 0x00);
+        g_current_state = R_TX;
+        cmd_tx ();
+    }
+    else
+    {
+        reg_write (S2LP_PROTOCOL1, S2LP_PROTOCOL1_CSMA_ON);
+        g_csma_attempts = 0;
+        g_current_state = R_CCA;
+        csma_backoff_start ();
+    }
+}
+
+/** Put the packet in g_arr_pkt after its length in the TX FIFO */
+static void tx_fifo_load (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    uint8_t pckt_len[2];
+
+    timer_cancel ();
+    listen_exit ();
+    ready_enter ();
+    s2lp_spi_cmd (S2LP_CMD_FLUSHTXFIFO);
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
+#endif
+    g_arr_pkt[0] = RF_COMM_HDR_LEN+len;
+    g_arr_pkt[1 + RF_COMM_HDR_SEQ_POS] = g_tx_seq++;
+    g_arr_pkt[1 + RF_COMM_HDR_TYPE_POS] = pkt_type;
+    memcpy (&g_arr_pkt[1 + RF_COMM_HDR_LEN], p_data, len);
+
+    //The radio sends the length byte from PCKTLEN before the FIFO data
+    pckt_len[0] = 0;
+    pckt_len[1] = g_arr_pkt[0];
+    s2lp_spi_write (S2LP_PCKTLEN1, pckt_len, 2);
+    s2lp_spi_write (S2LP_FIFO, &g_arr_pkt[1], g_arr_pkt[0]);
+}
+
+uint32_t rf_comm_csma_config (rf_comm_csma_t * p_csma)
+{
+    uint8_t csma[2];
+
+    if(p_csma != &g_csma)
+    {
+        memcpy (&g_csma, p_csma, sizeof(rf_comm_csma_t));
+    }
+    if(g_csma.max_attempts != 0)
+    {
+        reg_write (S2LP_RSSI_TH, (uint8_t) (g_csma.cca_thr_dbm + RSSI_OFFSET));
+        //One check of 64 bit periods, and no backoff by the radio
+        csma[0] = (1 << 2);
+        csma[1] = (1 << 4);
+        s2lp_spi_write (S2LP_CSMA_CONF1, csma, 2);
+    }
+    return 0;
+}
+
+void rf_comm_get_csma_stats (rf_comm_csma_stats_t * p_stats)
+{
+    memcpy (p_stats, &g_csma_stats, sizeof(rf_comm_csma_stats_t));
+}
+
+uint32_t rf_comm_pkt_send (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    tx_fifo_load (pkt_type, p_data, len);
+    g_tx_wake_ms = 0;
+    tx_start ();
+    return 0;
+}
+
+uint32_t rf_comm_pkt_resend (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    g_tx_seq--;
+    return rf_comm_pkt_send (pkt_type, p_data, len);
+}
+
+uint32_t rf_comm_pkt_send_wake (uint8_t pkt_type, uint8_t * p_data, uint8_t len,
+        uint32_t interval_ms)
+{
+    uint32_t pairs = (uint32_t) (((uint64_t) (interval_ms + RF_COMM_WAKE_MARGIN_MS)
+            * g_bitrate) / 2000);
+
+    tx_fifo_load (pkt_type, p_data, len);
+    preamble_set ((pairs > PREAMBLE_PAIRS_MAX) ? PREAMBLE_PAIRS_MAX : pairs);
+    g_tx_wake_ms = interval_ms;
+    tx_start ();
+    return 0;
+}
+
+uint32_t rf_comm_listen_start (uint32_t interval_ms)
+{
+    uint32_t ticks = (uint32_t) (((uint64_t) interval_ms * RF_RCO_FREQ) / 1000);
+    uint32_t mult = 0, presc;
+    uint8_t timers[2];
+
+    //The wake up time is (TIMERS2 + 1) * (TIMERS3 + 1) * 2^mult RCO periods
+    while((ticks > 0x10000) && (mult < 3))
+    {
+        ticks >>= 1;
+        mult++;
+    }
+    if(ticks > 0x10000)
+    {
+        ticks = 0x10000;
+    }
+    else if(ticks == 0)
+    {
+        ticks = 1;
+    }
+    presc = (ticks - 1) >> 8;
+
+    timer_cancel ();
+    listen_exit ();
+    ready_enter ();
+    s2lp_spi_cmd (S2LP_CMD_FLUSHRXFIFO);
+    timers[0] = presc;
+    timers[1] = (ticks / (presc + 1)) - 1;
+    s2lp_spi_write (S2LP_TIMERS3, timers, 2);
+    reg_write (S2LP_PROTOCOL2, S2LP_PROTOCOL2_CS_TIMEOUT_MASK | mult);
+    rx_timer_set (RF_COMM_SNIFF_US);
+    //Back to sleep after a packet, with the FIFO kept till it is read
+    reg_write (S2LP_PROTOCOL0, 0x00);
+    reg_write (S2LP_PM_CONF0, PM_CONF0_DEFAULT | S2LP_PM_CONF0_SLEEP_FIFO_RET);
+    reg_write (S2LP_PROTOCOL1, S2LP_PROTOCOL1_LDC_MODE | S2LP_PROTOCOL1_FAST_CS_TERM_EN);
+
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+#endif
+    g_rx_buf_len = 0;
+    g_rx_pkt_pos = RX_NO_PKT;
+    g_current_state = R_RX;
+    g_is_listening = true;
+    cmd_rx ();
+    return 0;
+}
+
+uint32_t rf_comm_listen_stop (void)
+{
+    listen_exit ();
+    g_current_state = R_IDLE;
+    return 0;
+}
+
+uint32_t rf_comm_rx_enable ()
+{
+    timer_cancel ();
+    listen_exit ();
+    ready_enter ();
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+#endif
+    g_current_state = R_RX;
+    g_rx_buf_len = 0;
+    g_rx_pkt_pos = RX_NO_PKT;
+    s2lp_spi_cmd (S2LP_CMD_FLUSHRXFIFO);
+    reg_write (S2LP_PROTOCOL1, 0x00);
+    cmd_rx ();
+    return 0;
+}
+
+static void rx_window_timeout (void)
+{
+    g_is_rx_window = false;
+    ready_enter ();
+    s2lp_spi_cmd (S2LP_CMD_FLUSHRXFIFO);
+    g_rx_pkt_pos = RX_NO_PKT;
+    g_current_state = R_IDLE;
+    if(gp_rx_failed != NULL)
+    {
+        gp_rx_failed (RF_COMM_RX_TIMEOUT);
+    }
+}
+
+uint32_t rf_comm_rx_window (uint32_t timeout_ms)
+{
+    rf_comm_rx_enable ();
+    g_is_rx_window = true;
+    ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+            MS_TIMER_TICKS_MS(timeout_ms), rx_window_timeout);
+    return 0;
+}
+
+uint8_t rf_comm_get_tx_seq (void)
+{
+    return (uint8_t) (g_tx_seq - 1);
+}
+
+
+/** Where rf_comm_pkt_receive copies the packet */
+static uint8_t * gp_rx_dest;
+static uint8_t * gp_rx_dest_len;
+static uint32_t g_rx_dest_status;
+
+static void rx_copy_handler (rf_comm_rx_pkt_t * p_pkt)
+{
+    memcpy (gp_rx_dest, p_pkt->p_data, p_pkt->len);
+    *gp_rx_dest_len = p_pkt->len;
+    g_rx_dest_status = p_pkt->crc_ok ? CRC_OK : 0;
+}
+
+uint32_t rf_comm_pkt_receive (uint8_t * p_rxbuff, uint8_t * p_len)
+{
+    gp_rx_dest = p_rxbuff;
+    gp_rx_dest_len = p_len;
+    g_rx_dest_status = 0;
+    *p_len = 0;
+
+    //The packets are read from the RX FIFO as they end, and in the listen
+    //mode the radio goes back to sniffing by itself
+    (void) rx_buf_parse (rx_copy_handler, 1);
+    g_current_state = R_RX;
+    return g_rx_dest_status;
+}
+
+uint32_t rf_comm_pkt_receive_all (rf_comm_rx_pkt_handler_t handler)
+{
+    uint32_t pkts;
+
+    pkts = rx_buf_parse (handler, UINT32_MAX);
+    g_current_state = R_RX;
+    return pkts;
+}
+
+uint32_t rf_comm_get_rx_overflows (void)
+{
+    return g_rx_overflows;
+}
+
+uint32_t rf_comm_idle ()
+{
+    timer_cancel ();
+    listen_exit ();
+    ready_enter ();
+
+    s2lp_spi_cmd (S2LP_CMD_FLUSHRXFIFO);
+    s2lp_spi_cmd (S2LP_CMD_FLUSHTXFIFO);
+    g_rx_pkt_pos = RX_NO_PKT;
+    return(0);
+}
+
+uint32_t rf_comm_sleep ()
+{
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_clear (g_comm_hw.rf_hgm_pin);
+    hal_gpio_pin_clear (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_clear (g_comm_hw.rf_pa_pin);
+#endif
+    timer_cancel ();
+    listen_exit ();
+    ready_enter ();
+
+    //The registers are kept in SLEEP, the FIFOs are not
+    s2lp_spi_cmd (S2LP_CMD_SLEEP);
+    g_rx_pkt_pos = RX_NO_PKT;
+    return(0);
+}
+
+
+uint32_t rf_comm_flush(void)
+{
+    s2lp_spi_cmd (S2LP_CMD_FLUSHRXFIFO);
+    s2lp_spi_cmd (S2LP_CMD_FLUSHTXFIFO);
+    return(0);
+}
+
+uint32_t rf_comm_wake(void)
+{
+    s2lp_spi_cmd (S2LP_CMD_READY);
+    state_wait (S2LP_STATE_READY);
+    return(0);
+}
+
+void rf_comm_cal_update (uint32_t elapsed_s, int32_t temp_c)
+{
+    //The S2-LP calibrates its VCO on each lock of the synthesizer
+}
+
+uint32_t rf_comm_set_freq_offset (int32_t offset_hz)
+{
+    //The AFC of the S2-LP follows the offset in each packet
+    return 1;
+}
+
+int32_t rf_comm_get_freq_offset (void)
+{
+    return 0;
+}
+
+int8_t rf_comm_get_rssi ()
+{
+    return (int8_t) ((int32_t) reg_read (S2LP_RSSI_LEVEL_RUN) - RSSI_OFFSET);
+}
+
+void rf_comm_disable_irq ()
+{
+    NRF_GPIOTE->CONFIG[GPIOTE_USED0] = 0;
+    NRF_GPIOTE->INTENCLR = 1 << GPIOTE_USED0;
+}
+
+void rf_comm_enable_irq()
+{
+    //An event while disabled would hold nIRQ low without an edge
+    (void) irq_status_read ();
+    NRF_GPIOTE->CONFIG[GPIOTE_USED0] =
+        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos)
+        | (g_comm_hw.rf_gpio0_pin << GPIOTE_CONFIG_PSEL_Pos)
+        | (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
+    NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED0;
+}
+
+uint32_t rf_comm_get_state ()
+{
+    return state_read ();
+}
+
+uint32_t rf_comm_get_radio_id ()
+{
+    return reg_read (S2LP_DEVICE_INFO1);
+}
+
+static void irq_handle (uint32_t irq)
+{
+    if(irq & S2LP_IRQ_RX_FIFO_ERROR)
+    {
+        rx_restart ();
+        return;
+    }
+
+    //A packet longer than the RX FIFO
+    if((irq & (S2LP_IRQ_RX_FIFO_ALMOST_FULL | S2LP_IRQ_RX_DATA_READY))
+            == S2LP_IRQ_RX_FIFO_ALMOST_FULL)
+    {
+        (void) rx_fifo_read (S2LP_FIFO_SIZE);
+    }
+
+    //A bad packet dropped by the radio, drop what was read of it
+    if((irq & S2LP_IRQ_RX_DATA_DISC) && (g_rx_pkt_pos != RX_NO_PKT))
+    {
+        g_rx_buf_len = g_rx_pkt_pos;
+        g_rx_pkt_pos = RX_NO_PKT;
+    }
+
+    if((irq & S2LP_IRQ_RX_DATA_READY) && rx_pkt_done ())
+    {
+        if(g_current_state == R_RX)
+        {
+            log_printf("Rx Done\n");
+            g_current_state = R_IDLE;
+            if(gp_rx_done != NULL)
+            {
+                gp_rx_done (irq);
+            }
+        }
+    }
+
+    if(irq & S2LP_IRQ_TX_DATA_SENT)
+    {
+        if((g_current_state == R_TX) || (g_current_state == R_CCA))
+        {
+            if(g_current_state == R_CCA)
+            {
+                g_csma_stats.last_attempts = g_csma_attempts;
+                g_csma_stats.sent++;
+            }
+            log_printf("Tx Done\n");
+            tx_end ();
+            if(gp_tx_done != NULL)
+            {
+                gp_tx_done (irq);
+            }
+        }
+    }
+    else if(irq & S2LP_IRQ_TX_FIFO_ERROR)
+    {
+        if((g_current_state == R_TX) || (g_current_state == R_CCA))
+        {
+            log_printf("Tx Failed\n");
+            s2lp_spi_cmd (S2LP_CMD_FLUSHTXFIFO);
+            tx_end ();
+            if(gp_tx_failed != NULL)
+            {
+                gp_tx_failed (irq);
+            }
+        }
+    }
+    else if((irq & S2LP_IRQ_MAX_BO_CCA_REACH) && (g_current_state == R_CCA))
+    {
+        csma_busy ();
+    }
+}
+
+#if ISR_MANAGER == 1
+void rf_comm_gpiote_Handler (uint32_t fired)
+#else
+void GPIOTE_IRQHandler ()
+#endif
+{
+#if ISR_MANAGER == 0
+    uint32_t fired = isr_dispatch_take (NRF_GPIOTE);
+#endif
+    if(fired & ISR_DISPATCH_EVT(NRF_GPIOTE, NRF_GPIOTE->EVENTS_IN[GPIOTE_USED0]))
+    {
+        irq_handle (irq_status_read ());
+    }
+}
@@ -0,0 +1,224 @@
+/*
+ *  s2lp_def.h : Registers, commands and bit fields of the ST S2-LP
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef S2LP_DEF_H
+#define S2LP_DEF_H
+
+//
+// Configuration registers
+//
+#define S2LP_GPIO0_CONF         0x00      //GPIO0 Configuration
+#define S2LP_GPIO1_CONF         0x01      //GPIO1 Configuration
+#define S2LP_GPIO2_CONF         0x02      //GPIO2 Configuration
+#define S2LP_GPIO3_CONF         0x03      //GPIO3 Configuration
+#define S2LP_SYNT3              0x05      //CP_ISEL, BS and SYNT[27:24]
+#define S2LP_SYNT2              0x06      //SYNT[23:16]
+#define S2LP_SYNT1              0x07      //SYNT[15:8]
+#define S2LP_SYNT0              0x08      //SYNT[7:0]
+#define S2LP_IF_OFFSET_ANA      0x09      //Analog IF
+#define S2LP_IF_OFFSET_DIG      0x0A      //Digital IF
+#define S2LP_CH_SPACE           0x0C      //Channel spacing
+#define S2LP_CHNUM              0x0D      //Channel number
+#define S2LP_MOD4               0x0E      //DATARATE_M[15:8]
+#define S2LP_MOD3               0x0F      //DATARATE_M[7:0]
+#define S2LP_MOD2               0x10      //MOD_TYPE and DATARATE_E
+#define S2LP_MOD1               0x11      //Interpolators and FDEV_E
+#define S2LP_MOD0               0x12      //FDEV_M
+#define S2LP_CHFLT              0x13      //CHFLT_M and CHFLT_E
+#define S2LP_AFC2               0x14      //AFC configuration
+#define S2LP_RSSI_FLT           0x17      //RSSI filter and CS mode
+#define S2LP_RSSI_TH            0x18      //RSSI threshold of the carrier sense
+#define S2LP_PCKTCTRL6          0x2B      //SYNC_LEN and PREAMBLE_LEN[9:8]
+#define S2LP_PCKTCTRL5          0x2C      //PREAMBLE_LEN[7:0]
+#define S2LP_PCKTCTRL4          0x2D      //Length field width and address
+#define S2LP_PCKTCTRL3          0x2E      //Packet format and RX mode
+#define S2LP_PCKTCTRL2          0x2F      //Fixed or variable length
+#define S2LP_PCKTCTRL1          0x30      //CRC, whitening and TX source
+#define S2LP_PCKTLEN1           0x31      //Length of the packet to send [15:8]
+#define S2LP_PCKTLEN0           0x32      //Length of the packet to send [7:0]
+#define S2LP_SYNC3              0x33      //Sync word [31:24]
+#define S2LP_SYNC2              0x34      //Sync word [23:16]
+#define S2LP_SYNC1              0x35      //Sync word [15:8]
+#define S2LP_SYNC0              0x36      //Sync word [7:0]
+#define S2LP_QI                 0x37      //Quality indicator thresholds
+#define S2LP_PROTOCOL2          0x39      //RX timeout stop conditions, LDC multiplier
+#define S2LP_PROTOCOL1          0x3A      //LDC, sniff and CSMA modes
+#define S2LP_PROTOCOL0          0x3B      //Retransmissions and persistent RX
+#define S2LP_FIFO_CONFIG3       0x3C      //RX FIFO almost full threshold
+#define S2LP_FIFO_CONFIG2       0x3D      //RX FIFO almost empty threshold
+#define S2LP_FIFO_CONFIG1       0x3E      //TX FIFO almost full threshold
+#define S2LP_FIFO_CONFIG0       0x3F      //TX FIFO almost empty threshold
+#define S2LP_PCKT_FLT_OPTIONS   0x40      //Packet filters
+#define S2LP_TIMERS5            0x46      //RX timer counter
+#define S2LP_TIMERS4            0x47      //RX timer prescaler
+#define S2LP_TIMERS3            0x48      //Wake up timer prescaler
+#define S2LP_TIMERS2            0x49      //Wake up timer counter
+#define S2LP_CSMA_CONF3         0x4C      //Seed of the backoff [14:8]
+#define S2LP_CSMA_CONF2         0x4D      //Seed of the backoff [7:0]
+#define S2LP_CSMA_CONF1         0x4E      //BU_PRSC and CCA_PERIOD
+#define S2LP_CSMA_CONF0         0x4F      //CCA_LEN and NBACKOFF_MAX
+#define S2LP_IRQ_MASK3          0x50      //IRQ mask [31:24]
+#define S2LP_IRQ_MASK2          0x51      //IRQ mask [23:16]
+#define S2LP_IRQ_MASK1          0x52      //IRQ mask [15:8]
+#define S2LP_IRQ_MASK0          0x53      //IRQ mask [7:0]
+#define S2LP_PA_POWER8          0x5A      //PA level of index 7
+#define S2LP_PA_POWER1          0x61      //PA level of index 0
+#define S2LP_PA_POWER0          0x62      //PA_MAXDBM, ramping and PA_LEVEL_MAX_IDX
+#define S2LP_PA_CONFIG1         0x63      //FIR configuration
+#define S2LP_PA_CONFIG0         0x64      //PA Bessel filter
+#define S2LP_SYNTH_CONFIG2      0x65      //PFD split
+#define S2LP_XO_RCO_CONF1       0x6C      //Clock dividers
+#define S2LP_XO_RCO_CONF0       0x6D      //Reference divider and RCO calibration
+#define S2LP_PM_CONF3           0x76      //SMPS rate multiplier [14:8]
+#define S2LP_PM_CONF0           0x79      //SMPS level and sleep mode
+
+//
+// Status registers
+//
+#define S2LP_MC_STATE1          0x8D      //Main controller state 1
+#define S2LP_MC_STATE0          0x8E      //Main controller state 0
+#define S2LP_TX_FIFO_STATUS     0x8F      //Bytes in the TX FIFO
+#define S2LP_RX_FIFO_STATUS     0x90      //Bytes in the RX FIFO
+#define S2LP_LINK_QUALIF2       0x9F      //PQI of the packet received
+#define S2LP_LINK_QUALIF1       0xA0      //Carrier sense and SQI of the packet received
+#define S2LP_RSSI_LEVEL         0xA2      //RSSI at the sync word of the packet received
+#define S2LP_RX_PCKT_LEN1       0xA4      //Length of the packet received [14:8]
+#define S2LP_RX_PCKT_LEN0       0xA5      //Length of the packet received [7:0]
+#define S2LP_RSSI_LEVEL_RUN     0xEF      //RSSI now
+#define S2LP_DEVICE_INFO1       0xF0      //Part number
+#define S2LP_DEVICE_INFO0       0xF1      //Version
+#define S2LP_IRQ_STATUS3        0xFA      //IRQ status [31:24], cleared on read
+#define S2LP_IRQ_STATUS0        0xFD      //IRQ status [7:0]
+
+/** The address for the access of the TX and RX FIFOs */
+#define S2LP_FIFO               0xFF
+/** Size of each of the TX and RX FIFOs */
+#define S2LP_FIFO_SIZE          128
+
+//
+// Header byte of an SPI transaction
+//
+#define S2LP_HDR_WRITE          0x00
+#define S2LP_HDR_READ           0x01
+#define S2LP_HDR_CMD            0x80
+
+//
+// Commands
+//
+#define S2LP_CMD_TX             0x60      // Go to TX
+#define S2LP_CMD_RX             0x61      // Go to RX
+#define S2LP_CMD_READY          0x62      // Go to READY
+#define S2LP_CMD_STANDBY        0x63      // Go to STANDBY
+#define S2LP_CMD_SLEEP          0x64      // Go to SLEEP
+#define S2LP_CMD_LOCKRX         0x65      // Go to LOCK for RX
+#define S2LP_CMD_LOCKTX         0x66      // Go to LOCK for TX
+#define S2LP_CMD_SABORT         0x67      // Exit TX or RX and go to READY
+#define S2LP_CMD_LDC_RELOAD     0x68      // Reload the LDC timer
+#define S2LP_CMD_RCO_CALIB      0x69      // Calibrate the RCO
+#define S2LP_CMD_SRES           0x70      // Reset the chip
+#define S2LP_CMD_FLUSHRXFIFO    0x71      // Flush the RX FIFO
+#define S2LP_CMD_FLUSHTXFIFO    0x72      // Flush the TX FIFO
+
+//
+// States in MC_STATE0[7:1]
+//
+#define S2LP_STATE_READY        0x00
+#define S2LP_STATE_SLEEP_NOFIFO 0x01
+#define S2LP_STATE_STANDBY      0x02
+#define S2LP_STATE_SLEEP        0x03
+#define S2LP_STATE_LOCKON       0x0C
+#define S2LP_STATE_RX           0x30
+#define S2LP_STATE_LOCKST       0x14
+#define S2LP_STATE_SYNTH_SETUP  0x50
+#define S2LP_STATE_TX           0x5C
+#define S2LP_STATE_Pos          1
+
+//
+// IRQ bits of IRQ_MASK and IRQ_STATUS as a 32 bit word
+//
+#define S2LP_IRQ_RX_DATA_READY          0x00000001
+#define S2LP_IRQ_RX_DATA_DISC           0x00000002
+#define S2LP_IRQ_TX_DATA_SENT           0x00000004
+#define S2LP_IRQ_MAX_RE_TX_REACH        0x00000008
+#define S2LP_IRQ_CRC_ERROR              0x00000010
+#define S2LP_IRQ_TX_FIFO_ERROR          0x00000020
+#define S2LP_IRQ_RX_FIFO_ERROR          0x00000040
+#define S2LP_IRQ_TX_FIFO_ALMOST_FULL    0x00000080
+#define S2LP_IRQ_TX_FIFO_ALMOST_EMPTY   0x00000100
+#define S2LP_IRQ_RX_FIFO_ALMOST_FULL    0x00000200
+#define S2LP_IRQ_RX_FIFO_ALMOST_EMPTY   0x00000400
+#define S2LP_IRQ_MAX_BO_CCA_REACH       0x00000800
+#define S2LP_IRQ_VALID_PREAMBLE         0x00001000
+#define S2LP_IRQ_VALID_SYNC             0x00002000
+#define S2LP_IRQ_RSSI_ABOVE_TH          0x00004000
+#define S2LP_IRQ_WKUP_TOUT_LDC          0x00008000
+#define S2LP_IRQ_READY                  0x00010000
+#define S2LP_IRQ_RX_TIMEOUT             0x10000000
+#define S2LP_IRQ_RX_SNIFF_TIMEOUT       0x20000000
+
+//
+// Bit fields
+//
+/** GPIOx_CONF : nIRQ, active low, as a low power digital output */
+#define S2LP_GPIO_NIRQ                  0x00
+#define S2LP_GPIO_MODE_OUT_LP           0x02
+
+#define S2LP_SYNT3_BS                   0x10      //1: Middle band
+#define S2LP_SYNT3_CP_ISEL_Pos          5
+#define S2LP_SYNTH_CONFIG2_PFD_SPLIT    0x04
+
+#define S2LP_MOD2_2GFSK_BT1             0x20
+#define S2LP_MOD1_FDEV_E_Msk            0x0F
+
+#define S2LP_AFC2_FREEZE_ON_SYNC        0x80
+
+#define S2LP_PCKTCTRL6_SYNC_LEN_Pos     2
+#define S2LP_PCKTCTRL2_VAR_LEN          0x01
+#define S2LP_PCKTCTRL1_CRC_16_8005      0x40
+
+#define S2LP_PROTOCOL2_CS_TIMEOUT_MASK  0x80
+#define S2LP_PROTOCOL2_LDC_MULT_Msk     0x03
+#define S2LP_PROTOCOL1_LDC_MODE         0x80
+#define S2LP_PROTOCOL1_FAST_CS_TERM_EN  0x10
+#define S2LP_PROTOCOL1_CSMA_ON          0x04
+#define S2LP_PROTOCOL0_PERS_RX          0x02
+
+#define S2LP_PCKT_FLT_RX_TIMEOUT_OR     0x40
+#define S2LP_PCKT_FLT_CRC               0x01
+
+#define S2LP_PA_POWER0_MAXDBM           0x40
+#define S2LP_PA_POWER0_MAX_IDX_Msk      0x07
+#define S2LP_PA_CONFIG0_FC_Msk          0x03
+
+#define S2LP_XO_RCO_CONF1_PD_CLKDIV     0x10
+#define S2LP_XO_RCO_CONF0_RCO_CALIB     0x01
+
+#define S2LP_PM_CONF0_SLEEP_FIFO_RET    0x01
+
+#define S2LP_LINK_QUALIF1_CS            0x80
+#define S2LP_LINK_QUALIF1_SQI_Msk       0x7F
+
+/** PM_CONF3 : SMPS switching frequency written before the TX and RX
+ *  commands, as done by the ST library */
+#define S2LP_PM_CONF3_TX                0x9C
+#define S2LP_PM_CONF3_RX                0x90
+
+/** Part number in DEVICE_INFO1 */
+#define S2LP_PARTNUM                    0x03
+
+#endif /* S2LP_DEF_H */
@@ -0,0 +1,71 @@
+/*
+ *  spi_s2lp_nrf52.c : SPI access of the registers, FIFOs and commands of
+ *  the S2-LP over the SPIM
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "spi_s2lp_nrf52.h"
+#include "s2lp_def.h"
+#include "hal_spim.h"
+
+#include "string.h"
+
+/** Header byte, address or command byte, and a FIFO worth of data */
+#define SPI_BUF_SIZE    (2 + S2LP_FIFO_SIZE)
+
+static s2lp_status_t transfer (uint8_t hdr, uint8_t addr, uint8_t * p_tx,
+        uint8_t * p_rx, uint32_t len)
+{
+    uint8_t tx_buff[SPI_BUF_SIZE];
+    uint8_t rx_buff[SPI_BUF_SIZE];
+
+    if(len > S2LP_FIFO_SIZE)
+    {
+        len = S2LP_FIFO_SIZE;
+    }
+    tx_buff[0] = hdr;
+    tx_buff[1] = addr;
+    if(p_tx != NULL)
+    {
+        memcpy (&tx_buff[2], p_tx, len);
+    }
+    else
+    {
+        memset (&tx_buff[2], 0x00, len);
+    }
+    hal_spim_tx_rx (tx_buff, 2 + len, rx_buff, 2 + len);
+    while(hal_spim_is_busy ());
+    if(p_rx != NULL)
+    {
+        memcpy (p_rx, &rx_buff[2], len);
+    }
+    return (rx_buff[0] << 8) | rx_buff[1];
+}
+
+s2lp_status_t s2lp_spi_write (uint8_t addr, uint8_t * p_data, uint32_t len)
+{
+    return transfer (S2LP_HDR_WRITE, addr, p_data, NULL, len);
+}
+
+s2lp_status_t s2lp_spi_read (uint8_t addr, uint8_t * p_data, uint32_t len)
+{
+    return transfer (S2LP_HDR_READ, addr, NULL, p_data, len);
+}
+
+s2lp_status_t s2lp_spi_cmd (uint8_t cmd)
+{
+    return transfer (S2LP_HDR_CMD, cmd, NULL, NULL, 0);
+}
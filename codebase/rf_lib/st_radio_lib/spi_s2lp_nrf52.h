@@ -0,0 +1,60 @@
+/*
+ *  spi_s2lp_nrf52.h : SPI access of the registers, FIFOs and commands of
+ *  the S2-LP over the SPIM
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPI_S2LP_NRF52_H
+#define SPI_S2LP_NRF52_H
+#include "stdint.h"
+
+typedef struct
+{
+  uint8_t   addr;
+  uint8_t   data;
+}s2lp_reg_setting_t;
+
+/** The two status bytes sent by the S2-LP at the start of each transaction,
+ *  MC_STATE1 in the MSB and MC_STATE0 in the LSB */
+typedef uint16_t s2lp_status_t;
+
+/**
+ * @brief Write consecutive registers, or the TX FIFO at @ref S2LP_FIFO
+ * @param addr Address of the first register
+ * @param p_data The bytes to write
+ * @param len Number of bytes, at most 128
+ * @return Status bytes
+ */
+s2lp_status_t s2lp_spi_write (uint8_t addr, uint8_t * p_data, uint32_t len);
+
+/**
+ * @brief Read consecutive registers, or the RX FIFO at @ref S2LP_FIFO
+ * @param addr Address of the first register
+ * @param p_data Filled with the bytes read
+ * @param len Number of bytes, at most 128
+ * @return Status bytes
+ */
+s2lp_status_t s2lp_spi_read (uint8_t addr, uint8_t * p_data, uint32_t len);
+
+/**
+ * @brief Send a command
+ * @param cmd The command
+ * @return Status bytes
+ */
+s2lp_status_t s2lp_spi_cmd (uint8_t cmd);
+
+#endif /* SPI_S2LP_NRF52_H */
@@ -20,16 +20,27 @@
 
 #include "spi_rf_nrf52.h"
 #include "rf_comm.h"
+#include "rf_spi_hw.h"
 #include "cc112x_def.h"
 #include "hal_gpio.h"
 #include "nrf.h"
+#include "isr_dispatch.h"
 #include "log.h"
 #include "hal_nop_delay.h"
+#include "ms_timer.h"
+#include "random_num.h"
 
 #ifndef RF_XTAL_FREQ
 #define RF_XTAL_FREQ 32000000
 #endif
 
+/** 1 for the FREQ word of the firmware in the field, with RF_XTAL_FREQ/2^16
+ *  truncated. Set to 0 for the rounded word once all the radios of a
+ *  network can be updated together, as the two are on different channels */
+#ifndef RF_FREQ_TRUNCATED
+#define RF_FREQ_TRUNCATED 1
+#endif
+
 #define MATH_BUFF1 ((uint32_t)(549755813888/RF_XTAL_FREQ))
 
 #if ISR_MANAGER == 1
@@ -43,17 +54,49 @@
 
 #define RF_LO_DIVIDER          4             /* there is a hardware LO divider CC112x */
 
+/** FREQOFF and FREQOFF_EST : Offset in steps of f_xosc/(LO divider * 2^18) */
+#define FREQOFF_STEP_DIV       ((int32_t) RF_LO_DIVIDER << 18)
+
+/** Frequency of the RC oscillator of the eWOR timer, calibrated to the XOSC */
+#define RF_RCOSC_FREQ          (RF_XTAL_FREQ/1000)
+
+/** WOR_CFG1 : Normal eWOR mode, EVENT1 (XOSC start) of 4 RCOSC periods.
+ *  The resolution WOR_RES is in bits 7:6 */
+#define WOR_CFG1_LISTEN        0x08
+#define WOR_CFG1_RES_Pos       6
+/** WOR_CFG0 : 256 Hz clock divider enabled, RCOSC running */
+#define WOR_CFG0_LISTEN        0x20
+/** WOR_CFG0 : RC_MODE which calibrates the RCOSC on the next SIDLE */
+#define WOR_CFG0_RC_CAL        0x04
+/** WOR_CFG0 : Reset value, with the RCOSC powered down */
+#define WOR_CFG0_DEFAULT       0x21
+/** RFEND_CFG0 : Back to eWOR on a bad packet, RX terminated without carrier sense */
+#define RFEND_CFG0_LISTEN      0x09
+/** RFEND_CFG0 : Reset value */
+#define RFEND_CFG0_DEFAULT     0x00
+
+/** The state in the status byte of the radio */
+#define STATUS_STATE_Msk       0x70
+/** The state in the status byte after an overflow of the RX FIFO */
+#define STATUS_RX_FIFO_ERR     0x60
+/** The status bytes appended to a received packet, RSSI and CRC_OK|LQI */
+#define RX_STATUS_LEN          2
+/** The offset of the RSSI in dBm from the RSSI status byte */
+#define RSSI_OFFSET            99
+/** MARC_STATUS0 : Set when the last STX strobe found the channel busy */
+#define MARC_STATUS0_TXONCCA_FAILED 0x08
+
 
 const registerSetting_t default_setting[] = 
 {
     {PKT_CFG0,          0x20},
     {PKT_CFG1,          0x05},
-    {PKT_CFG2,          0x04},
+    {PKT_CFG2,          0x0C}, //CCA : RSSI below threshold and not receiving
     {PKT_LEN,           0x0F},
     {IOCFG3,            0xB0},
     {IOCFG2,            0x06},
     {IOCFG1,            0x13},
-    {IOCFG0,            0x06},
+    {IOCFG0,            0x00}, //RXFIFO_THR
     {MODCFG_DEV_E,      0x02}, //fdev testing
 
     {SYNC_CFG1,         0x0B},
@@ -65,7 +108,9 @@ const registerSetting_t default_setting[] =
     {AGC_CS_THR,        0x19},
     {AGC_CFG1,          0xA9},
     {AGC_CFG0,          0xCF},
-    {FIFO_CFG,          0x00},
+    {FIFO_CFG,          (RF_COMM_RX_FIFO_THR - 1)},
+    {RFEND_CFG1,        0x3F}, //Stay in RX after a packet
+    {SETTLING_CFG,      0x03}, //Calibrate the FS only on SCAL, kept in SLEEP
     {FS_CFG,            0x12},
     {IF_MIX_CFG,        0x00},
     {FS_DIG1,           0x00},
@@ -89,6 +134,7 @@ typedef enum
     R_IDLE,
     R_RX,
     R_TX,
+    R_CCA,
 }radio_state_t;
 
 volatile radio_state_t g_current_state;
@@ -99,11 +145,165 @@ uint8_t g_marc_sts1;
 
 static uint8_t g_arr_pkt[260];
 
+/** Sequence number of the next packet sent */
+static uint8_t g_tx_seq = 0;
+
+/** The bytes read from the RX FIFO and not yet delivered as packets */
+static uint8_t g_rx_buf[RF_COMM_RX_BUF_SIZE];
+static uint32_t g_rx_buf_len = 0;
+static uint32_t g_rx_overflows = 0;
+
+/** If the radio is in the low power listen mode */
+static volatile bool g_is_listening = false;
+
+static rf_comm_csma_t g_csma;
+static rf_comm_csma_stats_t g_csma_stats;
+/** Clear channel checks done for the packet being sent */
+static uint32_t g_csma_attempts;
+/** Listen interval of the receiver of the packet being sent with the long
+ *  preamble, 0 for a normal send */
+static uint32_t g_tx_wake_ms;
+
+/** If RX was started with rf_comm_rx_window and hasn't timed out */
+static volatile bool g_is_rx_window = false;
+
+/** The radio parameters with the changes of the setters, to write the
+ *  configuration again if the radio loses it in the sleep */
+static rf_comm_radio_t g_radio;
+static bool g_is_configured = false;
+/** FREQ2..0 as written, read back at the wake to check the configuration */
+static uint8_t g_freq_regs[3];
+
+/** Time in s and temperature since the last calibration of the FS */
+static uint32_t g_cal_age_s;
+static int32_t g_cal_temp_c = RF_COMM_TEMP_UNKNOWN;
+/** Latest temperature of rf_comm_cal_update */
+static int32_t g_temp_c = RF_COMM_TEMP_UNKNOWN;
+/** If the FS is to be calibrated at the next wake or send */
+static bool g_is_cal_due = false;
+
+/** Frequency offset in FREQOFF and as estimated for the last good packet,
+ *  in steps of f_xosc/FREQOFF_STEP_DIV */
+static int16_t g_freq_off = 0;
+static int16_t g_freq_off_est = 0;
+
 void (* gp_tx_done) (uint32_t error);
 void (* gp_rx_done) (uint32_t error);
 void (* gp_tx_failed) (uint32_t error);
 void (* gp_rx_failed) (uint32_t error);
 
+static void reg_write (uint16_t addr, uint8_t value)
+{
+    trx8BitRegAccess (RADIO_WRITE_ACCESS, (0xFF & addr), &value, 1);
+}
+
+/** Stop the low power listen mode if it is on, leaving the radio in IDLE */
+static void listen_exit (void)
+{
+    if(g_is_listening)
+    {
+        g_is_listening = false;
+        trxSpiCmdStrobe (SIDLE);
+        reg_write (RFEND_CFG0, RFEND_CFG0_DEFAULT);
+        reg_write (WOR_CFG0, WOR_CFG0_DEFAULT);
+    }
+}
+
+/** Stop the timer of a CSMA backoff or an RX window still pending */
+static void timer_cancel (void)
+{
+    if(g_current_state == R_CCA)
+    {
+        ms_timer_stop (MS_TIMER_USED_RF_COMM);
+        g_current_state = R_IDLE;
+    }
+    if(g_is_rx_window)
+    {
+        ms_timer_stop (MS_TIMER_USED_RF_COMM);
+        g_is_rx_window = false;
+    }
+}
+
+/** The length of the complete packets at the start of the buffer */
+static uint32_t rx_buf_complete_len (void)
+{
+    uint32_t pos = 0;
+
+    while((pos < g_rx_buf_len)
+            && ((g_rx_buf_len - pos) >= (1 + g_rx_buf[pos] + RX_STATUS_LEN)))
+    {
+        pos += 1 + g_rx_buf[pos] + RX_STATUS_LEN;
+    }
+    return pos;
+}
+
+/** Restart RX after an overflow of the RX FIFO or the buffer, keeping the
+ *  complete packets in the buffer and dropping the one cut short */
+static void rx_restart (void)
+{
+    g_rx_overflows++;
+    g_rx_buf_len = rx_buf_complete_len ();
+    trxSpiCmdStrobe (SIDLE);
+    trxSpiCmdStrobe (SFRX);
+    trxSpiCmdStrobe (g_is_listening ? SWOR : SRX);
+}
+
+/** Read all the bytes in the RX FIFO into the buffer */
+static void rx_fifo_read (void)
+{
+    uint8_t count;
+    rfStatus_t status;
+
+    status = trx16BitRegAccess (RADIO_READ_ACCESS, 0x2F, (0xFF & NUM_RXBYTES),
+            &count, 1);
+    if(count > (RF_COMM_RX_BUF_SIZE - g_rx_buf_len))
+    {
+        rx_restart ();
+        return;
+    }
+    if(count != 0)
+    {
+        trx8BitRegAccess (RADIO_READ_ACCESS|RADIO_BURST_ACCESS, RXFIFO,
+                &g_rx_buf[g_rx_buf_len], count);
+        g_rx_buf_len += count;
+    }
+    //The FIFO is kept in RX_FIFO_ERR, so the packets before the one which
+    //overflowed are read before the flush
+    if((status & STATUS_STATE_Msk) == STATUS_RX_FIFO_ERR)
+    {
+        rx_restart ();
+    }
+}
+
+/** Pass up to max_pkts complete packets in the buffer to the handler and
+ *  remove them from the buffer */
+static uint32_t rx_buf_parse (rf_comm_rx_pkt_handler_t handler, uint32_t max_pkts)
+{
+    uint32_t pos = 0, pkts = 0;
+    rf_comm_rx_pkt_t pkt;
+
+    while((pkts < max_pkts) && (pos < g_rx_buf_len))
+    {
+        uint32_t len = g_rx_buf[pos];
+        if((g_rx_buf_len - pos) < (1 + len + RX_STATUS_LEN))
+        {
+            //The rest of the packet is still being received
+            break;
+        }
+        pkt.p_data = &g_rx_buf[pos + 1];
+        pkt.len = len;
+        pkt.rssi = (int8_t) g_rx_buf[pos + 1 + len] - RSSI_OFFSET;
+        pkt.lqi = g_rx_buf[pos + 2 + len] & ~CRC_OK;
+        pkt.crc_ok = ((g_rx_buf[pos + 2 + len] & CRC_OK) != 0);
+        handler (&pkt);
+        pos += 1 + len + RX_STATUS_LEN;
+        pkts++;
+    }
+    g_rx_buf_len -= pos;
+    memmove (g_rx_buf, &g_rx_buf[pos], g_rx_buf_len);
+    return pkts;
+}
+
 uint32_t math_log (uint32_t num, uint32_t base)
 {
     return ((num > (base-1))? 1 +  math_log((num/base), base) : 0);
@@ -143,6 +343,61 @@ void assign_default ()
 	}
 }
 
+/** Calibrate the FS, with the radio in IDLE */
+static void cal_run (void)
+{
+    trxSpiCmdStrobe (SCAL);
+    while(rf_comm_get_state ())
+    {
+    }
+    g_cal_age_s = 0;
+    g_cal_temp_c = g_temp_c;
+    g_is_cal_due = false;
+}
+
+static void cal_if_due (void)
+{
+    if(g_is_cal_due)
+    {
+        cal_run ();
+    }
+}
+
+static void freq_off_write (void)
+{
+    uint8_t regs[2];
+
+    regs[0] = ((uint16_t) g_freq_off >> 8) & 0xFF;
+    regs[1] = (uint16_t) g_freq_off & 0xFF;
+    trx16BitRegAccess (RADIO_WRITE_ACCESS | RADIO_BURST_ACCESS, 0x2F,
+            (0xFF & FREQOFF1), regs, 2);
+}
+
+/** Latch the offset estimated for the packet just received, as the next
+ *  sync word updates it */
+static void freq_off_est_read (void)
+{
+    uint8_t regs[2];
+
+    trx16BitRegAccess (RADIO_READ_ACCESS | RADIO_BURST_ACCESS, 0x2F,
+            (0xFF & FREQOFF_EST1), regs, 2);
+    g_freq_off_est = (int16_t) ((regs[0] << 8) | regs[1]);
+}
+
+/** Write the configuration of the radio over the reset values */
+static void config_write (rf_comm_radio_t * p_radio)
+{
+    assign_default ();
+    rf_comm_set_bw (p_radio->rx_bandwidth);
+    rf_comm_set_bitrate (p_radio->bitrate);
+    rf_comm_set_fdev (p_radio->freq_dev);
+
+    rf_comm_set_freq (p_radio->center_freq);
+    rf_comm_set_pwr (p_radio->tx_power);
+    rf_comm_csma_config (&g_csma);
+    freq_off_write ();
+}
+
 uint32_t rf_comm_radio_init (rf_comm_radio_t * p_radio_params, rf_comm_hw_t * p_comm_hw)
 {
     //reset
@@ -181,13 +436,10 @@ uint32_t rf_comm_radio_init (rf_comm_radio_t * p_radio_params, rf_comm_hw_t * p_
 	/* give the tranciever time enough to complete reset cycle */
 	hal_nop_delay_us (16000);
 
-    assign_default ();
-    rf_comm_set_bw (p_radio_params->rx_bandwidth);
-    rf_comm_set_bitrate (p_radio_params->bitrate);
-    rf_comm_set_fdev (p_radio_params->freq_dev);
-
-    rf_comm_set_freq (p_radio_params->center_freq);
-    rf_comm_set_pwr (p_radio_params->tx_power);
+    memcpy (&g_radio, p_radio_params, sizeof(rf_comm_radio_t));
+    config_write (&g_radio);
+    g_is_configured = true;
+    cal_run ();
     
 //    hal_gpio_cfg_input (g_comm_hw.rf_gpio0_pin, HAL_GPIO_PULL_DISABLED);
 //    hal_gpio_cfg_input (g_comm_hw.rf_gpio1_pin, HAL_GPIO_PULL_DISABLED);
@@ -206,6 +458,14 @@ uint32_t rf_comm_radio_init (rf_comm_radio_t * p_radio_params, rf_comm_hw_t * p_
         | (g_comm_hw.rf_gpio2_pin << GPIOTE_CONFIG_PSEL_Pos)
         | (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
     NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED0;
+    hal_gpio_cfg_input (g_comm_hw.rf_gpio0_pin, HAL_GPIO_PULL_DISABLED);
+    NRF_GPIOTE->CONFIG[GPIOTE_USED1] =
+        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos)
+        | (g_comm_hw.rf_gpio0_pin << GPIOTE_CONFIG_PSEL_Pos)
+        | (GPIOTE_CONFIG_POLARITY_LoToHi << GPIOTE_CONFIG_POLARITY_Pos);
+    NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED1;
+    g_rx_buf_len = 0;
+    g_rx_overflows = 0;
 
     NVIC_SetPriority (GPIOTE_IRQn, p_radio_params->irq_priority);
     NVIC_EnableIRQ (GPIOTE_IRQn);
@@ -215,19 +475,25 @@ uint32_t rf_comm_radio_init (rf_comm_radio_t * p_radio_params, rf_comm_hw_t * p_
 
 uint32_t rf_comm_set_freq (uint32_t freq)
 {
+    g_radio.center_freq = freq;
     freq = freq*1000;
 	uint8_t freq_regs[3];
 	uint32_t freq_regs_uint32;
 	uint32_t f_vco;
-    const uint32_t math_buff1 = RF_XTAL_FREQ/ (1 << 16);
 
 	/* Radio frequency -> VCO frequency */
 	f_vco = freq * RF_LO_DIVIDER;
 
-	/* Divide by oscillator frequency */
-
-	/* Convert value into uint32_t from float */
-	freq_regs_uint32 = (f_vco/ math_buff1);
+	/* Divide by oscillator frequency. Truncating it to 2^16 steps was 0.06%
+	 * off, about 500 kHz high at 866 MHz, so the radios with the truncated
+	 * word and the rounded one are on different channels. The rounded one is
+	 * only used with RF_FREQ_TRUNCATED set to 0, for the gateway and its
+	 * nodes together. */
+#if RF_FREQ_TRUNCATED == 1
+	freq_regs_uint32 = f_vco / (RF_XTAL_FREQ / (1 << 16));
+#else
+	freq_regs_uint32 = (uint32_t) ROUNDED_DIV(((uint64_t) f_vco << 16), RF_XTAL_FREQ);
+#endif
 
 	/* return the frequency word */
 
@@ -238,6 +504,9 @@ uint32_t rf_comm_set_freq (uint32_t freq)
 	/* write the frequency word to the transciever */
 	trx16BitRegAccess(RADIO_WRITE_ACCESS | RADIO_BURST_ACCESS, 0x2F, (0xFF & FREQ2), freq_regs, 3);
 //    log_printf("%s : 0x%x\n", __func__,freq_regs_uint32);
+    memcpy (g_freq_regs, freq_regs, sizeof(g_freq_regs));
+    //The FS isn't calibrated on its own when going to RX or TX
+    g_is_cal_due = true;
 
     return 0;
 
@@ -249,7 +518,7 @@ uint32_t rf_comm_set_bitrate (uint32_t bitrate)
     uint32_t srate_m;
     uint8_t arr_reg[3];
     
-    
+    g_radio.bitrate = bitrate;
     srate_e = math_log((bitrate*MATH_BUFF1),2) - 20;
     
     srate_m = (bitrate*MATH_BUFF1/ (1 << srate_e)) - (1 << 20);
@@ -296,6 +565,7 @@ uint32_t rf_comm_set_bitrate (uint32_t bitrate)
 
 uint32_t rf_comm_set_fdev (uint32_t fdev)
 {
+    g_radio.freq_dev = fdev;
     if(fdev / 1000 == 0)
     {
         fdev = fdev * 1000;
@@ -336,6 +606,7 @@ uint32_t rf_comm_set_bw (uint32_t bandwidth)
 {
     //Bypass will be always enabled and Decimation factor will always be 20
     //refer "RX filter bandwidth" section in CC112x datasheet.
+    g_radio.rx_bandwidth = bandwidth;
     if((int)(bandwidth/1000) == 0)
     {
         bandwidth = bandwidth*1000;
@@ -353,9 +624,31 @@ uint32_t rf_comm_set_bw (uint32_t bandwidth)
     
 }
 
+uint32_t rf_comm_set_freq_offset (int32_t offset_hz)
+{
+    int64_t steps = (int64_t) offset_hz * FREQOFF_STEP_DIV;
+
+    //Rounded to the nearest step either side of 0
+    steps = (steps + ((steps < 0) ? -(RF_XTAL_FREQ/2) : (RF_XTAL_FREQ/2)))
+            / RF_XTAL_FREQ;
+    if((steps > INT16_MAX) || (steps < INT16_MIN))
+    {
+        return 1;
+    }
+    g_freq_off = (int16_t) steps;
+    freq_off_write ();
+    return 0;
+}
+
+int32_t rf_comm_get_freq_offset (void)
+{
+    return (int32_t) (((int64_t) g_freq_off_est * RF_XTAL_FREQ) / FREQOFF_STEP_DIV);
+}
+
 uint32_t rf_comm_set_pwr (int32_t pwr)
 {
     //For now it is assumed bitrate < 5kbps
+    g_radio.tx_power = pwr;
     if (pwr > 14)
     {
         pwr = 14;
@@ -388,66 +681,349 @@ uint32_t rf_comm_pkt_config (rf_comm_pkt_t * p_pkt_config)
     return 0;
 }
 
+/** Write the packet after the long preamble of rf_comm_pkt_send_wake */
+static void wake_preamble_done (void)
+{
+	trx8BitRegAccess(RADIO_WRITE_ACCESS|RADIO_BURST_ACCESS, TXFIFO, g_arr_pkt,
+            g_arr_pkt[0] + 1);
+}
+
+/** The radio has gone to TX with the TX FIFO loaded for a normal send, or
+ *  empty for the long preamble */
+static void tx_started (void)
+{
+    g_current_state = R_TX;
+    if(g_tx_wake_ms != 0)
+    {
+        ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+                MS_TIMER_TICKS_MS(g_tx_wake_ms + RF_COMM_WAKE_MARGIN_MS),
+                wake_preamble_done);
+    }
+}
+
+static void csma_check (void);
+
+/** Wait a random time in the backoff window, which doubles with each check */
+static void csma_backoff_start (void)
+{
+    uint32_t window = g_csma.max_backoff_ms;
+
+    if((g_csma_attempts < 16)
+            && ((g_csma.min_backoff_ms << g_csma_attempts) < window))
+    {
+        window = g_csma.min_backoff_ms << g_csma_attempts;
+    }
+    ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+            MS_TIMER_TICKS_MS(1 + ((window != 0) ? random_num_below (window) : 0)),
+            csma_check);
+}
+
+/** Go to RX till the carrier sense is valid and send with TXONCCA */
+static void csma_check (void)
+{
+    uint8_t reg = 0;
+    uint32_t wait_us = 0;
+
+    g_csma_attempts++;
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_clear (g_comm_hw.rf_pa_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+#endif
+    trxSpiCmdStrobe (SRX);
+    do
+    {
+        hal_nop_delay_us (RF_COMM_CCA_POLL_US);
+        wait_us += RF_COMM_CCA_POLL_US;
+        trx16BitRegAccess (RADIO_READ_ACCESS, 0x2F, (0xFF & RSSI0), &reg, 1);
+    }while(((reg & RSSI0_CARRIER_SENSE_VALID) == 0)
+            && (wait_us < RF_COMM_CCA_TIMEOUT_US));
+
+    //The radio stays in RX if the channel isn't clear
+    trxSpiCmdStrobe (STX);
+    hal_nop_delay_us (RF_COMM_CCA_POLL_US);
+    trx16BitRegAccess (RADIO_READ_ACCESS, 0x2F, (0xFF & MARC_STATUS0), &reg, 1);
+
+    if((reg & MARC_STATUS0_TXONCCA_FAILED) == 0)
+    {
+#ifdef RF_COMM_AMPLIFIRE
+        hal_gpio_pin_clear (g_comm_hw.rf_lna_pin);
+        hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
+#endif
+        g_csma_stats.last_attempts = g_csma_attempts;
+        g_csma_stats.sent++;
+        tx_started ();
+        return;
+    }
+
+    g_csma_stats.busy++;
+    //Back off in IDLE, without the packet received meanwhile
+    trxSpiCmdStrobe (SIDLE);
+    trxSpiCmdStrobe (SFRX);
+    if(g_csma_attempts < g_csma.max_attempts)
+    {
+        csma_backoff_start ();
+        return;
+    }
+
+    log_printf("CSMA Dropped\n");
+    g_csma_stats.last_attempts = g_csma_attempts;
+    g_csma_stats.dropped++;
+    trxSpiCmdStrobe (SFTX);
+    g_current_state = R_IDLE;
+    if(gp_tx_failed != NULL)
+    {
+        gp_tx_failed (RF_COMM_TX_CCA_FAIL);
+    }
+}
+
+/** Send the loaded TX FIFO now or after the listen before talk */
+static void tx_start (void)
+{
+    if(g_csma.max_attempts == 0)
+    {
+        trxSpiCmdStrobe(STX);               // Change state to TX, initiating
+        tx_started ();
+    }
+    else
+    {
+        g_csma_attempts = 0;
+        g_current_state = R_CCA;
+        csma_backoff_start ();
+    }
+}
+
+uint32_t rf_comm_csma_config (rf_comm_csma_t * p_csma)
+{
+    uint8_t thr;
+
+    if(p_csma != &g_csma)
+    {
+        memcpy (&g_csma, p_csma, sizeof(rf_comm_csma_t));
+    }
+    if(g_csma.max_attempts != 0)
+    {
+        //The carrier sense threshold is in dB above the RSSI offset
+        thr = (uint8_t) (g_csma.cca_thr_dbm + RSSI_OFFSET);
+        trx8BitRegAccess (RADIO_WRITE_ACCESS, (0xFF & AGC_CS_THR), &thr, 1);
+    }
+    return 0;
+}
+
+void rf_comm_get_csma_stats (rf_comm_csma_stats_t * p_stats)
+{
+    memcpy (p_stats, &g_csma_stats, sizeof(rf_comm_csma_stats_t));
+}
+
 uint32_t rf_comm_pkt_send (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
 {
+    timer_cancel ();
+    listen_exit ();
+    //SFTX works only in IDLE and from IDLE the STX isn't gated by the CCA
+    trxSpiCmdStrobe (SIDLE);
     trxSpiCmdStrobe (SFTX);
+    cal_if_due ();
 #ifdef RF_COMM_AMPLIFIRE
     hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
     hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
 #endif
-    g_arr_pkt[0] = 4+len;  //Change this values
-    g_arr_pkt[4] = pkt_type;
-    memcpy (&g_arr_pkt[5], p_data, len);
+    g_arr_pkt[0] = RF_COMM_HDR_LEN+len;
+    g_arr_pkt[1 + RF_COMM_HDR_SEQ_POS] = g_tx_seq++;
+    g_arr_pkt[1 + RF_COMM_HDR_TYPE_POS] = pkt_type;
+    memcpy (&g_arr_pkt[1 + RF_COMM_HDR_LEN], p_data, len);
     
-	trx8BitRegAccess(RADIO_WRITE_ACCESS|RADIO_BURST_ACCESS, TXFIFO, g_arr_pkt, len+5);
-	trxSpiCmdStrobe(STX);               // Change state to TX, initiating
-    g_current_state = R_TX;
+	trx8BitRegAccess(RADIO_WRITE_ACCESS|RADIO_BURST_ACCESS, TXFIFO, g_arr_pkt,
+            1+RF_COMM_HDR_LEN+len);
+    g_tx_wake_ms = 0;
+    tx_start ();
+    return 0;
+}
+
+uint32_t rf_comm_pkt_resend (uint8_t pkt_type, uint8_t * p_data, uint8_t len)
+{
+    g_tx_seq--;
+    return rf_comm_pkt_send (pkt_type, p_data, len);
+}
+
+uint32_t rf_comm_pkt_send_wake (uint8_t pkt_type, uint8_t * p_data, uint8_t len,
+        uint32_t interval_ms)
+{
+    timer_cancel ();
+    listen_exit ();
+    //SFTX works only in IDLE and from IDLE the STX isn't gated by the CCA
+    trxSpiCmdStrobe (SIDLE);
+    trxSpiCmdStrobe (SFTX);
+    cal_if_due ();
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_pa_pin);
+#endif
+    g_arr_pkt[0] = RF_COMM_HDR_LEN+len;
+    g_arr_pkt[1 + RF_COMM_HDR_SEQ_POS] = g_tx_seq++;
+    g_arr_pkt[1 + RF_COMM_HDR_TYPE_POS] = pkt_type;
+    memcpy (&g_arr_pkt[1 + RF_COMM_HDR_LEN], p_data, len);
+
+    //With the TX FIFO empty the preamble is sent till the packet is written
+    g_tx_wake_ms = interval_ms;
+    tx_start ();
+    return 0;
+}
+
+uint32_t rf_comm_listen_start (uint32_t interval_ms)
+{
+    uint32_t ticks = interval_ms * (RF_RCOSC_FREQ/1000);
+    uint8_t res = 0;
+    uint8_t event0[2];
+
+    //EVENT0 is 16 bits, each step of WOR_RES is 2^5 RCOSC periods
+    while((ticks > 0xFFFF) && (res < 3))
+    {
+        ticks >>= 5;
+        res++;
+    }
+    if(ticks > 0xFFFF)
+    {
+        ticks = 0xFFFF;
+    }
+    else if(ticks == 0)
+    {
+        ticks = 1;
+    }
+
+    timer_cancel ();
+    listen_exit ();
+    trxSpiCmdStrobe (SIDLE);
+    reg_write (WOR_CFG1, WOR_CFG1_LISTEN | (res << WOR_CFG1_RES_Pos));
+    event0[0] = (ticks >> 8) & 0xFF;
+    event0[1] = ticks & 0xFF;
+    trx8BitRegAccess (RADIO_WRITE_ACCESS | RADIO_BURST_ACCESS,
+            (0xFF & WOR_EVENT0_MSB), event0, 2);
+    reg_write (RFEND_CFG0, RFEND_CFG0_LISTEN);
+
+    //Calibrate the RCOSC to the XOSC on the SIDLE strobe
+    reg_write (WOR_CFG0, WOR_CFG0_LISTEN | WOR_CFG0_RC_CAL);
+    trxSpiCmdStrobe (SIDLE);
+    reg_write (WOR_CFG0, WOR_CFG0_LISTEN);
+
+#ifdef RF_COMM_AMPLIFIRE
+    hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
+    hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
+#endif
+    g_current_state = R_RX;
+    g_is_listening = true;
+    trxSpiCmdStrobe (SFRX);
+    trxSpiCmdStrobe (SWORRST);
+    trxSpiCmdStrobe (SWOR);
+    return 0;
+}
+
+uint32_t rf_comm_listen_stop (void)
+{
+    listen_exit ();
+    g_current_state = R_IDLE;
     return 0;
 }
 
 uint32_t rf_comm_rx_enable ()
 {
+    timer_cancel ();
+    listen_exit ();
 #ifdef RF_COMM_AMPLIFIRE
     hal_gpio_pin_set (g_comm_hw.rf_lna_pin);
     hal_gpio_pin_set (g_comm_hw.rf_hgm_pin);
 #endif
     g_current_state = R_RX;
+    g_rx_buf_len = 0;
     trxSpiCmdStrobe (SFRX);
 	trxSpiCmdStrobe(SRX);               // Change state to RX, initiating
     return 0;
 }
 
+static void rx_window_timeout (void)
+{
+    g_is_rx_window = false;
+    trxSpiCmdStrobe (SIDLE);
+    trxSpiCmdStrobe (SFRX);
+    g_current_state = R_IDLE;
+    if(gp_rx_failed != NULL)
+    {
+        gp_rx_failed (RF_COMM_RX_TIMEOUT);
+    }
+}
 
-uint32_t rf_comm_pkt_receive (uint8_t * p_rxbuff, uint8_t * p_len)
+uint32_t rf_comm_rx_window (uint32_t timeout_ms)
 {
-    uint8_t pktLen;
-    uint8_t status;
-//	trx16BitRegAccess(RADIO_READ_ACCESS, 0x2F, 0xff & NUM_RXBYTES, &pktLen, 1);
+    rf_comm_rx_enable ();
+    g_is_rx_window = true;
+    ms_timer_start (MS_TIMER_USED_RF_COMM, MS_SINGLE_CALL,
+            MS_TIMER_TICKS_MS(timeout_ms), rx_window_timeout);
+    return 0;
+}
 
-    trx8BitRegAccess(RADIO_READ_ACCESS, RXFIFO, &pktLen, 1);
-    *p_len = pktLen;
-    log_printf("Pkt Len : %d\n", pktLen);
-	if (pktLen > 0)
-    {
+uint8_t rf_comm_get_tx_seq (void)
+{
+    return (uint8_t) (g_tx_seq - 1);
+}
+
+
+/** Where rf_comm_pkt_receive copies the packet */
+static uint8_t * gp_rx_dest;
+static uint8_t * gp_rx_dest_len;
+static uint32_t g_rx_dest_status;
+
+static void rx_copy_handler (rf_comm_rx_pkt_t * p_pkt)
+{
+    memcpy (gp_rx_dest, p_pkt->p_data, p_pkt->len);
+    *gp_rx_dest_len = p_pkt->len;
+    g_rx_dest_status = p_pkt->crc_ok ? CRC_OK : 0;
+}
 
-		trx8BitRegAccess(RADIO_READ_ACCESS|RADIO_BURST_ACCESS, RXFIFO, p_rxbuff, pktLen);
-		/* retrieve the FIFO content */
+/** Go back to sniffing after a packet in the listen mode */
+static void listen_resume (void)
+{
+    if(g_is_listening)
+    {
+        //The radio stays in RX after the packet, go back to sleep and sniff
+        trxSpiCmdStrobe(SIDLE);
+        trxSpiCmdStrobe(SFRX);
+        trxSpiCmdStrobe(SWOR);
+        g_rx_buf_len = 0;
+    }
+}
 
+uint32_t rf_comm_pkt_receive (uint8_t * p_rxbuff, uint8_t * p_len)
+{
+    gp_rx_dest = p_rxbuff;
+    gp_rx_dest_len = p_len;
+    g_rx_dest_status = 0;
+    *p_len = 0;
 
-		/* retrieve the CRC status information */
-		trx16BitRegAccess(RADIO_READ_ACCESS, 0x2F, 0xff & LQI_VAL, &status, 1);
+    rx_fifo_read ();
+    (void) rx_buf_parse (rx_copy_handler, 1);
+    g_current_state = R_RX;
+    listen_resume ();
+    return g_rx_dest_status;
+}
 
-		/* Return CRC_OK bit */
-		status  = status & CRC_OK;
-        trxSpiCmdStrobe(SFRX);	                     // Flush RXFIFO
+uint32_t rf_comm_pkt_receive_all (rf_comm_rx_pkt_handler_t handler)
+{
+    uint32_t pkts;
 
-	}
+    rx_fifo_read ();
+    pkts = rx_buf_parse (handler, UINT32_MAX);
     g_current_state = R_RX;
-    return status;
+    listen_resume ();
+    return pkts;
+}
+
+uint32_t rf_comm_get_rx_overflows (void)
+{
+    return g_rx_overflows;
 }
 
 uint32_t rf_comm_idle ()
 {
+    timer_cancel ();
+    listen_exit ();
 	/* Force transciever idle state */
 	trxSpiCmdStrobe(SIDLE);
 
@@ -465,15 +1041,17 @@ uint32_t rf_comm_sleep ()
     hal_gpio_pin_clear (g_comm_hw.rf_lna_pin);
     hal_gpio_pin_clear (g_comm_hw.rf_pa_pin);
 #endif
+    timer_cancel ();
+    listen_exit ();
 	/* Force transciever idle state */
-    trxSpiCmdStrobe(SRES);
-    hal_nop_delay_ms (20);
+    trxSpiCmdStrobe(SIDLE);
 
     while(rf_comm_get_state ())
     {
     }
 
-	/* Enter sleep state on exit */
+	/* Enter sleep state on exit, the registers and the calibration of the
+	 * FS are kept, the FIFOs aren't */
 	trxSpiCmdStrobe(SPWD);
 
 	return(0);
@@ -489,16 +1067,54 @@ uint32_t rf_comm_flush(void)
 
 uint32_t rf_comm_wake(void)
 {
+    uint8_t freq_regs[3];
 
+    if(rf_spi_wait_ready (RF_COMM_WAKE_TIMEOUT_US) != 0)
+    {
+        return 1;
+    }
 	/* Force transciever idle state */
 	trxSpiCmdStrobe(SIDLE);
 
-	/* 1 ms delay for letting RX settle */
-	hal_nop_delay_us (5000);
-
+    if(g_is_configured)
+    {
+        //A reset of the radio in the sleep, such as on a brown out, loses
+        //the configuration
+        trx16BitRegAccess (RADIO_READ_ACCESS | RADIO_BURST_ACCESS, 0x2F,
+                (0xFF & FREQ2), freq_regs, 3);
+        if(memcmp (freq_regs, g_freq_regs, sizeof(freq_regs)) != 0)
+        {
+            log_printf("%s : Config lost\n", __func__);
+            config_write (&g_radio);
+        }
+        cal_if_due ();
+    }
 	return(0);
 }
 
+void rf_comm_cal_update (uint32_t elapsed_s, int32_t temp_c)
+{
+    int32_t delta_c = 0;
+
+    g_cal_age_s += elapsed_s;
+    if(temp_c != RF_COMM_TEMP_UNKNOWN)
+    {
+        //The first temperature known is taken as that of the calibration
+        if(g_cal_temp_c == RF_COMM_TEMP_UNKNOWN)
+        {
+            g_cal_temp_c = temp_c;
+        }
+        g_temp_c = temp_c;
+        delta_c = (temp_c > g_cal_temp_c) ?
+                (temp_c - g_cal_temp_c) : (g_cal_temp_c - temp_c);
+    }
+    if((g_cal_age_s >= RF_COMM_CAL_INTERVAL_S)
+            || (delta_c >= RF_COMM_CAL_TEMP_DELTA_C))
+    {
+        g_is_cal_due = true;
+    }
+}
+
 int8_t rf_comm_get_rssi ()
 {
 	int8_t rssi;
@@ -530,6 +1146,8 @@ void rf_comm_disable_irq ()
         
     NRF_GPIOTE->CONFIG[GPIOTE_USED0] = 0;
     NRF_GPIOTE->INTENCLR = 1 << GPIOTE_USED0;
+    NRF_GPIOTE->CONFIG[GPIOTE_USED1] = 0;
+    NRF_GPIOTE->INTENCLR = 1 << GPIOTE_USED1;
     
 }
 
@@ -541,6 +1159,11 @@ void rf_comm_enable_irq()
         | (g_comm_hw.rf_gpio2_pin << GPIOTE_CONFIG_PSEL_Pos)
         | (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
     NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED0;
+    NRF_GPIOTE->CONFIG[GPIOTE_USED1] =
+        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos)
+        | (g_comm_hw.rf_gpio0_pin << GPIOTE_CONFIG_PSEL_Pos)
+        | (GPIOTE_CONFIG_POLARITY_LoToHi << GPIOTE_CONFIG_POLARITY_Pos);
+    NRF_GPIOTE->INTENSET = 1 << GPIOTE_USED1;
 
 }
 
@@ -561,16 +1184,22 @@ uint32_t rf_comm_get_radio_id ()
 }
 
 #if ISR_MANAGER == 1
-void rf_comm_gpiote_Handler ()
+void rf_comm_gpiote_Handler (uint32_t fired)
 #else
 void GPIOTE_IRQHandler ()
 #endif
 {
-    if(NRF_GPIOTE->EVENTS_IN[GPIOTE_USED0])
-    {
 #if ISR_MANAGER == 0
-        NRF_GPIOTE->EVENTS_IN[GPIOTE_USED0] = 0;
+    uint32_t fired = isr_dispatch_take (NRF_GPIOTE);
 #endif
+    //The RX FIFO is above the threshold during a long packet
+    if(fired & ISR_DISPATCH_EVT(NRF_GPIOTE, NRF_GPIOTE->EVENTS_IN[GPIOTE_USED1]))
+    {
+        rx_fifo_read ();
+    }
+
+    if(fired & ISR_DISPATCH_EVT(NRF_GPIOTE, NRF_GPIOTE->EVENTS_IN[GPIOTE_USED0]))
+    {
         
 //        if(radio_check_status_flag (MARC_NO_FAILURE)) 
 //        {
@@ -614,6 +1243,7 @@ void GPIOTE_IRQHandler ()
             if(g_current_state == R_RX)
             {
                 log_printf("Rx Done\n");
+                freq_off_est_read ();
                 g_current_state = R_IDLE;
                 if(gp_rx_done != NULL)
                 {
@@ -622,6 +1252,17 @@ void GPIOTE_IRQHandler ()
             }
         }
 
+        //RX is restarted here after an overflow of the RX FIFO, and the
+        //packets received before it are passed on
+        else if((g_marc_sts1 == MARC_RX_FIFO_OF) && (g_current_state == R_RX))
+        {
+            rx_fifo_read ();
+            if((rx_buf_complete_len () != 0) && (gp_rx_done != NULL))
+            {
+                g_current_state = R_IDLE;
+                gp_rx_done (g_marc_sts1);
+            }
+        }
         else
         {
             if(g_current_state == R_TX)
@@ -633,7 +1274,10 @@ void GPIOTE_IRQHandler ()
                     gp_tx_failed (g_marc_sts1);
                 }
             }
-            if(g_current_state == R_RX)
+            //In the listen mode the radio goes back to sniff by itself and
+            //in an RX window it stays in RX till the timeout
+            if((g_current_state == R_RX) && (g_is_listening == false)
+                    && (g_is_rx_window == false))
             {
                 log_printf("Rx Failed\n");
                 g_current_state = R_IDLE;
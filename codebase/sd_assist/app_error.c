@@ -19,6 +19,18 @@
 #include "app_error.h"
 #include "nrf.h"
 
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+#if defined WARM_BOOT_USED
+#include "warm_boot.h"
+/** Record the fault in the snapshot of the warm boot module */
+#define RECORD_FAULT(fault, id, pc)     warm_boot_fault(fault, id, pc)
+#else
+#define RECORD_FAULT(fault, id, pc)
+#endif
+
 
 #ifdef DEBUG
 
@@ -29,6 +41,8 @@ noreturn void app_error_handler(uint32_t error_code, uint32_t line_num, const ui
 {
     // This call can be used for ONLY debug purposes during application development.
     log_printf("Error of 0x%X at %d in  %s\n", error_code, line_num, p_file_name);
+    RECORD_FAULT(WARM_BOOT_FAULT_APP_ERROR, error_code,
+            (uint32_t) __builtin_return_address(0));
 
     // On error, the system can only recover with a reset.
     NVIC_SystemReset();
@@ -39,6 +53,7 @@ noreturn void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
 {
     // This call can be used for ONLY debug purposes during application development.
     log_printf("Error of 0x%X ID at 0x%X PC with 0x%X info\n", id, pc, info);
+    RECORD_FAULT(WARM_BOOT_FAULT_SD, id, pc);
 
     // On error, the system can only recover with a reset.
     NVIC_SystemReset();
@@ -49,12 +64,13 @@ noreturn void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
 
 void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
 {
-
+    RECORD_FAULT(WARM_BOOT_FAULT_APP_ERROR, error_code,
+            (uint32_t) __builtin_return_address(0));
 }
 
 void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
 {
-
+    RECORD_FAULT(WARM_BOOT_FAULT_SD, id, pc);
 }
 
 #endif  /* DEBUG flag as compiler flag */
@@ -0,0 +1,231 @@
+/**
+ *  rtt_chan.c : Multiple channel RTT transport
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rtt_chan.h"
+#include "nrf.h"
+#include "nrf_util.h"
+#include "nrf_assert.h"
+#include "string.h"
+
+/** The buffer of the binary data channel */
+static uint8_t data_buf[RTT_CHAN_DATA_SIZE];
+
+static rtt_chan_policy_t policies[RTT_CHAN_UP_COUNT];
+static rtt_chan_stats_t stats[RTT_CHAN_UP_COUNT];
+
+static const rtt_chan_cmd_t * cmd_list;
+static uint32_t cmd_count = 0;
+
+/** The command line being received and its length */
+static char line[RTT_CHAN_CMD_LINE_SIZE];
+static uint32_t line_len = 0;
+/** If the line is too long and is dropped till its end */
+static bool is_line_dropped = false;
+
+/** The free space in an up ring, one byte is always left empty */
+static uint32_t avail_space(SEGGER_RTT_BUFFER_UP * ring)
+{
+    uint32_t rd = ring->RdOff;
+    uint32_t wr = ring->WrOff;
+
+    if(rd <= wr)
+    {
+        return ring->SizeOfBuffer - 1 - wr + rd;
+    }
+    return rd - wr - 1;
+}
+
+void rtt_chan_init(void)
+{
+    SEGGER_RTT_Init();
+    //Channel 0 keeps its buffer from SEGGER_RTT.c, used by SEGGER_RTT_printf
+    rtt_chan_up_config(RTT_CHAN_LOG, "Terminal", _SEGGER_RTT.aUp[0].pBuffer,
+            _SEGGER_RTT.aUp[0].SizeOfBuffer, RTT_CHAN_LOG_POLICY);
+    rtt_chan_up_config(RTT_CHAN_DATA, "Data", data_buf, sizeof(data_buf),
+            RTT_CHAN_DATA_POLICY);
+}
+
+void rtt_chan_up_config(uint32_t chan, const char * name, void * buf,
+        uint32_t size, rtt_chan_policy_t policy)
+{
+    ASSERT(chan < RTT_CHAN_UP_COUNT);
+
+    //SEGGER_RTT_printf only blocks or skips, any overwrite is done here
+    SEGGER_RTT_ConfigUpBuffer(chan, name, buf, size,
+            (policy == RTT_CHAN_BLOCK) ? SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL
+                    : SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+    policies[chan] = policy;
+    memset(&stats[chan], 0, sizeof(rtt_chan_stats_t));
+}
+
+bool rtt_chan_reserve(uint32_t chan, uint32_t len, rtt_chan_span_t * span)
+{
+    ASSERT(chan < RTT_CHAN_UP_COUNT);
+    SEGGER_RTT_BUFFER_UP * ring = &_SEGGER_RTT.aUp[chan];
+    uint32_t avail;
+    ASSERT(len < ring->SizeOfBuffer);
+
+    while(1)
+    {
+        nrf_util_critical_region_enter(&span->cr_state);
+        avail = avail_space(ring);
+        if((avail >= len) || (policies[chan] != RTT_CHAN_BLOCK))
+        {
+            break;
+        }
+        //Let the interrupts run while the host reads
+        nrf_util_critical_region_exit(span->cr_state);
+    }
+
+    if(avail < len)
+    {
+#if RTT_CHAN_OVERWRITE_UNSAFE == 1
+        if(policies[chan] == RTT_CHAN_OVERWRITE)
+        {
+            //Move the read offset past the oldest bytes to make the space
+            uint32_t rd = ring->RdOff + (len - avail);
+            ring->RdOff = (rd >= ring->SizeOfBuffer) ? (rd - ring->SizeOfBuffer) : rd;
+            stats[chan].overwritten += (len - avail);
+        }
+        else
+#endif
+        {
+            stats[chan].dropped += len;
+            nrf_util_critical_region_exit(span->cr_state);
+            return false;
+        }
+    }
+
+    uint32_t wr = ring->WrOff;
+    uint32_t first = ring->SizeOfBuffer - wr;
+    if(first > len)
+    {
+        first = len;
+    }
+    span->chan = chan;
+    span->ptr[0] = (uint8_t *) ring->pBuffer + wr;
+    span->len[0] = first;
+    span->ptr[1] = (uint8_t *) ring->pBuffer;
+    span->len[1] = len - first;
+    return true;
+}
+
+void rtt_chan_commit(rtt_chan_span_t * span)
+{
+    SEGGER_RTT_BUFFER_UP * ring = &_SEGGER_RTT.aUp[span->chan];
+    uint32_t len = span->len[0] + span->len[1];
+    uint32_t wr = ring->WrOff + len;
+
+    //The data must be in RAM before the host sees the new write offset
+    __DMB();
+    ring->WrOff = (wr >= ring->SizeOfBuffer) ? (wr - ring->SizeOfBuffer) : wr;
+    stats[span->chan].bytes += len;
+    nrf_util_critical_region_exit(span->cr_state);
+}
+
+bool rtt_chan_write(uint32_t chan, const void * data, uint32_t len)
+{
+    rtt_chan_span_t span;
+
+    if(rtt_chan_reserve(chan, len, &span) == false)
+    {
+        return false;
+    }
+    memcpy(span.ptr[0], data, span.len[0]);
+    memcpy(span.ptr[1], (const uint8_t *) data + span.len[0], span.len[1]);
+    rtt_chan_commit(&span);
+    return true;
+}
+
+void rtt_chan_get_stats(uint32_t chan, rtt_chan_stats_t * p_stats)
+{
+    ASSERT(chan < RTT_CHAN_UP_COUNT);
+    CRITICAL_REGION_ENTER();
+    *p_stats = stats[chan];
+    CRITICAL_REGION_EXIT();
+}
+
+void rtt_chan_cmd_init(const rtt_chan_cmd_t * cmds, uint32_t count)
+{
+    cmd_list = cmds;
+    cmd_count = count;
+    line_len = 0;
+    is_line_dropped = false;
+}
+
+/** Call the handler of the command in the line */
+static void dispatch(void)
+{
+    char * args = line;
+    uint32_t name_len;
+
+    while(*args != ' ' && *args != '\0')
+    {
+        args++;
+    }
+    name_len = args - line;
+    if(*args == ' ')
+    {
+        *args++ = '\0';
+    }
+    if(name_len == 0)
+    {
+        return;
+    }
+
+    for(uint32_t i = 0; i < cmd_count; i++)
+    {
+        if(strcmp(cmd_list[i].name, line) == 0)
+        {
+            cmd_list[i].handler(args);
+            return;
+        }
+    }
+    (void) rtt_chan_write(RTT_CHAN_LOG, "?\n", 2);
+}
+
+void rtt_chan_cmd_process(void)
+{
+    char buf[16];
+    uint32_t count;
+
+    while((count = SEGGER_RTT_Read(RTT_CHAN_CMD, buf, sizeof(buf))) > 0)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(buf[i] == '\n' || buf[i] == '\r')
+            {
+                line[line_len] = '\0';
+                if(is_line_dropped == false)
+                {
+                    dispatch();
+                }
+                line_len = 0;
+                is_line_dropped = false;
+            }
+            else if(line_len < (RTT_CHAN_CMD_LINE_SIZE - 1))
+            {
+                line[line_len++] = buf[i];
+            }
+            else
+            {
+                is_line_dropped = true;
+            }
+        }
+    }
+}
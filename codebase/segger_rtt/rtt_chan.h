@@ -0,0 +1,213 @@
+/**
+ *  rtt_chan.h : Multiple channel RTT transport
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_peripheral_modules
+ * @{
+ *
+ * @defgroup group_rtt_chan RTT channels
+ * @brief Layer over SEGGER RTT which gives each kind of traffic its own
+ *  up channel, with its own buffer and policy for when the buffer is full,
+ *  so that the logs, binary data and command replies don't block or drop
+ *  each other. Channel 0 is the text log of log_printf, channel 1 is for
+ *  binary data and channel 2 is free for the application to configure with
+ *  @ref rtt_chan_up_config.
+ *
+ *  A producer reserves space in the ring of a channel with
+ *  @ref rtt_chan_reserve, writes into it directly and makes it visible to
+ *  the host with @ref rtt_chan_commit, so that the data isn't copied to an
+ *  intermediate buffer. The interrupts of the application are disabled from
+ *  the reserve till the commit, so producers at any interrupt level can
+ *  share a channel and the reservation must be filled quickly. Spans of
+ *  different channels can be held together, and are committed in the
+ *  reverse order of their reserve.
+ *
+ *  Lines written by the host on the down channel 0, such as by typing in
+ *  the telnet session of the J-Link RTT server, are dispatched to the
+ *  handlers of the commands given in @ref rtt_chan_cmd_init from
+ *  @ref rtt_chan_cmd_process. utils/rtt_logger.py shows the channels
+ *  separately and the throughput of each.
+ * @{
+ */
+
+#ifndef CODEBASE_SEGGER_RTT_RTT_CHAN_H_
+#define CODEBASE_SEGGER_RTT_RTT_CHAN_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "SEGGER_RTT.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+/** Up channel of the text logs */
+#define RTT_CHAN_LOG            0
+/** Up channel of the binary data */
+#define RTT_CHAN_DATA           1
+/** Down channel of the commands */
+#define RTT_CHAN_CMD            0
+
+/** Number of up channels */
+#define RTT_CHAN_UP_COUNT       SEGGER_RTT_MAX_NUM_UP_BUFFERS
+
+#ifndef RTT_CHAN_LOG_POLICY
+/** Policy of the log channel when its buffer is full */
+#define RTT_CHAN_LOG_POLICY     RTT_CHAN_DROP
+#endif
+
+#ifndef RTT_CHAN_DATA_SIZE
+/** Size of the buffer of the binary data channel in bytes */
+#define RTT_CHAN_DATA_SIZE      1024
+#endif
+
+#ifndef RTT_CHAN_DATA_POLICY
+/** Policy of the binary data channel when its buffer is full */
+#define RTT_CHAN_DATA_POLICY    RTT_CHAN_DROP
+#endif
+
+#ifndef RTT_CHAN_OVERWRITE_UNSAFE
+/** Set to 1 to have the @ref RTT_CHAN_OVERWRITE policy. It moves the read
+ *  offset of the ring, which belongs to the host. A host reading at the
+ *  same time can write back its own read offset over it and then read the
+ *  bytes being written as old data, so it is only for debugging. */
+#define RTT_CHAN_OVERWRITE_UNSAFE   0
+#endif
+
+#ifndef RTT_CHAN_CMD_LINE_SIZE
+/** Maximum length of a command line including its arguments */
+#define RTT_CHAN_CMD_LINE_SIZE  64
+#endif
+
+/** What a write does when there isn't space for it in the channel */
+typedef enum
+{
+    RTT_CHAN_BLOCK,     ///< Wait for the host to read, forever if none is connected
+    RTT_CHAN_DROP,      ///< Drop the new data
+#if RTT_CHAN_OVERWRITE_UNSAFE == 1
+    /** Drop the oldest data not yet read by the host, which races with the
+     *  host, see @ref RTT_CHAN_OVERWRITE_UNSAFE */
+    RTT_CHAN_OVERWRITE,
+#endif
+}rtt_chan_policy_t;
+
+/** Space reserved in the ring of a channel, which can wrap around its end */
+typedef struct
+{
+    /** The channel of the space */
+    uint32_t chan;
+    /** The start of the space before and after the wrap around */
+    uint8_t * ptr[2];
+    /** The length of the space before and after the wrap around */
+    uint32_t len[2];
+    /** The state of the critical region held till the commit */
+    uint8_t cr_state;
+}rtt_chan_span_t;
+
+/** Statistics of an up channel */
+typedef struct
+{
+    /** Bytes committed */
+    uint32_t bytes;
+    /** Bytes dropped as there wasn't space */
+    uint32_t dropped;
+    /** Bytes not read by the host which were overwritten, always 0 without
+     *  @ref RTT_CHAN_OVERWRITE_UNSAFE */
+    uint32_t overwritten;
+}rtt_chan_stats_t;
+
+/** Handler of a command, with the text after its name and a space */
+typedef void (*rtt_chan_cmd_handler_t)(char * args);
+
+/** A command of the down channel */
+typedef struct
+{
+    /** The name, which is the first word of the line */
+    const char * name;
+    /** The handler called with the rest of the line */
+    rtt_chan_cmd_handler_t handler;
+}rtt_chan_cmd_t;
+
+/**
+ * @brief Configure the log and binary data channels
+ */
+void rtt_chan_init(void);
+
+/**
+ * @brief Configure an up channel
+ * @param chan The channel, less than @ref RTT_CHAN_UP_COUNT
+ * @param name The name of the channel shown by the host
+ * @param buf The buffer of the channel
+ * @param size The size of the buffer in bytes
+ * @param policy What a write does when the buffer is full
+ */
+void rtt_chan_up_config(uint32_t chan, const char * name, void * buf,
+        uint32_t size, rtt_chan_policy_t policy);
+
+/**
+ * @brief Reserve space in the ring of an up channel. If successful, the
+ *  interrupts are disabled till @ref rtt_chan_commit is called.
+ * @param chan The up channel
+ * @param len The number of bytes, less than the size of the buffer
+ * @param span Filled with the space reserved
+ * @return True if the space is reserved, false if it is dropped
+ */
+bool rtt_chan_reserve(uint32_t chan, uint32_t len, rtt_chan_span_t * span);
+
+/**
+ * @brief Make the data written in the reserved space visible to the host
+ * @param span The space got from @ref rtt_chan_reserve
+ */
+void rtt_chan_commit(rtt_chan_span_t * span);
+
+/**
+ * @brief Copy data into an up channel, as per the policy of the channel
+ * @param chan The up channel
+ * @param data The data
+ * @param len The number of bytes, less than the size of the buffer
+ * @return True if written, false if dropped
+ */
+bool rtt_chan_write(uint32_t chan, const void * data, uint32_t len);
+
+/**
+ * @brief Get the statistics of an up channel since its configuration
+ * @param chan The up channel
+ * @param stats Filled with the statistics
+ */
+void rtt_chan_get_stats(uint32_t chan, rtt_chan_stats_t * stats);
+
+/**
+ * @brief Set the commands dispatched from the down channel
+ * @param cmds The array of the commands, which must remain valid
+ * @param count The number of commands
+ */
+void rtt_chan_cmd_init(const rtt_chan_cmd_t * cmds, uint32_t count);
+
+/**
+ * @brief Read the down channel and call the handler of each complete
+ *  line. An unknown command is replied to with "?" on the log channel.
+ *  To be called in the main loop.
+ */
+void rtt_chan_cmd_process(void);
+
+#endif /* CODEBASE_SEGGER_RTT_RTT_CHAN_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,189 @@
+/**
+ *  evt_sched.c : Priority event queue and run to completion scheduler
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "evt_sched.h"
+#include "stddef.h"
+#include "nrf_util.h"
+
+/** Check if EVT_SCHED_QUEUE_SIZE is power of 2 */
+#if (!(!(EVT_SCHED_QUEUE_SIZE & (EVT_SCHED_QUEUE_SIZE-1)) && EVT_SCHED_QUEUE_SIZE))
+#error EVT_SCHED_QUEUE_SIZE must be a power of 2
+#endif
+
+#define QUEUE_MASK      (EVT_SCHED_QUEUE_SIZE - 1)
+
+struct event
+{
+    uint16_t id;
+    void * data;
+};
+
+/** The queues for each priority. Posting is done in a critical region and
+ *  only @ref evt_sched_process pops, so the get index needs no protection. */
+static volatile struct
+{
+    uint32_t get_idx;
+    uint32_t put_idx;
+    struct event entry[EVT_SCHED_QUEUE_SIZE];
+} queue[EVT_SCHED_PRIO_MAX];
+
+static struct
+{
+    uint16_t id;
+    evt_sched_handler_t handler;
+} subscriber[EVT_SCHED_MAX_SUBSCRIBERS];
+
+static uint32_t subscriber_cnt;
+
+static evt_sched_stats_t stats[EVT_SCHED_PRIO_MAX];
+
+static void (*idle_cb)(void);
+
+void evt_sched_init(void (*idle_handler)(void))
+{
+    CRITICAL_REGION_ENTER();
+    for(uint32_t prio = 0; prio < EVT_SCHED_PRIO_MAX; prio++)
+    {
+        queue[prio].get_idx = queue[prio].put_idx = 0;
+        stats[prio].posted = 0;
+        stats[prio].dropped = 0;
+        stats[prio].max_depth = 0;
+    }
+    CRITICAL_REGION_EXIT();
+    idle_cb = idle_handler;
+}
+
+bool evt_sched_subscribe(uint16_t id, evt_sched_handler_t handler)
+{
+    for(uint32_t i = 0; i < subscriber_cnt; i++)
+    {
+        if((subscriber[i].id == id) && (subscriber[i].handler == handler))
+        {
+            return true;
+        }
+    }
+    if((subscriber_cnt == EVT_SCHED_MAX_SUBSCRIBERS) || (handler == NULL))
+    {
+        return false;
+    }
+    subscriber[subscriber_cnt].id = id;
+    subscriber[subscriber_cnt].handler = handler;
+    subscriber_cnt++;
+    return true;
+}
+
+void evt_sched_unsubscribe(uint16_t id, evt_sched_handler_t handler)
+{
+    for(uint32_t i = 0; i < subscriber_cnt; i++)
+    {
+        if((subscriber[i].id == id) && (subscriber[i].handler == handler))
+        {
+            //Shift the rest to keep the order of subscription
+            for(uint32_t j = i + 1; j < subscriber_cnt; j++)
+            {
+                subscriber[j - 1] = subscriber[j];
+            }
+            subscriber_cnt--;
+            return;
+        }
+    }
+}
+
+bool evt_sched_post(uint16_t id, evt_sched_prio_t prio, void * data)
+{
+    bool is_posted = false;
+
+    if(prio >= EVT_SCHED_PRIO_MAX)
+    {
+        prio = EVT_SCHED_PRIO_LOW;
+    }
+
+    CRITICAL_REGION_ENTER();
+    uint32_t depth = queue[prio].put_idx - queue[prio].get_idx;
+    if(depth < EVT_SCHED_QUEUE_SIZE)
+    {
+        queue[prio].entry[queue[prio].put_idx & QUEUE_MASK].id = id;
+        queue[prio].entry[queue[prio].put_idx & QUEUE_MASK].data = data;
+        queue[prio].put_idx++;
+        stats[prio].posted++;
+        if(depth + 1 > stats[prio].max_depth)
+        {
+            stats[prio].max_depth = depth + 1;
+        }
+        is_posted = true;
+    }
+    else
+    {
+        stats[prio].dropped++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return is_posted;
+}
+
+void evt_sched_process(void)
+{
+    uint32_t prio = 0;
+
+    while(prio < EVT_SCHED_PRIO_MAX)
+    {
+        if(queue[prio].put_idx == queue[prio].get_idx)
+        {
+            prio++;
+            continue;
+        }
+
+        uint32_t get_idx = queue[prio].get_idx;
+        uint16_t id = queue[prio].entry[get_idx & QUEUE_MASK].id;
+        void * data = queue[prio].entry[get_idx & QUEUE_MASK].data;
+        queue[prio].get_idx = get_idx + 1;
+
+        for(uint32_t i = 0; i < subscriber_cnt; i++)
+        {
+            if(subscriber[i].id == id)
+            {
+                subscriber[i].handler(id, data);
+            }
+        }
+
+        //A higher priority event could have been posted by the handler or an ISR
+        prio = 0;
+    }
+
+    if(idle_cb != NULL)
+    {
+        idle_cb();
+    }
+}
+
+bool evt_sched_is_empty(void)
+{
+    for(uint32_t prio = 0; prio < EVT_SCHED_PRIO_MAX; prio++)
+    {
+        if(queue[prio].put_idx != queue[prio].get_idx)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const evt_sched_stats_t * evt_sched_get_stats(evt_sched_prio_t prio)
+{
+    return &stats[prio];
+}
@@ -0,0 +1,145 @@
+/**
+ *  evt_sched.h : Priority event queue and run to completion scheduler
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_util
+ * @{
+ *
+ * @defgroup group_evt_sched Event scheduler
+ * @brief Module to defer work from interrupt handlers to the main thread.
+ *  Events with an ID and a payload pointer are posted from any context to
+ *  one of the priority queues. @ref evt_sched_process, called from the main
+ *  loop, dispatches them one at a time to the handlers subscribed to the ID,
+ *  always taking the event from the highest priority queue which isn't empty.
+ *  Each handler runs to completion before the next event is taken.
+ * @{
+ */
+
+#ifndef CODEBASE_UTIL_EVT_SCHED_H_
+#define CODEBASE_UTIL_EVT_SCHED_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+#ifndef EVT_SCHED_QUEUE_SIZE
+/** Number of events in each priority queue, must be a power of 2 */
+#define EVT_SCHED_QUEUE_SIZE        16
+#endif
+
+#ifndef EVT_SCHED_MAX_SUBSCRIBERS
+/** Maximum number of (event ID, handler) subscriptions */
+#define EVT_SCHED_MAX_SUBSCRIBERS   16
+#endif
+
+/** IDs from this value onwards are reserved for the modules in the codebase,
+ *  the application's event IDs should be below it */
+#define EVT_SCHED_ID_CODEBASE_BASE  0xFF00
+
+/** The priority levels of the events */
+typedef enum
+{
+    EVT_SCHED_PRIO_HIGH,    ///< Dispatched before all other events
+    EVT_SCHED_PRIO_MID,     ///< Dispatched when no high priority event is pending
+    EVT_SCHED_PRIO_LOW,     ///< Dispatched when no other event is pending
+    EVT_SCHED_PRIO_MAX      ///< Not a priority, the number of priority levels
+}evt_sched_prio_t;
+
+/** Handler called in the main thread with the ID and payload of an event */
+typedef void (*evt_sched_handler_t)(uint16_t id, void * data);
+
+/** The statistics of a priority queue */
+typedef struct
+{
+    /** Events posted successfully */
+    uint32_t posted;
+    /** Events dropped as the queue was full */
+    uint32_t dropped;
+    /** Highest number of events pending in the queue */
+    uint32_t max_depth;
+}evt_sched_stats_t;
+
+/**
+ * @brief Initialize the scheduler by emptying the queues and resetting the
+ *  statistics. The subscriptions are kept.
+ * @param idle_handler Function called at the end of @ref evt_sched_process
+ *  when all the queues are empty, such as to let the power management go
+ *  to sleep. NULL if not required.
+ * @note The state is zero initialized at reset, so modules can subscribe
+ *  before the application calls this.
+ */
+void evt_sched_init(void (*idle_handler)(void));
+
+/**
+ * @brief Subscribe a handler to the events with an ID. An event can have
+ *  more than one handler, which are called in the order of subscription.
+ * @param id The ID of the events
+ * @param handler The function to be called for the events
+ * @return True if subscribed or already subscribed, false if the list of
+ *  subscriptions is full
+ */
+bool evt_sched_subscribe(uint16_t id, evt_sched_handler_t handler);
+
+/**
+ * @brief Unsubscribe a handler from the events with an ID
+ * @param id The ID of the events
+ * @param handler The function subscribed to the events
+ */
+void evt_sched_unsubscribe(uint16_t id, evt_sched_handler_t handler);
+
+/**
+ * @brief Post an event to be dispatched in the main thread. Can be called
+ *  from any interrupt priority.
+ * @param id The ID of the event
+ * @param prio The priority of the event
+ * @param data The payload passed to the handlers, which must remain valid
+ *  till the event is dispatched
+ * @return True if posted, false if the queue of the priority is full. In this
+ *  case the event is dropped and counted in the statistics.
+ */
+bool evt_sched_post(uint16_t id, evt_sched_prio_t prio, void * data);
+
+/**
+ * @brief Dispatch the pending events in the order of their priority till all
+ *  the queues are empty and then call the idle handler. To be called in the
+ *  main loop after every wake up.
+ */
+void evt_sched_process(void);
+
+/**
+ * @brief Check if any event is pending
+ * @return True if all the queues are empty
+ */
+bool evt_sched_is_empty(void);
+
+/**
+ * @brief Get the statistics of a priority queue
+ * @param prio The priority of the queue
+ * @return Pointer to the statistics of the queue
+ */
+const evt_sched_stats_t * evt_sched_get_stats(evt_sched_prio_t prio);
+
+#endif /* CODEBASE_UTIL_EVT_SCHED_H_ */
+
+/**
+ * @}
+ * @}
+ */
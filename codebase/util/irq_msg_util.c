@@ -17,82 +17,57 @@
  */
 
 #include "irq_msg_util.h"
+#include "evt_sched.h"
 #include "stdbool.h"
 #include "stddef.h"
-#include "CBUF.h"
-#include "nrf_util.h"
-#include "string.h"
 #include "nrf_assert.h"
 
 //For all the code not public for file, message is shortened to msg
 
-/** @brief Size of the ring buffer for the message list
- *  @note Should be a power of 2 */
-#define msgbuf_SIZE  16
+/** @brief The event ID of a message type in the event scheduler */
+#define MSG_EVT_ID(type)    (EVT_SCHED_ID_CODEBASE_BASE + (type))
 
-/** Check if MSG_SIZE is power of 2 */
-#if (!(!(msgbuf_SIZE & (msgbuf_SIZE-1)) && msgbuf_SIZE))
-#error msgbuf_SIZE must be a power of 2
-#endif
-
-struct message
-{
-    irq_msg_types type;
-    void * more_data;
-};
+irq_msg_callbacks cb_list = { NULL, NULL };
 
-volatile static struct
+/**
+ * @brief Handler of the message events from the event scheduler
+ * @param id The event ID of the message type
+ * @param more_data The data of the message
+ */
+static void msg_handler(uint16_t id, void * more_data)
 {
-    uint32_t m_getIdx;
-    uint32_t m_putIdx;
-    struct message m_entry[msgbuf_SIZE];
-} msgbuf;
-
-irq_msg_callbacks cb_list = { NULL, NULL };
+    switch (id)
+    {
+    case MSG_EVT_ID(MSG_NEXT_INTERVAL):
+        cb_list.next_interval_cb((uint32_t) (more_data));
+        break;
+    case MSG_EVT_ID(MSG_STATE_CHANGE):
+        cb_list.state_change_cb((uint32_t) (more_data));
+        break;
+    default:
+        break;
+    }
+}
 
 void irq_msg_init(irq_msg_callbacks * cb_ptr)
 {
-    CBUF_Init(msgbuf);
-
     ASSERT((cb_ptr->next_interval_cb != NULL)
             && (cb_ptr->state_change_cb != NULL));
 
     cb_list.next_interval_cb = cb_ptr->next_interval_cb;
     cb_list.state_change_cb = cb_ptr->state_change_cb;
+
+    evt_sched_subscribe(MSG_EVT_ID(MSG_NEXT_INTERVAL), msg_handler);
+    evt_sched_subscribe(MSG_EVT_ID(MSG_STATE_CHANGE), msg_handler);
 }
 
 void irq_msg_push(irq_msg_types pushed_msg, void * more_data)
 {
-    CRITICAL_REGION_ENTER();
-
-    struct message msg;
-    msg.type = pushed_msg;
-    msg.more_data = more_data;
-
-    CBUF_Push(msgbuf, msg);
-
-    CRITICAL_REGION_EXIT();
+    //Same priority for both so that the messages are handled in order
+    evt_sched_post(MSG_EVT_ID(pushed_msg), EVT_SCHED_PRIO_MID, more_data);
 }
 
 void irq_msg_process(void)
 {
-    while (CBUF_Len(msgbuf))
-    {
-        struct message msg = CBUF_Pop(msgbuf);
-
-//    log_printf("_%x\n",msg.type);
-        switch (msg.type)
-        {
-        case MSG_NEXT_INTERVAL:
-            cb_list.next_interval_cb(
-                    (uint32_t) (msg.more_data));
-            break;
-        case MSG_STATE_CHANGE:
-            cb_list.state_change_cb(
-                    (uint32_t) (msg.more_data));
-            break;
-        default:
-            break;
-        }
-    }
+    evt_sched_process();
 }
@@ -24,6 +24,8 @@
  * @brief This module is used to pass messages from any higher priority
  *  interrupts to the main thread so that the higher
  *  priority interrupt can finish soon and off-load non-real time tasks.
+ *  The messages are passed as events of @ref group_evt_sched, so
+ *  evt_sched.c needs to be compiled along with this.
  * @{
  */
 
@@ -0,0 +1,77 @@
+/**
+ *  isr_dispatch.c : Profiling of the handlers called by the ISR manager
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "isr_dispatch.h"
+
+#if defined ISR_DISPATCH_PROFILE
+
+#include "stddef.h"
+#include "nrf_util.h"
+#include "log.h"
+
+/** List of the handlers profiled, in the order of their first call */
+static isr_dispatch_profile_t * profile_list;
+
+void isr_dispatch_profile_add(isr_dispatch_profile_t * profile, uint32_t cycles)
+{
+    uint32_t bucket = 0;
+
+    if(profile->count == 0)
+    {
+        //The DWT counter is enabled on the first call in any handler
+        if((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+        {
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CYCCNT = 0;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+            return;
+        }
+        CRITICAL_REGION_ENTER();
+        profile->next = profile_list;
+        profile_list = profile;
+        CRITICAL_REGION_EXIT();
+    }
+
+    profile->count++;
+    if(cycles > profile->max)
+    {
+        profile->max = cycles;
+    }
+    while((cycles >>= 1) && (bucket < (ISR_DISPATCH_PROFILE_BUCKETS - 1)))
+    {
+        bucket++;
+    }
+    profile->hist[bucket]++;
+}
+
+void isr_dispatch_profile_dump(void)
+{
+    for(isr_dispatch_profile_t * p = profile_list; p != NULL; p = p->next)
+    {
+        log_printf("%s: %d calls, max %d cycles\n", p->name, p->count, p->max);
+        for(uint32_t i = 0; i < ISR_DISPATCH_PROFILE_BUCKETS; i++)
+        {
+            if(p->hist[i])
+            {
+                log_printf(" >=%d: %d\n", 1 << i, p->hist[i]);
+            }
+        }
+    }
+}
+
+#endif
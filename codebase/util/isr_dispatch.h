@@ -0,0 +1,148 @@
+/**
+ *  isr_dispatch.h : Helpers for the ISR manager to dispatch and clear events
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_util
+ * @{
+ *
+ * @defgroup group_isr_dispatch ISR dispatch helpers
+ * @brief Helpers used by the isr_manager.c of the applications. In the nRF52
+ *  peripherals the event register n is at offset 0x100 + 4*n and its
+ *  interrupt is enabled with bit n of INTEN. So the events that can have
+ *  caused an interrupt are found from INTEN alone, without a table per
+ *  peripheral. These events are cleared before the module handlers are
+ *  called and the mask of them is passed to the handlers, which act only on
+ *  the events in the mask. So an event which arrives while the handlers run
+ *  isn't lost, raises the interrupt again and is handled once. The events
+ *  are taken even when no handler is compiled in for a peripheral, so that
+ *  they don't keep the interrupt pending.
+ *
+ *  When ISR_DISPATCH_PROFILE is defined, the cycles taken by each module
+ *  handler are recorded in a histogram using the DWT cycle counter and can
+ *  be printed with @ref isr_dispatch_profile_dump. isr_dispatch.c needs to
+ *  be compiled only in this case.
+ * @{
+ */
+
+#ifndef CODEBASE_UTIL_ISR_DISPATCH_H_
+#define CODEBASE_UTIL_ISR_DISPATCH_H_
+
+#include "stdint.h"
+
+/** Offset of the first event register of a peripheral */
+#define ISR_DISPATCH_EVENTS_OFFSET      0x100
+/** Offset of the INTENSET register of a peripheral, which reads as INTEN */
+#define ISR_DISPATCH_INTENSET_OFFSET    0x304
+
+/** Mask of an event of a peripheral as returned by @ref isr_dispatch_take,
+ *  for example ISR_DISPATCH_EVT(NRF_RTC1, NRF_RTC1->EVENTS_COMPARE[0]) */
+#define ISR_DISPATCH_EVT(p_periph, event)                                   \
+    (1UL << ((((uintptr_t) &(event)) - ((uintptr_t) (p_periph))             \
+            - ISR_DISPATCH_EVENTS_OFFSET)/4))
+
+/**
+ * @brief Get and clear the events of a peripheral which are both set and
+ *  enabled to generate an interrupt
+ * @param p_periph Pointer to the peripheral, such as NRF_RADIO
+ * @return The mask of the events with bit n for the event at 0x100 + 4*n
+ */
+static inline uint32_t isr_dispatch_take(volatile void * p_periph)
+{
+    volatile uint32_t * reg = (volatile uint32_t *) p_periph;
+    uint32_t inten = reg[ISR_DISPATCH_INTENSET_OFFSET/4];
+    uint32_t fired = 0;
+    uint32_t last = 0;
+
+    for(uint32_t n = 0; inten != 0; n++, inten >>= 1)
+    {
+        if((inten & 1) && reg[ISR_DISPATCH_EVENTS_OFFSET/4 + n])
+        {
+            reg[ISR_DISPATCH_EVENTS_OFFSET/4 + n] = 0;
+            fired |= (1UL << n);
+            last = n;
+        }
+    }
+    if(fired != 0)
+    {
+        //Read back the last cleared event so that the write is done before
+        //the ISR returns and the interrupt isn't triggered again
+        (void) reg[ISR_DISPATCH_EVENTS_OFFSET/4 + last];
+    }
+    return fired;
+}
+
+#if defined ISR_DISPATCH_PROFILE
+
+#include "nrf.h"
+
+/** Number of buckets in the histogram, bucket n counts durations from
+ *  2^n to 2^(n+1) - 1 cycles and the last one all the longer ones */
+#define ISR_DISPATCH_PROFILE_BUCKETS    16
+
+/** The profile of a module handler called from the ISR manager */
+typedef struct isr_dispatch_profile
+{
+    /** Name of the handler */
+    const char * name;
+    /** Next handler profiled, for the dump */
+    struct isr_dispatch_profile * next;
+    /** Number of calls */
+    uint32_t count;
+    /** Longest duration in cycles */
+    uint32_t max;
+    /** Histogram of the durations */
+    uint32_t hist[ISR_DISPATCH_PROFILE_BUCKETS];
+}isr_dispatch_profile_t;
+
+/**
+ * @brief Record the duration of a call of a handler
+ * @param profile The profile of the handler
+ * @param cycles Number of CPU cycles taken by the call
+ */
+void isr_dispatch_profile_add(isr_dispatch_profile_t * profile, uint32_t cycles);
+
+/**
+ * @brief Print the histograms of all the handlers called so far with
+ *  log_printf
+ */
+void isr_dispatch_profile_dump(void);
+
+/** Call a module handler with its arguments and record its duration */
+#define ISR_DISPATCH_CALL(handler, ...)                                     \
+    do                                                                      \
+    {                                                                       \
+        static isr_dispatch_profile_t __prof = { .name = #handler };        \
+        uint32_t __start = DWT->CYCCNT;                                     \
+        handler (__VA_ARGS__);                                              \
+        isr_dispatch_profile_add(&__prof, DWT->CYCCNT - __start);           \
+    }while(0)
+
+#else
+
+/** Call a module handler with its arguments, usually the mask of the
+ *  events taken with @ref isr_dispatch_take */
+#define ISR_DISPATCH_CALL(handler, ...) handler (__VA_ARGS__)
+
+#endif
+
+#endif /* CODEBASE_UTIL_ISR_DISPATCH_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,508 @@
+/**
+ *  nmea_parser.c : Streaming NMEA 0183 sentence parser
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "nmea_parser.h"
+#include "stddef.h"
+#include "string.h"
+
+/** The maximum number of comma separated fields in a parsed sentence */
+#define MAX_FIELDS          20
+
+/** The number of decimal places of the minutes kept in a coordinate */
+#define COORD_MIN_DECIMALS  6
+
+/** States of the byte-wise parsing of a sentence */
+typedef enum
+{
+    STATE_IDLE,         ///< Waiting for a '$'
+    STATE_BODY,         ///< Storing the sentence till the '*'
+    STATE_CHECKSUM_HI,  ///< Expecting the first hex digit of the checksum
+    STATE_CHECKSUM_LO,  ///< Expecting the second hex digit of the checksum
+}parse_state_t;
+
+static struct
+{
+    char line[NMEA_PARSER_MAX_LEN + 1];
+    uint32_t len;
+    uint8_t checksum;
+    uint8_t rx_checksum;
+    parse_state_t state;
+}parser;
+
+static nmea_parser_data_t nmea_data;
+
+static nmea_parser_stats_t stats;
+
+static void (*sentence_handler)(nmea_sentence_t type, nmea_parser_data_t * data);
+
+/**
+ * @brief Converts a hex character to its value
+ * @param c The character
+ * @return The value of the hex digit, -1 if it isn't one
+ */
+static int32_t hex_val(uint8_t c)
+{
+    if((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+    if((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Parses a decimal number as a fixed point integer
+ * @param field The field with the number, terminated by '\0'
+ * @param decimals The number of decimal places kept. Extra digits are dropped
+ * @param val Pointer where the number x 10^decimals is stored
+ * @return True if the field is a non-empty number that fits in 32 bits
+ */
+static bool parse_fixed(const char * field, uint32_t decimals, int32_t * val)
+{
+    bool neg = false;
+    bool digits = false;
+    bool in_frac = false;
+    uint32_t frac_cnt = 0;
+    uint32_t num = 0;
+
+    if(*field == '-')
+    {
+        neg = true;
+        field++;
+    }
+
+    for(; *field != '\0'; field++)
+    {
+        if(*field == '.')
+        {
+            if(in_frac)
+            {
+                return false;
+            }
+            in_frac = true;
+        }
+        else if((*field >= '0') && (*field <= '9'))
+        {
+            digits = true;
+            if(in_frac && (frac_cnt == decimals))
+            {
+                continue;
+            }
+            if(num > (INT32_MAX - 9)/10)
+            {
+                return false;
+            }
+            num = num*10 + (*field - '0');
+            frac_cnt += in_frac;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    for(; frac_cnt < decimals; frac_cnt++)
+    {
+        if(num > INT32_MAX/10)
+        {
+            return false;
+        }
+        num *= 10;
+    }
+
+    *val = neg ? -((int32_t) num) : ((int32_t) num);
+    return digits;
+}
+
+/**
+ * @brief Parses a coordinate in the NMEA (d)ddmm.mmmm format
+ * @param field The coordinate field
+ * @param hemi The hemisphere field, N, S, E or W
+ * @param max_deg The maximum degrees, 90 for latitude and 180 for longitude
+ * @param deg_e7 Pointer where the coordinate in degrees x 10^7 is stored
+ * @return True if the coordinate is valid
+ */
+static bool parse_coord(const char * field, const char * hemi, uint32_t max_deg,
+        int32_t * deg_e7)
+{
+    uint32_t int_part = 0;
+    uint32_t frac = 0;
+    uint32_t frac_cnt = 0;
+    bool digits = false;
+
+    //The integer part has at most 5 digits, so it is parsed separately to fit 32 bits
+    for(; (*field >= '0') && (*field <= '9'); field++)
+    {
+        if(int_part > 99999)
+        {
+            return false;
+        }
+        int_part = int_part*10 + (*field - '0');
+        digits = true;
+    }
+    if(*field == '.')
+    {
+        for(field++; (*field >= '0') && (*field <= '9'); field++)
+        {
+            if(frac_cnt < COORD_MIN_DECIMALS)
+            {
+                frac = frac*10 + (*field - '0');
+                frac_cnt++;
+            }
+        }
+    }
+    if((*field != '\0') || (digits == false))
+    {
+        return false;
+    }
+    for(; frac_cnt < COORD_MIN_DECIMALS; frac_cnt++)
+    {
+        frac *= 10;
+    }
+
+    uint32_t deg = int_part/100;
+    uint32_t min_u = (int_part%100)*1000000 + frac;
+    if((min_u >= 60000000) || (deg > max_deg))
+    {
+        return false;
+    }
+
+    //10^-6 minutes to 10^-7 degrees is a division by 6
+    int32_t val = deg*10000000 + (min_u + 3)/6;
+    if((hemi[0] == 'S') || (hemi[0] == 'W'))
+    {
+        val = -val;
+    }
+    else if((hemi[0] != 'N') && (hemi[0] != 'E'))
+    {
+        return false;
+    }
+    *deg_e7 = val;
+    return true;
+}
+
+/**
+ * @brief Parses the hhmmss.ss UTC time to centi-seconds of the day
+ * @param field The time field
+ * @param time_cs Pointer where the time is stored
+ * @return True if the time is valid
+ */
+static bool parse_time(const char * field, uint32_t * time_cs)
+{
+    int32_t val;
+    if(parse_fixed(field, 2, &val) == false)
+    {
+        return false;
+    }
+    uint32_t hhmmss = val/100;
+    uint32_t hh = hhmmss/10000, mm = (hhmmss/100)%100, ss = hhmmss%100;
+    if((val < 0) || (hh > 23) || (mm > 59) || (ss > 60))
+    {
+        return false;
+    }
+    *time_cs = ((hh*60 + mm)*60 + ss)*100 + val%100;
+    return true;
+}
+
+/**
+ * @brief Parses a dilution of precision field
+ * @param field The DOP field
+ * @param dop_c Pointer where the DOP x 100 is stored, @ref NMEA_PARSER_DOP_UNKNOWN
+ *  if the field is empty so that a previous DOP isn't taken for this fix
+ * @return True if the field is empty or valid
+ */
+static bool parse_dop(const char * field, uint16_t * dop_c)
+{
+    int32_t val;
+    if(*field == '\0')
+    {
+        *dop_c = NMEA_PARSER_DOP_UNKNOWN;
+        return true;
+    }
+    if((parse_fixed(field, 2, &val) == false) || (val < 0) || (val > UINT16_MAX))
+    {
+        return false;
+    }
+    *dop_c = val;
+    return true;
+}
+
+static bool parse_gga(char ** f, uint32_t num)
+{
+    int32_t val;
+    if(num < 10)
+    {
+        return false;
+    }
+    if((parse_fixed(f[6], 0, &val) == false) || (val < 0))
+    {
+        return false;
+    }
+    nmea_data.quality = val;
+    nmea_data.valid = (val != 0);
+    if(nmea_data.valid == false)
+    {
+        return true;
+    }
+
+    if((parse_time(f[1], &nmea_data.time_cs) == false) ||
+       (parse_coord(f[2], f[3], 90, &nmea_data.lat_e7) == false) ||
+       (parse_coord(f[4], f[5], 180, &nmea_data.lng_e7) == false) ||
+       (parse_dop(f[8], &nmea_data.hdop_c) == false))
+    {
+        return false;
+    }
+    if((parse_fixed(f[7], 0, &val) == true) && (val >= 0))
+    {
+        nmea_data.sats = val;
+    }
+    if(parse_fixed(f[9], 2, &val) == true)
+    {
+        nmea_data.alt_cm = val;
+    }
+    return true;
+}
+
+static bool parse_rmc(char ** f, uint32_t num)
+{
+    int32_t val;
+    if(num < 10)
+    {
+        return false;
+    }
+    nmea_data.valid = (f[2][0] == 'A');
+    if(nmea_data.valid == false)
+    {
+        return true;
+    }
+
+    if((parse_time(f[1], &nmea_data.time_cs) == false) ||
+       (parse_coord(f[3], f[4], 90, &nmea_data.lat_e7) == false) ||
+       (parse_coord(f[5], f[6], 180, &nmea_data.lng_e7) == false) ||
+       (parse_fixed(f[9], 0, &val) == false) || (val < 0))
+    {
+        return false;
+    }
+    nmea_data.date = val;
+    if((parse_fixed(f[7], 3, &val) == true) && (val >= 0))
+    {
+        nmea_data.speed_mknot = val;
+    }
+    return true;
+}
+
+static bool parse_gll(char ** f, uint32_t num)
+{
+    if(num < 7)
+    {
+        return false;
+    }
+    nmea_data.valid = (f[6][0] == 'A');
+    if(nmea_data.valid == false)
+    {
+        return true;
+    }
+
+    return ((parse_coord(f[1], f[2], 90, &nmea_data.lat_e7) == true) &&
+            (parse_coord(f[3], f[4], 180, &nmea_data.lng_e7) == true) &&
+            (parse_time(f[5], &nmea_data.time_cs) == true));
+}
+
+static bool parse_gsa(char ** f, uint32_t num)
+{
+    int32_t val;
+    if(num < 18)
+    {
+        return false;
+    }
+    if((parse_fixed(f[2], 0, &val) == false) || (val < 1) || (val > 3))
+    {
+        return false;
+    }
+    nmea_data.fix_type = val;
+    nmea_data.valid = (val > 1);
+
+    uint32_t sats = 0;
+    for(uint32_t i = 3; i <= 14; i++)
+    {
+        sats += (f[i][0] != '\0');
+    }
+    nmea_data.sats = sats;
+
+    return ((parse_dop(f[15], &nmea_data.pdop_c) == true) &&
+            (parse_dop(f[16], &nmea_data.hdop_c) == true) &&
+            (parse_dop(f[17], &nmea_data.vdop_c) == true));
+}
+
+/**
+ * @brief Splits the checksum verified sentence in @ref parser into its fields
+ *  and parses it based on its type
+ */
+static void process_sentence(void)
+{
+    char * fields[MAX_FIELDS];
+    uint32_t num = 0;
+    char * ptr = parser.line;
+
+    fields[num++] = ptr;
+    for(; *ptr != '\0'; ptr++)
+    {
+        if(*ptr == ',')
+        {
+            *ptr = '\0';
+            if(num == MAX_FIELDS)
+            {
+                break;
+            }
+            fields[num++] = ptr + 1;
+        }
+    }
+
+    //The address field is the two character talker ID and the sentence type
+    nmea_sentence_t type = NMEA_SENTENCE_UNKNOWN;
+    bool ok = true;
+    if(strlen(fields[0]) == 5)
+    {
+        const char * id = fields[0] + 2;
+        if(strcmp(id, "GGA") == 0)
+        {
+            type = NMEA_SENTENCE_GGA;
+            ok = parse_gga(fields, num);
+        }
+        else if(strcmp(id, "RMC") == 0)
+        {
+            type = NMEA_SENTENCE_RMC;
+            ok = parse_rmc(fields, num);
+        }
+        else if(strcmp(id, "GLL") == 0)
+        {
+            type = NMEA_SENTENCE_GLL;
+            ok = parse_gll(fields, num);
+        }
+        else if(strcmp(id, "GSA") == 0)
+        {
+            type = NMEA_SENTENCE_GSA;
+            ok = parse_gsa(fields, num);
+        }
+    }
+
+    if(ok == false)
+    {
+        stats.field_err[type]++;
+        return;
+    }
+
+    stats.parsed[type]++;
+    if((type != NMEA_SENTENCE_UNKNOWN) && (sentence_handler != NULL))
+    {
+        sentence_handler(type, &nmea_data);
+    }
+}
+
+void nmea_parser_init(void (*handler)(nmea_sentence_t type,
+        nmea_parser_data_t * data))
+{
+    sentence_handler = handler;
+    parser.state = STATE_IDLE;
+    parser.len = 0;
+    memset(&nmea_data, 0, sizeof(nmea_data));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void nmea_parser_feed(uint8_t byte)
+{
+    int32_t hex;
+
+    if(byte == '$')
+    {
+        if(parser.state != STATE_IDLE)
+        {
+            stats.framing_err++;
+        }
+        parser.len = 0;
+        parser.checksum = 0;
+        parser.state = STATE_BODY;
+        return;
+    }
+
+    switch(parser.state)
+    {
+    case STATE_IDLE:
+        break;
+    case STATE_BODY:
+        if(byte == '*')
+        {
+            parser.line[parser.len] = '\0';
+            parser.state = STATE_CHECKSUM_HI;
+        }
+        else if((byte == '\r') || (byte == '\n'))
+        {
+            //Sentences without a checksum aren't trusted
+            stats.checksum_err++;
+            parser.state = STATE_IDLE;
+        }
+        else if(parser.len == NMEA_PARSER_MAX_LEN)
+        {
+            stats.overflow_err++;
+            parser.state = STATE_IDLE;
+        }
+        else
+        {
+            parser.line[parser.len++] = byte;
+            parser.checksum ^= byte;
+        }
+        break;
+    case STATE_CHECKSUM_HI:
+        hex = hex_val(byte);
+        if(hex < 0)
+        {
+            stats.checksum_err++;
+            parser.state = STATE_IDLE;
+        }
+        else
+        {
+            parser.rx_checksum = hex << 4;
+            parser.state = STATE_CHECKSUM_LO;
+        }
+        break;
+    case STATE_CHECKSUM_LO:
+        hex = hex_val(byte);
+        parser.state = STATE_IDLE;
+        if((hex < 0) || ((parser.rx_checksum | hex) != parser.checksum))
+        {
+            stats.checksum_err++;
+        }
+        else
+        {
+            process_sentence();
+        }
+        break;
+    }
+}
+
+const nmea_parser_stats_t * nmea_parser_get_stats(void)
+{
+    return &stats;
+}
@@ -0,0 +1,135 @@
+/**
+ *  nmea_parser.h : Streaming NMEA 0183 sentence parser
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_util
+ * @{
+ *
+ * @defgroup group_nmea_parser Streaming NMEA parser
+ * @brief Parser for the NMEA 0183 sentences from GPS receivers which is fed one
+ *  byte at a time, such as from the UARTE receive handler. The sentence is
+ *  held in a bounded buffer and its checksum is verified before any field is
+ *  parsed. GGA, RMC, GLL and GSA sentences are parsed with integer arithmetic
+ *  only, so no floating point code is pulled into the image.
+ * @{
+ */
+
+#ifndef CODEBASE_UTIL_NMEA_PARSER_H_
+#define CODEBASE_UTIL_NMEA_PARSER_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** The maximum number of characters between the '$' and the '*' of a sentence.
+ *  The NMEA standard limits a sentence to 82 characters including $ and CRLF */
+#define NMEA_PARSER_MAX_LEN         80
+
+/** The DOP x 100 of a sentence with an empty DOP field, which is above
+ *  any limit on the DOP of a fix */
+#define NMEA_PARSER_DOP_UNKNOWN     UINT16_MAX
+
+/** The sentences that are parsed */
+typedef enum
+{
+    NMEA_SENTENCE_GGA,      ///< Fix data with altitude and HDOP
+    NMEA_SENTENCE_RMC,      ///< Recommended minimum data with date
+    NMEA_SENTENCE_GLL,      ///< Geographic position
+    NMEA_SENTENCE_GSA,      ///< DOP and active satellites
+    NMEA_SENTENCE_UNKNOWN,  ///< Valid sentence which isn't parsed
+    NMEA_SENTENCE_MAX       ///< Not a sentence, the number of sentence types
+}nmea_sentence_t;
+
+/**
+ * @brief The data parsed from the sentences. Only the fields present in
+ *  a sentence type are updated when it is received, the rest keep their
+ *  previous values.
+ */
+typedef struct
+{
+    /** Latitude in degrees x 10^7, negative in the south. GGA, RMC, GLL */
+    int32_t lat_e7;
+    /** Longitude in degrees x 10^7, negative in the west. GGA, RMC, GLL */
+    int32_t lng_e7;
+    /** Altitude above mean sea level in centi-meters. GGA */
+    int32_t alt_cm;
+    /** UTC time of the day in centi-seconds. GGA, RMC, GLL */
+    uint32_t time_cs;
+    /** UTC date as ddmmyy. RMC */
+    uint32_t date;
+    /** Speed over ground in milli-knots. RMC */
+    uint32_t speed_mknot;
+    /** Horizontal dilution of precision x 100, @ref NMEA_PARSER_DOP_UNKNOWN
+     *  if not given. GGA, GSA */
+    uint16_t hdop_c;
+    /** Position dilution of precision x 100, @ref NMEA_PARSER_DOP_UNKNOWN
+     *  if not given. GSA */
+    uint16_t pdop_c;
+    /** Vertical dilution of precision x 100, @ref NMEA_PARSER_DOP_UNKNOWN
+     *  if not given. GSA */
+    uint16_t vdop_c;
+    /** Fix quality, 0 is no fix. GGA */
+    uint8_t quality;
+    /** Number of satellites used. GGA, GSA */
+    uint8_t sats;
+    /** Fix type, 1 is no fix, 2 is 2D and 3 is 3D. GSA */
+    uint8_t fix_type;
+    /** If the position in the last sentence is from a valid fix. All */
+    bool valid;
+}nmea_parser_data_t;
+
+/** The statistics of the sentences received */
+typedef struct
+{
+    /** Sentences parsed successfully per type */
+    uint32_t parsed[NMEA_SENTENCE_MAX];
+    /** Sentences with a correct checksum whose fields couldn't be parsed */
+    uint32_t field_err[NMEA_SENTENCE_MAX];
+    /** Sentences with a wrong or missing checksum */
+    uint32_t checksum_err;
+    /** Sentences longer than @ref NMEA_PARSER_MAX_LEN */
+    uint32_t overflow_err;
+    /** Sentences cut short by the start of another one */
+    uint32_t framing_err;
+}nmea_parser_stats_t;
+
+/**
+ * @brief Initialize the parser and reset its statistics
+ * @param handler Function called on every successfully parsed sentence with
+ *  its type and the data with the fields of the sentence updated
+ */
+void nmea_parser_init(void (*handler)(nmea_sentence_t type,
+        nmea_parser_data_t * data));
+
+/**
+ * @brief Feed the next received byte to the parser
+ * @param byte The received byte
+ */
+void nmea_parser_feed(uint8_t byte);
+
+/**
+ * @brief Get the statistics of the sentences received since init
+ * @return Pointer to the statistics
+ */
+const nmea_parser_stats_t * nmea_parser_get_stats(void);
+
+#endif /* CODEBASE_UTIL_NMEA_PARSER_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -30,6 +30,8 @@ void nrf_util_critical_region_enter(uint8_t * is_critical_entered)
 #if defined(SOFTDEVICE_PRESENT)
     (void) sd_nvic_critical_region_enter(is_critical_entered);
 #else
+    //Nested if the interrupts are already disabled, as with the SoftDevice
+    *is_critical_entered = (__get_PRIMASK() != 0);
     __disable_irq();
 #endif
 }
@@ -39,7 +41,10 @@ void nrf_util_critical_region_exit(uint8_t critical_entered)
 #if defined(SOFTDEVICE_PRESENT)
     (void) sd_nvic_critical_region_exit(critical_entered);
 #else
-    __enable_irq();
+    if(critical_entered == 0)
+    {
+        __enable_irq();
+    }
 #endif
 }
 
@@ -0,0 +1,122 @@
+/**
+ *  prof_region.c : Profiling of named regions of code
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "prof_region.h"
+
+#if defined PROF_REGION_EN
+
+#include "stddef.h"
+
+#if defined __linux__
+#include <stdio.h>
+#define PROF_REGION_PRINTF(...)     printf(__VA_ARGS__)
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+#else
+#include "nrf_util.h"
+#include "log.h"
+#define PROF_REGION_PRINTF(...)     log_printf(__VA_ARGS__)
+#endif
+
+/** List of the regions measured, in the order of their first end */
+static prof_region_t * region_list;
+
+/** Duration of an empty region, subtracted from all the durations */
+static uint32_t overhead = 0;
+
+void prof_region_init(void)
+{
+#if !defined __linux__
+    if((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+#endif
+
+    //The least of a few empty regions, as an interrupt can lengthen any
+    overhead = 0;
+    uint32_t least = UINT32_MAX;
+    for(uint32_t i = 0; i < 8; i++)
+    {
+        uint32_t start = prof_region_now();
+        uint32_t ticks = prof_region_now() - start;
+        if(ticks < least)
+        {
+            least = ticks;
+        }
+    }
+    overhead = least;
+}
+
+void prof_region_add(prof_region_t * region, uint32_t ticks)
+{
+    ticks = (ticks > overhead) ? (ticks - overhead) : 0;
+
+    CRITICAL_REGION_ENTER();
+    if(region->is_listed == false)
+    {
+        region->next = region_list;
+        region_list = region;
+        region->is_listed = true;
+    }
+    if(region->count == 0)
+    {
+        region->min = ticks;
+        region->max = ticks;
+    }
+    region->count++;
+    region->total += ticks;
+    if(ticks < region->min)
+    {
+        region->min = ticks;
+    }
+    if(ticks > region->max)
+    {
+        region->max = ticks;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void prof_region_dump(void)
+{
+    PROF_REGION_PRINTF("Region: count, min, mean, max in ticks of %d per us\n",
+            (int) PROF_REGION_TICKS_PER_US);
+    for(prof_region_t * p = region_list; p != NULL; p = p->next)
+    {
+        if(p->count)
+        {
+            PROF_REGION_PRINTF("%s: %d, %d, %d, %d\n", p->name, (int) p->count,
+                (int) p->min, (int) (p->total/p->count), (int) p->max);
+        }
+    }
+}
+
+void prof_region_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    for(prof_region_t * p = region_list; p != NULL; p = p->next)
+    {
+        p->count = 0;
+        p->total = 0;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+#endif
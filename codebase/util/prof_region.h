@@ -0,0 +1,144 @@
+/**
+ *  prof_region.h : Profiling of named regions of code
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_util
+ * @{
+ *
+ * @defgroup group_prof_region Region profiler
+ * @brief Measures the time taken by named regions of code marked with
+ *  @ref PROF_REGION_START and @ref PROF_REGION_STOP. The count and the
+ *  minimum, maximum and total durations of each region are kept in RAM
+ *  and printed only when @ref prof_region_dump is called, so nothing is
+ *  printed while measuring. Each region keeps its start in a local
+ *  variable, so regions can be nested and a region can be entered from
+ *  different interrupt levels. The names of the regions in a function must
+ *  be different.
+ *
+ *  On the nRF52 the durations are in CPU cycles from the DWT cycle counter,
+ *  which doesn't use a TIMER or PPI. On Linux they are in ns from the
+ *  monotonic clock, so the modules marked with regions can be profiled in
+ *  host benchmarks. The time taken by an empty region is measured in
+ *  @ref prof_region_init and subtracted from every duration.
+ *
+ *  The regions are measured only when PROF_REGION_EN is defined, else the
+ *  macros are empty and prof_region.c compiles to nothing.
+ * @{
+ */
+
+#ifndef CODEBASE_UTIL_PROF_REGION_H_
+#define CODEBASE_UTIL_PROF_REGION_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#if defined PROF_REGION_EN
+
+#if defined __linux__
+#include <time.h>
+
+/** Number of ticks of the durations in a micro-second */
+#define PROF_REGION_TICKS_PER_US    1000
+
+/** The monotonic time in ns */
+static inline uint32_t prof_region_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#else
+#include "nrf.h"
+
+/** Number of ticks of the durations in a micro-second */
+#define PROF_REGION_TICKS_PER_US    (SystemCoreClock/1000000)
+
+/** The DWT cycle count */
+static inline uint32_t prof_region_now(void)
+{
+    return DWT->CYCCNT;
+}
+#endif
+
+/** The statistics of a region */
+typedef struct prof_region
+{
+    /** Name of the region */
+    const char * name;
+    /** Next region measured, for the dump */
+    struct prof_region * next;
+    /** If the region is in the list for the dump */
+    bool is_listed;
+    /** Number of times the region ran */
+    uint32_t count;
+    /** Shortest duration in ticks */
+    uint32_t min;
+    /** Longest duration in ticks */
+    uint32_t max;
+    /** Sum of the durations in ticks */
+    uint64_t total;
+}prof_region_t;
+
+/**
+ * @brief Start the cycle counter and measure the overhead of a region
+ */
+void prof_region_init(void);
+
+/**
+ * @brief Record a duration of a region
+ * @param region The statistics of the region
+ * @param ticks The duration in ticks including the overhead
+ */
+void prof_region_add(prof_region_t * region, uint32_t ticks);
+
+/**
+ * @brief Print the table of the count and the minimum, mean and maximum
+ *  duration in ticks of all the regions with log_printf, or printf on Linux
+ */
+void prof_region_dump(void);
+
+/**
+ * @brief Reset the statistics of all the regions
+ */
+void prof_region_reset(void);
+
+/** Mark the start of a region, the name must be a valid identifier */
+#define PROF_REGION_START(region)                                           \
+    static prof_region_t __prof_##region = { .name = #region };            \
+    uint32_t __prof_start_##region = prof_region_now()
+
+/** Mark the end of a region started in the same scope */
+#define PROF_REGION_STOP(region)                                            \
+    prof_region_add(&__prof_##region, prof_region_now() - __prof_start_##region)
+
+#else
+
+#define prof_region_init()
+#define prof_region_dump()
+#define prof_region_reset()
+#define PROF_REGION_START(region)
+#define PROF_REGION_STOP(region)
+
+#endif
+
+#endif /* CODEBASE_UTIL_PROF_REGION_H_ */
+
+/**
+ * @}
+ * @}
+ */
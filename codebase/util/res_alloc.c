@@ -0,0 +1,161 @@
+/**
+ *  res_alloc.c : Allocator of the shared hardware resources
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "res_alloc.h"
+#include "nrf_util.h"
+
+#ifndef EGU_COUNT
+#define EGU_COUNT       0
+#define EGU0_CH_NUM     16
+#endif
+
+/** Maximum number of resources of a type */
+#define MAX_RES_PER_TYPE    128
+
+/** The number of CC registers of all the TIMERs together */
+#if TIMER_COUNT > 4
+#define TIMER_CC_TOTAL      (TIMER0_CC_NUM + TIMER1_CC_NUM + TIMER2_CC_NUM \
+                                + TIMER3_CC_NUM + TIMER4_CC_NUM)
+#elif TIMER_COUNT > 3
+#define TIMER_CC_TOTAL      (TIMER0_CC_NUM + TIMER1_CC_NUM + TIMER2_CC_NUM \
+                                + TIMER3_CC_NUM)
+#else
+#define TIMER_CC_TOTAL      (TIMER0_CC_NUM + TIMER1_CC_NUM + TIMER2_CC_NUM)
+#endif
+
+/** The number of CC registers of each TIMER */
+static const uint8_t timer_cc_num[TIMER_COUNT] =
+{
+    TIMER0_CC_NUM, TIMER1_CC_NUM, TIMER2_CC_NUM,
+#if TIMER_COUNT > 3
+    TIMER3_CC_NUM,
+#endif
+#if TIMER_COUNT > 4
+    TIMER4_CC_NUM,
+#endif
+};
+
+/** The number of resources of each type in the SoC */
+static const uint32_t res_count[RES_ALLOC_TYPE_MAX] =
+{
+    [RES_ALLOC_PPI_CH] = PPI_CH_NUM,
+    [RES_ALLOC_PPI_GROUP] = PPI_GROUP_NUM,
+    [RES_ALLOC_GPIOTE_CH] = GPIOTE_CH_NUM,
+    [RES_ALLOC_EGU_TRIG] = EGU_COUNT*EGU0_CH_NUM,
+    [RES_ALLOC_TIMER_CC] = TIMER_CC_TOTAL,
+};
+
+/** Bit map of the used resources of each type, zero at reset */
+static uint32_t used[RES_ALLOC_TYPE_MAX][MAX_RES_PER_TYPE/32];
+
+#define IS_USED(type, idx)      (used[type][(idx)/32] & (1UL << ((idx) % 32)))
+#define SET_USED(type, idx)     (used[type][(idx)/32] |= (1UL << ((idx) % 32)))
+#define CLR_USED(type, idx)     (used[type][(idx)/32] &= ~(1UL << ((idx) % 32)))
+
+int32_t res_alloc_timer_cc_idx(uint32_t timer, uint32_t cc)
+{
+    int32_t idx = 0;
+
+    if((timer >= TIMER_COUNT) || (cc >= timer_cc_num[timer]))
+    {
+        return RES_ALLOC_NONE;
+    }
+    for(uint32_t t = 0; t < timer; t++)
+    {
+        idx += timer_cc_num[t];
+    }
+    return idx + cc;
+}
+
+bool res_alloc_reserve(res_alloc_type_t type, uint32_t idx)
+{
+    return res_alloc_reserve_range(type, idx, 1);
+}
+
+bool res_alloc_reserve_range(res_alloc_type_t type, uint32_t first, uint32_t count)
+{
+    bool is_reserved = true;
+
+    if((type >= RES_ALLOC_TYPE_MAX) || (first >= res_count[type])
+            || (count > res_count[type] - first))
+    {
+        return false;
+    }
+
+    CRITICAL_REGION_ENTER();
+    for(uint32_t idx = first; idx < first + count; idx++)
+    {
+        if(IS_USED(type, idx))
+        {
+            is_reserved = false;
+        }
+    }
+    if(is_reserved)
+    {
+        for(uint32_t idx = first; idx < first + count; idx++)
+        {
+            SET_USED(type, idx);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    return is_reserved;
+}
+
+int32_t res_alloc_get(res_alloc_type_t type)
+{
+    int32_t res = RES_ALLOC_NONE;
+
+    if(type >= RES_ALLOC_TYPE_MAX)
+    {
+        return RES_ALLOC_NONE;
+    }
+
+    CRITICAL_REGION_ENTER();
+    for(uint32_t idx = 0; idx < res_count[type]; idx++)
+    {
+        if(!IS_USED(type, idx))
+        {
+            SET_USED(type, idx);
+            res = idx;
+            break;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    return res;
+}
+
+void res_alloc_free(res_alloc_type_t type, uint32_t idx)
+{
+    if((type < RES_ALLOC_TYPE_MAX) && (idx < res_count[type]))
+    {
+        CRITICAL_REGION_ENTER();
+        CLR_USED(type, idx);
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+bool res_alloc_is_free(res_alloc_type_t type, uint32_t idx)
+{
+    if((type >= RES_ALLOC_TYPE_MAX) || (idx >= res_count[type]))
+    {
+        return false;
+    }
+    return (IS_USED(type, idx) == 0);
+}
@@ -0,0 +1,113 @@
+/**
+ *  res_alloc.h : Allocator of the shared hardware resources
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_util
+ * @{
+ *
+ * @defgroup group_res_alloc Resource allocator
+ * @brief Keeps track of the PPI channels and groups, GPIOTE channels, EGU
+ *  triggers and TIMER CC registers for modules which get them at run time.
+ *  A module which doesn't need a particular resource gets any free one and
+ *  frees it when done. Fixed resources can be reserved first so that they
+ *  aren't handed out. The fixed allocations in sys_config.h are checked at
+ *  build time with the 'check' make target (utils/sys_config_check.py).
+ * @{
+ */
+
+#ifndef CODEBASE_UTIL_RES_ALLOC_H_
+#define CODEBASE_UTIL_RES_ALLOC_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "nrf.h"
+#include "nrf_peripherals.h"
+
+/** Returned by @ref res_alloc_get when no resource is free */
+#define RES_ALLOC_NONE              (-1)
+
+/** Index of an EGU trigger for the RES_ALLOC_EGU_TRIG type */
+#define RES_ALLOC_EGU_TRIG_IDX(egu, trig)   ((egu)*EGU0_CH_NUM + (trig))
+
+/** The types of resources */
+typedef enum
+{
+    RES_ALLOC_PPI_CH,       ///< Programmable PPI channels
+    RES_ALLOC_PPI_GROUP,    ///< PPI channel groups
+    RES_ALLOC_GPIOTE_CH,    ///< GPIOTE channels
+    RES_ALLOC_EGU_TRIG,     ///< EGU triggers, index from @ref RES_ALLOC_EGU_TRIG_IDX
+    RES_ALLOC_TIMER_CC,     ///< TIMER CC registers, index from @ref res_alloc_timer_cc_idx
+    RES_ALLOC_TYPE_MAX      ///< Not a type, the number of resource types
+}res_alloc_type_t;
+
+/**
+ * @brief Get the index of a CC register of a TIMER for the RES_ALLOC_TIMER_CC
+ *  type. The CC registers of all the TIMERs are numbered one after the other,
+ *  with the number of each TIMER as in TIMERn_CC_NUM of the SoC.
+ * @param timer The TIMER instance
+ * @param cc The CC register of the TIMER
+ * @return The index, @ref RES_ALLOC_NONE if the TIMER or the CC doesn't exist
+ */
+int32_t res_alloc_timer_cc_idx(uint32_t timer, uint32_t cc);
+
+/**
+ * @brief Reserve a particular resource, as given in sys_config.h
+ * @param type The type of the resource
+ * @param idx The index of the resource
+ * @return True if reserved, false if it is already used or doesn't exist
+ */
+bool res_alloc_reserve(res_alloc_type_t type, uint32_t idx);
+
+/**
+ * @brief Reserve consecutive resources
+ * @param type The type of the resources
+ * @param first The index of the first resource
+ * @param count The number of resources
+ * @return True if all are reserved, false if any is already used or doesn't
+ *  exist in which case none are reserved
+ */
+bool res_alloc_reserve_range(res_alloc_type_t type, uint32_t first, uint32_t count);
+
+/**
+ * @brief Get a free resource of a type
+ * @param type The type of the resource
+ * @return The index of the resource, @ref RES_ALLOC_NONE if none are free
+ */
+int32_t res_alloc_get(res_alloc_type_t type);
+
+/**
+ * @brief Free a resource reserved or got earlier
+ * @param type The type of the resource
+ * @param idx The index of the resource
+ */
+void res_alloc_free(res_alloc_type_t type, uint32_t idx);
+
+/**
+ * @brief Check if a resource is free
+ * @param type The type of the resource
+ * @param idx The index of the resource
+ * @return True if free, false if used or doesn't exist
+ */
+bool res_alloc_is_free(res_alloc_type_t type, uint32_t idx);
+
+#endif /* CODEBASE_UTIL_RES_ALLOC_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -0,0 +1,163 @@
+/**
+ *  warm_boot.c : State retained across resets for a warm boot
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "warm_boot.h"
+#include "nrf.h"
+#include "nrf_util.h"
+#include "string.h"
+
+/** Marks a snapshot written by this module, with its size so that a change
+ *  of the layout in a new firmware makes a cold boot */
+#define WARM_BOOT_MAGIC     (0x5A3C0000 | sizeof(warm_boot_state_t))
+
+/** The resets after which the boot can be warm */
+#define WARM_RESETS         (POWER_RESETREAS_DOG_Msk | POWER_RESETREAS_LOCKUP_Msk \
+                                | POWER_RESETREAS_SREQ_Msk)
+
+/** The resets after which the boot is always cold, as the user asked for it */
+#define COLD_RESETS         (POWER_RESETREAS_RESETPIN_Msk | POWER_RESETREAS_OFF_Msk \
+                                | POWER_RESETREAS_DIF_Msk)
+
+/** Key mixed into the check of the pending fault, so that the random
+ *  content of the RAM after a power on is not taken as a fault */
+#define FAULT_KEY           0xA5C3F00F
+
+/** The check word of a pending fault */
+#define FAULT_CHECK(f, id, pc)  ((f) ^ (id) ^ (pc) ^ FAULT_KEY)
+
+/** The snapshot with its magic number and CRC, not initialized on boot */
+static struct
+{
+    uint32_t magic;
+    warm_boot_state_t state;
+    uint32_t crc;
+    /** The fault recorded for the coming reset, moved to the state on boot.
+     *  It is kept out of the CRC with a check word of its own, so that
+     *  recording it is only a few stores just before the reset. */
+    uint32_t fault, fault_id, fault_pc, fault_check;
+}retained __attribute__((section(".noinit")));
+
+static bool is_warm = false;
+
+/** CRC-32 (IEEE 802.3) of a buffer, with a table of 16 entries so that it
+ *  is short enough to be done in a critical region */
+static uint32_t crc32(const uint8_t * buff, uint32_t len)
+{
+    static const uint32_t table[16] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = 0xFFFFFFFF;
+
+    while(len--)
+    {
+        crc ^= *buff++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static uint32_t state_crc(void)
+{
+    return crc32((const uint8_t *) &retained.state, sizeof(warm_boot_state_t));
+}
+
+bool warm_boot_init(void)
+{
+    uint32_t reset_reason = NRF_POWER->RESETREAS;
+    bool is_intact = (retained.magic == WARM_BOOT_MAGIC)
+            && (retained.crc == state_crc());
+
+    is_warm = is_intact && (reset_reason & WARM_RESETS)
+            && ((reset_reason & COLD_RESETS) == 0)
+            && (retained.state.warm_count < WARM_BOOT_MAX_WARM);
+
+    if(is_warm)
+    {
+        retained.state.warm_count++;
+    }
+    else
+    {
+        memset(&retained.state, 0, sizeof(warm_boot_state_t));
+    }
+    if(retained.fault_check == FAULT_CHECK(retained.fault,
+            retained.fault_id, retained.fault_pc))
+    {
+        retained.state.fault = retained.fault;
+        retained.state.fault_id = retained.fault_id;
+        retained.state.fault_pc = retained.fault_pc;
+    }
+    else
+    {
+        //The watchdog bites too soon after its interrupt to record it
+        retained.state.fault = (reset_reason & POWER_RESETREAS_DOG_Msk) ?
+                WARM_BOOT_FAULT_WDT : WARM_BOOT_FAULT_NONE;
+        retained.state.fault_id = 0;
+        retained.state.fault_pc = 0;
+    }
+    retained.fault_check = 0;
+    retained.state.reset_reason = reset_reason;
+    retained.magic = WARM_BOOT_MAGIC;
+    warm_boot_commit();
+
+    return is_warm;
+}
+
+bool warm_boot_is_warm(void)
+{
+    return is_warm;
+}
+
+warm_boot_state_t * warm_boot_state(void)
+{
+    return &retained.state;
+}
+
+void warm_boot_commit(void)
+{
+    CRITICAL_REGION_ENTER();
+    retained.crc = state_crc();
+    CRITICAL_REGION_EXIT();
+}
+
+void warm_boot_fault(warm_boot_fault_t fault, uint32_t id, uint32_t pc)
+{
+    retained.fault = fault;
+    retained.fault_id = id;
+    retained.fault_pc = pc;
+    //Covers the three words, so a reset in between leaves it wrong
+    retained.fault_check = FAULT_CHECK(fault, id, pc);
+}
+
+void warm_boot_mark_stable(void)
+{
+    if(retained.state.warm_count != 0)
+    {
+        retained.state.warm_count = 0;
+        warm_boot_commit();
+    }
+}
+
+void warm_boot_invalidate(void)
+{
+    retained.magic = 0;
+}
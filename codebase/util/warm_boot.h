@@ -0,0 +1,157 @@
+/**
+ *  warm_boot.h : State retained across resets for a warm boot
+ *  Copyright (C) 2019  Appiko
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @addtogroup group_util
+ * @{
+ *
+ * @defgroup group_warm_boot Warm boot
+ * @brief Keeps a snapshot of the state of the application in the .noinit
+ *  RAM section, which isn't initialized on boot and so is retained across
+ *  the resets other than power on. The snapshot is protected with a CRC
+ *  which is updated with @ref warm_boot_commit whenever the application
+ *  changes the state.
+ *
+ *  @ref warm_boot_init is called first in main. The boot is warm if the
+ *  snapshot is intact and the reset was by the watchdog, a CPU lockup or a
+ *  software reset. The application can then resume from the snapshot
+ *  instead of reading its configuration from flash and playing its start
+ *  up UI. Otherwise the snapshot is cleared and the boot is cold. A reset
+ *  requested by the user, such as for a DFU, must call
+ *  @ref warm_boot_invalidate before. So that a fault on resume doesn't
+ *  cause a loop of resets, a boot is cold after @ref WARM_BOOT_MAX_WARM
+ *  consecutive warm boots without a call of @ref warm_boot_mark_stable.
+ * @{
+ */
+
+#ifndef CODEBASE_UTIL_WARM_BOOT_H_
+#define CODEBASE_UTIL_WARM_BOOT_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#if SYS_CFG_PRESENT == 1
+#include "sys_config.h"
+#endif
+
+/** Number of counters in the snapshot */
+#ifndef WARM_BOOT_COUNTERS
+#define WARM_BOOT_COUNTERS          4
+#endif
+
+/** Size in 32 bit words of the data of the application in the snapshot */
+#ifndef WARM_BOOT_APP_DATA_WORDS
+#define WARM_BOOT_APP_DATA_WORDS    16
+#endif
+
+/** Maximum consecutive warm boots before a cold boot */
+#ifndef WARM_BOOT_MAX_WARM
+#define WARM_BOOT_MAX_WARM          3
+#endif
+
+/** The cause of the last reset as recorded before it */
+typedef enum
+{
+    WARM_BOOT_FAULT_NONE,       ///< No fault recorded
+    WARM_BOOT_FAULT_WDT,        ///< The watchdog timed out
+    WARM_BOOT_FAULT_APP_ERROR,  ///< An error code failed APP_ERROR_CHECK
+    WARM_BOOT_FAULT_SD,         ///< The SoftDevice reported a fault
+}warm_boot_fault_t;
+
+/** The snapshot of the state retained across resets */
+typedef struct
+{
+    /** The RESETREAS register at this boot */
+    uint32_t reset_reason;
+    /** The fault from @ref warm_boot_fault_t recorded before the reset */
+    uint32_t fault;
+    /** The ID or error code of the fault */
+    uint32_t fault_id;
+    /** The program counter at the fault, 0 if not known */
+    uint32_t fault_pc;
+    /** Number of consecutive warm boots */
+    uint32_t warm_count;
+    /** Time of day in s */
+    uint32_t time_s;
+    /** Date, packed as the application needs */
+    uint32_t date;
+    /** Mode or state of the application */
+    uint32_t mode;
+    /** Counters of the application, such as the number of triggers */
+    uint32_t counters[WARM_BOOT_COUNTERS];
+    /** Data of the application, such as a copy of its configuration */
+    uint32_t app_data[WARM_BOOT_APP_DATA_WORDS];
+}warm_boot_state_t;
+
+/**
+ * @brief Check the snapshot and the reason of the reset. To be called at
+ *  the start of main, before the RESETREAS register is cleared.
+ * @return True if the boot is warm and the snapshot can be resumed from.
+ *  When false, all the fields are cleared except the fault ones, which are
+ *  filled whenever a fault was recorded before the reset. A watchdog reset
+ *  without a recorded fault is given as @ref WARM_BOOT_FAULT_WDT.
+ */
+bool warm_boot_init(void);
+
+/**
+ * @brief Check if the boot was warm
+ * @return The value returned by @ref warm_boot_init
+ */
+bool warm_boot_is_warm(void);
+
+/**
+ * @brief Get the snapshot to read or change. The changes must be followed
+ *  by @ref warm_boot_commit.
+ * @return Pointer to the snapshot
+ */
+warm_boot_state_t * warm_boot_state(void);
+
+/**
+ * @brief Update the CRC of the snapshot after it is changed
+ */
+void warm_boot_commit(void);
+
+/**
+ * @brief Record the cause of a reset which is about to happen. It is given
+ *  in the fault fields of the snapshot after the reset. It is kept apart
+ *  from the CRC of the snapshot and needs no @ref warm_boot_commit, so it
+ *  is only a few stores. It isn't needed for the watchdog, whose reset
+ *  reason identifies it and which resets about 61 us after its interrupt.
+ * @param fault The cause from @ref warm_boot_fault_t
+ * @param id The ID or error code of the fault
+ * @param pc The program counter at the fault, 0 if not known
+ */
+void warm_boot_fault(warm_boot_fault_t fault, uint32_t id, uint32_t pc);
+
+/**
+ * @brief Mark that the application has run properly after the boot, which
+ *  resets the count of consecutive warm boots
+ */
+void warm_boot_mark_stable(void);
+
+/**
+ * @brief Invalidate the snapshot so that the next boot is cold
+ */
+void warm_boot_invalidate(void);
+
+#endif /* CODEBASE_UTIL_WARM_BOOT_H_ */
+
+/**
+ * @}
+ * @}
+ */
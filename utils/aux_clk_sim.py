@@ -0,0 +1,606 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Simulation of the two counters of aux_clk (codebase/peripheral_modules/
+# aux_clk.c), the 32768 Hz RTC and the 1 MHz TIMER, with the module built
+# for the host. The tasks of the counters written by the module go through
+# a hook to the model, which counts the RTC on the edges of the LFCLK and
+# the TIMER from the time it is started, raises the compare events at the
+# time the counter reaches the CC and runs the module's handler for them as
+# the ISR managers do. The time is kept in units of 1/512 us, in which both
+# the RTC ticks and the us are whole.
+#
+# Checked:
+# - The deadlines are hit with the RTC alone within -46/+16 us, which is
+#   the rounding of the deadline to a tick and the phase of the LFCLK at
+#   the start, and with the TIMER alone within 1 us.
+# - With the source switched at random times, every deadline is hit within
+#   that error plus one RTC tick (31 us) however many switches there were,
+#   and aux_clk_get_ms keeps counting across the switches.
+# - With a compare event clearing the counter through PPI, on whichever
+#   source runs at the time, the deadlines after each clear are hit within
+#   the same error from the time of the clear.
+# - In the auto mode, the deadlines of a sensebe IR sync session are hit
+#   within the same error.
+#
+# The session is a sync every --period ms with a --window ms pulse window
+# after it, after which the clock is cleared for the next sync. The time
+# the TIMER runs in the auto mode is reported against the whole session
+# with TSSP_DETECT_HF_CLK, with the saving of the average current at the
+# PWR_MGR_UA_HFXO estimate of the HF crystal.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   aux_clk_sim.py [--seconds 60] [--period 1000] [--window 2] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="aux_clk two counter simulation")
+parser.add_argument("--seconds", type=float, default=60, help="simulated time of each run")
+parser.add_argument("--period", type=int, default=1000, help="sync period of the session in ms")
+parser.add_argument("--window", type=int, default=2, help="pulse window after the sync in ms")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules"]
+
+# Peripherals used by the test build
+RTC0_BASE = 0x4000B000
+TIMER1_BASE = 0x40009000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+TASKS_START = 0x000
+TASKS_STOP = 0x004
+TIMER_TASKS_CLEAR = 0x00C
+TIMER_TASKS_SHUTDOWN = 0x010
+TIMER_TASKS_CAPTURE = 0x040
+RTC_TASKS_CLEAR = 0x008
+EVENTS_COMPARE = 0x140
+INTENSET = 0x304
+RTC_COUNTER = 0x504
+CC = 0x540
+
+# Time units in a us and a RTC tick
+US = 512
+TICK = 15625
+SECOND = 1000000 * US
+RTC_MASK = 0xFFFFFF
+TIMER_MASK = 0xFFFFFFFF
+
+# aux_clk_source_t
+SRC_LFCLK = 0
+SRC_HFCLK = 1
+SRC_AUTO = 2
+
+# aux_clk_evt_t and aux_clk_tsk_t
+EVT_CC0 = 0x01
+TASKS_CLEAR = 2
+
+# Error of a deadline in us from the RTC alone and added by the switches
+ERR_EARLY_US = 46
+ERR_LATE_US = 16
+ERR_SWITCH_US = 31
+
+# Current of the HF crystal, as PWR_MGR_UA_HFXO in pwr_mgr.h
+UA_HFXO = 250
+
+CFLAGS = ["-DISR_MANAGER=1", "-DRTC_USED_AUX_CLK=0", "-DTIMER_USED_AUX_CLK=1",
+		"-DAUX_CLK_HFCLK_SOLO_MODULE=0"]
+
+HARNESS = r"""
+#include <stdint.h>
+#include "nrf.h"
+#include "isr_dispatch.h"
+
+void aux_clk_rtc_handler (uint32_t fired);
+void aux_clk_timer_handler (uint32_t fired);
+
+void (*host_on_task) (uint32_t addr);
+
+void host_task (volatile uint32_t * task)
+{
+    host_on_task ((uint32_t) (uintptr_t) task);
+}
+
+/* The SET and CLR registers follow the register they act on, which reads
+ * the same from all three */
+void host_setclr (volatile uint32_t * reg, uint32_t val)
+{
+    volatile uint32_t * base = (volatile uint32_t *) ((uintptr_t) reg & ~0xFUL);
+    uint32_t cur = base[0];
+    cur = (((uintptr_t) reg & 0xF) == 4) ? (cur | val) : (cur & ~val);
+    base[0] = base[1] = base[2] = cur;
+}
+
+/* As RTC0_IRQHandler and TIMER1_IRQHandler of the ISR managers */
+void host_rtc0_isr (void)
+{
+    uint32_t fired = isr_dispatch_take (NRF_RTC0);
+    ISR_DISPATCH_CALL (aux_clk_rtc_handler, fired);
+}
+
+void host_timer1_isr (void)
+{
+    uint32_t fired = isr_dispatch_take (NRF_TIMER1);
+    ISR_DISPATCH_CALL (aux_clk_timer_handler, fired);
+}
+"""
+
+STUB = r"""
+#include <stdint.h>
+#include "hal_ppi.h"
+
+uint32_t host_assert;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+
+/* The PPI channels as set by the module */
+uint32_t host_ppi_event[32];
+uint32_t host_ppi_task[32];
+uint32_t host_ppi_fork[32];
+uint32_t host_ppi_en[32];
+
+ppi_setup_status_t hal_ppi_set (hal_ppi_setup_t * setup)
+{
+    host_ppi_event[setup->ppi_id] = setup->event;
+    host_ppi_task[setup->ppi_id] = setup->task;
+    host_ppi_fork[setup->ppi_id] = setup->fork;
+    return PPI_SETUP_SUCCESSFUL;
+}
+
+void hal_ppi_en_ch (uint32_t ppi_id)
+{
+    host_ppi_en[ppi_id] = 1;
+}
+
+void hal_ppi_dis_ch (uint32_t ppi_id)
+{
+    host_ppi_en[ppi_id] = 0;
+}
+"""
+
+# Empty isr_manager.h for the module built with ISR_MANAGER
+ISR_MANAGER_H = "\n"
+
+TASK_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint32)
+EVT_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint8)
+
+class AuxClkPpi(ctypes.Structure):
+	_fields_ = [("event", ctypes.c_uint32), ("task1", ctypes.c_uint32),
+			("task2", ctypes.c_uint32)]
+
+class AuxClkSetup(ctypes.Structure):
+	_fields_ = [("source", ctypes.c_int), ("irq_priority", ctypes.c_int),
+			("callback_handler", EVT_FN), ("arr_cc_ms", ctypes.c_uint32 * 4),
+			("events_en", ctypes.c_uint8), ("arr_ppi_cnf", AuxClkPpi * 2)]
+
+def hook(text):
+	"""Route the tasks of the counters and the SET and CLR registers to the host"""
+	text = re.sub(r"(RTC_USED|TIMER_USED)->(TASKS_\w+(?:\[\d+\])?)\s*=\s*1;",
+			r"host_task(&(\1)->\2);", text)
+	return re.sub(r"(\w+)->((?:INTEN|EVTEN)(?:SET|CLR))\s*\|?=\s*([^;]+);",
+			r"host_setclr(&(\1)->\2, (\3));", text)
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (RTC0_BASE, TIMER1_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+class Counter(object):
+	"""A counter which increments every unit of time from a start"""
+	def __init__(self, base, unit, mask, edge_aligned):
+		self.base = base
+		self.unit = unit
+		self.mask = mask
+		self.edge_aligned = edge_aligned
+		self.running = False
+		self.count0 = 0
+		self.t0 = 0
+		self.on_time = 0
+
+	def steps(self, t):
+		"""The increments from the start to t"""
+		if self.edge_aligned:
+			return t // self.unit - self.t0 // self.unit
+		return (t - self.t0) // self.unit
+
+	def value(self, t):
+		if not self.running:
+			return self.count0
+		return (self.count0 + self.steps(t)) & self.mask
+
+	def start(self, t):
+		if not self.running:
+			self.running = True
+			self.t0 = t
+
+	def stop(self, t):
+		if self.running:
+			self.count0 = self.value(t)
+			self.on_time += t - self.t0
+			self.running = False
+
+	def clear(self, t):
+		if self.running:
+			self.on_time += t - self.t0
+		self.count0 = 0
+		self.t0 = t
+
+	def next_match(self, t, cc):
+		"""Time after t at which the counter reaches cc, None if stopped"""
+		if not self.running:
+			return None
+		now = self.value(t)
+		diff = (cc - now) & self.mask
+		if diff == 0:
+			diff = self.mask + 1
+		if self.edge_aligned:
+			return (t // self.unit + diff) * self.unit
+		return self.t0 + (self.steps(t) + diff) * self.unit
+
+class Sim(object):
+	def __init__(self, lib):
+		self.lib = lib
+		self.on_task = TASK_FN(self.task)
+		ctypes.c_void_p.in_dll(lib, "host_on_task").value = \
+				ctypes.cast(self.on_task, ctypes.c_void_p).value
+		self.on_evt = EVT_FN(self.evt)
+		lib.aux_clk_get_ms.restype = ctypes.c_uint32
+		self.ppi = [(ctypes.c_uint32 * 32).in_dll(lib, name) for name in
+				("host_ppi_event", "host_ppi_task", "host_ppi_fork", "host_ppi_en")]
+
+	def reset(self):
+		for base in (RTC0_BASE, TIMER1_BASE):
+			ctypes.memset(base, 0, PAGE)
+		for arr in self.ppi:
+			ctypes.memset(arr, 0, ctypes.sizeof(arr))
+		self.t = 0
+		self.rtc = Counter(RTC0_BASE, TICK, RTC_MASK, True)
+		self.timer = Counter(TIMER1_BASE, US, TIMER_MASK, False)
+		self.actions = []
+		self.fired = []
+		self.on_fire = None
+
+	def sync_regs(self):
+		reg(RTC0_BASE + RTC_COUNTER).value = self.rtc.value(self.t)
+
+	def task(self, addr):
+		for ctr, clear in ((self.rtc, RTC_TASKS_CLEAR), (self.timer, TIMER_TASKS_CLEAR)):
+			off = addr - ctr.base
+			if 0 <= off < PAGE:
+				break
+		else:
+			sys.exit("Task 0x%08X of an unknown peripheral" % addr)
+		if off == TASKS_START:
+			ctr.start(self.t)
+		elif off == TASKS_STOP or (ctr is self.timer and off == TIMER_TASKS_SHUTDOWN):
+			ctr.stop(self.t)
+		elif off == clear:
+			ctr.clear(self.t)
+		elif ctr is self.timer and TIMER_TASKS_CAPTURE <= off < TIMER_TASKS_CAPTURE + 24:
+			reg(ctr.base + CC + off - TIMER_TASKS_CAPTURE).value = ctr.value(self.t)
+		self.sync_regs()
+
+	def on_time(self, ctr):
+		return ctr.on_time + (self.t - ctr.t0 if ctr.running else 0)
+
+	def evt(self, events):
+		self.fired.append((self.t, events))
+		if self.on_fire:
+			self.on_fire(events)
+
+	def pending(self, base):
+		inten = reg(base + INTENSET).value
+		return any((inten >> (16 + n)) & 1 and reg(base + EVENTS_COMPARE + 4 * n).value
+				for n in range(4))
+
+	def run_isrs(self):
+		for _ in range(10):
+			if self.pending(RTC0_BASE):
+				self.lib.host_rtc0_isr()
+			elif self.pending(TIMER1_BASE):
+				self.lib.host_timer1_isr()
+			else:
+				return
+		sys.exit("An interrupt of aux_clk stays pending")
+
+	def ppi_route(self, evt):
+		event, task, fork, en = self.ppi
+		for ch in range(32):
+			if en[ch] and event[ch] == evt:
+				for tsk in (task[ch], fork[ch]):
+					if tsk:
+						self.task(tsk)
+
+	def at(self, t, fn):
+		self.actions.append((t, fn))
+		self.actions.sort(key=lambda a: a[0])
+
+	def run(self, end):
+		while self.t < end:
+			nxt = [(self.actions[0][0], None)] if self.actions else []
+			for ctr in (self.rtc, self.timer):
+				for n in range(4):
+					t = ctr.next_match(self.t, reg(ctr.base + CC + 4 * n).value)
+					if t is not None:
+						nxt.append((t, (ctr, n)))
+			if not nxt:
+				break
+			t = min(x[0] for x in nxt)
+			if t > end:
+				self.t = end
+				break
+			self.t = t
+			self.sync_regs()
+			for when, match in nxt:
+				if when == t and match:
+					evt = match[0].base + EVENTS_COMPARE + 4 * match[1]
+					reg(evt).value = 1
+					self.ppi_route(evt)
+			self.run_isrs()
+			while self.actions and self.actions[0][0] <= self.t:
+				self.actions.pop(0)[1]()
+				self.run_isrs()
+
+	def setup(self, source, cc_ms, events, ppi=None):
+		s = AuxClkSetup()
+		if ppi:
+			s.arr_ppi_cnf[0] = AuxClkPpi(*ppi)
+		s.source = source
+		s.irq_priority = 3
+		s.callback_handler = self.on_evt
+		s.arr_cc_ms = (ctypes.c_uint32 * 4)(*cc_ms)
+		s.events_en = events
+		self.lib.aux_clk_set(ctypes.byref(s))
+		self.lib.aux_clk_start()
+
+class Suite(object):
+	def __init__(self, sim):
+		self.sim = sim
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def deadlines(self, source, switch_ms):
+		"""Random deadlines on two channels, with a switch of the source
+		every random interval up to switch_ms if given. Returns the list
+		of (error in us, switches since the start) and the get_ms lag."""
+		sim = self.sim
+		sim.reset()
+		rnd = random.Random(35 + source)
+		t_start = rnd.randrange(TICK)
+		sim.t = t_start
+		deadline = {}
+		state = {"switches": 0, "src": source}
+		errors = []
+		lags = []
+
+		def next_deadline(n):
+			ms = sim.lib.aux_clk_get_ms() + rnd.randint(2, 2000)
+			deadline[n] = ms
+			sim.lib.aux_clk_update_cc(n, ms)
+
+		def on_fire(events):
+			for n in range(2):
+				if events & (1 << n):
+					due = t_start + deadline[n] * 1000 * US
+					errors.append(((sim.t - due) / float(US), state["switches"]))
+					next_deadline(n)
+
+		def switch():
+			state["src"] = SRC_HFCLK if state["src"] == SRC_LFCLK else SRC_LFCLK
+			sim.lib.aux_clk_select_src(state["src"])
+			state["switches"] += 1
+			true_ms = (sim.t - t_start) / float(1000 * US)
+			lags.append((true_ms - sim.lib.aux_clk_get_ms(), state["switches"]))
+			sim.at(sim.t + rnd.randint(1, switch_ms) * 1000 * US, switch)
+
+		sim.on_fire = on_fire
+		first = [rnd.randint(2, 2000), rnd.randint(2, 2000)]
+		deadline.update({0: first[0], 1: first[1]})
+		sim.setup(source, first + [0, 0], 0x03)
+		if switch_ms:
+			sim.at(sim.t + rnd.randint(1, switch_ms) * 1000 * US, switch)
+		sim.run(t_start + int(args.seconds * SECOND))
+		return errors, lags
+
+	def test_fixed(self):
+		for source, name, lo, hi in ((SRC_LFCLK, "RTC", -ERR_EARLY_US, ERR_LATE_US),
+				(SRC_HFCLK, "TIMER", 0, 1)):
+			errors, _ = self.deadlines(source, 0)
+			bad = [e for e, _ in errors if not lo <= e <= hi]
+			self.check("%d deadlines with the %s alone within %d/+%d us" %
+					(len(errors), name, lo, hi), errors and not bad,
+					"worst %s" % (max(bad, key=abs) if bad else None))
+
+	def test_switches(self):
+		errors, lags = self.deadlines(SRC_LFCLK, 500)
+		bad = [(e, n) for e, n in errors if not
+				-ERR_EARLY_US - ERR_SWITCH_US <= e <= ERR_LATE_US + ERR_SWITCH_US]
+		self.check("%d deadlines across %d switches within a tick of the RTC alone" %
+				(len(errors), lags[-1][1] if lags else 0), errors and not bad,
+				"first out %s" % (bad[:1],))
+		worst = max(errors, key=lambda x: abs(x[0])) if errors else (0, 0)
+		print("  Worst deadline error %.1f us after %d switches" % worst)
+		bad = [(l, n) for l, n in lags if not abs(l) <= 1 + (ERR_EARLY_US + ERR_SWITCH_US) / 1000.0]
+		self.check("time kept across the switches", lags and not bad, "first out %s" % (bad[:1],))
+
+	def test_hw_clear(self):
+		"""Channel 0 clears the counter through PPI every --period ms, as in
+		tssp_detect, with a random deadline on channel 1 after each clear
+		and the source switched at random times"""
+		sim = self.sim
+		sim.reset()
+		rnd = random.Random(37)
+		t_start = rnd.randrange(TICK)
+		sim.t = t_start
+		state = {"clear": t_start, "cc1": rnd.randint(2, args.period - 2),
+				"src": SRC_LFCLK, "switches": 0}
+		errors = []
+
+		def on_fire(events):
+			if events & 0x01:
+				due = state["clear"] + args.period * 1000 * US
+				errors.append((sim.t - due) / float(US))
+				# The counter was cleared by the compare event
+				state["clear"] = sim.t
+				state["cc1"] = rnd.randint(2, args.period - 2)
+				sim.lib.aux_clk_update_cc(1, state["cc1"])
+			if events & 0x02:
+				due = state["clear"] + state["cc1"] * 1000 * US
+				errors.append((sim.t - due) / float(US))
+
+		def switch():
+			state["src"] = SRC_HFCLK if state["src"] == SRC_LFCLK else SRC_LFCLK
+			sim.lib.aux_clk_select_src(state["src"])
+			state["switches"] += 1
+			sim.at(sim.t + rnd.randint(1, 500) * 1000 * US, switch)
+
+		sim.on_fire = on_fire
+		sim.setup(SRC_LFCLK, [args.period, state["cc1"], 0, 0], 0x03,
+				(EVT_CC0, TASKS_CLEAR, TASKS_CLEAR))
+		sim.at(sim.t + rnd.randint(1, 500) * 1000 * US, switch)
+		sim.run(t_start + int(args.seconds * SECOND))
+		bad = [e for e in errors if not
+				-ERR_EARLY_US - ERR_SWITCH_US <= e <= ERR_LATE_US + ERR_SWITCH_US]
+		self.check("%d deadlines after clears through PPI across %d switches within a tick" %
+				(len(errors), state["switches"]),
+				len(errors) >= 2 * int(args.seconds * 1000 / args.period) - 2 and not bad,
+				"worst %s" % (max(bad, key=abs) if bad else None))
+
+	def test_auto(self):
+		"""The sensebe IR sync session in the auto mode"""
+		sim = self.sim
+		sim.reset()
+		t_clear = [0]
+		switches = [0]
+		errors = []
+		cc = [args.period, args.period + args.window]
+
+		def on_fire(events):
+			for n in range(2):
+				if events & (1 << n):
+					due = t_clear[0] + cc[n] * 1000 * US
+					errors.append((sim.t - due) / float(US))
+			if events & 0x02:
+				# The pulse window is over, restart the period
+				sim.lib.aux_clk_clear()
+				t_clear[0] = sim.t
+
+		sim.on_fire = on_fire
+		sim.t = t_clear[0] = 7 * US
+		sim.setup(SRC_AUTO, cc + [0, 0], 0x03)
+		end = sim.t + int(args.seconds * SECOND)
+		sim.run(end)
+		hf = sim.on_time(sim.timer) / float(end - 7 * US)
+		err = ERR_SWITCH_US
+		bad = [e for e in errors if not -ERR_EARLY_US - err <= e <= ERR_LATE_US + err]
+		self.check("%d deadlines of the auto mode within a tick of the RTC alone" %
+				len(errors), errors and not bad, "worst %s" % (max(bad, key=abs) if bad else None))
+		self.check("TIMER stopped away from the deadlines", hf < 0.5, "%.1f%% on" % (hf * 100))
+		print("Sensebe IR sync session, %d ms period and %d ms window, %.0f s:" %
+				(args.period, args.window, args.seconds))
+		print("  HF clock on %.2f%% of the time in the auto mode, 100%% with TSSP_DETECT_HF_CLK" %
+				(hf * 100))
+		print("  About %.0f uA of the HF crystal saved on average" % ((1 - hf) * UA_HFXO))
+		print("  Worst deadline error %.1f us" % max(errors, key=abs))
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	src = os.path.join(tmp, "aux_clk.c")
+	with open(src, "w") as f:
+		f.write('#include <stdint.h>\nvoid host_task (volatile uint32_t * task);\n'
+				'void host_setclr (volatile uint32_t * reg, uint32_t val);\n' +
+				hook(open("codebase/peripheral_modules/aux_clk.c").read()))
+	for name, text in (("harness.c", HARNESS), ("stub.c", STUB),
+			("isr_manager.h", ISR_MANAGER_H)):
+		with open(os.path.join(tmp, name), "w") as f:
+			f.write(text)
+	so = os.path.join(tmp, "aux_clk.so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-iquote", tmp] + CFLAGS +
+			["-I" + i for i in INC] + ["-o", so, os.path.join(tmp, "harness.c"),
+			os.path.join(tmp, "stub.c"), src])
+	return ctypes.CDLL(so)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		lib = build(tmp)
+		suite = Suite(Sim(lib))
+		suite.test_fixed()
+		suite.test_switches()
+		suite.test_hw_clear()
+		suite.test_auto()
+		suite.check("no asserts", ctypes.c_uint32.in_dll(lib, "host_assert").value == 0)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,437 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of the event scheduler (codebase/util/evt_sched.c) and irq_msg_util on
+# it, with interrupts posting at random times. The two interrupt priorities
+# are POSIX timer signals re-armed with random delays, which preempt the main
+# loop at any instruction, the higher one also preempting the lower one. The
+# critical region of nrf_util masks the signals as PRIMASK masks the
+# interrupts. The higher interrupt posts high priority events, the lower one
+# mid and low priority events and irq_msg messages, and the handlers in the
+# main loop post low priority events too.
+#
+# Every event posted must be dispatched once and in order per source, an
+# event must never be dispatched while one of a higher priority posted before
+# the previous handler ended is pending, the second subscriber of an ID must
+# get the event right after the first and the statistics must match the posts
+# and drops seen by the posters. The latency from the post to the dispatch
+# is reported per priority, in host time.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   evt_sched_test.py [--seconds 2] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="evt_sched randomized interrupt test")
+parser.add_argument("--seconds", type=float, default=2, help="run time of each load")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/util", "codebase/nrf_core", "codebase/cmsis/include"]
+
+PRIOS = ["high", "mid", "low"]
+
+# (name, mean interrupt period in us, mean handler run time in us). With the
+# overload the events come faster than they are handled, so the queues fill,
+# the events are dropped and the lower priorities are starved.
+LOADS = [("light", 200, 5), ("heavy", 50, 10), ("overload", 20, 30)]
+
+HARNESS = r"""
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "evt_sched.h"
+#include "irq_msg_util.h"
+#include "nrf_util.h"
+
+#define SIG_LOW         (SIGRTMIN)
+#define SIG_HIGH        (SIGRTMIN + 1)
+
+/* The posting sources, each with its own sequence numbers */
+enum {SRC_HIGH, SRC_MID, SRC_LOW, SRC_MSG, SRC_MAIN, SRC_MAX};
+static const evt_sched_prio_t src_prio[SRC_MAX] = {EVT_SCHED_PRIO_HIGH,
+        EVT_SCHED_PRIO_MID, EVT_SCHED_PRIO_LOW, EVT_SCHED_PRIO_MID, EVT_SCHED_PRIO_LOW};
+static const uint16_t src_id[SRC_MAX] = {1, 2, 3, 0, 4};
+
+#define DATA(src, seq)  ((void *) (uintptr_t) (((src) << 24) | ((seq) & 0xFFFFFF)))
+#define TMASK           0xFFFF
+#define HIST_LEN        100000
+
+static volatile uint32_t next_seq[SRC_MAX], expect_seq[SRC_MAX];
+static uint64_t t_post[SRC_MAX][TMASK + 1];
+
+volatile uint32_t host_posted[EVT_SCHED_PRIO_MAX], host_dropped[EVT_SCHED_PRIO_MAX];
+uint32_t host_dispatched[EVT_SCHED_PRIO_MAX];
+uint32_t host_hist[EVT_SCHED_PRIO_MAX][HIST_LEN];
+uint32_t host_order_err, host_prio_err, host_sub_err, host_idle, host_assert;
+uint32_t host_cr_nest_err;
+static uint32_t snapshot[EVT_SCHED_PRIO_MAX];
+static void * last_data;
+static uint32_t work_ns, period_ns;
+static timer_t timer[2];
+static uint64_t end_ns;
+static uint32_t rnd_state[3] = {0x12345678, 0x9ABCDEF1, 0x2468ACE1};
+
+static uint64_t now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/* xorshift, one state per context so that the interrupts don't share one */
+static uint32_t rnd (uint32_t ctx)
+{
+    uint32_t x = rnd_state[ctx];
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return rnd_state[ctx] = x;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    sigset_t set, old;
+    sigemptyset (&set);
+    sigaddset (&set, SIG_LOW);
+    sigaddset (&set, SIG_HIGH);
+    pthread_sigmask (SIG_BLOCK, &set, &old);
+    /* Only the signals which weren't masked are unmasked at the exit */
+    *is_critical_entered = (!sigismember (&old, SIG_LOW)) |
+            ((!sigismember (&old, SIG_HIGH)) << 1) | 0x80;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+    sigset_t set;
+    host_cr_nest_err += ((is_critical_entered & 0x80) == 0);
+    sigemptyset (&set);
+    if(is_critical_entered & 1)
+    {
+        sigaddset (&set, SIG_LOW);
+    }
+    if(is_critical_entered & 2)
+    {
+        sigaddset (&set, SIG_HIGH);
+    }
+    pthread_sigmask (SIG_UNBLOCK, &set, NULL);
+}
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+static void post (uint32_t src)
+{
+    uint32_t seq = next_seq[src];
+    bool ok;
+    t_post[src][seq & TMASK] = now_ns ();
+    if(src == SRC_MSG)
+    {
+        uint32_t before = host_posted[EVT_SCHED_PRIO_MID];
+        irq_msg_push ((seq & 1) ? MSG_STATE_CHANGE : MSG_NEXT_INTERVAL, DATA(src, seq));
+        ok = (evt_sched_get_stats (EVT_SCHED_PRIO_MID)->posted != before);
+    }
+    else
+    {
+        ok = evt_sched_post (src_id[src], src_prio[src], DATA(src, seq));
+    }
+    /* A dropped event doesn't take a sequence number. The counts are also
+       updated by the main loop, so an interrupt mustn't come in between. */
+    CRITICAL_REGION_ENTER ();
+    if(ok)
+    {
+        next_seq[src] = seq + 1;
+        host_posted[src_prio[src]]++;
+    }
+    else
+    {
+        host_dropped[src_prio[src]]++;
+    }
+    CRITICAL_REGION_EXIT ();
+}
+
+/* The interrupts stop at the end of the run, so that an overloaded
+   evt_sched_process can return */
+static void rearm (uint32_t idx)
+{
+    struct itimerspec its;
+    if(now_ns () > end_ns)
+    {
+        return;
+    }
+    memset (&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1000 + rnd (idx) % (2*period_ns);
+    timer_settime (timer[idx], 0, &its, NULL);
+}
+
+static void isr_high (int sig)
+{
+    post (SRC_HIGH);
+    rearm (1);
+}
+
+static void isr_low (int sig)
+{
+    post ((rnd (0) & 1) ? SRC_MID : SRC_LOW);
+    if(rnd (0) & 1)
+    {
+        post (SRC_MSG);
+    }
+    rearm (0);
+}
+
+static void check (void * data)
+{
+    uint32_t src = ((uintptr_t) data) >> 24, seq = ((uintptr_t) data) & 0xFFFFFF;
+    evt_sched_prio_t prio = src_prio[src];
+
+    if(seq != (expect_seq[src] & 0xFFFFFF))
+    {
+        host_order_err++;
+    }
+    expect_seq[src] = seq + 1;
+    for(uint32_t q = 0; q < prio; q++)
+    {
+        if(host_dispatched[q] < snapshot[q])
+        {
+            host_prio_err++;
+        }
+    }
+    host_dispatched[prio]++;
+
+    uint64_t lat = (now_ns () - t_post[src][seq & TMASK])/1000;
+    host_hist[prio][(lat < HIST_LEN) ? lat : HIST_LEN - 1]++;
+
+    uint64_t end = now_ns () + rnd (2) % (2*work_ns + 1);
+    while(now_ns () < end)
+    {
+    }
+    if((src != SRC_MAIN) && (rnd (2) % 8 == 0))
+    {
+        post (SRC_MAIN);
+    }
+
+    /* The posts so far, which are all before the next pick of an event */
+    CRITICAL_REGION_ENTER ();
+    memcpy (snapshot, (void *) host_posted, sizeof(snapshot));
+    CRITICAL_REGION_EXIT ();
+}
+
+static void handler (uint16_t id, void * data)
+{
+    last_data = data;
+    check (data);
+}
+
+/* Subscribed after handler to the ID of the high priority events */
+static void handler_second (uint16_t id, void * data)
+{
+    host_sub_err += (last_data != data);
+    last_data = NULL;
+}
+
+static void msg_cb (uint32_t data)
+{
+    check ((void *) (uintptr_t) data);
+}
+
+static void idle (void)
+{
+    host_idle++;
+}
+
+void host_run (double seconds, uint32_t period_us, uint32_t work_us)
+{
+    struct sigaction sa;
+    struct sigevent sev;
+    irq_msg_callbacks cb = {msg_cb, msg_cb};
+
+    memset ((void *) next_seq, 0, sizeof(next_seq));
+    memset ((void *) expect_seq, 0, sizeof(expect_seq));
+    memset ((void *) host_posted, 0, sizeof(host_posted));
+    memset ((void *) host_dropped, 0, sizeof(host_dropped));
+    memset (host_dispatched, 0, sizeof(host_dispatched));
+    memset (host_hist, 0, sizeof(host_hist));
+    memset (snapshot, 0, sizeof(snapshot));
+    host_order_err = host_prio_err = host_sub_err = host_idle = host_assert = 0;
+    host_cr_nest_err = 0;
+    period_ns = period_us*1000;
+    work_ns = work_us*1000;
+
+    evt_sched_init (idle);
+    irq_msg_init (&cb);
+    for(uint32_t src = SRC_HIGH; src < SRC_MAX; src++)
+    {
+        if(src != SRC_MSG)
+        {
+            evt_sched_subscribe (src_id[src], handler);
+        }
+    }
+    evt_sched_subscribe (src_id[SRC_HIGH], handler_second);
+
+    /* The lower interrupt can be preempted by the higher one, not the reverse */
+    memset (&sa, 0, sizeof(sa));
+    sa.sa_handler = isr_low;
+    sigemptyset (&sa.sa_mask);
+    sigaction (SIG_LOW, &sa, NULL);
+    sa.sa_handler = isr_high;
+    sigaddset (&sa.sa_mask, SIG_LOW);
+    sigaction (SIG_HIGH, &sa, NULL);
+
+    memset (&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIG_LOW;
+    timer_create (CLOCK_MONOTONIC, &sev, &timer[0]);
+    sev.sigev_signo = SIG_HIGH;
+    timer_create (CLOCK_MONOTONIC, &sev, &timer[1]);
+    end_ns = now_ns () + (uint64_t) (seconds*1e9);
+    rearm (0);
+    rearm (1);
+
+    while(now_ns () < end_ns)
+    {
+        evt_sched_process ();
+    }
+
+    timer_delete (timer[0]);
+    timer_delete (timer[1]);
+    evt_sched_process ();
+    evt_sched_unsubscribe (src_id[SRC_HIGH], handler_second);
+}
+
+uint32_t host_stat (uint32_t prio, uint32_t field)
+{
+    const evt_sched_stats_t * s = evt_sched_get_stats (prio);
+    return (field == 0) ? s->posted : ((field == 1) ? s->dropped : s->max_depth);
+}
+
+uint32_t host_pending (void)
+{
+    uint32_t pending = 0;
+    for(uint32_t src = 0; src < SRC_MAX; src++)
+    {
+        pending += next_seq[src] - expect_seq[src];
+    }
+    return pending;
+}
+"""
+
+def percentile(hist, p):
+	total = sum(hist)
+	if total == 0:
+		return 0
+	acc = 0
+	for us, cnt in enumerate(hist):
+		acc += cnt
+		if acc * 100.0 >= total * p:
+			return us
+	return len(hist) - 1
+
+class Suite(object):
+	def __init__(self, lib):
+		self.lib = lib
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def val(self, name, typ=ctypes.c_uint32):
+		return typ.in_dll(self.lib, name).value
+
+	def arr(self, name):
+		return list((ctypes.c_uint32 * 3).in_dll(self.lib, name))
+
+	def run(self, name, period_us, work_us):
+		print("%s load: interrupts every %d us on average, handlers of %d us" %
+				(name, period_us, work_us))
+		self.lib.host_run(ctypes.c_double(args.seconds), period_us, work_us)
+		posted, dropped = self.arr("host_posted"), self.arr("host_dropped")
+		dispatched = self.arr("host_dispatched")
+		stats = [[self.lib.host_stat(p, f) for f in range(3)] for p in range(3)]
+		total = sum(posted)
+		self.check("%d events posted, all dispatched once" % total,
+				dispatched == posted and self.lib.host_pending() == 0,
+				"posted %s, dispatched %s" % (posted, dispatched))
+		self.check("in order per source", self.val("host_order_err") == 0,
+				"%d out of order" % self.val("host_order_err"))
+		self.check("never before a pending higher priority event",
+				self.val("host_prio_err") == 0, "%d inversions" % self.val("host_prio_err"))
+		self.check("second subscriber called right after the first",
+				self.val("host_sub_err") == 0, "%d errors" % self.val("host_sub_err"))
+		self.check("statistics match the posts and drops %s" % dropped,
+				[s[0] for s in stats] == posted and [s[1] for s in stats] == dropped and
+				all(s[2] <= 16 for s in stats), "stats %s, posted %s, dropped %s" %
+				(stats, posted, dropped))
+		self.check("critical regions and asserts", self.val("host_cr_nest_err") == 0 and
+				self.val("host_assert") == 0)
+		hist = (ctypes.c_uint32 * 100000 * 3).in_dll(self.lib, "host_hist")
+		for p in range(3):
+			h = list(hist[p])
+			pct = [percentile(h, q) for q in (50, 90, 99, 100)]
+			pct = [(">%d" % (len(h) - 1)) if v == len(h) - 1 else str(v) for v in pct]
+			print("  %-4s latency us: p50 %s, p90 %s, p99 %s, max %s, max depth %d" %
+					tuple([PRIOS[p]] + pct + [stats[p][2]]))
+		print("  idle handler calls: %d" % self.val("host_idle"))
+
+def main():
+	cc = os.environ.get("CC", "cc")
+	tmp = tempfile.mkdtemp()
+	try:
+		with open(os.path.join(tmp, "harness.c"), "w") as f:
+			f.write(HARNESS)
+		so = os.path.join(tmp, "evt_sched.so")
+		subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+				"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+				"-DNRF52832_XXAA"] + ["-I" + i for i in INC] + ["-o", so,
+				os.path.join(tmp, "harness.c"), "codebase/util/evt_sched.c",
+				"codebase/util/irq_msg_util.c", "-lrt"])
+		suite = Suite(ctypes.CDLL(so))
+		for name, period, work in LOADS:
+			suite.run(name, period, work)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
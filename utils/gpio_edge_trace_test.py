@@ -0,0 +1,550 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of button_ui and gpio_level_handler on gpio_edge with scripted edge
+# traces. The modules are built for the host on a model of the GPIO port
+# and the GPIOTE PORT event: a pin is latched while its level matches its
+# SENSE, a LATCH clear leaving bits set raises the PORT event again as in
+# the LDETECT mode, and the DETECT mode of the old button_ui raises it on
+# the rising edge of the OR of the pins. The ms_timer is a stub on the RTC
+# counter of the model, which counts at 32768 Hz.
+#
+# The button presses are scripted with contact bounces on the press and
+# the release. The step and release events of button_ui must be the ones
+# of the old button_ui, polled every fast tick, for the same presses
+# without the bounces. The wakeups of a long press, the PORT interrupts
+# and the timer callbacks, are reported against the ones of the old
+# button_ui, which were the interrupt and every fast tick of the press.
+#
+# The GPIO level handler must report every change of a pin once, the first
+# edge of a change at once, no two changes of a pin within the debounce
+# time and the level the pin settles at. The PORT event must not be lost
+# for edges which come while the handlers run.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   gpio_edge_trace_test.py [--presses 40] [--seed 36] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="GPIO edge trace test")
+parser.add_argument("--presses", type=int, default=40, help="button presses scripted")
+parser.add_argument("--seed", type=int, default=36, help="seed of the traces")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform"]
+
+P0_BASE = 0x50000000
+GPIOTE_BASE = 0x40006000
+RTC1_BASE = 0x40011000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+GPIO_IN = 0x510
+GPIO_LATCH = 0x520
+GPIO_DETECTMODE = 0x524
+GPIO_PIN_CNF = 0x700
+GPIOTE_EVENTS_PORT = 0x17C
+GPIOTE_INTENSET = 0x304
+INTEN_PORT = 1 << 31
+RTC_COUNTER = 0x504
+
+SENSE_HIGH = 2
+SENSE_LOW = 3
+
+TICKS_S = 32768
+RTC_MASK = 0xFFFFFF
+
+def ms(x):
+	return int(round(x * TICKS_S / 1000.0))
+
+# sensepi_rev3, the button is active low
+BUTTON_PIN = 26
+# The fast tick of the sense_pir app, which polled the old button_ui
+FAST_TICK = ms(60)
+DEBOUNCE = ms(20)
+# press_duration of button_ui.h
+STEPS = [ms(100), ms(5000), ms(15000)]
+STEP_NAMES = ["QUICK", "SHORT", "LONG", "WAKE"]
+ACT_NAMES = ["CROSS", "RELEASE"]
+
+# Pins of the level handler, the first triggers on high
+LEVEL_PINS = [(3, True), (4, False)]
+
+CFLAGS = ["-DISR_MANAGER=0", "-DRTC_USED_MS_TIMER=1", "-DSYS_CFG_PRESENT=0",
+		"-DMS_TIMER_USED_BUTTON_UI=3", "-DMS_TIMER_USED_GPIO_LEVEL=2"]
+
+HARNESS = r"""
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+#include "ms_timer.h"
+
+extern inline uint32_t ms_timer_get_current_count(void);
+
+void (*host_on_latch_clr) (uint32_t pins);
+
+void host_latch_clr (uint32_t pins)
+{
+    host_on_latch_clr (pins);
+}
+
+uint32_t host_assert;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+
+/* The one shot timers of ms_timer, fired by the model at their count */
+uint32_t host_timer_on[4];
+uint32_t host_timer_at[4];
+void (*host_timer_cb[4]) (void);
+
+void ms_timer_start (ms_timer_num id, ms_timer_mode mode, uint64_t ticks,
+        void (*handler) (void))
+{
+    host_timer_at[id] = (ms_timer_get_current_count () + ticks) & 0xFFFFFF;
+    host_timer_cb[id] = handler;
+    host_timer_on[id] = 1;
+}
+
+void ms_timer_stop (ms_timer_num id)
+{
+    host_timer_on[id] = 0;
+}
+
+void host_timer_fire (uint32_t id)
+{
+    host_timer_on[id] = 0;
+    host_timer_cb[id] ();
+}
+"""
+
+LEVEL_HARNESS = r"""
+#include <stdint.h>
+#include <stdbool.h>
+#include "gpio_level_handler.h"
+
+void (*host_on_level) (uint32_t pin, bool is_on);
+
+static void level_3 (bool is_on)
+{
+    host_on_level (3, is_on);
+}
+
+static void level_4 (bool is_on)
+{
+    host_on_level (4, is_on);
+}
+
+void host_level_init (void)
+{
+    static gpio_level_cfg cfg[] =
+    {
+        {.handler = level_3, .pin_num = 3, .pull_cfg = 1, .trigger_on_high = true},
+        {.handler = level_4, .pin_num = 4, .pull_cfg = 3, .trigger_on_high = false},
+    };
+    gpio_level_init (cfg, 2, 3);
+}
+"""
+
+BUTTON_HARNESS = r"""
+#include <stdint.h>
+#include "button_ui.h"
+
+void (*host_on_button) (uint32_t step, uint32_t act);
+
+static void button_handler (button_ui_steps step, button_ui_action act)
+{
+    host_on_button (step, act);
+}
+
+void host_button_init (uint32_t pin)
+{
+    button_ui_init (pin, 3, button_handler);
+}
+"""
+
+LATCH_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint32)
+LEVEL_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_bool)
+BUTTON_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_uint32)
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (P0_BASE, GPIOTE_BASE, RTC1_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+class Port(object):
+	"""The GPIO port, the GPIOTE PORT event and the RTC of ms_timer, with
+	the module under test built in lib"""
+	def __init__(self, lib):
+		self.lib = lib
+		self.on_latch_clr = LATCH_FN(self.latch_clr)
+		ctypes.c_void_p.in_dll(lib, "host_on_latch_clr").value = \
+				ctypes.cast(self.on_latch_clr, ctypes.c_void_p).value
+		self.timer_on = (ctypes.c_uint32 * 4).in_dll(lib, "host_timer_on")
+		self.timer_at = (ctypes.c_uint32 * 4).in_dll(lib, "host_timer_at")
+		for base in (P0_BASE, GPIOTE_BASE, RTC1_BASE):
+			ctypes.memset(base, 0, PAGE)
+		self.t = 0
+		self.level = 0
+		self.detect = False
+		self.port_isrs = 0
+		self.timer_calls = 0
+		self.in_isr = None
+
+	def sensed(self):
+		"""The pins whose level matches their SENSE"""
+		pins = 0
+		for pin in range(32):
+			sense = (reg(P0_BASE + GPIO_PIN_CNF + 4 * pin).value >> 16) & 3
+			level = (self.level >> pin) & 1
+			if (sense == SENSE_HIGH and level) or (sense == SENSE_LOW and not level):
+				pins |= 1 << pin
+		return pins
+
+	def settle(self):
+		"""Latch the sensed pins and raise the PORT event on a rising DETECT"""
+		reg(P0_BASE + GPIO_IN).value = self.level
+		reg(RTC1_BASE + RTC_COUNTER).value = self.t & RTC_MASK
+		sensed = self.sensed()
+		if reg(P0_BASE + GPIO_DETECTMODE).value & 1:
+			latch = reg(P0_BASE + GPIO_LATCH).value
+			reg(P0_BASE + GPIO_LATCH).value = latch | sensed
+			detect = (latch | sensed) != 0
+		else:
+			detect = sensed != 0
+		if detect and not self.detect:
+			reg(GPIOTE_BASE + GPIOTE_EVENTS_PORT).value = 1
+		self.detect = detect
+
+	def latch_clr(self, pins):
+		latch = reg(P0_BASE + GPIO_LATCH).value & ~pins
+		latch |= self.sensed()
+		reg(P0_BASE + GPIO_LATCH).value = latch
+		# LDETECT rises again if bits are left after a clear
+		if latch:
+			reg(GPIOTE_BASE + GPIOTE_EVENTS_PORT).value = 1
+		self.detect = latch != 0
+		if self.in_isr:
+			self.in_isr()
+
+	def run_isrs(self):
+		self.settle()
+		for _ in range(100):
+			if reg(GPIOTE_BASE + GPIOTE_EVENTS_PORT).value and \
+					reg(GPIOTE_BASE + GPIOTE_INTENSET).value & INTEN_PORT:
+				self.port_isrs += 1
+				self.lib.GPIOTE_IRQHandler()
+				self.settle()
+			else:
+				return
+		sys.exit("The PORT interrupt stays pending")
+
+	def next_timer(self):
+		due = [(self.t + ((self.timer_at[i] - self.t) & RTC_MASK), i)
+				for i in range(4) if self.timer_on[i]]
+		return min(due) if due else None
+
+	def run_to(self, end):
+		"""Fire the timers due till end"""
+		while True:
+			nxt = self.next_timer()
+			if nxt is None or nxt[0] > end:
+				break
+			self.t = nxt[0]
+			self.settle()
+			self.timer_calls += 1
+			self.lib.host_timer_fire(nxt[1])
+			self.run_isrs()
+		self.t = end
+		self.settle()
+
+	def play(self, trace, end=None):
+		"""Play a trace of (time, pin, level) and run till end"""
+		for t, pin, level in trace:
+			self.run_to(t)
+			self.set_pin(pin, level)
+			self.run_isrs()
+		if end is not None:
+			self.run_to(end)
+
+	def set_pin(self, pin, level):
+		self.level = (self.level & ~(1 << pin)) | (level << pin)
+		self.settle()
+
+def bounces(rnd, t, pin, level):
+	"""An edge to level at t with contact bounces after it"""
+	edges = [(t, pin, level)]
+	for _ in range(rnd.randint(0, 8)):
+		t += rnd.randint(2, 40)
+		level ^= 1
+		edges.append((t, pin, level))
+	if level != edges[0][2]:
+		edges.append((t + rnd.randint(2, 40), pin, edges[0][2]))
+	return edges
+
+def press_durations(rnd):
+	"""Press durations away from the steps, as the old button_ui measured
+	them in fast ticks"""
+	bands = [(ms(20), ms(60)), (ms(300), ms(4500)), (ms(5400), ms(14000)),
+			(ms(15500), ms(20000))]
+	return [rnd.randint(*rnd.choice(bands)) for _ in range(args.presses)]
+
+class Suite(object):
+	def __init__(self, tmp):
+		self.tmp = tmp
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + str(detail))
+
+	def build(self, name, sources, extra=[]):
+		cc = os.environ.get("CC", "cc")
+		files = []
+		for fname, text in sources:
+			path = os.path.join(self.tmp, fname)
+			with open(path, "w") as f:
+				f.write(text)
+			files.append(path)
+		so = os.path.join(self.tmp, name + ".so")
+		subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w",
+				"-U__linux__", "-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix",
+				"-DNRF52832", "-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-iquote", self.tmp] +
+				CFLAGS + extra + ["-I" + i for i in INC] + ["-o", so] + files)
+		return ctypes.CDLL(so)
+
+	def module(self, path, text=None):
+		"""A module with its writes to the LATCH routed to the model"""
+		if text is None:
+			text = open(path).read()
+		text = re.sub(r"NRF_GPIO->LATCH\s*=\s*([^;]+);", r"host_latch_clr(\1);", text)
+		# RBIT is inline assembly for the Cortex-M
+		text = text.replace("__CLZ(__RBIT(", "__builtin_ctz((")
+		return (os.path.basename(path), "#include <stdint.h>\n"
+				"void host_latch_clr (uint32_t pins);\n" + text)
+
+	def button_run(self, lib, presses, is_polled):
+		"""Play the presses on the button and return the events and the
+		wakeups of each press"""
+		port = Port(lib)
+		events = []
+		cur = [None]
+		on_button = BUTTON_FN(lambda step, act: events.append(
+				(cur[0], STEP_NAMES[step], ACT_NAMES[act])))
+		ctypes.c_void_p.in_dll(lib, "host_on_button").value = \
+				ctypes.cast(on_button, ctypes.c_void_p).value
+		port.set_pin(BUTTON_PIN, 1)
+		lib.host_button_init(BUTTON_PIN)
+		port.run_isrs()
+		port.t = ms(1000)
+		wakeups = []
+		tick = 0
+		for n, (down, up) in enumerate(presses):
+			cur[0] = n
+			start = port.port_isrs + port.timer_calls
+			ticks = 0
+			end = up[-1][0] + ms(500)
+			for t, pin, level in down + up:
+				if is_polled:
+					while tick < t:
+						port.run_to(tick)
+						lib.button_ui_add_tick(FAST_TICK)
+						ticks += 1 if down[0][0] <= tick <= up[-1][0] + FAST_TICK else 0
+						tick += FAST_TICK
+				port.run_to(t)
+				port.set_pin(pin, level)
+				port.run_isrs()
+			if is_polled:
+				while tick < end:
+					port.run_to(tick)
+					lib.button_ui_add_tick(FAST_TICK)
+					ticks += 1 if tick <= up[-1][0] + FAST_TICK else 0
+					tick += FAST_TICK
+			port.run_to(end)
+			wakeups.append(port.port_isrs + port.timer_calls - start + ticks)
+		return events, wakeups
+
+	def test_button(self, old_src, new_srcs):
+		rnd = random.Random(args.seed)
+		durations = press_durations(rnd)
+		clean, bouncy = [], []
+		t = ms(2000)
+		for d in durations:
+			t = (t // FAST_TICK + 1) * FAST_TICK + rnd.randint(1, FAST_TICK - 1)
+			clean.append(([(t, BUTTON_PIN, 0)], [(t + d, BUTTON_PIN, 1)]))
+			bouncy.append((bounces(rnd, t, BUTTON_PIN, 0), bounces(rnd, t + d, BUTTON_PIN, 1)))
+			t += d + ms(1000)
+
+		old = self.build("button_old", [("harness.c", HARNESS), ("button.c", BUTTON_HARNESS),
+				self.module("button_ui.c", old_src)])
+		new = self.build("button_new", [("harness.c", HARNESS), ("button.c", BUTTON_HARNESS)] +
+				new_srcs)
+
+		old_events, old_wakeups = self.button_run(old, clean, True)
+		new_events, new_wakeups = self.button_run(new, bouncy, False)
+		diff = [(a, b) for a, b in zip(old_events, new_events) if a != b]
+		self.check("%d step events of %d bouncy presses as the old button_ui's clean ones" %
+				(len(new_events), len(bouncy)), old_events == new_events and len(old_events),
+				diff[:2] or (len(old_events), len(new_events)))
+		press_wakes = [sum(1 for e in new_events if e[0] == n and e[1] == "WAKE" and
+				e[2] == "CROSS") for n in range(len(bouncy))]
+		self.check("one wake per press", all(w == 1 for w in press_wakes))
+		self.check("no asserts", ctypes.c_uint32.in_dll(new, "host_assert").value == 0)
+
+		longs = [n for n, d in enumerate(durations) if d > STEPS[2]]
+		if longs:
+			n = max(longs, key=lambda n: durations[n])
+			print("Wakeups of a %.1f s press: %d now with %d bounces, %d polled every %d ms" %
+					(durations[n] / float(TICKS_S), new_wakeups[n],
+					len(bouncy[n][0]) + len(bouncy[n][1]) - 2, old_wakeups[n],
+					int(round(FAST_TICK * 1000.0 / TICKS_S))))
+			self.check("fewer wakeups of a long press than polled",
+					new_wakeups[n] < old_wakeups[n])
+
+	def test_level(self, srcs):
+		lib = self.build("level", [("harness.c", HARNESS), ("level.c", LEVEL_HARNESS)] + srcs)
+		rnd = random.Random(args.seed + 1)
+		for name, gap, bounce in (("clean", (ms(30), ms(400)), False),
+				("bouncy", (ms(1), ms(400)), True)):
+			port = Port(lib)
+			reports = {pin: [] for pin, _ in LEVEL_PINS}
+			on_level = LEVEL_FN(lambda pin, is_on: reports[pin].append((port.t, is_on)))
+			ctypes.c_void_p.in_dll(lib, "host_on_level").value = \
+					ctypes.cast(on_level, ctypes.c_void_p).value
+			# Idle levels, off for both
+			port.set_pin(3, 0)
+			port.set_pin(4, 1)
+			lib.host_level_init()
+			port.run_isrs()
+
+			trace = []
+			for pin, is_high in LEVEL_PINS:
+				t = ms(100)
+				level = 0 if is_high else 1
+				for _ in range(200):
+					t += rnd.randint(*gap)
+					level ^= 1
+					if bounce:
+						trace += bounces(rnd, t, pin, level)
+						t = trace[-1][0]
+					else:
+						trace.append((t, pin, level))
+			trace.sort()
+
+			# Both pins end off. An edge of pin 4 while the handler of pin 3
+			# runs must be seen.
+			burst = []
+			def edge_in_isr():
+				if burst:
+					port.set_pin(*burst.pop())
+			port.in_isr = edge_in_isr
+			t_end = trace[-1][0] + ms(100)
+			port.play(trace)
+			burst.append((4, 0))
+			port.play([(t_end, 3, 1)], t_end + ms(100))
+			trace += [(t_end, 3, 1), (t_end, 4, 0)]
+
+			for pin, is_high in LEVEL_PINS:
+				rep = reports[pin]
+				edges = [(e[0], (e[2] == 1) == is_high) for e in trace if e[1] == pin]
+				alternate = all(a[1] != b[1] for a, b in zip(rep, rep[1:])) and \
+						rep and rep[0][1]
+				spaced = all(b[0] - a[0] >= DEBOUNCE for a, b in zip(rep, rep[1:]))
+				settled = rep and rep[-1][1] == edges[-1][1]
+				self.check("%s pin %d: %d reports alternate, %d ms apart, end at the level" %
+						(name, pin, len(rep), 20), alternate and spaced and settled,
+						(alternate, spaced, settled))
+				if bounce:
+					# A report is at an edge to its level or at the end of
+					# the debounce of the report before it
+					times = set(t for t, on in edges)
+					late = [r for i, r in enumerate(rep) if r[0] not in times and
+							(i == 0 or r[0] - rep[i - 1][0] != DEBOUNCE)]
+					self.check("bouncy pin %d: changes reported at the edge or the debounce end" %
+							pin, not late, late[:2])
+				else:
+					ok = rep == edges
+					self.check("clean pin %d: every edge reported at once" % pin, ok,
+							[(a, b) for a, b in zip(rep, edges) if a != b][:2])
+			self.check("%s: pin 4 edge in the handler seen" % name,
+					reports[4][-1][1] is True)
+		self.check("no asserts", ctypes.c_uint32.in_dll(lib, "host_assert").value == 0)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		suite = Suite(tmp)
+		edge = suite.module("codebase/peripheral_modules/gpio_edge.c")
+		old_button = subprocess.check_output(["git", "show",
+				"3d2b980^:codebase/peripheral_modules/button_ui.c"]).decode()
+		suite.test_button(old_button, [edge,
+				suite.module("codebase/peripheral_modules/button_ui.c")])
+		suite.test_level([edge, suite.module("codebase/peripheral_modules/gpio_level_handler.c")])
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,373 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of the ISR dispatch (codebase/util/isr_dispatch.h) with ms_timer and
+# aux_clk built with ISR_MANAGER, on a register bank of the RTC and TIMER at
+# their nRF52 addresses. The ISRs take the events as the isr_manager.c of the
+# applications do and pass the mask to the module handlers. The writes to
+# the INTENSET, INTENCLR, EVTENSET and EVTENCLR registers go through a hook,
+# so that INTEN and EVTEN are kept as the hardware does. The test raises the
+# events as the counters would, and runs an ISR as long as an enabled event
+# is set, as the NVIC keeps the interrupt pending.
+#
+# Checked:
+# - An event which comes while the handlers run isn't lost and is handled
+#   once, in the next run of the ISR.
+# - The compare event of a stopped ms_timer, whose CC still matches, doesn't
+#   call its handler when another event of the RTC interrupts.
+# - A long ms_timer doesn't expire at the overflow before its last one, from
+#   the compare event set on an earlier wrap of the counter.
+# - The compare events of aux_clk only routed through PPI are cleared and
+#   aren't passed to the callback.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   isr_dispatch_test.py [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="ISR dispatch register bank test")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules"]
+
+# Peripherals used by the test build
+RTC0_BASE = 0x4000B000
+RTC1_BASE = 0x40011000
+TIMER1_BASE = 0x40009000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+EVENTS_OVRFLW = 0x104
+EVENTS_COMPARE = 0x140
+INTENSET = 0x304
+RTC_COUNTER = 0x504
+RTC_CC = 0x540
+
+# ms_timer_mode
+MS_SINGLE_CALL = 0
+MS_REPEATED_CALL = 1
+
+CFLAGS = ["-DISR_MANAGER=1", "-DMS_TIMER_RTC_USED=1", "-DRTC_USED_AUX_CLK=0",
+		"-DTIMER_USED_AUX_CLK=1", "-DAUX_CLK_HFCLK_SOLO_MODULE=0"]
+
+HARNESS = r"""
+#include <stdint.h>
+#include "nrf.h"
+#include "isr_dispatch.h"
+
+void ms_timer_rtc_Handler (uint32_t fired);
+void aux_clk_timer_handler (uint32_t fired);
+
+/* The SET and CLR registers follow the register they act on, which reads
+ * the same from all three */
+void host_setclr (volatile uint32_t * reg, uint32_t val)
+{
+    volatile uint32_t * base = (volatile uint32_t *) ((uintptr_t) reg & ~0xFUL);
+    uint32_t cur = base[0];
+    cur = (((uintptr_t) reg & 0xF) == 4) ? (cur | val) : (cur & ~val);
+    base[0] = base[1] = base[2] = cur;
+}
+
+/* As RTC1_IRQHandler and TIMER1_IRQHandler of the ISR managers */
+void host_rtc1_isr (void)
+{
+    uint32_t fired = isr_dispatch_take (NRF_RTC1);
+    ISR_DISPATCH_CALL (ms_timer_rtc_Handler, fired);
+}
+
+void host_timer1_isr (void)
+{
+    uint32_t fired = isr_dispatch_take (NRF_TIMER1);
+    ISR_DISPATCH_CALL (aux_clk_timer_handler, fired);
+}
+"""
+
+STUB = r"""
+#include <stdint.h>
+#include "hal_ppi.h"
+
+uint32_t host_assert;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+
+ppi_setup_status_t hal_ppi_set (hal_ppi_setup_t * setup)
+{
+    return PPI_SETUP_SUCCESSFUL;
+}
+
+void hal_ppi_en_ch (uint32_t ppi_id)
+{
+}
+
+void hal_ppi_dis_ch (uint32_t ppi_id)
+{
+}
+
+int log_printf (const char * fmt, ...)
+{
+    return 0;
+}
+"""
+
+# Empty isr_manager.h for the modules built with ISR_MANAGER
+ISR_MANAGER_H = "\n"
+
+VOID_FN = ctypes.CFUNCTYPE(None)
+EVT_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint8)
+
+def hook_setclr(text):
+	"""Route the writes to the SET and CLR registers through host_setclr"""
+	return re.sub(r"(\w+)->((?:INTEN|EVTEN)(?:SET|CLR))\s*\|?=\s*([^;]+);",
+			r"host_setclr(&(\1)->\2, (\3));", text)
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (RTC0_BASE, RTC1_BASE, TIMER1_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+def clear_pages():
+	for base in (RTC0_BASE, RTC1_BASE, TIMER1_BASE):
+		ctypes.memset(base, 0, PAGE)
+
+def pending(base):
+	"""If an event enabled in INTEN is set, as the NVIC would see it"""
+	inten = reg(base + INTENSET).value
+	return any((inten >> n) & 1 and reg(base + 0x100 + 4 * n).value for n in range(32))
+
+class Suite(object):
+	def __init__(self, lib):
+		self.lib = lib
+		self.fails = 0
+		self.calls = []
+		# Keep the callbacks referenced as long as the library can call them
+		self.cbs = [VOID_FN(lambda n=n: self.on_timer(n)) for n in range(4)]
+		self.on_call = {}
+		self.aux_cb = EVT_FN(self.on_aux)
+		self.aux_events = []
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def on_timer(self, n):
+		self.calls.append(n)
+		hook = self.on_call.pop(n, None)
+		if hook:
+			hook()
+
+	def on_aux(self, events):
+		self.aux_events.append(events)
+
+	def run_isr(self, base, isr):
+		"""Run the ISR while its interrupt is pending, return the runs"""
+		runs = 0
+		while pending(base) and runs < 10:
+			isr()
+			runs += 1
+		return runs
+
+	def ms_timer_reset(self):
+		clear_pages()
+		self.calls = []
+		self.on_call = {}
+		self.lib.ms_timer_init(3)
+
+	def compare(self, base, n):
+		reg(base + EVENTS_COMPARE + 4 * n).value = 1
+
+	def test_mid_handler(self):
+		"""Events raised from the handler of an earlier event of the ISR"""
+		self.ms_timer_reset()
+		self.lib.ms_timer_start(0, MS_REPEATED_CALL, ctypes.c_uint64(100), self.cbs[0])
+		self.lib.ms_timer_start(1, MS_SINGLE_CALL, ctypes.c_uint64(300), self.cbs[1])
+		seen = []
+
+		def during_first():
+			# The taken event is already cleared when the handler runs
+			seen.append(reg(RTC1_BASE + EVENTS_COMPARE).value)
+			# The next period of timer 0 and the expiry of timer 1 come now
+			self.compare(RTC1_BASE, 0)
+			self.compare(RTC1_BASE, 1)
+		self.on_call[0] = during_first
+		self.compare(RTC1_BASE, 0)
+		runs = self.run_isr(RTC1_BASE, self.lib.host_rtc1_isr)
+		self.check("event taken before the handlers run", seen == [0], "read %s" % seen)
+		self.check("events raised in a handler handled once in the next run",
+				sorted(self.calls) == [0, 0, 1] and runs == 2,
+				"calls %s in %d runs" % (self.calls, runs))
+		self.check("no enabled event left set", not pending(RTC1_BASE))
+
+	def test_stopped_compare(self):
+		"""A stopped timer's CC still matches and sets its compare event"""
+		self.ms_timer_reset()
+		self.lib.ms_timer_start(0, MS_SINGLE_CALL, ctypes.c_uint64(100), self.cbs[0])
+		self.lib.ms_timer_start(1, MS_SINGLE_CALL, ctypes.c_uint64(50), self.cbs[1])
+		self.lib.ms_timer_stop(1)
+		self.compare(RTC1_BASE, 1)
+		stray = pending(RTC1_BASE)
+		self.compare(RTC1_BASE, 0)
+		self.run_isr(RTC1_BASE, self.lib.host_rtc1_isr)
+		self.check("stopped timer's compare event doesn't interrupt", not stray)
+		self.check("stopped timer's handler not called by another event",
+				self.calls == [0], "calls %s" % self.calls)
+
+	def test_long_timer(self):
+		"""A timer longer than a wrap of the 24 bit counter"""
+		self.ms_timer_reset()
+		reg(RTC1_BASE + RTC_COUNTER).value = 100
+		self.lib.ms_timer_start(2, MS_SINGLE_CALL, ctypes.c_uint64((1 << 24) + 1000), self.cbs[2])
+		cc = reg(RTC1_BASE + RTC_CC + 8).value
+		# The counter passes CC before the overflow, the compare interrupt
+		# isn't enabled yet but the event is set
+		reg(RTC1_BASE + RTC_COUNTER).value = cc
+		self.compare(RTC1_BASE, 2)
+		early = pending(RTC1_BASE)
+		reg(RTC1_BASE + RTC_COUNTER).value = 0
+		reg(RTC1_BASE + EVENTS_OVRFLW).value = 1
+		self.run_isr(RTC1_BASE, self.lib.host_rtc1_isr)
+		at_overflow = list(self.calls)
+		reg(RTC1_BASE + RTC_COUNTER).value = cc
+		self.compare(RTC1_BASE, 2)
+		self.run_isr(RTC1_BASE, self.lib.host_rtc1_isr)
+		self.check("long timer not expired by the compare before the overflow",
+				not early and at_overflow == [], "calls at the overflow %s" % at_overflow)
+		self.check("long timer expired at its compare after the overflow",
+				self.calls == [2], "calls %s" % self.calls)
+
+	def test_aux_clk_ppi(self):
+		"""A compare event of aux_clk only used through PPI"""
+		clear_pages()
+		setup = AuxClkSetup()
+		setup.source = 1
+		setup.irq_priority = 3
+		setup.callback_handler = self.aux_cb
+		setup.arr_cc_ms = (ctypes.c_uint32 * 4)(10, 20, 0, 0)
+		setup.events_en = 0x02
+		# Channel 0 clears the counter through PPI, without an interrupt
+		setup.arr_ppi_cnf[0] = AuxClkPpi(0x01, 2, 0)
+		self.lib.aux_clk_set(ctypes.byref(setup))
+		self.lib.aux_clk_start()
+		self.aux_events = []
+		self.compare(TIMER1_BASE, 0)
+		stray = pending(TIMER1_BASE)
+		self.compare(TIMER1_BASE, 1)
+		self.run_isr(TIMER1_BASE, self.lib.host_timer1_isr)
+		self.check("PPI only compare doesn't interrupt", not stray)
+		self.check("callback gets only the interrupt events",
+				self.aux_events == [0x02], "events %s" % self.aux_events)
+		self.check("PPI only compare event cleared by the handler",
+				reg(TIMER1_BASE + EVENTS_COMPARE).value == 0)
+		# Enabling its interrupt later doesn't fire for a stale event
+		self.compare(TIMER1_BASE, 0)
+		self.lib.aux_clk_en_evt(0x01)
+		self.check("stale compare event cleared when its interrupt is enabled",
+				not pending(TIMER1_BASE))
+
+class AuxClkPpi(ctypes.Structure):
+	_fields_ = [("event", ctypes.c_uint32), ("task1", ctypes.c_uint32),
+			("task2", ctypes.c_uint32)]
+
+class AuxClkSetup(ctypes.Structure):
+	_fields_ = [("source", ctypes.c_int), ("irq_priority", ctypes.c_int),
+			("callback_handler", EVT_FN), ("arr_cc_ms", ctypes.c_uint32 * 4),
+			("events_en", ctypes.c_uint8), ("arr_ppi_cnf", AuxClkPpi * 2)]
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	srcs = []
+	for path in ("codebase/peripheral_modules/ms_timer.c",
+			"codebase/peripheral_modules/aux_clk.c"):
+		out = os.path.join(tmp, os.path.basename(path))
+		with open(out, "w") as f:
+			f.write('void host_setclr (volatile unsigned * reg, unsigned val);\n' +
+					hook_setclr(open(path).read()))
+		srcs.append(out)
+	for name, text in (("harness.c", HARNESS), ("stub.c", STUB),
+			("isr_manager.h", ISR_MANAGER_H)):
+		with open(os.path.join(tmp, name), "w") as f:
+			f.write(text)
+	so = os.path.join(tmp, "isr_dispatch.so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-iquote", tmp] + CFLAGS +
+			["-I" + i for i in INC] + ["-o", so, os.path.join(tmp, "harness.c"),
+			os.path.join(tmp, "stub.c")] + srcs)
+	return ctypes.CDLL(so)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		suite = Suite(build(tmp))
+		suite.test_mid_handler()
+		suite.test_stopped_compare()
+		suite.test_long_timer()
+		suite.test_aux_clk_ppi()
+		suite.check("no asserts", ctypes.c_uint32.in_dll(suite.lib, "host_assert").value == 0)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,451 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Checks the streamed playback of led_ui against the earlier pre-rendering
+# of the whole sequence. led_ui.c and hal_pwm.c are built for the host with
+# the led_seq tables of sense_pir and one more sequence of 40 s, longer than
+# the 20 s buffer of the pre-rendering. A model of the PWM peripheral plays
+# SEQ[0] and SEQ[1] from the EasyDMA pointers with the LOOP count, the
+# shortcuts and the SEQEND and STOPPED interrupts, and records the value of
+# every step. The reference is the pre-rendering loop that led_ui had, which
+# is kept here as it was. The single and loop sequences, a single sequence
+# over a loop one and the return to the loop must give the same values
+# sample for sample, each held for the same number of PWM periods.
+#
+# Prints the RAM of the sequence buffers from the symbols of the two builds
+# and, as the start-up latency, the updates interpolated by a start and the
+# host time of a start with both.
+#
+# The PWM, GPIO and NVIC registers are at fixed addresses, so the pages of
+# the nRF52 peripherals are mapped at them, which needs Linux. Needs a host
+# C compiler, run from the root of the repository.
+# Usage:
+#   led_ui_stream_sim.py [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import timeit
+
+parser = argparse.ArgumentParser(description="led_ui streaming check")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+LED_SEQ_DIR = "application/sense_pir/led_sequences"
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform", LED_SEQ_DIR]
+
+SEQ_NAMES = ["RAMP_OFFSET", "RED_PULSE", "ORANGE_WAVE", "DUAL_FREQ", "PIR_PULSE",
+		"GREEN_WAVE", "LONG_40S"]
+LONG_SEQ = 6
+
+# The led_seq tables of the application with a longer sequence added
+LED_SEQ = r"""
+#define led_seq_get_pin_num app_led_seq_get_pin_num
+#define led_seq_get_seg_len app_led_seq_get_seg_len
+#define led_seq_get_seq_color_ptr app_led_seq_get_seq_color_ptr
+#define led_seq_get_seq_duration_ptr app_led_seq_get_seq_duration_ptr
+#include "led_seq.c"
+#undef led_seq_get_pin_num
+#undef led_seq_get_seg_len
+#undef led_seq_get_seq_color_ptr
+#undef led_seq_get_seq_duration_ptr
+#define LONG_SEQ %d
+static uint16_t long_seq[2][3] = { {0, 1000, 0}, {0, 500, 0} };
+static uint16_t long_duration[] = { 0, 20000, 20000 };
+uint32_t led_seq_get_pin_num (led_sequences seq)
+{
+	return (seq == LONG_SEQ) ? 2 : app_led_seq_get_pin_num(seq);
+}
+uint32_t led_seq_get_seg_len (led_sequences seq)
+{
+	return (seq == LONG_SEQ) ? 3 : app_led_seq_get_seg_len(seq);
+}
+uint16_t * led_seq_get_seq_color_ptr (led_sequences seq, led_seq_color color)
+{
+	return (seq == LONG_SEQ) ? long_seq[color] : app_led_seq_get_seq_color_ptr(seq, color);
+}
+uint16_t * led_seq_get_seq_duration_ptr (led_sequences seq)
+{
+	return (seq == LONG_SEQ) ? long_duration : app_led_seq_get_seq_duration_ptr(seq);
+}
+""" % LONG_SEQ
+
+# The pre-rendering of led_ui before the streaming, with its buffer of
+# MAX_SEQ_LEN_SEC, which is made large enough here for the long sequence
+PRE_RENDER = r"""
+#include <stdint.h>
+#include "led_seq.h"
+#include "boards.h"
+#define MAX_SEQ_LEN_SEC         20
+#define PWM_UPDATE_PERIOD_MS    32
+#define PWM_BUFFER_SIZE         ((uint32_t)((MAX_SEQ_LEN_SEC*1000)/PWM_UPDATE_PERIOD_MS))
+static const uint16_t zero_val_arr[32] = { 0 };
+/* The RAM the pre-rendering reserved */
+struct
+{
+  uint16_t color[LED_COLOR_MAX];
+} seq_buffer[PWM_BUFFER_SIZE];
+static struct
+{
+  uint16_t color[LED_COLOR_MAX];
+} host_buffer[4*PWM_BUFFER_SIZE];
+uint32_t host_pre_render (led_sequences seq, uint16_t * out)
+{
+    uint16_t * dur_ptr = led_seq_get_seq_duration_ptr(seq);
+    uint32_t seq_seg_num = led_seq_get_seg_len(seq);
+
+    uint32_t led_num = led_seq_get_pin_num(seq);
+
+    uint16_t * seq_ptr[LED_COLOR_MAX];
+
+    for(uint32_t k = 0; k < led_num; k++)
+    {
+        seq_ptr[k] = led_seq_get_seq_color_ptr(seq, k);
+    }
+    for(uint32_t k = led_num; k < LED_COLOR_MAX; k++)
+    {
+        seq_ptr[k] = (uint16_t *)zero_val_arr;
+    }
+
+    uint32_t overflow = 0; //To store the overflow from one segment to another
+    uint32_t buff_cnt = 0; //To store the number of elements generated in buffer
+
+    for(uint32_t i = 1; i<seq_seg_num; i++)
+    {
+        uint32_t curr_seg_dur = dur_ptr[i] - overflow;
+        uint32_t seg_updates_num = 1 + curr_seg_dur/PWM_UPDATE_PERIOD_MS;
+
+        for(uint32_t j = 0; j < seg_updates_num; j++)
+        {
+            uint32_t seg_count = overflow + j*PWM_UPDATE_PERIOD_MS;
+            for(uint32_t k = 0; k < LED_COLOR_MAX; k++)
+            {
+                host_buffer[buff_cnt].color[k] = ((int32_t)(seg_count *
+                    ((int32_t)(seq_ptr[k][i] - seq_ptr[k][i-1]))))
+                    /dur_ptr[i] + seq_ptr[k][i-1];
+
+                host_buffer[buff_cnt].color[k] = (LEDS_ACTIVE_STATE)?
+                        (host_buffer[buff_cnt].color[k] | (1<<15)):
+                        (host_buffer[buff_cnt].color[k]);
+            }
+            buff_cnt++;
+        }
+
+        uint32_t curr_dur_mod = curr_seg_dur - (seg_updates_num-1)*PWM_UPDATE_PERIOD_MS;
+        overflow = (curr_dur_mod)?(PWM_UPDATE_PERIOD_MS - curr_dur_mod):0;
+    }
+    buff_cnt--;
+    if(out)
+    {
+        for(uint32_t i = 0; i < buff_cnt; i++)
+        {
+            out[2*i] = host_buffer[i].color[0];
+            out[2*i+1] = host_buffer[i].color[LED_COLOR_MAX - 1];
+        }
+    }
+    return buff_cnt;
+}
+"""
+
+# led_ui with access to its buffer for the host, an ASSERT failing is counted
+WRAP = r"""
+#include "led_ui.c"
+void * host_seq_buffer (void) { return seq_buffer; }
+uint32_t host_asserts;
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name) { host_asserts++; }
+"""
+
+NOP_DELAY_H = "#include <stdint.h>\nvoid hal_nop_delay_us (uint32_t us);\nvoid hal_nop_delay_ms (uint32_t ms);\n"
+
+PWM0_BASE = 0x4001C000
+GPIO_BASE = 0x50000000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+TASKS_STOP = 0x004
+TASKS_SEQSTART = 0x008
+EVENTS_STOPPED = 0x104
+EVENTS_SEQEND = 0x110
+EVENTS_LOOPSDONE = 0x11C
+SHORTS = 0x200
+INTEN = 0x300
+INTENSET = 0x304
+ENABLE = 0x500
+LOOP = 0x514
+SEQ = 0x520
+
+SHORT_SEQEND0_STOP = 1 << 0
+SHORT_LOOPSDONE_SEQSTART0 = 1 << 2
+SHORT_LOOPSDONE_STOP = 1 << 4
+INT_STOPPED = 1 << 1
+INT_SEQEND0 = 1 << 4
+INT_LOOPSDONE = 1 << 7
+
+LED_UI_LOOP_SEQ = 0
+LED_UI_SINGLE_SEQ = 1
+LED_UI_LOW_PRIORITY = 0
+LED_UI_MID_PRIORITY = 1
+
+def reg(offset):
+	return ctypes.c_uint32.from_address(PWM0_BASE + offset)
+
+def map_peripherals():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (PWM0_BASE, GPIO_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	for name, text in (("led_seq_host.c", LED_SEQ), ("pre_render.c", PRE_RENDER),
+			("wrap.c", WRAP), ("hal_nop_delay.h", NOP_DELAY_H)):
+		with open(os.path.join(tmp, name), "w") as f:
+			f.write(text)
+	flags = ["-shared", "-fPIC", "-std=gnu11", "-w", "-U__linux__", "-U__linux", "-Ulinux",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832", "-DNRF52832_XXAA",
+			"-DBOARD_SENSEPI_REV4", "-iquote", tmp] + ["-I" + i for i in INC]
+	libs = []
+	for name, srcs in (("led_ui", ["wrap.c", "led_seq_host.c"]),
+			("pre_render", ["pre_render.c", "led_seq_host.c"])):
+		so = os.path.join(tmp, name + ".so")
+		subprocess.check_call([cc] + flags + [os.path.join(tmp, s) for s in srcs] +
+				(["codebase/hal/hal_pwm.c"] if name == "led_ui" else []) + ["-o", so])
+		libs.append(so)
+	return libs
+
+def symbol_size(so, name):
+	out = subprocess.check_output(["nm", "-S", so]).decode()
+	for line in out.splitlines():
+		f = line.split()
+		if len(f) == 4 and f[3] == name:
+			return int(f[1], 16)
+	return 0
+
+class Pwm(object):
+	"""The PWM peripheral with the grouped decoder load of led_ui and two LEDs"""
+	def __init__(self, lib):
+		self.lib = lib
+		lib.host_seq_buffer.restype = ctypes.c_void_p
+		# The EasyDMA pointers have the low 32 bits of the address
+		self.high = lib.host_seq_buffer() & ~0xFFFFFFFF
+		self.steps = []
+		self.running = False
+		self.stops = 0
+		self.errors = []
+
+	def event(self, offset, irq):
+		reg(offset).value = 1
+		if reg(INTEN).value & irq:
+			# INTENSET reads as INTEN, which the ISR uses for its events
+			reg(INTENSET).value = reg(INTEN).value
+			self.lib.PWM0_IRQHandler()
+
+	def tasks(self):
+		"""The tasks written by the driver since the last call"""
+		start = reg(TASKS_SEQSTART).value
+		if reg(TASKS_STOP).value:
+			reg(TASKS_STOP).value = 0
+			# A restart clears the events of the stop before it, else the
+			# stop is with the interrupts off
+			if self.running and not start:
+				self.running = False
+				self.event(EVENTS_STOPPED, INT_STOPPED)
+			self.running = False
+		if start:
+			reg(TASKS_SEQSTART).value = 0
+			self.seq_start(0)
+			self.loops = 0
+
+	def seq_start(self, n):
+		self.running = True
+		self.seq = n
+		self.step = 0
+		# PTR, CNT and REFRESH are read when the sequence starts
+		self.ptr = self.high | reg(SEQ + n * 0x20).value
+		self.cnt = reg(SEQ + n * 0x20 + 4).value
+		self.refresh = reg(SEQ + n * 0x20 + 8).value
+		if self.cnt == 0:
+			self.errors.append("SEQ[%d] started with no values" % n)
+
+	def seq_end(self):
+		n = self.seq
+		# The shortcuts act on the event, before the interrupt is handled
+		shorts = reg(SHORTS).value
+		self.event(EVENTS_SEQEND + 4 * n, INT_SEQEND0 << n)
+		if shorts & (SHORT_SEQEND0_STOP << n):
+			self.running = False
+			self.stops += 1
+			self.event(EVENTS_STOPPED, INT_STOPPED)
+			return
+		if reg(LOOP).value == 0:
+			self.running = False
+			return
+		if n == 0:
+			self.seq_start(1)
+			return
+		self.loops += 1
+		if self.loops < reg(LOOP).value:
+			self.seq_start(0)
+			return
+		self.event(EVENTS_LOOPSDONE, INT_LOOPSDONE)
+		if shorts & SHORT_LOOPSDONE_SEQSTART0:
+			self.loops = 0
+			self.seq_start(0)
+		elif shorts & SHORT_LOOPSDONE_STOP:
+			self.running = False
+			self.event(EVENTS_STOPPED, INT_STOPPED)
+		else:
+			self.running = False
+
+	def run(self, steps):
+		"""Plays till the PWM stops or for a number of steps"""
+		self.tasks()
+		for i in range(steps):
+			if not self.running or self.cnt == 0:
+				self.running = False
+				return
+			# Grouped load, a value for each LED in a step
+			values = (ctypes.c_uint16 * 2).from_address(self.ptr + 4 * self.step)
+			self.steps.append((values[0], values[1], self.refresh + 1))
+			self.step += 1
+			if 2 * self.step >= self.cnt:
+				self.seq_end()
+			self.tasks()
+
+class Suite(object):
+	def __init__(self, libs):
+		self.fails = 0
+		self.led_ui = ctypes.CDLL(libs[0])
+		self.pre = ctypes.CDLL(libs[1])
+		self.libs = libs
+
+	def check(self, name, cond, detail=""):
+		print("  %-4s %s" % ("PASS" if cond else "FAIL", name))
+		if not cond:
+			self.fails += 1
+			if args.verbose and detail:
+				print("       " + detail)
+
+	def pre_render(self, seq):
+		cnt = self.pre.host_pre_render(seq, None)
+		out = (ctypes.c_uint16 * (2 * cnt))()
+		self.pre.host_pre_render(seq, out)
+		return [(out[2 * i], out[2 * i + 1], 31) for i in range(cnt)]
+
+	def diff(self, got, want):
+		for i, (g, w) in enumerate(zip(got, want)):
+			if g != w:
+				return "step %d got %r want %r" % (i, g, w)
+		return "%d steps, want %d" % (len(got), len(want))
+
+	def pwm(self):
+		self.led_ui.led_ui_stop_everything()
+		return Pwm(self.led_ui)
+
+	def t_single(self, seq):
+		pwm = self.pwm()
+		self.led_ui.led_ui_single_start(seq, LED_UI_MID_PRIORITY, True)
+		want = self.pre_render(seq)
+		pwm.run(10 * len(want))
+		self.check("single %s: %d values as pre-rendered, then stopped" % (SEQ_NAMES[seq],
+				len(want)), pwm.steps == want and not pwm.running and not pwm.errors,
+				self.diff(pwm.steps, want) + " " + " ".join(pwm.errors))
+
+	def t_loop(self, seq):
+		pwm = self.pwm()
+		self.led_ui.led_ui_loop_start(seq, LED_UI_LOW_PRIORITY)
+		want = self.pre_render(seq) * 3
+		pwm.run(len(want))
+		self.check("loop %s: three runs as pre-rendered" % SEQ_NAMES[seq],
+				pwm.steps == want and pwm.running and not pwm.errors,
+				self.diff(pwm.steps, want) + " " + " ".join(pwm.errors))
+
+	def t_switch(self, loop_seq, single_seq):
+		pwm = self.pwm()
+		self.led_ui.led_ui_loop_start(loop_seq, LED_UI_LOW_PRIORITY)
+		pwm.run(37)
+		self.led_ui.led_ui_single_start(single_seq, LED_UI_MID_PRIORITY, True)
+		pwm.tasks()
+		single = self.pre_render(single_seq)
+		loop = self.pre_render(loop_seq)
+		pwm.run(len(single) + len(loop))
+		want = (loop * 2)[:37] + single + loop
+		self.check("single %s over loop %s, then the loop from its start" %
+				(SEQ_NAMES[single_seq], SEQ_NAMES[loop_seq]),
+				pwm.steps == want and not pwm.errors,
+				self.diff(pwm.steps, want) + " " + " ".join(pwm.errors))
+
+	def report(self):
+		old = symbol_size(self.libs[1], "seq_buffer")
+		new = symbol_size(self.libs[0], "seq_buffer")
+		gen = symbol_size(self.libs[0], "gen")
+		print("RAM of the sequence: pre-rendered %d bytes, streamed %d bytes of chunks "
+				"and %d bytes of state, %d bytes saved" % (old, new, gen, old - new - gen))
+		print("Start-up latency, updates interpolated and host time of a start:")
+		for seq in range(len(SEQ_NAMES)):
+			pwm = self.pwm()
+			self.led_ui.led_ui_single_start(seq, LED_UI_MID_PRIORITY, True)
+			streamed = (reg(SEQ + 4).value + reg(SEQ + 0x24).value) // 2
+			t_new = min(timeit.repeat(lambda: self.led_ui.led_ui_single_start(seq,
+					LED_UI_MID_PRIORITY, True), number=200, repeat=3)) / 200
+			t_old = min(timeit.repeat(lambda: self.pre.host_pre_render(seq, None),
+					number=200, repeat=3)) / 200
+			print("  %-12s pre-rendered %4d updates %6.1f us, streamed %2d updates %6.1f us"
+					% (SEQ_NAMES[seq], self.pre.host_pre_render(seq, None) + 1, t_old * 1e6,
+					streamed, t_new * 1e6))
+		self.led_ui.led_ui_stop_everything()
+
+	def run(self):
+		for seq in range(len(SEQ_NAMES)):
+			self.t_single(seq)
+		for seq in range(len(SEQ_NAMES)):
+			self.t_loop(seq)
+		self.t_switch(0, 4)
+		self.t_switch(LONG_SEQ, 1)
+		self.report()
+		return self.fails
+
+tmp = tempfile.mkdtemp()
+try:
+	map_peripherals()
+	fails = Suite(build(tmp)).run()
+	print("%d failed" % fails)
+finally:
+	shutil.rmtree(tmp)
+sys.exit(1 if fails else 0)
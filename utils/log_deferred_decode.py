@@ -0,0 +1,154 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Decodes the records of the deferred logging backend (LOG_DEFERRED_RTT or
+# LOG_DEFERRED_UART) to text using the ELF file of the application, which has
+# the format strings in its .log_fmt section. The input is a capture of the
+# RTT channel 0, e.g.
+#   JLinkRTTLogger -Device NRF52832_XXAA -If SWD -Speed 4000 -RTTChannel 0 capture.bin
+# or a dump of the UART. Usage:
+#   log_deferred_decode.py <application.elf> <capture.bin | ->
+
+from __future__ import print_function
+import re,struct,sys
+
+SYNC = 0xA5
+RTC_FREQ = 32768.0
+SPEC = re.compile(r'%([-+ 0#]*)(\d*)(?:\.(\d+))?[hlzjt]*([diuxXcsp%])')
+
+class Elf(object):
+	"""Minimal reader of the sections of a 32 bit little endian ELF file"""
+	def __init__(self, path):
+		data = open(path, 'rb').read()
+		if data[:4] != b'\x7fELF' or bytearray(data)[4] != 1:
+			raise ValueError("%s isn't a 32 bit ELF file" % path)
+		shoff, = struct.unpack_from('<I', data, 0x20)
+		shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x2E)
+		headers = [struct.unpack_from('<IIIIIIIIII', data, shoff + i*shentsize)
+				for i in range(shnum)]
+		strtab = headers[shstrndx]
+		self.sections = {}
+		for name, typ, flags, addr, offset, size, _, _, _, _ in headers:
+			end = data.find(b'\0', strtab[4] + name)
+			sec_name = data[strtab[4] + name:end].decode()
+			# NOBITS sections such as .bss don't have any content
+			content = data[offset:offset + size] if typ != 8 else b''
+			self.sections[sec_name] = (addr, flags, content)
+
+	def string(self, section, addr):
+		"""Gives the string at the address of a section, None if not in it"""
+		base, _, content = self.sections[section]
+		if not base <= addr < base + len(content):
+			return None
+		start = addr - base
+		return content[start:content.find(b'\0', start)].decode('latin-1')
+
+	def loaded_string(self, addr):
+		"""Gives the string at an address in the loaded sections, like .rodata"""
+		for name, (base, flags, content) in self.sections.items():
+			# SHF_ALLOC sections are the ones in the image on the device
+			if flags & 0x2 and content and name != '.log_fmt':
+				s = self.string(name, addr)
+				if s is not None:
+					return s
+		return None
+
+def format_log(elf, fmt, args):
+	"""printf style formatting of the arguments as done by tinyprintf"""
+	args = list(args)
+	def conv(m):
+		flags, width, prec, spec = m.groups()
+		if spec == '%':
+			return '%'
+		arg = args.pop(0) if args else 0
+		if spec in 'di':
+			arg = arg - (1 << 32) if arg & 0x80000000 else arg
+			spec = 'd'
+		elif spec == 'u':
+			spec = 'd'
+		elif spec == 'c':
+			arg = chr(arg & 0xFF)
+		elif spec == 's':
+			s = elf.loaded_string(arg)
+			arg = s if s is not None else '<str@0x%08x>' % arg
+		elif spec == 'p':
+			return '0x%08x' % arg
+		return ('%' + flags + width + ('.' + prec if prec else '') + spec) % arg
+	return SPEC.sub(conv, fmt)
+
+def records(data):
+	"""Yields the records in data, resyncing on unknown format strings"""
+	idx = 0
+	while idx + 8 <= len(data):
+		word0, word1 = struct.unpack_from('<II', data, idx)
+		nargs = (word0 >> 16) & 0xFF
+		if (word0 >> 24) != SYNC or nargs > 8 or idx + 8 + 4*nargs > len(data):
+			idx += 1
+			continue
+		args = struct.unpack_from('<%dI' % nargs, data, idx + 8)
+		yield idx, word0 & 0xFFFF, nargs, word1 >> 24, word1 & 0xFFFFFF, args
+		idx += 8 + 4*nargs
+
+if len(sys.argv) < 3:
+	print("Usage: %s <application.elf> <capture.bin | ->" % sys.argv[0])
+	sys.exit(0)
+
+elf = Elf(sys.argv[1])
+if '.log_fmt' not in elf.sections:
+	sys.exit("%s doesn't have the .log_fmt section" % sys.argv[1])
+
+if sys.argv[2] == '-':
+	data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+else:
+	data = open(sys.argv[2], 'rb').read()
+
+next_seq = None
+overflows = 0
+last_time = 0
+dropped = 0
+count = 0
+
+for idx, fmt_id, nargs, seq, time, args in records(data):
+	fmt = elf.string('.log_fmt', fmt_id)
+	if fmt is None:
+		sys.stderr.write("Unknown record at byte %d, resyncing\n" % idx)
+		continue
+	if next_seq is not None and seq != next_seq:
+		dropped += (seq - next_seq) & 0xFF
+		print("*** %d logs dropped" % ((seq - next_seq) & 0xFF))
+	next_seq = (seq + 1) & 0xFF
+	# The 24 bit RTC count overflows every 512 s
+	if time < last_time:
+		overflows += 1
+	last_time = time
+	count += 1
+	sys.stdout.write("[%10.5f] %s" % (((overflows << 24) + time)/RTC_FREQ,
+		format_log(elf, fmt, args)))
+
+sys.stderr.write("Logs: %d, dropped: %d\n" % (count, dropped))
@@ -0,0 +1,534 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Round-trip test of the deferred logging backend (LOG_DEFERRED_RTT and
+# LOG_DEFERRED_UART of log.h). log_printf calls with every format specifier
+# used in the tree are built for the host with log_deferred.c and the same
+# calls are formatted with the printf of the C library as the reference. The
+# records sent to the sink are decoded with log_deferred_decode.py using an
+# ELF file made of the format strings of the build, placed at address 0 as
+# the linker scripts of the firmware do, and the text must match the
+# reference. The time stamps, the RTC overflow, the sequence number
+# wrapping, the logs dropped with a full ring and an RTT buffer that is
+# drained slower than the logs are written are checked too.
+#
+# The report has the host time of a call against tinyprintf formatting the
+# same call, the bytes of a record against the text and the bytes of the
+# log_printf format strings of the sample applications, which move out of the
+# flash. The times are of the host, only their ratio says something of the
+# Cortex-M0/M4.
+#
+# The RTC registers are at fixed addresses, so their pages are mapped at them,
+# which needs Linux. Needs a host C compiler, run from the root of the
+# repository.
+# Usage:
+#   log_deferred_test.py [--calls 5000] [--seed 1] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="deferred logging round-trip test")
+parser.add_argument("--calls", type=int, default=5000, help="number of logs of the stress test")
+parser.add_argument("--seed", type=int, default=1, help="seed of the random generator")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "codebase/segger_rtt", "platform"]
+
+DECODER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "log_deferred_decode.py")
+
+APPS = ["sense_pir", "sensebe_tx", "sensebe_rx", "saadc_logger", "lrf_node", "lrf_gateway"]
+
+# The calls of the test, with the specifiers used with log_printf in the tree
+CASES = r"""
+#define LOG_CASES(X, i)                                                         \
+    X(0, "%d %u\n", (int32_t)(i*7) - 1000, i)                                   \
+    X(1, "0x%x 0x%X\n", i*0x9E3779B1u, i*0x85EBCA6Bu)                           \
+    X(2, "%02x:%02x:%02x\n", i & 0xFF, (i >> 3) & 0xF, 0xA5)                    \
+    X(3, "%03d.%03d V\n", (int32_t) i % 1000, (int32_t) (i*13) % 1000)          \
+    X(4, "[%8x]\n", i*0x1F)                                                     \
+    X(5, "%c%c%c\n", 'A' + i % 26, 'a' + i % 26, '0' + i % 10)                  \
+    X(6, "%s: %s|\n", str_name, (i & 1) ? str_empty : str_name)                 \
+    X(7, "%lu ms\n", (unsigned long) i*1000)                                    \
+    X(8, "No arguments\n")                                                      \
+    X(9, "%d %d %d %d %d %d %d %d\n", 1, -2, 3, -4, 5, -6, 7, (int32_t) i)      \
+    X(10, "100%% %d\n", (int32_t) i)                                            \
+    X(11, "%d %d %u\n", INT32_MIN, INT32_MAX, UINT32_MAX)
+#define LOG_CASE_COUNT 12
+"""
+
+# log_printf with the format strings in a section which the linker gives
+# the start of, the offset from it is the ID as on the device
+WRAP = r"""
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "cases.h"
+
+#undef LOG_DEFERRED_FMT_SECTION
+#define LOG_DEFERRED_FMT_SECTION __attribute__((section("log_fmt"), used))
+extern const char __start_log_fmt[], __stop_log_fmt[];
+#define log_deferred_write(addr, ...) \
+    log_deferred_write((addr) - (uint32_t) (uintptr_t) __start_log_fmt, __VA_ARGS__)
+
+/* Strings in flash, which the decoder can print */
+#define FLASH_STR __attribute__((section("log_str"), used))
+extern const char __start_log_str[], __stop_log_str[];
+static const char str_name[] FLASH_STR = "sense_pir";
+static const char str_empty[] FLASH_STR = "";
+
+char host_expect[1 << 22];
+uint32_t host_expect_len;
+
+static void expect (const char * fmt, ...)
+{
+    va_list va;
+    va_start (va, fmt);
+    host_expect_len += vsnprintf (host_expect + host_expect_len,
+            sizeof(host_expect) - host_expect_len, fmt, va);
+    va_end (va);
+}
+
+const void * host_fmt_start (void) { return __start_log_fmt; }
+uint32_t host_fmt_len (void) { return __stop_log_fmt - __start_log_fmt; }
+const void * host_str_start (void) { return __start_log_str; }
+uint32_t host_str_len (void) { return __stop_log_str - __start_log_str; }
+
+/* The log call n with the parameter i, the text is added to host_expect */
+#define X_LOG(n, ...) case n: log_printf (__VA_ARGS__); expect (__VA_ARGS__); break;
+void host_log (uint32_t n, uint32_t i)
+{
+    host_expect_len = (host_expect_len > sizeof(host_expect) - 256) ? 0 : host_expect_len;
+    switch(n)
+    {
+    LOG_CASES (X_LOG, i)
+    }
+}
+
+void host_init (void)
+{
+    host_expect_len = 0;
+    log_init ();
+}
+
+void host_process (void)
+{
+    log_process ();
+}
+
+#define X_DEFER(n, ...) log_printf (__VA_ARGS__);
+#define X_TFP(n, ...) tfp_sprintf (buf, __VA_ARGS__);
+int tfp_sprintf (char * str, const char * fmt, ...);
+
+/* One pass of all the calls, to time them */
+void host_bench_deferred (uint32_t i)
+{
+    log_init ();
+    LOG_CASES (X_DEFER, i)
+}
+
+void host_bench_tfp (uint32_t i)
+{
+    static char buf[128];
+    LOG_CASES (X_TFP, i)
+}
+"""
+
+# The sink, RTT with an up buffer drained by the host or the UART
+STUB = r"""
+#include <stdint.h>
+#include <string.h>
+#define CAPTURE_SIZE (16*1024*1024)
+uint8_t host_capture[CAPTURE_SIZE];
+uint32_t host_capture_len;
+uint32_t host_rtt_size = 1024;
+uint32_t host_rtt_used;
+int host_cr_depth, host_cr_err;
+
+unsigned SEGGER_RTT_Write (unsigned idx, const void * buf, unsigned len)
+{
+    /* NO_BLOCK_SKIP: all or nothing, one byte of the ring is always free */
+    if(idx != 0 || host_rtt_size - 1 - host_rtt_used < len ||
+            host_capture_len + len > CAPTURE_SIZE)
+    {
+        return 0;
+    }
+    memcpy (host_capture + host_capture_len, buf, len);
+    host_capture_len += len;
+    host_rtt_used += len;
+    return len;
+}
+
+void hal_uart_init (uint32_t baud, void (*handler) (uint8_t * ptr))
+{
+}
+
+void hal_uart_putdata (uint8_t * p_data, uint32_t len)
+{
+    if(host_capture_len + len <= CAPTURE_SIZE)
+    {
+        memcpy (host_capture + host_capture_len, p_data, len);
+        host_capture_len += len;
+    }
+}
+
+void host_reset_sink (void)
+{
+    host_capture_len = 0;
+    host_rtt_used = 0;
+}
+
+void host_rtt_drain (uint32_t len)
+{
+    host_rtt_used = (len > host_rtt_used) ? 0 : host_rtt_used - len;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+    host_cr_depth++;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+    host_cr_err += (is_critical_entered != 1) || (host_cr_depth == 0);
+    host_cr_depth--;
+}
+"""
+
+RTT_H = r"""
+unsigned SEGGER_RTT_Write (unsigned idx, const void * buf, unsigned len);
+"""
+
+# The RTCs of the nRF52, the COUNTER of the one of ms_timer is read for the
+# time stamp
+RTC_BASES = [0x4000B000, 0x40011000, 0x40024000]
+RTC_COUNTER = 0x504
+PAGE = 0x1000
+
+def map_rtcs():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in RTC_BASES:
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+def set_count(count):
+	for base in RTC_BASES:
+		ctypes.c_uint32.from_address(base + RTC_COUNTER).value = count & 0xFFFFFF
+
+def elf32(sections):
+	# A 32 bit little endian ELF file with only the section headers, enough
+	# for the decoder. sections is a list of (name, addr, flags, content).
+	names = b"\0"
+	offsets = []
+	for name, _, _, _ in sections + [(".shstrtab", 0, 0, b"")]:
+		offsets.append(len(names))
+		names += name.encode() + b"\0"
+	data = bytearray(52)
+	placed = []
+	for _, _, _, content in sections:
+		placed.append(len(data))
+		data += content
+	strtab_off = len(data)
+	data += names
+	shoff = len(data)
+	data += bytearray(40)
+	for i, (name, addr, flags, content) in enumerate(sections):
+		data += struct.pack("<IIIIIIIIII", offsets[i], 1, flags, addr, placed[i],
+				len(content), 0, 0, 1, 0)
+	data += struct.pack("<IIIIIIIIII", offsets[-1], 3, 0, 0, strtab_off, len(names), 0, 0, 1, 0)
+	shnum = len(sections) + 2
+	struct.pack_into("<4sBBBB", data, 0, b"\x7fELF", 1, 1, 1, 0)
+	struct.pack_into("<HHIIIIIHHHHHH", data, 16, 2, 40, 1, 0, 0, shoff, 0, 52, 0, 0,
+			40, shnum, shnum - 1)
+	return bytes(data)
+
+def decode(tmp, lib, capture):
+	# Runs the decoder on the capture, gives the (time, text) of the logs,
+	# the counts of dropped logs and the summary line
+	fmt = ctypes.string_at(lib.host_fmt_start(), lib.host_fmt_len())
+	strs = ctypes.string_at(lib.host_str_start(), lib.host_str_len())
+	str_addr = lib.host_str_start() & 0xFFFFFFFF
+	elf = os.path.join(tmp, "app.elf")
+	with open(elf, "wb") as f:
+		# .log_fmt isn't loaded, the flash strings are in an SHF_ALLOC section
+		f.write(elf32([(".log_fmt", 0, 0, fmt), (".rodata", str_addr, 2, strs)]))
+	cap = os.path.join(tmp, "capture.bin")
+	with open(cap, "wb") as f:
+		f.write(capture)
+	p = subprocess.Popen([sys.executable, DECODER, elf, cap], stdout=subprocess.PIPE,
+			stderr=subprocess.PIPE)
+	out, err = p.communicate()
+	logs, drops = [], []
+	for m in re.finditer(r"\[ *([0-9.]+)\] (.*?\n)|\*\*\* (\d+) logs dropped\n",
+			out.decode("latin-1"), re.S):
+		if m.group(3):
+			drops.append((len(logs), int(m.group(3))))
+		else:
+			logs.append((float(m.group(1)), m.group(2)))
+	return logs, drops, err.decode("latin-1")
+
+class Suite(object):
+	def __init__(self, tmp, lib, sink):
+		self.tmp = tmp
+		self.lib = lib
+		self.sink = sink
+		self.fails = 0
+		for fn in ("host_fmt_start", "host_str_start"):
+			getattr(lib, fn).restype = ctypes.c_void_p
+		self.capture_len = ctypes.c_uint32.in_dll(lib, "host_capture_len")
+		self.expect_len = ctypes.c_uint32.in_dll(lib, "host_expect_len")
+		self.rtt_size = ctypes.c_uint32.in_dll(lib, "host_rtt_size")
+		self.cr_depth = ctypes.c_int.in_dll(lib, "host_cr_depth")
+		self.cr_err = ctypes.c_int.in_dll(lib, "host_cr_err")
+		self.case_count = 12
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s: %s" % ("PASS" if ok else "FAIL", self.sink, name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def capture(self):
+		addr = ctypes.addressof(ctypes.c_uint8.in_dll(self.lib, "host_capture"))
+		return ctypes.string_at(addr, self.capture_len.value)
+
+	def log(self, n, i):
+		# One call, gives the reference text
+		self.expect_len.value = 0
+		self.lib.host_log(n, i)
+		addr = ctypes.addressof(ctypes.c_char.in_dll(self.lib, "host_expect"))
+		return ctypes.string_at(addr, self.expect_len.value).decode("latin-1")
+
+	def start(self, rtt_size=1 << 20):
+		self.rtt_size.value = rtt_size
+		self.lib.host_init()
+		self.lib.host_reset_sink()
+		set_count(0)
+
+	def test_specifiers(self):
+		self.start()
+		expect = []
+		for i in range(40):
+			for n in range(self.case_count):
+				expect.append(self.log(n, i * 977 + n))
+			self.lib.host_process()
+		logs, drops, err = decode(self.tmp, self.lib, self.capture())
+		bad = [(e, g) for e, (_, g) in zip(expect, logs) if e != g]
+		self.check("all specifiers decode as printf formats them, %d logs" % len(expect),
+				len(logs) == len(expect) and not bad and not drops,
+				"%d logs of %d, first mismatch %r" % (len(logs), len(expect), bad[:1]))
+		self.check("the critical regions are balanced",
+				self.cr_depth.value == 0 and self.cr_err.value == 0,
+				"depth %d, errors %d" % (self.cr_depth.value, self.cr_err.value))
+
+	def test_time(self):
+		# Across three overflows of the 24 bit RTC, seen at least once per 512 s
+		self.start()
+		times = []
+		for k in range(64):
+			times.append((k * 0x3F0000 + 123) / 32768.0)
+			set_count(k * 0x3F0000 + 123)
+			self.log(k % self.case_count, k)
+			self.lib.host_process()
+		logs, _, _ = decode(self.tmp, self.lib, self.capture())
+		err = max(abs(t - g) for t, (g, _) in zip(times, logs)) if logs else 1
+		self.check("time stamps across the RTC overflow", len(logs) == 64 and err < 1e-5,
+				"%d logs, worst error %f s" % (len(logs), err))
+
+	def test_seq_wrap(self):
+		self.start()
+		for k in range(700):
+			self.log(8, k)
+			self.lib.host_process()
+		logs, drops, _ = decode(self.tmp, self.lib, self.capture())
+		self.check("no false drops over the sequence number wrap",
+				len(logs) == 700 and not drops, "%d logs, drops %s" % (len(logs), drops))
+
+	def test_full_ring(self):
+		# Without draining the 1 kB ring fills and the rest is dropped
+		self.start()
+		expect = [self.log(9, k) for k in range(100)]
+		self.lib.host_process()
+		expect.append(self.log(0, 1))
+		self.lib.host_process()
+		logs, drops, _ = decode(self.tmp, self.lib, self.capture())
+		kept = len(logs) - 1
+		ok = kept > 0 and [g for _, g in logs] == expect[:kept] + expect[-1:] and \
+				drops == [(kept, 100 - kept)]
+		self.check("%d of 100 logs kept in a full ring, the %d dropped are reported" %
+				(kept, 100 - kept), ok, "drops %s" % drops)
+
+	def test_slow_sink(self, rng):
+		# The 1 kB RTT up buffer of channel 0 drained at random, the ring wraps
+		# around and fills at times. Every log is decoded or counted as dropped.
+		self.start(1024)
+		expect = []
+		for k in range(args.calls):
+			n = rng.randrange(self.case_count)
+			expect.append(self.log(n, rng.randrange(1 << 20)))
+			if rng.random() < 0.3:
+				self.lib.host_process()
+			if rng.random() < 0.3:
+				self.lib.host_rtt_drain(rng.randrange(300))
+		for _ in range(100):
+			self.lib.host_rtt_drain(1024)
+			self.lib.host_process()
+		logs, drops, err = decode(self.tmp, self.lib, self.capture())
+		got = [g for _, g in logs]
+		dropped = sum(c for _, c in drops)
+		self.check("%d logs through a slow RTT sink: %d decoded, %d dropped" %
+				(len(expect), len(logs), dropped),
+				len(logs) + dropped == len(expect) and "resync" not in err,
+				"decoder: %s" % err.strip())
+		# The logs written, less the ones reported dropped before each log
+		order, idx = [], 0
+		for at, cnt in drops + [(len(got), 0)]:
+			while len(order) < at:
+				order.append(idx)
+				idx += 1
+			idx += cnt
+		seq_ok = [expect[i] for i in order] == got
+		self.check("the decoded logs are the ones written, in order", seq_ok)
+
+	def wire_bytes(self):
+		# Bytes of a record against the text of the same call
+		rec = txt = 0
+		for n in range(self.case_count):
+			self.start()
+			txt += len(self.log(n, 12345))
+			self.lib.host_process()
+			rec += self.capture_len.value
+		return rec, txt
+
+	def bench(self):
+		import timeit
+		loops = 20000
+		self.lib.host_bench_deferred.argtypes = [ctypes.c_uint32]
+		t_def = min(timeit.repeat(lambda: self.lib.host_bench_deferred(7), number=loops, repeat=3))
+		t_tfp = min(timeit.repeat(lambda: self.lib.host_bench_tfp(7), number=loops, repeat=3))
+		t_nop = min(timeit.repeat(lambda: self.lib.host_process(), number=loops, repeat=3))
+		per = lambda t: (t - t_nop) / loops / self.case_count * 1e9
+		return per(t_def), per(t_tfp)
+
+def format_strings(app):
+	# Bytes of the log_printf format strings in the sources of an application
+	make = os.path.join("application", app, "Makefile")
+	srcs = set()
+	with open(make) as f:
+		for line in f:
+			if line.startswith("C_SRC"):
+				srcs.update(re.findall(r"(\w+\.c)", line))
+	paths = {}
+	for root, _, files in os.walk("codebase"):
+		for name in files:
+			paths.setdefault(name, os.path.join(root, name))
+	total = count = 0
+	for name in srcs:
+		path = os.path.join("application", app, name)
+		if not os.path.exists(path):
+			path = paths.get(name)
+		if path is None:
+			continue
+		text = open(path, errors="replace").read()
+		text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+		text = re.sub(r"//[^\n]*", "", text)
+		for m in re.finditer(r"log_printf\s*\(\s*((?:\"(?:[^\"\\]|\\.)*\"\s*)+)", text):
+			lit = "".join(re.findall(r"\"((?:[^\"\\]|\\.)*)\"", m.group(1)))
+			total += len(lit.encode().decode("unicode_escape")) + 1
+			count += 1
+	return count, total
+
+def build(tmp, sink):
+	cc = os.environ.get("CC", "cc")
+	so = os.path.join(tmp, "log_%s.so" % sink)
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-DLOG_DEFERRED_%s" % sink,
+			"-iquote", tmp] + ["-I" + i for i in INC] +
+			[os.path.join(tmp, "wrap.c"), os.path.join(tmp, "stub.c"),
+			"codebase/peripheral_modules/log_deferred.c",
+			"codebase/peripheral_modules/tinyprintf.c", "-o", so])
+	return ctypes.CDLL(so)
+
+def main():
+	rng = random.Random(args.seed)
+	map_rtcs()
+	tmp = tempfile.mkdtemp()
+	fails = 0
+	try:
+		for name, text in (("wrap.c", WRAP), ("stub.c", STUB), ("cases.h", CASES),
+				("SEGGER_RTT.h", RTT_H)):
+			with open(os.path.join(tmp, name), "w") as f:
+				f.write(text)
+		for sink in ("RTT", "UART"):
+			suite = Suite(tmp, build(tmp, sink), sink)
+			suite.test_specifiers()
+			suite.test_time()
+			suite.test_seq_wrap()
+			suite.test_full_ring()
+			if sink == "RTT":
+				suite.test_slow_sink(rng)
+				rec, txt = suite.wire_bytes()
+				t_def, t_tfp = suite.bench()
+			fails += suite.fails
+
+		print("Report (host)")
+		print("  per call: log_deferred_write %.0f ns, tinyprintf formatting %.0f ns (%.1fx)"
+				% (t_def, t_tfp, t_tfp / t_def))
+		print("  on the wire for the %d calls: %d bytes of records, %d bytes of text"
+				% (suite.case_count, rec, txt))
+		for app in APPS:
+			count, total = format_strings(app)
+			print("  %-13s %3d log_printf format strings, %5d bytes out of the flash"
+					% (app, count, total))
+		print("%d failed" % fails)
+		sys.exit(1 if fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
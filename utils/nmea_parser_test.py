@@ -0,0 +1,617 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Replay and fuzz test of the streaming NMEA parser (codebase/util/nmea_parser.c)
+# used by gps_mod. The parser is built for the host and fed byte by byte.
+#
+# Replay: the sentences of a log, a built-in sample or the file given with
+# --log, are parsed and every field is compared with an exact decimal
+# reference, the coordinates to the 7th decimal of a degree. Randomly
+# generated valid sentences are checked the same way.
+# Fuzz: the sentences are mutated with bit flips, truncation, dropped and
+# inserted bytes, stray '$' and overlong lines. A sentence is never parsed
+# unless its checksum is right, every '$' is accounted for exactly once in the
+# statistics and the parsed fields stay in range. The same streams are fed to
+# a build with the address and undefined behaviour sanitizers, when the
+# compiler supports them.
+# Benchmark: the time per sentence and the code size of the parser and of the
+# minmea based path it replaced, with its float conversion of the coordinates.
+# These are host numbers, only their ratio says something of the Cortex-M4.
+#
+# Needs a host C compiler, run from the root of the repository.
+# Usage:
+#   nmea_parser_test.py [--log capture.nmea] [--iterations 20000] [--seed 1] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+from fractions import Fraction
+
+parser = argparse.ArgumentParser(description="NMEA parser replay and fuzz test")
+parser.add_argument("--log", help="file with NMEA sentences to replay, one per line")
+parser.add_argument("--iterations", type=int, default=20000, help="number of fuzzed sentences")
+parser.add_argument("--seed", type=int, default=1, help="seed of the random generator")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/util"]
+SRC = ["codebase/util/nmea_parser.c"]
+
+GGA, RMC, GLL, GSA, UNKNOWN, MAX = range(6)
+NAMES = ["GGA", "RMC", "GLL", "GSA"]
+# NMEA_PARSER_DOP_UNKNOWN
+DOP_UNKNOWN = 0xFFFF
+
+class Data(ctypes.Structure):
+	_fields_ = [("lat_e7", ctypes.c_int32), ("lng_e7", ctypes.c_int32),
+			("alt_cm", ctypes.c_int32), ("time_cs", ctypes.c_uint32),
+			("date", ctypes.c_uint32), ("speed_mknot", ctypes.c_uint32),
+			("hdop_c", ctypes.c_uint16), ("pdop_c", ctypes.c_uint16),
+			("vdop_c", ctypes.c_uint16), ("quality", ctypes.c_uint8),
+			("sats", ctypes.c_uint8), ("fix_type", ctypes.c_uint8),
+			("valid", ctypes.c_bool)]
+
+class Stats(ctypes.Structure):
+	_fields_ = [("parsed", ctypes.c_uint32 * MAX), ("field_err", ctypes.c_uint32 * MAX),
+			("checksum_err", ctypes.c_uint32), ("overflow_err", ctypes.c_uint32),
+			("framing_err", ctypes.c_uint32)]
+
+# Records the sentences passed to the handler and has the old minmea path of
+# gps_mod for the benchmark
+HARNESS = r"""
+#include <string.h>
+#include <time.h>
+#include "nmea_parser.h"
+#include "minmea.h"
+
+#define HOST_MAX_CALLS 64
+
+int host_calls;
+int host_type[HOST_MAX_CALLS];
+nmea_parser_data_t host_data[HOST_MAX_CALLS];
+
+static void handler (nmea_sentence_t type, nmea_parser_data_t * data)
+{
+    if(host_calls < HOST_MAX_CALLS)
+    {
+        host_type[host_calls] = type;
+        host_data[host_calls] = *data;
+    }
+    host_calls++;
+}
+
+void host_init (void)
+{
+    host_calls = 0;
+    nmea_parser_init (handler);
+}
+
+void host_feed (const uint8_t * buf, int len)
+{
+    for(int i = 0; i < len; i++)
+    {
+        nmea_parser_feed (buf[i]);
+    }
+}
+
+const nmea_parser_stats_t * host_stats (void)
+{
+    return nmea_parser_get_stats ();
+}
+
+/* The line buffering and GGA path of gps_mod before nmea_parser, at D7 */
+static char line[82];
+static uint32_t line_len;
+volatile int32_t minmea_lat, minmea_lng;
+
+static void minmea_feed (uint8_t byte)
+{
+    if(byte == '\n' || byte == '\r')
+    {
+        if(line_len != 0 && minmea_sentence_id (line, false) == MINMEA_SENTENCE_GGA)
+        {
+            struct minmea_sentence_gga frame;
+            if(minmea_parse_gga (&frame, line))
+            {
+                minmea_lng = (int32_t)(minmea_tocoord (&frame.longitude) * 10000000);
+                minmea_lat = (int32_t)(minmea_tocoord (&frame.latitude) * 10000000);
+            }
+        }
+        line_len = 0;
+    }
+    else if(line_len == 0 && byte == '$')
+    {
+        memset (line, '\0', sizeof(line));
+        line[line_len++] = '$';
+    }
+    else if(line_len != 0 && line_len < sizeof(line) - 1)
+    {
+        line[line_len++] = byte;
+    }
+}
+
+void host_minmea_gga (const uint8_t * buf, int len, int32_t * lat, int32_t * lng)
+{
+    line_len = 0;
+    for(int i = 0; i < len; i++)
+    {
+        minmea_feed (buf[i]);
+    }
+    *lat = minmea_lat;
+    *lng = minmea_lng;
+}
+
+static double now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+/* Average ns per pass of the buffer through the parser or the minmea path */
+double host_bench (const uint8_t * buf, int len, int loops, int use_minmea)
+{
+    double start = now_ns ();
+    for(int l = 0; l < loops; l++)
+    {
+        for(int i = 0; i < len; i++)
+        {
+            if(use_minmea)
+            {
+                minmea_feed (buf[i]);
+            }
+            else
+            {
+                nmea_parser_feed (buf[i]);
+            }
+        }
+    }
+    return (now_ns () - start)/loops;
+}
+"""
+
+# Feeds stdin to the parser, for the sanitizer build
+DRIVER = r"""
+#include <stdio.h>
+#include "nmea_parser.h"
+
+static void handler (nmea_sentence_t type, nmea_parser_data_t * data)
+{
+    (void) type;
+    (void) data;
+}
+
+int main (void)
+{
+    int c;
+    nmea_parser_init (handler);
+    while((c = getchar ()) != EOF)
+    {
+        nmea_parser_feed (c);
+    }
+    return 0;
+}
+"""
+
+# minmea.h includes it for the platforms without timegm
+COMPAT_H = "\n"
+
+# A capture of a receiver with a fix, GSV and TXT are parsed as unknown
+SAMPLE = [
+	"GPTXT,01,01,02,ANTSTATUS=OK",
+	"GPRMC,083559.00,A,1234.56789,N,07733.21094,E,0.004,77.52,091202,,,A",
+	"GPGGA,083559.00,1234.56789,N,07733.21094,E,1,08,1.01,920.3,M,-86.5,M,,",
+	"GPGSA,A,3,10,07,05,02,29,04,08,13,,,,,1.72,1.03,1.38",
+	"GPGSV,3,1,11,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30",
+	"GPGLL,1234.56789,N,07733.21094,E,083559.00,A,A",
+	"GPRMC,083600.00,A,1234.56801,N,07733.21102,E,0.011,,091202,,,A",
+	"GPGGA,083600.00,1234.56801,N,07733.21102,E,1,08,1.01,920.4,M,-86.5,M,,",
+	"GNGGA,083601.00,5109.0262317,S,11402.3291611,W,2,12,0.6,1048.47,M,-16.27,M,,",
+	"GNRMC,083601.00,A,5109.0262317,S,11402.3291611,W,0.03,165.48,260319,,,D",
+	"GPGLL,0000.00000,N,00000.00001,W,083602.00,A,A",
+	"GPGGA,235959.99,8959.99999,N,17959.99999,E,1,04,9.99,-12.5,M,0.0,M,,",
+	"GPRMC,083603.00,V,,,,,,,091202,,,N",
+	"GPGGA,083603.00,,,,,0,00,99.99,,,,,,",
+	"GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99",
+	"GPGLL,,,,,083603.00,V,N",
+]
+
+def checksum(body):
+	c = 0
+	for ch in body:
+		c ^= ord(ch)
+	return c
+
+def sentence(body):
+	return "$%s*%02X\r\n" % (body, checksum(body))
+
+def ref_fixed(text, decimals):
+	# The value x 10^decimals with the extra digits dropped, as parse_fixed
+	neg = text.startswith("-")
+	ip, _, fp = text.lstrip("-").partition(".")
+	val = int(ip or "0") * 10**decimals + int((fp[:decimals]).ljust(decimals, "0") or "0")
+	return -val if neg else val
+
+def ref_dop(text):
+	# An empty DOP is NMEA_PARSER_DOP_UNKNOWN, not the previous one
+	return ref_fixed(text, 2) if text else DOP_UNKNOWN
+
+def ref_coord(text, hemi):
+	# Exact degrees x 10^7 rounded half up, the decimals of the minutes after
+	# the 6th, below 2 mm, are dropped
+	ip, _, fp = text.partition(".")
+	fp = fp[:6]
+	deg = int(ip) // 100
+	minutes = Fraction(int(ip) % 100) + Fraction(int(fp or "0"), 10**len(fp))
+	exact = (deg + minutes / 60) * 10**7
+	val = int(exact + Fraction(1, 2))
+	return -val if hemi in "SW" else val
+
+def ref_time(text):
+	cs = ref_fixed(text, 2)
+	hh, mm, ss = cs // 1000000, cs // 10000 % 100, cs // 100 % 100
+	return ((hh * 60 + mm) * 60 + ss) * 100 + cs % 100
+
+def reference(body):
+	# The type and the fields expected from a sentence, None if not parsed
+	f = body.split(",")
+	kind = f[0][2:] if len(f[0]) == 5 else ""
+	if kind == "GGA":
+		if int(f[6]) == 0:
+			return GGA, {"valid": False, "quality": 0}
+		exp = {"valid": True, "quality": int(f[6]), "time_cs": ref_time(f[1]),
+				"lat_e7": ref_coord(f[2], f[3]), "lng_e7": ref_coord(f[4], f[5]),
+				"sats": int(f[7]), "hdop_c": ref_dop(f[8])}
+		if f[9]:
+			exp["alt_cm"] = ref_fixed(f[9], 2)
+		return GGA, exp
+	if kind == "RMC":
+		if f[2] != "A":
+			return RMC, {"valid": False}
+		exp = {"valid": True, "time_cs": ref_time(f[1]), "lat_e7": ref_coord(f[3], f[4]),
+				"lng_e7": ref_coord(f[5], f[6]), "date": int(f[9])}
+		if f[7]:
+			exp["speed_mknot"] = ref_fixed(f[7], 3)
+		return RMC, exp
+	if kind == "GLL":
+		if f[6] != "A":
+			return GLL, {"valid": False}
+		return GLL, {"valid": True, "lat_e7": ref_coord(f[1], f[2]),
+				"lng_e7": ref_coord(f[3], f[4]), "time_cs": ref_time(f[5])}
+	if kind == "GSA":
+		exp = {"fix_type": int(f[2]), "valid": int(f[2]) > 1,
+				"sats": sum(1 for s in f[3:15] if s)}
+		for name, field in (("pdop_c", f[15]), ("hdop_c", f[16]), ("vdop_c", f[17])):
+			exp[name] = ref_dop(field)
+		return GSA, exp
+	return UNKNOWN, None
+
+def random_coord(rng, max_deg, hemis):
+	deg = rng.randint(0, max_deg - 1)
+	decimals = rng.randint(0, 6)
+	minutes = "%02d" % rng.randint(0, 59)
+	if decimals:
+		minutes += "." + "".join(rng.choice("0123456789") for _ in range(decimals))
+	width = 2 if max_deg == 90 else 3
+	return ("%0*d" % (width, deg)) + minutes, rng.choice(hemis)
+
+def random_time(rng):
+	return "%02d%02d%02d.%02d" % (rng.randint(0, 23), rng.randint(0, 59),
+			rng.randint(0, 59), rng.randint(0, 99))
+
+def random_dop(rng):
+	# Receivers leave the DOP empty without enough satellites
+	if rng.random() < 0.1:
+		return ""
+	return "%d.%02d" % (rng.randint(0, 50), rng.randint(0, 99))
+
+def random_body(rng):
+	talker = rng.choice(["GP", "GN", "GL"])
+	lat, ns = random_coord(rng, 90, "NS")
+	lng, ew = random_coord(rng, 180, "EW")
+	kind = rng.choice(NAMES)
+	if kind == "GGA":
+		return "%sGGA,%s,%s,%s,%s,%s,%d,%02d,%s,%d.%d,M,-86.5,M,," % (talker,
+				random_time(rng), lat, ns, lng, ew, rng.randint(1, 6), rng.randint(0, 24),
+				random_dop(rng), rng.randint(-400, 9000), rng.randint(0, 9))
+	if kind == "RMC":
+		return "%sRMC,%s,A,%s,%s,%s,%s,%d.%03d,,%02d%02d%02d,,,A" % (talker, random_time(rng),
+				lat, ns, lng, ew, rng.randint(0, 999), rng.randint(0, 999),
+				rng.randint(1, 31), rng.randint(1, 12), rng.randint(0, 99))
+	if kind == "GLL":
+		return "%sGLL,%s,%s,%s,%s,%s,A,A" % (talker, lat, ns, lng, ew, random_time(rng))
+	sats = [("%02d" % rng.randint(1, 32)) if rng.random() < 0.6 else "" for _ in range(12)]
+	return "%sGSA,A,%d,%s,%s,%s,%s" % (talker, rng.randint(1, 3), ",".join(sats),
+			random_dop(rng), random_dop(rng), random_dop(rng))
+
+def mutate(rng, text):
+	# One random corruption of a sentence with its CRLF
+	b = bytearray(text.encode())
+	op = rng.randrange(7)
+	pos = rng.randrange(len(b))
+	if op == 0:
+		b[pos] ^= 1 << rng.randrange(8)
+	elif op == 1:
+		del b[pos:]
+	elif op == 2:
+		del b[pos]
+	elif op == 3:
+		b.insert(pos, rng.randrange(256))
+	elif op == 4:
+		b.insert(pos, ord("$"))
+	elif op == 5:
+		b[pos:pos] = bytearray(rng.randrange(256) for _ in range(rng.randint(60, 120)))
+	else:
+		b = bytearray(rng.randrange(256) for _ in range(rng.randint(1, 100)))
+	return bytes(b)
+
+def valid_sentences(data):
+	# The sentences in a byte stream whose checksum is right, as the parser
+	# frames them
+	out = []
+	for part in data.split(b"$")[1:]:
+		star = part.find(b"*")
+		if star < 0 or star > 80 or len(part) < star + 3:
+			continue
+		body = part[:star]
+		if b"\r" in body or b"\n" in body:
+			continue
+		try:
+			rx = int(part[star + 1:star + 3].decode("ascii"), 16)
+		except (UnicodeDecodeError, ValueError):
+			continue
+		if part[star + 1:star + 3].strip() != part[star + 1:star + 3]:
+			continue
+		c = 0
+		for ch in bytearray(body):
+			c ^= ch
+		if c == rx:
+			out.append(body)
+	return out
+
+class Suite(object):
+	def __init__(self, lib):
+		self.lib = lib
+		self.fails = 0
+		lib.host_stats.restype = ctypes.POINTER(Stats)
+		lib.host_bench.restype = ctypes.c_double
+		self.calls = ctypes.c_int.in_dll(lib, "host_calls")
+		self.types = (ctypes.c_int * 64).in_dll(lib, "host_type")
+		self.data = (Data * 64).in_dll(lib, "host_data")
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def feed(self, data):
+		self.lib.host_feed(data, len(data))
+
+	def stats(self):
+		s = self.lib.host_stats().contents
+		return {"parsed": list(s.parsed), "field_err": list(s.field_err),
+				"checksum_err": s.checksum_err, "overflow_err": s.overflow_err,
+				"framing_err": s.framing_err}
+
+	def compare(self, bodies):
+		# Parses the sentences one at a time and compares with the reference
+		errs = []
+		for body in bodies:
+			self.lib.host_init()
+			self.feed(sentence(body).encode())
+			kind, exp = reference(body)
+			st = self.stats()
+			if exp is None:
+				if self.calls.value != 0 or st["parsed"][UNKNOWN] != 1:
+					errs.append("%s: not taken as unknown" % body)
+				continue
+			if self.calls.value != 1 or self.types[0] != kind:
+				errs.append("%s: %d calls, stats %s" % (body, self.calls.value, st))
+				continue
+			got = self.data[0]
+			for name, val in sorted(exp.items()):
+				if getattr(got, name) != val:
+					errs.append("%s: %s %r, expected %r" % (body, name, getattr(got, name), val))
+		return errs
+
+	def test_replay(self, bodies, label):
+		errs = self.compare(bodies)
+		self.check("%s: %d sentences match the reference" % (label, len(bodies)),
+				not errs, "; ".join(errs[:5]))
+
+	def test_d7(self):
+		# 12 deg 34.56789 min is 12.5761315 deg, the 7th decimal isn't 0
+		self.lib.host_init()
+		self.feed(sentence(SAMPLE[2]).encode())
+		lat = self.data[0].lat_e7
+		self.check("GGA latitude 1234.56789 N is 125761315 x 1e-7 deg", lat == 125761315,
+				"got %d" % lat)
+		self.lib.host_init()
+		self.feed(sentence("GPGLL,0000.00006,N,00000.00001,W,083602.00,A,A").encode())
+		self.check("GLL 0.00006 min rounds to 10 x 1e-7 deg, 0.00001 W to -2",
+				(self.data[0].lat_e7, self.data[0].lng_e7) == (10, -2),
+				"got %d %d" % (self.data[0].lat_e7, self.data[0].lng_e7))
+		# A fix with no HDOP after one with a good HDOP, gps_mod must not
+		# qualify it with the previous HDOP
+		self.lib.host_init()
+		self.feed((sentence(SAMPLE[2]) + sentence(
+				"GPGGA,083600.00,1234.56801,N,07733.21102,E,1,03,,920.4,M,-86.5,M,,")).encode())
+		self.check("GGA with an empty HDOP after a 1.01 one gives NMEA_PARSER_DOP_UNKNOWN",
+				self.calls.value == 2 and self.data[1].hdop_c == DOP_UNKNOWN,
+				"calls %d, got %d" % (self.calls.value, self.data[1].hdop_c))
+
+	def test_stream(self, bodies):
+		# The whole log as one stream, as from the UART
+		self.lib.host_init()
+		self.feed("".join(sentence(b) for b in bodies).encode())
+		st = self.stats()
+		errs = sum(st["field_err"]) + st["checksum_err"] + st["overflow_err"] + st["framing_err"]
+		self.check("stream of %d sentences parsed without errors" % len(bodies),
+				sum(st["parsed"]) == len(bodies) and errs == 0, "stats %s" % st)
+
+	def test_fuzz(self, rng, count):
+		self.lib.host_init()
+		base = [sentence(b) for b in SAMPLE] + [sentence(random_body(rng)) for _ in range(200)]
+		stream = bytearray()
+		bad_parse = []
+		for i in range(count):
+			text = rng.choice(base)
+			data = mutate(rng, text) if rng.random() < 0.8 else text.encode()
+			before = self.stats()
+			calls = self.calls.value
+			self.feed(data)
+			stream += data
+			after = self.stats()
+			new = sum(after["parsed"]) - sum(before["parsed"]) + \
+					sum(after["field_err"]) - sum(before["field_err"])
+			# Sentences left open by the previous piece can be completed by this one
+			if new > len(valid_sentences(bytes(stream[-200:]))):
+				bad_parse.append(data)
+			if self.calls.value > calls:
+				d = self.data[min(self.calls.value, 64) - 1]
+				if abs(d.lat_e7) > 900000000 or abs(d.lng_e7) > 1800000000 or \
+						d.time_cs >= 8640100 or d.fix_type > 3:
+					bad_parse.append(data)
+			if self.calls.value >= 64:
+				self.calls.value = 0
+		self.feed(b"\r\n")
+		stream += b"\r\n"
+		st = self.stats()
+		total = sum(st["parsed"]) + sum(st["field_err"]) + st["checksum_err"] + \
+				st["overflow_err"] + st["framing_err"]
+		self.check("%d fuzzed sentences: nothing parsed without a valid checksum" % count,
+				not bad_parse, "%d bad, first %r" % (len(bad_parse), bad_parse[:1]))
+		self.check("every '$' is counted once in the statistics",
+				total == stream.count(b"$"), "%d counted, %d '$'" % (total, stream.count(b"$")))
+		self.check("sentences with a valid checksum are all parsed or field errors",
+				sum(st["parsed"]) + sum(st["field_err"]) == len(valid_sentences(bytes(stream))),
+				"stats %s, %d valid" % (st, len(valid_sentences(bytes(stream)))))
+		if args.verbose:
+			print("      stats %s" % st)
+		return bytes(stream)
+
+	def minmea_error(self, bodies):
+		# The largest error of the old float conversion, in 1e-7 degrees
+		worst = 0
+		for body in bodies:
+			if reference(body)[0] != GGA or reference(body)[1].get("valid") is not True:
+				continue
+			lat, lng = ctypes.c_int32(), ctypes.c_int32()
+			data = sentence(body).encode()
+			self.lib.host_minmea_gga(data, len(data), ctypes.byref(lat), ctypes.byref(lng))
+			exp = reference(body)[1]
+			worst = max(worst, abs(lat.value - exp["lat_e7"]), abs(lng.value - exp["lng_e7"]))
+		return worst
+
+	def bench(self, bodies):
+		gga = "".join(sentence(b) for b in bodies if reference(b)[0] == GGA).encode()
+		n = gga.count(b"$")
+		loops = 2000
+		self.lib.host_init()
+		new = self.lib.host_bench(gga, len(gga), loops, 0) / n
+		old = self.lib.host_bench(gga, len(gga), loops, 1) / n
+		print("  GGA sentence on the host: nmea_parser %.0f ns, minmea path %.0f ns (%.2fx)"
+				% (new, old, old / new))
+
+def code_size(cc, tmp, src, name):
+	obj = os.path.join(tmp, name + ".o")
+	subprocess.check_call([cc, "-c", "-Os", "-w", "-iquote", tmp] +
+			["-I" + i for i in INC] + ["-o", obj, src])
+	try:
+		out = subprocess.check_output(["size", obj]).decode().splitlines()[1].split()
+		return int(out[0])
+	except (OSError, subprocess.CalledProcessError):
+		return None
+
+def main():
+	cc = os.environ.get("CC", "cc")
+	rng = random.Random(args.seed)
+	bodies = list(SAMPLE)
+	if args.log:
+		with open(args.log) as f:
+			bodies = [l.strip().lstrip("$").split("*")[0] for l in f if l.strip().startswith("$")]
+
+	tmp = tempfile.mkdtemp()
+	try:
+		for name, text in (("harness.c", HARNESS), ("driver.c", DRIVER),
+				("minmea_compat.h", COMPAT_H)):
+			with open(os.path.join(tmp, name), "w") as f:
+				f.write(text)
+		so = os.path.join(tmp, "nmea.so")
+		subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-iquote", tmp] +
+				["-I" + i for i in INC] + ["-o", so, os.path.join(tmp, "harness.c"),
+				"codebase/util/minmea.c"] + SRC + ["-lm"])
+		suite = Suite(ctypes.CDLL(so))
+
+		print("Replay")
+		suite.test_replay(bodies, "log" if args.log else "sample")
+		suite.test_replay([random_body(rng) for _ in range(5000)], "random")
+		suite.test_d7()
+		suite.test_stream(bodies)
+
+		print("Fuzz")
+		stream = suite.test_fuzz(rng, args.iterations)
+		san = os.path.join(tmp, "nmea_san")
+		built = subprocess.call([cc, "-std=gnu11", "-g", "-w", "-fsanitize=address,undefined",
+				"-fno-sanitize-recover=all", "-iquote", tmp] + ["-I" + i for i in INC] +
+				["-o", san, os.path.join(tmp, "driver.c")] + SRC,
+				stderr=open(os.devnull, "w")) == 0
+		if built:
+			p = subprocess.Popen([san], stdin=subprocess.PIPE, stderr=subprocess.PIPE)
+			_, err = p.communicate(stream)
+			suite.check("fuzzed stream under the address and UB sanitizers",
+					p.returncode == 0, err.decode(errors="replace")[:500])
+		else:
+			print("  SKIP sanitizers aren't supported by %s" % cc)
+
+		print("Benchmark (host)")
+		worst = suite.minmea_error([random_body(rng) for _ in range(2000)] + bodies)
+		print("  worst error of the float minmea_tocoord at D7: %d x 1e-7 deg" % worst)
+		suite.bench(bodies + [random_body(rng) for _ in range(200)])
+		new = code_size(cc, tmp, SRC[0], "nmea_parser")
+		old = code_size(cc, tmp, "codebase/util/minmea.c", "minmea")
+		if new and old:
+			print("  text at -Os: nmea_parser %d B, minmea %d B without the float library"
+					% (new, old))
+
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,760 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Simulation of the two backends of out_pattern_gen (codebase/peripheral_
+# modules/out_pattern_gen.c) with the module built for the host twice: with
+# the ms_timer, which writes the pins in its RTC interrupt, and with
+# TIMER_USED_OUT_GEN as in sense_pir, where the compare events of a TIMER
+# toggle the pins through PPI and GPIOTE and the interrupt only loads the
+# next edge. The model counts the RTC of ms_timer on the edges of the LFCLK
+# and the TIMER at 1 MHz from its start, follows the PPI channels set with
+# hal_ppi and the GPIOTE tasks and configurations, and runs the interrupts
+# a random latency up to --latency us after their event, as code of a
+# higher priority would delay them. The pin levels are traced at each
+# change. The time is kept in units of 1/512 us, in which both the RTC
+# ticks and the us are whole.
+#
+# Checked for the camera trigger patterns of cam_trigger and random ones:
+# - Both backends make the same edges, pin for pin and level for level,
+#   and end with the done handler called once with the pattern's state.
+# - The TIMER backend places every edge within 1 us of its time, at any
+#   latency below the gap between the edges of a pin, and holds the HF
+#   crystal only while the pattern plays.
+# - A pattern with more pins than OUT_GEN_HW_NUM_OUT falls back to the
+#   ms_timer, out_gen_stop in the middle of a pattern leaves the pins at the
+#   values given and nothing running, and with a latency above the gap of
+#   the edges the late ones are made by the CPU, in order, and counted.
+#
+# The wakeups and the worst error of the edges of each backend are reported.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   out_gen_sim.py [--patterns 200] [--latency 20] [--seed 28] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="out_pattern_gen backend simulation")
+parser.add_argument("--patterns", type=int, default=200, help="random patterns of each run")
+parser.add_argument("--latency", type=int, default=20, help="maximum interrupt latency in us")
+parser.add_argument("--seed", type=int, default=28, help="seed of the patterns")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform"]
+
+# Peripherals used by the test build
+GPIOTE_BASE = 0x40006000
+TIMER1_BASE = 0x40009000
+RTC1_BASE = 0x40011000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+TASKS_START = 0x000
+TASKS_STOP = 0x004
+TIMER_TASKS_CLEAR = 0x00C
+TIMER_TASKS_SHUTDOWN = 0x010
+TIMER_TASKS_CAPTURE = 0x040
+EVENTS_COMPARE = 0x140
+INTENSET = 0x304
+RTC_COUNTER = 0x504
+CC = 0x540
+GPIOTE_TASKS_OUT = 0x000
+GPIOTE_CONFIG = 0x510
+GPIOTE_CH = 8
+
+# Time units in a us and a RTC tick
+US = 512
+TICK = 15625
+RTC_MASK = 0xFFFFFF
+TIMER_MASK = 0xFFFFFFFF
+
+MS_TIMER_USED_OUT_GEN = 1
+MS_SINGLE_CALL = 0
+PWR_MGR_NEED_HFXO = 1
+
+# The pins of cam_trigger on sense_pir, focus and trigger, and two more
+PINS = [23, 24, 25, 26]
+
+COMMON = ["-DISR_MANAGER=1", "-DSYS_CFG_PRESENT=0", "-DRTC_USED_MS_TIMER=1",
+		"-DMS_TIMER_USED_OUT_GEN=%d" % MS_TIMER_USED_OUT_GEN]
+# As in the sys_config.h of sense_pir
+HW = ["-DTIMER_USED_OUT_GEN=1", "-DOUT_GEN_HW_NUM_OUT=2", "-DPPI_CH_USED_OUT_GEN_0=5",
+		"-DPPI_CH_USED_OUT_GEN_1=6", "-DGPIOTE_CH_USED_OUT_GEN_0=0",
+		"-DGPIOTE_CH_USED_OUT_GEN_1=1"]
+HW_NUM_OUT = 2
+
+HARNESS = r"""
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "ms_timer.h"
+#include "out_pattern_gen.h"
+#include "isr_dispatch.h"
+#include "hal_ppi.h"
+
+extern inline uint32_t ms_timer_get_current_count(void);
+void out_gen_timer_Handler (uint32_t fired);
+
+void (*host_on_task) (uint32_t addr);
+void (*host_on_pin) (uint32_t pin, uint32_t val);
+void (*host_on_gpiote) (uint32_t ch);
+void (*host_on_need) (uint32_t needs);
+void (*host_on_done) (uint32_t state);
+
+void host_task (volatile uint32_t * task)
+{
+    host_on_task ((uint32_t) (uintptr_t) task);
+}
+
+void host_pin (uint32_t pin, uint32_t val)
+{
+    host_on_pin (pin, val);
+}
+
+void host_gpiote_config (volatile uint32_t * reg, uint32_t val)
+{
+    *reg = val;
+    host_on_gpiote ((uint32_t) (reg - &NRF_GPIOTE->CONFIG[0]));
+}
+
+/* The SET and CLR registers follow the register they act on, which reads
+ * the same from all three */
+void host_setclr (volatile uint32_t * reg, uint32_t val)
+{
+    volatile uint32_t * base = (volatile uint32_t *) ((uintptr_t) reg & ~0xFUL);
+    uint32_t cur = base[0];
+    cur = (((uintptr_t) reg & 0xF) == 4) ? (cur | val) : (cur & ~val);
+    base[0] = base[1] = base[2] = cur;
+}
+
+uint32_t host_assert;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+
+/* The one shot timers of ms_timer, fired by the model at their count */
+uint32_t host_timer_on[4];
+uint32_t host_timer_at[4];
+void (*host_timer_cb[4]) (void);
+
+void ms_timer_start (ms_timer_num id, ms_timer_mode mode, uint64_t ticks,
+        void (*handler) (void))
+{
+    if(ticks == 0)
+    {
+        host_timer_on[id] = 0;
+        handler ();
+        return;
+    }
+    ticks = (ticks < 2) ? 2 : ticks;
+    host_timer_at[id] = (ms_timer_get_current_count () + ticks) & 0xFFFFFF;
+    host_timer_cb[id] = handler;
+    host_timer_on[id] = 1;
+}
+
+void ms_timer_stop (ms_timer_num id)
+{
+    host_timer_on[id] = 0;
+}
+
+void host_timer_fire (uint32_t id)
+{
+    host_timer_on[id] = 0;
+    host_timer_cb[id] ();
+}
+
+/* The PPI channels as set by the module */
+uint32_t host_ppi_event[32];
+uint32_t host_ppi_task[32];
+uint32_t host_ppi_en[32];
+
+ppi_setup_status_t hal_ppi_set (hal_ppi_setup_t * setup)
+{
+    host_ppi_event[setup->ppi_id] = setup->event;
+    host_ppi_task[setup->ppi_id] = setup->task;
+    return PPI_SETUP_SUCCESSFUL;
+}
+
+void hal_ppi_en_ch (uint32_t ppi_id)
+{
+    host_ppi_en[ppi_id] = 1;
+}
+
+void hal_ppi_dis_ch (uint32_t ppi_id)
+{
+    host_ppi_en[ppi_id] = 0;
+}
+
+uint32_t pwr_mgr_client_register (const char * name)
+{
+    return 3;
+}
+
+void pwr_mgr_need (uint32_t client, uint32_t needs)
+{
+    host_on_need (needs);
+}
+
+/* As TIMER1_IRQHandler of the ISR managers */
+void host_timer1_isr (void)
+{
+#if defined TIMER_USED_OUT_GEN
+    uint32_t fired = isr_dispatch_take (NRF_TIMER1);
+    ISR_DISPATCH_CALL (out_gen_timer_Handler, fired);
+#endif
+}
+
+static void done (uint32_t state)
+{
+    host_on_done (state);
+}
+
+void host_init (uint32_t num_out, uint32_t * pins, bool * init)
+{
+    out_gen_init (num_out, pins, init);
+}
+
+void host_start (uint32_t num_transitions, uint32_t * durations, bool * next_out,
+        uint32_t state)
+{
+    static out_gen_config_t config;
+    memset (&config, 0, sizeof(config));
+    config.num_transitions = num_transitions;
+    memcpy (config.transitions_durations, durations, num_transitions * sizeof(uint32_t));
+    memcpy (config.next_out, next_out, sizeof(config.next_out));
+    config.done_handler = done;
+    config.out_gen_state = state;
+    out_gen_start (&config);
+}
+
+void host_stop (bool * out_vals)
+{
+    out_gen_stop (out_vals);
+}
+"""
+
+# The GPIO writes of the module go to the model
+HAL_GPIO_H = r"""
+#ifndef CODEBASE_HAL_HAL_GPIO_H_
+#define CODEBASE_HAL_HAL_GPIO_H_
+#include <stdint.h>
+
+void host_pin (uint32_t pin, uint32_t val);
+
+static inline void hal_gpio_cfg_output(uint32_t pin_num, uint32_t init_val)
+{
+    host_pin (pin_num, init_val);
+}
+
+static inline void hal_gpio_pin_write(uint32_t pin_num, uint32_t val)
+{
+    host_pin (pin_num, val);
+}
+#endif
+"""
+
+# Empty isr_manager.h for the module built with ISR_MANAGER
+ISR_MANAGER_H = "\n"
+
+TASK_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint32)
+PIN_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_uint32)
+
+def hook(text):
+	"""Route the tasks, the GPIOTE configurations and the SET and CLR
+	registers of the TIMER to the host"""
+	text = re.sub(r"(TIMER_ID|NRF_GPIOTE)->(TASKS_\w+(?:\[.*?\])?)\s*=\s*1;",
+			r"host_task(&(\1)->\2);", text)
+	text = re.sub(r"NRF_GPIOTE->CONFIG\[(.*?)\]\s*=\s*([^;]+);",
+			r"host_gpiote_config(&NRF_GPIOTE->CONFIG[\1], (\2));", text)
+	return re.sub(r"(TIMER_ID)->(INTEN(?:SET|CLR))\s*=\s*([^;]+);",
+			r"host_setclr(&(\1)->\2, (\3));", text)
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (GPIOTE_BASE, TIMER1_BASE, RTC1_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+class Timer(object):
+	"""The TIMER at 1 MHz, counting from the time it is started"""
+	def __init__(self):
+		self.running = False
+		self.count0 = 0
+		self.t0 = 0
+
+	def value(self, t):
+		if not self.running:
+			return self.count0
+		return (self.count0 + (t - self.t0) // US) & TIMER_MASK
+
+	def start(self, t):
+		if not self.running:
+			self.running = True
+			self.t0 = t
+
+	def stop(self, t):
+		if self.running:
+			self.count0 = self.value(t)
+			self.running = False
+
+	def clear(self, t):
+		self.count0 = 0
+		self.t0 = t
+
+	def next_match(self, t, cc):
+		"""Time after t at which the counter reaches cc, None if stopped"""
+		if not self.running:
+			return None
+		diff = (cc - self.value(t)) & TIMER_MASK
+		if diff == 0:
+			diff = TIMER_MASK + 1
+		return self.t0 + ((t - self.t0) // US + diff) * US
+
+class Sim(object):
+	"""The RTC of ms_timer, the TIMER, PPI and GPIOTE and the pins, with the
+	module built in lib"""
+	def __init__(self, lib, hw):
+		self.lib = lib
+		self.hw = hw
+		self.cbs = [TASK_FN(self.task), PIN_FN(self.pin), TASK_FN(self.gpiote),
+				TASK_FN(self.need), TASK_FN(self.done)]
+		for name, cb in zip(("host_on_task", "host_on_pin", "host_on_gpiote",
+				"host_on_need", "host_on_done"), self.cbs):
+			ctypes.c_void_p.in_dll(lib, name).value = ctypes.cast(cb, ctypes.c_void_p).value
+		self.timer_on = (ctypes.c_uint32 * 4).in_dll(lib, "host_timer_on")
+		self.timer_at = (ctypes.c_uint32 * 4).in_dll(lib, "host_timer_at")
+		self.ppi_event = (ctypes.c_uint32 * 32).in_dll(lib, "host_ppi_event")
+		self.ppi_task = (ctypes.c_uint32 * 32).in_dll(lib, "host_ppi_task")
+		self.ppi_en = (ctypes.c_uint32 * 32).in_dll(lib, "host_ppi_en")
+		lib.out_gen_is_on.restype = ctypes.c_bool
+		lib.out_gen_get_late_edges.restype = ctypes.c_uint32
+
+	def reset(self, num_out, latency_us, seed):
+		for base in (GPIOTE_BASE, TIMER1_BASE, RTC1_BASE):
+			ctypes.memset(base, 0, PAGE)
+		for i in range(4):
+			self.timer_on[i] = 0
+		for i in range(32):
+			self.ppi_en[i] = 0
+		self.rnd = random.Random(seed)
+		self.latency = latency_us * US
+		self.t = self.rnd.randrange(TICK)
+		self.timer = Timer()
+		self.gpio = {}
+		self.gpiote_out = [0] * GPIOTE_CH
+		self.pins = PINS[:num_out]
+		self.level = {}
+		self.trace = []
+		self.wakeups = 0
+		self.timer_isr = None
+		self.rtc_isr = None
+		self.actions = []
+		self.needs = []
+		self.dones = []
+		self.on_done = None
+		self.sync_regs()
+		pins = (ctypes.c_uint32 * num_out)(*self.pins)
+		init = (ctypes.c_bool * num_out)(*([True] * num_out))
+		self.lib.host_init(num_out, pins, init)
+
+	def sync_regs(self):
+		reg(RTC1_BASE + RTC_COUNTER).value = (self.t // TICK) & RTC_MASK
+
+	def pin_level(self, pin):
+		for ch in range(GPIOTE_CH):
+			cfg = reg(GPIOTE_BASE + GPIOTE_CONFIG + 4 * ch).value
+			if cfg & 3 == 3 and (cfg >> 8) & 0x1F == pin:
+				return self.gpiote_out[ch]
+		return self.gpio.get(pin, 0)
+
+	def update(self):
+		for pin in self.pins:
+			lvl = self.pin_level(pin)
+			if self.level.get(pin) != lvl:
+				self.level[pin] = lvl
+				self.trace.append((self.t, pin, lvl))
+
+	def pin(self, pin, val):
+		self.gpio[pin] = 1 if val else 0
+		self.update()
+
+	def gpiote(self, ch):
+		cfg = reg(GPIOTE_BASE + GPIOTE_CONFIG + 4 * ch).value
+		if cfg & 3 == 3:
+			self.gpiote_out[ch] = (cfg >> 20) & 1
+		self.update()
+
+	def task(self, addr):
+		off = addr - TIMER1_BASE
+		if 0 <= off < PAGE:
+			if off == TASKS_START:
+				self.timer.start(self.t)
+			elif off in (TASKS_STOP, TIMER_TASKS_SHUTDOWN):
+				self.timer.stop(self.t)
+			elif off == TIMER_TASKS_CLEAR:
+				self.timer.clear(self.t)
+			elif TIMER_TASKS_CAPTURE <= off < TIMER_TASKS_CAPTURE + 24:
+				reg(TIMER1_BASE + CC + off - TIMER_TASKS_CAPTURE).value = \
+						self.timer.value(self.t)
+			return
+		off = addr - GPIOTE_BASE
+		if GPIOTE_TASKS_OUT <= off < GPIOTE_TASKS_OUT + 4 * GPIOTE_CH:
+			ch = (off - GPIOTE_TASKS_OUT) // 4
+			if reg(GPIOTE_BASE + GPIOTE_CONFIG + 4 * ch).value & 3 == 3:
+				self.gpiote_out[ch] ^= 1
+				self.update()
+			return
+		sys.exit("Task 0x%08X of an unknown peripheral" % addr)
+
+	def need(self, needs):
+		self.needs.append((self.t, needs))
+
+	def done(self, state):
+		self.dones.append((self.t, state))
+		if self.on_done:
+			self.on_done(state)
+
+	def lat(self):
+		return self.rnd.randint(0, self.latency)
+
+	def timer_pending(self):
+		inten = reg(TIMER1_BASE + INTENSET).value
+		return any((inten >> (16 + n)) & 1 and reg(TIMER1_BASE + EVENTS_COMPARE + 4 * n).value
+				for n in range(4))
+
+	def check_irq(self):
+		if self.timer_isr is None and self.timer_pending():
+			self.timer_isr = self.t + self.lat()
+
+	def at(self, t, fn):
+		self.actions.append((t, fn))
+		self.actions.sort(key=lambda a: a[0])
+
+	def run(self, end):
+		while True:
+			nxt = []
+			if self.actions:
+				nxt.append((self.actions[0][0], "action", None))
+			if self.timer_on[MS_TIMER_USED_OUT_GEN] and self.rtc_isr is None:
+				diff = (self.timer_at[MS_TIMER_USED_OUT_GEN] - self.t // TICK) & RTC_MASK
+				nxt.append(((self.t // TICK + (diff or RTC_MASK + 1)) * TICK, "rtc", None))
+			for n in range(4):
+				t = self.timer.next_match(self.t, reg(TIMER1_BASE + CC + 4 * n).value)
+				if t is not None:
+					nxt.append((t, "compare", n))
+			if self.rtc_isr is not None:
+				nxt.append((self.rtc_isr[0], "rtc_isr", None))
+			if self.timer_isr is not None:
+				nxt.append((self.timer_isr, "timer_isr", None))
+			if not nxt:
+				return
+			t = min(x[0] for x in nxt)
+			if t > end:
+				self.t = end
+				self.sync_regs()
+				return
+			self.t = t
+			self.sync_regs()
+			# The hardware events come before the interrupts at a time
+			for when, kind, n in sorted(nxt, key=lambda x: x[1] != "compare"):
+				if when != t:
+					continue
+				if kind == "compare":
+					self.compare(n)
+				elif kind == "rtc":
+					self.rtc_isr = (t + self.lat(), self.timer_at[MS_TIMER_USED_OUT_GEN])
+				elif kind == "rtc_isr":
+					armed = self.rtc_isr[1]
+					self.rtc_isr = None
+					if self.timer_on[MS_TIMER_USED_OUT_GEN] and \
+							self.timer_at[MS_TIMER_USED_OUT_GEN] == armed:
+						self.wakeups += 1
+						self.lib.host_timer_fire(MS_TIMER_USED_OUT_GEN)
+				elif kind == "timer_isr":
+					self.timer_isr = None
+					self.wakeups += 1
+					self.lib.host_timer1_isr()
+				else:
+					self.actions.pop(0)[1]()
+				self.check_irq()
+
+	def compare(self, n):
+		evt = TIMER1_BASE + EVENTS_COMPARE + 4 * n
+		reg(evt).value = 1
+		for ch in range(32):
+			if self.ppi_en[ch] and self.ppi_event[ch] == evt:
+				self.task(self.ppi_task[ch])
+
+	def start(self, pattern, state):
+		durations, outs = pattern
+		n = len(durations)
+		flat = [False] * (4 * 64)
+		for i, seq in enumerate(outs):
+			for k, v in enumerate(seq):
+				flat[i * 64 + k] = bool(v)
+		self.lib.host_start(n, (ctypes.c_uint32 * 64)(*durations),
+				(ctypes.c_bool * (4 * 64))(*flat), state)
+
+	def stop(self, vals):
+		self.lib.host_stop((ctypes.c_bool * 4)(*vals))
+
+def expected(pattern, t0):
+	"""The edges of a pattern started at t0 as (ideal time, pin, level)"""
+	durations, outs = pattern
+	edges = []
+	t = t0
+	for k in range(1, len(durations) + 1):
+		t += durations[k - 1] * TICK
+		for i, seq in enumerate(outs):
+			if seq[k] != seq[k - 1]:
+				edges.append((t, PINS[i], seq[k]))
+	return edges
+
+def per_pin(edges):
+	return dict((p, [(t, l) for t, q, l in edges if q == p]) for p in set(e[1] for e in edges))
+
+def random_pattern(rnd, num_out, min_ticks, max_ticks=3000):
+	n = rnd.randint(1, 40)
+	durations = [rnd.randint(min_ticks, max_ticks) for _ in range(n)]
+	outs = [[1] + [rnd.randint(0, 1) for _ in range(n)] for _ in range(num_out)]
+	return durations, outs
+
+def cam_pattern(shots):
+	"""A multi-shot of cam_trigger: the focus pin pressed, then both pins
+	pressed and released for every shot, active low"""
+	durations = [6554]
+	focus = [1, 0]
+	trigger = [1, 1]
+	for _ in range(shots):
+		durations += [4096, 4096]
+		focus += [0, 1]
+		trigger += [0, 1]
+	durations[-1] = 2048
+	return durations, [focus, trigger]
+
+class Suite(object):
+	def __init__(self, sw, hw):
+		self.sw = sw
+		self.hw = hw
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def play(self, sim, pattern, latency_us, seed):
+		"""Play a pattern, returns the edges after the start, the expected
+		ones and the error of each edge in us"""
+		sim.reset(len(pattern[1]), latency_us, seed)
+		t0 = sim.t
+		sim.start(pattern, 7)
+		sim.run(t0 + (sum(pattern[0]) + 64) * TICK + 100 * latency_us * US)
+		got = [e for e in sim.trace if e[0] > t0]
+		exp = expected(pattern, t0)
+		g, x = per_pin(got), per_pin(exp)
+		same = sorted(g) == sorted(x) and all([l for _, l in g[p]] == [l for _, l in x[p]]
+				for p in x)
+		errors = []
+		if same:
+			for p in x:
+				errors += [(tg - tx) / float(US) for (tg, _), (tx, _) in zip(g[p], x[p])]
+		end = t0 + sum(pattern[0]) * TICK
+		return same, errors, end
+
+	def test_backends(self):
+		rnd = random.Random(args.seed)
+		patterns = [cam_pattern(1), cam_pattern(3), cam_pattern(20)]
+		for _ in range(args.patterns):
+			patterns.append(random_pattern(rnd, rnd.randint(1, HW_NUM_OUT), 2))
+		# The edges of a pin are over the worst latency apart
+		min_gap = int(args.latency * 1.0 / (TICK / US)) + 2
+		patterns = [p for p in patterns if p[0] and min(p[0]) >= min_gap]
+		res = {}
+		for name, sim in (("ms_timer", self.sw), ("TIMER", self.hw)):
+			same = errors = wakeups = edges = 0
+			worst = 0.0
+			bad_done = []
+			for i, pat in enumerate(patterns):
+				ok, err, end = self.play(sim, pat, args.latency, args.seed + i)
+				same += ok
+				if err:
+					worst = max(worst, max(abs(e) for e in err))
+				if sim.hw and any(not -1 <= e <= 1 for e in err):
+					errors += 1
+				wakeups += sim.wakeups
+				edges += len(expected(pat, 0))
+				final = [seq[-1] for seq in pat[1]]
+				if len(sim.dones) != 1 or sim.dones[0][1] != 7 or sim.dones[0][0] < end - TICK \
+						or [sim.level[p] for p in sim.pins] != final \
+						or sim.lib.out_gen_is_on():
+					bad_done.append(i)
+			res[name] = (wakeups, edges, worst)
+			self.check("%s: %d patterns with the edges of the pattern" % (name, len(patterns)),
+					same == len(patterns), "%d differ" % (len(patterns) - same))
+			self.check("%s: done once at the end with the final levels" % name, not bad_done,
+					"patterns %s" % bad_done[:5])
+			if sim.hw:
+				self.check("TIMER: every edge within 1 us at up to %d us latency" % args.latency,
+						errors == 0, "%d patterns out, worst %.1f us" % (errors, worst))
+				self.check("TIMER: no late edges", sim.lib.out_gen_get_late_edges() == 0)
+		print("%d patterns, %d edges, interrupt latency up to %d us:" %
+				(len(patterns), res["TIMER"][1], args.latency))
+		for name in ("ms_timer", "TIMER"):
+			w, e, worst = res[name]
+			print("  %-8s %5d wakeups, worst edge error %6.1f us" % (name, w, worst))
+
+	def test_hfxo(self):
+		sim = self.hw
+		pat = cam_pattern(3)
+		_, _, end = self.play(sim, pat, args.latency, 1)
+		needs = [n for _, n in sim.needs]
+		self.check("TIMER: HF crystal held only while the pattern plays",
+				needs == [PWR_MGR_NEED_HFXO, 0] and sim.needs[1][0] >= end - TICK,
+				"%s" % sim.needs)
+		self.check("TIMER: stopped with the PPI off after the pattern",
+				not sim.timer.running and not any(sim.ppi_en), "")
+
+	def test_fallback(self):
+		"""More pins than OUT_GEN_HW_NUM_OUT are played by the ms_timer"""
+		rnd = random.Random(args.seed + 1)
+		pat = random_pattern(rnd, HW_NUM_OUT + 1, 40)
+		pat[1][0][1] = 1 - pat[1][0][0]
+		ok, err, _ = self.play(self.hw, pat, args.latency, 2)
+		self.check("%d pins beyond OUT_GEN_HW_NUM_OUT fall back to the ms_timer" %
+				(HW_NUM_OUT + 1), ok and not self.hw.needs and not self.hw.timer.running
+				and self.hw.wakeups == len(pat[0]) and len(self.hw.dones) == 1,
+				"same %s needs %s wakeups %d" % (ok, self.hw.needs, self.hw.wakeups))
+
+	def test_stop(self):
+		for name, sim in (("ms_timer", self.sw), ("TIMER", self.hw)):
+			pat = cam_pattern(10)
+			sim.reset(2, args.latency, 3)
+			t0 = sim.t
+			t_stop = t0 + sum(pat[0]) * TICK // 2 + 1234
+			sim.at(t_stop, lambda: sim.stop([True, False, False, False]))
+			sim.start(pat, 7)
+			sim.run(t0 + (sum(pat[0]) + 64) * TICK)
+			after = [e for e in sim.trace if e[0] > t_stop]
+			self.check("%s: stopped in the middle with the pins as given" % name,
+					[sim.level[p] for p in sim.pins] == [1, 0] and not after
+					and not sim.dones and not sim.lib.out_gen_is_on()
+					and not sim.timer.running and not any(sim.ppi_en)
+					and (not sim.hw or sim.needs[-1][1] == 0),
+					"levels %s after %s dones %s" % (sim.level, after, sim.dones))
+
+	def test_late(self):
+		"""A latency over the gap of the edges of a pin"""
+		sim = self.hw
+		rnd = random.Random(args.seed + 2)
+		bad = []
+		late = 0
+		for i in range(20):
+			pat = random_pattern(rnd, HW_NUM_OUT, 2, 20)
+			ok, err, end = self.play(sim, pat, 400, 100 + i)
+			n_late = sim.lib.out_gen_get_late_edges()
+			late += n_late
+			if not ok or len(sim.dones) != 1 or n_late != len([e for e in err if e > 1]) \
+					or [sim.level[p] for p in sim.pins] != [s[-1] for s in pat[1]]:
+				bad.append((i, ok, n_late, len([e for e in err if e > 1])))
+		self.check("late edges made in order and counted, %d at 400 us latency" % late,
+				not bad and late > 0, "%s" % bad[:3])
+
+def build(tmp, name, cflags):
+	cc = os.environ.get("CC", "cc")
+	src = os.path.join(tmp, "out_pattern_gen.c")
+	with open(src, "w") as f:
+		f.write('#include <stdint.h>\nvoid host_task (volatile uint32_t * task);\n'
+				'void host_gpiote_config (volatile uint32_t * reg, uint32_t val);\n'
+				'void host_setclr (volatile uint32_t * reg, uint32_t val);\n' +
+				hook(open("codebase/peripheral_modules/out_pattern_gen.c").read()))
+	for fname, text in (("harness.c", HARNESS), ("hal_gpio.h", HAL_GPIO_H),
+			("isr_manager.h", ISR_MANAGER_H)):
+		with open(os.path.join(tmp, fname), "w") as f:
+			f.write(text)
+	so = os.path.join(tmp, name + ".so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV4", "-iquote", tmp] + COMMON + cflags +
+			["-I" + i for i in INC] + ["-o", so, os.path.join(tmp, "harness.c"), src,
+			"codebase/util/res_alloc.c"])
+	return ctypes.CDLL(so)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		sw = Sim(build(tmp, "sw", []), False)
+		hw = Sim(build(tmp, "hw", HW), True)
+		suite = Suite(sw, hw)
+		suite.test_backends()
+		suite.test_hfxo()
+		suite.test_fallback()
+		suite.test_stop()
+		suite.test_late()
+		suite.check("no asserts", all(ctypes.c_uint32.in_dll(s.lib, "host_assert").value == 0
+				for s in (sw, hw)))
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,407 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Host benchmark of the modules marked with prof_region regions, byte_frame,
+# AT_proc and nvm_logger, on the Linux backend of prof_region (codebase/util/
+# prof_region.c). The modules are built for the host with PROF_REGION_EN:
+# byte_frame encodes and decodes random frames, AT_proc gets its responses
+# byte by byte as from the UART and nvm_logger counts the entries of a log
+# and finds its next location in a flash image mapped at the nRF52 address
+# of its pages. The table of prof_region_dump is printed.
+#
+# log_printf spins for --print-us in the build, as a print over RTT or the
+# UART takes time. The regions must not contain a print, so their shortest
+# duration must stay under it, as the longest can be lengthened by the host. The count of each region must match the
+# calls made, a nested region can't be longer than the region around it,
+# and without PROF_REGION_EN the regions and prof_region.c must compile to
+# nothing.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   prof_region_bench.py [--runs 2000] [--print-us 100] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="prof_region host benchmark")
+parser.add_argument("--runs", type=int, default=2000, help="calls of each workload")
+parser.add_argument("--print-us", type=int, default=100, help="time taken by a log_printf")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/util", "codebase/nrf_core", "codebase/cmsis/include", "codebase/hal",
+		"codebase/peripheral_modules", "codebase/AT_lib"]
+
+# Flash pages of nvm_logger, NVM_LOG_PAGE0 down to the last one it reads
+FLASH_BASE = 0x22000
+FLASH_END = 0x28000
+NVM_PAGE_SIZE = 0x1000
+PAGE_METADATA_ADDR = 0xFF0
+# The log in the image, 16 byte entries in 2 pages. Each of the other logs
+# has an empty page, as nvm_logger_mod_init can't find the next location of
+# a log without pages on the host, where a modulo by 0 traps.
+LOG_PAGES = [0x27000, 0x26000]
+OTHER_LOG_PAGES = [0x25000, 0x24000, 0x23000]
+ENTRY_SIZE = 16
+ENTRIES_PER_PAGE = 4080 // ENTRY_SIZE
+LOG_ENTRIES = ENTRIES_PER_PAGE + 100
+
+REGIONS = ["byte_frame_encode", "byte_frame_decode", "AT_proc_rsp",
+		"nvm_logger_count_entries", "nvm_logger_next_loc", "bench_outer", "bench_inner"]
+
+# Included by the module wrappers in place of log.h
+LOG_STUB = r"""
+#include <stdint.h>
+#define CODEBASE_PERIPHERAL_MODULES_LOG_H_
+#define log_printf(...) host_log()
+void host_log (void);
+"""
+
+HARNESS = r"""
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "prof_region.h"
+#include "byte_frame.h"
+#include "AT_proc.h"
+#include "nvm_logger.h"
+#include "hal_uarte.h"
+
+uint32_t host_log_ns;
+uint32_t host_logs;
+
+static uint64_t now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* A print which takes the time of one over RTT or the UART */
+void host_log (void)
+{
+    uint64_t end = now_ns () + host_log_ns;
+    host_logs++;
+    while (now_ns () < end);
+}
+
+/* Flash writes only clear bits */
+uint32_t hal_nvmc_erase_page (uint32_t page_start_address)
+{
+    memset ((void *) (uintptr_t) page_start_address, 0xFF, 0x1000);
+    return 0;
+}
+
+void hal_nvmc_write_data (void * p_destination, void * p_source, uint32_t size_of_data)
+{
+    for (uint32_t i = 0; i < size_of_data; i++)
+    {
+        ((uint8_t *) p_destination)[i] &= ((uint8_t *) p_source)[i];
+    }
+}
+
+static void (*uarte_rx) (uint8_t rx_byte);
+
+void hal_uarte_init (hal_uarte_baud_t baud, uint32_t irq_priority)
+{
+}
+
+void hal_uarte_puts (uint8_t * buff, uint32_t len)
+{
+}
+
+void hal_uarte_start_rx (void (*handler) (uint8_t rx_byte))
+{
+    uarte_rx = handler;
+}
+
+void hal_uarte_process (void)
+{
+}
+
+static uint32_t frames_done;
+
+static void frame_done (const uint8_t * data, uint16_t len)
+{
+    frames_done++;
+}
+
+static uint8_t encoded[80];
+static uint16_t encoded_len;
+
+static void encode_done (const uint8_t * data, uint16_t len)
+{
+    memcpy (encoded, data, len);
+    encoded_len = len;
+}
+
+/* Encode and decode a frame, returns if it was decoded */
+uint32_t host_frame (const uint8_t * data, uint16_t len)
+{
+    uint32_t done = frames_done;
+    encodeFrame (data, len, encode_done);
+    decodeFrame (encoded, encoded_len, frame_done);
+    return frames_done - done;
+}
+
+static uint32_t at_ok;
+
+static void at_successful (uint32_t cmd_id, uint32_t response_id)
+{
+    at_ok++;
+}
+
+static void at_failed (uint32_t cmd_id, uint8_t is_critical, uint8_t is_timeout,
+        uint32_t error_id)
+{
+}
+
+static void at_data (uint32_t cmd_id, at_uart_data_t * u_data1, uint32_t len)
+{
+}
+
+void host_at_init (void)
+{
+    AT_proc_init_t init =
+    {
+        .cmd_successful = at_successful,
+        .cmd_successful_data = at_data,
+        .cmd_failed = at_failed,
+    };
+    AT_proc_init (&init);
+}
+
+/* Send a command and receive its echo and response, returns if it passed */
+uint32_t host_at (void)
+{
+    static const char echo[] = "AT+CSQ\r\n+CSQ: 17,0\r\n\r\nOK\r\n";
+    at_proc_cmd_t cmd =
+    {
+        .cmd_id = 1,
+        .cmd = {"AT+CSQ\r\n", 8},
+        .resp = {{"OK\r\n", 4}},
+        .err = {{"ERROR\r\n", 7}},
+        .timeout = 1000,
+    };
+    uint32_t ok = at_ok;
+    AT_proc_send_cmd (&cmd);
+    for (uint32_t i = 0; i < sizeof(echo) - 1; i++)
+    {
+        uarte_rx (echo[i]);
+    }
+    return at_ok - ok;
+}
+
+void get_total_entries (uint32_t log_id);
+uint32_t get_next_loc (uint32_t log_id);
+
+void host_nvm (void)
+{
+    get_total_entries (0);
+    get_next_loc (0);
+}
+
+/* A region in a region */
+void host_nested (uint32_t n)
+{
+    volatile uint32_t sum = 0;
+    PROF_REGION_START(bench_outer);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        sum += i;
+    }
+    PROF_REGION_START(bench_inner);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        sum += i;
+    }
+    PROF_REGION_STOP(bench_inner);
+    PROF_REGION_STOP(bench_outer);
+}
+"""
+
+def wrapper(tmp, path):
+	"""A file including a module with log_printf replaced, and the NOP
+	delay of the Cortex-M left out as no module benchmarked uses it"""
+	name = os.path.join(tmp, "wrap_" + os.path.basename(path))
+	with open(name, "w") as f:
+		f.write(LOG_STUB + "#define CODEBASE_HAL_HAL_NOP_DELAY_H_\n" +
+				'#include "%s"\n' % os.path.abspath(path))
+	return name
+
+def build(tmp, name, is_en):
+	cc = os.environ.get("CC", "cc")
+	harness = os.path.join(tmp, "harness.c")
+	with open(harness, "w") as f:
+		f.write(HARNESS)
+	so = os.path.join(tmp, name + ".so")
+	# __linux__ is kept for the Linux backend of prof_region, __unix makes
+	# nrf.h expect a simulator
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__unix",
+			"-U__unix__", "-Uunix", "-DNRF52832", "-DNRF52832_XXAA", "-DSYS_CFG_PRESENT=0"] +
+			(["-DPROF_REGION_EN"] if is_en else []) + ["-I" + i for i in INC] +
+			["-o", so, harness, "codebase/util/prof_region.c",
+			wrapper(tmp, "codebase/peripheral_modules/byte_frame.c"),
+			wrapper(tmp, "codebase/AT_lib/AT_proc.c"),
+			wrapper(tmp, "codebase/peripheral_modules/nvm_logger.c")])
+	return ctypes.CDLL(so)
+
+def map_flash():
+	"""Map the flash pages of nvm_logger with a log of LOG_ENTRIES entries"""
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	size = FLASH_END - FLASH_BASE
+	if libc.mmap(FLASH_BASE, size, 3, 0x22 | 0x100000, -1, 0) != FLASH_BASE:
+		sys.exit("Can't map the flash at 0x%08X" % FLASH_BASE)
+	ctypes.memset(FLASH_BASE, 0xFF, size)
+	rnd = random.Random(37)
+	for n in range(LOG_ENTRIES):
+		page = LOG_PAGES[n // ENTRIES_PER_PAGE]
+		addr = page + (n % ENTRIES_PER_PAGE) * ENTRY_SIZE
+		ctypes.memmove(addr, bytes(rnd.randrange(255) for _ in range(ENTRY_SIZE)), ENTRY_SIZE)
+	pages = [(0, n, page) for n, page in enumerate(LOG_PAGES)]
+	pages += [(n + 1, 0, page) for n, page in enumerate(OTHER_LOG_PAGES)]
+	for log_id, page_no, page in pages:
+		# log_id, log_page_no and data_size of page_metadata_t
+		ctypes.memmove(page + PAGE_METADATA_ADDR,
+				bytes([log_id, page_no, ENTRY_SIZE & 0xFF, ENTRY_SIZE >> 8]), 4)
+
+def dump(lib):
+	"""The table of prof_region_dump as {region: (count, min, mean, max)}
+	and the ticks per us"""
+	sys.stdout.flush()
+	libc = ctypes.CDLL(None)
+	out = tempfile.TemporaryFile()
+	saved = os.dup(1)
+	libc.fflush(None)
+	os.dup2(out.fileno(), 1)
+	try:
+		lib.prof_region_dump()
+		libc.fflush(None)
+	finally:
+		os.dup2(saved, 1)
+		os.close(saved)
+	out.seek(0)
+	lines = out.read().decode().splitlines()
+	per_us = int(lines[0].split("of ")[1].split()[0])
+	table = {}
+	for line in lines[1:]:
+		name, vals = line.split(":")
+		table[name] = tuple(int(v) for v in vals.split(","))
+	return table, per_us
+
+class Suite(object):
+	def __init__(self):
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + str(detail))
+
+	def run(self, lib, is_en):
+		rnd = random.Random(37)
+		ctypes.c_uint32.in_dll(lib, "host_log_ns").value = args.print_us * 1000
+		if is_en:
+			lib.prof_region_init()
+		lib.nvm_logger_mod_init()
+		lib.host_at_init()
+		if is_en:
+			lib.prof_region_reset()
+		frames = ats = 0
+		for _ in range(args.runs):
+			data = bytes(rnd.choice([0x12, 0x13, 0x7D, rnd.randrange(256)])
+					for _ in range(rnd.randint(1, 32)))
+			frames += lib.host_frame(data, len(data))
+			ats += lib.host_at()
+		nvm_runs = max(args.runs // 20, 1)
+		for _ in range(nvm_runs):
+			lib.host_nvm()
+		for _ in range(args.runs):
+			lib.host_nested(rnd.randint(10, 200))
+		self.check("%d frames decoded and %d AT responses matched" % (frames, ats),
+				frames == args.runs and ats == args.runs)
+		return nvm_runs
+
+	def test_enabled(self, lib):
+		nvm_runs = self.run(lib, True)
+		table, per_us = dump(lib)
+		# AT_proc processes each of the 4 lines received for a command
+		calls = {"nvm_logger_count_entries": nvm_runs, "nvm_logger_next_loc": nvm_runs,
+				"AT_proc_rsp": 4 * args.runs}
+		counts = dict((r, table.get(r, (0,))[0]) for r in REGIONS)
+		bad = [r for r in REGIONS if counts[r] != calls.get(r, args.runs)]
+		self.check("count of every region matches its calls", not bad,
+				[(r, counts[r]) for r in bad])
+		self.check("min <= mean <= max for every region", all(
+				v[1] <= v[2] <= v[3] for v in table.values()))
+		limit = args.print_us * per_us
+		slow = [(r, v[1]) for r, v in table.items() if v[1] >= limit]
+		self.check("no region takes the time of a print, %d us" % args.print_us,
+				not slow, slow)
+		outer, inner = table["bench_outer"], table["bench_inner"]
+		self.check("nested region within the region around it",
+				inner[1] <= outer[1] and inner[2] <= outer[2])
+		print("Regions in ticks of %d per us, count, min, mean, max:" % per_us)
+		for r in REGIONS:
+			if r in table:
+				print("  %-26s %6d %8d %8d %8d" % ((r,) + table[r]))
+
+	def test_disabled(self, lib):
+		self.run(lib, False)
+		self.check("without PROF_REGION_EN nothing is compiled",
+				not hasattr(lib, "prof_region_add") and not hasattr(lib, "prof_region_dump"))
+
+def main():
+	map_flash()
+	tmp = tempfile.mkdtemp()
+	try:
+		suite = Suite()
+		suite.test_enabled(build(tmp, "prof_en", True))
+		suite.test_disabled(build(tmp, "prof_dis", False))
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,590 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Simulation of the power manager (codebase/peripheral_modules/pwr_mgr.c)
+# on a model of the clock tree and the wake sources, without the SoftDevice.
+# The HF crystal is started and stopped through stubs of hal_clocks, which
+# set HFCLKSTAT. The RTCs count only between their START and STOP tasks.
+# The WFI advances the time to the next wake and sets the interrupt pending
+# in the NVIC. It is built twice, once with RTC2 as the time base as on the
+# nRF52832 and once sharing the RTC of ms_timer as on the nRF52810, with
+# ms_timer built in.
+#
+# Checked:
+# - The HF crystal is never running during a sleep without a client which
+#   needs it, unless it was started outside the manager. It is started when
+#   a need is added and stopped at the sleep after the release.
+# - A need added by an interrupt while the sleep applies the needs is kept.
+# - A need of only the HF clock doesn't start the HF crystal and its time
+#   asleep is counted on the HF internal oscillator, and the current of the
+#   peripheral of each client with a need is counted over the sleep.
+# - The CPU sleeps with the interrupts masked and the wakes are counted per
+#   interrupt, or as other when none is pending.
+# - The time asleep and awake matches the model's, including when
+#   ms_timer_stop leaves no ms_timer running.
+#
+# Then the sensing mode of sense_pir is run for a simulated hour in its
+# normal mode, with the PIR sampled on the LFCLK, and in its testing mode,
+# with the HF crystal held by aux_clk, and the report of the power manager
+# is printed as the estimated current budget. The wakes are the slow device
+# tick every 300 s, a SAADC limit interrupt per motion and three ms_timer
+# wakes of the camera trigger pattern after each. The current of the PIR
+# front end isn't in the estimate.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   pwr_mgr_sim.py [--motions-per-hour 30] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="pwr_mgr clock tree simulation")
+parser.add_argument("--motions-per-hour", type=float, default=30,
+		help="motions seen by the PIR in the sense_pir budget")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules"]
+
+# Peripherals used by the test build
+CLOCK_BASE = 0x40000000
+RTC0_BASE = 0x4000B000
+RTC1_BASE = 0x40011000
+RTC2_BASE = 0x40024000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+HFCLKSTAT = CLOCK_BASE + 0x40C
+HFCLKSTAT_XTAL_RUNNING = 0x10001
+TASKS_CONSTLAT = CLOCK_BASE + 0x78
+TASKS_LOWPWR = CLOCK_BASE + 0x7C
+NVIC_ISPR = SCS_BASE + 0x200
+RTC_TASKS_START = 0x000
+RTC_TASKS_STOP = 0x004
+RTC_COUNTER = 0x504
+RTC_PRESCALER = 0x508
+
+LFCLK_FREQ = 32768
+RTC_MASK = 0xFFFFFF
+
+# IRQn of the wake sources
+GPIOTE_IRQN = 6
+SAADC_IRQN = 7
+RTC1_IRQN = 17
+WAKE_SRC_OTHER = 40
+
+# pwr_mgr_need_t
+NEED_NONE = 0
+NEED_HFXO = 1
+NEED_CONST_LAT = 2
+NEED_HFCLK = 4
+
+# ms_timer_mode
+MS_SINGLE_CALL = 0
+
+# Currents of the estimate, as the defaults in pwr_mgr.h
+UA_SLEEP = 2
+UA_HFXO = 250
+UA_HFINT = 60
+UA_RUN = 3700
+UA_TIMER = 5
+UA_UARTE = 55
+
+# The application's view of pwr_mgr.c and its statics, with the core
+# intrinsics and the log going to the host
+WRAP = r"""
+#include <stdio.h>
+#include "nrf.h"
+#define CODEBASE_PERIPHERAL_MODULES_LOG_H_
+#define log_printf printf
+void host_wfi (void);
+void host_disable_irq (void);
+void host_enable_irq (void);
+#define __WFI host_wfi
+#define __disable_irq host_disable_irq
+#define __enable_irq host_enable_irq
+#include "pwr_mgr.c"
+uint32_t host_unowned (void) { return unowned_hfxo_sleeps; }
+void host_flush (void) { fflush(stdout); }
+"""
+
+STUB = r"""
+#include <stdint.h>
+#include "nrf.h"
+
+uint32_t host_assert;
+uint32_t host_primask;
+uint32_t host_hfxo_starts;
+uint32_t host_hfxo_stops;
+void (*host_on_wfi) (void);
+/* Called as an interrupt at the next stop of the HF crystal */
+void (*host_irq_at_hfxo_stop) (void);
+
+static uint32_t cr_depth;
+static void (*cr_deferred) (void);
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    cr_depth++;
+    *is_critical_entered = 1;
+}
+
+/* An interrupt held off by the critical region runs when it's left */
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+    if(--cr_depth == 0 && cr_deferred)
+    {
+        void (*irq) (void) = cr_deferred;
+        cr_deferred = 0;
+        irq();
+    }
+}
+
+void host_disable_irq (void)
+{
+    host_primask = 1;
+}
+
+void host_enable_irq (void)
+{
+    host_primask = 0;
+}
+
+void host_wfi (void)
+{
+    host_on_wfi();
+}
+
+void hfclk_xtal_init_blocking (void)
+{
+    host_hfxo_starts++;
+    *(volatile uint32_t *) &NRF_CLOCK->HFCLKSTAT = 0x10001;
+}
+
+void hfclk_xtal_deinit (void)
+{
+    host_hfxo_stops++;
+    *(volatile uint32_t *) &NRF_CLOCK->HFCLKSTAT = 0;
+    if(host_irq_at_hfxo_stop)
+    {
+        void (*irq) (void) = host_irq_at_hfxo_stop;
+        host_irq_at_hfxo_stop = 0;
+        if(cr_depth)
+        {
+            cr_deferred = irq;
+        }
+        else
+        {
+            irq();
+        }
+    }
+}
+"""
+
+# Empty isr_manager.h for ms_timer built with ISR_MANAGER
+ISR_MANAGER_H = "\n"
+
+VOID_FN = ctypes.CFUNCTYPE(None)
+
+class Stats(ctypes.Structure):
+	_fields_ = [("sleep_count", ctypes.c_uint32), ("sleep_ticks", ctypes.c_uint64),
+			("sleep_hfxo_ticks", ctypes.c_uint64), ("sleep_hfint_ticks", ctypes.c_uint64),
+			("sleep_periph_charge", ctypes.c_uint64), ("awake_ticks", ctypes.c_uint64),
+			("wake_count", ctypes.c_uint32 * (WAKE_SRC_OTHER + 1))]
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (CLOCK_BASE, RTC0_BASE, RTC1_BASE, RTC2_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+class Sim(object):
+	"""The clock tree and the wake sources around a build of pwr_mgr"""
+	def __init__(self, lib):
+		self.lib = lib
+		self.on_wfi = VOID_FN(self.wfi)
+		ctypes.c_void_p.in_dll(lib, "host_on_wfi").value = \
+				ctypes.cast(self.on_wfi, ctypes.c_void_p).value
+		lib.pwr_mgr_get_stats.restype = ctypes.POINTER(Stats)
+		for name in ("host_primask", "host_hfxo_starts", "host_hfxo_stops", "host_assert"):
+			setattr(self, name, ctypes.c_uint32.in_dll(lib, name))
+		self.irq_at_hfxo_stop = ctypes.c_void_p.in_dll(lib, "host_irq_at_hfxo_stop")
+		for base in (RTC0_BASE, RTC1_BASE, RTC2_BASE):
+			ctypes.memset(base, 0, PAGE)
+		self.running = {RTC1_BASE: False, RTC2_BASE: False}
+		self.const_lat = False
+		self.reset()
+
+	def reset(self):
+		"""Reset the model, the RTCs keep running as they were"""
+		ctypes.memset(CLOCK_BASE, 0, PAGE)
+		reg(NVIC_ISPR).value = 0
+		reg(NVIC_ISPR + 4).value = 0
+		self.now = 0
+		self.sleep_ticks = 0
+		self.awake_ticks = 0
+		self.last_awake = 0
+		self.wakes = {}
+		# Per sleep: (HF crystal running, any client needs it, started outside, masked)
+		self.sleeps = []
+		# Per sleep: (constant latency set, any client needs it)
+		self.lat_sleeps = []
+		# Time asleep with only the HF clock needed and the charge of the
+		# peripherals of the clients with a need
+		self.hfint_ticks = 0
+		self.periph_charge = 0
+		self.needs = {}
+		self.external_hfxo = False
+		# The next wake as (delay in ticks, IRQn or None), popped by the WFI
+		self.next_wake = []
+
+	def poll_rtcs(self):
+		"""Latch the START and STOP tasks written since the last poll"""
+		for base in self.running:
+			if reg(base + RTC_TASKS_STOP).value:
+				reg(base + RTC_TASKS_STOP).value = 0
+				self.running[base] = False
+			if reg(base + RTC_TASKS_START).value:
+				reg(base + RTC_TASKS_START).value = 0
+				self.running[base] = True
+
+	def advance(self, ticks):
+		self.poll_rtcs()
+		for base, running in self.running.items():
+			if running:
+				counter = reg(base + RTC_COUNTER)
+				counter.value = (counter.value + ticks) & RTC_MASK
+		self.now += ticks
+
+	def poll_power(self):
+		"""Latch the power mode tasks written since the last poll"""
+		if reg(TASKS_CONSTLAT).value:
+			reg(TASKS_CONSTLAT).value = 0
+			self.const_lat = True
+		if reg(TASKS_LOWPWR).value:
+			reg(TASKS_LOWPWR).value = 0
+			self.const_lat = False
+
+	def wfi(self):
+		hfxo = reg(HFCLKSTAT).value == HFCLKSTAT_XTAL_RUNNING
+		needed = any(n & NEED_HFXO for n in self.needs.values())
+		self.sleeps.append((hfxo, needed, self.external_hfxo, self.host_primask.value == 1))
+		self.poll_power()
+		self.lat_sleeps.append((self.const_lat,
+				any(n & NEED_CONST_LAT for n in self.needs.values())))
+		delay, irq = self.next_wake.pop(0) if self.next_wake else (LFCLK_FREQ, None)
+		if not hfxo and any(n & NEED_HFCLK for n in self.needs.values()):
+			self.hfint_ticks += delay
+		self.periph_charge += delay * sum(self.periph_ua[c] for c, n in self.needs.items() if n)
+		self.advance(delay)
+		self.sleep_ticks += delay
+		if irq is not None:
+			reg(NVIC_ISPR + 4 * (irq // 32)).value |= 1 << (irq % 32)
+		self.wakes[WAKE_SRC_OTHER if irq is None else irq] = \
+				self.wakes.get(WAKE_SRC_OTHER if irq is None else irq, 0) + 1
+
+	def sleep(self, delay, irq, awake):
+		"""One pass of the main loop, sleeping till the wake and then awake"""
+		self.next_wake.append((delay, irq))
+		self.lib.pwr_mgr_sleep()
+		# The handler of the wake runs and the main loop processes
+		reg(NVIC_ISPR).value = 0
+		reg(NVIC_ISPR + 4).value = 0
+		self.advance(awake)
+		self.awake_ticks += awake
+		self.last_awake = awake
+
+	def need(self, client, needs):
+		self.needs[client] = needs
+		self.lib.pwr_mgr_need(client, needs)
+		self.poll_rtcs()
+
+	def hfxo(self):
+		return reg(HFCLKSTAT).value == HFCLKSTAT_XTAL_RUNNING
+
+	def stats(self):
+		return self.lib.pwr_mgr_get_stats().contents
+
+	def stray_hfxo_sleeps(self):
+		"""Sleeps with the HF crystal on, not needed and not started outside"""
+		return sum(1 for hfxo, needed, ext, _ in self.sleeps if hfxo and not needed and not ext)
+
+class Suite(object):
+	def __init__(self):
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def test_hfxo(self, sim, clients):
+		"""The HF crystal follows the needs of the clients"""
+		radio, aux = clients
+		sim.reset()
+		sim.lib.pwr_mgr_stats_reset()
+		sim.sleep(100, RTC1_IRQN, 3)
+		sim.need(aux, NEED_HFXO)
+		started = sim.hfxo() and sim.host_hfxo_starts.value == 1
+		sim.sleep(100, RTC1_IRQN, 3)
+		sim.need(aux, NEED_NONE)
+		held = sim.hfxo()
+		sim.sleep(100, RTC1_IRQN, 3)
+		self.check("HF crystal started when a need is added", started)
+		self.check("HF crystal kept till the sleep after the release",
+				held and not sim.hfxo(), "held %s, after the sleep %s" % (held, sim.hfxo()))
+
+		# The crystal started outside the manager, as by hal_radio
+		reg(HFCLKSTAT).value = HFCLKSTAT_XTAL_RUNNING
+		sim.external_hfxo = True
+		stops = sim.host_hfxo_stops.value
+		sim.sleep(100, RTC1_IRQN, 3)
+		self.check("HF crystal started outside the manager left running and counted",
+				sim.hfxo() and sim.host_hfxo_stops.value == stops and sim.lib.host_unowned() == 1)
+		reg(HFCLKSTAT).value = 0
+		sim.external_hfxo = False
+
+		# Random needs of two clients
+		rnd = random.Random(34)
+		for _ in range(500):
+			if rnd.random() < 0.3:
+				sim.need(rnd.choice(clients), rnd.choice((NEED_NONE, NEED_HFXO,
+						NEED_CONST_LAT, NEED_HFXO | NEED_CONST_LAT)))
+			sim.sleep(rnd.randint(2, 5000), rnd.choice((RTC1_IRQN, SAADC_IRQN, None)),
+					rnd.randint(1, 20))
+		sim.need(radio, NEED_NONE)
+		sim.need(aux, NEED_NONE)
+		sim.sleep(100, None, 3)
+		self.check("HF crystal never on during a sleep without a client needing it",
+				sim.stray_hfxo_sleeps() == 0, "%d sleeps" % sim.stray_hfxo_sleeps())
+		self.check("HF crystal stopped once no client needs it", not sim.hfxo())
+		wrong = sum(1 for mode, needed in sim.lat_sleeps if mode != needed)
+		self.check("constant latency mode only while a client needs it", wrong == 0,
+				"%d sleeps" % wrong)
+
+	def test_need_from_irq(self, sim, aux):
+		"""An interrupt adds a need while the sleep applies the needs"""
+		sim.reset()
+		sim.need(aux, NEED_HFXO)
+		sim.sleep(100, RTC1_IRQN, 3)
+		sim.need(aux, NEED_NONE)
+
+		def irq():
+			sim.needs[aux] = NEED_HFXO
+			sim.lib.pwr_mgr_need(aux, NEED_HFXO)
+		cb = VOID_FN(irq)
+		sim.irq_at_hfxo_stop.value = ctypes.cast(cb, ctypes.c_void_p).value
+		sim.sleep(100, RTC1_IRQN, 3)
+		kept = sim.sleeps[-1][0]
+		sim.need(aux, NEED_NONE)
+		sim.sleep(100, RTC1_IRQN, 3)
+		self.check("need added by an interrupt during the sleep setup is kept", kept)
+		self.check("HF crystal stopped after that need is released",
+				not sim.hfxo() and not sim.sleeps[-1][0])
+
+	def test_hfclk(self, sim, clients):
+		"""Needs of the HF clock alone and the current of the peripherals"""
+		radio, aux, uarte = clients
+		sim.reset()
+		sim.lib.pwr_mgr_stats_reset()
+		starts = sim.host_hfxo_starts.value
+		sim.need(uarte, NEED_HFCLK)
+		sim.sleep(1000, None, 3)
+		self.check("HF clock need doesn't start the HF crystal",
+				not sim.hfxo() and sim.host_hfxo_starts.value == starts)
+		rnd = random.Random(12)
+		for _ in range(500):
+			if rnd.random() < 0.3:
+				sim.need(rnd.choice(clients), rnd.choice((NEED_NONE, NEED_HFXO,
+						NEED_HFCLK, NEED_HFCLK | NEED_CONST_LAT)))
+			sim.sleep(rnd.randint(2, 5000), rnd.choice((RTC1_IRQN, None)),
+					rnd.randint(1, 20))
+		for client in clients:
+			sim.need(client, NEED_NONE)
+		sim.sleep(100, None, 3)
+		stats = sim.stats()
+		self.check("time asleep on the HF internal oscillator matches the model",
+				stats.sleep_hfint_ticks == sim.hfint_ticks and sim.hfint_ticks > 0,
+				"%d ticks, model %d" % (stats.sleep_hfint_ticks, sim.hfint_ticks))
+		self.check("charge of the peripherals asleep matches the model",
+				stats.sleep_periph_charge == sim.periph_charge and sim.periph_charge > 0,
+				"%d, model %d" % (stats.sleep_periph_charge, sim.periph_charge))
+		awake = sim.awake_ticks - sim.last_awake
+		model = (sim.sleep_ticks * UA_SLEEP + stats.sleep_hfxo_ticks * UA_HFXO +
+				sim.hfint_ticks * UA_HFINT + sim.periph_charge +
+				awake * UA_RUN) * 1000 // (sim.sleep_ticks + awake)
+		na = sim.lib.pwr_mgr_estimate_current_na()
+		self.check("estimate with the HF clock and the peripherals from the model",
+				na == model, "%d nA, model %d nA" % (na, model))
+
+	def test_wakes_and_time(self, sim, with_ms_timer):
+		"""Wake counts and the times against the model"""
+		sim.reset()
+		sim.lib.pwr_mgr_stats_reset()
+		rnd = random.Random(7)
+		expect = {}
+		for i in range(300):
+			if with_ms_timer and i == 10:
+				# The last ms_timer stops, the time base must keep counting
+				cb = VOID_FN(lambda: None)
+				sim.lib.ms_timer_start(0, MS_SINGLE_CALL, ctypes.c_uint64(1000), cb)
+				sim.lib.ms_timer_stop(0)
+			irq = rnd.choice((GPIOTE_IRQN, SAADC_IRQN, RTC1_IRQN, None))
+			sim.sleep(rnd.randint(2, 200000), irq, rnd.randint(1, 50))
+		stats = sim.stats()
+		wakes = dict(sim.wakes)
+		got = dict((n, stats.wake_count[n]) for n in range(WAKE_SRC_OTHER + 1)
+				if stats.wake_count[n])
+		self.check("sleeps with the interrupts masked",
+				all(masked for _, _, _, masked in sim.sleeps))
+		self.check("wakes counted per interrupt", got == wakes,
+				"counted %s, model %s" % (got, wakes))
+		self.check("time asleep matches the model",
+				stats.sleep_ticks == sim.sleep_ticks,
+				"%d ticks, model %d" % (stats.sleep_ticks, sim.sleep_ticks))
+		# The time awake is counted up to the last sleep
+		model_awake = sim.awake_ticks - sim.last_awake
+		self.check("time awake matches the model", stats.awake_ticks == model_awake,
+				"%d ticks, model %d" % (stats.awake_ticks, model_awake))
+
+	def budget(self, sim, aux, name, hfxo):
+		"""An hour of the sensing mode of sense_pir"""
+		sim.reset()
+		sim.lib.pwr_mgr_stats_reset()
+		sim.need(aux, NEED_HFXO if hfxo else NEED_NONE)
+		rnd = random.Random(1)
+		hour = 3600 * LFCLK_FREQ
+		ticks = lambda us: max(1, int(round(us * LFCLK_FREQ / 1e6)))
+		events = [(t, "tick") for t in range(300 * LFCLK_FREQ, hour, 300 * LFCLK_FREQ)]
+		motions = int(round(args.motions_per_hour))
+		events += [(rnd.randrange(hour), "motion") for _ in range(motions)]
+		events.sort()
+		now = 0
+		for at, kind in events:
+			if at < now:
+				continue
+			if kind == "tick":
+				sim.sleep(at - now, RTC1_IRQN, ticks(150))
+			else:
+				sim.sleep(at - now, SAADC_IRQN, ticks(300))
+				# The camera trigger pattern on ms_timer
+				for _ in range(3):
+					sim.sleep(ticks(100000), RTC1_IRQN, ticks(50))
+			now = sim.now
+		sim.sleep(hour - now, None, ticks(50))
+		sim.lib.host_flush()
+		print("%s mode of sense_pir, %d motions in an hour:" % (name, motions))
+		sys.stdout.flush()
+		sim.lib.pwr_mgr_log_report()
+		sim.lib.host_flush()
+		awake = sim.awake_ticks - sim.last_awake
+		model = (sim.sleep_ticks * UA_SLEEP +
+				(sim.sleep_ticks if hfxo else 0) * (UA_HFXO + UA_TIMER) +
+				awake * UA_RUN) * 1000 // (sim.sleep_ticks + awake)
+		na = sim.lib.pwr_mgr_estimate_current_na()
+		print("  Average %.2f uA, %.3f mAh a day from the clocks, the CPU and the TIMER" %
+				(na / 1000.0, na * 24 / 1e6))
+		sim.need(aux, NEED_NONE)
+		self.check("%s mode estimate from the model's times" % name, na == model,
+				"%d nA, model %d nA" % (na, model))
+
+def build(tmp, name, cflags, with_ms_timer):
+	cc = os.environ.get("CC", "cc")
+	srcs = [os.path.join(tmp, "wrap.c"), os.path.join(tmp, "stub.c")]
+	if with_ms_timer:
+		srcs.append("codebase/peripheral_modules/ms_timer.c")
+	so = os.path.join(tmp, name + ".so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-DISR_MANAGER=1", "-iquote", tmp] +
+			cflags + ["-I" + i for i in INC] + ["-o", so] + srcs)
+	return ctypes.CDLL(so)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		for name, text in (("wrap.c", WRAP), ("stub.c", STUB), ("isr_manager.h", ISR_MANAGER_H)):
+			with open(os.path.join(tmp, name), "w") as f:
+				f.write(text)
+		suite = Suite()
+		builds = [("RTC2 time base", build(tmp, "rtc2", [], False), False),
+				("Shared ms_timer RTC", build(tmp, "shared", ["-DRTC_USED_PWR_MGR=1"], True),
+				True)]
+		sims = []
+		for title, lib, with_ms_timer in builds:
+			print("%s:" % title)
+			sim = Sim(lib)
+			if with_ms_timer:
+				# Before the first sleep, as in the applications
+				lib.ms_timer_init(3)
+			# The manager keeps the pointers to the names
+			sim.names = [ctypes.c_char_p(b"hal_radio"), ctypes.c_char_p(b"aux_clk"),
+					ctypes.c_char_p(b"hal_uarte")]
+			clients = tuple(lib.pwr_mgr_client_register(n, ua) for n, ua in
+					zip(sim.names, (0, UA_TIMER, UA_UARTE)))
+			sim.periph_ua = dict(zip(clients, (0, UA_TIMER, UA_UARTE)))
+			suite.test_hfxo(sim, clients[:2])
+			suite.test_hfclk(sim, clients)
+			suite.test_need_from_irq(sim, clients[1])
+			suite.test_wakes_and_time(sim, with_ms_timer)
+			suite.check("no asserts", sim.host_assert.value == 0)
+			sims.append((sim, clients[1]))
+		sim, aux = sims[0]
+		suite.budget(sim, aux, "Normal", False)
+		suite.budget(sim, aux, "Testing", True)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,403 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of the random number service (codebase/peripheral_modules/
+# random_num.c) on a simulated RNG peripheral, without the SoftDevice. The
+# module is built for the host with the RNG, the FICR and the NVIC at their
+# nRF52 addresses. Between the calls the simulation advances the time by the
+# gap given, the RNG gives a byte every --byte-us while started, and the
+# RNG_IRQHandler runs for each VALRDY as long as the interrupt is enabled.
+# So the RNG never has a byte ready during a call, and a call which waited
+# for one would never return.
+#
+# Checked, with the chi-square test at p = 0.001:
+# - random_num_below is uniform for small bounds, for bounds which aren't a
+#   power of 2 and for a bound of 3 * 2^30, where a plain modulo or the
+#   old (byte * range)/256 scaling shows its bias.
+# - random_num_generate stays in [min, max) and is uniform in it.
+# - Every byte of random_num_get is uniform, also from an RNG stuck at 0.
+# - The calls are served with less than a word in the pool, and the RNG is stopped once
+#   the pool is full when the calls are sparse.
+#
+# The time per call on the host and the time the RNG runs are printed.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   random_num_test.py [--samples 200000] [--byte-us 120] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import math
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="random_num distribution test")
+parser.add_argument("--samples", type=int, default=200000, help="numbers drawn per check")
+parser.add_argument("--byte-us", type=int, default=120,
+		help="time of the RNG per byte with the bias correction, in us")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules"]
+
+# Peripherals used by the test build
+FICR_BASE = 0x10000000
+RNG_BASE = 0x4000D000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+# The entropy of the simulated RNG
+SOURCE_GOOD = 0
+SOURCE_STUCK = 1
+
+# What the harness draws
+DRAW_BELOW = 0
+DRAW_GENERATE = 1
+DRAW_BYTE = 2
+
+# The module with its statics reachable and the simulated RNG around it
+HARNESS = r"""
+#include <stdint.h>
+#include <time.h>
+#include "nrf.h"
+
+void host_setclr (volatile uint32_t * reg, uint32_t val);
+
+#include "random_num.c"
+
+static uint64_t now_us;
+static uint64_t next_byte_us;
+static uint64_t rng_on_us;
+static uint32_t rng_on;
+static uint64_t source_state = 0x9E3779B97F4A7C15ULL;
+
+/* The INTENSET and INTENCLR registers act on the INTEN read from both */
+void host_setclr (volatile uint32_t * reg, uint32_t val)
+{
+    volatile uint32_t * base = (volatile uint32_t *) ((uintptr_t) reg & ~0x7UL);
+    uint32_t cur = base[0];
+    cur = (((uintptr_t) reg & 0x7) == 4) ? (cur | val) : (cur & ~val);
+    base[0] = base[1] = cur;
+}
+
+static uint8_t source_byte (uint32_t source)
+{
+    if(source == 1)
+    {
+        return 0;
+    }
+    /* splitmix64 */
+    uint64_t z = (source_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint8_t) (z ^ (z >> 31));
+}
+
+/* Latch the tasks and run the RNG for a while */
+static void advance (uint32_t us, uint32_t byte_us, uint32_t source)
+{
+    uint64_t end = now_us + us;
+    while(1)
+    {
+        if(NRF_RNG->TASKS_STOP)
+        {
+            NRF_RNG->TASKS_STOP = 0;
+            rng_on = 0;
+        }
+        if(NRF_RNG->TASKS_START)
+        {
+            NRF_RNG->TASKS_START = 0;
+            if(rng_on == 0)
+            {
+                next_byte_us = now_us + byte_us;
+            }
+            rng_on = 1;
+        }
+        if(rng_on == 0 || next_byte_us > end)
+        {
+            break;
+        }
+        rng_on_us += next_byte_us - now_us;
+        now_us = next_byte_us;
+        next_byte_us += byte_us;
+        *(volatile uint32_t *) &NRF_RNG->VALUE = source_byte(source);
+        NRF_RNG->EVENTS_VALRDY = 1;
+        if(NRF_RNG->INTENSET & RNG_INTENSET_VALRDY_Msk)
+        {
+            RNG_IRQHandler();
+        }
+    }
+    if(rng_on)
+    {
+        rng_on_us += end - now_us;
+    }
+    now_us = end;
+}
+
+static uint64_t host_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Results of host_draw */
+uint64_t host_call_ns;
+uint32_t host_empty_calls;
+uint64_t host_rng_on_us;
+uint64_t host_elapsed_us;
+
+void host_reset (void)
+{
+    now_us = 0;
+    rng_on = 0;
+    rng_on_us = 0;
+    pool_wr = pool_rd = 0;
+    is_init = false;
+    is_rng_running = false;
+    mix_idx = 0;
+    NRF_RNG->TASKS_START = NRF_RNG->TASKS_STOP = 0;
+    NRF_RNG->EVENTS_VALRDY = 0;
+    NRF_RNG->INTENSET = NRF_RNG->INTENCLR = 0;
+    random_num_init(3);
+}
+
+/* Draw count numbers with a gap between the calls. The numbers are put in
+ * out, or counted in hist for the bytes of random_num_get. */
+void host_draw (uint32_t draw, uint32_t count, uint32_t a, uint32_t b, uint32_t gap_us,
+        uint32_t byte_us, uint32_t source, uint32_t * out, uint32_t * hist)
+{
+    uint64_t start_us = now_us;
+    uint64_t start_on = rng_on_us;
+    host_call_ns = 0;
+    host_empty_calls = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        advance(gap_us, byte_us, source);
+        if(pool_count() < 4)
+        {
+            host_empty_calls++;
+        }
+        uint64_t t = host_ns();
+        uint32_t val;
+        switch(draw)
+        {
+        case 0:
+            val = random_num_below(a);
+            break;
+        case 1:
+            val = random_num_generate(a, b);
+            break;
+        default:
+            val = random_num_get();
+            break;
+        }
+        host_call_ns += host_ns() - t;
+        if(draw == 2)
+        {
+            for(uint32_t n = 0; n < 4; n++)
+            {
+                hist[256*n + ((val >> (8*n)) & 0xFF)]++;
+            }
+        }
+        else
+        {
+            out[i] = val;
+        }
+    }
+    host_rng_on_us = rng_on_us - start_on;
+    host_elapsed_us = now_us - start_us;
+}
+"""
+
+STUB = r"""
+#include <stdint.h>
+
+uint32_t host_assert;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+"""
+
+def hook_setclr(text):
+	"""Route the writes to the INTENSET and INTENCLR registers through host_setclr"""
+	return re.sub(r"(\w+)->(INTEN(?:SET|CLR))\s*\|?=\s*([^;]+);",
+			r"host_setclr(&(\1)->\2, (\3));", text)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (FICR_BASE, RNG_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+	# A device ID and address, as in the FICR
+	for off, val in ((0x060, 0x1A2B3C4D), (0x064, 0x5E6F7081), (0x0A4, 0xC0FFEE42),
+			(0x0A8, 0x0000D00D)):
+		ctypes.c_uint32.from_address(FICR_BASE + off).value = val
+
+def chi2_limit(dof):
+	"""The chi-square at p = 0.001, with the Wilson-Hilferty approximation"""
+	z = 3.09
+	return dof * (1 - 2.0 / (9 * dof) + z * math.sqrt(2.0 / (9 * dof))) ** 3
+
+def chi2(counts):
+	n = float(sum(counts))
+	exp = n / len(counts)
+	return sum((c - exp) ** 2 / exp for c in counts)
+
+class Suite(object):
+	def __init__(self, lib):
+		self.lib = lib
+		self.fails = 0
+		lib.host_reset()
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def draw(self, draw, count, a=0, b=0, gap_us=50, source=SOURCE_GOOD):
+		out = (ctypes.c_uint32 * count)()
+		hist = (ctypes.c_uint32 * 1024)()
+		self.lib.host_draw(draw, count, a, b, gap_us, args.byte_us, source, out, hist)
+		return list(out), list(hist)
+
+	def stat(self, name):
+		return ctypes.c_uint64.in_dll(self.lib, name).value
+
+	def uniform(self, vals, bins, width=1, offset=0):
+		counts = [0] * bins
+		for v in vals:
+			counts[(v - offset) // width] += 1
+		c = chi2(counts)
+		return c < chi2_limit(bins - 1), "chi-square %.1f, limit %.1f" % (c, chi2_limit(bins - 1))
+
+	def test_below(self):
+		for bound in (2, 3, 6, 10, 100, 1000):
+			n = max(args.samples, 100 * bound)
+			vals, _ = self.draw(DRAW_BELOW, n, bound)
+			ok, detail = self.uniform(vals, bound) if max(vals) < bound else (False, "out of range")
+			self.check("random_num_below(%d) uniform" % bound, ok, detail)
+		# Three bins of 2^30 each, a modulo would put half the numbers in the first
+		bound = 3 << 30
+		vals, _ = self.draw(DRAW_BELOW, args.samples, bound)
+		ok, detail = self.uniform(vals, 3, 1 << 30)
+		self.check("random_num_below(3 * 2^30) uniform", ok, detail)
+
+	def test_generate(self):
+		vals, _ = self.draw(DRAW_GENERATE, args.samples, 1000, 1037)
+		in_range = min(vals) >= 1000 and max(vals) < 1037
+		ok, detail = self.uniform(vals, 37, 1, 1000) if in_range else (False, "out of range")
+		self.check("random_num_generate(1000, 1037) in range and uniform", ok, detail)
+
+	def test_bytes(self):
+		for source, name in ((SOURCE_GOOD, "the RNG"), (SOURCE_STUCK, "an RNG stuck at 0")):
+			self.lib.host_reset()
+			_, hist = self.draw(DRAW_BYTE, args.samples, source=source)
+			worst = max(chi2(hist[256 * n:256 * (n + 1)]) for n in range(4))
+			self.check("every byte of random_num_get uniform from %s" % name,
+					worst < chi2_limit(255), "worst chi-square %.1f, limit %.1f" %
+					(worst, chi2_limit(255)))
+
+	def test_latency(self):
+		"""Back to back calls drain the pool, sparse ones let the RNG stop"""
+		self.lib.host_reset()
+		n = args.samples
+		self.draw(DRAW_BYTE, n, gap_us=1)
+		ns = self.stat("host_call_ns") / float(n)
+		empty = ctypes.c_uint32.in_dll(self.lib, "host_empty_calls").value
+		self.check("calls served without waiting with the pool drained", empty > n // 2,
+				"%d of %d calls with less than a word in the pool" % (empty, n))
+		print("    %.0f ns per call on the host, %d of %d back to back calls with less"
+				" than a word in the pool" % (ns, empty, n))
+
+		self.draw(DRAW_BYTE, 1000, gap_us=10000)
+		duty = self.stat("host_rng_on_us") / float(self.stat("host_elapsed_us"))
+		# A word of 4 bytes to refill per call
+		expect = 4.0 * args.byte_us / 10000
+		self.check("RNG stopped once the pool is full", duty < 2 * expect,
+				"on %.2f%% of the time, %.2f%% expected" % (100 * duty, 100 * expect))
+		print("    RNG on %.2f%% of the time with a call every 10 ms" % (100 * duty))
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	src = os.path.join(tmp, "random_num.c")
+	with open(src, "w") as f:
+		f.write(hook_setclr(open("codebase/peripheral_modules/random_num.c").read()))
+	for name, text in (("harness.c", HARNESS), ("stub.c", STUB)):
+		with open(os.path.join(tmp, name), "w") as f:
+			f.write(text)
+	so = os.path.join(tmp, "random_num.so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-DISR_MANAGER=0", "-iquote", tmp] +
+			["-I" + i for i in INC] + ["-o", so, os.path.join(tmp, "harness.c"),
+			os.path.join(tmp, "stub.c")])
+	return ctypes.CDLL(so)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		lib = build(tmp)
+		suite = Suite(lib)
+		suite.test_below()
+		suite.test_generate()
+		suite.test_bytes()
+		suite.test_latency()
+		suite.check("no asserts", ctypes.c_uint32.in_dll(lib, "host_assert").value == 0)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
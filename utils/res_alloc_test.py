@@ -0,0 +1,231 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of the allocator of the shared hardware resources (codebase/util/
+# res_alloc.c) built for the nRF52832 and the nRF52810, and of the checker of
+# the fixed allocations (utils/sys_config_check.py). The allocator is checked
+# for the number of each resource in the SoC, with the CC registers of each
+# TIMER from its TIMERn_CC_NUM, for reserving a resource or a range of them
+# only if all are free and for handing out and freeing the free ones. The
+# checker is run on every application, which must have no collision, and on
+# copies of an application with a collision made in its sys_config.h, by a
+# module's default and by a channel used with a literal number in a source.
+#
+# Needs a host C compiler, run from the root of the repository.
+# Usage:
+#   res_alloc_test.py [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="res_alloc and sys_config_check test")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/util"]
+
+# The critical region of nrf_util, which needs the CPU
+STUBS = r"""
+#include <stdint.h>
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+	*is_critical_entered = 1;
+}
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+"""
+
+# The types of res_alloc_type_t
+PPI_CH, PPI_GROUP, GPIOTE_CH, EGU_TRIG, TIMER_CC = range(5)
+NONE = -1
+
+# The resources of the SoCs, (PPI_CH_NUM, PPI_GROUP_NUM, GPIOTE_CH_NUM,
+# CC registers of each TIMER)
+SOCS = {
+	"NRF52832": (20, 6, 8, [4, 4, 4, 6, 6]),
+	"NRF52810": (20, 6, 8, [4, 4, 4]),
+}
+
+class Lib(object):
+	"""A fresh instance of res_alloc, with none of the resources used"""
+	count = 0
+
+	def __init__(self, tmp, soc):
+		so = os.path.join(tmp, "res_alloc_%s.so" % soc)
+		if not os.path.exists(so):
+			with open(os.path.join(tmp, "stubs.c"), "w") as f:
+				f.write(STUBS)
+			cc = os.environ.get("CC", "cc")
+			subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w",
+					"-U__linux__", "-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix",
+					"-D" + soc, "-D" + soc + "_XXAA"] + ["-I" + i for i in INC] +
+					["-o", so, "codebase/util/res_alloc.c", os.path.join(tmp, "stubs.c")])
+		# A copy per instance, as dlopen gives the loaded one for the same path
+		Lib.count += 1
+		copy = os.path.join(tmp, "res_alloc_%d.so" % Lib.count)
+		shutil.copy(so, copy)
+		self.lib = ctypes.CDLL(copy)
+		self.lib.res_alloc_get.restype = ctypes.c_int32
+		self.lib.res_alloc_timer_cc_idx.restype = ctypes.c_int32
+		for fn in ("res_alloc_reserve", "res_alloc_reserve_range", "res_alloc_is_free"):
+			getattr(self.lib, fn).restype = ctypes.c_bool
+
+	def __getattr__(self, name):
+		return getattr(self.lib, "res_alloc_" + name)
+
+def run_check(path):
+	"""The exit status and the output of sys_config_check.py on a path"""
+	p = subprocess.Popen([sys.executable, "utils/sys_config_check.py", path],
+			stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+	out = p.communicate()[0].decode()
+	return p.returncode, out.strip()
+
+def app_copy(tmp, app, name, config=None, makefile=None, files={}):
+	"""A copy of an application with the changes to its sys_config.h and
+	Makefile as (regex, replacement) and the files added"""
+	dst = os.path.join(tmp, name)
+	os.mkdir(dst)
+	for f in ("Makefile", "sys_config.h"):
+		src = os.path.join("application", app, f)
+		text = open(src).read()
+		for change in ((config if f == "sys_config.h" else makefile) or []):
+			text, n = re.subn(change[0], change[1], text, flags=re.M)
+			assert n, "%s not in %s" % (change[0], src)
+		with open(os.path.join(dst, f), "w") as out:
+			out.write(text)
+	for f in glob.glob(os.path.join("application", app, "*.[ch]")):
+		if not os.path.exists(os.path.join(dst, os.path.basename(f))):
+			shutil.copy(f, dst)
+	for f, text in files.items():
+		with open(os.path.join(dst, f), "w") as out:
+			out.write(text)
+	return dst
+
+tmp = tempfile.mkdtemp()
+try:
+	fails = 0
+
+	def check(name, cond, detail=""):
+		global fails
+		print("  %-4s %s" % ("PASS" if cond else "FAIL", name)
+				+ ((" : " + detail) if (args.verbose and not cond and detail) else ""))
+		if not cond:
+			fails += 1
+
+	for soc, (n_ppi, n_group, n_gpiote, timer_cc) in sorted(SOCS.items()):
+		lib = Lib(tmp, soc)
+		want = []
+		got = []
+		for t in range(len(timer_cc) + 1):
+			for c in range(7):
+				want.append(sum(timer_cc[:t]) + c if t < len(timer_cc) and c < timer_cc[t]
+						else NONE)
+				got.append(lib.timer_cc_idx(t, c))
+		check("%s: TIMER CC index from TIMERn_CC_NUM" % soc, got == want,
+				"%s != %s" % (got, want))
+
+		for kind, name, n in ((PPI_CH, "PPI channels", n_ppi), (PPI_GROUP, "PPI groups", n_group),
+				(GPIOTE_CH, "GPIOTE channels", n_gpiote),
+				(TIMER_CC, "TIMER CCs", sum(timer_cc))):
+			lib = Lib(tmp, soc)
+			got = [lib.get(kind) for i in range(n + 1)]
+			check("%s: all %d %s handed out once" % (soc, n, name),
+					got == list(range(n)) + [NONE], "%s" % got)
+
+		lib = Lib(tmp, soc)
+		last = lib.timer_cc_idx(len(timer_cc) - 1, timer_cc[-1] - 1)
+		check("%s: last CC of the last TIMER reserved, one past it not" % soc,
+				lib.reserve(TIMER_CC, last) and not lib.reserve(TIMER_CC, last + 1)
+				and not lib.reserve_range(TIMER_CC, ctypes.c_uint32(NONE).value, 4))
+
+	lib = Lib(tmp, "NRF52832")
+	ok = lib.reserve(PPI_CH, 5) and not lib.reserve(PPI_CH, 5) and not lib.is_free(PPI_CH, 5)
+	check("reserved channel can't be reserved again", ok)
+	ok = not lib.reserve_range(PPI_CH, 3, 4) and lib.is_free(PPI_CH, 3) \
+			and lib.is_free(PPI_CH, 4) and lib.is_free(PPI_CH, 6)
+	check("range over a used channel reserves none of it", ok)
+	ok = not lib.reserve_range(PPI_CH, 18, 3) and lib.is_free(PPI_CH, 18) \
+			and lib.reserve_range(PPI_CH, 17, 3)
+	check("range past the last channel reserves none of it", ok)
+	got = [lib.get(PPI_CH) for i in range(4)]
+	check("get skips the reserved channels", got == [0, 1, 2, 3], "%s" % got)
+	lib.free(PPI_CH, 5)
+	lib.free(PPI_CH, 1)
+	lib.free(PPI_CH, 40)
+	got = [lib.get(PPI_CH) for i in range(3)]
+	check("freed channels handed out again", got == [1, 4, 5], "%s" % got)
+	check("other types are independent", lib.is_free(GPIOTE_CH, 5) and lib.get(GPIOTE_CH) == 0)
+	check("a type past the last is never free", not lib.is_free(5, 0) and lib.get(5) == NONE
+			and not lib.reserve(5, 0))
+
+	apps = sorted(os.path.dirname(p) for p in glob.glob("application/*/Makefile"))
+	bad = []
+	for app in apps:
+		status, out = run_check(app)
+		if status != 0:
+			bad.append(out)
+	check("no collision in the %d applications" % len(apps), not bad, "\n".join(bad))
+
+	injected = [
+		("in sys_config.h",
+			app_copy(tmp, "sense_pir", "config", config=[
+				(r"^#define GPIOTE_CH_USED_OUT_GEN_1 1$", "#define GPIOTE_CH_USED_OUT_GEN_1 0")]),
+			"GPIOTE channel 0 used by both GPIOTE_CH_USED_OUT_GEN_0 and GPIOTE_CH_USED_OUT_GEN_1"),
+		("by a module's default",
+			app_copy(tmp, "sensebe_tx", "default", makefile=[
+				(r"^(C_SRC \+= tssp_ir_tx.c)$", r"\1\nC_SRC += simple_pwm.c")]),
+			"TIMER 1 used by both TIMER_USED_SIMPLE_PWM (default in simple_pwm.h)"),
+		("by a default of a define of sys_config.h",
+			app_copy(tmp, "sense_pir", "hw_num", config=[
+				(r"^#define OUT_GEN_HW_NUM_OUT 2$", "#define OUT_GEN_HW_NUM_OUT 3"),
+				(r"^#define GPIOTE_CH_USED_OUT_GEN_1 1$", "#define GPIOTE_CH_USED_OUT_GEN_1 6")]),
+			"GPIOTE channel 6 used by both GPIOTE_CH_USED_OUT_GEN_1 and"
+			" GPIOTE_CH_USED_OUT_GEN_2 (default in out_pattern_gen.h)"),
+		("by a literal channel",
+			app_copy(tmp, "sense_pir", "literal", makefile=[
+				(r"^(C_SRC = main.c)$", r"\1 extra.c")],
+				files={"extra.c": "void extra (void)\n{\n    NRF_PPI->CH[5].EEP = 0;\n}\n"}),
+			"PPI channel 5 used by both PPI_CH_USED_OUT_GEN_0 and NRF_PPI->CH[5] in extra.c"),
+	]
+	for name, path, want in injected:
+		status, out = run_check(path)
+		check("collision %s found" % name, status == 1 and want in out, out)
+	print("%d failed" % fails)
+finally:
+	shutil.rmtree(tmp)
+sys.exit(1 if fails else 0)
@@ -0,0 +1,1522 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Conformance of the rf_comm backends, the CC112x one of ti_radio_lib, the
+# S2-LP one of st_radio_lib and the CC1101 one of cc1101_radio_lib, to the
+# rf_comm API. Each rf_comm.c is built for the host with a stub of its SPI
+# layer which calls a register model of the radio in Python, and of ms_timer
+# which runs on a simulated clock. Two copies of each build are loaded as two
+# nodes on a simulated air, so that the same send and receive tests run on
+# all the backends. The models keep the registers, FIFOs, commands and
+# states that rf_comm uses, raise the GPIO edges of the radio, which call the
+# GPIOTE handler of the node through the NRF_GPIOTE registers, and put the
+# frames on the air with the frequency, bit rate, power and preamble decoded
+# from the registers.
+#
+# The sleep test checks that the registers after a sleep and a wake are as
+# after rf_comm_radio_init, with the configuration kept in the radio, and
+# prints the SPI bytes and the time of a sleep and wake cycle, from the
+# bytes at 125 kHz and the delays of the driver. The frequency offset test
+# gives the CC112x or CC1101 of a node a crystal off by some ppm, checks the
+# estimate of the offset and its correction in FREQOFF or FSCTRL0, and that
+# the gateway with a narrow RX filter then gets the packets of the node. The
+# CC1101 model also drains the TX FIFO of 64 bytes as the frame is sent, so
+# a long packet needs the refills of the driver.
+#
+# The GPIOTE, GPIO and NVIC registers are at fixed addresses, so the pages
+# of the nRF52 peripherals are mapped at them, which needs Linux. Needs a
+# host C compiler, run from the root of the repository.
+# Usage:
+#   rf_comm_conformance.py [--backend ti|st|cc1101|all] [--bitrate 1200] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import heapq
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="rf_comm backend conformance")
+parser.add_argument("--backend", default="all", choices=["ti", "st", "cc1101", "all"],
+		help="ti_radio_lib (CC112x), st_radio_lib (S2-LP), cc1101_radio_lib or all")
+parser.add_argument("--bitrate", type=int, default=1200, help="bit rate in bps")
+parser.add_argument("--freq", type=int, default=866000, help="center frequency in kHz")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform", "codebase/rf_lib"]
+
+# SPI layers of the backends and ms_timer, calling the host
+STUB = r"""
+#include <stdint.h>
+typedef uint32_t (*host_spi_t) (uint32_t op, uint32_t addr, uint8_t * p, uint32_t len);
+typedef void (*host_timer_t) (uint32_t id, uint64_t ticks, void (*h) (void));
+static host_spi_t host_spi;
+static host_timer_t host_timer;
+/* Total of the busy waits of the driver */
+uint32_t host_delay_us;
+void host_set (host_spi_t spi, host_timer_t timer)
+{
+	host_spi = spi; host_timer = timer;
+}
+#if defined(HOST_TI)
+/* op is the access type, or 0x100 for a strobe. addr has the extended
+ * address in bits 15:8 */
+uint8_t trx8BitRegAccess (uint8_t type, uint8_t addr, uint8_t * p, uint16_t len)
+{
+	return host_spi (type, addr, p, len);
+}
+uint8_t trx16BitRegAccess (uint8_t type, uint8_t ext, uint8_t addr, uint8_t * p, uint8_t len)
+{
+	return host_spi (type, (ext << 8) | addr, p, len);
+}
+uint8_t trxSpiCmdStrobe (uint8_t cmd)
+{
+	return host_spi (0x100, cmd, 0, 0);
+}
+#elif defined(HOST_CC1101)
+/* op is the read bit of the header, or 0x100 for a strobe */
+uint8_t cc1101_spi_write (uint8_t addr, uint8_t * p, uint32_t len)
+{
+	return host_spi (0x00, addr, p, len);
+}
+uint8_t cc1101_spi_read (uint8_t addr, uint8_t * p, uint32_t len)
+{
+	return host_spi (0x80, addr, p, len);
+}
+uint8_t cc1101_spi_strobe (uint8_t cmd)
+{
+	return host_spi (0x100, cmd, 0, 0);
+}
+#else
+/* op is the header byte */
+uint16_t s2lp_spi_write (uint8_t addr, uint8_t * p, uint32_t len)
+{
+	return host_spi (0x00, addr, p, len);
+}
+uint16_t s2lp_spi_read (uint8_t addr, uint8_t * p, uint32_t len)
+{
+	return host_spi (0x01, addr, p, len);
+}
+uint16_t s2lp_spi_cmd (uint8_t cmd)
+{
+	return host_spi (0x80, cmd, 0, 0);
+}
+#endif
+#if defined(HOST_TI) || defined(HOST_CC1101)
+/* 0x200 for the wait with CSn low till the chip is ready */
+uint32_t rf_spi_wait_ready (uint32_t timeout_us)
+{
+	return host_spi (0x200, 0, 0, timeout_us);
+}
+#endif
+void hal_nop_delay_us (uint32_t us) { host_delay_us += us; }
+void hal_nop_delay_ms (uint32_t ms) { host_delay_us += 1000 * ms; }
+void ms_timer_start (uint32_t id, uint32_t mode, uint64_t ticks, void (*h) (void))
+{
+	host_timer (id, ticks, h);
+}
+void ms_timer_stop (uint32_t id)
+{
+	host_timer (id, 0, 0);
+}
+uint32_t random_num_below (uint32_t bound) { return 0; }
+"""
+
+NOP_DELAY_H = "#include <stdint.h>\nvoid hal_nop_delay_us (uint32_t us);\nvoid hal_nop_delay_ms (uint32_t ms);\n"
+
+MS_TIMER_FREQ = 32768
+# Clock of the SPI to the radio, hal_spim at HAL_SPIM_FREQ_125K
+SPI_FREQ = 125000
+
+# nRF52 peripherals used by rf_comm
+GPIOTE_BASE = 0x40006000
+GPIO_BASE = 0x50000000
+SCS_BASE = 0xE000E000
+GPIOTE_EVENTS_IN = 0x100
+GPIOTE_INTEN = 0x304
+GPIOTE_CONFIG = 0x510
+PAGE = 0x1000
+
+# Pins of the radio given to rf_comm_radio_init
+PIN_GPIO0 = 10
+PIN_GPIO2 = 11
+
+SPI_CB = ctypes.CFUNCTYPE(ctypes.c_uint32, ctypes.c_uint32, ctypes.c_uint32,
+		ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32)
+TIMER_CB = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_uint64, ctypes.c_void_p)
+HANDLER = ctypes.CFUNCTYPE(None, ctypes.c_uint32)
+VOID_FN = ctypes.CFUNCTYPE(None)
+
+class RxPkt(ctypes.Structure):
+	_fields_ = [("p_data", ctypes.POINTER(ctypes.c_uint8)), ("len", ctypes.c_uint8),
+			("rssi", ctypes.c_int8), ("lqi", ctypes.c_uint8), ("crc_ok", ctypes.c_bool)]
+
+PKT_HANDLER = ctypes.CFUNCTYPE(None, ctypes.POINTER(RxPkt))
+
+class Radio(ctypes.Structure):
+	_fields_ = [("center_freq", ctypes.c_uint32), ("freq_dev", ctypes.c_uint32),
+			("bitrate", ctypes.c_uint32), ("tx_power", ctypes.c_int32),
+			("rx_bandwidth", ctypes.c_uint32), ("irq_priority", ctypes.c_int),
+			("tx_done", HANDLER), ("rx_done", HANDLER), ("tx_failed", HANDLER),
+			("rx_failed", HANDLER)]
+
+class Hw(ctypes.Structure):
+	_fields_ = [(n, ctypes.c_uint32) for n in ("reset", "gpio0", "gpio1", "gpio2", "gpio3",
+			"hgm", "lna", "pa")]
+
+class PktConfig(ctypes.Structure):
+	_fields_ = [("max_len", ctypes.c_uint8), ("app_id", ctypes.c_uint8),
+			("dev_id", ctypes.c_uint16)]
+
+class Csma(ctypes.Structure):
+	_fields_ = [("max_attempts", ctypes.c_uint32), ("min_backoff_ms", ctypes.c_uint32),
+			("max_backoff_ms", ctypes.c_uint32), ("cca_thr_dbm", ctypes.c_int32)]
+
+class CsmaStats(ctypes.Structure):
+	_fields_ = [("last_attempts", ctypes.c_uint32), ("sent", ctypes.c_uint32),
+			("busy", ctypes.c_uint32), ("dropped", ctypes.c_uint32)]
+
+def map_peripherals():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (GPIOTE_BASE, GPIO_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+def build(tmp, backend):
+	cc = os.environ.get("CC", "cc")
+	lib_dir = "codebase/rf_lib/%s_radio_lib" % backend
+	with open(os.path.join(tmp, "stub.c"), "w") as f:
+		f.write(STUB)
+	# The delay of the HAL is in ARM assembly
+	with open(os.path.join(tmp, "hal_nop_delay.h"), "w") as f:
+		f.write(NOP_DELAY_H)
+	flags = ["-shared", "-fPIC", "-std=gnu11", "-w", "-U__linux__", "-U__linux", "-Ulinux",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832_XXAA", "-DBOARD_SENSEELE_PCB_REV2",
+			"-DMS_TIMER_FREQ=%d" % MS_TIMER_FREQ, "-DHOST_%s" % backend.upper(),
+			"-iquote", tmp] + ["-I" + i for i in INC + [lib_dir]]
+	so = os.path.join(tmp, "rf_comm_%s.so" % backend)
+	subprocess.check_call([cc] + flags + [os.path.join(lib_dir, "rf_comm.c"),
+			os.path.join(tmp, "stub.c"), "-o", so])
+	# A copy for each node, so that each has its own globals
+	paths = []
+	for n in ("a", "b"):
+		paths.append(os.path.join(tmp, "rf_comm_%s_%s.so" % (backend, n)))
+		shutil.copy(so, paths[-1])
+	return paths
+
+class Sim(object):
+	"""Simulated clock in ms with the events of the air and the timers"""
+	def __init__(self):
+		self.now = 0.0
+		self.events = []
+		self.seq = 0
+		self.nodes = []
+		self.frames = []
+		self.noise_dbm = -120
+		self.link_dbm = -70
+		self.corrupt_next = False
+
+	def at(self, t, fn):
+		self.seq += 1
+		heapq.heappush(self.events, (t, self.seq, fn))
+
+	def dispatch(self):
+		busy = True
+		while busy:
+			busy = False
+			for node in self.nodes:
+				if node.edges:
+					node.isr(node.edges.pop(0))
+					busy = True
+
+	def run(self, ms):
+		end = self.now + ms
+		self.dispatch()
+		while self.events and self.events[0][0] <= end:
+			t, s, fn = heapq.heappop(self.events)
+			self.now = max(self.now, t)
+			fn()
+			self.dispatch()
+		self.now = end
+
+	def transmit(self, sender, freq, bitrate, pwr, start, preamble_ms, payload, sync_bits=32):
+		"""A frame with its length byte before the payload and a 16 bit CRC"""
+		frame = {"sender": sender, "freq": freq, "bitrate": bitrate, "pwr": pwr,
+				"start": start, "sync": start + preamble_ms,
+				"payload": bytes(payload), "crc_ok": not self.corrupt_next, "aborted": False}
+		frame["end"] = frame["sync"] + (sync_bits + 8 * (len(payload) + 3)) * 1000.0 / bitrate
+		self.corrupt_next = False
+		self.frames.append(frame)
+		for node in self.nodes:
+			if node.model is not sender:
+				self.at(max(frame["sync"], self.now), lambda m=node.model: m.frame_sync(frame))
+				self.at(frame["end"], lambda m=node.model: m.frame_end(frame))
+		self.at(frame["end"], lambda: sender.tx_end(frame))
+		return frame
+
+	def channel_dbm(self, model):
+		"""The RSSI at a receiver from the noise and the frames on air"""
+		rssi = self.noise_dbm
+		for f in self.frames:
+			if (f["sender"] is not model) and (f["aborted"] == False) \
+					and (f["start"] <= self.now < f["end"]) and model.matches(f):
+				rssi = max(rssi, self.link_dbm)
+		return rssi
+
+class Cc112x(object):
+	"""Registers, FIFOs and strobes of the CC112x used by ti_radio_lib"""
+	IDLE, RX, TX, RXFIFO_ERR = 0, 1, 2, 6
+	XTAL = 32e6
+	PREAMBLE_BYTES = 4
+	FIFO_THR = 64
+	PARTNUMBER = 0x48
+	FREQOFF_STEP = XTAL / 2**20
+	OFFSET_PPM = 10
+
+	def __init__(self, sim, node):
+		self.sim, self.node = sim, node
+		# Calibrations of the FS and accesses without waiting for the chip
+		# after SPWD
+		self.cals = self.sleep_accesses = 0
+		# Error of the crystal, and if frames are received only within the
+		# RX filter bandwidth instead of within 1 kHz
+		self.ppm = 0.0
+		self.bw_check = False
+		self.reset()
+
+	def reset(self):
+		self.regs = [0] * 256
+		self.ext = [0] * 256
+		self.state = self.IDLE
+		self.txfifo, self.rxfifo = [], []
+		self.marc_sts1 = self.marc_sts0 = 0
+		self.wor = self.sleeping = False
+		self.preamble_start = None
+		self.tx_frame = self.rx_frame = None
+		self.freqoff_est = 0
+
+	# Decoding of the registers
+	def freq(self):
+		"""FREQ and FREQOFF, in steps of f_xosc/(4 * 2^18)"""
+		word = (self.ext[0x0C] << 16) | (self.ext[0x0D] << 8) | self.ext[0x0E]
+		off = ctypes.c_int16((self.ext[0x0A] << 8) | self.ext[0x0B]).value
+		return (4 * word + off) * self.XTAL * (1 + self.ppm * 1e-6) / 2**18 / 4
+
+	def freqoff_reg(self):
+		return ctypes.c_int16((self.ext[0x0A] << 8) | self.ext[0x0B]).value
+
+	def set_freq(self, f_hz):
+		"""The frequency of the FREQ word rf_comm_set_freq writes, with
+		f_xosc/2^16 truncated as in the firmware in the field"""
+		return (int(f_hz) * 4 // (int(self.XTAL) >> 16)) * self.XTAL / 2**16 / 4
+
+	def bw(self):
+		return self.XTAL / (8 * 20 * max(1, self.regs[0x11] & 0x3F))
+
+	def bitrate(self):
+		e = self.regs[0x14] >> 4
+		m = ((self.regs[0x14] & 0x0F) << 16) | (self.regs[0x15] << 8) | self.regs[0x16]
+		if e == 0:
+			return m * self.XTAL / 2**38
+		return (2**20 + m) * 2.0**e / 2**39 * self.XTAL
+
+	def pwr(self):
+		return ((self.regs[0x2B] & 0x3F) + 1) / 2.0 - 18
+
+	def cca_thr(self):
+		return ctypes.c_int8(self.regs[0x18]).value - 99
+
+	def wor_interval(self):
+		event0 = (self.regs[0x24] << 8) | self.regs[0x25]
+		res = self.regs[0x22] >> 6
+		return event0 * 2.0**(5 * res) * 1000.0 / (self.XTAL / 1000)
+
+	def matches(self, f):
+		df = abs(f["freq"] - self.freq())
+		if self.bw_check:
+			in_band = df + f["bitrate"] / 2.0 <= self.bw() / 2
+		else:
+			in_band = df < 1000
+		return in_band and abs(f["bitrate"] - self.bitrate()) < 0.01 * f["bitrate"]
+
+	def snapshot(self):
+		return list(self.regs), list(self.ext)
+
+	def spi_bytes(self, op, addr, n):
+		"""Header bytes, with the extended address, and the data bytes"""
+		if op == 0x200:
+			return 0
+		if op == 0x100:
+			return 1
+		return (2 if addr & 0xFF00 else 1) + n
+
+	def spi(self, op, addr, p, n):
+		if op == 0x200:
+			# CSn low wakes the chip, SO low when ready
+			self.sleeping = False
+			return 0
+		if self.sleeping:
+			self.sleep_accesses += 1
+		if op == 0x100:
+			self.strobe(addr)
+		elif addr & 0xFF00:
+			for i in range(n):
+				a = (addr & 0xFF) + (i if op & 0x40 else 0)
+				if op & 0x80:
+					p[i] = self.ext_read(a)
+				else:
+					self.ext[a] = p[i]
+		elif addr == 0x3F:
+			for i in range(n):
+				if op & 0x80:
+					p[i] = self.rxfifo.pop(0) if self.rxfifo else 0
+				else:
+					self.txfifo.append(p[i])
+			if (op & 0x80) == 0:
+				self.tx_fifo_written()
+		else:
+			for i in range(n):
+				a = addr + (i if op & 0x40 else 0)
+				if op & 0x80:
+					p[i] = self.regs[a]
+				else:
+					self.regs[a] = p[i]
+		return self.state << 4
+
+	def ext_read(self, a):
+		if a == 0x94:
+			v, self.marc_sts1 = self.marc_sts1, 0
+			return v
+		if a == 0x95:
+			return self.marc_sts0
+		if a == 0x71:
+			return (self.sim.channel_dbm(self) + 99) & 0xFF
+		if a == 0x72:
+			cs = 0x04 if self.sim.channel_dbm(self) >= self.cca_thr() else 0
+			return 0x03 | cs
+		if a == 0xD7:
+			return len(self.rxfifo)
+		if a == 0x77:
+			return (self.freqoff_est >> 8) & 0xFF
+		if a == 0x78:
+			return self.freqoff_est & 0xFF
+		if a == 0x8F:
+			return self.PARTNUMBER
+		return self.ext[a]
+
+	def tx_abort(self):
+		if self.tx_frame is not None:
+			self.tx_frame["aborted"] = True
+			self.tx_frame = None
+		self.preamble_start = None
+
+	def strobe(self, cmd):
+		if cmd == 0x30:
+			self.tx_abort()
+			self.reset()
+		elif cmd == 0x36:
+			self.tx_abort()
+			self.state, self.wor, self.sleeping = self.IDLE, False, False
+			self.rx_frame = None
+		elif cmd == 0x34:
+			self.state = self.RX
+		elif cmd == 0x35:
+			self.tx_strobe()
+		elif cmd == 0x38:
+			self.state, self.wor = self.IDLE, True
+		elif cmd == 0x33:
+			self.cals += 1
+		elif cmd == 0x39:
+			self.sleeping = True
+		elif cmd == 0x3A:
+			self.rxfifo = []
+			if self.state == self.RXFIFO_ERR:
+				self.state = self.IDLE
+		elif cmd == 0x3B:
+			self.txfifo = []
+
+	def tx_strobe(self):
+		# TXONCCA from RX, RSSI below the threshold and not receiving
+		if self.state == self.RX and (self.regs[0x26] & 0x1C) != 0 \
+				and (self.sim.channel_dbm(self) >= self.cca_thr() or self.rx_frame):
+			self.marc_sts0 |= 0x08
+			return
+		self.marc_sts0 &= ~0x08
+		self.state = self.TX
+		self.rx_frame = None
+		self.preamble_start = self.sim.now
+		if self.txfifo:
+			self.tx_fifo_written()
+
+	def tx_fifo_written(self):
+		if self.state != self.TX or self.preamble_start is None or not self.txfifo:
+			return
+		length = self.txfifo[0]
+		payload = self.txfifo[1:1 + length]
+		self.txfifo = self.txfifo[1 + length:]
+		preamble = self.sim.now - self.preamble_start \
+				+ self.PREAMBLE_BYTES * 8 * 1000.0 / self.bitrate()
+		self.tx_frame = self.sim.transmit(self, self.freq(), self.bitrate(), self.pwr(),
+				self.preamble_start, preamble, payload)
+		self.preamble_start = None
+
+	def tx_end(self, frame):
+		if frame is not self.tx_frame:
+			return
+		self.tx_frame = None
+		self.state = self.IDLE
+		self.marc_sts1 = 0x40
+		self.node.edge(PIN_GPIO2, False)
+
+	def frame_sync(self, f):
+		if self.sleeping or f["aborted"] or not self.matches(f):
+			return
+		if self.state == self.RX:
+			self.rx_frame = f
+		elif self.wor and self.state == self.IDLE and (f["sync"] - f["start"]) >= self.wor_interval():
+			self.state = self.RX
+			self.rx_frame = f
+
+	def frame_end(self, f):
+		if f is not self.rx_frame or f["aborted"] or self.state != self.RX:
+			return
+		self.rx_frame = None
+		if self.wor and not f["crc_ok"]:
+			# Back to sniffing on a bad packet
+			self.state = self.IDLE
+			return
+		est = int(round((f["freq"] - self.freq()) * 4 * 2**18 / self.XTAL))
+		self.freqoff_est = max(-32768, min(32767, est))
+		data = [len(f["payload"])] + list(f["payload"]) \
+				+ [(self.sim.link_dbm + 99) & 0xFF, (0x80 if f["crc_ok"] else 0) | 10]
+		if len(self.rxfifo) + len(data) > 128:
+			self.state = self.RXFIFO_ERR
+			return
+		room = self.FIFO_THR - len(self.rxfifo)
+		if len(data) > room:
+			self.rxfifo += data[:room]
+			self.node.edge(PIN_GPIO0, True)
+			self.sim.dispatch()
+			data = data[room:]
+		self.rxfifo += data
+		self.marc_sts1 = 0x80
+		self.node.edge(PIN_GPIO2, False)
+
+class S2lp(object):
+	"""Registers, FIFOs, commands and IRQs of the S2-LP used by st_radio_lib"""
+	READY, STANDBY, SLEEP, RX, TX = 0x00, 0x02, 0x03, 0x30, 0x5C
+	XTAL = 50e6
+	PARTNUMBER = 0x03
+	RESET = {0x00: 0x0A, 0x10: 0x77, 0x11: 0x03, 0x13: 0x23, 0x14: 0xC8, 0x18: 0x28,
+			0x2B: 0x00, 0x2C: 0x10, 0x39: 0x40, 0x3B: 0x08, 0x40: 0x40, 0x46: 0x01,
+			0x62: 0x47, 0x63: 0x03, 0x64: 0x8A, 0x65: 0xD0, 0x6C: 0x6C, 0x6D: 0x30,
+			0x79: 0x42}
+
+	def __init__(self, sim, node):
+		self.sim, self.node = sim, node
+		self.reset()
+
+	def reset(self):
+		self.regs = [0] * 256
+		for a, v in self.RESET.items():
+			self.regs[a] = v
+		self.state = self.READY
+		self.txfifo, self.rxfifo = [], []
+		self.irq = 0
+		self.ldc = False
+		self.tx_frame = self.rx_frame = None
+		self.cca_gen = 0
+		self.last_rx = (0, 0, 0)
+
+	def f_dig(self):
+		return self.XTAL if self.regs[0x6C] & 0x10 else self.XTAL / 2
+
+	def freq(self):
+		synt = ((self.regs[0x05] & 0x0F) << 24) | (self.regs[0x06] << 16) \
+				| (self.regs[0x07] << 8) | self.regs[0x08]
+		band = 8 if self.regs[0x05] & 0x10 else 4
+		return self.XTAL * synt / (band * 2.0**19)
+
+	def bitrate(self):
+		m = (self.regs[0x0E] << 8) | self.regs[0x0F]
+		e = self.regs[0x10] & 0x0F
+		if e == 0:
+			return self.f_dig() * m / 2.0**32
+		return self.f_dig() * (65536 + m) * 2.0**e / 2.0**33
+
+	def pwr(self):
+		idx = self.regs[0x62] & 0x07
+		return (29 - self.regs[0x5A + 7 - idx]) / 2.0
+
+	def cca_thr(self):
+		return self.regs[0x18] - 146
+
+	def preamble_bits(self):
+		return 2 * (((self.regs[0x2B] & 0x03) << 8) | self.regs[0x2C])
+
+	def wut_ms(self):
+		f_rco = self.f_dig() / 750
+		return (self.regs[0x49] + 1) * (self.regs[0x48] + 1) * 2**(self.regs[0x39] & 0x03) \
+				* 1000.0 / f_rco
+
+	def matches(self, f):
+		return abs(f["freq"] - self.freq()) < 1000 \
+				and abs(f["bitrate"] - self.bitrate()) < 0.01 * f["bitrate"]
+
+	def raise_irq(self, bits):
+		mask = (self.regs[0x50] << 24) | (self.regs[0x51] << 16) | (self.regs[0x52] << 8) \
+				| self.regs[0x53]
+		was_low = (self.irq & mask) != 0
+		self.irq |= bits
+		# nIRQ on GPIO0 goes low on the first event
+		if (self.regs[0x00] & 0xF8) == 0 and not was_low and (self.irq & mask):
+			self.node.edge(PIN_GPIO0, False)
+
+	def snapshot(self):
+		return list(self.regs)
+
+	def spi_bytes(self, op, addr, n):
+		"""Header and address or command, then the data bytes"""
+		return 2 + n
+
+	def spi(self, op, addr, p, n):
+		status = ((self.state << 1) & 0xFF)
+		if op == 0x80:
+			self.command(addr)
+		elif addr == 0xFF:
+			for i in range(n):
+				if op & 0x01:
+					p[i] = self.rxfifo.pop(0) if self.rxfifo else 0
+				else:
+					self.txfifo.append(p[i])
+			if len(self.txfifo) > 128:
+				self.txfifo = self.txfifo[:128]
+				self.raise_irq(0x20)
+		elif op & 0x01:
+			values = [self.reg_read(addr + i) for i in range(n)]
+			if addr <= 0xFA < addr + n:
+				self.irq = 0
+			for i in range(n):
+				p[i] = values[i]
+		else:
+			for i in range(n):
+				self.regs[addr + i] = p[i]
+		return status
+
+	def reg_read(self, a):
+		if a == 0x8E:
+			return self.state << 1
+		if a == 0x8F:
+			return len(self.txfifo)
+		if a == 0x90:
+			return len(self.rxfifo)
+		if a == 0xA0:
+			return self.last_rx[2]
+		if a == 0xA2:
+			return self.last_rx[1]
+		if a == 0xA4:
+			return self.last_rx[0] >> 8
+		if a == 0xA5:
+			return self.last_rx[0] & 0xFF
+		if a == 0xEF:
+			return (self.sim.channel_dbm(self) + 146) & 0xFF
+		if a == 0xF0:
+			return self.PARTNUMBER
+		if 0xFA <= a <= 0xFD:
+			return (self.irq >> (8 * (0xFD - a))) & 0xFF
+		return self.regs[a]
+
+	def tx_abort(self):
+		if self.tx_frame is not None:
+			self.tx_frame["aborted"] = True
+			self.tx_frame = None
+		self.cca_gen += 1
+
+	def command(self, cmd):
+		if cmd == 0x70:
+			self.tx_abort()
+			self.reset()
+		elif cmd == 0x67:
+			if self.state in (self.RX, self.TX) or self.ldc:
+				self.tx_abort()
+				self.state, self.ldc, self.rx_frame = self.READY, False, None
+		elif cmd == 0x62:
+			if self.state not in (self.RX, self.TX):
+				self.state, self.ldc = self.READY, False
+		elif cmd == 0x63:
+			if self.state == self.READY:
+				self.state = self.STANDBY
+		elif cmd == 0x64:
+			if self.state == self.READY:
+				self.state = self.SLEEP
+				if (self.regs[0x79] & 0x01) == 0:
+					self.rxfifo, self.txfifo = [], []
+		elif cmd == 0x71:
+			self.rxfifo = []
+		elif cmd == 0x72:
+			self.txfifo = []
+		elif cmd == 0x61:
+			if self.regs[0x3A] & 0x80:
+				# LDC, asleep till the wake up timer
+				self.ldc, self.state = True, self.SLEEP
+			else:
+				self.state = self.RX
+		elif cmd == 0x60:
+			self.tx_command()
+
+	def tx_command(self):
+		if self.regs[0x3A] & 0x04:
+			# One CCA of CCA_PERIOD bit periods, with no backoff of the radio
+			self.state = self.RX
+			self.cca_gen += 1
+			gen = self.cca_gen
+			period = 64 << (self.regs[0x4E] & 0x03)
+			self.sim.at(self.sim.now + period * 1000.0 / self.bitrate(),
+					lambda: self.cca_end(gen))
+			return
+		self.tx_go()
+
+	def cca_end(self, gen):
+		if gen != self.cca_gen or self.state != self.RX:
+			return
+		if self.sim.channel_dbm(self) >= self.cca_thr() or self.rx_frame:
+			self.state = self.READY
+			self.raise_irq(0x800)
+		else:
+			self.tx_go()
+
+	def tx_go(self):
+		length = (self.regs[0x31] << 8) | self.regs[0x32]
+		if len(self.txfifo) < length:
+			self.raise_irq(0x20)
+			self.state = self.READY
+			return
+		payload = self.txfifo[:length]
+		self.txfifo = self.txfifo[length:]
+		self.state = self.TX
+		self.rx_frame = None
+		preamble = self.preamble_bits() * 1000.0 / self.bitrate()
+		self.tx_frame = self.sim.transmit(self, self.freq(), self.bitrate(), self.pwr(),
+				self.sim.now, preamble, payload, sync_bits=(self.regs[0x2B] >> 2) & 0x3F)
+
+	def tx_end(self, frame):
+		if frame is not self.tx_frame:
+			return
+		self.tx_frame = None
+		self.state = self.READY
+		self.raise_irq(0x04)
+
+	def frame_sync(self, f):
+		if f["aborted"] or not self.matches(f):
+			return
+		if self.state == self.RX:
+			self.rx_frame = f
+		elif self.ldc and self.state == self.SLEEP \
+				and (f["sync"] - f["start"]) >= self.wut_ms():
+			self.state = self.RX
+			self.rx_frame = f
+
+	def frame_end(self, f):
+		if f is not self.rx_frame or f["aborted"] or self.state != self.RX:
+			return
+		self.rx_frame = None
+		if self.ldc or (self.regs[0x3B] & 0x02) == 0:
+			self.state = self.SLEEP if self.ldc else self.READY
+		if not f["crc_ok"] and (self.regs[0x40] & 0x01):
+			self.raise_irq(0x02 | 0x10)
+			return
+		data = list(f["payload"])
+		if len(self.rxfifo) + len(data) > 128:
+			self.raise_irq(0x40)
+			return
+		thr = self.regs[0x3C]
+		if len(self.rxfifo) + len(data) > thr:
+			split = max(0, thr + 1 - len(self.rxfifo))
+			self.rxfifo += data[:split]
+			data = data[split:]
+			self.raise_irq(0x200)
+			self.sim.dispatch()
+		self.rxfifo += data
+		sqi = 64 - 10
+		self.last_rx = (len(f["payload"]), (self.sim.link_dbm + 146) & 0xFF, 0x80 | sqi)
+		self.raise_irq(0x01)
+
+class Cc1101(object):
+	"""Registers, FIFOs and strobes of the CC1101 used by cc1101_radio_lib"""
+	IDLE, RX, TX, RXFIFO_ERR, TXFIFO_ERR = 0, 1, 2, 6, 7
+	MARCSTATE = {IDLE: 0x01, RX: 0x0D, TX: 0x13, RXFIFO_ERR: 0x11, TXFIFO_ERR: 0x16}
+	XTAL = 26e6
+	PREAMBLE_BYTES = 4
+	FIFO_SIZE = 64
+	PARTNUMBER = 0x14
+	FREQOFF_STEP = XTAL / 2**14
+	# A bigger error than for the CC112x, as the RX filter is at least 58 kHz
+	OFFSET_PPM = 40
+	# PATABLE values in the 868 MHz band
+	PA_TABLE = {0x03: -30, 0x17: -20, 0x1D: -15, 0x26: -10, 0x37: -6, 0x50: 0, 0x86: 5,
+			0xCD: 7, 0xC5: 10, 0xC0: 12}
+	PWR_LEVELS = sorted(PA_TABLE.values())
+
+	def __init__(self, sim, node):
+		self.sim, self.node = sim, node
+		self.cals = self.sleep_accesses = 0
+		self.ppm = 0.0
+		self.bw_check = False
+		self.reset()
+
+	def reset(self):
+		self.regs = [0] * 0x30
+		self.patable = [0] * 8
+		self.state = self.IDLE
+		self.txfifo, self.rxfifo = [], []
+		self.wor = self.sleeping = False
+		self.preamble_start = None
+		self.tx_frame = self.rx_frame = None
+		self.freqest = 0
+		self.crc_ok = False
+		self.gdo0 = False
+
+	# Decoding of the registers
+	def freq(self):
+		"""FREQ in steps of f_xosc/2^16 and FSCTRL0 in steps of f_xosc/2^14"""
+		word = (self.regs[0x0D] << 16) | (self.regs[0x0E] << 8) | self.regs[0x0F]
+		return (word + 4 * self.freqoff_reg()) * self.XTAL * (1 + self.ppm * 1e-6) / 2**16
+
+	def freqoff_reg(self):
+		return ctypes.c_int8(self.regs[0x0C]).value
+
+	def bw(self):
+		e, m = self.regs[0x10] >> 6, (self.regs[0x10] >> 4) & 0x03
+		return self.XTAL / (8 * (4 + m) * 2**e)
+
+	def bitrate(self):
+		e, m = self.regs[0x10] & 0x0F, self.regs[0x11]
+		return (256 + m) * 2.0**e * self.XTAL / 2**28
+
+	def pwr(self):
+		return self.PA_TABLE.get(self.patable[0], -99)
+
+	def wor_interval(self):
+		event0 = (self.regs[0x1E] << 8) | self.regs[0x1F]
+		res = self.regs[0x20] & 0x03
+		return event0 * 750 * 2.0**(5 * res) * 1000.0 / self.XTAL
+
+	def matches(self, f):
+		df = abs(f["freq"] - self.freq())
+		if self.bw_check:
+			in_band = df + f["bitrate"] / 2.0 <= self.bw() / 2
+		else:
+			in_band = df < 1000
+		return in_band and abs(f["bitrate"] - self.bitrate()) < 0.01 * f["bitrate"]
+
+	def gdo0_update(self):
+		"""GDO0 for the threshold of the RX or TX FIFO, with the edges"""
+		cfg, code = self.regs[0x02], self.regs[0x03] & 0x0F
+		if (cfg & 0x3F) == 0x00:
+			level = len(self.rxfifo) >= 4 * (code + 1)
+		elif (cfg & 0x3F) == 0x02:
+			level = len(self.txfifo) >= 61 - 4 * code
+		else:
+			level = False
+		level = level != bool(cfg & 0x40)
+		if level != self.gdo0:
+			self.gdo0 = level
+			self.node.edge(PIN_GPIO0, level)
+
+	def snapshot(self):
+		return list(self.regs), list(self.patable)
+
+	def spi_bytes(self, op, addr, n):
+		"""Header byte, then the data bytes"""
+		if op == 0x200:
+			return 0
+		if op == 0x100:
+			return 1
+		return 1 + n
+
+	def spi(self, op, addr, p, n):
+		if op == 0x200:
+			# CSn low wakes the chip, SO low when ready
+			self.sleeping = False
+			return 0
+		if self.sleeping:
+			self.sleep_accesses += 1
+		if op == 0x100:
+			self.strobe(addr)
+		elif addr == 0x3F:
+			for i in range(n):
+				if op & 0x80:
+					p[i] = self.rxfifo.pop(0) if self.rxfifo else 0
+				else:
+					self.txfifo.append(p[i])
+			if (op & 0x80) == 0:
+				self.txfifo = self.txfifo[:self.FIFO_SIZE]
+				self.tx_fifo_written()
+		elif addr == 0x3E:
+			for i in range(min(n, 8)):
+				if op & 0x80:
+					p[i] = self.patable[i]
+				else:
+					self.patable[i] = p[i]
+		elif op & 0x80:
+			for i in range(n):
+				p[i] = self.reg_read(addr + i)
+		else:
+			for i in range(n):
+				self.regs[addr + i] = p[i]
+		self.gdo0_update()
+		return self.state << 4
+
+	def reg_read(self, a):
+		if a < 0x30:
+			return self.regs[a]
+		if a == 0x31:
+			return self.PARTNUMBER
+		if a == 0x32:
+			return self.freqest & 0xFF
+		if a == 0x34:
+			return ((self.sim.channel_dbm(self) + 74) * 2) & 0xFF
+		if a == 0x35:
+			return self.MARCSTATE[self.state]
+		if a == 0x38:
+			sfd = 0x08 if (self.state == self.RX and self.rx_frame) else 0
+			return (0x80 if self.crc_ok else 0) | sfd
+		if a == 0x3A:
+			return len(self.txfifo) | (0x80 if self.state == self.TXFIFO_ERR else 0)
+		if a == 0x3B:
+			return len(self.rxfifo) | (0x80 if self.state == self.RXFIFO_ERR else 0)
+		return 0
+
+	def tx_abort(self):
+		if self.tx_frame is not None:
+			self.tx_frame["aborted"] = True
+			self.tx_frame = None
+		self.preamble_start = None
+
+	def strobe(self, cmd):
+		if cmd == 0x30:
+			self.tx_abort()
+			self.reset()
+		elif cmd == 0x36:
+			self.tx_abort()
+			self.state, self.wor, self.sleeping = self.IDLE, False, False
+			self.rx_frame = None
+		elif cmd == 0x34:
+			self.state = self.RX
+		elif cmd == 0x35:
+			self.tx_strobe()
+		elif cmd == 0x38:
+			self.state, self.wor = self.IDLE, True
+		elif cmd == 0x33:
+			self.cals += 1
+		elif cmd == 0x39:
+			# Only the test registers and the PATABLE but the first entry
+			# are lost, with the FIFOs
+			self.sleeping = True
+			for a in range(0x29, 0x2F):
+				self.regs[a] = 0
+			self.patable[1:] = [0] * 7
+			self.rxfifo, self.txfifo = [], []
+		elif cmd == 0x3A:
+			# Only in IDLE or RXFIFO_OVERFLOW
+			if self.state in (self.IDLE, self.RXFIFO_ERR):
+				self.rxfifo, self.state = [], self.IDLE
+		elif cmd == 0x3B:
+			if self.state in (self.IDLE, self.TXFIFO_ERR):
+				self.txfifo, self.state = [], self.IDLE
+
+	def tx_strobe(self):
+		# From RX, gated on a packet being received with CCA_MODE 2
+		if self.state == self.RX and (self.regs[0x17] & 0x30) == 0x20 and self.rx_frame:
+			return
+		self.state = self.TX
+		self.rx_frame = None
+		self.preamble_start = self.sim.now
+		if self.txfifo:
+			self.tx_fifo_written()
+
+	def tx_fifo_written(self):
+		if self.state != self.TX or self.preamble_start is None or not self.txfifo:
+			return
+		length = self.txfifo[0]
+		preamble = self.sim.now - self.preamble_start \
+				+ self.PREAMBLE_BYTES * 8 * 1000.0 / self.bitrate()
+		# The payload is taken from the FIFO as it is sent
+		frame = self.sim.transmit(self, self.freq(), self.bitrate(), self.pwr(),
+				self.preamble_start, preamble, [0] * length)
+		self.tx_frame, self.tx_data = frame, []
+		self.preamble_start = None
+		for i in range(1 + length):
+			self.sim.at(frame["sync"] + (32 + 8 * (i + 1)) * 1000.0 / frame["bitrate"],
+					lambda: self.tx_byte(frame, 1 + length))
+
+	def tx_byte(self, frame, total):
+		if frame is not self.tx_frame:
+			return
+		if not self.txfifo:
+			# TXFIFO_UNDERFLOW, GDO2 deasserts
+			self.tx_abort()
+			self.state = self.TXFIFO_ERR
+			self.node.edge(PIN_GPIO2, False)
+			return
+		self.tx_data.append(self.txfifo.pop(0))
+		if len(self.tx_data) == total:
+			frame["payload"] = bytes(bytearray(self.tx_data[1:]))
+		self.gdo0_update()
+
+	def tx_end(self, frame):
+		if frame is not self.tx_frame:
+			return
+		self.tx_frame = None
+		self.state = self.IDLE
+		self.gdo0_update()
+		self.node.edge(PIN_GPIO2, False)
+
+	def frame_sync(self, f):
+		if self.sleeping or f["aborted"] or not self.matches(f):
+			return
+		if self.state == self.RX:
+			self.rx_frame = f
+		elif self.wor and self.state == self.IDLE and (f["sync"] - f["start"]) >= self.wor_interval():
+			self.state = self.RX
+			self.rx_frame = f
+
+	def frame_end(self, f):
+		if f is not self.rx_frame or f["aborted"] or self.state != self.RX:
+			return
+		data = [len(f["payload"])] + list(f["payload"]) \
+				+ [((self.sim.link_dbm + 74) * 2) & 0xFF, (0x80 if f["crc_ok"] else 0) | 10]
+		# Filled to the threshold at a time while the packet is in
+		# progress, for the handler to drain
+		thr = 4 * ((self.regs[0x03] & 0x0F) + 1)
+		while len(self.rxfifo) < thr <= len(self.rxfifo) + len(data):
+			room = thr - len(self.rxfifo)
+			self.rxfifo += data[:room]
+			data = data[room:]
+			self.gdo0_update()
+			self.sim.dispatch()
+		self.rx_frame = None
+		if len(self.rxfifo) + len(data) > self.FIFO_SIZE:
+			# RXFIFO_OVERFLOW, GDO2 deasserts
+			self.state = self.RXFIFO_ERR
+			self.node.edge(PIN_GPIO2, False)
+			return
+		self.rxfifo += data
+		self.crc_ok = f["crc_ok"]
+		est = int(round((f["freq"] - self.freq()) * 2**14 / self.XTAL))
+		self.freqest = max(-128, min(127, est))
+		self.gdo0_update()
+		self.node.edge(PIN_GPIO2, False)
+
+class Node(object):
+	"""A build of rf_comm with a model of its radio, and the NRF_GPIOTE
+	registers it sees"""
+	def __init__(self, sim, path, model_class):
+		self.sim = sim
+		self.lib = ctypes.CDLL(path)
+		self.model = model_class(sim, self)
+		self.edges = []
+		self.timers = {}
+		self.gpiote = (ctypes.c_uint8 * PAGE)()
+		self.depth = 0
+		self.log = []
+		self.pkts = []
+		self.spi_bytes = 0
+		# Strobes and register writes, when a list
+		self.trace = None
+		self._spi = SPI_CB(self.spi)
+		self._timer = TIMER_CB(self.timer)
+		self.lib.host_set(self._spi, self._timer)
+		self.handlers = [HANDLER(lambda e, k=k: self.log.append((k, e)))
+				for k in ("tx_done", "rx_done", "tx_failed", "rx_failed")]
+		self._pkt = PKT_HANDLER(self.pkt)
+		self.lib.rf_comm_set_pwr.argtypes = [ctypes.c_int32]
+		self.lib.rf_comm_set_freq_offset.argtypes = [ctypes.c_int32]
+		self.lib.rf_comm_get_freq_offset.restype = ctypes.c_int32
+		self.lib.rf_comm_get_rssi.restype = ctypes.c_int8
+		self.lib.rf_comm_get_tx_seq.restype = ctypes.c_uint8
+
+	def spi(self, op, addr, p, n):
+		self.spi_bytes += self.model.spi_bytes(op, addr, n)
+		if self.trace is not None:
+			if op == 0x100:
+				self.trace.append(("S", addr, None))
+			elif op != 0x200 and (op & 0x80) == 0:
+				for i in range(n):
+					self.trace.append(("W", addr + (i if op & 0x40 else 0), p[i]))
+		return self.model.spi(op, addr, p, n)
+
+	def delay_us(self):
+		return ctypes.c_uint32.in_dll(self.lib, "host_delay_us").value
+
+	def call(self, name, *fn_args):
+		# Each node has its own NRF_GPIOTE
+		if self.depth == 0:
+			ctypes.memmove(GPIOTE_BASE, self.gpiote, PAGE)
+		self.depth += 1
+		try:
+			return getattr(self.lib, name)(*fn_args)
+		finally:
+			self.depth -= 1
+			if self.depth == 0:
+				ctypes.memmove(self.gpiote, GPIOTE_BASE, PAGE)
+
+	def api(self, name, *fn_args):
+		ret = self.call(name, *fn_args)
+		self.sim.dispatch()
+		return ret
+
+	def edge(self, pin, rising):
+		self.edges.append((pin, rising))
+
+	def isr(self, e):
+		pin, rising = e
+		conf = (ctypes.c_uint32 * 8).from_buffer(self.gpiote, GPIOTE_CONFIG)
+		events = (ctypes.c_uint32 * 8).from_buffer(self.gpiote, GPIOTE_EVENTS_IN)
+		inten = ctypes.c_uint32.from_buffer(self.gpiote, GPIOTE_INTEN)
+		for ch in range(8):
+			c = conf[ch]
+			if (c & 0x03) == 1 and ((c >> 8) & 0x1F) == pin \
+					and ((c >> 16) & 0x03) in ((1, 3) if rising else (2, 3)):
+				# A write to INTENSET overwrites the page in place of
+				# setting the bit, so set the bit of the channel here
+				inten.value |= (1 << ch)
+				events[ch] = 1
+				self.call("GPIOTE_IRQHandler")
+				events[ch] = 0
+
+	def timer(self, tid, ticks, handler):
+		gen = self.timers.get(tid, (0, None))[0] + 1
+		self.timers[tid] = (gen, handler)
+		if handler:
+			fn = VOID_FN(handler)
+			self.sim.at(self.sim.now + ticks * 1000.0 / MS_TIMER_FREQ,
+					lambda: self.timer_fire(tid, gen, fn))
+
+	def timer_fire(self, tid, gen, fn):
+		if self.timers.get(tid, (0, None))[0] == gen:
+			self.timers[tid] = (gen, None)
+			if self.depth == 0:
+				ctypes.memmove(GPIOTE_BASE, self.gpiote, PAGE)
+			self.depth += 1
+			fn()
+			self.depth -= 1
+			if self.depth == 0:
+				ctypes.memmove(self.gpiote, GPIOTE_BASE, PAGE)
+
+	def pkt(self, p):
+		pkt = p.contents
+		self.pkts.append((bytes(bytearray(pkt.p_data[:pkt.len])), pkt.rssi, pkt.crc_ok))
+
+	def init(self, freq, bitrate, pwr, app_id, dev_id):
+		radio = Radio(freq, 2, bitrate, pwr, 10, 3, *self.handlers)
+		hw = Hw(0, PIN_GPIO0, 0, PIN_GPIO2, 0, 0, 0, 0)
+		self.api("rf_comm_radio_init", ctypes.byref(radio), ctypes.byref(hw))
+		cfg = PktConfig(255, app_id, dev_id)
+		self.api("rf_comm_pkt_config", ctypes.byref(cfg))
+
+	def send(self, pkt_type, data, wake_ms=None):
+		buf = (ctypes.c_uint8 * max(1, len(data)))(*bytearray(data))
+		if wake_ms is None:
+			return self.api("rf_comm_pkt_send", pkt_type, buf, len(data))
+		return self.api("rf_comm_pkt_send_wake", pkt_type, buf, len(data), wake_ms)
+
+	def receive_all(self):
+		self.pkts = []
+		self.api("rf_comm_pkt_receive_all", self._pkt)
+		return self.pkts
+
+	def events(self, kind):
+		return [e for k, e in self.log if k == kind]
+
+class Suite(object):
+	APP_ID, DEV_ID = 0x22, 0x1234
+
+	def __init__(self, backend, paths):
+		self.backend = backend
+		self.paths = paths
+		self.model_class = {"ti": Cc112x, "st": S2lp, "cc1101": Cc1101}[backend]
+		self.fails = 0
+
+	def setup(self):
+		self.sim = Sim()
+		self.a = Node(self.sim, self.paths[0], self.model_class)
+		self.b = Node(self.sim, self.paths[1], self.model_class)
+		self.sim.nodes = [self.a, self.b]
+		for n in (self.a, self.b):
+			n.init(args.freq, args.bitrate, 10, self.APP_ID, self.DEV_ID)
+
+	def air_ms(self, payload_len):
+		return (64 + 32 + 8 * (payload_len + 8)) * 1000.0 / args.bitrate + 50
+
+	def header(self, seq, pkt_type):
+		return bytes(bytearray([self.APP_ID, self.DEV_ID >> 8, self.DEV_ID & 0xFF,
+				seq, pkt_type]))
+
+	def check(self, name, cond, detail=""):
+		print("  %-4s %s" % ("PASS" if cond else "FAIL", name)
+				+ ((" : " + detail) if (args.verbose and not cond and detail) else ""))
+		if not cond:
+			self.fails += 1
+
+	def t_radio_id(self):
+		got = self.a.api("rf_comm_get_radio_id")
+		self.check("radio id", got == self.model_class.PARTNUMBER, "0x%X" % got)
+
+	def t_settings(self):
+		m = self.a.model
+		ok, detail = True, []
+		for f in (865000, 866500, 868000):
+			self.a.api("rf_comm_set_freq", f)
+			exp = m.set_freq(f*1000) if hasattr(m, "set_freq") else f*1000
+			if abs(m.freq() - exp) > 500:
+				ok = False
+				detail.append("%d kHz -> %.0f Hz, not %.0f Hz" % (f, m.freq(), exp))
+		for b in (300, 1200, 4800, 38400):
+			self.a.api("rf_comm_set_bitrate", b)
+			if abs(m.bitrate() - b) > 0.01 * b:
+				ok = False
+				detail.append("%d bps -> %.1f" % (b, m.bitrate()))
+		# The highest step at or below the power for a radio with steps
+		levels = getattr(m, "PWR_LEVELS", None)
+		for p in (-3, 0, 10, 14):
+			self.a.api("rf_comm_set_pwr", p)
+			exp = max([l for l in levels if l <= p] or levels[:1]) if levels else p
+			if abs(m.pwr() - exp) > 0.5:
+				ok = False
+				detail.append("%d dBm -> %.1f" % (p, m.pwr()))
+		self.check("frequency, bit rate and power in the registers", ok, ", ".join(detail))
+
+	def t_send_receive(self):
+		self.b.api("rf_comm_rx_enable")
+		self.a.send(5, b"hello")
+		self.sim.run(self.air_ms(10))
+		pkts = self.b.receive_all()
+		exp = self.header(self.a.call("rf_comm_get_tx_seq"), 5) + b"hello"
+		self.check("send and receive", self.a.events("tx_done") and self.b.events("rx_done")
+				and len(pkts) == 1 and pkts[0][0] == exp and pkts[0][2]
+				and abs(pkts[0][1] - self.sim.link_dbm) <= 1, repr(pkts))
+
+	def t_pkt_receive(self):
+		self.b.api("rf_comm_rx_enable")
+		self.a.send(6, b"abc")
+		self.sim.run(self.air_ms(8))
+		buf = (ctypes.c_uint8 * 256)()
+		length = ctypes.c_uint8(0)
+		sts = self.b.api("rf_comm_pkt_receive", buf, ctypes.byref(length))
+		exp = self.header(self.a.call("rf_comm_get_tx_seq"), 6) + b"abc"
+		self.check("rf_comm_pkt_receive", sts == 0x80
+				and bytes(bytearray(buf[:length.value])) == exp, "0x%X" % sts)
+
+	def t_back_to_back(self):
+		self.b.api("rf_comm_rx_enable")
+		seqs = []
+		for i in range(3):
+			self.a.send(7, bytes(bytearray([i])))
+			seqs.append(self.a.call("rf_comm_get_tx_seq"))
+			self.sim.run(self.air_ms(6))
+		pkts = self.b.receive_all()
+		self.check("3 packets back to back", len(pkts) == 3
+				and [p[0] for p in pkts] == [self.header(s, 7) + bytes(bytearray([i]))
+				for i, s in enumerate(seqs)] and len(set(seqs)) == 3, repr(pkts))
+
+	def t_resend(self):
+		self.b.api("rf_comm_rx_enable")
+		self.a.send(7, b"\x01")
+		seq = self.a.call("rf_comm_get_tx_seq")
+		self.sim.run(self.air_ms(6))
+		buf = (ctypes.c_uint8 * 1)(3)
+		self.a.api("rf_comm_pkt_resend", 7, buf, 1)
+		self.sim.run(self.air_ms(6))
+		self.a.send(7, b"\x01")
+		self.sim.run(self.air_ms(6))
+		pkts = self.b.receive_all()
+		self.check("resend with the same sequence number", [p[0] for p in pkts] ==
+				[self.header(seq, 7) + b"\x01", self.header(seq, 7) + b"\x03",
+				self.header((seq + 1) & 0xFF, 7) + b"\x01"], repr(pkts))
+
+	def t_long(self):
+		self.b.api("rf_comm_rx_enable")
+		data = bytes(bytearray(range(120)))
+		self.a.send(8, data)
+		self.sim.run(self.air_ms(125))
+		pkts = self.b.receive_all()
+		self.check("120 byte payload past the RX FIFO threshold", len(pkts) == 1
+				and pkts[0][0][5:] == data and pkts[0][2], repr(pkts))
+
+	def t_corrupt(self):
+		self.b.api("rf_comm_rx_enable")
+		self.sim.corrupt_next = True
+		self.a.send(9, b"bad")
+		self.sim.run(self.air_ms(8))
+		pkts = self.b.receive_all()
+		self.check("bad CRC not delivered as good", not [p for p in pkts if p[2]], repr(pkts))
+
+	def t_idle(self):
+		self.b.api("rf_comm_idle")
+		self.a.send(10, b"x")
+		self.sim.run(self.air_ms(6))
+		pkts = self.b.receive_all()
+		self.check("nothing received in idle", not pkts and not self.b.events("rx_done"),
+				repr(pkts))
+
+	def t_rx_window(self):
+		self.b.api("rf_comm_rx_window", 100)
+		self.sim.run(150)
+		self.check("RX window timeout", self.b.events("rx_failed") == [0x01],
+				repr(self.b.log))
+
+	def t_csma(self):
+		csma = Csma(3, 10, 100, -90)
+		self.a.api("rf_comm_csma_config", ctypes.byref(csma))
+		self.sim.noise_dbm = -60
+		self.a.send(11, b"busy")
+		self.sim.run(2000)
+		stats = CsmaStats()
+		self.a.api("rf_comm_get_csma_stats", ctypes.byref(stats))
+		busy = (stats.last_attempts, stats.dropped, stats.busy)
+		self.sim.noise_dbm = -120
+		self.b.api("rf_comm_rx_enable")
+		self.a.send(11, b"clear")
+		self.sim.run(2000)
+		self.a.api("rf_comm_get_csma_stats", ctypes.byref(stats))
+		pkts = self.b.receive_all()
+		csma.max_attempts = 0
+		self.a.api("rf_comm_csma_config", ctypes.byref(csma))
+		self.check("CSMA drop on a busy channel and send on a clear one",
+				self.a.events("tx_failed") == [0x0B] and busy == (3, 1, 3)
+				and stats.sent == 1 and stats.last_attempts == 1
+				and len(pkts) == 1 and pkts[0][0][5:] == b"clear",
+				"log %r busy %r sent %d pkts %r" % (self.a.log, busy, stats.sent, pkts))
+
+	def t_listen(self):
+		# The preamble of the S2-LP is at most 2046 bits
+		interval = min(500, int(2046 * 1000 / args.bitrate) - 25)
+		ok = True
+		self.b.api("rf_comm_listen_start", interval)
+		for i in range(2):
+			self.b.log = []
+			self.a.send(12, b"plain")
+			self.sim.run(interval + self.air_ms(10))
+			missed = not self.b.receive_all()
+			self.b.log = []
+			self.a.send(12, b"wake", interval)
+			self.sim.run(2 * interval + self.air_ms(10))
+			rx = self.b.events("rx_done")
+			pkts = self.b.receive_all()
+			ok = ok and missed and rx and len(pkts) == 1 and pkts[0][0][5:] == b"wake"
+		self.b.api("rf_comm_listen_stop")
+		self.check("listen: long preamble received, normal send missed", ok)
+
+	def t_listen_regs(self):
+		# WOR_CFG1, WOR_CFG0, WOR_EVENT0, RFEND_CFG0 and the strobes SIDLE,
+		# SWORRST and SWOR of the CC112x
+		regs = (0x22, 0x23, 0x24, 0x25, 0x2A)
+		strobes = (0x36, 0x3C, 0x38)
+		m, ok, detail = self.b.model, True, []
+		# The second call is made while listening
+		for interval in (20, 500, 500, 5000, 100000, 5000000):
+			self.b.trace = []
+			self.b.api("rf_comm_listen_start", interval)
+			ticks, res = interval * 32, 0
+			while ticks > 0xFFFF and res < 3:
+				ticks, res = ticks >> 5, res + 1
+			ticks = min(max(ticks, 1), 0xFFFF)
+			want = [("W", 0x22, 0x08 | (res << 6)), ("W", 0x24, ticks >> 8),
+					("W", 0x25, ticks & 0xFF), ("W", 0x2A, 0x09), ("W", 0x23, 0x24),
+					("S", 0x36, None), ("W", 0x23, 0x20), ("S", 0x3C, None),
+					("S", 0x38, None)]
+			got = [e for e in self.b.trace if (e[0] == "W" and e[1] in regs)
+					or (e[0] == "S" and e[1] in strobes)]
+			# From the last write of WOR_CFG1, after the stop of the listen
+			starts = [i for i, e in enumerate(got) if e[:2] == ("W", 0x22)]
+			got = got[starts[-1]:] if starts else got
+			step = 2.0**(5 * res) / 32
+			exact = min(interval, 0xFFFF * step)
+			ok = ok and got == want and self.b.trace[-1] == ("S", 0x38, None) \
+					and abs(m.wor_interval() - exact) < step and m.wor
+			detail.append((interval, got == want, m.wor_interval()))
+		self.b.trace = []
+		self.b.api("rf_comm_listen_stop")
+		got = [e for e in self.b.trace if (e[0] == "W" and e[1] in regs)
+				or (e[0] == "S" and e[1] in strobes)]
+		ok = ok and got == [("S", 0x36, None), ("W", 0x2A, 0x00), ("W", 0x23, 0x21)] \
+				and not m.wor
+		self.b.trace = None
+		self.check("listen: register sequence of the start and the stop", ok,
+				"%r stop %r" % (detail, got))
+
+	def cycle(self, node, fn):
+		"""SPI bytes and time in ms of the calls of fn"""
+		spi, delay = node.spi_bytes, node.delay_us()
+		fn()
+		spi = node.spi_bytes - spi
+		return spi, spi * 8 * 1000.0 / SPI_FREQ + (node.delay_us() - delay) / 1000.0
+
+	def t_sleep(self):
+		m = self.b.model
+		init = m.snapshot()
+		sleep_wake = lambda: (self.b.api("rf_comm_sleep"), self.b.api("rf_comm_wake"))
+		spi, ms = self.cycle(self.b, sleep_wake)
+		kept = m.snapshot() == init
+		# As before, with rf_comm_radio_init at each wake
+		spi_init, ms_init = self.cycle(self.b, lambda: (sleep_wake(),
+				self.b.init(args.freq, args.bitrate, 10, self.APP_ID, self.DEV_ID)))
+		print("  INFO sleep and wake : %d SPI bytes %.1f ms, with init %d SPI bytes %.1f ms"
+				% (spi, ms, spi_init, ms_init))
+		self.b.api("rf_comm_sleep")
+		self.a.send(13, b"zz")
+		self.sim.run(self.air_ms(8))
+		asleep = not self.b.events("rx_done")
+		self.b.api("rf_comm_wake")
+		self.b.api("rf_comm_rx_enable")
+		self.a.send(13, b"up")
+		self.sim.run(self.air_ms(8))
+		pkts = self.b.receive_all()
+		self.check("sleep, then wake without init", asleep and kept and len(pkts) == 1
+				and pkts[0][0][5:] == b"up", repr(pkts))
+
+	def t_sleep_cal(self):
+		m = self.b.model
+		init = m.snapshot()
+		cals = m.cals
+		self.b.api("rf_comm_sleep")
+		self.b.api("rf_comm_wake")
+		no_cal = m.cals == cals
+		self.b.call("rf_comm_cal_update", 60, 25)
+		self.b.api("rf_comm_sleep")
+		self.b.api("rf_comm_wake")
+		same_temp = m.cals == cals
+		self.b.call("rf_comm_cal_update", 60, 25 + 10)
+		self.b.api("rf_comm_sleep")
+		self.b.api("rf_comm_wake")
+		temp_cal = m.cals == cals + 1
+		self.b.call("rf_comm_cal_update", 4 * 60 * 60, 35)
+		self.b.api("rf_comm_sleep")
+		self.b.api("rf_comm_wake")
+		time_cal = m.cals == cals + 2
+		# A reset of the radio in the sleep
+		self.b.api("rf_comm_sleep")
+		m.reset()
+		self.b.api("rf_comm_wake")
+		restored = m.snapshot() == init and m.cals == cals + 3
+		self.check("calibration at the wake only when due", no_cal and same_temp
+				and temp_cal and time_cal and m.sleep_accesses == 0,
+				"%r" % ((no_cal, same_temp, temp_cal, time_cal, m.sleep_accesses),))
+		self.check("configuration restored after a reset in the sleep", restored)
+
+	def t_freq_offset(self):
+		node, gw = self.a, self.b
+		step = self.model_class.FREQOFF_STEP
+		regs = node.model.freqoff_reg
+		math_ok = True
+		for hz in (-20000, -46, 0, 31, 12345):
+			node.call("rf_comm_set_freq_offset", hz)
+			math_ok = math_ok and regs() == int(round(hz / step))
+		math_ok = math_ok and node.call("rf_comm_set_freq_offset", 2000000) == 1
+		node.call("rf_comm_set_freq_offset", 0)
+		node.model.ppm = self.model_class.OFFSET_PPM
+		offset = node.model.freq() - gw.model.freq()
+		# An RX filter wide enough for the offset
+		for n in (node, gw):
+			n.api("rf_comm_set_bw", args.bitrate + 4 * int(abs(offset)))
+			n.model.bw_check = True
+		gw.api("rf_comm_rx_enable")
+		node.send(14, b"n")
+		self.sim.run(self.air_ms(6))
+		est_gw = gw.call("rf_comm_get_freq_offset")
+		node.api("rf_comm_rx_enable")
+		gw.send(14, b"g")
+		self.sim.run(self.air_ms(6))
+		est_node = node.call("rf_comm_get_freq_offset")
+		node.api("rf_comm_set_freq_offset", est_node)
+		residual = node.model.freq() - gw.model.freq()
+		self.check("frequency offset estimate and FREQOFF", math_ok
+				and abs(est_gw - offset) <= step and abs(est_node + offset) <= step
+				and abs(residual) <= step, "offset %.0f Hz est %d %d residual %.0f Hz"
+				% (offset, est_gw, est_node, residual))
+		# An RX filter narrower than the offset
+		gw.api("rf_comm_set_bw", args.bitrate + 4000)
+		got = []
+		for shift in (est_node, 0):
+			node.api("rf_comm_set_freq_offset", shift)
+			gw.api("rf_comm_rx_enable")
+			node.send(14, b"c")
+			self.sim.run(self.air_ms(6))
+			got.append(len(gw.receive_all()))
+		node.api("rf_comm_set_freq_offset", est_node)
+		node.api("rf_comm_sleep")
+		node.api("rf_comm_wake")
+		kept = regs()
+		node.init(args.freq, args.bitrate, 10, self.APP_ID, self.DEV_ID)
+		self.check("narrow RX filter with the offset corrected, kept in sleep and init",
+				got == [1, 0] and kept == regs() == int(round(est_node / step)),
+				"bw %.0f Hz got %r FREQOFF %d %d" % (gw.model.bw(), got, kept, regs()))
+
+	def t_rssi(self):
+		self.b.api("rf_comm_rx_enable")
+		self.sim.noise_dbm = -80
+		rssi = self.b.api("rf_comm_get_rssi")
+		self.sim.noise_dbm = -120
+		self.check("RSSI of the channel", abs(rssi + 80) <= 1, "%d dBm" % rssi)
+
+	def run(self):
+		tests = [self.t_radio_id, self.t_settings, self.t_send_receive, self.t_pkt_receive,
+				self.t_back_to_back, self.t_resend, self.t_long, self.t_corrupt, self.t_idle,
+				self.t_rx_window, self.t_csma, self.t_listen, self.t_sleep, self.t_rssi]
+		if self.backend in ("ti", "cc1101"):
+			tests += [self.t_sleep_cal, self.t_freq_offset]
+		if self.backend == "ti":
+			tests += [self.t_listen_regs]
+		for t in tests:
+			self.setup()
+			t()
+		return self.fails
+
+backends = ["ti", "st", "cc1101"] if args.backend == "all" else [args.backend]
+tmp = tempfile.mkdtemp()
+try:
+	map_peripherals()
+	fails = 0
+	for backend in backends:
+		print("%s_radio_lib at %d bps" % (backend, args.bitrate))
+		fails += Suite(backend, build(tmp, backend)).run()
+	print("%d failed" % fails)
+finally:
+	shutil.rmtree(tmp)
+sys.exit(1 if fails else 0)
@@ -0,0 +1,162 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Discrete event simulation of LRF nodes sending to one gateway on a shared
+# channel, without and with the listen before talk of rf_comm
+# (rf_comm_csma_config). Each node sends a packet every period with a
+# random jitter, as the alive packets of lrf_node, and all the nodes send
+# within a short spread at each common event, as a tilt of a whole site.
+# A packet is delivered if no other packet overlaps it at the gateway. With
+# the CSMA a node waits a random backoff, senses the channel and sends only
+# if it is clear, else it doubles the window and tries again. A node doesn't
+# sense a packet which started less than the sense time before, nor one
+# from a node hidden from it. The charge is that of the radio from the CSMA
+# till the end of the send, with the typical currents of the CC1120.
+# Usage:
+#   rf_csma_sim.py [--nodes 40] [--hours 24] [--events 24] [--hidden 0.1]
+#                  [--attempts 8] [--min-backoff 20] [--max-backoff 2560]
+
+from __future__ import print_function
+import argparse
+import heapq
+import random
+
+parser = argparse.ArgumentParser(description="rf_comm CSMA simulation")
+parser.add_argument("--nodes", type=int, default=40, help="number of nodes")
+parser.add_argument("--hours", type=float, default=24, help="simulated time")
+parser.add_argument("--period", type=float, default=1800, help="s between the packets of a node")
+parser.add_argument("--jitter", type=float, default=3, help="s of random jitter of the period")
+parser.add_argument("--events", type=int, default=24,
+		help="common events in the simulated time when all the nodes send")
+parser.add_argument("--spread", type=float, default=0.5,
+		help="s within which the nodes send at a common event")
+parser.add_argument("--hidden", type=float, default=0.1,
+		help="probability that two nodes can't hear each other")
+parser.add_argument("--bitrate", type=float, default=1200, help="bit rate in bps")
+parser.add_argument("--payload", type=int, default=7,
+		help="bytes after the length byte, with the rf_comm header")
+parser.add_argument("--overhead", type=int, default=11,
+		help="bytes of preamble, sync word, length and CRC")
+parser.add_argument("--attempts", type=int, default=8, help="maximum clear channel checks")
+parser.add_argument("--min-backoff", type=float, default=20, help="first backoff window in ms")
+parser.add_argument("--max-backoff", type=float, default=2560, help="largest backoff window in ms")
+parser.add_argument("--sense", type=float, default=1.5,
+		help="ms in RX for a valid carrier sense, also the blind time of the check")
+parser.add_argument("--i-idle", type=float, default=1.5, help="mA in IDLE during a backoff")
+parser.add_argument("--i-rx", type=float, default=22.0, help="mA in RX")
+parser.add_argument("--i-tx", type=float, default=45.0, help="mA in TX at +14 dBm")
+parser.add_argument("--seed", type=int, default=1, help="seed of the random numbers")
+args = parser.parse_args()
+
+airtime_ms = (args.overhead + args.payload) * 8 * 1000.0 / args.bitrate
+duration_ms = args.hours * 3600 * 1000.0
+
+def simulate(use_csma):
+	rnd = random.Random(args.seed)
+	hidden = set()
+	for a in range(args.nodes):
+		for b in range(a + 1, args.nodes):
+			if rnd.random() < args.hidden:
+				hidden.add((a, b))
+				hidden.add((b, a))
+
+	# Event queue of (time in ms, is a check, node, attempts done). A send
+	# starts a backoff which ends with a check, in the order of the times
+	queue = []
+	for node in range(args.nodes):
+		t = rnd.uniform(0, args.period * 1000)
+		while t < duration_ms:
+			heapq.heappush(queue, (t, False, node, 0))
+			t += (args.period + rnd.uniform(0, args.jitter)) * 1000
+	for i in range(args.events):
+		t = rnd.uniform(0, duration_ms)
+		for node in range(args.nodes):
+			heapq.heappush(queue, (t + rnd.uniform(0, args.spread * 1000), False, node, 0))
+
+	sends = []          # (start, end, node) of the packets on air
+	charge = 0.0        # uC
+	packets = dropped = checks = busy = 0
+
+	while queue:
+		t, is_check, node, tries = heapq.heappop(queue)
+		if not use_csma:
+			packets += 1
+			sends.append((t, t + airtime_ms, node))
+			charge += airtime_ms * args.i_tx
+			continue
+		if not is_check:
+			if tries == 0:
+				packets += 1
+			window = min(args.min_backoff * (2 ** tries), args.max_backoff)
+			backoff = 1 + rnd.uniform(0, window)
+			charge += backoff * args.i_idle + args.sense * args.i_rx
+			heapq.heappush(queue, (t + backoff + args.sense, True, node, tries))
+			continue
+		checks += 1
+		heard = [s for s in sends if s[0] <= t - args.sense and s[1] > t
+			and (s[2], node) not in hidden]
+		if heard:
+			busy += 1
+			if tries + 1 < args.attempts:
+				heapq.heappush(queue, (t, False, node, tries + 1))
+			else:
+				dropped += 1
+			continue
+		sends.append((t, t + airtime_ms, node))
+		charge += airtime_ms * args.i_tx
+
+	# A packet is lost at the gateway if any other packet overlaps it
+	sends.sort()
+	lost = [False] * len(sends)
+	for i in range(len(sends)):
+		j = i + 1
+		while j < len(sends) and sends[j][0] < sends[i][1]:
+			lost[i] = lost[j] = True
+			j += 1
+	delivered = lost.count(False)
+
+	return {
+		"packets": packets,
+		"delivered": delivered,
+		"dropped": dropped,
+		"checks": checks,
+		"busy": busy,
+		"charge": charge,
+	}
+
+print("%d nodes, %.0f h, airtime %.1f ms, %d common events, %.0f%% hidden pairs"
+		% (args.nodes, args.hours, airtime_ms, args.events, args.hidden * 100))
+print("%-6s %8s %9s %7s %8s %9s %10s" % ("MAC", "packets", "delivered", "ratio",
+		"dropped", "checks/pk", "uC/deliv"))
+for use_csma in (False, True):
+	r = simulate(use_csma)
+	print("%-6s %8d %9d %6.1f%% %8d %9.2f %10.1f" % ("CSMA" if use_csma else "none",
+			r["packets"], r["delivered"], 100.0 * r["delivered"] / max(r["packets"], 1),
+			r["dropped"], float(r["checks"]) / max(r["packets"], 1),
+			r["charge"] / max(r["delivered"], 1)))
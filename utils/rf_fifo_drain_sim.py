@@ -0,0 +1,520 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Packets lost in the RX FIFO of the CC112x at the gateway, with the receive
+# of ti_radio_lib in the tree, which drains every packet in the FIFO, and
+# with the one of an older revision, which reads one packet and flushes the
+# FIFO. Both rf_comm.c are built for the host with a stub of the SPI which
+# calls a model of the RX side of the CC112x. The model puts each byte of a
+# frame in the FIFO of 128 bytes at the time it is received, appends the
+# RSSI and CRC_OK|LQI status bytes, deasserts GPIO2 at the end of the frame
+# (PKT_SYNC_RXTX), asserts GPIO0 over the FIFO threshold (RXFIFO_THR) if
+# IOCFG0 selects it, and goes to IDLE or stays in RX after a packet as set by
+# RXOFF_MODE. A frame is only received if the radio was in RX before its sync
+# word, and a byte which doesn't fit in the FIFO is an RX FIFO overflow.
+#
+# The gateway is as lrf_gateway for each revision, the older one reads the
+# RSSI and the packet in rx_done and then goes to IDLE and back to RX, the
+# newer one calls rf_comm_pkt_receive_all in rx_done. Each SPI transfer
+# takes its bytes at 125 kHz, with the radio going on receiving meanwhile,
+# and each interrupt is taken some latency after its edge, as if the CPU was
+# busy with something else. The GPIOTE events of a channel don't queue, so
+# the edges of the packets ended before the interrupt is taken give one
+# interrupt.
+#
+# A burst of packets is sent back to back at each bit rate and latency, and
+# the packets lost with each revision are given. The run fails if the newer
+# receive loses a packet when the FIFO didn't overflow, or more packets than
+# the older one, if it doesn't get a packet longer than the FIFO, or if it
+# doesn't count an overflow and go on receiving after it.
+#
+# The GPIOTE, GPIO and NVIC registers are at fixed addresses, so the pages
+# of the nRF52 peripherals are mapped at them, which needs Linux. Needs a
+# host C compiler and git, run from the root of the repository.
+# Usage:
+#   rf_fifo_drain_sim.py [--bitrates 1200,38400] [--latencies 0,2,10,40]
+#                        [--count 20] [--len 10] [--old-rev REV] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import heapq
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# The parent of the commit which added the drain of the FIFO
+OLD_REV = "3ca3cadef629977f49a481ed5025f00c73fb4284^"
+
+parser = argparse.ArgumentParser(description="Packets lost in the RX FIFO of the CC112x")
+parser.add_argument("--bitrates", default="1200,38400", help="bit rates in bps")
+parser.add_argument("--latencies", default="0,2,10,40",
+		help="latencies of the interrupts in ms")
+parser.add_argument("--count", type=int, default=20, help="packets in a burst")
+parser.add_argument("--len", type=int, default=10, help="bytes of data in a packet")
+parser.add_argument("--old-rev", default=OLD_REV, help="git revision of the older receive")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform", "codebase/rf_lib"]
+LIB_DIR = "codebase/rf_lib/ti_radio_lib"
+
+# SPI layer of ti_radio_lib and ms_timer, calling the host
+STUB = r"""
+#include <stdint.h>
+typedef uint32_t (*host_spi_t) (uint32_t op, uint32_t addr, uint8_t * p, uint32_t len);
+static host_spi_t host_spi;
+void host_set (host_spi_t spi)
+{
+	host_spi = spi;
+}
+/* op is the access type, or 0x100 for a strobe. addr has the extended
+ * address in bits 15:8 */
+uint8_t trx8BitRegAccess (uint8_t type, uint8_t addr, uint8_t * p, uint16_t len)
+{
+	return host_spi (type, addr, p, len);
+}
+uint8_t trx16BitRegAccess (uint8_t type, uint8_t ext, uint8_t addr, uint8_t * p, uint8_t len)
+{
+	return host_spi (type, (ext << 8) | addr, p, len);
+}
+uint8_t trxSpiCmdStrobe (uint8_t cmd)
+{
+	return host_spi (0x100, cmd, 0, 0);
+}
+uint32_t rf_spi_wait_ready (uint32_t timeout_us)
+{
+	return 0;
+}
+void hal_nop_delay_us (uint32_t us) { }
+void hal_nop_delay_ms (uint32_t ms) { }
+void ms_timer_start (uint32_t id, uint32_t mode, uint64_t ticks, void (*h) (void)) { }
+void ms_timer_stop (uint32_t id) { }
+uint32_t random_num_below (uint32_t bound) { return 0; }
+"""
+
+NOP_DELAY_H = "#include <stdint.h>\nvoid hal_nop_delay_us (uint32_t us);\nvoid hal_nop_delay_ms (uint32_t ms);\n"
+
+# Clock of the SPI to the radio, hal_spim at HAL_SPIM_FREQ_125K
+SPI_FREQ = 125000
+
+GPIOTE_BASE = 0x40006000
+GPIO_BASE = 0x50000000
+SCS_BASE = 0xE000E000
+GPIOTE_EVENTS_IN = 0x100
+GPIOTE_INTEN = 0x304
+GPIOTE_CONFIG = 0x510
+PAGE = 0x1000
+
+PIN_GPIO0 = 10
+PIN_GPIO2 = 11
+APP_ID, DEV_ID = 0x22, 0x1234
+# Bytes of preamble and sync word before the length byte
+PREAMBLE_BYTES, SYNC_BYTES = 4, 4
+RSSI_DBM = -70
+
+SPI_CB = ctypes.CFUNCTYPE(ctypes.c_uint32, ctypes.c_uint32, ctypes.c_uint32,
+		ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32)
+HANDLER = ctypes.CFUNCTYPE(None, ctypes.c_uint32)
+
+class RxPkt(ctypes.Structure):
+	_fields_ = [("p_data", ctypes.POINTER(ctypes.c_uint8)), ("len", ctypes.c_uint8),
+			("rssi", ctypes.c_int8), ("lqi", ctypes.c_uint8), ("crc_ok", ctypes.c_bool)]
+
+PKT_HANDLER = ctypes.CFUNCTYPE(None, ctypes.POINTER(RxPkt))
+
+class Radio(ctypes.Structure):
+	_fields_ = [("center_freq", ctypes.c_uint32), ("freq_dev", ctypes.c_uint32),
+			("bitrate", ctypes.c_uint32), ("tx_power", ctypes.c_int32),
+			("rx_bandwidth", ctypes.c_uint32), ("irq_priority", ctypes.c_int),
+			("tx_done", HANDLER), ("rx_done", HANDLER), ("tx_failed", HANDLER),
+			("rx_failed", HANDLER)]
+
+class Hw(ctypes.Structure):
+	_fields_ = [(n, ctypes.c_uint32) for n in ("reset", "gpio0", "gpio1", "gpio2", "gpio3",
+			"hgm", "lna", "pa")]
+
+class PktConfig(ctypes.Structure):
+	_fields_ = [("max_len", ctypes.c_uint8), ("app_id", ctypes.c_uint8),
+			("dev_id", ctypes.c_uint16)]
+
+def map_peripherals():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (GPIOTE_BASE, GPIO_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+def build(tmp, name, src_dir):
+	"""rf_comm.c in src_dir, with the rf_comm.h next to it"""
+	cc = os.environ.get("CC", "cc")
+	flags = ["-shared", "-fPIC", "-std=gnu11", "-w", "-U__linux__", "-U__linux", "-Ulinux",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832_XXAA", "-DBOARD_SENSEELE_PCB_REV2",
+			"-iquote", tmp] + ["-I" + i for i in INC + [LIB_DIR]]
+	so = os.path.join(tmp, "rf_comm_%s.so" % name)
+	subprocess.check_call([cc] + flags + [os.path.join(src_dir, "rf_comm.c"),
+			os.path.join(tmp, "stub.c"), "-o", so])
+	return so
+
+def build_all(tmp):
+	with open(os.path.join(tmp, "stub.c"), "w") as f:
+		f.write(STUB)
+	# The delay of the HAL is in ARM assembly
+	with open(os.path.join(tmp, "hal_nop_delay.h"), "w") as f:
+		f.write(NOP_DELAY_H)
+	old_dir = os.path.join(tmp, "old")
+	os.mkdir(old_dir)
+	for path in (LIB_DIR + "/rf_comm.c", "codebase/rf_lib/rf_comm.h"):
+		src = subprocess.check_output(["git", "show", "%s:%s" % (args.old_rev, path)])
+		with open(os.path.join(old_dir, os.path.basename(path)), "wb") as f:
+			f.write(src)
+	return build(tmp, "old", old_dir), build(tmp, "new", LIB_DIR)
+
+class Cc112xRx(object):
+	"""RX FIFO, GPIO0, GPIO2 and the states of the CC112x in RX"""
+	IDLE, RX, RXFIFO_ERR = 0, 1, 6
+	FIFO_SIZE = 128
+	MARC_RX_OK, MARC_RXFIFO_OVF = 0x80, 0x09
+
+	def __init__(self, gw):
+		self.gw = gw
+		self.regs = [0] * 256
+		self.ext = [0] * 256
+		self.state = self.IDLE
+		self.rx_since = None
+		self.rxfifo = []
+		self.frame = None
+		self.marc_sts1 = 0
+		self.lqi = 0
+		self.gpio0 = False
+
+	def rxoff_rx(self):
+		"""RXOFF_MODE of RFEND_CFG1, RX or IDLE after a packet"""
+		return ((self.regs[0x29] >> 4) & 0x03) == 0x03
+
+	def gpio0_update(self):
+		level = (self.regs[0x03] & 0x3F) == 0x00 \
+				and len(self.rxfifo) >= (self.regs[0x1E] & 0x7F) + 1
+		if level != self.gpio0:
+			self.gpio0 = level
+			self.gw.edge(PIN_GPIO0, level)
+
+	def spi_bytes(self, op, addr, n):
+		if op == 0x100:
+			return 1
+		return (2 if addr & 0xFF00 else 1) + n
+
+	def spi(self, op, addr, p, n):
+		if op == 0x100:
+			self.strobe(addr)
+		elif addr & 0xFF00:
+			for i in range(n):
+				a = (addr & 0xFF) + (i if op & 0x40 else 0)
+				if op & 0x80:
+					p[i] = self.ext_read(a)
+				else:
+					self.ext[a] = p[i]
+		elif addr == 0x3F:
+			if op & 0x80:
+				for i in range(n):
+					p[i] = self.rxfifo.pop(0) if self.rxfifo else 0
+				self.gpio0_update()
+		else:
+			for i in range(n):
+				a = addr + (i if op & 0x40 else 0)
+				if op & 0x80:
+					p[i] = self.regs[a]
+				else:
+					self.regs[a] = p[i]
+		return self.state << 4
+
+	def ext_read(self, a):
+		if a == 0x94:
+			v, self.marc_sts1 = self.marc_sts1, 0
+			return v
+		if a == 0x71:
+			return (RSSI_DBM + 99) & 0xFF
+		if a == 0x72:
+			return 0x03
+		if a == 0x74:
+			return self.lqi
+		if a == 0xD7:
+			return len(self.rxfifo)
+		if a == 0x8F:
+			return 0x48
+		return self.ext[a]
+
+	def strobe(self, cmd):
+		if cmd == 0x30:
+			self.__init__(self.gw)
+		elif cmd == 0x36:
+			self.state, self.frame = self.IDLE, None
+		elif cmd == 0x34:
+			if self.state == self.IDLE:
+				self.state, self.rx_since = self.RX, self.gw.cpu
+		elif cmd == 0x3A:
+			if self.state in (self.IDLE, self.RXFIFO_ERR):
+				self.rxfifo, self.state = [], self.IDLE
+				self.gpio0_update()
+
+	def sync(self, f, t):
+		# The preamble is needed before the sync word
+		if self.state == self.RX and self.frame is None \
+				and self.rx_since <= t - f["preamble_ms"] / 2:
+			self.frame = f
+
+	def byte(self, f, b):
+		if f is not self.frame:
+			return
+		if len(self.rxfifo) >= self.FIFO_SIZE:
+			# GPIO2 deasserts on the overflow too
+			self.state, self.frame = self.RXFIFO_ERR, None
+			self.marc_sts1 = self.MARC_RXFIFO_OVF
+			self.gw.edge(PIN_GPIO2, False)
+			return
+		self.rxfifo.append(b)
+		self.gpio0_update()
+
+	def end(self, f):
+		if f is not self.frame:
+			return
+		for b in ((RSSI_DBM + 99) & 0xFF, 0x80 | 10):
+			self.byte(f, b)
+		if f is not self.frame:
+			return
+		self.frame = None
+		self.lqi = 0x80 | 10
+		self.marc_sts1 = self.MARC_RX_OK
+		if not self.rxoff_rx():
+			self.state = self.IDLE
+		self.gw.edge(PIN_GPIO2, False)
+
+class Gateway(object):
+	"""A build of rf_comm with the radio model and the receive of lrf_gateway,
+	on a simulated clock in ms"""
+	def __init__(self, path, old, bitrate, latency_ms):
+		ctypes.memset(GPIOTE_BASE, 0, PAGE)
+		self.lib = ctypes.CDLL(path)
+		self.old, self.bitrate, self.latency = old, bitrate, latency_ms
+		self.radio = Cc112xRx(self)
+		self.events = []
+		self.seq = 0
+		self.now = self.cpu = 0.0
+		self.irq_at = None
+		self.in_isr = False
+		self.pkts = []
+		self._spi = SPI_CB(self.spi)
+		self.lib.host_set(self._spi)
+		self._pkt = PKT_HANDLER(self.pkt)
+		self.handlers = [HANDLER(lambda e: None), HANDLER(self.rx_done),
+				HANDLER(lambda e: None), HANDLER(self.rx_failed)]
+		self.lib.rf_comm_get_rssi.restype = ctypes.c_int8
+		radio = Radio(866000, 2, bitrate, 10, 10, 3, *self.handlers)
+		hw = Hw(0, PIN_GPIO0, 0, PIN_GPIO2, 0, 0, 0, 0)
+		self.lib.rf_comm_radio_init(ctypes.byref(radio), ctypes.byref(hw))
+		cfg = PktConfig(255, APP_ID, DEV_ID)
+		self.lib.rf_comm_pkt_config(ctypes.byref(cfg))
+		self.lib.rf_comm_rx_enable()
+		self.overflows = 0
+
+	def at(self, t, fn):
+		self.seq += 1
+		heapq.heappush(self.events, (t, self.seq, fn))
+
+	def advance(self, t):
+		"""The radio up to t, while the CPU is busy"""
+		while self.events and self.events[0][0] <= t:
+			et, s, fn = heapq.heappop(self.events)
+			self.now = max(self.now, et)
+			fn()
+		self.now = max(self.now, t)
+
+	def spi(self, op, addr, p, n):
+		self.advance(self.cpu)
+		ret = self.radio.spi(op, addr, p, n)
+		self.cpu += self.radio.spi_bytes(op, addr, n) * 8 * 1000.0 / SPI_FREQ
+		return ret
+
+	def edge(self, pin, rising):
+		conf = (ctypes.c_uint32 * 8).from_address(GPIOTE_BASE + GPIOTE_CONFIG)
+		events = (ctypes.c_uint32 * 8).from_address(GPIOTE_BASE + GPIOTE_EVENTS_IN)
+		inten = ctypes.c_uint32.from_address(GPIOTE_BASE + GPIOTE_INTEN)
+		for ch in range(8):
+			c = conf[ch]
+			if (c & 0x03) == 1 and ((c >> 8) & 0x1F) == pin \
+					and ((c >> 16) & 0x03) in ((1, 3) if rising else (2, 3)):
+				# A write to INTENSET overwrites the page in place of
+				# setting the bit, so set the bit of the channel here
+				inten.value |= (1 << ch)
+				events[ch] = 1
+				if self.irq_at is None:
+					self.irq_at = self.now + self.latency
+
+	def isr(self):
+		self.cpu = max(self.cpu, self.irq_at)
+		self.irq_at = None
+		self.lib.GPIOTE_IRQHandler()
+		events = (ctypes.c_uint32 * 8).from_address(GPIOTE_BASE + GPIOTE_EVENTS_IN)
+		if self.irq_at is None and any(events):
+			self.irq_at = self.cpu
+
+	def run(self, ms):
+		end = self.now + ms
+		while True:
+			t_irq = max(self.irq_at, self.cpu) if self.irq_at is not None else None
+			t_evt = self.events[0][0] if self.events else None
+			if t_irq is not None and t_irq <= end and (t_evt is None or t_irq < t_evt):
+				self.advance(t_irq)
+				self.isr()
+			elif t_evt is not None and t_evt <= end:
+				self.advance(t_evt)
+			else:
+				break
+		self.now = self.cpu = max(end, self.cpu)
+
+	# The receive of lrf_gateway
+	def rx_done(self, error):
+		if self.old:
+			buf = (ctypes.c_uint8 * 256)()
+			plen = ctypes.c_uint8(0)
+			self.lib.rf_comm_get_rssi()
+			crc = self.lib.rf_comm_pkt_receive(buf, ctypes.byref(plen))
+			if crc:
+				self.pkts.append(bytes(bytearray(buf[:plen.value])))
+			self.lib.rf_comm_idle()
+			self.lib.rf_comm_rx_enable()
+		else:
+			self.lib.rf_comm_pkt_receive_all(self._pkt)
+
+	def rx_failed(self, error):
+		self.lib.rf_comm_rx_enable()
+
+	def pkt(self, p):
+		pkt = p.contents
+		if pkt.crc_ok:
+			self.pkts.append(bytes(bytearray(pkt.p_data[:pkt.len])))
+
+	def send(self, start, payload):
+		"""A frame from start, returns the time of its end"""
+		bit_ms = 1000.0 / self.bitrate
+		f = {"preamble_ms": 8 * PREAMBLE_BYTES * bit_ms}
+		sync = start + 8 * (PREAMBLE_BYTES + SYNC_BYTES) * bit_ms
+		self.at(sync, lambda: self.radio.sync(f, sync))
+		data = [len(payload)] + list(bytearray(payload))
+		for i, b in enumerate(data):
+			self.at(sync + 8 * (i + 1) * bit_ms, lambda b=b: self.radio.byte(f, b))
+		# And the CRC
+		end = sync + 8 * (len(data) + 2) * bit_ms
+		self.at(end, lambda: self.radio.end(f))
+		return end
+
+def payload(seq, n):
+	return bytes(bytearray([APP_ID, DEV_ID >> 8, DEV_ID & 0xFF, seq & 0xFF, 1]
+			+ [(seq + i) & 0xFF for i in range(n)]))
+
+def burst(path, old, bitrate, latency, count, n):
+	"""Packets got of a burst sent back to back, and the overflows"""
+	gw = Gateway(path, old, bitrate, latency)
+	sent = [payload(i, n) for i in range(count)]
+	# After the init of the radio
+	t = gw.cpu + 1.0
+	for p in sent:
+		t = gw.send(t, p)
+	gw.run(t - gw.now + latency + 1000)
+	got = [p for p in gw.pkts if p in sent]
+	ovf = 0 if old else gw.lib.rf_comm_get_rx_overflows()
+	return gw, len(set(got)), len(gw.pkts) - len(got), ovf
+
+tmp = tempfile.mkdtemp()
+try:
+	map_peripherals()
+	old_so, new_so = build_all(tmp)
+	fails = 0
+
+	def check(name, cond, detail=""):
+		global fails
+		print("  %-4s %s" % ("PASS" if cond else "FAIL", name)
+				+ ((" : " + detail) if (args.verbose and not cond and detail) else ""))
+		if not cond:
+			fails += 1
+
+	bitrates = [int(b) for b in args.bitrates.split(",")]
+	latencies = [float(l) for l in args.latencies.split(",")]
+	in_fifo = 1 + 5 + args.len + 2
+	print("Burst of %d packets of %d bytes, lost with the older receive and the newer one"
+			% (args.count, 5 + args.len))
+	print("  %8s %10s %6s %6s %10s" % ("bps", "latency ms", "older", "newer", "overflows"))
+	no_loss = not_worse = no_bad = True
+	detail = []
+	for br in bitrates:
+		for lat in latencies:
+			gw, old_got, old_bad, _ = burst(old_so, True, br, lat, args.count, args.len)
+			gw, new_got, new_bad, ovf = burst(new_so, False, br, lat, args.count, args.len)
+			print("  %8d %10g %6d %6d %10d" % (br, lat, args.count - old_got,
+					args.count - new_got, ovf))
+			# The bytes received in the latency, with a packet being read
+			if lat * br / 8000.0 + 2 * in_fifo <= Cc112xRx.FIFO_SIZE:
+				no_loss = no_loss and new_got == args.count and ovf == 0
+			not_worse = not_worse and new_got >= old_got
+			no_bad = no_bad and new_bad == 0
+			detail.append((br, lat, old_got, new_got, new_bad, ovf))
+	check("newer receive loses no packet without an overflow", no_loss, repr(detail))
+	check("newer receive loses no more packets than the older one", not_worse, repr(detail))
+	check("newer receive delivers no corrupt packet", no_bad, repr(detail))
+
+	# Longer than the FIFO, drained at the threshold while it is received
+	br = bitrates[-1]
+	long_got = []
+	for so, old in ((old_so, True), (new_so, False)):
+		gw, got, bad, _ = burst(so, old, br, 0, 1, 200)
+		long_got.append(got)
+	print("  INFO packet of 205 bytes at %d bps : older got %d newer got %d"
+			% (br, long_got[0], long_got[1]))
+	check("newer receive gets a packet longer than the FIFO", long_got[1] == 1)
+
+	# An overflow with the interrupts held off for longer than the FIFO
+	lat = 2 * Cc112xRx.FIFO_SIZE * 8000.0 / br
+	gw, got, bad, ovf = burst(new_so, False, br, lat, args.count, args.len)
+	gw.latency = 0
+	after = payload(0x80, args.len)
+	gw.run(gw.send(gw.now + 1, after) - gw.now + 100)
+	ovf = gw.lib.rf_comm_get_rx_overflows()
+	check("newer receive counts an overflow and goes on receiving",
+			ovf > 0 and gw.pkts[-1:] == [after] and bad == 0,
+			"overflows %d got %d last %r" % (ovf, got, gw.pkts[-1:]))
+	print("%d failed" % fails)
+finally:
+	shutil.rmtree(tmp)
+sys.exit(1 if fails else 0)
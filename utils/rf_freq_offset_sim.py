@@ -0,0 +1,155 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Simulation of the crystal offset of an LRF node against the gateway over
+# a temperature profile, with and without the correction of the node with
+# rf_comm_set_freq_offset. The crystal of the node has an initial tolerance
+# and a parabolic drift around its turnover temperature, and the node is
+# outdoors with a daily cycle of temperature and random swings on top,
+# while the gateway is indoors at a constant temperature.
+#
+# As in lrf_node, at each packet exchange the node takes the estimate of
+# the gateway, which is in steps of FREQOFF_EST with noise, fully the
+# first time and then a part of it (FREQ_OFF_GAIN_DIV). Between the
+# exchanges the offset drifts with the temperature. For each interval
+# between the exchanges the largest offset left is given, with the RX
+# filter needed by Carson's rule for it rounded up to the next bandwidth of
+# the CC112x (200 kHz/decimation factor) and the gain in sensitivity of
+# the narrower filter over the one needed without the correction.
+# Usage:
+#   rf_freq_offset_sim.py [--bitrate 1200] [--fdev 4000] [--days 7]
+#                         [--intervals 60,300,900,3600]
+
+from __future__ import print_function
+import argparse
+import math
+import random
+
+parser = argparse.ArgumentParser(description="Crystal offset correction simulation")
+parser.add_argument("--bitrate", type=float, default=1200, help="bit rate in bps")
+parser.add_argument("--fdev", type=float, default=4000, help="frequency deviation in Hz")
+parser.add_argument("--freq", type=float, default=866e6, help="carrier frequency in Hz")
+parser.add_argument("--days", type=float, default=7, help="simulated time")
+parser.add_argument("--intervals", default="60,300,900,3600",
+		help="s between the packet exchanges, comma separated")
+parser.add_argument("--tolerance", type=float, default=10,
+		help="ppm initial tolerance of the crystal of the node")
+parser.add_argument("--gw-tolerance", type=float, default=-10,
+		help="ppm initial tolerance of the crystal of the gateway")
+parser.add_argument("--curve", type=float, default=-0.035,
+		help="ppm/C^2 parabolic drift of the crystal")
+parser.add_argument("--turnover", type=float, default=25, help="C turnover temperature")
+parser.add_argument("--gw-temp", type=float, default=25, help="C at the gateway")
+parser.add_argument("--temp-mean", type=float, default=20, help="C mean at the node")
+parser.add_argument("--temp-swing", type=float, default=15,
+		help="C amplitude of the daily cycle at the node")
+parser.add_argument("--temp-noise", type=float, default=0.5,
+		help="C/sqrt(min) random walk around the daily cycle")
+parser.add_argument("--est-noise", type=float, default=100,
+		help="Hz rms noise of the estimate of a packet")
+parser.add_argument("--gain-div", type=int, default=2,
+		help="part of the estimate taken after the first (FREQ_OFF_GAIN_DIV)")
+parser.add_argument("--seed", type=int, default=1, help="seed of the random numbers")
+args = parser.parse_args()
+
+XTAL_FREQ = 32e6
+#FREQOFF and FREQOFF_EST step of the CC112x with the LO divider of 4
+FREQOFF_STEP = XTAL_FREQ/(4*2**18)
+#Time step of the temperature profile in s
+T_STEP = 60
+
+def xtal_ppm(tolerance, temp):
+	return tolerance + args.curve*(temp - args.turnover)**2
+
+def rx_bw(offset):
+	"""Narrowest CC112x RX filter for the signal and the offset, 0 if none"""
+	need = args.bitrate + 2*args.fdev + 2*abs(offset)
+	for decfact in range(63, 0, -1):
+		bw = XTAL_FREQ/(160*decfact)
+		if bw >= need:
+			return bw
+	return 0
+
+def temp_profile():
+	"""Temperatures at the node every T_STEP"""
+	rnd = random.Random(args.seed)
+	walk = 0.0
+	temps = []
+	for i in range(int(args.days*86400/T_STEP)):
+		walk += rnd.gauss(0, args.temp_noise)*math.sqrt(T_STEP/60.0)
+		#Pulled back so that the swings stay around the daily cycle
+		walk *= 0.98
+		day = 2*math.pi*i*T_STEP/86400
+		temps.append(args.temp_mean - args.temp_swing*math.cos(day) + walk)
+	return temps
+
+def run(temps, interval):
+	"""Largest offset without and with the correction, and the exchanges"""
+	rnd = random.Random(args.seed + interval)
+	gw_ppm = xtal_ppm(args.gw_tolerance, args.gw_temp)
+	corr = 0.0
+	is_set = False
+	worst_raw = 0.0
+	worst_left = 0.0
+	exchanges = 0
+	next_t = 0
+	for i, temp in enumerate(temps):
+		offset = (xtal_ppm(args.tolerance, temp) - gw_ppm)*args.freq/1e6
+		left = offset - corr
+		worst_raw = max(worst_raw, abs(offset))
+		#Till the first exchange the node has no correction
+		if is_set:
+			worst_left = max(worst_left, abs(left))
+		if i*T_STEP < next_t:
+			continue
+		next_t += interval
+		exchanges += 1
+		est = round((left + rnd.gauss(0, args.est_noise))/FREQOFF_STEP)*FREQOFF_STEP
+		corr += est/args.gain_div if is_set else est
+		#Applied in steps of FREQOFF
+		corr = round(corr/FREQOFF_STEP)*FREQOFF_STEP
+		is_set = True
+	return worst_raw, worst_left, exchanges
+
+temps = temp_profile()
+print("Node from %.1f to %.1f C, %.0f Hz/ppm, signal of %.0f Hz"
+		% (min(temps), max(temps), args.freq/1e6, args.bitrate + 2*args.fdev))
+print("%10s %10s %10s %10s %10s %10s %10s" % ("Interval", "Exchanges",
+		"Offset", "Left", "BW", "BW", "Gain"))
+print("%10s %10s %10s %10s %10s %10s %10s" % ("s", "", "Hz", "Hz",
+		"uncorr Hz", "corr Hz", "dB"))
+for interval in [int(i) for i in args.intervals.split(",")]:
+	worst_raw, worst_left, exchanges = run(temps, interval)
+	bw_raw = rx_bw(worst_raw)
+	bw_left = rx_bw(worst_left)
+	if (bw_raw == 0) or (bw_left == 0):
+		print("%10d  the offset is beyond the widest RX filter" % interval)
+		continue
+	print("%10d %10d %10.0f %10.0f %10.0f %10.0f %10.1f" % (interval, exchanges,
+			worst_raw, worst_left, bw_raw, bw_left, 10*math.log10(bw_raw/bw_left)))
@@ -0,0 +1,282 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Simulation of the link adaptation of LRF nodes (rf_link_adapt) at a spread
+# of distances from the gateway, with the C module built for the host and
+# run through ctypes. The path loss is log-distance with a shadowing fixed
+# for each node and a fading for each packet. A packet is received if the
+# RSSI is above the sensitivity of its bit rate, with a soft edge. As in
+# lrf_node, the node sends at the power and rate of the adaptation and
+# listens for the feedback of the gateway after every few packets, which
+# become up to --feedback-max while the link is steady or at the fall back. The
+# charge per delivered packet is that of the TX and of the feedback RX, with
+# the typical currents of the CC1120, against the fixed maximum power.
+#
+# Before the simulation the power and rate programming of rf_comm is checked
+# at the register level: rf_comm.c is built for the host with an SPI stub
+# which keeps the registers of the radio, and the PA_CFG2 and SYMBOL_RATE
+# registers written after a reset are decoded as the CC112x does.
+# Needs a host C compiler, run from the root of the repository.
+# Usage:
+#   rf_link_adapt_sim.py [--distances 50,100,200,500,1000,2000,4000]
+#                        [--rates 1200:-125] [--max-pwr 14] [--min-pwr -3]
+#                        [--feedback-every 4] [--feedback-max 64]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import math
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="rf_link_adapt simulation")
+parser.add_argument("--distances", default="50,100,200,500,1000,2000,4000",
+		help="node distances in m, comma separated")
+parser.add_argument("--rates", default="1200:-125",
+		help="bit rates with the gateway sensitivity as bps:dBm from the most robust,"
+		" such as 300:-130,1200:-125,4800:-118,38400:-110")
+parser.add_argument("--max-pwr", type=int, default=14, help="maximum TX power in dBm")
+parser.add_argument("--min-pwr", type=int, default=-3, help="minimum TX power in dBm")
+parser.add_argument("--step", type=int, default=3, help="power step in dB")
+parser.add_argument("--target", type=int, default=10, help="target link margin in dB")
+parser.add_argument("--hysteresis", type=int, default=6, help="hysteresis in dB")
+parser.add_argument("--max-misses", type=int, default=3, help="misses before the fall back")
+parser.add_argument("--feedback-every", type=int, default=4,
+		help="packets between the feedbacks, lrf_node asks for it in the ack of an alive packet")
+parser.add_argument("--feedback-max", type=int, default=64,
+		help="packets between the feedbacks at most, doubled from --feedback-every while the link doesn't change")
+parser.add_argument("--gw-pwr", type=float, default=14, help="TX power of the gateway in dBm")
+parser.add_argument("--pl0", type=float, default=31, help="path loss at 1 m in dB")
+parser.add_argument("--exponent", type=float, default=3.0, help="path loss exponent")
+parser.add_argument("--shadowing", type=float, default=6, help="dB std. dev. for each node")
+parser.add_argument("--fading", type=float, default=3, help="dB std. dev. for each packet")
+parser.add_argument("--payload", type=int, default=15,
+		help="bytes after the length byte, with the rf_comm header")
+parser.add_argument("--overhead", type=int, default=11,
+		help="bytes of preamble, sync word, length and CRC")
+parser.add_argument("--feedback-bytes", type=int, default=26,
+		help="bytes on air of the feedback (LINK_FEEDBACK_PKT_BYTES)")
+parser.add_argument("--turnaround", type=float, default=10,
+		help="ms from the end of the packet till the feedback starts")
+parser.add_argument("--window-margin", type=float, default=150,
+		help="ms of the RX window beyond the feedback (LINK_FEEDBACK_MARGIN_MS)")
+parser.add_argument("--nodes", type=int, default=50, help="nodes at each distance")
+parser.add_argument("--packets", type=int, default=400, help="packets of each node")
+parser.add_argument("--i-rx", type=float, default=22.0, help="mA in RX")
+parser.add_argument("--seed", type=int, default=1, help="random seed")
+args = parser.parse_args()
+
+# Typical TX current of the CC1120 in mA at the TX power in dBm
+TX_CURRENT = [(-16, 18.0), (-6, 22.0), (0, 26.0), (10, 34.0), (14, 45.0)]
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform", "codebase/rf_lib",
+		"codebase/rf_lib/ti_radio_lib"]
+
+# Registers of the radio for rf_comm.c, 8 bit and extended address space
+SPI_STUB = r"""
+#include <stdint.h>
+#include <string.h>
+uint8_t regs[256], ext_regs[256];
+static void access (uint8_t * r, uint8_t type, uint8_t addr, uint8_t * p, uint32_t len)
+{
+	for(uint32_t i = 0; i < len; i++, addr += ((type & 0x40) ? 1 : 0))
+	{
+		if(type & 0x80) p[i] = r[addr]; else r[addr] = p[i];
+	}
+}
+uint8_t trx8BitRegAccess (uint8_t type, uint8_t addr, uint8_t * p, uint16_t len)
+{
+	access (regs, type, addr & 0x3F, p, len); return 0;
+}
+uint8_t trx16BitRegAccess (uint8_t type, uint8_t ext, uint8_t addr, uint8_t * p, uint8_t len)
+{
+	access (ext_regs, type, addr, p, len); return 0;
+}
+uint8_t trxSpiCmdStrobe (uint8_t cmd)
+{
+	if(cmd == 0x30)
+	{
+		/* SRES, the reset values of the registers checked */
+		memset (regs, 0, sizeof(regs));
+		regs[0x14] = 0x43; regs[0x15] = 0xA9; regs[0x16] = 0x2A; regs[0x2B] = 0x7F;
+	}
+	return 0;
+}
+uint32_t rf_spi_wait_ready (uint32_t timeout_us) { return 0; }
+void hal_nop_delay_us (uint32_t us) {}
+void hal_nop_delay_ms (uint32_t ms) {}
+void ms_timer_start (uint32_t id, uint32_t mode, uint32_t ticks, void (*h) (void)) {}
+void ms_timer_stop (uint32_t id) {}
+uint32_t random_num_below (uint32_t bound) { return 0; }
+"""
+
+NOP_DELAY_H = "#include <stdint.h>\nvoid hal_nop_delay_us (uint32_t us);\nvoid hal_nop_delay_ms (uint32_t ms);\n"
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	with open(os.path.join(tmp, "spi_stub.c"), "w") as f:
+		f.write(SPI_STUB)
+	# The delay of the HAL is in ARM assembly
+	with open(os.path.join(tmp, "hal_nop_delay.h"), "w") as f:
+		f.write(NOP_DELAY_H)
+	flags = ["-shared", "-fPIC", "-std=gnu11", "-w", "-U__linux__", "-U__linux", "-Ulinux",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832_XXAA", "-DBOARD_SENSEELE_PCB_REV2",
+			"-iquote", tmp] + ["-I" + i for i in INC]
+	comm = os.path.join(tmp, "rf_comm.so")
+	adapt = os.path.join(tmp, "rf_link_adapt.so")
+	subprocess.check_call([cc] + flags + ["codebase/rf_lib/ti_radio_lib/rf_comm.c",
+			os.path.join(tmp, "spi_stub.c"), "-o", comm])
+	subprocess.check_call([cc] + flags + ["codebase/rf_lib/rf_link_adapt.c", "-o", adapt])
+	return ctypes.CDLL(comm), ctypes.CDLL(adapt)
+
+def check_registers(comm, powers, bitrates):
+	regs = (ctypes.c_uint8 * 256).in_dll(comm, "regs")
+	comm.rf_comm_set_pwr.argtypes = [ctypes.c_int32]
+	comm.rf_comm_set_bitrate.argtypes = [ctypes.c_uint32]
+	fails = 0
+	for pwr in powers:
+		for bitrate in bitrates:
+			# From the reset values, as rf_comm_radio_init
+			comm.trxSpiCmdStrobe(0x30)
+			comm.rf_comm_set_bitrate(bitrate)
+			comm.rf_comm_set_pwr(pwr)
+			ramp = regs[0x2B] & 0x3F
+			got_pwr = (ramp + 1) / 2.0 - 18
+			srate_e = regs[0x14] >> 4
+			srate_m = ((regs[0x14] & 0x0F) << 16) | (regs[0x15] << 8) | regs[0x16]
+			got_rate = (2**20 + srate_m) * 2.0**srate_e / 2**39 * 32e6
+			if (got_pwr != min(pwr, 14)) or (abs(got_rate - bitrate) > 0.01 * bitrate):
+				print("  FAIL %d dBm %d bps : PA_CFG2 0x%02X -> %.1f dBm, SYMBOL_RATE"
+						" 0x%02X%02X%02X -> %.1f bps" % (pwr, bitrate, regs[0x2B],
+						got_pwr, regs[0x14], regs[0x15], regs[0x16], got_rate))
+				fails += 1
+	return fails
+
+class Rate(ctypes.Structure):
+	_fields_ = [("bitrate", ctypes.c_uint32), ("sensitivity_dbm", ctypes.c_int16)]
+
+class Config(ctypes.Structure):
+	_fields_ = [("min_pwr_dbm", ctypes.c_int8), ("max_pwr_dbm", ctypes.c_int8),
+			("pwr_step_db", ctypes.c_uint8), ("target_margin_db", ctypes.c_uint8),
+			("hysteresis_db", ctypes.c_uint8), ("max_misses", ctypes.c_uint8),
+			("p_rates", ctypes.POINTER(Rate)), ("rate_count", ctypes.c_uint32)]
+
+class Link(ctypes.Structure):
+	_fields_ = [("p_config", ctypes.POINTER(Config)), ("pwr_dbm", ctypes.c_int8),
+			("rate_idx", ctypes.c_uint8), ("misses", ctypes.c_uint8)]
+
+def tx_current(pwr):
+	for (p0, i0), (p1, i1) in zip(TX_CURRENT, TX_CURRENT[1:]):
+		if pwr <= p1:
+			return i0 + (i1 - i0) * (max(pwr, p0) - p0) / float(p1 - p0)
+	return TX_CURRENT[-1][1]
+
+def received(rssi, sensitivity):
+	# Soft edge of about 2 dB from no packets to all packets
+	return random.random() < 1 / (1 + math.exp(-(rssi - sensitivity) * 2))
+
+def simulate(adapt, config, rates, distance, adaptive):
+	# The same nodes for the fixed and the adaptive power
+	nodes = random.Random(args.seed)
+	random.seed(args.seed)
+	delivered = 0
+	charge = 0.0
+	pwr_sum = 0.0
+	sent = 0
+	for n in range(args.nodes):
+		loss = args.pl0 + 10 * args.exponent * math.log10(distance) \
+				+ nodes.gauss(0, args.shadowing)
+		link = Link()
+		adapt.rf_link_adapt_init(ctypes.byref(link), ctypes.byref(config))
+		every = args.feedback_every
+		since = 0
+		for k in range(args.packets):
+			pwr, (bitrate, sensitivity) = link.pwr_dbm, rates[link.rate_idx]
+			air_ms = (args.overhead + args.payload + 1) * 8 * 1000.0 / bitrate
+			charge += tx_current(pwr) * air_ms
+			pwr_sum += pwr
+			sent += 1
+			rssi = pwr - loss + random.gauss(0, args.fading)
+			is_rx = received(rssi, sensitivity)
+			delivered += is_rx
+			since += 1
+			if (adaptive == False) or (since < every):
+				continue
+			since = 0
+			fb_ms = args.feedback_bytes * 8 * 1000.0 / bitrate
+			gw_rssi = args.gw_pwr - loss + random.gauss(0, args.fading)
+			if is_rx and received(gw_rssi, sensitivity):
+				charge += args.i_rx * (args.turnaround + fb_ms)
+				is_changed = adapt.rf_link_adapt_feedback(ctypes.byref(link),
+						ctypes.c_int8(max(-128, int(round(rssi)))))
+			else:
+				charge += args.i_rx * (fb_ms + args.window_margin)
+				# A miss is checked again soon unless already at the fall back
+				is_changed = adapt.rf_link_adapt_miss(ctypes.byref(link)) \
+						or (link.pwr_dbm != args.max_pwr) or (link.rate_idx != 0)
+			every = args.feedback_every if is_changed else min(2 * every, args.feedback_max)
+	# mA x ms is uC
+	per_pkt = charge / delivered if delivered else float("inf")
+	return 100.0 * delivered / sent, pwr_sum / sent, per_pkt
+
+rates = [(int(b), int(s)) for b, s in (r.split(":") for r in args.rates.split(","))]
+distances = [float(d) for d in args.distances.split(",")]
+tmp = tempfile.mkdtemp()
+try:
+	comm, adapt = build(tmp)
+
+	powers = list(range(args.min_pwr, args.max_pwr + 1))
+	bitrates = sorted(set([b for b, s in rates] + [300, 600, 1200, 2400, 4800, 9600, 38400]))
+	print("Register check of rf_comm_set_pwr and rf_comm_set_bitrate, %d dBm to %d dBm, %s bps"
+			% (args.min_pwr, args.max_pwr, ",".join(str(b) for b in bitrates)))
+	fails = check_registers(comm, powers, bitrates)
+	print("  %d of %d settings wrong" % (fails, len(powers) * len(bitrates)))
+
+	adapt.rf_link_adapt_feedback.restype = ctypes.c_bool
+	adapt.rf_link_adapt_miss.restype = ctypes.c_bool
+	rate_arr = (Rate * len(rates))(*[Rate(b, s) for b, s in rates])
+	config = Config(args.min_pwr, args.max_pwr, args.step, args.target, args.hysteresis,
+			args.max_misses, rate_arr, len(rates))
+
+	print("\nDistance  Fixed %d dBm           Adaptive" % args.max_pwr)
+	print("     (m)  Delivered  uC/pkt    Delivered  Mean dBm  uC/pkt   Saving")
+	for d in distances:
+		f_dlv, f_pwr, f_q = simulate(adapt, config, rates, d, False)
+		a_dlv, a_pwr, a_q = simulate(adapt, config, rates, d, True)
+		print("%8d  %8.1f%%  %7.0f    %8.1f%%  %8.1f  %7.0f  %6.1f%%" % (d, f_dlv, f_q,
+				a_dlv, a_pwr, a_q, 100 * (1 - a_q / f_q) if f_q != float("inf") else 0))
+finally:
+	shutil.rmtree(tmp)
+
+sys.exit(1 if fails else 0)
@@ -0,0 +1,393 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Discrete event simulation of the reliable delivery of the events of LRF
+# nodes to the UART of the gateway, with rf_link_arq, rf_link_table and the
+# feedback packet of rf_link_adapt built for the host and run through
+# ctypes. As in lrf_node, a node checks every second, sends a packet with
+# the flags of the link after the listen before talk of rf_comm, listens for
+# the ack and sends the packet again with the same sequence number after the
+# backoff of rf_link_arq. As in lrf_gateway, the gateway acks at once with
+# the command kept for the node and drops a packet sent again which it got
+# before. The events of a node waiting for the packet before are queued.
+#
+# Each link loses packets as one of the channel models, besides the
+# collisions of the packets which overlap, including the acks:
+#   none       collisions only
+#   bernoulli  each packet lost with a fixed probability
+#   gilbert    bursts of loss, with the link in a good or a bad state for
+#              random times, the same state for both the directions
+# Each model is run without the retries and with them. The run fails if an
+# event is sent to the UART more than once, or if an event acked to its node
+# didn't reach the UART. The retries and the airtime of the nodes and of the
+# gateway are given per event delivered.
+# Needs a host C compiler, run from the root of the repository.
+# Usage:
+#   rf_link_arq_sim.py [--nodes 20] [--hours 6] [--interval 300] [--loss 0.2]
+#                      [--max-retries 5] [--min-backoff 2] [--max-backoff 16]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import heapq
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="rf_link_arq simulation")
+parser.add_argument("--nodes", type=int, default=20, help="number of nodes")
+parser.add_argument("--hours", type=float, default=6, help="simulated time")
+parser.add_argument("--interval", type=float, default=300,
+		help="mean s between the events of a node")
+parser.add_argument("--bursts", type=int, default=12,
+		help="common events in the simulated time when all the nodes have an event")
+parser.add_argument("--spread", type=float, default=2,
+		help="s within which the nodes have an event at a common event")
+parser.add_argument("--models", default="none,bernoulli,gilbert", help="channel models")
+parser.add_argument("--loss", type=float, default=0.2, help="loss of the bernoulli model")
+parser.add_argument("--good-s", type=float, default=120, help="mean s in the good state")
+parser.add_argument("--bad-s", type=float, default=15, help="mean s in the bad state")
+parser.add_argument("--loss-good", type=float, default=0.02, help="loss in the good state")
+parser.add_argument("--loss-bad", type=float, default=0.9, help="loss in the bad state")
+parser.add_argument("--hidden", type=float, default=0.1,
+		help="probability that two nodes can't hear each other")
+parser.add_argument("--max-retries", type=int, default=5, help="retries of a packet")
+parser.add_argument("--min-backoff", type=int, default=2, help="first backoff window in s")
+parser.add_argument("--max-backoff", type=int, default=16, help="largest backoff window in s")
+parser.add_argument("--bitrate", type=float, default=1200, help="bit rate in bps")
+parser.add_argument("--overhead", type=int, default=11,
+		help="bytes of preamble, sync word, length and CRC")
+parser.add_argument("--wakeup", type=float, default=50, help="ms for the TCXO at the wake up")
+parser.add_argument("--turnaround", type=float, default=10,
+		help="ms from the end of the packet till the ack starts")
+parser.add_argument("--window-margin", type=float, default=150,
+		help="ms of the RX window beyond the ack (LINK_FEEDBACK_MARGIN_MS)")
+parser.add_argument("--attempts", type=int, default=8, help="maximum clear channel checks")
+parser.add_argument("--min-csma", type=float, default=20, help="first CSMA backoff window in ms")
+parser.add_argument("--max-csma", type=float, default=2560, help="largest CSMA backoff window in ms")
+parser.add_argument("--sense", type=float, default=1.5, help="ms in RX for a carrier sense")
+parser.add_argument("--cmd-every", type=float, default=600,
+		help="s between the commands set for a node heard")
+parser.add_argument("--no-dup-filter", action="store_true",
+		help="send the packets sent again to the UART too, to see the check fail")
+parser.add_argument("--seed", type=int, default=1, help="seed of the random numbers")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform", "codebase/rf_lib"]
+
+RANDOM_STUB = r"""
+#include <stdint.h>
+static uint32_t state = 1;
+void random_stub_seed (uint32_t seed) { state = seed ? seed : 1; }
+uint32_t random_num_below (uint32_t bound)
+{
+	state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+	return bound ? (state % bound) : 0;
+}
+"""
+
+# As in rf_comm.h, rf_link_arq.h and rf_link_adapt.h
+HDR_LEN = 5
+FLAG_ACK_REQ = 0x01
+FLAG_RETX = 0x02
+FEEDBACK_ENTRY_LEN = 5
+FEEDBACK_PKT_BYTES = 4 + 4 + 1 + 5 + 10 + 2
+# The flags, then the event ID in place of the battery and the angle
+PAYLOAD_LEN = 3
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	with open(os.path.join(tmp, "random_stub.c"), "w") as f:
+		f.write(RANDOM_STUB)
+	flags = ["-shared", "-fPIC", "-std=gnu11", "-w", "-U__linux__", "-U__linux", "-Ulinux",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832_XXAA", "-DBOARD_SENSEELE_PCB_REV2",
+			"-iquote", tmp] + ["-I" + i for i in INC]
+	lib = os.path.join(tmp, "rf_link.so")
+	subprocess.check_call([cc] + flags + ["codebase/rf_lib/rf_link_arq.c",
+			"codebase/rf_lib/rf_link_table.c", "codebase/rf_lib/rf_link_adapt.c",
+			os.path.join(tmp, "random_stub.c"), "-o", lib])
+	return ctypes.CDLL(lib)
+
+class ArqConfig(ctypes.Structure):
+	_fields_ = [("max_retries", ctypes.c_uint8), ("min_backoff", ctypes.c_uint16),
+			("max_backoff", ctypes.c_uint16)]
+
+class ArqStats(ctypes.Structure):
+	_fields_ = [("sent", ctypes.c_uint32), ("retries", ctypes.c_uint32),
+			("acked", ctypes.c_uint32), ("dropped", ctypes.c_uint32)]
+
+class Arq(ctypes.Structure):
+	_fields_ = [("p_config", ctypes.POINTER(ArqConfig)), ("retries", ctypes.c_uint8),
+			("is_busy", ctypes.c_bool), ("ticks_left", ctypes.c_uint16), ("stats", ArqStats)]
+
+def air_ms(nbytes):
+	return nbytes * 8 * 1000.0 / args.bitrate
+
+class Channel(object):
+	"""Loss of the packets of the link of a node, in both directions"""
+	def __init__(self, model, rnd):
+		self.model, self.rnd = model, rnd
+		self.is_bad = False
+		self.next_switch = rnd.expovariate(1.0 / (args.good_s * 1000))
+
+	def lost(self, t):
+		if self.model == "bernoulli":
+			return self.rnd.random() < args.loss
+		if self.model == "gilbert":
+			while t >= self.next_switch:
+				self.is_bad = not self.is_bad
+				mean = args.bad_s if self.is_bad else args.good_s
+				self.next_switch += self.rnd.expovariate(1.0 / (mean * 1000))
+			return self.rnd.random() < (args.loss_bad if self.is_bad else args.loss_good)
+		return False
+
+class Node(object):
+	def __init__(self, idx, lib, config, channel):
+		self.dev_id = 0x100 + idx
+		self.arq = Arq()
+		lib.rf_link_arq_init(ctypes.byref(self.arq), ctypes.byref(config))
+		self.channel = channel
+		self.seq = 0xFF
+		self.events = []        # IDs of the events waiting to be sent
+		self.event = None       # ID of the event in the current packet
+		self.flags = 0
+		self.busy = False       # The radio is in a send or an RX window
+		self.window_end = 0
+		self.cmds = 0
+
+def simulate(lib, model, max_retries):
+	rnd = random.Random(args.seed)
+	lib.random_stub_seed(args.seed)
+	lib.rf_link_table_init()
+	duration = args.hours * 3600 * 1000.0
+	config = ArqConfig(max_retries, args.min_backoff, args.max_backoff)
+	nodes = [Node(i, lib, config, Channel(model, random.Random(args.seed * 1000 + i)))
+			for i in range(args.nodes)]
+	hidden = set()
+	for a in range(args.nodes):
+		for b in range(a + 1, args.nodes):
+			if rnd.random() < args.hidden:
+				hidden.update([(a, b), (b, a)])
+	pkt_ms = air_ms(args.overhead + HDR_LEN + PAYLOAD_LEN)
+
+	queue = []
+	def push(t, kind, node, *rest):
+		heapq.heappush(queue, (t, len(queue) + rnd.random(), kind, node) + rest)
+	next_event = [0]
+	def new_event(t, n):
+		push(t, "event", n, next_event[0])
+		next_event[0] += 1
+	for n in range(args.nodes):
+		push(rnd.uniform(0, 1000), "tick", n)
+		t = rnd.expovariate(1.0 / (args.interval * 1000))
+		while t < duration:
+			new_event(t, n)
+			t += rnd.expovariate(1.0 / (args.interval * 1000))
+	for i in range(args.bursts):
+		t = rnd.uniform(0, duration)
+		for n in range(args.nodes):
+			new_event(t + rnd.uniform(0, args.spread * 1000), n)
+	push(args.cmd_every * 1000, "cmd", None)
+
+	on_air = []             # [start, end, sender] with the gateway as -1
+	gw_busy_till = 0.0
+	uart = {}               # (node, event) : times sent to the UART
+	acked = set()
+	given_up = set()
+	tx_ms = ack_ms = 0.0
+	cmds_set = cmds_got = 0
+	arq_missed = lib.rf_link_arq_missed
+
+	def audible(sender, listener):
+		return (sender < 0) or (listener < 0) or ((sender, listener) not in hidden)
+
+	def overlapped(start, end, sender, listener):
+		return any(s != sender and a < end and b > start and audible(s, listener)
+				for a, b, s in on_air)
+
+	def give_up(n, node):
+		if node.event is not None:
+			given_up.add((n, node.event))
+		node.event = None
+
+	while queue:
+		entry = heapq.heappop(queue)
+		t, kind, n = entry[0], entry[2], entry[3]
+		if t > duration and kind in ("tick", "event", "cmd"):
+			continue
+		on_air = [s for s in on_air if s[1] > t - 5000]
+		node = nodes[n] if n is not None else None
+		if kind == "event":
+			node.events.append(entry[4])
+		elif kind == "tick":
+			push(t + 1000, "tick", n)
+			if node.busy:
+				continue
+			if lib.rf_link_arq_tick(ctypes.byref(node.arq)):
+				node.flags = FLAG_ACK_REQ | FLAG_RETX
+			elif node.events and not lib.rf_link_arq_is_busy(ctypes.byref(node.arq)):
+				give_up(n, node)
+				node.event = node.events.pop(0)
+				node.seq = (node.seq + 1) & 0xFF
+				node.flags = FLAG_ACK_REQ
+				lib.rf_link_arq_sent(ctypes.byref(node.arq))
+			else:
+				continue
+			node.busy = True
+			push(t + args.wakeup, "csma", n, 0)
+		elif kind == "csma":
+			tries = entry[4]
+			window = min(args.min_csma * 2 ** tries, args.max_csma)
+			push(t + 1 + rnd.uniform(0, window) + args.sense, "check", n, tries)
+		elif kind == "check":
+			tries = entry[4]
+			if any(a <= t - args.sense and b > t and audible(s, n) for a, b, s in on_air):
+				if tries + 1 < args.attempts:
+					push(t, "csma", n, tries + 1)
+				else:
+					# The tx failed handler, a retry like a missed ack
+					if not arq_missed(ctypes.byref(node.arq)):
+						give_up(n, node)
+					node.busy = False
+				continue
+			on_air.append((t, t + pkt_ms, n))
+			tx_ms += pkt_ms
+			push(t + pkt_ms, "tx_end", n, t)
+		elif kind == "tx_end":
+			start = entry[4]
+			node.window_end = t + air_ms(FEEDBACK_PKT_BYTES) + args.window_margin
+			push(node.window_end, "window_end", n, node.seq, node.flags)
+			if (start < gw_busy_till) or overlapped(start, t, n, -1) \
+					or node.channel.lost(t):
+				continue
+			# The rx_pkt_handler of lrf_gateway
+			is_dup = bool(node.flags & FLAG_RETX) and \
+					lib.rf_link_table_is_dup(node.dev_id, node.seq)
+			lib.rf_link_table_update(node.dev_id, 0, node.seq, -90, 0, int(t / 1000))
+			if node.flags & FLAG_ACK_REQ:
+				payload = (ctypes.c_uint8 * FEEDBACK_ENTRY_LEN)()
+				cmd = lib.rf_link_table_cmd_get(node.dev_id)
+				length = lib.rf_link_feedback_put(payload, 0, node.dev_id, node.seq, -90, cmd)
+				ack = air_ms(args.overhead + HDR_LEN + length)
+				gw_busy_till = t + args.turnaround + ack
+				on_air.append((t + args.turnaround, gw_busy_till, -1))
+				ack_ms += ack
+				push(gw_busy_till, "ack_end", n, t + args.turnaround, payload, length)
+			if (not is_dup) or args.no_dup_filter:
+				key = (n, node.event)
+				uart[key] = uart.get(key, 0) + 1
+		elif kind == "ack_end":
+			start, payload, length = entry[4], entry[5], entry[6]
+			if (not node.busy) or (t > node.window_end) or overlapped(start, t, -1, n) \
+					or node.channel.lost(t):
+				continue
+			rssi, cmd = ctypes.c_int8(), ctypes.c_uint8()
+			if lib.rf_link_feedback_find(payload, length, node.dev_id, node.seq,
+					ctypes.byref(rssi), ctypes.byref(cmd)):
+				lib.rf_link_arq_acked(ctypes.byref(node.arq))
+				acked.add((n, node.event))
+				node.event = None
+				cmds_got += cmd.value != 0
+				node.busy = False
+		elif kind == "window_end":
+			# The rx failed handler if the window wasn't closed by the ack
+			if node.busy and node.seq == entry[4] and t == node.window_end:
+				if not arq_missed(ctypes.byref(node.arq)):
+					give_up(n, node)
+				node.busy = False
+		elif kind == "cmd":
+			push(t + args.cmd_every * 1000, "cmd", None)
+			cmds_set += lib.rf_link_table_cmd_set(0x100 + rnd.randrange(args.nodes),
+					rnd.randint(1, 2))
+
+	events = next_event[0]
+	delivered = len(uart)
+	dups = sum(c - 1 for c in uart.values())
+	unsent = sum(len(node.events) for node in nodes)
+	retries = sum(node.arq.stats.retries for node in nodes)
+	lost_acked = len([k for k in acked if k not in uart])
+	return {
+		"events": events - unsent,
+		"delivered": delivered,
+		"dups": dups,
+		"lost_acked": lost_acked,
+		"given_up": len([k for k in given_up if k not in uart]),
+		"retries": retries,
+		"tx_ms": tx_ms,
+		"ack_ms": ack_ms,
+		"cmds_set": cmds_set,
+		"cmds_got": cmds_got,
+	}
+
+tmp = tempfile.mkdtemp()
+fails = 0
+try:
+	lib = build(tmp)
+	for name, restype in (("rf_link_arq_tick", ctypes.c_bool),
+			("rf_link_arq_missed", ctypes.c_bool), ("rf_link_arq_is_busy", ctypes.c_bool),
+			("rf_link_table_is_dup", ctypes.c_bool), ("rf_link_table_cmd_set", ctypes.c_bool),
+			("rf_link_table_cmd_get", ctypes.c_uint8), ("rf_link_feedback_find", ctypes.c_bool),
+			("rf_link_feedback_put", ctypes.c_uint32)):
+		getattr(lib, name).restype = restype
+	lib.rf_link_table_update.argtypes = [ctypes.c_uint16, ctypes.c_uint8, ctypes.c_uint8,
+			ctypes.c_int8, ctypes.c_uint8, ctypes.c_uint32]
+	lib.rf_link_table_is_dup.argtypes = [ctypes.c_uint16, ctypes.c_uint8]
+	lib.rf_link_table_cmd_set.argtypes = [ctypes.c_uint16, ctypes.c_uint8]
+	lib.rf_link_table_cmd_get.argtypes = [ctypes.c_uint16]
+	lib.rf_link_feedback_put.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint16,
+			ctypes.c_uint8, ctypes.c_int8, ctypes.c_uint8]
+	lib.rf_link_feedback_find.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint16,
+			ctypes.c_uint8, ctypes.c_void_p, ctypes.c_void_p]
+	lib.random_stub_seed.argtypes = [ctypes.c_uint32]
+
+	print("%d nodes, %.0f h, an event every %.0f s and %d common events, packet %.0f ms,"
+			" %.0f%% hidden pairs" % (args.nodes, args.hours, args.interval, args.bursts,
+			air_ms(args.overhead + HDR_LEN + PAYLOAD_LEN), args.hidden * 100))
+	print("%-10s %-8s %7s %9s %5s %6s %10s %9s %9s %7s" % ("Channel", "Retries", "events",
+			"delivered", "dups", "lost", "retries/ev", "node ms/ev", "gw ms/ev", "cmds"))
+	for model in args.models.split(","):
+		for max_retries in (0, args.max_retries):
+			r = simulate(lib, model, max_retries)
+			dlv = max(r["delivered"], 1)
+			print("%-10s %-8d %7d %8.1f%% %5d %6d %10.2f %10.1f %9.1f %3d/%-3d" % (model,
+					max_retries, r["events"], 100.0 * r["delivered"] / max(r["events"], 1),
+					r["dups"], r["given_up"], float(r["retries"]) / dlv, r["tx_ms"] / dlv,
+					r["ack_ms"] / dlv, r["cmds_got"], r["cmds_set"]))
+			if r["dups"] or r["lost_acked"]:
+				print("  FAIL %d events sent to the UART again, %d acked but not sent to"
+						" the UART" % (r["dups"], r["lost_acked"]))
+				fails += 1
+finally:
+	shutil.rmtree(tmp)
+
+sys.exit(1 if fails else 0)
@@ -0,0 +1,314 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of the link table of the LRF gateway (codebase/rf_lib/rf_link_table.c)
+# with synthetic packet streams. Each stream is the packets of a node with
+# their sequence numbers, RSSI and LQI, of which some are lost as given by a
+# pattern:
+#   periodic   every nth packet lost
+#   bernoulli  each packet lost with a fixed probability
+#   gilbert    bursts of loss, from a good and a bad state
+#   dups       packets received twice, as when an ack is lost
+#   restart    the node restarts its sequence numbers after a while
+# The packets of the nodes are interleaved as a gateway would hear them and
+# the table is checked against a model in Python of the counts, the loss
+# from the gaps in the sequence numbers through their wrap, the smoothed
+# RSSI and LQI and the least recently heard node replaced when the table is
+# full. The time of an update is measured in C for a few and for a full
+# table of nodes, and with a node replaced at each packet.
+#
+# Needs a host C compiler, run from the root of the repository.
+# Usage:
+#   rf_link_table_test.py [--nodes 300] [--packets 2000] [--seed 1] [-v]
+
+from __future__ import print_function
+import argparse
+import collections
+import ctypes
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="rf_link_table packet stream test")
+parser.add_argument("--nodes", type=int, default=300, help="nodes heard, more than the table")
+parser.add_argument("--packets", type=int, default=2000, help="packets sent by each node")
+parser.add_argument("--seed", type=int, default=1, help="seed of the streams")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+TABLE_SIZE = 256
+EWMA_SHIFT = 3
+MAX_SEQ_GAP = 127
+
+BENCH = r"""
+#include <stdint.h>
+#include <time.h>
+#include "rf_link_table.h"
+
+/* ns per update of n packets from the nodes in ids in turn */
+double host_bench (const uint16_t * ids, uint32_t n_ids, uint32_t n)
+{
+	struct timespec t0, t1;
+	uint8_t seq = 0;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	for(uint32_t i = 0; i < n; i++)
+	{
+		if((i % n_ids) == 0)
+		{
+			seq++;
+		}
+		rf_link_table_update (ids[i % n_ids], 1, seq, -80, 10, i);
+	}
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n;
+}
+"""
+
+class Stats(ctypes.Structure):
+	_fields_ = [("dev_id", ctypes.c_uint16), ("app_id", ctypes.c_uint8),
+			("last_seq", ctypes.c_uint8), ("rssi_x16", ctypes.c_int16),
+			("lqi_x16", ctypes.c_uint16), ("rx_count", ctypes.c_uint32),
+			("lost_count", ctypes.c_uint32), ("dup_count", ctypes.c_uint32),
+			("last_seen", ctypes.c_uint32), ("freq_off_hz", ctypes.c_int32)]
+
+FIELDS = ["last_seq", "rssi_x16", "lqi_x16", "rx_count", "lost_count", "dup_count",
+		"last_seen"]
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	with open(os.path.join(tmp, "bench.c"), "w") as f:
+		f.write(BENCH)
+	so = os.path.join(tmp, "rf_link_table.so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w",
+			"-Icodebase/rf_lib", "codebase/rf_lib/rf_link_table.c",
+			os.path.join(tmp, "bench.c"), "-o", so])
+	lib = ctypes.CDLL(so)
+	lib.rf_link_table_update.restype = ctypes.POINTER(Stats)
+	lib.rf_link_table_update.argtypes = [ctypes.c_uint16, ctypes.c_uint8, ctypes.c_uint8,
+			ctypes.c_int8, ctypes.c_uint8, ctypes.c_uint32]
+	lib.rf_link_table_find.restype = ctypes.POINTER(Stats)
+	lib.rf_link_table_find.argtypes = [ctypes.c_uint16]
+	lib.rf_link_loss_pct.argtypes = [ctypes.POINTER(Stats)]
+	lib.host_bench.restype = ctypes.c_double
+	lib.host_bench.argtypes = [ctypes.POINTER(ctypes.c_uint16), ctypes.c_uint32,
+			ctypes.c_uint32]
+	return lib
+
+def c_div(a, b):
+	"""Division of C, truncated towards zero"""
+	q = abs(a) // abs(b)
+	return q if (a >= 0) == (b > 0) else -q
+
+def s16(v):
+	return ((v + 0x8000) & 0xFFFF) - 0x8000
+
+class Model(object):
+	"""The statistics of the nodes and the order in which they were heard"""
+	def __init__(self):
+		self.nodes = collections.OrderedDict()
+		self.evictions = 0
+
+	def update(self, dev, seq, rssi, lqi, now):
+		s = self.nodes.pop(dev, None)
+		if s is None:
+			if len(self.nodes) == TABLE_SIZE:
+				self.nodes.popitem(last=False)
+				self.evictions += 1
+			s = dict(last_seq=seq, rssi_x16=rssi * 16, lqi_x16=lqi * 16, rx_count=1,
+					lost_count=0, dup_count=0, last_seen=now)
+			self.nodes[dev] = s
+			return
+		self.nodes[dev] = s
+		s["last_seen"] = now
+		gap = (seq - s["last_seq"]) & 0xFF
+		if gap == 0:
+			s["dup_count"] += 1
+			return
+		if gap <= MAX_SEQ_GAP:
+			s["lost_count"] += gap - 1
+		s["rssi_x16"] = s16(s["rssi_x16"] + c_div(rssi * 16 - s["rssi_x16"], 1 << EWMA_SHIFT))
+		s["lqi_x16"] = (s["lqi_x16"] + c_div(lqi * 16 - s["lqi_x16"], 1 << EWMA_SHIFT)) & 0xFFFF
+		s["last_seq"] = seq
+		s["rx_count"] += 1
+
+def stream(rnd, pattern, n):
+	"""(seq, times received) of the n packets sent by a node"""
+	seq = rnd.randrange(256)
+	bad = False
+	out = []
+	for i in range(n):
+		times = 1
+		if pattern == "periodic":
+			times = 0 if (i % 5) == 4 else 1
+		elif pattern == "bernoulli":
+			times = 0 if rnd.random() < 0.2 else 1
+		elif pattern == "gilbert":
+			# Bursts of 10 packets lost on average
+			bad = (rnd.random() < 0.9) if bad else (rnd.random() < 0.02)
+			times = 0 if bad else 1
+		elif pattern == "dups":
+			times = 2 if rnd.random() < 0.1 else 1
+		elif pattern == "restart" and i == n // 2:
+			seq = (seq + 128 + rnd.randrange(100)) & 0xFF
+		out.append((seq, times))
+		seq = (seq + 1) & 0xFF
+	return out
+
+PATTERNS = ["none", "periodic", "bernoulli", "gilbert", "dups", "restart"]
+
+def interleave(rnd, nodes, n):
+	"""The packets of the nodes in the order heard, a node sending at
+	random times around its period"""
+	events = []
+	for k, (dev, pattern) in enumerate(nodes):
+		t = rnd.uniform(0, 300)
+		rssi = -60 - rnd.randrange(50)
+		for seq, times in stream(rnd, pattern, n):
+			t += rnd.uniform(250, 350)
+			for r in range(times):
+				events.append((t + r, dev, seq, max(-128, rssi + rnd.randrange(-8, 9)),
+						rnd.randrange(5, 60)))
+	events.sort()
+	return events
+
+tmp = tempfile.mkdtemp()
+try:
+	lib = build(tmp)
+	fails = 0
+
+	def check(name, cond, detail=""):
+		global fails
+		print("  %-4s %s" % ("PASS" if cond else "FAIL", name)
+				+ ((" : " + detail) if (args.verbose and not cond and detail) else ""))
+		if not cond:
+			fails += 1
+
+	def compare(model, devs):
+		bad = []
+		for dev in devs:
+			p = lib.rf_link_table_find(dev)
+			want = model.nodes.get(dev)
+			if (not p) != (want is None):
+				bad.append((dev, "present" if p else "missing"))
+			elif p:
+				got = dict((f, getattr(p.contents, f)) for f in FIELDS)
+				if got != want:
+					bad.append((dev, got, want))
+		return bad
+
+	rnd = random.Random(args.seed)
+
+	# One node per pattern, alone in the table
+	ok, detail = True, []
+	for pattern in PATTERNS:
+		lib.rf_link_table_init()
+		model = Model()
+		dev = 0x1000
+		sent = 0
+		for t, d, seq, rssi, lqi in interleave(rnd, [(dev, pattern)], args.packets):
+			lib.rf_link_table_update(dev, 0x22, seq, rssi, lqi, int(t))
+			model.update(dev, seq, rssi, lqi, int(t))
+		p = lib.rf_link_table_find(dev).contents
+		pct = lib.rf_link_loss_pct(ctypes.byref(p))
+		bad = compare(model, [dev])
+		if pattern == "periodic":
+			# A loss is only seen with the next packet received
+			lost = (args.packets - 1) // 5
+			bad += [] if (p.lost_count == lost
+					and pct == 100 * lost // (p.rx_count + lost)) else ["loss"]
+		elif pattern in ("none", "dups", "restart"):
+			bad += [] if p.lost_count == 0 else ["loss"]
+		if pattern == "dups":
+			bad += [] if p.rx_count == args.packets and p.dup_count > 0 else ["dups"]
+		ok = ok and not bad
+		detail.append((pattern, p.rx_count, p.lost_count, p.dup_count, pct, bad[:3]))
+		if args.verbose:
+			print("  INFO %-9s rx %5d lost %5d dup %4d loss %3d%% RSSI %.1f dBm"
+					% (pattern, p.rx_count, p.lost_count, p.dup_count, pct,
+					p.rssi_x16 / 16.0))
+	check("statistics of a node with each loss pattern", ok, repr(detail))
+
+	# The smoothed RSSI after a step, within 1 dB in 40 packets
+	lib.rf_link_table_init()
+	for i in range(40):
+		p = lib.rf_link_table_update(7, 0x22, i, -60 if i == 0 else -90, 10, i).contents
+	check("smoothed RSSI follows a step of 30 dB", abs(p.rssi_x16 / 16.0 + 90) < 1,
+			"%.2f dBm" % (p.rssi_x16 / 16.0))
+
+	# All the patterns interleaved, with more nodes than the table
+	lib.rf_link_table_init()
+	model = Model()
+	nodes = [(rnd.randrange(0x10000), PATTERNS[k % len(PATTERNS)]) for k in range(args.nodes)]
+	nodes = list(dict(nodes).items())
+	devs = [d for d, p in nodes]
+	# Most of the nodes heard at first, the others join later
+	early = devs[:TABLE_SIZE - 16]
+	events = interleave(rnd, [n for n in nodes if n[0] in early], args.packets // 4)
+	late = interleave(rnd, [n for n in nodes if n[0] not in early], 50)
+	t_end = events[-1][0]
+	events += [(t + t_end, d, s, r, l) for t, d, s, r, l in late]
+	mismatch = []
+	for i, (t, dev, seq, rssi, lqi) in enumerate(events):
+		lib.rf_link_table_update(dev, 0x22, seq, rssi, lqi, int(t))
+		model.update(dev, seq, rssi, lqi, int(t))
+		if (i % 997) == 0:
+			mismatch += compare(model, devs)
+	mismatch += compare(model, devs)
+	check("interleaved streams of %d nodes match the model" % len(devs), not mismatch,
+			repr(mismatch[:3]))
+	check("least recently heard nodes replaced when full",
+			lib.rf_link_table_count() == TABLE_SIZE
+			and lib.rf_link_table_evictions() == model.evictions > 0,
+			"count %d evictions %d model %d" % (lib.rf_link_table_count(),
+			lib.rf_link_table_evictions(), model.evictions))
+
+	# The time of an update
+	ns = {}
+	for name, n_ids, consecutive in (("8 nodes", 8, True), ("256 nodes", 256, True),
+			("256 random IDs", 256, False), ("512 nodes, replaced", 512, True)):
+		ids = list(range(0x4000, 0x4000 + n_ids)) if consecutive \
+				else rnd.sample(range(0x10000), n_ids)
+		arr = (ctypes.c_uint16 * n_ids)(*ids)
+		best = None
+		for r in range(5):
+			lib.rf_link_table_init()
+			t = lib.host_bench(arr, n_ids, 200000)
+			best = t if best is None else min(best, t)
+		ns[name] = best
+		print("  INFO update with %-20s %.1f ns" % (name, best))
+	check("update time doesn't grow with the nodes",
+			max(ns["256 nodes"], ns["256 random IDs"]) < 4 * ns["8 nodes"] + 20,
+			repr(ns))
+	print("%d failed" % fails)
+finally:
+	shutil.rmtree(tmp)
+sys.exit(1 if fails else 0)
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Estimates the average current of a CC112x in the low power listen mode of
+# rf_comm (rf_comm_listen_start) and the latency of a packet sent to it with
+# rf_comm_pkt_send_wake, for listen intervals from 100 ms to 2 s. Every
+# interval the radio wakes from sleep, starts the XOSC, settles the
+# synthesizer and stays in RX till the RSSI is valid to check for a carrier.
+# The currents are typical values from the CC1120 datasheet.
+# The latency is from the start of the send to the end of the packet.
+# Usage:
+#   rf_wor_calc.py [--bitrate 300] [--payload 15] [--cs-symbols 8]
+#                  [--intervals 100,200,500,1000,2000]
+
+from __future__ import print_function
+import argparse
+
+parser = argparse.ArgumentParser(description="CC112x eWOR duty cycle calculator")
+parser.add_argument("--bitrate", type=float, default=300, help="bit rate in bps")
+parser.add_argument("--payload", type=int, default=15,
+		help="bytes after the length byte, with the rf_comm header")
+parser.add_argument("--preamble", type=int, default=4, help="preamble bytes of a normal packet")
+parser.add_argument("--sync", type=int, default=4, help="sync word bytes")
+parser.add_argument("--cs-symbols", type=float, default=8,
+		help="symbols in RX till the RSSI is valid for carrier sense")
+parser.add_argument("--margin", type=float, default=20,
+		help="ms of preamble beyond the interval (RF_COMM_WAKE_MARGIN_MS)")
+parser.add_argument("--intervals", default="100,200,500,1000,2000",
+		help="listen intervals in ms, comma separated")
+parser.add_argument("--i-sleep", type=float, default=0.0005, help="mA in sleep with the eWOR timer")
+parser.add_argument("--i-idle", type=float, default=1.5, help="mA while the XOSC starts and settles")
+parser.add_argument("--i-rx", type=float, default=22.0, help="mA in RX")
+parser.add_argument("--i-tx", type=float, default=45.0, help="mA in TX at +14 dBm")
+args = parser.parse_args()
+
+RCOSC_FREQ = 32000.0
+#EVENT1 of 4 RCOSC periods and the XOSC start up, in s
+T_XOSC = 4/RCOSC_FREQ + 0.0003
+#Calibration and settling of the synthesizer before RX, in s
+T_SETTLE = 0.0004
+
+t_cs = args.cs_symbols/args.bitrate
+#Length byte, payload and the two CRC bytes
+t_pkt = (args.preamble + args.sync + 1 + args.payload + 2)*8/args.bitrate
+#Charge in mA.s of one sniff without a carrier
+q_sniff = T_XOSC*args.i_idle + (T_SETTLE + t_cs)*args.i_rx
+t_sniff = T_XOSC + T_SETTLE + t_cs
+
+print("Bit rate %d bps, sniff of %.2f ms, packet of %.1f ms"
+		% (args.bitrate, t_sniff*1000, t_pkt*1000))
+print("Continuous RX: %.0f uA" % (args.i_rx*1000))
+print("%10s %8s %10s %10s %12s %14s" % ("Interval", "Duty", "Average",
+		"Latency", "Rx per pkt", "Sender charge"))
+print("%10s %8s %10s %10s %12s %14s" % ("ms", "%", "uA", "ms", "ms", "mC per pkt"))
+for interval in [float(i) for i in args.intervals.split(",")]:
+	period = interval/1000
+	if t_sniff >= period:
+		print("%10d  the sniff is longer than the interval" % interval)
+		continue
+	i_avg = (q_sniff + (period - t_sniff)*args.i_sleep)/period
+	#The packet is sent after the whole preamble, which is caught on average
+	#half way by the receiver, which then stays in RX till the packet ends
+	t_preamble = period + args.margin/1000
+	latency = t_preamble + t_pkt
+	t_rx = t_preamble/2 + t_pkt
+	q_tx = latency*args.i_tx
+	print("%10d %8.2f %10.1f %10.0f %12.0f %14.1f" % (interval,
+			100*t_sniff/period, i_avg*1000, latency*1000, t_rx*1000, q_tx))
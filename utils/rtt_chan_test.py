@@ -0,0 +1,426 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Test of the RTT channels (codebase/segger_rtt/rtt_chan.c) with SEGGER_RTT.c
+# and its control block in the memory of the host. The producers are host
+# threads and the critical region is a lock, nested as nrf_util's is, so
+# that only one producer at a time is between a reserve and its commit, as
+# on the target with the interrupts disabled. Another thread is the J-Link:
+# it reads the up rings without the lock, at a limited rate, and moves
+# their read offsets as the host does.
+#
+# The producers write numbered records whose content follows from their
+# number:
+# - Two on the log channel with rtt_chan_write.
+# - One on the data channel writing in its reserved span directly, which
+#   also holds a span of the log channel at the same time, committed
+#   before its own.
+# - One on channel 2 configured to block.
+#
+# Checked:
+# - Every record read by the host is whole and in order for its producer.
+# - The records missing on the drop channels are the bytes counted as
+#   dropped, and none are missing on the blocking channel.
+# - The bytes read are the bytes counted as committed.
+# - Holding two spans at once doesn't leave the critical region held.
+# - RTT_CHAN_OVERWRITE, which races with the host, needs
+#   RTT_CHAN_OVERWRITE_UNSAFE.
+#
+# The throughput of each channel is printed.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   rtt_chan_test.py [--records 20000] [--gap-us 50] [--host-kbps 1000] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="RTT channels in-memory control block test")
+parser.add_argument("--records", type=int, default=20000, help="records per producer")
+parser.add_argument("--gap-us", type=int, default=50, help="pause of a producer between records")
+parser.add_argument("--host-kbps", type=int, default=1000,
+		help="rate at which the host reads all the channels, in kB/s")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "codebase/segger_rtt"]
+
+CHANNELS = 3
+PRODUCERS = 5
+# Producer of each record stream and its channel
+PRODUCER_CHAN = [0, 0, 1, 0, 2]
+
+HARNESS = r"""
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "rtt_chan.h"
+
+#define CHANNELS    3
+#define PRODUCERS   5
+
+/* The critical region, held by one producer at a time */
+static pthread_mutex_t cr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t cr_owner;
+static volatile int cr_held;
+
+uint32_t host_assert;
+uint32_t host_stuck;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    __atomic_add_fetch(&host_assert, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Nested as nrf_util_critical_region_enter, given up after a second so
+ * that a region left held fails the test instead of hanging it. The
+ * producers then stop. */
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    if(cr_held && pthread_equal(cr_owner, pthread_self()))
+    {
+        *is_critical_entered = 1;
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 1;
+    if(pthread_mutex_timedlock(&cr_lock, &ts) != 0)
+    {
+        __atomic_add_fetch(&host_stuck, 1, __ATOMIC_SEQ_CST);
+        *is_critical_entered = 1;
+        return;
+    }
+    cr_owner = pthread_self();
+    cr_held = 1;
+    *is_critical_entered = 0;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+    if(is_critical_entered == 0)
+    {
+        cr_held = 0;
+        pthread_mutex_unlock(&cr_lock);
+    }
+}
+
+static uint8_t cmd_buf[256];
+static uint32_t records;
+static struct timespec gap;
+static volatile int producers_done;
+
+/* Length of a record with its 4 byte header */
+static uint32_t rec_len (uint32_t prod, uint32_t seq)
+{
+    return 4 + (seq * 13 + prod * 5) % 60;
+}
+
+static void rec_fill (uint8_t * p, uint32_t prod, uint32_t seq, uint32_t len)
+{
+    p[0] = prod;
+    p[1] = len;
+    p[2] = seq & 0xFF;
+    p[3] = seq >> 8;
+    for(uint32_t i = 4; i < len; i++)
+    {
+        p[i] = (seq * 7 + i + prod) & 0xFF;
+    }
+}
+
+/* Copy a record into a span, byte by byte as a producer filling it */
+static void span_fill (rtt_chan_span_t * span, uint32_t prod, uint32_t seq, uint32_t len)
+{
+    uint8_t rec[64];
+    rec_fill(rec, prod, seq, len);
+    memcpy(span->ptr[0], rec, span->len[0]);
+    memcpy(span->ptr[1], rec + span->len[0], span->len[1]);
+}
+
+static void * writer (void * arg)
+{
+    uint32_t prod = (uintptr_t) arg;
+    uint32_t chan = (prod == 4) ? 2 : 0;
+    uint8_t rec[64];
+    for(uint32_t seq = 0; (seq < records) && (host_stuck == 0); seq++)
+    {
+        uint32_t len = rec_len(prod, seq);
+        rec_fill(rec, prod, seq, len);
+        (void) rtt_chan_write(chan, rec, len);
+        nanosleep(&gap, NULL);
+    }
+    return NULL;
+}
+
+/* Producer 2 on the data channel, holding a span of producer 3 on the log
+ * channel within its own */
+static void * zero_copy (void * arg)
+{
+    for(uint32_t seq = 0; (seq < records) && (host_stuck == 0); seq++)
+    {
+        rtt_chan_span_t data, log;
+        uint32_t len = rec_len(2, seq);
+        if(rtt_chan_reserve(1, len, &data))
+        {
+            uint32_t log_len = rec_len(3, seq);
+            if(rtt_chan_reserve(0, log_len, &log))
+            {
+                span_fill(&log, 3, seq, log_len);
+                rtt_chan_commit(&log);
+            }
+            span_fill(&data, 2, seq, len);
+            rtt_chan_commit(&data);
+        }
+        else
+        {
+            /* Producer 3 writes its record alone */
+            uint8_t rec[64];
+            uint32_t log_len = rec_len(3, seq);
+            rec_fill(rec, 3, seq, log_len);
+            (void) rtt_chan_write(0, rec, log_len);
+        }
+        nanosleep(&gap, NULL);
+    }
+    return NULL;
+}
+
+/* What the host read of each channel */
+uint8_t * host_read_buf[CHANNELS];
+uint32_t host_read_size[CHANNELS];
+uint32_t host_read_len[CHANNELS];
+double host_seconds;
+
+/* The J-Link, reading the rings at a limited rate */
+static void * reader (void * arg)
+{
+    uint32_t bytes_per_ms = (uintptr_t) arg;
+    struct timespec period = { 0, 1000000 };
+    int idle = 0;
+    uint32_t first = 0;
+    while(1)
+    {
+        uint32_t budget = bytes_per_ms;
+        uint32_t got = 0;
+        /* Starting from the next channel on each poll, as the budget can
+         * run out before the last */
+        first = (first + 1) % CHANNELS;
+        for(uint32_t n = 0; n < CHANNELS && budget; n++)
+        {
+            uint32_t c = (first + n) % CHANNELS;
+            SEGGER_RTT_BUFFER_UP * ring = &_SEGGER_RTT.aUp[c];
+            uint32_t wr = __atomic_load_n(&ring->WrOff, __ATOMIC_ACQUIRE);
+            uint32_t rd = ring->RdOff;
+            while(rd != wr && budget)
+            {
+                if(host_read_len[c] < host_read_size[c])
+                {
+                    host_read_buf[c][host_read_len[c]++] = ring->pBuffer[rd];
+                }
+                rd = (rd + 1 == ring->SizeOfBuffer) ? 0 : rd + 1;
+                budget--;
+                got++;
+            }
+            __atomic_store_n(&ring->RdOff, rd, __ATOMIC_RELEASE);
+        }
+        if(producers_done && got == 0 && ++idle > 2)
+        {
+            break;
+        }
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+void host_run (uint32_t n, uint32_t gap_us, uint32_t bytes_per_ms)
+{
+    pthread_t prod[PRODUCERS], rd;
+    struct timespec t0, t1;
+
+    records = n;
+    gap.tv_nsec = gap_us * 1000;
+    rtt_chan_init();
+    rtt_chan_up_config(2, "Block", cmd_buf, sizeof(cmd_buf), RTT_CHAN_BLOCK);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_create(&rd, NULL, reader, (void *) (uintptr_t) bytes_per_ms);
+    pthread_create(&prod[0], NULL, writer, (void *) 0);
+    pthread_create(&prod[1], NULL, writer, (void *) 1);
+    pthread_create(&prod[2], NULL, zero_copy, NULL);
+    pthread_create(&prod[4], NULL, writer, (void *) 4);
+    pthread_join(prod[0], NULL);
+    pthread_join(prod[1], NULL);
+    pthread_join(prod[2], NULL);
+    pthread_join(prod[4], NULL);
+    producers_done = 1;
+    pthread_join(rd, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    host_seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+}
+"""
+
+class Stats(ctypes.Structure):
+	_fields_ = [("bytes", ctypes.c_uint32), ("dropped", ctypes.c_uint32),
+			("overwritten", ctypes.c_uint32)]
+
+def rec_len(prod, seq):
+	return 4 + (seq * 13 + prod * 5) % 60
+
+def rec_ok(rec, prod, seq):
+	return all(rec[i] == (seq * 7 + i + prod) & 0xFF for i in range(4, len(rec)))
+
+class Suite(object):
+	def __init__(self):
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def parse(self, data, chan):
+		"""The records of a channel, with the problems found"""
+		next_seq = {}
+		missing = {}
+		errors = []
+		pos = 0
+		while pos + 4 <= len(data):
+			prod, ln, seq = data[pos], data[pos + 1], data[pos + 2] | (data[pos + 3] << 8)
+			if prod >= PRODUCERS or PRODUCER_CHAN[prod] != chan or ln < 4 or \
+					pos + ln > len(data):
+				errors.append("bad header at %d" % pos)
+				break
+			exp = next_seq.get(prod, 0)
+			if seq < exp or ln != rec_len(prod, seq) or not rec_ok(data[pos:pos + ln], prod, seq):
+				errors.append("record %d of producer %d broken at %d" % (seq, prod, pos))
+				break
+			missing[prod] = missing.get(prod, 0) + sum(rec_len(prod, s) for s in range(exp, seq))
+			next_seq[prod] = seq + 1
+			pos += ln
+		if pos != len(data) and not errors:
+			errors.append("%d bytes after the last record" % (len(data) - pos))
+		for prod, exp in next_seq.items():
+			missing[prod] = missing.get(prod, 0) + \
+					sum(rec_len(prod, s) for s in range(exp, args.records))
+		for prod in range(PRODUCERS):
+			if PRODUCER_CHAN[prod] == chan and prod not in next_seq:
+				missing[prod] = sum(rec_len(prod, s) for s in range(args.records))
+		return missing, errors
+
+	def test_channels(self, lib):
+		size = 64 * args.records * PRODUCERS
+		bufs = [ctypes.create_string_buffer(size) for _ in range(CHANNELS)]
+		read_buf = (ctypes.c_void_p * CHANNELS).in_dll(lib, "host_read_buf")
+		read_size = (ctypes.c_uint32 * CHANNELS).in_dll(lib, "host_read_size")
+		for c in range(CHANNELS):
+			read_buf[c] = ctypes.cast(bufs[c], ctypes.c_void_p).value
+			read_size[c] = size
+		lib.host_run(args.records, args.gap_us, args.host_kbps)
+		read_len = (ctypes.c_uint32 * CHANNELS).in_dll(lib, "host_read_len")
+		seconds = ctypes.c_double.in_dll(lib, "host_seconds").value
+		stuck = ctypes.c_uint32.in_dll(lib, "host_stuck").value
+
+		whole, counted, committed = [], [], []
+		for c in range(CHANNELS):
+			data = bytearray(bufs[c].raw[:read_len[c]])
+			missing, errors = self.parse(data, c)
+			stats = Stats()
+			lib.rtt_chan_get_stats(c, ctypes.byref(stats))
+			whole += ["channel %d: %s" % (c, e) for e in errors]
+			lost = sum(missing.values())
+			if lost != stats.dropped:
+				counted.append("channel %d: %d bytes missing, %d dropped" %
+						(c, lost, stats.dropped))
+			if read_len[c] != stats.bytes:
+				committed.append("channel %d: %d bytes read, %d committed" %
+						(c, read_len[c], stats.bytes))
+			print("    channel %d: %.1f kB/s read, %d bytes dropped, %d overwritten" %
+					(c, read_len[c] / seconds / 1000, stats.dropped, stats.overwritten))
+
+		self.check("every record read whole and in order", not whole, "; ".join(whole))
+		self.check("bytes missing on each channel counted as dropped", not counted,
+				"; ".join(counted))
+		stats = Stats()
+		lib.rtt_chan_get_stats(2, ctypes.byref(stats))
+		self.check("no bytes dropped on the blocking channel", stats.dropped == 0 and
+				read_len[2] == sum(rec_len(4, s) for s in range(args.records)))
+		self.check("bytes read are the bytes committed", not committed, "; ".join(committed))
+		self.check("critical region released with two spans held", stuck == 0,
+				"%d waits given up" % stuck)
+
+	def test_overwrite_opt_in(self, tmp):
+		src = os.path.join(tmp, "overwrite.c")
+		with open(src, "w") as f:
+			f.write('#include "rtt_chan.h"\nint policy = RTT_CHAN_OVERWRITE;\n')
+		def compiles(flags):
+			return subprocess.call([os.environ.get("CC", "cc"), "-fsyntax-only", "-std=gnu11",
+					"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832", "-DNRF52832_XXAA"] + flags +
+					["-I" + i for i in INC] + [src], stderr=open(os.devnull, "w")) == 0
+		self.check("RTT_CHAN_OVERWRITE only with RTT_CHAN_OVERWRITE_UNSAFE",
+				not compiles([]) and compiles(["-DRTT_CHAN_OVERWRITE_UNSAFE=1"]))
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	# The barrier of the commit as a fence of the host
+	src = os.path.join(tmp, "rtt_chan.c")
+	with open(src, "w") as f:
+		f.write(open("codebase/segger_rtt/rtt_chan.c").read().replace(
+				"__DMB();", "__atomic_thread_fence(__ATOMIC_SEQ_CST);"))
+	with open(os.path.join(tmp, "harness.c"), "w") as f:
+		f.write(HARNESS)
+	so = os.path.join(tmp, "rtt_chan.so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-pthread",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832", "-DNRF52832_XXAA",
+			"-iquote", tmp] + ["-I" + i for i in INC] + ["-o", so,
+			os.path.join(tmp, "harness.c"), src, "codebase/segger_rtt/SEGGER_RTT.c"])
+	return ctypes.CDLL(so)
+
+def main():
+	tmp = tempfile.mkdtemp()
+	try:
+		lib = build(tmp)
+		suite = Suite()
+		suite.test_channels(lib)
+		suite.test_overwrite_opt_in(tmp)
+		suite.check("no asserts", ctypes.c_uint32.in_dll(lib, "host_assert").value == 0)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()
@@ -27,72 +27,156 @@
 # ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 # POSSIBILITY OF SUCH DAMAGE.
 
+# Shows the RTT channels of the target. The channel 0 of the text logs is
+# read from the telnet port of the J-Link RTT server, on which lines can also
+# be typed to the commands of the down channel 0 (see rtt_chan.h). Each other
+# channel given is read with JLinkRTTLogger into a file in /tmp, and is
+# shown prefixed with its number if it is text, or only counted if binary.
+# The bytes per second of each channel are shown every few seconds and on
+# exit. Usage:
+#   rtt_logger.py <nrf51 | nrf52> [<channel>:<text | bin> ...]
+# e.g. rtt_logger.py nrf52 1:bin
+
+from __future__ import print_function
 import socket
 import datetime
-import subprocess,time,sys,os
+import subprocess,time,sys,os,select
 
-if len(sys.argv)<2:
-	print "Enter the first argument as either 'nrf51' or 'nrf52'"
+JLINK_DIR = "/opt/SEGGER/JLink"
+#Interval in s at which the throughput of the channels is shown
+REPORT_INTERVAL = 5
+
+def usage():
+	print("Usage: rtt_logger.py <nrf51 | nrf52> [<channel>:<text | bin> ...]")
 	sys.exit(0)
 
+if len(sys.argv)<2:
+	usage()
+
 device = sys.argv[1]
 
 if (device != "nrf51") and (device != "nrf52"):
-	print "Enter the first argument as either 'nrf51' or 'nrf52'"
-	sys.exit(0)
+	usage()
+
+class Channel(object):
+	"""An RTT up channel with the count of its bytes for the throughput"""
+	def __init__(self, number, is_text):
+		self.number = number
+		self.is_text = is_text
+		self.bytes = 0
+		self.total = 0
+		self.partial = ""
+		self.proc = None
+		self.file = None
+
+channels = [Channel(0, True)]
+for arg in sys.argv[2:]:
+	try:
+		number, kind = arg.split(":")
+		channels.append(Channel(int(number), kind == "text"))
+	except ValueError:
+		usage()
+	if kind not in ("text", "bin") or channels[-1].number == 0:
+		usage()
 
 #Start the JLinkExe so that the RTT server is started
-print "Starting Server..."
-subprocess.call("/opt/SEGGER/JLink/JLinkExe -If swd -device " + device + " -speed 4000 -AutoConnect 1 &",shell=True)
+print("Starting Server...")
+subprocess.call(JLINK_DIR + "/JLinkExe -If swd -device " + device + " -speed 4000 -AutoConnect 1 &",shell=True)
 time.sleep(1)
 
+#Start a logger for each of the other channels
+for ch in channels[1:]:
+	path = "/tmp/rtt_channel_%d.bin" % ch.number
+	open(path, "wb").close()
+	ch.proc = subprocess.Popen([JLINK_DIR + "/JLinkRTTLogger", "-Device", device,
+			"-If", "SWD", "-Speed", "4000", "-RTTChannel", str(ch.number), path],
+			stdout=open(os.devnull, "w"), stderr=subprocess.STDOUT)
+	ch.file = open(path, "rb")
+	print("Logging channel %d to %s" % (ch.number, path))
+
 # Create a TCP/IP socket
 sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
 
 # Bind the socket to the port
 server_address = ('localhost', 19021)
 
-print "Connecting to the server @",server_address
+print("Connecting to the server @",server_address)
 sock.connect(server_address)
+sock.setblocking(0)
 
 time.sleep(1)
 
 past = 0
 base = 0
+start = time.time()
+last_report = start
+
+def show(ch, rcv):
+	"""Print the complete lines of a text channel with the time stamp"""
+	global past, base
+	#Set base time as the time when first character is received
+	if not base:
+		base = time.time()
+
+	current = time.time()
+	elapsed = current - base
+	delta = elapsed - past
+	past = elapsed
+
+	current_str = datetime.datetime.now().strftime("%H:%M:%S.%f")
+	prefix = "" if ch.number == 0 else "<%d> " % ch.number
+	lines = (ch.partial + rcv).split("\n")
+	ch.partial = lines.pop()
+	for line in lines:
+		print("[%s %2.6f] %s%s" % (current_str, delta, prefix, line.rstrip()))
+
+def report(period):
+	msg = ", ".join("ch%d %.1f B/s" % (ch.number, ch.bytes/period) for ch in channels)
+	print("---- " + msg)
+	for ch in channels:
+		ch.total += ch.bytes
+		ch.bytes = 0
+
+def stop():
+	for ch in channels[1:]:
+		ch.proc.terminate()
+	print("Total bytes: " + ", ".join("ch%d %d" % (ch.number, ch.total) for ch in channels))
+	print("Disconnecting socket and killing JLinkExe\n")
+	os.system("pkill JLinkExe")
+	time.sleep(1)
+	sys.exit(0)
 
 try:
 	while True:
-    	#read up to 1000 bytes from the socket (the max amount)
-		rcv=sock.recv(1000)
-    	#we didn't get any data.
-		if rcv=="":
-			continue
-
-    	#Set base time as the time when first character is received
-		if not base:
-			base = time.time()
-
-		current = time.time()
-		elapsed = current - base
-		delta = elapsed - past
-		past = elapsed 
-		
-		current_str = datetime.datetime.now().strftime("%H:%M:%S.%f")
-		print_msg = "[%s %2.6f] " % (current_str, delta)
-		print (print_msg + rcv).strip()
+		readable, _, _ = select.select([sock, sys.stdin], [], [], 0.1)
+		if sock in readable:
+			#read up to 1000 bytes from the socket (the max amount)
+			rcv = sock.recv(1000)
+			if rcv:
+				channels[0].bytes += len(rcv)
+				show(channels[0], rcv.decode("latin-1"))
+		if sys.stdin in readable:
+			#Send the line typed to the commands of the down channel 0
+			sock.sendall(sys.stdin.readline().encode("latin-1"))
+
+		for ch in channels[1:]:
+			rcv = ch.file.read()
+			if rcv:
+				ch.bytes += len(rcv)
+				if ch.is_text:
+					show(ch, rcv.decode("latin-1"))
+
+		now = time.time()
+		if now - last_report >= REPORT_INTERVAL:
+			report(now - last_report)
+			last_report = now
 
 #On Ctrl + C
 except KeyboardInterrupt:
-	print "Disconnecting socket and killing JLinkExe\n"
-	del sock
-	os.system("pkill JLinkExe")
-	time.sleep(1)
-	sys.exit(0)
+	report(time.time() - last_report)
+	stop()
 
 #On any exception
 except Exception as e:
-	print "Exception: " + str(e) + "\nDisconnecting socket and killing JLinkExe\n"
-	del sock
-	os.system("pkill JLinkExe")
-	time.sleep(1)
-	sys.exit(0)
+	print("Exception: " + str(e))
+	stop()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Decodes the binary frames of the saadc_logger application's streaming mode
+# (SAADC_LOG_STREAM) to CSV. The input is a capture of the RTT channel 1, e.g.
+#   JLinkRTTLogger -Device NRF52832_XXAA -If SWD -Speed 4000 -RTTChannel 1 capture.bin
+# or a dump of the UARTE. Usage:
+#   saadc_stream_decode.py <capture.bin | -> [output.csv]
+
+from __future__ import print_function
+import struct,sys
+
+SYNC = b'\x5a\xa5'
+# len, seq, timestamp, lost, ch_mask, ch_count, period
+HEADER = struct.Struct('<HIIIBBH')
+RTC_FREQ = 32768.0
+TIMER_FREQ = 16000000.0
+
+def fletcher16(data):
+	sum1 = 0
+	sum2 = 0
+	for b in bytearray(data):
+		sum1 = (sum1 + b) % 255
+		sum2 = (sum2 + sum1) % 255
+	return (sum2 << 8) | sum1
+
+def frames(data):
+	"""Yields the valid frames in data, resyncing after corrupt ones"""
+	idx = 0
+	while True:
+		idx = data.find(SYNC, idx)
+		if idx < 0 or idx + 2 + HEADER.size > len(data):
+			return
+		start = idx + 2
+		length, seq, timestamp, lost, ch_mask, ch_count, period = \
+			HEADER.unpack_from(data, start)
+		end = start + HEADER.size + length
+		if ch_count == 0 or end + 2 > len(data):
+			idx += 1
+			continue
+		checksum, = struct.unpack_from('<H', data, end)
+		if checksum != fletcher16(data[start:end]):
+			sys.stderr.write("Checksum error at byte %d, resyncing\n" % idx)
+			idx += 1
+			continue
+		samples = struct.unpack_from('<%dh' % (length // 2), data, start + HEADER.size)
+		yield seq, timestamp, lost, ch_mask, ch_count, period, samples
+		idx = end + 2
+
+def main():
+	if len(sys.argv) < 2:
+		print("Usage: %s <capture.bin | -> [output.csv]" % sys.argv[0])
+		sys.exit(0)
+
+	if sys.argv[1] == '-':
+		data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+	else:
+		data = open(sys.argv[1], 'rb').read()
+
+	out = open(sys.argv[2], 'w') if len(sys.argv) > 2 else sys.stdout
+
+	next_seq = None
+	gaps = 0
+	count = 0
+	lost = 0
+	header_done = False
+
+	for seq, timestamp, lost, ch_mask, ch_count, period, samples in frames(data):
+		if not header_done:
+			channels = [i for i in range(8) if ch_mask & (1 << i)]
+			out.write("seq,rtc_time_s,sample,time_s," +
+				",".join("ch%d" % ch for ch in channels) + "\n")
+			header_done = True
+
+		if next_seq is not None and seq != next_seq:
+			gaps += (seq - next_seq) & 0xFFFFFFFF
+			sys.stderr.write("Gap of %d blocks before seq %d\n" %
+				((seq - next_seq) & 0xFFFFFFFF, seq))
+		next_seq = (seq + 1) & 0xFFFFFFFF
+		count += 1
+
+		rounds = len(samples) // ch_count
+		for r in range(rounds):
+			sample_idx = seq * rounds + r
+			out.write("%d,%.6f,%d,%.7f,%s\n" % (seq, timestamp / RTC_FREQ, sample_idx,
+				sample_idx * period / TIMER_FREQ,
+				",".join(str(v) for v in samples[r*ch_count:(r+1)*ch_count])))
+
+	sys.stderr.write("Frames: %d, blocks missing in capture: %d, blocks lost on device: %d\n"
+		% (count, gaps, lost))
+
+if __name__ == '__main__':
+	main()
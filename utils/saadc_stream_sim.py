@@ -0,0 +1,411 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Simulation of the streaming mode (SAADC_LOG_STREAM) of the saadc_logger
+# application with the RTT sink. The main.c of the application is built for
+# the host with a stub of SEGGER_RTT that models the 4 kB up buffer in the
+# NO_BLOCK_SKIP mode, drained by the host at a given rate. A model of the
+# SAADC fills the block at the EasyDMA pointer latched at each START with a
+# known ramp, raises END and, as the PPI does, START of the next block, and
+# then calls the SAADC_IRQHandler. The main loop runs after every interrupt.
+# The capture is decoded with the frame parser of saadc_stream_decode.py.
+#
+# At 10, 50 and 100 kS/s with a sink that keeps up, there must be no sequence
+# gaps, no blocks lost on the device, every sample of the ramp in place and
+# the EasyDMA must never write a block that is waiting to be sent. With a
+# sink slower than the stream the lost count in the frames must match the
+# gaps in the capture, so that the losses are always reported.
+#
+# The SAADC, TIMER, RTC, PPI and NVIC registers are at fixed addresses, so
+# the pages of the nRF52 peripherals are mapped at them, which needs Linux.
+# Needs a host C compiler, run from the root of the repository.
+# Usage:
+#   saadc_stream_sim.py [--seconds 2] [--sink-rate 1000] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from saadc_stream_decode import frames
+
+parser = argparse.ArgumentParser(description="saadc_logger streaming simulation")
+parser.add_argument("--seconds", type=float, default=2, help="simulated time of each run")
+parser.add_argument("--sink-rate", type=float, default=1000,
+		help="rate in kB/s at which the host reads the RTT buffer")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules", "platform", "application/saadc_logger"]
+
+RATES = [10000, 50000, 100000]
+
+# The application with main renamed and access to its statics for the host
+WRAP = r"""
+#include "nrf.h"
+void host_wfi (void);
+#define main saadc_logger_main
+#define __WFI host_wfi
+#include "main.c"
+void host_wfi (void) { }
+void host_init (void) { saadc_init(); }
+void host_process (void) { stream_process(); }
+void * host_ring (uint32_t i) { return stream_ring[i].samples; }
+void * host_discard (void) { return stream_discard; }
+uint32_t host_pending (void) { return stream.put - stream.get; }
+uint32_t host_block_len (void) { return STREAM_BLOCK_LEN; }
+uint32_t host_block_count (void) { return STREAM_BLOCK_COUNT; }
+"""
+
+# The RTT up buffer as a count of bytes, the bytes written go to the capture
+STUB = r"""
+#include <stdint.h>
+#include <string.h>
+#include "hal_saadc.h"
+#define CAPTURE_SIZE (16*1024*1024)
+uint8_t host_capture[CAPTURE_SIZE];
+uint32_t host_capture_len;
+static uint32_t rtt_size, rtt_used;
+int SEGGER_RTT_ConfigUpBuffer (unsigned idx, const char * name, void * buf,
+		unsigned size, unsigned flags)
+{
+	rtt_size = size; rtt_used = 0; host_capture_len = 0;
+	return 0;
+}
+unsigned SEGGER_RTT_Write (unsigned idx, const void * buf, unsigned len)
+{
+	/* One byte of the ring is always free in RTT */
+	if(rtt_size - 1 - rtt_used < len || host_capture_len + len > CAPTURE_SIZE)
+	{
+		return 0;
+	}
+	memcpy(host_capture + host_capture_len, buf, len);
+	host_capture_len += len;
+	rtt_used += len;
+	return len;
+}
+void host_rtt_drain (uint32_t len)
+{
+	rtt_used = (len > rtt_used) ? 0 : rtt_used - len;
+}
+uint32_t host_rtt_used (void) { return rtt_used; }
+void nrf_saadc_channel_init (uint8_t channel, nrf_saadc_channel_config_t const * const config) { }
+void log_init (void) { }
+void log_printf (const char * fmt, ...) { }
+void lfclk_init (uint32_t src) { }
+"""
+
+# The part of the nrf_saadc.h of the SDK that the application uses
+SAADC_H = r"""
+#include <stdbool.h>
+#include <stdint.h>
+#include "nrf.h"
+typedef enum {NRF_SAADC_RESISTOR_DISABLED} nrf_saadc_resistor_t;
+typedef enum {NRF_SAADC_GAIN1 = 5, NRF_SAADC_GAIN4 = 7} nrf_saadc_gain_t;
+typedef enum {NRF_SAADC_REFERENCE_INTERNAL} nrf_saadc_reference_t;
+typedef enum {NRF_SAADC_ACQTIME_3US, NRF_SAADC_ACQTIME_10US = 2} nrf_saadc_acqtime_t;
+typedef enum {NRF_SAADC_MODE_DIFFERENTIAL = 1} nrf_saadc_mode_t;
+typedef enum {NRF_SAADC_BURST_DISABLED, NRF_SAADC_BURST_ENABLED} nrf_saadc_burst_t;
+typedef enum {NRF_SAADC_INPUT_DISABLED} nrf_saadc_input_t;
+typedef enum {NRF_SAADC_RESOLUTION_12BIT = 2} nrf_saadc_resolution_t;
+typedef enum {NRF_SAADC_OVERSAMPLE_DISABLED} nrf_saadc_oversample_t;
+typedef enum {NRF_SAADC_EVENT_STARTED = 0x100, NRF_SAADC_EVENT_END = 0x104,
+	NRF_SAADC_EVENT_DONE = 0x108, NRF_SAADC_EVENT_RESULTDONE = 0x10C,
+	NRF_SAADC_EVENT_STOPPED = 0x114, NRF_SAADC_EVENT_CH0_LIMITH = 0x118,
+	NRF_SAADC_EVENT_CH0_LIMITL = 0x11C, NRF_SAADC_EVENT_CH1_LIMITH = 0x120,
+	NRF_SAADC_EVENT_CH1_LIMITL = 0x124} nrf_saadc_event_t;
+enum {NRF_SAADC_INT_STARTED = 1, NRF_SAADC_INT_END = 2,
+	NRF_SAADC_INT_CH0LIMITH = 1 << 6, NRF_SAADC_INT_CH0LIMITL = 1 << 7};
+typedef struct { nrf_saadc_resistor_t resistor_p, resistor_n; nrf_saadc_gain_t gain;
+	nrf_saadc_reference_t reference; nrf_saadc_acqtime_t acq_time; nrf_saadc_mode_t mode;
+	nrf_saadc_burst_t burst; uint32_t pin_p, pin_n; } nrf_saadc_channel_config_t;
+void nrf_saadc_channel_init (uint8_t ch, nrf_saadc_channel_config_t const * const c);
+static inline volatile uint32_t * nrf_saadc_reg (uint32_t offset)
+{
+	return (volatile uint32_t *) ((uintptr_t) NRF_SAADC_BASE + offset);
+}
+static inline bool nrf_saadc_event_check (nrf_saadc_event_t e) { return *nrf_saadc_reg(e); }
+static inline void nrf_saadc_event_clear (nrf_saadc_event_t e) { *nrf_saadc_reg(e) = 0; }
+static inline void nrf_saadc_int_enable (uint32_t m) { NRF_SAADC->INTENSET = m; }
+static inline void nrf_saadc_enable (void) { NRF_SAADC->ENABLE = 1; }
+static inline void nrf_saadc_disable (void) { NRF_SAADC->ENABLE = 0; }
+static inline void nrf_saadc_resolution_set (nrf_saadc_resolution_t r) { NRF_SAADC->RESOLUTION = r; }
+static inline void nrf_saadc_oversample_set (nrf_saadc_oversample_t o) { NRF_SAADC->OVERSAMPLE = o; }
+static inline void nrf_saadc_channel_limits_set (uint8_t ch, int16_t l, int16_t h) { }
+static inline void nrf_saadc_channel_input_set (uint8_t ch, nrf_saadc_input_t p,
+	nrf_saadc_input_t n) { }
+/* EasyDMA has 32 bit pointers, the host resolves them against the buffers */
+static inline void nrf_saadc_buffer_init (int16_t * b, uint32_t n)
+{
+	NRF_SAADC->RESULT.PTR = (uint32_t) (uintptr_t) b;
+	NRF_SAADC->RESULT.MAXCNT = n;
+}
+"""
+
+RTT_H = r"""
+#define SEGGER_RTT_MODE_NO_BLOCK_SKIP 0
+int SEGGER_RTT_ConfigUpBuffer (unsigned idx, const char * name, void * buf,
+		unsigned size, unsigned flags);
+unsigned SEGGER_RTT_Write (unsigned idx, const void * buf, unsigned len);
+"""
+
+NOP_DELAY_H = "#include <stdint.h>\nvoid hal_nop_delay_us (uint32_t us);\nvoid hal_nop_delay_ms (uint32_t ms);\n"
+
+# nRF52 peripherals used in the streaming mode
+SAADC_BASE = 0x40007000
+TIMER1_BASE = 0x40009000
+RTC0_BASE = 0x4000B000
+PPI_BASE = 0x4001F000
+SCS_BASE = 0xE000E000
+PAGE = 0x1000
+
+SAADC_TASKS_START = SAADC_BASE + 0x000
+SAADC_TASKS_SAMPLE = SAADC_BASE + 0x004
+SAADC_EVENTS_STARTED = SAADC_BASE + 0x100
+SAADC_EVENTS_END = SAADC_BASE + 0x104
+SAADC_INTEN = SAADC_BASE + 0x304
+SAADC_RESULT_PTR = SAADC_BASE + 0x62C
+SAADC_RESULT_MAXCNT = SAADC_BASE + 0x630
+TIMER1_EVENTS_COMPARE0 = TIMER1_BASE + 0x140
+TIMER1_SHORTS = TIMER1_BASE + 0x200
+TIMER1_CC0 = TIMER1_BASE + 0x540
+RTC0_COUNTER = RTC0_BASE + 0x504
+PPI_CH_EEP = PPI_BASE + 0x510
+
+INTEN_STARTED = 1 << 0
+INTEN_END = 1 << 1
+RTC_FREQ = 32768
+TIMER_FREQ = 16000000
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_peripherals():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	for base in (SAADC_BASE, TIMER1_BASE, RTC0_BASE, PPI_BASE, SCS_BASE):
+		if libc.mmap(base, PAGE, 3, 0x22 | 0x100000, -1, 0) != base:
+			sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % base)
+
+def clear_peripherals():
+	for base in (SAADC_BASE, TIMER1_BASE, RTC0_BASE, PPI_BASE):
+		ctypes.memset(base, 0, PAGE)
+
+def build(tmp, rate):
+	cc = os.environ.get("CC", "cc")
+	for name, text in (("wrap.c", WRAP), ("stub.c", STUB), ("SEGGER_RTT.h", RTT_H),
+			("nrf_saadc.h", SAADC_H),
+			("hal_nop_delay.h", NOP_DELAY_H)):
+		with open(os.path.join(tmp, name), "w") as f:
+			f.write(text)
+	flags = ["-shared", "-fPIC", "-std=gnu11", "-w", "-U__linux__", "-U__linux", "-Ulinux",
+			"-U__unix", "-U__unix__", "-Uunix", "-DNRF52832", "-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3",
+			"-DSAADC_LOG_STREAM", "-DSTREAM_SINK_RTT", "-DSTREAM_SAMPLE_FREQ=%d" % rate,
+			"-iquote", tmp] + ["-I" + i for i in INC]
+	so = os.path.join(tmp, "saadc_logger_%d.so" % rate)
+	subprocess.check_call([cc] + flags + [os.path.join(tmp, "wrap.c"),
+			os.path.join(tmp, "stub.c"), "-o", so])
+	return ctypes.CDLL(so)
+
+def ramp(k):
+	"""The 12 bit differential sample the model gives for the sample number k"""
+	return (k % 4096) - 2048
+
+class Stream(object):
+	"""The SAADC with the PPI of the application and the host reading the RTT"""
+	def __init__(self, lib, rate, sink_rate):
+		self.lib = lib
+		self.rate = rate
+		self.sink_rate = sink_rate
+		lib.host_ring.restype = ctypes.c_void_p
+		lib.host_discard.restype = ctypes.c_void_p
+		self.block_len = lib.host_block_len()
+		self.count = lib.host_block_count()
+		self.ring = [lib.host_ring(i) for i in range(self.count)]
+		self.discard = lib.host_discard()
+		self.block_s = float(self.block_len) / rate
+		self.sample = 0
+		self.filled = 0
+		self.collisions = 0
+		self.max_pending = 0
+		self.now = 0.0
+
+	def buffer(self):
+		"""The buffer at the EasyDMA pointer, which has the low 32 bits of the address"""
+		ptr = reg(SAADC_RESULT_PTR).value
+		for addr in self.ring + [self.discard]:
+			if addr & 0xFFFFFFFF == ptr:
+				return addr
+		sys.exit("EasyDMA pointer 0x%08X isn't a block of the ring" % ptr)
+
+	def start(self):
+		"""The START task, latching the pointer and the count"""
+		self.cur = self.buffer()
+		self.maxcnt = reg(SAADC_RESULT_MAXCNT).value
+		reg(SAADC_EVENTS_STARTED).value = 1
+
+	def irq(self):
+		reg(RTC0_COUNTER).value = int(self.now * RTC_FREQ) & 0xFFFFFF
+		if reg(SAADC_INTEN).value & (INTEN_STARTED | INTEN_END):
+			self.lib.SAADC_IRQHandler()
+		self.max_pending = max(self.max_pending, self.lib.host_pending())
+		# The main loop runs after the WFI
+		self.lib.host_process()
+
+	def fill(self):
+		"""The SAMPLE tasks of a block from the TIMER, then END and START by PPI"""
+		if self.cur != self.discard:
+			idx = self.ring.index(self.cur)
+			pending = self.lib.host_pending()
+			get = (self.filled - pending) % self.count
+			if any((get + i) % self.count == idx for i in range(pending)):
+				self.collisions += 1
+		buf = (ctypes.c_int16 * self.maxcnt).from_address(self.cur)
+		for i in range(self.maxcnt):
+			buf[i] = ramp(self.sample + i)
+		self.sample += self.maxcnt
+		if self.cur != self.discard:
+			self.filled += 1
+		reg(SAADC_EVENTS_END).value = 1
+		self.start()
+
+	def run(self, seconds):
+		clear_peripherals()
+		self.lib.host_init()
+		if reg(SAADC_TASKS_START).value != 1:
+			sys.exit("saadc_init didn't start the SAADC")
+		self.start()
+		self.irq()
+		while self.now < seconds:
+			self.now += self.block_s
+			self.lib.host_rtt_drain(int(self.sink_rate * self.block_s))
+			self.fill()
+			self.irq()
+		data = ctypes.string_at(ctypes.addressof(ctypes.c_uint8.in_dll(self.lib, "host_capture")),
+				ctypes.c_uint32.in_dll(self.lib, "host_capture_len").value)
+		return list(frames(data))
+
+class Suite(object):
+	def __init__(self):
+		self.fails = 0
+
+	def check(self, name, cond, detail=""):
+		print("  %-4s %s" % ("PASS" if cond else "FAIL", name))
+		if not cond:
+			self.fails += 1
+			if args.verbose and detail:
+				print("       " + detail)
+
+	def analyse(self, stream, got):
+		gaps = 0
+		bad_samples = 0
+		bad_time = 0
+		lost_match = True
+		next_seq = 0
+		block_ticks = stream.block_s * RTC_FREQ
+		for seq, timestamp, lost, ch_mask, ch_count, period, samples in got:
+			gaps += seq - next_seq
+			next_seq = seq + 1
+			lost_match = lost_match and lost == gaps
+			first = seq * stream.block_len
+			bad_samples += sum(1 for i, v in enumerate(samples) if v != ramp(first + i))
+			if abs(timestamp - (seq + 1) * block_ticks) > 1:
+				bad_time += 1
+		return gaps, bad_samples, bad_time, lost_match
+
+	def run_rate(self, lib, rate):
+		stream = Stream(lib, rate, args.sink_rate * 1000)
+		got = stream.run(args.seconds)
+		gaps, bad_samples, bad_time, lost_match = self.analyse(stream, got)
+		blocks = stream.sample // stream.block_len
+		print("%d kS/s, %.0f kB/s stream to a %.0f kB/s sink: %d blocks, %d frames, "
+				"at most %d of %d blocks waiting" % (rate // 1000,
+				rate * 2 / 1000.0, args.sink_rate, blocks, len(got),
+				stream.max_pending, stream.count))
+		period = TIMER_FREQ // rate
+		self.check("TIMER paces the SAMPLE task through PPI",
+				reg(TIMER1_CC0).value == period and reg(TIMER1_SHORTS).value & 1
+				and reg(PPI_CH_EEP).value == TIMER1_EVENTS_COMPARE0
+				and reg(PPI_CH_EEP + 4).value == SAADC_TASKS_SAMPLE,
+				"CC0 %d SHORTS 0x%X" % (reg(TIMER1_CC0).value, reg(TIMER1_SHORTS).value))
+		self.check("END restarts the SAADC through PPI",
+				reg(PPI_CH_EEP + 8).value == SAADC_EVENTS_END
+				and reg(PPI_CH_EEP + 12).value == SAADC_TASKS_START)
+		self.check("frames of all the blocks but those in the ring",
+				blocks - stream.count <= len(got) <= blocks,
+				"%d blocks %d frames" % (blocks, len(got)))
+		self.check("no sequence gaps and nothing lost on the device",
+				gaps == 0 and (not got or got[-1][2] == 0),
+				"%d blocks missing, lost %d" % (gaps, got[-1][2] if got else 0))
+		self.check("every sample of the ramp in place", bad_samples == 0,
+				"%d wrong samples" % bad_samples)
+		self.check("period in the header and block timestamps",
+				all(f[5] == period for f in got) and bad_time == 0,
+				"%d blocks with the wrong timestamp" % bad_time)
+		self.check("EasyDMA never writes a block waiting to be sent",
+				stream.collisions == 0, "%d blocks overwritten" % stream.collisions)
+
+	def run_slow(self, lib, rate):
+		# Half the rate of the stream
+		sink = rate * 2 / 2.0
+		stream = Stream(lib, rate, sink)
+		got = stream.run(args.seconds)
+		gaps, bad_samples, bad_time, lost_match = self.analyse(stream, got)
+		print("%d kS/s to a %.0f kB/s sink: %d frames, %d blocks lost" %
+				(rate // 1000, sink / 1000, len(got), gaps))
+		self.check("blocks are lost with a slow sink", gaps > 0)
+		self.check("lost count in the frames matches the gaps", lost_match,
+				"%d gaps lost %d" % (gaps, got[-1][2] if got else 0))
+		self.check("frames after losses keep their samples", bad_samples == 0,
+				"%d wrong samples" % bad_samples)
+		self.check("EasyDMA never writes a block waiting to be sent",
+				stream.collisions == 0, "%d blocks overwritten" % stream.collisions)
+
+tmp = tempfile.mkdtemp()
+try:
+	map_peripherals()
+	suite = Suite()
+	for rate in RATES:
+		lib = build(tmp, rate)
+		suite.run_rate(lib, rate)
+		if rate == RATES[-1]:
+			suite.run_slow(lib, rate)
+	print("%d failed" % suite.fails)
+finally:
+	shutil.rmtree(tmp)
+sys.exit(1 if suite.fails else 0)
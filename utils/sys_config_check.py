@@ -0,0 +1,299 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Checks the hardware resources allocated to the modules of applications
+# for collisions. Two modules are reported if they are given the same RTC,
+# TIMER, PPI channel, GPIOTE channel, CC register of a TIMER, EGU trigger,
+# SAADC channel, SWI or ms_timer instance. A define whose value is the name
+# of another define, such as
+#   #define PPI_CHANNEL_USED_PIR_SENSE_2 PPI_CHANNEL_USED_AUX_CLK_0
+# is an intended sharing and isn't reported.
+#
+# The resources are taken from the application's sys_config.h and, for the
+# sources in C_SRC of its Makefile, from the #ifndef defaults of the modules
+# which sys_config.h doesn't override and from the channels, TIMERs and RTCs
+# the sources use with a literal number, such as NRF_PPI->CH[0] or NRF_RTC0.
+# The -D flags of the Makefile are taken as defines for this.
+# Without a Makefile next to it, only the sys_config.h is checked. Usage:
+#   sys_config_check.py <sys_config.h or application dir> [...]
+# The exit status is 1 if any collision is found. It is run by the 'check'
+# target of application/Makefile.common.
+
+from __future__ import print_function
+import os,re,sys
+
+DEFINE = re.compile(r'^\s*#define\s+(\w+)(?:[ \t]+(.*?))?\s*(?://.*|/\*.*)?$')
+DIRECTIVE = re.compile(r'^\s*#\s*(ifdef|ifndef|if|elif|else|endif|define)\b(.*)$')
+
+# (kind, regex of the define name) for the resources used by one module each
+SINGLE = [
+	('RTC', re.compile(r'^RTC_USED_(\w+)$|^(\w+)_RTC_USED$')),
+	('TIMER', re.compile(r'^TIMER_USED_(\w+)$|^(?!\w*MS_TIMER)(\w+)_TIMER_USED$')),
+	('PPI channel', re.compile(r'^PPI_(?:CH|CHANNEL)_USED_(\w+)$')),
+	('GPIOTE channel', re.compile(r'^GPIOTE_CH_USED_(\w+)$')),
+	('SAADC channel', re.compile(r'^SAADC_CHANNEL_USED_(\w+)$')),
+	('SWI', re.compile(r'^SWI_USED_(\w+)$|^SWI_(\w+)_USED$')),
+	('ms_timer', re.compile(r'^MS_TIMER_USED_(\w+)$')),
+]
+
+# (kind, count define, base define) for the ranges of channels from a base
+RANGES = [
+	('PPI channel', 'PPI_CHANNELS_USED_', 'PPI_CHANNEL_BASE_', 'PPI_CHANNEL_USED_'),
+	('GPIOTE channel', 'GPIOTE_CHS_USED_', 'GPIOTE_CH_BASE_', 'GPIOTE_CH_USED_'),
+]
+
+# (kind, regex) of the resources used with a literal number in the sources
+LITERAL = [
+	('PPI channel', re.compile(r'\bNRF_PPI->(?:CH|FORK)\[\s*(\d+|PPI_CHEN_CH\d+_Pos)\s*\]')),
+	('GPIOTE channel', re.compile(r'\bNRF_GPIOTE->\w+\[\s*(\d+)\s*\]')),
+	('TIMER', re.compile(r'\bNRF_TIMER(\d)\s*->')),
+	('RTC', re.compile(r'\bNRF_RTC(\d)\s*->')),
+]
+
+# Sources whose literal uses aren't an allocation
+LITERAL_EXEMPT = {
+	# Clears the STOP task of every RTC at start up
+	'hal_clocks.c',
+}
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+def parse(path):
+	defines = {}
+	for line in open(path):
+		m = DEFINE.match(line)
+		if m:
+			defines[m.group(1)] = (m.group(2) or '').strip()
+	return defines
+
+def evaluate(defines, name, depth=0):
+	"""Evaluates the integer value of a define, None if it isn't one"""
+	expr = defines.get(name, '')
+	if depth > 10 or expr == '':
+		return None
+	expr = re.sub(r'\b([A-Za-z_]\w*)\b',
+		lambda m: str(evaluate(defines, m.group(1), depth + 1)), expr)
+	if 'None' in expr or not re.match(r'^[\d\s()+\-*/x<>a-fA-FuUlL]*$', expr):
+		return None
+	try:
+		return int(eval(re.sub(r'(\d)[uUlL]+', r'\1', expr).replace('/', '//')))
+	except Exception:
+		return None
+
+def condition(defines, expr):
+	"""Evaluates the condition of an #if, false if it can't be"""
+	expr = re.sub(r'\bdefined\s*\(?\s*(\w+)\s*\)?',
+		lambda m: '1' if m.group(1) in defines else '0', expr)
+	expr = re.sub(r'\b([A-Za-z_]\w*)\b',
+		lambda m: str(evaluate(defines, m.group(1))), expr)
+	if 'None' in expr or not re.match(r'^[\d\s()+\-*/<>=!&|xa-fA-F]*$', expr):
+		return False
+	expr = expr.replace('&&', ' and ').replace('||', ' or ')
+	expr = re.sub(r'!(?!=)', ' not ', expr).replace('/', '//')
+	try:
+		return bool(eval(expr))
+	except Exception:
+		return False
+
+def read_code(path):
+	"""The text of a source without comments, with continued lines joined"""
+	text = open(path).read().replace('\\\n', ' ')
+	text = re.sub(r'/\*.*?\*/', lambda m: '\n' * m.group(0).count('\n'), text, flags=re.S)
+	return re.sub(r'//[^\n]*', '', text)
+
+def add_defaults(path, defines, origin):
+	"""Adds the defines of a source which are active with the defines known
+	so far and not already defined"""
+	stack = []
+	active = True
+	for line in read_code(path).split('\n'):
+		m = DIRECTIVE.match(line)
+		if not m:
+			continue
+		directive, rest = m.group(1), m.group(2).strip()
+		if directive in ('if', 'ifdef', 'ifndef'):
+			if directive == 'if':
+				cond = condition(defines, rest)
+			else:
+				cond = (rest.split() or [''])[0] in defines
+				cond = cond if directive == 'ifdef' else not cond
+			stack.append((active, cond))
+			active = active and cond
+		elif directive == 'elif' and stack:
+			parent, taken = stack[-1]
+			cond = not taken and condition(defines, rest)
+			stack[-1] = (parent, taken or cond)
+			active = parent and cond
+		elif directive == 'else' and stack:
+			parent, taken = stack[-1]
+			stack[-1] = (parent, True)
+			active = parent and not taken
+		elif directive == 'endif' and stack:
+			active = stack.pop()[0]
+		elif directive == 'define' and active:
+			d = DEFINE.match(line)
+			if d and d.group(1) not in defines:
+				defines[d.group(1)] = (d.group(2) or '').strip()
+				origin[d.group(1)] = os.path.basename(path)
+
+def makefile_defines(app_dir, defines):
+	"""Adds the -D flags given in the Makefile of an application, with the
+	make variables in them expanded"""
+	makefile = os.path.join(app_dir, 'Makefile')
+	if not os.path.isfile(makefile):
+		return
+	variables = {}
+	for line in open(makefile):
+		line = line.split('#')[0]
+		m = re.match(r'^\s*(\w+)\s*:?=\s*(.*?)\s*$', line)
+		if m:
+			variables[m.group(1)] = m.group(2)
+		line = re.sub(r'\$\((\w+)\)', lambda v: variables.get(v.group(1), ''), line)
+		for d in re.finditer(r'(?<!\S)-D(\w+)(?:=(\S+))?', line):
+			if d.group(1) not in defines:
+				defines[d.group(1)] = d.group(2) or '1'
+
+def sources(app_dir):
+	"""The sources in C_SRC of the Makefile of an application with their
+	headers, those of the application first"""
+	makefile = os.path.join(app_dir, 'Makefile')
+	if not os.path.isfile(makefile):
+		return []
+	names = []
+	for line in open(makefile):
+		m = re.match(r'^\s*C_SRC\s*[+:]?=(.*)$', line)
+		if m:
+			names += [n for n in m.group(1).split() if n.endswith('.c') and n not in names]
+	found = {}
+	for top in (os.path.join(ROOT, 'codebase'), app_dir):
+		for dirpath, _, files in os.walk(top):
+			for f in files:
+				found[f] = os.path.join(dirpath, f)
+	app = [n for n in names if found.get(n, '').startswith(os.path.abspath(app_dir))]
+	paths = []
+	for n in app + [n for n in names if n not in app]:
+		for f in (n[:-2] + '.h', n):
+			if f in found and found[f] not in paths:
+				paths.append(found[f])
+	return paths
+
+def is_alias(defines, name):
+	"""True if the define's value is just the name of another define"""
+	return defines.get(name, '').strip('() ') in defines
+
+def resources(defines, origin={}):
+	"""Gives a list of (kind, index, owner) of all the resources"""
+	label = lambda name: name + (' (default in %s)' % origin[name] if name in origin else '')
+	used = []
+	for name in sorted(defines):
+		if is_alias(defines, name):
+			continue
+		for kind, regex in SINGLE:
+			if regex.match(name):
+				val = evaluate(defines, name)
+				if val is not None:
+					used.append((kind, val, label(name)))
+
+		# A range of channels from the base
+		for kind, count_def, base_def, single_def in RANGES:
+			if name.startswith(count_def) and base_def + name[len(count_def):] in defines:
+				mod = name[len(count_def):]
+				base = evaluate(defines, base_def + mod)
+				count = evaluate(defines, name)
+				if base is not None and count is not None:
+					used += [(kind, base + i, label(base_def + mod) + ' + %d' % i)
+						for i in range(count) if '%s%s_%d' % (single_def, mod, i) not in defines]
+
+		# The CC register of the timer of the module with the longest name
+		# which is a prefix of the channel's name
+		m = re.match(r'^TIMER_CHANNEL_USED_(\w+)$', name)
+		if m:
+			owners = [t for t in defines if t.startswith('TIMER_USED_') and
+				m.group(1).startswith(t[len('TIMER_USED_'):])]
+			if owners:
+				timer = evaluate(defines, max(owners, key=len))
+				cc = evaluate(defines, name)
+				if timer is not None and cc is not None:
+					used.append(('TIMER%d CC' % timer, cc, label(name)))
+
+		m = re.match(r'^EGU_CHANNEL_USED_(\w+)$', name)
+		if m and 'EGU_USED_' + m.group(1) in defines:
+			egu = evaluate(defines, 'EGU_USED_' + m.group(1))
+			trig = evaluate(defines, name)
+			if egu is not None and trig is not None:
+				used.append(('EGU%d trigger' % egu, trig, label(name)))
+	return used
+
+def literals(paths):
+	"""Gives a list of (kind, index, owner) of the resources used with a
+	literal number, once per source"""
+	used = []
+	for path in paths:
+		if os.path.basename(path) in LITERAL_EXEMPT or not path.endswith('.c'):
+			continue
+		code = read_code(path)
+		for kind, regex in LITERAL:
+			for m in regex.finditer(code):
+				idx = int(re.sub(r'\D', '', m.group(1)))
+				owner = '%s in %s' % (m.group(0).rstrip('->').strip(), os.path.basename(path))
+				owner = re.sub(r'\[\s*\w+\s*\]', '[%d]' % idx, owner)
+				if not any(k == kind and i == idx and o.endswith(os.path.basename(path))
+						for k, i, o in used):
+					used.append((kind, idx, owner))
+	return used
+
+def check(arg):
+	if os.path.isdir(arg):
+		app_dir, config = arg, os.path.join(arg, 'sys_config.h')
+	else:
+		app_dir, config = os.path.dirname(arg) or '.', arg
+	defines = parse(config) if os.path.isfile(config) else {}
+	origin = {}
+	makefile_defines(app_dir, defines)
+	paths = sources(app_dir)
+	for path in paths:
+		add_defaults(path, defines, origin)
+	collisions = 0
+	owner = {}
+	for kind, idx, name in resources(defines, origin) + literals(paths):
+		key = (kind, idx)
+		if key in owner:
+			print("%s: %s %d used by both %s and %s" %
+				(arg, kind, idx, owner[key], name))
+			collisions += 1
+		else:
+			owner[key] = name
+	return collisions
+
+if len(sys.argv) < 2:
+	print("Usage: %s <sys_config.h or application dir> [...]" % sys.argv[0])
+	sys.exit(0)
+
+total = sum(check(path) for path in sys.argv[1:])
+sys.exit(1 if total else 0)
@@ -0,0 +1,427 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 Appiko
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+# OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Reset simulation of the warm boot snapshot (codebase/util/warm_boot.c),
+# built for the host with the snapshot of sense_pir. The application is
+# modelled as sense_pir uses the module: the sensing ticks update the time,
+# the date and the trigger counts, the state changes update the mode, a new
+# configuration is copied in, app_error records faults and the long press
+# invalidates the snapshot. All of them are followed by a commit, except the
+# fault and the invalidation.
+#
+# The resets come at random points, with a random reason. A reset in the
+# middle of an update leaves any mix of the old and the new words of the
+# retained RAM, which covers any order of the stores. A power on leaves
+# random words. A reset can also come in the middle of the commit of the
+# boot.
+#
+# Checked:
+# - A warm boot resumes exactly a state which was committed, or the one
+#   being committed at the reset, with the warm count one more than it.
+# - A cold boot clears the state, and is taken after a pin reset, a wake
+#   from System OFF, a power on and after WARM_BOOT_MAX_WARM warm boots in
+#   a row without a stable mark.
+# - The fault given after the reset is the one recorded or the watchdog
+#   when the reset reason is the watchdog, never a mix of two.
+# - A watchdog reset resumes warm with the watchdog fault without any
+#   handler, unless it came during an update.
+#
+# The boot-to-sensing time saved on a warm boot of sense_pir is printed.
+#
+# Needs Linux and a host C compiler, run from the root of the repository.
+# Usage:
+#   warm_boot_sim.py [--resets 5000] [--seed 38] [-v]
+
+from __future__ import print_function
+import argparse
+import ctypes
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description="warm_boot reset simulation")
+parser.add_argument("--resets", type=int, default=5000, help="resets to simulate")
+parser.add_argument("--seed", type=int, default=38, help="seed of the random resets")
+parser.add_argument("-v", "--verbose", action="store_true", help="print the failures in detail")
+args = parser.parse_args()
+
+INC = ["codebase/nrf_core", "codebase/cmsis/include", "codebase/hal", "codebase/util",
+		"codebase/peripheral_modules"]
+
+# The snapshot of sense_pir, from its sys_config.h
+APP_DATA_WORDS = 52
+COUNTERS = 4
+MAX_WARM = 3
+
+POWER_BASE = 0x40000000
+RESETREAS = POWER_BASE + 0x400
+PAGE = 0x1000
+
+# POWER_RESETREAS
+RESETPIN = 1 << 0
+DOG = 1 << 1
+SREQ = 1 << 2
+LOCKUP = 1 << 3
+OFF = 1 << 16
+DIF = 1 << 18
+POWER_ON = 0
+
+# warm_boot_fault_t
+FAULT_NONE = 0
+FAULT_WDT = 1
+FAULT_APP_ERROR = 2
+FAULT_SD = 3
+
+# Words of warm_boot_state_t
+W_REASON = 0
+W_FAULT = 1
+W_WARM_COUNT = 4
+W_TIME = 5
+W_DATE = 6
+W_MODE = 7
+W_COUNTERS = 8
+W_APP_DATA = W_COUNTERS + COUNTERS
+STATE_WORDS = W_APP_DATA + APP_DATA_WORDS
+
+# sense_pir's boot, in ms
+LED_BLINK_MS = 1200
+
+CFLAGS = ["-DWARM_BOOT_APP_DATA_WORDS=%d" % APP_DATA_WORDS,
+		"-DWARM_BOOT_COUNTERS=%d" % COUNTERS, "-DWARM_BOOT_MAX_WARM=%d" % MAX_WARM]
+
+# warm_boot.c with the retained struct reachable from the test
+WRAP = r"""
+#include "warm_boot.c"
+void * host_retained (void) { return &retained; }
+uint32_t host_retained_words (void) { return sizeof(retained)/sizeof(uint32_t); }
+"""
+
+STUB = r"""
+#include <stdint.h>
+
+uint32_t host_assert;
+
+void assert_nrf_callback (uint16_t line_num, const uint8_t * file_name)
+{
+    host_assert++;
+}
+
+void nrf_util_critical_region_enter (uint8_t * is_critical_entered)
+{
+    *is_critical_entered = 1;
+}
+
+void nrf_util_critical_region_exit (uint8_t is_critical_entered)
+{
+}
+"""
+
+def reg(addr):
+	return ctypes.c_uint32.from_address(addr)
+
+def map_pages():
+	libc = ctypes.CDLL(None, use_errno=True)
+	libc.mmap.restype = ctypes.c_void_p
+	libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+			ctypes.c_int, ctypes.c_long]
+	# PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE
+	if libc.mmap(POWER_BASE, PAGE, 3, 0x22 | 0x100000, -1, 0) != POWER_BASE:
+		sys.exit("Can't map the page at 0x%08X for the nRF52 registers" % POWER_BASE)
+
+class Device(object):
+	"""The retained RAM of a build of warm_boot and the model of what it holds"""
+	def __init__(self, lib, rnd):
+		self.lib = lib
+		self.rnd = rnd
+		lib.host_retained.restype = ctypes.c_void_p
+		lib.warm_boot_state.restype = ctypes.c_void_p
+		lib.warm_boot_init.restype = ctypes.c_bool
+		self.words = lib.host_retained_words()
+		self.ram = (ctypes.c_uint32 * self.words).from_address(lib.host_retained())
+		self.state = (ctypes.c_uint32 * STATE_WORDS).from_address(lib.warm_boot_state())
+		# The states which a warm boot can resume and the faults which can be
+		# given after the reset, None for no fault recorded
+		self.resumable = []
+		self.pending = [None]
+		self.invalid = [False]
+		self.power_on()
+
+	def ram_words(self):
+		return list(self.ram)
+
+	def set_ram(self, words):
+		for i, w in enumerate(words):
+			self.ram[i] = w
+
+	def power_on(self):
+		self.set_ram([self.rnd.getrandbits(32) for _ in range(self.words)])
+		self.resumable = []
+		self.pending = [None]
+		self.invalid = [True]
+
+	def update(self, op, torn):
+		"""Run an update, torn by a reset at a random point if asked"""
+		before = self.ram_words()
+		op()
+		if not torn:
+			return
+		after = self.ram_words()
+		self.set_ram([self.rnd.choice((b, a)) for b, a in zip(before, after)])
+
+	def committed(self):
+		return list(self.state)
+
+	def tick(self, torn):
+		"""A sensing tick of sense_pir, as retain_sensing"""
+		st = self.state
+		def op():
+			st[W_TIME] = (st[W_TIME] + self.rnd.randint(1, 300)) % 86400
+			st[W_DATE] = (19 << 16) | (self.rnd.randint(1, 12) << 8) | self.rnd.randint(1, 28)
+			st[W_COUNTERS] += self.rnd.randint(0, 3)
+			st[W_COUNTERS + 1] += self.rnd.randint(0, 1)
+			self.lib.warm_boot_commit()
+		self.commit(op, torn)
+
+	def mark_stable(self, torn):
+		self.commit(self.lib.warm_boot_mark_stable, torn)
+
+	def state_change(self, torn):
+		def op():
+			self.state[W_MODE] = self.rnd.randint(0, 2)
+			self.lib.warm_boot_commit()
+		self.commit(op, torn)
+
+	def config(self, torn):
+		def op():
+			for i in range(APP_DATA_WORDS):
+				self.state[W_APP_DATA + i] = self.rnd.getrandbits(32)
+			self.lib.warm_boot_commit()
+		self.commit(op, torn)
+
+	def commit(self, op, torn):
+		old = self.resumable
+		self.update(op, torn)
+		if torn:
+			self.resumable = old + [self.committed()]
+		else:
+			self.resumable = [self.committed()]
+
+	def fault(self, torn):
+		fault = (self.rnd.choice((FAULT_APP_ERROR, FAULT_SD)), self.rnd.getrandbits(32),
+				self.rnd.getrandbits(32) & ~1)
+		self.update(lambda: self.lib.warm_boot_fault(*fault), torn)
+		# A torn fault over another one leaves neither
+		self.pending = (self.pending + [fault, None]) if torn else [fault]
+
+	def invalidate(self, torn):
+		self.update(self.lib.warm_boot_invalidate, torn)
+		self.invalid = (self.invalid + [True]) if torn else [True]
+
+	def boot(self, reason, torn_init):
+		"""Boot after a reset, returns if warm, the state and the failures"""
+		reg(RESETREAS).value = reason
+		resumable, pending, invalid = self.resumable, self.pending, self.invalid
+		before = self.ram_words()
+		warm = self.lib.warm_boot_init()
+		st = list(self.state)
+		fails = []
+
+		warm_reason = (reason & (DOG | LOCKUP | SREQ)) and not (reason & (RESETPIN | OFF | DIF))
+		can_warm = [s for s in resumable if s[W_WARM_COUNT] < MAX_WARM]
+		if warm:
+			if not warm_reason or invalid == [True]:
+				fails.append("warm after reset 0x%x" % reason)
+			match = [s for s in resumable if s[W_WARM_COUNT:] ==
+					[st[W_WARM_COUNT] - 1] + st[W_WARM_COUNT + 1:]]
+			if not match:
+				fails.append("warm boot resumed a state never committed")
+		else:
+			if any(st[W_WARM_COUNT:]):
+				fails.append("cold boot didn't clear the state")
+			if (warm_reason and can_warm and len(resumable) == 1 and invalid == [False]):
+				fails.append("cold after reset 0x%x with an intact snapshot" % reason)
+
+		given = tuple(st[W_FAULT:W_FAULT + 3])
+		allowed = set()
+		for p in pending:
+			if p is not None:
+				allowed.add(p)
+			elif reason & DOG:
+				allowed.add((FAULT_WDT, 0, 0))
+			else:
+				allowed.add((FAULT_NONE, 0, 0))
+		if given not in allowed:
+			fails.append("fault %s given, expected one of %s" % (given, sorted(allowed)))
+		if st[W_REASON] != reason:
+			fails.append("reset reason not kept")
+
+		self.resumable = [self.committed()]
+		self.pending = [None]
+		self.invalid = [False]
+		if torn_init:
+			# Reset again in the middle of the commit of the boot
+			after = self.ram_words()
+			self.set_ram([self.rnd.choice((b, a)) for b, a in zip(before, after)])
+			self.resumable = resumable + self.resumable
+			self.pending = pending + self.pending
+			self.invalid = invalid + self.invalid
+		return warm, st, fails
+
+class Suite(object):
+	def __init__(self):
+		self.fails = 0
+
+	def check(self, name, ok, detail=""):
+		print("  %s %s" % ("PASS" if ok else "FAIL", name))
+		if not ok:
+			self.fails += 1
+			if args.verbose and detail:
+				print("      " + detail)
+
+	def test_random(self, dev, rnd):
+		"""Resets at random points of the updates of sense_pir"""
+		reasons = ((DOG, 30), (LOCKUP, 10), (SREQ, 15), (RESETPIN, 10), (OFF, 5),
+				(DIF, 2), (DOG | RESETPIN, 3), (POWER_ON, 5))
+		ops = ((dev.tick, 60), (dev.mark_stable, 10), (dev.state_change, 10),
+				(dev.config, 5), (dev.fault, 5), (dev.invalidate, 1))
+		def pick(choices):
+			return rnd.choice([c for c, n in choices for _ in range(n)])
+
+		fails = []
+		boots = {True: 0, False: 0}
+		dog_calm = [0, 0]
+		torn_outcome = [0, 0]
+		dev.boot(POWER_ON, False)
+		for n in range(args.resets):
+			for _ in range(rnd.randint(0, 20)):
+				pick(ops)(False)
+			torn = rnd.random() < 0.3
+			if torn:
+				pick(ops)(True)
+			reason = pick(reasons)
+			if reason == POWER_ON:
+				dev.power_on()
+			calm = (not torn and reason == DOG and len(dev.resumable) == 1
+					and dev.invalid == [False]
+					and dev.resumable[0][W_WARM_COUNT] < MAX_WARM)
+			warm, st, f = dev.boot(reason, rnd.random() < 0.05)
+			boots[warm] += 1
+			if calm:
+				dog_calm[0] += 1
+				dog_calm[1] += warm and st[W_FAULT] in (FAULT_WDT, FAULT_APP_ERROR, FAULT_SD)
+			if torn:
+				torn_outcome[0 if warm else 1] += 1
+			fails += ["reset %d: %s" % (n, x) for x in f]
+			# Resumed, so mark stable after a while as sense_pir does
+			if rnd.random() < 0.7:
+				dev.mark_stable(False)
+
+		self.check("every boot resumed a committed state or fell back to cold",
+				not fails, "; ".join(fails[:5]))
+		self.check("watchdog resets outside an update resume warm with the fault",
+				dog_calm[0] > 0 and dog_calm[0] == dog_calm[1],
+				"%d of %d" % (dog_calm[1], dog_calm[0]))
+		print("    %d boots, %d warm and %d cold, %d torn updates resumed and %d cold" %
+				(args.resets, boots[True], boots[False], torn_outcome[0], torn_outcome[1]))
+
+	def test_loop(self, dev):
+		"""A fault on resume ends in a cold boot"""
+		dev.power_on()
+		dev.boot(POWER_ON, False)
+		dev.tick(False)
+		warm = [dev.boot(LOCKUP, False)[0] for _ in range(MAX_WARM + 1)]
+		self.check("cold boot after %d warm boots without a stable mark" % MAX_WARM,
+				warm == [True] * MAX_WARM + [False], str(warm))
+
+	def test_wdt(self, dev):
+		"""The watchdog identified from the reset reason alone"""
+		dev.power_on()
+		dev.boot(POWER_ON, False)
+		dev.state_change(False)
+		dev.tick(False)
+		time_s, counts = dev.state[W_TIME], dev.state[W_COUNTERS]
+		warm, st, f = dev.boot(DOG, False)
+		self.check("watchdog reset resumes time, counters and mode without a handler",
+				warm and not f and st[W_FAULT] == FAULT_WDT and st[W_TIME] == time_s
+				and st[W_COUNTERS] == counts, "; ".join(f))
+
+		# The fault was recorded with the bite pending
+		dev.fault(False)
+		fault = dev.pending[0]
+		warm, st, f = dev.boot(DOG, False)
+		self.check("recorded fault kept over the watchdog reason",
+				warm and tuple(st[W_FAULT:W_FAULT + 3]) == fault, "; ".join(f))
+
+	def report(self):
+		"""The boot-to-sensing time of sense_pir saved on a warm boot"""
+		size = 4 * STATE_WORDS
+		# Two nibble lookups of a few cycles per byte at 64 MHz
+		crc_us = size * 2 * 6 / 64.0
+		print("    warm boot of sense_pir: the %d ms start-up LED blink and the two tail"
+				" fetches of the config log are skipped" % LED_BLINK_MS)
+		print("    warm_boot_init adds a CRC over %d bytes, about %.0f us, and each"
+				" sensing tick one commit of the same" % (size, crc_us))
+		print("    boot-to-sensing reduced by about %d ms" % LED_BLINK_MS)
+
+def build(tmp):
+	cc = os.environ.get("CC", "cc")
+	for name, text in (("harness.c", WRAP), ("stub.c", STUB)):
+		with open(os.path.join(tmp, name), "w") as f:
+			f.write(text)
+	so = os.path.join(tmp, "warm_boot.so")
+	subprocess.check_call([cc, "-shared", "-fPIC", "-std=gnu11", "-O2", "-w", "-U__linux__",
+			"-U__linux", "-Ulinux", "-U__unix", "-U__unix__", "-Uunix", "-DNRF52832",
+			"-DNRF52832_XXAA", "-DBOARD_SENSEPI_REV3", "-iquote", tmp] + CFLAGS +
+			["-I" + i for i in INC] + ["-o", so, os.path.join(tmp, "harness.c"),
+			os.path.join(tmp, "stub.c")])
+	return ctypes.CDLL(so)
+
+def main():
+	map_pages()
+	tmp = tempfile.mkdtemp()
+	try:
+		lib = build(tmp)
+		rnd = random.Random(args.seed)
+		dev = Device(lib, rnd)
+		suite = Suite()
+		suite.test_random(dev, rnd)
+		suite.test_loop(dev)
+		suite.test_wdt(dev)
+		suite.report()
+		suite.check("no asserts", ctypes.c_uint32.in_dll(lib, "host_assert").value == 0)
+		print("%d failed" % suite.fails)
+		sys.exit(1 if suite.fails else 0)
+	finally:
+		shutil.rmtree(tmp)
+
+if __name__ == "__main__":
+	main()